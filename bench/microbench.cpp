@@ -0,0 +1,249 @@
+/* dwarfpp: C++ binding for a useful subset of libdwarf, plus extra goodies.
+ *
+ * microbench.cpp: repeatable microbenchmarks of the core APIs
+ *
+ * Copyright (c) 2008--17, Stephen Kell. For licensing information, see the
+ * LICENSE file in the root of the libdwarfpp tree.
+ */
+
+#include <fstream>
+#include <iostream>
+#include <chrono>
+#include <atomic>
+#include <vector>
+#include <string>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <unistd.h>
+#include <fileno.hpp>
+#include <dwarfpp/lib.hpp>
+#include <dwarfpp/attr.hpp>
+#include <dwarfpp/frame.hpp>
+#include <dwarfpp/expr.hpp>
+
+using std::cout;
+using std::cerr;
+using std::endl;
+using std::vector;
+using std::string;
+using namespace dwarf;
+using core::iterator_df;
+using core::iterator_bf;
+using core::iterator_base;
+using core::type_die;
+using dwarf::spec::opt;
+
+/* Count allocations by replacing the global operator new. This sees only
+ * what C++ allocates; libdwarf's own mallocs go uncounted. */
+static std::atomic<unsigned long> n_allocs(0);
+void *operator new(size_t sz)
+{
+	++n_allocs;
+	void *p = malloc(sz ? sz : 1);
+	if (!p) throw std::bad_alloc();
+	return p;
+}
+void *operator new[](size_t sz) { return operator new(sz); }
+void operator delete(void *p) noexcept { free(p); }
+void operator delete[](void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+void operator delete[](void *p, size_t) noexcept { free(p); }
+
+static unsigned repeats = 5;
+static const char *corpus_name;
+static volatile unsigned long sink; // stop the compiler discarding results
+
+/* Run f (which returns how many ops it did) "repeats" times, and report
+ * the best run. One JSON object per line, for easy diffing and plotting. */
+template <typename F>
+static void bench(const char *name, F f)
+{
+	double best_ns_per_op = -1;
+	double allocs_per_op = 0;
+	unsigned long ops = 0;
+	for (unsigned rep = 0; rep < repeats; ++rep)
+	{
+		unsigned long allocs_before = n_allocs;
+		auto t0 = std::chrono::steady_clock::now();
+		ops = f();
+		auto t1 = std::chrono::steady_clock::now();
+		unsigned long allocs = n_allocs - allocs_before;
+		if (ops == 0) break;
+		double ns = std::chrono::duration<double, std::nano>(t1 - t0).count();
+		if (best_ns_per_op < 0 || ns / ops < best_ns_per_op)
+		{
+			best_ns_per_op = ns / ops;
+			allocs_per_op = (double) allocs / ops;
+		}
+	}
+	cout << "{\"corpus\": \"" << corpus_name << "\", \"bench\": \"" << name
+		<< "\", \"ops\": " << ops << ", \"ns_per_op\": " << (ops ? best_ns_per_op : 0)
+		<< ", \"allocs_per_op\": " << allocs_per_op << "}" << endl;
+}
+
+int main(int argc, char **argv)
+{
+	if (argc < 2)
+	{
+		cerr << "Usage: " << argv[0] << " <file-with-debug-info> [repeats]" << endl;
+		return 1;
+	}
+	corpus_name = argv[1];
+	if (argc > 2) repeats = std::max(1, atoi(argv[2]));
+	std::ifstream in(argv[1]);
+	if (!in) { cerr << "Could not open " << argv[1] << endl; return 1; }
+	core::root_die root(fileno(in));
+
+	/* Collect our inputs once, up front. */
+	vector<Dwarf_Off> offsets; // every 16th DIE
+	vector<string> names; // of the CUs' named children
+	vector<iterator_df<type_die> > types;
+	unsigned long n = 0;
+	for (iterator_df<> i = root.begin(); i != root.end(); ++i, ++n)
+	{
+		if (n % 16 == 0) offsets.push_back(i.offset_here());
+		if (i.depth() == 2 && i.name_here() && names.size() < 4096) names.push_back(*i.name_here());
+		if (i.is_a<type_die>() && types.size() < 65536) types.push_back(i.as_a<type_die>());
+	}
+
+	bench("iterator_df", [&root]() {
+		unsigned long n = 0;
+		for (iterator_df<> i = root.begin(); i != root.end(); ++i) ++n;
+		return n;
+	});
+	bench("iterator_bf", [&root]() {
+		unsigned long n = 0;
+		for (iterator_bf<> i = root.begin(); i != root.end(); ++i) ++n;
+		return n;
+	});
+	bench("iterator_sibs", [&root]() {
+		unsigned long n = 0;
+		auto cus = root.begin().children_here();
+		for (auto i_cu = std::move(cus.first); i_cu != cus.second; ++i_cu)
+		{
+			auto children = i_cu.children_here();
+			for (auto i = std::move(children.first); i != children.second; ++i) ++n;
+		}
+		return n;
+	});
+	bench("stream", [&root]() {
+		unsigned long n = 0;
+		root.stream([&n](const core::Die& d, unsigned short depth) { ++n; return true; });
+		return n;
+	});
+	bench("pos", [&root, &offsets]() {
+		for (auto i_off = offsets.begin(); i_off != offsets.end(); ++i_off)
+		{
+			sink += root.pos(*i_off).offset_here();
+		}
+		return (unsigned long) offsets.size();
+	});
+	bench("find", [&root, &offsets]() {
+		for (auto i_off = offsets.begin(); i_off != offsets.end(); ++i_off)
+		{
+			sink += root.find(*i_off).offset_here();
+		}
+		return (unsigned long) offsets.size();
+	});
+	bench("find_attr", [&root, &offsets]() {
+		for (auto i_off = offsets.begin(); i_off != offsets.end(); ++i_off)
+		{
+			sink += root.pos(*i_off)->find_attr(DW_AT_name).get_form();
+		}
+		return (unsigned long) offsets.size();
+	});
+	bench("resolve", [&root, &names]() {
+		for (auto i_name = names.begin(); i_name != names.end(); ++i_name)
+		{
+			sink += (bool) root.resolve(root.begin(), *i_name);
+		}
+		return (unsigned long) names.size();
+	});
+	bench("summary_code", [&types]() {
+		for (auto i_t = types.begin(); i_t != types.end(); ++i_t)
+		{
+			auto code = (*i_t)->summary_code();
+			sink += code ? *code : 0;
+		}
+		return (unsigned long) types.size();
+	});
+	bench("get_scc", [&types]() {
+		for (auto i_t = types.begin(); i_t != types.end(); ++i_t)
+		{
+			sink += (bool) (*i_t)->get_scc();
+		}
+		return (unsigned long) types.size();
+	});
+	bench("Fde::decode", [&root]() {
+		unsigned long n = 0;
+		auto& fs = root.get_frame_section();
+		for (auto i_fde = fs.fde_begin(); i_fde != fs.fde_end(); ++i_fde, ++n)
+		{
+			sink += i_fde->decode().rows.size();
+		}
+		return n;
+	});
+
+	/* Expressions don't depend on the corpus; we just want one shape of
+	 * each kind, many times over. */
+	const unsigned long N_EXPRS = 1000000;
+	Dwarf_Unsigned fbreg_ops[] = { DW_OP_fbreg, (Dwarf_Unsigned) -24 };
+	Dwarf_Unsigned general_ops[] = { DW_OP_breg7, 8, DW_OP_lit3, DW_OP_plus, DW_OP_plus_uconst, 16 };
+	encap::loc_expr fbreg_expr(fbreg_ops, 0, 0);
+	encap::loc_expr general_expr(general_ops, 0, 0);
+	struct fake_regs : public expr::regs
+	{
+		Dwarf_Signed get(int regnum) { return 0x7ffe0000 + regnum; }
+	} regs;
+	bench("evaluator/construct", [&]() {
+		for (unsigned long i = 0; i < N_EXPRS; ++i)
+		{
+			sink += expr::evaluator(general_expr, spec::DEFAULT_DWARF_SPEC, regs, 0x1000).tos();
+		}
+		return N_EXPRS;
+	});
+	bench("evaluator/reuse", [&]() {
+		expr::evaluator ev;
+		for (unsigned long i = 0; i < N_EXPRS; ++i)
+		{
+			ev.reset(&regs, opt<Dwarf_Signed>(0x1000));
+			ev.run(general_expr);
+			sink += ev.tos();
+		}
+		return N_EXPRS;
+	});
+	bench("compiled_expr/fbreg", [&]() {
+		expr::compiled_expr c(fbreg_expr);
+		for (unsigned long i = 0; i < N_EXPRS; ++i)
+		{
+			sink += c.eval(&regs, opt<Dwarf_Signed>(0x1000 + i));
+		}
+		return N_EXPRS;
+	});
+
+	/* Nor do snapshots: a CU of named, sized base types, loaded into a
+	 * fresh root each time. Per DIE, this is what load_snapshot() costs to
+	 * make each one; attributes stay in the mapping (see the note in
+	 * root.hpp). */
+	const unsigned N_SNAPSHOT_DIES = 65536;
+	string snapshot_filename = string(argv[0]) + ".snapshot";
+	{
+		core::in_memory_root_die r;
+		auto cu = r.get_or_create_synthetic_cu();
+		for (unsigned i = 0; i < N_SNAPSHOT_DIES; ++i)
+		{
+			auto t = r.make_new(cu, DW_TAG_base_type);
+			auto& attrs = dynamic_cast<core::in_memory_abstract_die&>(t.dereference()).attrs();
+			attrs.insert(make_pair(DW_AT_name, encap::attribute_value("t" + std::to_string(i))));
+			attrs.insert(make_pair(DW_AT_byte_size, encap::attribute_value((Dwarf_Unsigned) 4)));
+		}
+		if (!r.save_snapshot(snapshot_filename)) { cerr << "Could not save a snapshot" << endl; return 1; }
+	}
+	bench("load_snapshot", [&snapshot_filename]() {
+		core::in_memory_root_die loaded;
+		return loaded.load_snapshot(snapshot_filename) ? (unsigned long) N_SNAPSHOT_DIES + 1 : 0ul;
+	});
+	unlink(snapshot_filename.c_str());
+	return 0;
+}
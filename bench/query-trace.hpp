@@ -0,0 +1,144 @@
+/* dwarfpp: C++ binding for a useful subset of libdwarf, plus extra goodies.
+ *
+ * query-trace.hpp: recording and reading traces of root_die queries
+ *
+ * Copyright (c) 2008--17, Stephen Kell. For licensing information, see the
+ * LICENSE file in the root of the libdwarfpp tree.
+ */
+
+#ifndef DWARFPP_BENCH_QUERY_TRACE_HPP_
+#define DWARFPP_BENCH_QUERY_TRACE_HPP_
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <stdexcept>
+#include <dwarfpp/lib.hpp>
+#include <dwarfpp/frame.hpp>
+
+/* A trace is text, one query per line, so it can be diffed, grepped and
+ * cut down by hand:
+ *
+ *     pos 0x2f1c
+ *     find 0x2f1c
+ *     resolve main
+ *     symbolize 0x401136 0x401140
+ *     summary_code 0x4e0
+ *     fde 0x401136
+ *
+ * Offsets are into .debug_info, and pcs file-relative, so a trace only
+ * makes sense against the binary it was recorded from. resolve starts
+ * from the root, with a single name. Blank lines and lines starting '#'
+ * are skipped. See replay.cpp for what plays them back.
+ *
+ * To record one, have the program you care about make these calls
+ * through a query_recorder. It forwards each to the root_die and writes
+ * a line; it's safe to share between threads, though the lines of
+ * concurrent calls come out in whatever order they finish. */
+
+namespace dwarf
+{
+	namespace bench
+	{
+		using std::string;
+		using std::vector;
+		using core::root_die;
+		using core::iterator_base;
+		using core::iterator_df;
+		using core::type_die;
+		using core::FrameSection;
+		using dwarf::spec::opt;
+		using lib::Dwarf_Off;
+		using lib::Dwarf_Addr;
+
+		struct query
+		{
+			enum op_t { POS, FIND, RESOLVE, SYMBOLIZE, SUMMARY_CODE, FDE } op;
+			vector<Dwarf_Addr> args; // an offset, or pcs; none for RESOLVE
+			string name;
+		};
+		static const char *const query_op_names[] = {
+			"pos", "find", "resolve", "symbolize", "summary_code", "fde"
+		};
+
+		/* Returns false, having read what it could, at the first bad line;
+		 * *p_line gets its number. */
+		inline bool read_trace(std::istream& in, vector<query>& out, unsigned *p_line = nullptr)
+		{
+			string line;
+			unsigned n = 0;
+			while (std::getline(in, line))
+			{
+				++n;
+				if (line.empty() || line[0] == '#') continue;
+				std::istringstream s(line);
+				string op_name;
+				s >> op_name;
+				query q;
+				unsigned op = 0;
+				while (op <= query::FDE && op_name != query_op_names[op]) ++op;
+				if (op > query::FDE) { if (p_line) *p_line = n; return false; }
+				q.op = (query::op_t) op;
+				if (q.op == query::RESOLVE) s >> q.name;
+				else
+				{
+					string arg;
+					size_t used = 0;
+					while (s >> arg)
+					{
+						try { q.args.push_back(std::stoull(arg, &used, 0)); }
+						catch (std::logic_error&) { used = 0; }
+						if (used != arg.size()) { if (p_line) *p_line = n; return false; }
+					}
+				}
+				if ((q.op == query::RESOLVE) ? q.name.empty()
+					: (q.args.empty() || (q.op != query::SYMBOLIZE && q.args.size() != 1)))
+				{ if (p_line) *p_line = n; return false; }
+				out.push_back(std::move(q));
+			}
+			return true;
+		}
+
+		inline void write_query(std::ostream& s, const query& q)
+		{
+			s << query_op_names[q.op];
+			if (q.op == query::RESOLVE) s << " " << q.name;
+			for (auto i = q.args.begin(); i != q.args.end(); ++i)
+			{
+				s << " 0x" << std::hex << *i << std::dec;
+			}
+			s << "\n";
+		}
+
+		struct query_recorder
+		{
+			root_die& r;
+			std::ostream& out;
+			std::mutex m;
+			query_recorder(root_die& r, std::ostream& out) : r(r), out(out) {}
+
+			void note(query::op_t op, const vector<Dwarf_Addr>& args, const string& name = string())
+			{
+				query q = (query) { .op = op, .args = args, .name = name };
+				std::lock_guard<std::mutex> lock(m);
+				write_query(out, q);
+			}
+			iterator_base pos(Dwarf_Off off)
+			{ note(query::POS, { off }); return r.pos(off); }
+			iterator_base find(Dwarf_Off off)
+			{ note(query::FIND, { off }); return r.find(off); }
+			iterator_base resolve(const string& name)
+			{ note(query::RESOLVE, {}, name); return r.resolve(r.begin(), name); }
+			void symbolize(const vector<Dwarf_Addr>& pcs, root_die::symbolization& result)
+			{ note(query::SYMBOLIZE, pcs); r.symbolize(pcs, result); }
+			opt<uint32_t> summary_code(const iterator_df<type_die>& t)
+			{ note(query::SUMMARY_CODE, { t.offset_here() }); return t->summary_code(); }
+			FrameSection::fde_iterator fde_for_pc(Dwarf_Addr pc)
+			{ note(query::FDE, { pc }); return r.get_frame_section().find_fde_for_pc(pc); }
+		};
+	}
+}
+
+#endif
@@ -0,0 +1,301 @@
+/* dwarfpp: C++ binding for a useful subset of libdwarf, plus extra goodies.
+ *
+ * replay.cpp: replay a trace of queries, for throughput and tail latency
+ *
+ * Copyright (c) 2008--17, Stephen Kell. For licensing information, see the
+ * LICENSE file in the root of the libdwarfpp tree.
+ */
+
+#include <fstream>
+#include <iostream>
+#include <chrono>
+#include <thread>
+#include <random>
+#include <algorithm>
+#include <vector>
+#include <string>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <fileno.hpp>
+#include <dwarfpp/lib.hpp>
+#include <dwarfpp/frame.hpp>
+#include "query-trace.hpp"
+
+/* Unlike the microbenchmarks, which time one call many times over, this
+ * plays back a trace of a real program's queries (see query-trace.hpp),
+ * so that the caches see the mix and the order they would in production.
+ * Each run is one configuration, one JSON object on stdout: a thread
+ * count, a cache budget, a retention policy and a reader. We play the
+ * trace once single-threaded to warm up, then reset the counters and time
+ * "repeats" more passes. With more than one thread, the warm-up is followed
+ * by preload() and freeze(), and thread i takes queries i, i+n, i+2n...
+ * of each pass; so what we measure is the steady state of a frozen
+ * root, which is how a server would share one. Peak RSS is the process's
+ * high-water mark, so run each configuration in a process of its own, as
+ * "make -C bench scaling" does. With -s, we instead write a trace sampled
+ * from the binary, for when there's no recorded one to hand. */
+
+using std::cout;
+using std::cerr;
+using std::endl;
+using std::vector;
+using std::string;
+using namespace dwarf;
+using core::root_die;
+using core::iterator_df;
+using core::iterator_base;
+using core::type_die;
+using bench::query;
+using dwarf::spec::opt;
+
+static volatile unsigned long sink; // stop the compiler discarding results
+
+/* Returns false if the query threw. */
+static bool run_one(root_die& r, const query& q, root_die::symbolization& scratch)
+{
+	try
+	{
+		switch (q.op)
+		{
+			case query::POS:
+				sink += r.pos(q.args[0]).offset_here();
+				break;
+			case query::FIND:
+				sink += r.find(q.args[0]).offset_here();
+				break;
+			case query::RESOLVE:
+				sink += (bool) r.resolve(r.begin(), q.name);
+				break;
+			case query::SYMBOLIZE:
+				r.symbolize(q.args, scratch);
+				sink += scratch.pcs.size();
+				break;
+			case query::SUMMARY_CODE: {
+				auto t = r.find(q.args[0]).as_a<type_die>();
+				opt<uint32_t> code = t ? t->summary_code() : opt<uint32_t>();
+				sink += code ? *code : 0;
+			} break;
+			case query::FDE: {
+				auto& fs = r.get_frame_section();
+				auto found = fs.find_fde_for_pc(q.args[0]);
+				sink += (found == fs.fde_end()) ? 0 : found->get_fde_offset();
+			} break;
+		}
+		return true;
+	}
+	catch (...) { return false; }
+}
+
+struct latency
+{
+	uint32_t ns;
+	unsigned char op;
+	bool operator<(const latency& arg) const { return ns < arg.ns; }
+};
+
+static void replay_share(root_die& r, const vector<query>& trace, unsigned i_thread,
+	unsigned nthreads, unsigned repeats, vector<latency>& out, unsigned long *p_errors)
+{
+	root_die::symbolization scratch;
+	out.reserve((trace.size() / nthreads + 1) * repeats);
+	for (unsigned rep = 0; rep < repeats; ++rep)
+	{
+		for (size_t i = i_thread; i < trace.size(); i += nthreads)
+		{
+			auto t0 = std::chrono::steady_clock::now();
+			bool ok = run_one(r, trace[i], scratch);
+			auto t1 = std::chrono::steady_clock::now();
+			if (!ok) ++*p_errors;
+			unsigned long ns = std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count();
+			out.push_back((latency) { .ns = (uint32_t) std::min(ns, (unsigned long) UINT32_MAX),
+				.op = (unsigned char) trace[i].op });
+		}
+	}
+}
+
+/* Of sorted latencies. */
+static uint32_t percentile(const vector<latency>& sorted, double p)
+{
+	if (sorted.empty()) return 0;
+	size_t i = (size_t) (p * (sorted.size() - 1) + 0.5);
+	return sorted[i].ns;
+}
+
+/* Every 16th DIE's offset for pos and find, the CUs' named children for
+ * resolve, types for summary_code, and the FDEs' start pcs (plus a bit)
+ * for fde and, in batches of 16, symbolize; n of them, shuffled. */
+static int sample(root_die& r, unsigned long n)
+{
+	vector<query> all;
+	unsigned long i_die = 0;
+	for (iterator_df<> i = r.begin(); i != r.end(); ++i, ++i_die)
+	{
+		if (i_die % 16 == 0)
+		{
+			all.push_back((query) { .op = query::POS, .args = { i.offset_here() } });
+			all.push_back((query) { .op = query::FIND, .args = { i.offset_here() } });
+		}
+		if (i.depth() == 2 && i.name_here())
+		{
+			all.push_back((query) { .op = query::RESOLVE, .args = {}, .name = *i.name_here() });
+		}
+		if (i.is_a<type_die>())
+		{
+			all.push_back((query) { .op = query::SUMMARY_CODE, .args = { i.offset_here() } });
+		}
+	}
+	auto& fs = r.get_frame_section();
+	vector<Dwarf_Addr> pcs;
+	for (auto i_fde = fs.fde_begin(); i_fde != fs.fde_end(); ++i_fde)
+	{
+		Dwarf_Addr pc = i_fde->get_low_pc() + i_fde->get_func_length() / 2;
+		all.push_back((query) { .op = query::FDE, .args = { pc } });
+		pcs.push_back(pc);
+		if (pcs.size() == 16)
+		{
+			all.push_back((query) { .op = query::SYMBOLIZE, .args = pcs });
+			pcs.clear();
+		}
+	}
+	std::mt19937 gen(42); // the same binary gives the same trace
+	std::shuffle(all.begin(), all.end(), gen);
+	if (all.size() > n) all.resize(n);
+	cout << "# sampled dwarfpp query trace, " << all.size() << " queries" << endl;
+	for (auto i = all.begin(); i != all.end(); ++i) bench::write_query(cout, *i);
+	return 0;
+}
+
+static void usage(const char *argv0)
+{
+	cerr << "Usage: " << argv0 << " [-t threads] [-r repeats] [-b cache-budget-bytes]" << endl
+		<< "\t[-p retained-payloads] [-n (native reader)] <binary> <trace>" << endl
+		<< "   or: " << argv0 << " -s <binary> <n-queries>" << endl;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned nthreads = 1;
+	unsigned repeats = 3;
+	size_t budget = 0;
+	unsigned retained = 0;
+	bool native = false;
+	bool sampling = false;
+	int c;
+	while ((c = getopt(argc, argv, "t:r:b:p:ns")) != -1) switch (c)
+	{
+		case 't': nthreads = std::max(1, atoi(optarg)); break;
+		case 'r': repeats = std::max(1, atoi(optarg)); break;
+		case 'b': budget = strtoull(optarg, nullptr, 0); break;
+		case 'p': retained = atoi(optarg); break;
+		case 'n': native = true; break;
+		case 's': sampling = true; break;
+		default: usage(argv[0]); return 1;
+	}
+	if (argc - optind != 2) { usage(argv[0]); return 1; }
+	const char *binary = argv[optind];
+	std::ifstream in(binary);
+	if (!in) { cerr << "Could not open " << binary << endl; return 1; }
+	root_die r(fileno(in));
+	if (sampling) return sample(r, strtoul(argv[optind + 1], nullptr, 0));
+
+	vector<query> trace;
+	std::ifstream trace_in(argv[optind + 1]);
+	unsigned bad_line = 0;
+	if (!trace_in || !bench::read_trace(trace_in, trace, &bad_line))
+	{
+		cerr << "Could not read trace " << argv[optind + 1];
+		if (bad_line) cerr << " (line " << bad_line << ")";
+		cerr << endl;
+		return 1;
+	}
+
+	if (native && !r.set_reader(root_die::NATIVE_READER))
+	{ cerr << "Could not use the native reader" << endl; return 1; }
+	if (retained)
+	{
+		core::payload_retention_policy policy;
+		policy.max_payloads = retained;
+		r.set_retention_policy(policy);
+	}
+	if (budget) r.set_cache_budget(budget);
+
+	/* Warm up, single-threaded, so that what the trace asks for is
+	 * built, then (if we're sharing) freeze. */
+	vector<latency> warm;
+	unsigned long errors = 0;
+	replay_share(r, trace, 0, 1, 1, warm, &errors);
+	if (nthreads > 1)
+	{
+		bool any_types = std::any_of(trace.begin(), trace.end(),
+			[](const query& q) { return q.op == query::SUMMARY_CODE; });
+		if (any_types) compute_all_type_summaries(r);
+		if (!r.preload() || !r.freeze())
+		{
+			cerr << "Could not freeze the root for " << nthreads << " threads" << endl;
+			return 1;
+		}
+	}
+	r.reset_stats();
+
+	errors = 0;
+	vector<vector<latency> > by_thread(nthreads);
+	vector<unsigned long> errors_by_thread(nthreads);
+	auto t0 = std::chrono::steady_clock::now();
+	if (nthreads == 1) replay_share(r, trace, 0, 1, repeats, by_thread[0], &errors_by_thread[0]);
+	else
+	{
+		vector<std::thread> threads;
+		for (unsigned i = 0; i < nthreads; ++i)
+		{
+			threads.push_back(std::thread(replay_share, std::ref(r), std::cref(trace), i,
+				nthreads, repeats, std::ref(by_thread[i]), &errors_by_thread[i]));
+		}
+		for (auto i = threads.begin(); i != threads.end(); ++i) i->join();
+	}
+	auto t1 = std::chrono::steady_clock::now();
+	if (r.is_frozen()) r.thaw();
+
+	vector<latency> all;
+	vector<vector<latency> > by_op(query::FDE + 1);
+	for (unsigned i = 0; i < nthreads; ++i)
+	{
+		errors += errors_by_thread[i];
+		all.insert(all.end(), by_thread[i].begin(), by_thread[i].end());
+	}
+	for (auto i = all.begin(); i != all.end(); ++i) by_op[i->op].push_back(*i);
+	std::sort(all.begin(), all.end());
+	double secs = std::chrono::duration<double>(t1 - t0).count();
+	struct rusage ru;
+	getrusage(RUSAGE_SELF, &ru);
+
+	cout << "{\"corpus\": \"" << binary << "\", \"threads\": " << nthreads
+		<< ", \"cache_budget\": " << budget << ", \"retained_payloads\": " << retained
+		<< ", \"reader\": \"" << (native ? "native" : "libdwarf") << "\""
+		<< ", \"queries\": " << all.size() << ", \"errors\": " << errors
+		<< ", \"seconds\": " << secs << ", \"queries_per_sec\": " << (secs ? all.size() / secs : 0)
+		<< ", \"p50_ns\": " << percentile(all, 0.5) << ", \"p99_ns\": " << percentile(all, 0.99)
+		<< ", \"p999_ns\": " << percentile(all, 0.999)
+		<< ", \"max_ns\": " << (all.empty() ? 0 : all.back().ns)
+		<< ", \"peak_rss_kb\": " << ru.ru_maxrss
+		<< ", \"cache_bytes\": " << r.get_cache_usage().total();
+	cout << ", \"p99_ns_by_op\": {";
+	bool first = true;
+	for (unsigned op = 0; op <= query::FDE; ++op)
+	{
+		if (by_op[op].empty()) continue;
+		std::sort(by_op[op].begin(), by_op[op].end());
+		cout << (first ? "" : ", ") << "\"" << bench::query_op_names[op] << "\": "
+			<< percentile(by_op[op], 0.99);
+		first = false;
+	}
+	/* The counters are zero unless the library was built with stats. */
+	core::root_stats st = r.stats();
+	cout << "}, \"stats\": {\"enabled\": " << DWARFPP_STATS;
+#define DWARFPP_REPLAY_PRINT_STAT(name) cout << ", \"" #name "\": " << st.name;
+	DWARFPP_ROOT_STATS_FIELDS(DWARFPP_REPLAY_PRINT_STAT)
+#undef DWARFPP_REPLAY_PRINT_STAT
+	cout << "}}" << endl;
+	return 0;
+}
@@ -12,6 +12,16 @@ int main(int argc, char **argv)
 	assert(argc > 1);
 	std::ifstream in(argv[1]);
 	core::root_die root(fileno(in));
-	cout << root;
-	return 0;
+	/* Same output as "cout << root", but streamed, so we don't build up
+	 * payloads or navigation caches as we go. */
+	cout << "(no DIE)" << endl;
+	bool ok = root.stream([](const core::Die& d, unsigned short depth) {
+		for (unsigned u = 0; u < depth; ++u) cout << "\t";
+		cout << "DIE, offset 0x" << std::hex << d.offset_here() << std::dec
+			<< ", tag " << d.spec_here().tag_lookup(d.tag_here())
+			<< ", attributes: " << endl;
+		d.copy_attrs().print(cout, depth + 1);
+		return true;
+	});
+	return ok ? 0 : 1;
 }
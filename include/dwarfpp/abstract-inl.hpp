@@ -29,7 +29,7 @@ namespace dwarf
 		inline basic_die *factory::make_payload(abstract_die&& h, root_die& r)
 		{
 			Die d(std::move(dynamic_cast<Die&&>(h)));
-			if (d.tag_here() == DW_TAG_compile_unit) return make_cu_payload(std::move(d), r);
+			if (tag_is_cu(d.tag_here())) return make_cu_payload(std::move(d), r);
 			else return make_non_cu_payload(std::move(d), r);
 		}
 	}
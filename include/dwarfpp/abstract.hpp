@@ -35,10 +35,17 @@ namespace dwarf
 		struct dwarf_current_factory_t;
 		struct basic_die;
 		struct compile_unit_die;
+		struct payload_arena;
 		using dwarf::spec::opt;
 		using dwarf::spec::spec;
 		using dwarf::spec::DEFAULT_DWARF_SPEC; // FIXME: ... or get rid of spec:: namespace?
 
+		/* The unit DIEs we treat as compile units. A GNU-style (DWARF 4)
+		 * skeleton is a DW_TAG_compile_unit, but DWARF 5 gives skeletons a
+		 * tag of their own; either way it's a CU whose DIEs are in a .dwo. */
+		inline bool tag_is_cu(Dwarf_Half tag)
+		{ return tag == DW_TAG_compile_unit || tag == DW_TAG_skeleton_unit; }
+
 		/* This is a small interface designed to be implementable over both 
 		 * libdwarf Dwarf_Die handles and whatever other representation we 
 		 * choose. */
@@ -65,6 +72,8 @@ namespace dwarf
 			string summary() const;
 		};
 		
+		struct snapshot_view; // see snapshot.cpp
+		
 		/* the in-memory version, for synthetic (non-library-backed) DIEs. */
 		struct in_memory_abstract_die: public virtual abstract_die
 		{
@@ -72,6 +81,18 @@ namespace dwarf
 			Dwarf_Off m_offset;
 			Dwarf_Off m_cu_offset;
 			Dwarf_Half m_tag;
+			/* If we came from a snapshot and haven't been edited since, our
+			 * attributes are still in its mapped columns, at indices from
+			 * restored_begin up to restored_end, and m_attrs is empty. We
+			 * read them from there; attrs() copies them in. */
+			const snapshot_view *p_restored;
+			uint32_t restored_begin;
+			uint32_t restored_end;
+			bool restored_has_attr(Dwarf_Half attr) const;
+			opt<string> restored_name() const;
+			encap::attribute_value restored_attr(Dwarf_Half attr) const;
+			encap::attribute_map restored_attrs() const;
+			void unrestore();
 			struct attribute_map : public encap::attribute_map
 			{
 			private:
@@ -83,6 +104,7 @@ namespace dwarf
 				typedef encap::attribute_map super;
 			private:
 				void update_cache_on_insert(iterator inserted);
+				void forget_compiled_location();
 			public:
 				std::pair<iterator, bool> insert(const value_type& val)
 				{
@@ -119,21 +141,32 @@ namespace dwarf
 			Dwarf_Off get_offset() const { return m_offset; }
 			Dwarf_Half get_tag() const { return m_tag; }
 			opt<string> get_name() const 
-			{ return has_attr(DW_AT_name) ? m_attrs.find(DW_AT_name)->second.get_string() : opt<string>(); }
+			{
+				if (p_restored) return restored_name();
+				return has_attr(DW_AT_name) ? m_attrs.find(DW_AT_name)->second.get_string() : opt<string>();
+			}
 			Dwarf_Off get_enclosing_cu_offset() const 
 			{ return m_cu_offset; }
 			bool has_attr(Dwarf_Half attr) const 
-			{ return m_attrs.find(attr) != m_attrs.end(); }
+			{ return p_restored ? restored_has_attr(attr) : m_attrs.find(attr) != m_attrs.end(); }
+			encap::attribute_value attr_value(Dwarf_Half attr) const
+			{
+				if (p_restored) return restored_attr(attr);
+				auto found = m_attrs.find(attr);
+				assert(found != m_attrs.end());
+				return found->second;
+			}
 			encap::attribute_map copy_attrs() const
-			{ return m_attrs; }
+			{ return p_restored ? restored_attrs() : m_attrs; }
 			encap::attribute_map& attrs() 
-			{ return m_attrs; }
+			{ if (p_restored) unrestore(); return m_attrs; }
 			inline spec& get_spec(root_die& r) const;
 			root_die& get_root() const
 			{ return *p_root; }
 			
 			in_memory_abstract_die(root_die& r, Dwarf_Off offset, Dwarf_Off cu_offset, Dwarf_Half tag)
-			 : p_root(&r), m_offset(offset), m_cu_offset(cu_offset), m_tag(tag), m_attrs(*this)
+			 : p_root(&r), m_offset(offset), m_cu_offset(cu_offset), m_tag(tag),
+			   p_restored(nullptr), restored_begin(0), restored_end(0), m_attrs(*this)
 			{}
 		};
 
@@ -148,17 +181,28 @@ namespace dwarf
 			virtual basic_die *make_non_cu_payload(abstract_die&& h, root_die& r) = 0;
 			compile_unit_die *make_cu_payload(abstract_die&& , root_die& r);
 			compile_unit_die *make_new_cu(root_die& r, std::function<compile_unit_die*()> constructor);
+			/* Makes an in-memory DIE, at the offset and CU offset that
+			 * "where" gives, or null (without calling it) for unknown tags. */
+			basic_die *make_in_memory(root_die& r, spec& s, Dwarf_Half tag,
+				std::function<std::pair<Dwarf_Off, Dwarf_Off>()> where);
+			static payload_arena *arena_for(root_die& r); // null means use the heap
 		public:
 			inline basic_die *make_payload(abstract_die&& h, root_die& r);
 			basic_die *make_new(const iterator_base& parent, Dwarf_Half tag);
+			/* For loading snapshots: an in-memory DIE at a known offset,
+			 * which the caller must link in. See root_die::load_snapshot(). */
+			basic_die *make_restored(root_die& r, Dwarf_Half tag, Dwarf_Off off, Dwarf_Off cu_off);
 			
 			static inline factory& for_spec(dwarf::spec::spec& def);
 			virtual basic_die *dummy_for_tag(Dwarf_Half tag) = 0;
+			/* Any higher tag gets the basic_die dummy. */
+			virtual Dwarf_Half max_tag() = 0;
 		};
 		struct dwarf_current_factory_t : public factory
 		{
 			basic_die *make_non_cu_payload(abstract_die&& h, root_die& r);
 			basic_die *dummy_for_tag(Dwarf_Half tag);
+			Dwarf_Half max_tag();
 		};
 		extern dwarf_current_factory_t dwarf_current_factory;
 		inline factory& factory::for_spec(dwarf::spec::abstract_def& def)
@@ -12,11 +12,14 @@
 
 #include <memory>
 #include <vector>
+#include <atomic>
 
 #include "spec.hpp"
 #include "libdwarf.hpp" /* includes libdwarf.h, Error, No_entry, some fwddecls */
 
 #include <boost/optional.hpp>
+#include <boost/container/flat_map.hpp>
+#include <boost/container/small_vector.hpp>
 #include <srk31/util.hpp> /* for forward_constructors */
 
 namespace dwarf
@@ -43,6 +46,23 @@ namespace dwarf
 		using core::root_die;
 		using core::debug;
 		
+		/* Decoded loclists and rangelists never change, so copies of an
+		 * attribute_value share one, as do the attributes of DIEs that
+		 * point at the same .debug_loc or .debug_ranges offset (see
+		 * root_die::decoded_loclists). This is their refcount; a copy of
+		 * a list starts its own. */
+		struct list_refcount
+		{
+			mutable std::atomic<unsigned> refcount;
+			list_refcount() : refcount(0) {}
+			list_refcount(const list_refcount&) : refcount(0) {}
+			list_refcount& operator=(const list_refcount&) { return *this; }
+		};
+		void intrusive_ptr_add_ref(const loclist *p);
+		void intrusive_ptr_release(const loclist *p);
+		void intrusive_ptr_add_ref(const rangelist *p);
+		void intrusive_ptr_release(const rangelist *p);
+		
 		class attribute_value {
 				friend class core::basic_die; // for use of the NO_ATTR constructor in find_attr
 				friend class core::iterator_base; // the same in iterator_base::attr()
@@ -123,8 +143,8 @@ namespace dwarf
 				std::vector<unsigned char> *v_block;
 				std::string *v_string;
 				weak_ref *v_ref;
-				encap::loclist *v_loclist;
-				encap::rangelist *v_rangelist;
+				const encap::loclist *v_loclist; // shared; see list_refcount
+				const encap::rangelist *v_rangelist;
 			};
 			static form dwarf_form_to_form(const Dwarf_Half form); // helper hack
 			// -- the operator<< is a friend (WHY?)
@@ -150,6 +170,9 @@ namespace dwarf
 			attribute_value(const char *s)        : orig_form(DW_FORM_string),   f(STRING),   v_string(new std::string(s)) {}
 			attribute_value(const std::string& s) : orig_form(DW_FORM_string),   f(STRING),   v_string(new std::string(s)) {}
 			attribute_value(const weak_ref& r)    : orig_form(DW_FORM_ref_addr), f(REF),      v_ref(r.clone()) {}
+			explicit attribute_value(const loclist& l); // a copy, for making DIEs in memory
+			explicit attribute_value(const rangelist& l); // likewise
+			explicit attribute_value(const std::vector<unsigned char>& b); // likewise, a block
 			
 		public:
 			bool is_flag() const { return f == FLAG; }
@@ -194,13 +217,34 @@ namespace dwarf
 			//friend std::ostream& operator<<(std::ostream& o, const dwarf::encap::die& d);
 			// copy constructor
 			attribute_value(const attribute_value& av);
+			// move constructor -- steals the pointee, if any
+			attribute_value(attribute_value&& av) : orig_form(av.orig_form), f(av.f)
+			{
+				v_u = av.v_u; // HACK: every union member fits in a Dwarf_Unsigned
+				av.f = NO_ATTR; // so the source's destructor frees nothing
+			}
+			// assignment, by copy-and-swap (attribute_maps shuffle values around)
+			attribute_value& operator=(attribute_value av)
+			{
+				std::swap(orig_form, av.orig_form);
+				std::swap(f, av.f);
+				std::swap(v_u, av.v_u);
+				return *this;
+			}
 			
 			virtual ~attribute_value();
 		}; // end class attribute_value
 		
-		struct attribute_map : public std::map<Dwarf_Half, attribute_value> 
+		/* Most DIEs have fewer than eight attributes, so rather than a tree
+		 * node per attribute, we keep a sorted vector with room for eight
+		 * inline. Unlike std::map, inserting can invalidate iterators (and
+		 * references to values), so don't hang on to them across inserts. */
+		typedef boost::container::flat_map<Dwarf_Half, attribute_value, std::less<Dwarf_Half>,
+			boost::container::small_vector<std::pair<Dwarf_Half, attribute_value>, 8> >
+			attribute_map_base;
+		struct attribute_map : public attribute_map_base
 		{
-			typedef std::map<Dwarf_Half, attribute_value> base;
+			typedef attribute_map_base base;
 			// forward constructors
 			//forward_constructors(base, attribute_map)
 			// hmm -- this messes with overload resolution; just forward default for now
@@ -0,0 +1,78 @@
+/* dwarfpp: C++ binding for a useful subset of libdwarf, plus extra goodies.
+ *
+ * die-reader.hpp: what root_die needs from a reader other than libdwarf
+ *
+ * Copyright (c) 2008--17, Stephen Kell. For licensing information, see the
+ * LICENSE file in the root of the libdwarfpp tree.
+ */
+
+#ifndef DWARFPP_DIE_READER_HPP_
+#define DWARFPP_DIE_READER_HPP_
+
+#include "root.hpp"
+
+namespace dwarf
+{
+	namespace core
+	{
+		/* A reader that root_die can navigate with instead of libdwarf; see
+		 * root_die::set_reader(). It only has to do navigation, names and
+		 * has_attr(): attribute values still come from libdwarf, via
+		 * reader_die::copy_attrs(). A DIE is named by its unit's index and
+		 * its offset in .debug_info. Implementations are native_reader
+		 * (native-reader.hpp) and, if we're built with libdw, libdw_reader
+		 * (libdw-reader.hpp). */
+		class die_reader
+		{
+		public:
+			/* No DIE is at offset 0, since a unit header is. */
+			static const Dwarf_Off NONE = 0;
+
+			virtual ~die_reader() {}
+			virtual root_die::reader_kind kind() const = 0;
+
+			virtual unsigned unit_count() const = 0;
+			virtual Dwarf_Off unit_die_offset(unsigned idx) const = 0;
+			/* Which unit holds off, if any. */
+			virtual bool unit_index_for(Dwarf_Off off, unsigned *p_idx) const = 0;
+
+			/* 0 for a null entry or bad data. */
+			virtual Dwarf_Half tag_at(unsigned u, Dwarf_Off off) const = 0;
+			/* NONE if there isn't one. */
+			virtual Dwarf_Off first_child(unsigned u, Dwarf_Off off) const = 0;
+			virtual Dwarf_Off next_sibling(unsigned u, Dwarf_Off off) const = 0;
+			/* As next_sibling(), but where there is none, also says where
+			 * off's parent's subtree ends (just past the null entry ending
+			 * its children), or NONE if the reader can't tell. */
+			virtual Dwarf_Off next_sibling_or_end(unsigned u, Dwarf_Off off,
+				Dwarf_Off *out_parent_end) const
+			{ *out_parent_end = NONE; return next_sibling(u, off); }
+			virtual bool has_attr(unsigned u, Dwarf_Off off, Dwarf_Half attr) const = 0;
+			/* Lives as long as the reader does. A null view means no name,
+			 * or one the reader can't resolve (see has_attr()). */
+			virtual string_view name(unsigned u, Dwarf_Off off) const = 0;
+		};
+
+		/* An abstract_die over any die_reader: just a unit and an offset. */
+		struct reader_die : public virtual abstract_die
+		{
+			root_die *p_root;
+			const die_reader *p_reader;
+			unsigned unit_idx;
+			Dwarf_Off off;
+
+			reader_die(root_die& r, const die_reader& reader, unsigned unit_idx, Dwarf_Off off)
+			 : p_root(&r), p_reader(&reader), unit_idx(unit_idx), off(off) {}
+			Dwarf_Off get_offset() const { return off; }
+			Dwarf_Half get_tag() const { return p_reader->tag_at(unit_idx, off); }
+			opt<string> get_name() const;
+			Dwarf_Off get_enclosing_cu_offset() const
+			{ return p_reader->unit_die_offset(unit_idx); }
+			bool has_attr(Dwarf_Half attr) const { return p_reader->has_attr(unit_idx, off, attr); }
+			encap::attribute_map copy_attrs() const; // via libdwarf, for now
+			spec& get_spec(root_die& r) const;
+		};
+	}
+}
+
+#endif
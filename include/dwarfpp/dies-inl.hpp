@@ -26,18 +26,27 @@ namespace dwarf
 		 * with which compile_unit_die is friendly? */
 		inline std::string compile_unit_die::source_file_name(unsigned o) const
 		{
+			auto p_files = get_source_files();
+			if (p_files)
+			{
+				unsigned id = p_files->name_id(o);
+				assert(id != source_file_table::NONE);
+				return get_root().line_file_name(id);
+			}
 			StringList names(d);
 			//if (!names) throw Error(current_dwarf_error, 0);
 			/* Source file numbers in DWARF are indexed starting from 1. 
 			 * Source file zero means "no source file".
 			 * However, our array filesbuf is indexed beginning zero! */
-			assert(o <= names.get_len()); // FIXME: how to report error? ("throw No_entry();"?)
-			return names[o - 1];
+			Dwarf_Unsigned base = source_file_base(); // libdwarf lists DWARF 5's file 0 too
+			assert(o >= base && o - base < (Dwarf_Unsigned) names.get_len()); // FIXME: how to report error? ("throw No_entry();"?)
+			return names[o - base];
 		}
 
 		inline unsigned compile_unit_die::source_file_count() const
 		{
-			// FIXME: cache some stuff
+			auto p_files = get_source_files();
+			if (p_files) return p_files->names.size();
 			StringList names(d);
 			return names.get_len();
 		}
@@ -269,6 +269,10 @@ string abstract_name_for_type(iterator_df<type_die> t);
 opt<uint32_t> summary_code_for_type(iterator_df<type_die> t);
 opt<uint16_t> containment_summary_code_for_type(iterator_df<type_die> t);
 opt<uint16_t> traversal_summary_code_for_type(iterator_df<type_die> t);
+/* Compute the summary code of every type in r, up front and in parallel,
+ * so that summary_code() (hence type_set and type_map) never recurses.
+ * Returns false if r is frozen. nthreads == 0 means one per core. */
+bool compute_all_type_summaries(root_die& r, unsigned nthreads = 0);
 begin_class(type, base_initializations(initialize_base(program_element)), declare_base(program_element))
 		attr_optional(byte_size, unsigned)
 		mutable opt<uint32_t> cached_summary_code;
@@ -282,10 +286,11 @@ begin_class(type, base_initializations(initialize_base(program_element)), declar
 		opt<uint16_t> traversal_summary_code() const;
 		friend opt<uint16_t> containment_summary_code_for_type(iterator_df<type_die> t);
 		friend opt<uint16_t> traversal_summary_code_for_type(iterator_df<type_die> t);
+		friend bool compute_all_type_summaries(root_die& r, unsigned nthreads);
 	public:
 		mutable optional<shared_ptr<type_scc_t> > opt_cached_scc; // HACK: should be private, but test-scc needs it
 		virtual opt<Dwarf_Unsigned> calculate_byte_size() const;
-		// virtual bool is_rep_compatible(iterator_df<type_die> arg) const;
+		virtual bool is_rep_compatible(iterator_df<type_die> arg) const; // see rep.cpp
 		virtual iterator_df<type_die> get_concrete_type() const;
 		virtual iterator_df<type_die> get_unqualified_type() const;
 		virtual bool abstractly_equals(core::iterator_df<core::type_die> t) const;
@@ -342,18 +347,43 @@ struct type_iterator_df_base : public iterator_base
 	/* The stack records the grey nodes. The back of the stack
 	 * may or may not be our current position.  */
 	deque< pair<iterator_df<type_die>, iterator_df<program_element_die> > > m_stack;
-	struct black_offsets_set_t : std::unordered_set<Dwarf_Off>
+	/* If the root has dense navigation tables, the black set is a bitmap
+	 * per CU, indexed by position in the CU's table, so that a type walk
+	 * over the whole file doesn't cost a hash node per type. Anything the
+	 * tables don't cover (in-memory DIEs; END, which is void) goes in the
+	 * hash set. */
+	struct black_offsets_set_t
 	{
+		std::vector<std::vector<bool> > bits_by_cu; // sized on first use
+		std::unordered_set<Dwarf_Off> others;
+		static Dwarf_Off key(const iterator_base& i)
+		{ return i.is_end_position() ? (Dwarf_Off)-1 : i.offset_here(); }
 		bool contains(const iterator_base& i) const
 		{
-			return this->find(i.is_end_position() ? (Dwarf_Off)-1 : i.offset_here())
-				!= this->end();
+			unsigned cu_idx, rec_idx;
+			if (i.is_real_die_position()
+				&& i.root().dense_nav_position(i.offset_here(), &cu_idx, &rec_idx))
+			{
+				return cu_idx < bits_by_cu.size() && !bits_by_cu[cu_idx].empty()
+					&& bits_by_cu[cu_idx][rec_idx];
+			}
+			return others.find(key(i)) != others.end();
 		}
 		void insert(const iterator_base& i)
 		{
-			this->unordered_set::insert(i.is_end_position() ? (Dwarf_Off)-1 : i.offset_here());
+			unsigned cu_idx, rec_idx;
+			if (i.is_real_die_position()
+				&& i.root().dense_nav_position(i.offset_here(), &cu_idx, &rec_idx))
+			{
+				if (cu_idx >= bits_by_cu.size()) bits_by_cu.resize(cu_idx + 1);
+				auto& bits = bits_by_cu[cu_idx];
+				if (bits.empty()) bits.resize(i.root().dense_nav_cu_size(cu_idx));
+				bits[rec_idx] = true;
+				return;
+			}
+			others.insert(key(i));
 		}
-		using unordered_set::unordered_set;
+		void clear() { bits_by_cu.clear(); others.clear(); }
 	} black_offsets;
 
 	iterator_df<program_element_die> m_reason;
@@ -729,6 +759,16 @@ void walk_type(core::iterator_df<core::type_die> t,
 	public:
 		virtual bool location_requires_object_base() const = 0; 
 
+		/* Our own location attribute (DW_AT_data_member_location if we are
+		 * object-based, else DW_AT_location) lowered for fast evaluation;
+		 * null if we have none. Cached on the payload, unless frozen. */
+		shared_ptr<const expr::compiled_loclist> get_compiled_location() const;
+		/* For when the attribute changes under us, as in-memory DIEs' can. */
+		void forget_compiled_location() const { cached_compiled_location.reset(); }
+	protected:
+		mutable shared_ptr<const expr::compiled_loclist> cached_compiled_location;
+	public:
+
 		/* virtual Dwarf_Addr calculate_addr(
 			Dwarf_Signed frame_base_addr,
 			Dwarf_Off dieset_relative_ip,
@@ -810,6 +850,7 @@ begin_class(with_data_members, base_initializations(initialize_base(type)), decl
 protected:
 		mutable optional< iterator_df<> > maybe_cached_definition; 
 		// really use boost::optional, to distinguish "cached END" from "no cache"
+		friend struct root_die; // for invalidate_types_reaching()
 public:
 		iterator_base find_definition() const; // for turning declarations into defns
 		bool may_equal(core::iterator_df<core::type_die> t, const std::set< std::pair< core::iterator_df<core::type_die>, core::iterator_df<core::type_die> > >& assuming_equal) const; 
@@ -835,7 +876,7 @@ end_class(with_data_members)
 		opt<Dwarf_Unsigned> element_count() const; \
 		vector<opt<Dwarf_Unsigned> > dimension_element_counts() const; \
 		opt<Dwarf_Unsigned> calculate_byte_size() const; \
-		/* bool is_rep_compatible(iterator_df<type_die> arg) const; */ \
+		bool is_rep_compatible(iterator_df<type_die> arg) const; \
 		iterator_df<type_die> ultimate_element_type() const; \
 		opt<Dwarf_Unsigned> ultimate_element_count() const; \
 		bool may_equal(core::iterator_df<core::type_die> t, const std::set< std::pair< core::iterator_df<core::type_die>, core::iterator_df<core::type_die> > >& assuming_equal) const; \
@@ -850,9 +891,9 @@ end_class(with_data_members)
 		std::ostream& print_abstract_name(std::ostream& s) const; \
 		opt<Dwarf_Unsigned> calculate_byte_size() const;
 #define extra_decls_pointer_type \
-		/* bool is_rep_compatible(iterator_df<type_die> arg) const; */
+		bool is_rep_compatible(iterator_df<type_die> arg) const;
 #define extra_decls_reference_type \
-		/* bool is_rep_compatible(iterator_df<type_die> arg) const; */
+		bool is_rep_compatible(iterator_df<type_die> arg) const;
 #define extra_decls_base_type \
 		bool may_equal(core::iterator_df<core::type_die> t, const std::set< std::pair< core::iterator_df<core::type_die>, core::iterator_df<core::type_die> > >& assuming_equal) const; \
 		opt<Dwarf_Unsigned> calculate_byte_size() const; \
@@ -862,20 +903,20 @@ end_class(with_data_members)
 		std::ostream& print_abstract_name(std::ostream& s) const; \
 		string get_canonical_name() const; \
 		static string canonical_name_for(spec& spec, unsigned encoding, \
-			unsigned byte_size, unsigned bit_size, unsigned bit_offset);
-		/* bool is_rep_compatible(iterator_df<type_die> arg) const; */
+			unsigned byte_size, unsigned bit_size, unsigned bit_offset); \
+		bool is_rep_compatible(iterator_df<type_die> arg) const;
 #define extra_decls_structure_type \
 		opt<Dwarf_Unsigned> calculate_byte_size() const; \
-		/* bool is_rep_compatible(iterator_df<type_die> arg) const; */
+		bool is_rep_compatible(iterator_df<type_die> arg) const;
 #define extra_decls_union_type \
-		/* bool is_rep_compatible(iterator_df<type_die> arg) const; */
+		bool is_rep_compatible(iterator_df<type_die> arg) const;
 #define extra_decls_class_type \
-		/* bool is_rep_compatible(iterator_df<type_die> arg) const; */
+		bool is_rep_compatible(iterator_df<type_die> arg) const;
 #define extra_decls_enumeration_type \
 		bool abstractly_equals(iterator_df<type_die> t) const; \
 		std::ostream& print_abstract_name(std::ostream& s) const; \
 		bool may_equal(core::iterator_df<core::type_die> t, const std::set< std::pair< core::iterator_df<core::type_die>, core::iterator_df<core::type_die> > >& assuming_equal) const; \
-		/* bool is_rep_compatible(iterator_df<type_die> arg) const; */
+		bool is_rep_compatible(iterator_df<type_die> arg) const;
 #define extra_decls_subrange_type \
 		bool may_equal(core::iterator_df<core::type_die> t, const std::set< std::pair< core::iterator_df<core::type_die>, core::iterator_df<core::type_die> > >& assuming_equal) const; \
 		bool abstractly_equals(iterator_df<type_die> t) const; \
@@ -893,7 +934,7 @@ end_class(with_data_members)
 #define extra_decls_member \
 		iterator_df<type_die> find_or_create_type_handling_bitfields() const;
 #define extra_decls_subroutine_type \
-		/* bool is_rep_compatible(iterator_df<type_die> arg) const; */ \
+		bool is_rep_compatible(iterator_df<type_die> arg) const; \
 		core::iterator_df<core::type_die> get_return_type() const;
 #define extra_decls_unspecified_type \
 		std::ostream& print_abstract_name(std::ostream& s) const;
@@ -905,6 +946,8 @@ public: \
 inline std::string source_file_name(unsigned o) const; \
 opt<std::string> source_file_fq_pathname(unsigned o) const; \
 inline unsigned source_file_count() const; \
+/* The file number of the first source file: DWARF 5 counts from 0. */ \
+Dwarf_Unsigned source_file_base() const { return version_stamp >= 5 ? 0 : 1; } \
 /* We define fields and getters for the per-CU info (NOT attributes) */ \
 /* available from libdwarf. These will be filled in by root_die::make_payload(). */ \
 protected: \
@@ -930,6 +973,14 @@ mutable iterator_df<type_die> cached_implicit_subrange_base_type; \
 iterator_df<type_die> implicit_subrange_base_type() const; \
 encap::rangelist normalize_rangelist(const encap::rangelist& rangelist) const; \
 bool is_generic_pointee_type(iterator_df<type_die> t) const; \
+/* Our line number program; see line_table. While frozen, we can't */ \
+/* intern file names, so we only give one decoded before freezing. */ \
+mutable shared_ptr<const line_table> cached_line_table; \
+shared_ptr<const line_table> get_line_table() const; \
+/* Our source files; see source_file_table. Likewise, only one */ \
+/* decoded before freezing, e.g. by root_die::build_line_index(). */ \
+mutable shared_ptr<const source_file_table> cached_source_files; \
+shared_ptr<const source_file_table> get_source_files() const; \
 friend class iterator_base; \
 friend class factory; 
 
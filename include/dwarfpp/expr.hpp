@@ -12,6 +12,7 @@
 #include <vector>
 #include <stack>
 #include <boost/icl/interval_map.hpp>
+#include <boost/intrusive_ptr.hpp>
 #include <strings.h> // for bzero
 #include "spec.hpp"
 #include "libdwarf.hpp"
@@ -35,7 +36,7 @@ namespace dwarf
 		/* We don't support all expressions. */
 		class Not_supported
 		{
-			const string& m_msg;
+			string m_msg;
 		public:
 			Not_supported(const string& msg) : m_msg(msg) {}
 		};
@@ -55,7 +56,7 @@ namespace dwarf
 		using namespace dwarf::lib;
 		using dwarf::spec::opt;
 		
-		class rangelist : public vector<lib::Dwarf_Ranges>
+		class rangelist : public vector<lib::Dwarf_Ranges>, public list_refcount
 		{
 		public:
 			template <class In> rangelist(In first, In last)
@@ -229,7 +230,7 @@ namespace dwarf
 			friend std::ostream& operator<<(std::ostream& s, const loc_expr& e);
 		};
 		
-		struct loclist : public vector<loc_expr>
+		struct loclist : public vector<loc_expr>, public list_refcount
 		{
 			friend class ::dwarf::expr::evaluator;
 			friend class attribute_value;
@@ -307,65 +308,141 @@ namespace dwarf
 		using dwarf::spec::opt;
 		using std::stack;
 		using std::ostream;
+		/* A stack of fixed capacity, held inline, so that evaluating doesn't
+		 * allocate. DWARF expressions in the wild rarely go beyond a handful
+		 * of entries. */
+		class value_stack
+		{
+		public:
+			enum { CAPACITY = 64 };
+		private:
+			Dwarf_Unsigned vals[CAPACITY];
+			unsigned n;
+		public:
+			value_stack() : n(0) {}
+			bool empty() const { return n == 0; }
+			unsigned size() const { return n; }
+			void clear() { n = 0; }
+			void push(Dwarf_Unsigned v)
+			{
+				if (n == CAPACITY) throw Not_supported("DWARF expression stack overflow");
+				vals[n++] = v;
+			}
+			Dwarf_Unsigned top() const
+			{
+				if (n == 0) throw No_entry();
+				return vals[n - 1];
+			}
+			Dwarf_Unsigned pop()
+			{
+				if (n == 0) throw No_entry();
+				return vals[--n];
+			}
+		};
+		/* The evaluator does not copy its expression; the caller must keep
+		 * the loc_expr (or whatever) alive for as long as the evaluator.
+		 * For evaluating many expressions, make one evaluator and then
+		 * reset() it and run() each one in turn, pushing any initial
+		 * stack entries in between. That way nothing is allocated. */
 		class evaluator {
-			std::stack<Dwarf_Unsigned> m_stack;
-			vector<Dwarf_Loc> expr;
+			value_stack m_stack;
+			const Dwarf_Loc *expr_begin;
+			const Dwarf_Loc *expr_end;
 			const ::dwarf::spec::abstract_def& spec;
 			regs *p_regs; // optional set of register values, for DW_OP_breg*
 			bool tos_is_value; // whether we saw a DW_OP_stack_value hence have calculated a value not an addr
 			opt<Dwarf_Signed> frame_base;
-			vector<Dwarf_Loc>::iterator i;
+			const Dwarf_Loc *i;
 			void eval();
+			/* std::stack only lets us see the top, but its container,
+			 * bottom first, is there for derived classes to see. */
+			struct stack_contents : stack<Dwarf_Unsigned>
+			{
+				static const container_type& of(const stack<Dwarf_Unsigned>& s)
+				{ return s.*&stack_contents::c; }
+			};
+			void push_initial(const stack<Dwarf_Unsigned>& initial_stack)
+			{
+				const stack_contents::container_type& c = stack_contents::of(initial_stack);
+				for (auto i_v = c.begin(); i_v != c.end(); ++i_v) m_stack.push(*i_v);
+			}
+			void run_loclist(const encap::loclist& loclist, Dwarf_Addr vaddr);
 		public:
+			/* A reusable evaluator, with nothing to evaluate yet. */
+			explicit evaluator(const ::dwarf::spec::abstract_def& spec = spec::DEFAULT_DWARF_SPEC)
+			 : expr_begin(0), expr_end(0), spec(spec), p_regs(0), tos_is_value(false), i(0) {}
+			void reset(regs *p_regs = 0, opt<Dwarf_Signed> frame_base = opt<Dwarf_Signed>())
+			{
+				m_stack.clear();
+				this->p_regs = p_regs;
+				this->frame_base = frame_base;
+				tos_is_value = false;
+				expr_begin = expr_end = i = 0;
+			}
+			void push(Dwarf_Unsigned v) { m_stack.push(v); }
+			/* Evaluate [first, last) on the current stack. As with the
+			 * constructors, we stop early at a DW_OP_piece. */
+			void run(const Dwarf_Loc *first, const Dwarf_Loc *last)
+			{ expr_begin = i = first; expr_end = last; eval(); }
+			void run(const vector<Dwarf_Loc>& e) { run(e.data(), e.data() + e.size()); }
+
 			evaluator(const vector<unsigned char> expr, 
 				const ::dwarf::spec::abstract_def& spec) : spec(spec), p_regs(0), tos_is_value(false)
 			{
 				//i = expr.begin();
 				assert(false);
 			}
+			/* The rest evaluate as they're constructed, on the reusable
+			 * path: reset(), push() the initial stack if any, run(). */
 			evaluator(const encap::loclist& loclist,
 				Dwarf_Addr vaddr,
 				const ::dwarf::spec::abstract_def& spec = spec::DEFAULT_DWARF_SPEC,
 				regs *p_regs = 0,
-				opt<Dwarf_Signed> frame_base = opt<Dwarf_Signed>(),
-				const stack<Dwarf_Unsigned>& initial_stack = stack<Dwarf_Unsigned>());
-			
+				opt<Dwarf_Signed> frame_base = opt<Dwarf_Signed>())
+			 : evaluator(spec)
+			{ reset(p_regs, frame_base); run_loclist(loclist, vaddr); }
+			evaluator(const encap::loclist& loclist,
+				Dwarf_Addr vaddr,
+				const ::dwarf::spec::abstract_def& spec,
+				regs *p_regs,
+				opt<Dwarf_Signed> frame_base,
+				const stack<Dwarf_Unsigned>& initial_stack)
+			 : evaluator(spec)
+			{ reset(p_regs, frame_base); push_initial(initial_stack); run_loclist(loclist, vaddr); }
+
+			evaluator(const vector<Dwarf_Loc>& loc_desc,
+				const ::dwarf::spec::abstract_def& spec)
+			 : evaluator(spec)
+			{ run(loc_desc); }
 			evaluator(const vector<Dwarf_Loc>& loc_desc,
 				const ::dwarf::spec::abstract_def& spec,
-				const stack<Dwarf_Unsigned>& initial_stack = stack<Dwarf_Unsigned>())
-				: m_stack(initial_stack), spec(spec), p_regs(0), tos_is_value(false)
-			{
-				expr = loc_desc;
-				i = expr.begin();
-				eval();
-			}
+				const stack<Dwarf_Unsigned>& initial_stack)
+			 : evaluator(spec)
+			{ push_initial(initial_stack); run(loc_desc); }
+			evaluator(const vector<Dwarf_Loc>& loc_desc,
+				const ::dwarf::spec::abstract_def& spec,
+				regs& regs,
+				Dwarf_Signed frame_base)
+			 : evaluator(spec)
+			{ reset(&regs, opt<Dwarf_Signed>(frame_base)); run(loc_desc); }
 			evaluator(const vector<Dwarf_Loc>& loc_desc,
 				const ::dwarf::spec::abstract_def& spec,
 				regs& regs,
 				Dwarf_Signed frame_base,
-				const stack<Dwarf_Unsigned>& initial_stack = stack<Dwarf_Unsigned>()) 
-				: m_stack(initial_stack), spec(spec), p_regs(&regs), tos_is_value(false)
-			{
-				expr = loc_desc;
-				i = expr.begin();
-				this->frame_base = frame_base;
-				eval();
-			}
-
+				const stack<Dwarf_Unsigned>& initial_stack)
+			 : evaluator(spec)
+			{ reset(&regs, opt<Dwarf_Signed>(frame_base)); push_initial(initial_stack); run(loc_desc); }
+			evaluator(const vector<Dwarf_Loc>& loc_desc,
+				const ::dwarf::spec::abstract_def& spec,
+				Dwarf_Signed frame_base)
+			 : evaluator(spec)
+			{ reset(0, opt<Dwarf_Signed>(frame_base)); run(loc_desc); }
 			evaluator(const vector<Dwarf_Loc>& loc_desc,
 				const ::dwarf::spec::abstract_def& spec,
 				Dwarf_Signed frame_base,
-				const stack<Dwarf_Unsigned>& initial_stack = stack<Dwarf_Unsigned>()) 
-				: m_stack(initial_stack), spec(spec), p_regs(0), tos_is_value(false)
-			{
-				//if (av.get_form() != dwarf::encap::attribute_value::LOCLIST) throw "not a DWARF expression";
-				//if (av.get_loclist().size() != 1) throw "only support singleton loclists for now";
-				//expr = *(av.get_loclist().begin());
-				expr = loc_desc;
-				i = expr.begin();
-				this->frame_base = frame_base;
-				eval();
-			}
+				const stack<Dwarf_Unsigned>& initial_stack)
+			 : evaluator(spec)
+			{ reset(0, opt<Dwarf_Signed>(frame_base)); push_initial(initial_stack); run(loc_desc); }
 			
 			Dwarf_Unsigned tos() const { return m_stack.top(); }
 			Dwarf_Unsigned tos(bool may_be_value) const { // FIXME: more complete+orthogonal interface
@@ -373,9 +450,134 @@ namespace dwarf
 				if (!tos_is_value && !may_be_value) return m_stack.top();
 				throw No_entry();
 			}
-			bool finished() const { return i == expr.end(); }
+			bool finished() const { return i == expr_end; }
 			Dwarf_Loc current() const { return *i; }
 		};
+		/* Registers for a block of samples (say, of a profiled stack), a
+		 * column per register: cols[r][i] is register r in sample i. A null
+		 * or missing column is a register that wasn't sampled. We don't own
+		 * the columns. See compiled_expr::eval_batch(). */
+		struct regs_block
+		{
+			vector<const Dwarf_Signed *> cols; // by DWARF register number
+			size_t nrows;
+			explicit regs_block(size_t nrows = 0) : nrows(nrows) {}
+			void set_column(int regnum, const Dwarf_Signed *col)
+			{
+				assert(regnum >= 0);
+				if ((unsigned) regnum >= cols.size()) cols.resize(regnum + 1);
+				cols[regnum] = col;
+			}
+			const Dwarf_Signed *column(int regnum) const
+			{ return (regnum >= 0 && (unsigned) regnum < cols.size()) ? cols[regnum] : nullptr; }
+		};
+		/* One sample of a regs_block, for the interpreter. */
+		class regs_block_row : public regs
+		{
+			const regs_block *p_block;
+			size_t row;
+		public:
+			regs_block_row(const regs_block& block, size_t row) : p_block(&block), row(row) {}
+			void set_row(size_t r) { row = r; }
+			Dwarf_Signed get(int regnum)
+			{
+				const Dwarf_Signed *col = p_block->column(regnum);
+				if (!col) throw No_entry();
+				return col[row];
+			}
+		};
+		/* A location expression lowered ahead of time. Most expressions are
+		 * one of a few shapes -- DW_OP_fbreg N, DW_OP_bregX N, DW_OP_addr A,
+		 * DW_OP_regX, or DW_OP_plus_uconst N applied to an object base --
+		 * and those we evaluate with an add or two. Anything else we hand to
+		 * a (reusable) evaluator. Either way, evaluating gives the same
+		 * answers as constructing an evaluator over the original would. */
+		struct compiled_expr
+		{
+			enum kind_t
+			{
+				EMPTY, // gives its initial stack entry, if any
+				FBREG, // frame base + offset
+				BREG, // register regnum + offset
+				ADDR, // offset, i.e. a static address
+				REG, // like the interpreter, gives register's contents
+				CFA, // DW_OP_call_frame_cfa, which is the frame base
+				PLUS_UCONST, // initial stack entry + offset
+				GENERAL // interpret "code"
+			} kind;
+			int regnum;
+			Dwarf_Signed offset;
+			/* GENERAL only: the instructions, borrowed from the expression
+			 * we were compiled from, which must outlive us. */
+			const Dwarf_Loc *code_begin;
+			const Dwarf_Loc *code_end;
+
+			explicit compiled_expr(const vector<Dwarf_Loc>& expr);
+			bool is_simple() const { return kind != GENERAL; }
+			/* Throws No_entry if the expression needs something we weren't
+			 * given. p_ev, if given, is reset and used for GENERAL ones. */
+			Dwarf_Unsigned eval(regs *p_regs = 0,
+				opt<Dwarf_Signed> frame_base = opt<Dwarf_Signed>(),
+				opt<Dwarf_Unsigned> initial = opt<Dwarf_Unsigned>(),
+				evaluator *p_ev = 0) const;
+			/* The same, with the register file's type known at compile time
+			 * (say, an arch_regs from regs.hpp), so that a simple expression
+			 * reads its register by a direct call, not a virtual one. */
+			template <typename Regs>
+			Dwarf_Unsigned eval_with(Regs& rs, opt<Dwarf_Signed> frame_base = opt<Dwarf_Signed>(),
+				opt<Dwarf_Unsigned> initial = opt<Dwarf_Unsigned>(), evaluator *p_ev = 0) const
+			{
+				switch (kind)
+				{
+					case BREG: return rs.Regs::get(regnum) + offset;
+					case REG: return rs.Regs::get(regnum);
+					default: return eval(&rs, frame_base, initial, p_ev);
+				}
+			}
+			/* The same, for rows [first, first + n) of a block of samples.
+			 * Columns are indexed by row: rs gives the registers, and
+			 * frame_bases and initials (either may be null) the frame bases
+			 * and initial stack entries; results go in out. A row we can't
+			 * evaluate, because it needs something we weren't given, gets
+			 * ok[row] = 0 (if ok isn't null) and leaves out[row] alone; the
+			 * others get ok[row] = 1. Returns how many rows got a result.
+			 * The simple expressions are straight vector loops over the
+			 * columns; GENERAL ones interpret each row, with p_ev if given. */
+			size_t eval_batch(const regs_block& rs, size_t first, size_t n,
+				const Dwarf_Signed *frame_bases, const Dwarf_Unsigned *initials,
+				Dwarf_Unsigned *out, unsigned char *ok = 0, evaluator *p_ev = 0) const;
+		};
+		/* A loclist of compiled_exprs, with the base address selection
+		 * entries already applied, so each entry is a plain [lo, hi).
+		 * GENERAL entries borrow from the loclist. Built from a reference,
+		 * the loclist must outlive us; built from a pointer to a shared
+		 * one (as attribute_values hold them), we keep it alive. */
+		struct compiled_loclist
+		{
+			struct entry
+			{
+				Dwarf_Addr lo;
+				Dwarf_Addr hi;
+				compiled_expr expr;
+			};
+			vector<entry> entries; // in the original order
+			boost::intrusive_ptr<const encap::loclist> source; // may be null
+
+			explicit compiled_loclist(const encap::loclist& loclist);
+			explicit compiled_loclist(boost::intrusive_ptr<const encap::loclist> p_loclist)
+			 : compiled_loclist(*p_loclist) { source = std::move(p_loclist); }
+			/* The same choice as evaluator makes; null if none covers vaddr. */
+			const compiled_expr *find(Dwarf_Addr vaddr) const
+			{ const entry *e = find_entry(vaddr); return e ? &e->expr : nullptr; }
+			const entry *find_entry(Dwarf_Addr vaddr) const;
+			/* compiled_expr::eval_batch() over every row of rs, with pcs the
+			 * column of vaddrs that choose each row's entry. A row whose pc no
+			 * entry covers is one we can't evaluate. Rows with pcs in the same
+			 * entry's range go as a run, so sorting the samples by pc helps. */
+			size_t eval_batch(const Dwarf_Addr *pcs, const regs_block& rs,
+				const Dwarf_Signed *frame_bases, const Dwarf_Unsigned *initials,
+				Dwarf_Unsigned *out, unsigned char *ok = 0, evaluator *p_ev = 0) const;
+		};
 		Dwarf_Unsigned eval(const encap::loclist& loclist,
 			Dwarf_Addr vaddr,
 			Dwarf_Signed frame_base,
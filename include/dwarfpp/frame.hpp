@@ -13,7 +13,12 @@
 #include <stack>
 #include <vector>
 #include <queue>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
 #include <cassert>
+#include <cstring>
 #include <elf.h>
 #include <boost/optional.hpp>
 #include <boost/icl/interval_map.hpp>
@@ -73,29 +78,56 @@ namespace dwarf
 			 * i.e. *both* values are encoded as specified by table_enc.
 			 */
 			
-			map<lib::Dwarf_Off, set<lib::Dwarf_Off> > fde_offsets_by_cie_offset;
-			map<int, int> cie_offsets_by_index;
-			/* Our iterators transform from Dwarf_Fde to Fde and Dwarf_Cie to Cie. */
+			/* Since libdwarf doesn't give us CIE offsets, we build these with a
+			 * pass over every FDE. A lazy FrameSection leaves that until
+			 * ensure_indexes() (or something needing them) calls for it, so a
+			 * caller that only ever wants find_fde_for_pc() never pays. */
+			bool lazy;
+			mutable bool indexes_built;
+			mutable map<lib::Dwarf_Off, set<lib::Dwarf_Off> > fde_offsets_by_cie_offset;
+			mutable map<int, int> cie_offsets_by_index;
+			/* This decodes .eh_frame_hdr's table too, so that after it,
+			 * lookups only read. */
+			void ensure_indexes() const
+			{
+				if (!indexes_built) build_indexes();
+				if (!hdr_tbl_decoded) decode_hdr_table();
+			}
+			const map<lib::Dwarf_Off, set<lib::Dwarf_Off> >& get_fde_offsets_by_cie_offset() const
+			{ ensure_indexes(); return fde_offsets_by_cie_offset; }
+			/* The Fde and Cie for each position in fde_data and cie_data, made
+			 * the first time something asks, so each entry's range and
+			 * augmentation bytes are parsed once rather than per dereference.
+			 * These are sized when we get the lists and never resized, so
+			 * references into them last as long as we do. Filling them in is
+			 * not thread-safe, so build_indexes() fills them all; after
+			 * ensure_indexes(), as on a frozen root, they are only read. */
+			mutable std::vector<std::unique_ptr<Fde> > fdes;
+			mutable std::vector<std::unique_ptr<Cie> > cies;
+			inline const Fde& fde_at(Dwarf_Signed index) const;
+			inline const Cie& cie_at(Dwarf_Signed index) const;
+			/* Our iterators transform from Dwarf_Fde to Fde and Dwarf_Cie to Cie.
+			 * We take the handle by reference so that we know its position. */
 			struct fde_transformer_t
 			{
 				const FrameSection *p_owner;
 				fde_transformer_t(const FrameSection& owner) : p_owner(&owner) {}
-				typedef Fde result;
+				typedef const Fde& result;
 				
-				inline Fde operator()(Dwarf_Fde fde) const;
+				inline const Fde& operator()(const Dwarf_Fde& fde) const;
 			} fde_transformer;
 			struct cie_transformer_t
 			{
 				const FrameSection *p_owner;
 				cie_transformer_t(const FrameSection& owner) : p_owner(&owner) {}
 				
-				inline Cie operator()(Dwarf_Cie cie) const;
+				inline const Cie& operator()(const Dwarf_Cie& cie) const;
 			} cie_transformer;
 			
 			// transformers operate on the value, 
 			// but the second type argument is the *iterator*
-			typedef boost::transform_iterator< fde_transformer_t, Dwarf_Fde *, Fde, Fde > fde_iterator;
-			typedef boost::transform_iterator< cie_transformer_t, Dwarf_Cie *, Cie, Cie > cie_iterator;
+			typedef boost::transform_iterator< fde_transformer_t, Dwarf_Fde *, const Fde&, Fde > fde_iterator;
+			typedef boost::transform_iterator< cie_transformer_t, Dwarf_Cie *, const Cie&, Cie > cie_iterator;
 			
 			const Debug& get_dbg() const { return dbg; }
 			::Elf *get_elf() const; // don't rely on these!
@@ -202,9 +234,45 @@ namespace dwarf
 			{ return hdr_tbl_iterator(hdr_tbl + hdr_tbl_nbytes, this); }
 			unsigned char get_address_size(unsigned cie_version = 1) const;
 
-			inline FrameSection(const Debug& dbg, bool use_eh = false);
+			/* The search table, decoded once (the first time we look up a pc)
+			 * so that a lookup never goes through read_with_encoding(). We
+			 * keep each FDE's [lo, hi) and offset, in the table's (and
+			 * fde_data's) order, plus a copy of the los in Eytzinger order
+			 * (the implicit binary tree, root at 1, children of k at 2k and
+			 * 2k+1) padded to a complete tree, so every search takes the same
+			 * number of steps and the first few levels share cache lines. It
+			 * is only usable if it agrees with libdwarf's list, entry for
+			 * entry; otherwise lookups fall back to libdwarf. */
+			struct decoded_hdr_table
+			{
+				std::vector<Dwarf_Addr> lo;
+				std::vector<Dwarf_Addr> hi;
+				std::vector<Dwarf_Off> fde_offset;
+				std::vector<Dwarf_Addr> eyt_storage; // holds eyt, with room to align it
+				const Dwarf_Addr *eyt; // 64-byte-aligned; eyt[0] is unused
+				std::vector<uint32_t> eyt_rank; // Eytzinger position -> index into lo
+				unsigned depth;
+				bool usable;
+			};
+			mutable decoded_hdr_table hdr_decoded;
+			mutable bool hdr_tbl_decoded;
+			const decoded_hdr_table& get_decoded_hdr_table() const
+			{ if (!hdr_tbl_decoded) decode_hdr_table(); return hdr_decoded; }
+			/* For each of the n pcs, the index into fde_data (i.e. the
+			 * distance from fde_begin()) of the FDE covering it, or -1. The
+			 * searches go in lock-step, BATCH_SIZE at a time, so that their
+			 * cache misses overlap; pcs need not be sorted. */
+			enum { BATCH_SIZE = 16 };
+			void find_fde_indices_for_pcs(const Dwarf_Addr *pcs, size_t n, Dwarf_Signed *out) const;
+
+			inline FrameSection(const Debug& dbg, bool use_eh = false, bool lazy = false);
 		
 		private:
+			void build_indexes() const;
+			void decode_hdr_table() const;
+			void fill_decoded_hdr_table(decoded_hdr_table& t) const;
+			/* Using .eh_frame_hdr's search table, decoded; false if it can't say. */
+			bool find_fde_index_by_hdr(Dwarf_Addr pc, Dwarf_Signed *out_index) const;
 			// don't copy FrameSections
 			inline FrameSection(const FrameSection& arg)
 			: dbg(arg.dbg), fde_transformer(*this), cie_transformer(*this)
@@ -212,15 +280,7 @@ namespace dwarf
 			void init_eh_frame_hdr();
 		public:
 			
-			virtual ~FrameSection()
-			{
-				if (cie_data) dwarf_fde_cie_list_dealloc(dbg.raw_handle(), cie_data, cie_element_count, fde_data, fde_element_count);
-				else
-				{
-					assert(cie_element_count == 0);
-					assert(fde_element_count == 0);
-				}
-			};
+			inline virtual ~FrameSection(); // after Fde and Cie, which our vectors delete
 			/* "whole section" methods
 			     dwarf_set_frame_rule_table_size (for pre-getting-fde-info table sizing, ABI-dependent)
 			     dwarf_set_frame_rule_initial_value (similar)
@@ -312,21 +372,60 @@ namespace dwarf
 				}
 			};
 
+			/* The rules as decoded rows hold them. A rule is 16 bytes, with
+			 * expression rules pointing at the expression's bytes in the CFI
+			 * section rather than owning a decoded copy; expand() gives the
+			 * register_def. Rules are bzero'd before filling, so two rules
+			 * compare equal byte for byte. */
+			struct compact_rule
+			{
+				uint8_t k; // a register_def::kind
+				uint8_t unused;
+				uint16_t regnum; // the CFA's column, DW_FRAME_CFA_COL3, sorts with the rest
+				uint32_t expr_len; // for *_EXPR rules
+				union
+				{
+					int64_t offset; // for *_OFFSET_FROM_CFA rules
+					struct { int32_t reg; int32_t offset; } reg_plus_offset; // for REGISTER rules
+					const unsigned char *expr; // for *_EXPR rules
+				} u;
+				register_def expand(Dwarf_Debug dbg) const;
+				bool operator==(const compact_rule& r) const
+				{ return 0 == memcmp(this, &r, sizeof r); }
+				bool operator!=(const compact_rule& r) const { return !(*this == r); }
+			};
+
+			/* Decoded rows. Each row covers [lo, hi) and is a run of rules in
+			 * one flat array, sorted by register number, so decoding an FDE
+			 * costs a few vectors, not a tree of sets per row. Rows are sorted
+			 * by lo and don't overlap. As with the interval map that we used
+			 * to keep, a row with no rules is no row, and abutting rows with
+			 * the same rules are one row. Registers that a row doesn't mention
+			 * are INDETERMINATE. */
 			struct instrs_results
 			{
-				boost::icl::interval_map<Dwarf_Addr, set<pair<int /* regnum */, register_def > > > rows;
-				std::map<int, register_def> unfinished_row;
+				struct row
+				{
+					Dwarf_Addr lo;
+					Dwarf_Addr hi;
+					unsigned first_rule; // index into rules
+					unsigned n_rules;
+					bool operator==(const row& r) const
+					{ return lo == r.lo && hi == r.hi && first_rule == r.first_rule && n_rules == r.n_rules; }
+				};
+				std::vector<row> rows;
+				std::vector<compact_rule> rules;
+				std::vector<compact_rule> unfinished_row; // sorted by register number
 				Dwarf_Addr unfinished_row_addr;
-				
-				void add_unfinished_row(Dwarf_Addr high_pc) 
+
+				const compact_rule *rules_begin(const row& r) const { return rules.data() + r.first_rule; }
+				const compact_rule *rules_end(const row& r) const { return rules_begin(r) + r.n_rules; }
+				const row *find_row(Dwarf_Addr pc) const; // null if none covers pc
+				const compact_rule *find_rule(const row& r, int regnum) const; // null if indeterminate
+				void add_row(Dwarf_Addr lo, Dwarf_Addr hi, const std::vector<compact_rule>& row_rules);
+				void add_unfinished_row(Dwarf_Addr high_pc)
 				{
-					set< pair< int, FrameSection::register_def > > current_row_defs_set(
-						unfinished_row.begin(), unfinished_row.end()
-					);
-					rows += make_pair( 
-						boost::icl::interval<Dwarf_Addr>::right_open(unfinished_row_addr, high_pc),
-						current_row_defs_set
-					);
+					add_row(unfinished_row_addr, high_pc, unfinished_row);
 					unfinished_row.clear();
 					unfinished_row_addr = std::numeric_limits<Dwarf_Addr>::max();
 				}
@@ -337,6 +436,33 @@ namespace dwarf
 				Dwarf_Addr initial_row_addr, 
 				Dwarf_Ptr instrs, Dwarf_Unsigned instrs_len,
 				opt< const instrs_results & > initial_instrs_results = opt< const instrs_results & >()) const;
+			/* The CIE's initial instructions, interpreted as if for an FDE
+			 * starting at initial_row_addr. */
+			instrs_results cie_initial_results(const Cie& cie, Dwarf_Addr initial_row_addr) const;
+
+			/* Fde::decoded() remembers what it decodes, keyed by FDE offset,
+			 * keeping the max_entries most recently used (0 turns it off).
+			 * The CIEs' initial instructions are shared by many FDEs, so we
+			 * keep those too, keyed by the CIE's handle (libdwarf doesn't give
+			 * us its offset cheaply), under the same bound. A mutex guards
+			 * both, since decoding is a const operation. */
+			struct decode_cache_t
+			{
+				enum { DEFAULT_MAX_ENTRIES = 1024 };
+				typedef std::list<pair<Dwarf_Off, std::shared_ptr<const instrs_results> > > lru_list;
+				unsigned max_entries;
+				lru_list lru; // most recent first
+				std::unordered_map<Dwarf_Off, lru_list::iterator> where;
+				std::unordered_map<Dwarf_Cie, std::shared_ptr<const instrs_results> > cie_initial;
+				unsigned long hits;
+				unsigned long misses;
+				std::mutex mutex;
+				decode_cache_t() : max_entries(DEFAULT_MAX_ENTRIES), hits(0), misses(0) {}
+			};
+			mutable decode_cache_t decode_cache;
+			void set_decode_cache_size(unsigned max_entries);
+			unsigned get_decode_cache_size() const { return decode_cache.max_entries; }
+			void clear_decode_cache() { set_decode_cache_size(get_decode_cache_size()); }
 		};
 
 #define LIBDWARF_OK(ret) \
@@ -374,6 +500,7 @@ namespace dwarf
 			Dwarf_Cie raw_handle() const { return m_cie; };
 			inline FrameSection::cie_iterator iterator_here() const;
 			Dwarf_Off get_cie_offset() const { 
+				owner.ensure_indexes();
 				int index = iterator_here() - owner.cie_begin();
 				auto found = owner.cie_offsets_by_index.find(index);
 				assert(found != owner.cie_offsets_by_index.end());
@@ -498,6 +625,10 @@ namespace dwarf
 
 			FrameSection::instrs_results
 			decode() const;
+			/* As decode(), but shared with the owner's decode cache, so
+			 * cheap after the first time. */
+			std::shared_ptr<const FrameSection::instrs_results>
+			decoded() const;
 			
 			Dwarf_Fde raw_handle() const { return m_fde; }
 			Dwarf_Off get_fde_offset() const   { return fde_offset; }
@@ -592,13 +723,36 @@ namespace dwarf
 			}
 		};
 		
-		inline Fde FrameSection::fde_transformer_t::operator()(Dwarf_Fde fde) const
+		inline const Fde& FrameSection::fde_at(Dwarf_Signed index) const
 		{
-			return Fde(*p_owner, fde);
+			assert(index >= 0 && index < fde_element_count);
+			if (!fdes[index]) fdes[index].reset(new Fde(*this, fde_data[index]));
+			return *fdes[index];
 		}
-		inline Cie FrameSection::cie_transformer_t::operator()(Dwarf_Cie cie) const
+		inline const Cie& FrameSection::cie_at(Dwarf_Signed index) const
 		{
-			return Cie(*p_owner, cie);
+			assert(index >= 0 && index < cie_element_count);
+			if (!cies[index]) cies[index].reset(new Cie(*this, cie_data[index]));
+			return *cies[index];
+		}
+		inline const Fde& FrameSection::fde_transformer_t::operator()(const Dwarf_Fde& fde) const
+		{
+			return p_owner->fde_at(&fde - p_owner->fde_data);
+		}
+		inline const Cie& FrameSection::cie_transformer_t::operator()(const Dwarf_Cie& cie) const
+		{
+			return p_owner->cie_at(&cie - p_owner->cie_data);
+		}
+		inline FrameSection::~FrameSection()
+		{
+			/* Our Fdes and Cies only hold libdwarf's handles, so they can go
+			 * after the lists. */
+			if (cie_data) dwarf_fde_cie_list_dealloc(dbg.raw_handle(), cie_data, cie_element_count, fde_data, fde_element_count);
+			else
+			{
+				assert(cie_element_count == 0);
+				assert(fde_element_count == 0);
+			}
 		}
 		inline FrameSection::fde_iterator FrameSection::fde_begin() const { return fde_iterator(fde_data, fde_transformer); }
 		inline FrameSection::fde_iterator FrameSection::fde_end() const   { return fde_iterator(fde_data + fde_element_count, fde_transformer); }
@@ -615,8 +769,9 @@ namespace dwarf
 		inline FrameSection::fde_iterator FrameSection::begin() { return fde_begin(); }
 		inline FrameSection::fde_iterator FrameSection::end() { return fde_end(); }
 
-		inline FrameSection::FrameSection(const Debug& dbg, bool use_eh /* = false */)
-		 : dbg(dbg), using_eh(use_eh), is_64bit(false), fde_transformer(*this), cie_transformer(*this)
+		inline FrameSection::FrameSection(const Debug& dbg, bool use_eh /* = false */, bool lazy /* = false */)
+		 : dbg(dbg), using_eh(use_eh), is_64bit(false), lazy(lazy), indexes_built(false),
+		   fde_transformer(*this), cie_transformer(*this), hdr_tbl_decoded(false)
 		{
 
 			int ret = (use_eh ? dwarf_get_fde_list_eh : dwarf_get_fde_list)(
@@ -637,25 +792,10 @@ namespace dwarf
 				hdr_tbl_encoded_value_size = 0;
 				hdr_vaddr = 0;
 			}
+			fdes.resize(fde_element_count);
+			cies.resize(cie_element_count);
 
-			/* Since libdwarf doesn't let us get the CIE offset, do a pass
-			 * to build a table of these eagerly. */
-			for (auto i_fde = fde_begin(); i_fde != fde_end(); ++i_fde)
-			{
-				fde_offsets_by_cie_offset[i_fde->get_cie_offset()].insert(i_fde->get_fde_offset());
-				lib::Dwarf_Signed index;
-				lib::Dwarf_Cie cie;
-				int cie_ret = dwarf_get_cie_of_fde(i_fde->raw_handle(), &cie, &core::current_dwarf_error);
-				if (LIBDWARF_OK(cie_ret))
-				{
-					int index_ret = dwarf_get_cie_index(cie, &index, &core::current_dwarf_error);
-					assert(index_ret == DW_DLV_OK);
-					if (LIBDWARF_OK(index_ret))
-					{
-						cie_offsets_by_index[index] = i_fde->get_cie_offset();
-					}
-				}
-			}
+			if (!lazy) build_indexes();
 
 			/* libdwarf also doesn't expose the .eh_frame_hdr section. We only look
 			 * for it if we're using .eh_frame. */
@@ -674,6 +814,11 @@ namespace dwarf
 		}
 		inline FrameSection::fde_iterator FrameSection::find_fde_for_pc(Dwarf_Addr pc) const
 		{
+			Dwarf_Signed index;
+			if (find_fde_index_by_hdr(pc, &index))
+			{
+				return (index < 0) ? fde_end() : fde_iterator(fde_data + index, fde_transformer);
+			}
 			Dwarf_Addr lopc;
 			Dwarf_Addr hipc;
 			Dwarf_Fde fde;
@@ -681,10 +826,12 @@ namespace dwarf
 			if (!LIBDWARF_OK(ret)) return fde_end();
 			auto found = std::find(fde_data, fde_data + fde_element_count, fde);
 			assert(found != fde_data + fde_element_count);
+#ifndef NDEBUG
 			// assert that this FDE's range is consistent with what we asked for
-			Fde f(*this, fde);
+			const Fde& f = fde_at(found - fde_data);
 			assert(lopc >= f.get_low_pc() && lopc <  f.get_low_pc() + f.get_func_length());
 			assert(hipc >= f.get_low_pc() && hipc <= f.get_low_pc() + f.get_func_length());
+#endif
 			return fde_iterator(found, fde_transformer);
 		}
 		inline FrameSection::cie_iterator Cie::iterator_here() const
@@ -693,6 +840,65 @@ namespace dwarf
 			assert(found != owner.cie_end());
 			return found;
 		}
+
+		/* A compiled, flat form of the rows of every FDE in a FrameSection,
+		 * for when decode() is too heavy to call per lookup (think of an
+		 * unwinder, or a profiler taking samples; cf. the Linux kernel's ORC
+		 * tables). Each row covers [pc, next row's pc) and gives the rules
+		 * for the CFA and for a small fixed set of registers: by default,
+		 * the callee-saved ones and the return address column. Rules using
+		 * DWARF expressions point into a shared, deduplicated side table.
+		 * A row whose CFA rule is INDETERMINATE marks a gap between FDEs.
+		 * Registers that a row doesn't mention are INDETERMINATE, just as
+		 * in decode()'s output, and rules for registers we don't track are
+		 * dropped, though each row counts how many it lost. Lookups are a
+		 * binary search. The on-disk form is raw and in host byte order,
+		 * like the nav index, and carries the build-id of the binary whose
+		 * frame section it came from; loading checks both. */
+		struct cfi_table
+		{
+			enum { MAX_TRACKED_REGS = 8 };
+			struct rule
+			{
+				uint8_t k; // a FrameSection::register_def::kind
+				uint8_t unused;
+				uint16_t reg; // for REGISTER rules
+				int32_t offset; // offset, or for *_EXPR rules, index into exprs
+			};
+			struct row
+			{
+				Dwarf_Addr pc;
+				rule cfa;
+				rule regs[MAX_TRACKED_REGS]; // in the order of tracked_regs
+				/* Rules for registers not in tracked_regs. Unwinding through
+				 * a row with some is only as good as the caller's guess
+				 * that those registers don't matter. */
+				uint32_t n_untracked;
+				uint32_t unused;
+			};
+			std::vector<int> tracked_regs;
+			std::vector<row> rows; // sorted by pc
+			std::vector<encap::loc_expr> exprs;
+			opt<string> build_id; // of the binary we were compiled from
+
+			cfi_table() {}
+			explicit cfi_table(const FrameSection& fs,
+				const std::vector<int>& tracked_regs = std::vector<int>())
+			{ compile(fs, tracked_regs); }
+			/* An empty tracked_regs means the default set for the ELF machine.
+			 * Returns false if asked to track more than MAX_TRACKED_REGS. */
+			bool compile(const FrameSection& fs,
+				const std::vector<int>& tracked_regs = std::vector<int>());
+			static std::vector<int> default_tracked_regs(const FrameSection& fs);
+			opt<unsigned> tracked_index(int regnum) const;
+			/* Null if no FDE covers pc. */
+			const row *find_row(Dwarf_Addr pc) const;
+			const encap::loc_expr& expr_for(const rule& r) const { return exprs.at(r.offset); }
+			/* Saving needs a build-id; loading fails unless the file's
+			 * matches fs's binary. */
+			bool save(const string& filename) const;
+			bool load(const string& filename, const FrameSection& fs);
+		};
 	}
 }
 
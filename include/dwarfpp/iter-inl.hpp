@@ -24,7 +24,8 @@ namespace dwarf
 	{
 		inline spec& iterator_base::spec_here() const
 		{
-			if (tag_here() == DW_TAG_compile_unit)
+			if (state == OFFSET_ONLY) return *m_p_spec;
+			if (tag_is_cu(tag_here()))
 			{
 				// we only ask CUs for their spec after payload construction
 				assert(state == WITH_PAYLOAD);
@@ -44,10 +44,27 @@ namespace dwarf
 				mutable Die cur_handle; // to copy this, have to upgrade it
 				mutable root_die::ptr_type cur_payload; // payload = handle + shared count + extra state
 			// };
-			mutable enum { HANDLE_ONLY, WITH_PAYLOAD } state;
+			mutable enum { HANDLE_ONLY, WITH_PAYLOAD, OFFSET_ONLY } state;
 			/* ^-- this is the absolutely key design point that makes this code fast.
 			 * An iterator can either be a libdwarf handle, or a pointer to some
-			 * refcounted state (including such a handle, and maybe other cached stuff). */
+			 * refcounted state (including such a handle, and maybe other cached stuff).
+			 * Copying a handle means asking libdwarf for another, so a copy
+			 * starts out OFFSET_ONLY: just the offset, tag and spec, with
+			 * neither handle nor payload. Comparing offsets, tags and depths
+			 * never needs more; anything else materialize()s a handle first,
+			 * or picks up the payload if the DIE has gone live meanwhile. */
+			mutable Dwarf_Off m_off; // these three are only good when OFFSET_ONLY
+			mutable Dwarf_Half m_tag;
+			mutable spec *m_p_spec;
+			void materialize() const; // OFFSET_ONLY -> HANDLE_ONLY or WITH_PAYLOAD
+			void ensure_handle() const { if (state == OFFSET_ONLY) materialize(); }
+			void copy_offset_only(const iterator_base& arg)
+			{
+				this->state = OFFSET_ONLY;
+				this->m_off = arg.offset_here();
+				this->m_tag = arg.tag_here();
+				this->m_p_spec = &arg.spec_here();
+			}
 		public:
 			string summary() const { if (is_end_position()) return "(END)";
 				if (is_root_position()) return "(root)";
@@ -58,6 +75,7 @@ namespace dwarf
 				{ assert(!cur_handle.handle && !cur_payload); return cur_handle; }
 				switch (state)
 				{
+					case OFFSET_ONLY: materialize(); return get_handle();
 					case HANDLE_ONLY: return cur_handle;
 					case WITH_PAYLOAD: {
 						if (cur_payload->d.handle) return cur_payload->d;
@@ -78,7 +96,8 @@ namespace dwarf
 			// we are in an unusable state after this constructor
 			// -- the same state as end()!
 			iterator_base()
-			 : cur_handle(Die(nullptr, nullptr)), cur_payload(nullptr), state(HANDLE_ONLY), m_opt_depth(), p_root(nullptr) {}
+			 : cur_handle(Die(nullptr, nullptr)), cur_payload(nullptr), state(HANDLE_ONLY),
+			   m_off(0), m_tag(0), m_p_spec(nullptr), m_opt_depth(), p_root(nullptr) {}
 			
 			static const iterator_base END; // sentinel definition
 			
@@ -86,9 +105,9 @@ namespace dwarf
 			 * and non-null root pointer.
 			 * cf. end position, which has null root pointer. */
 			bool is_root_position() const 
-			{ return p_root && !cur_handle.handle && !cur_payload; }
+			{ return p_root && state != OFFSET_ONLY && !cur_handle.handle && !cur_payload; }
 			bool is_end_position() const 
-			{ return !p_root && !cur_handle.handle && !cur_payload; }
+			{ return !p_root && state != OFFSET_ONLY && !cur_handle.handle && !cur_payload; }
 			bool is_real_die_position() const 
 			{ return !is_root_position() && !is_end_position(); }
 			bool is_under(const iterator_base& i) const
@@ -96,7 +115,8 @@ namespace dwarf
 			
 			// this constructor sets us up at begin(), i.e. the root DIE position
 			explicit iterator_base(root_die& r)
-			 : cur_handle(nullptr, nullptr), cur_payload(nullptr), state(HANDLE_ONLY), m_opt_depth(0), p_root(&r) 
+			 : cur_handle(nullptr, nullptr), cur_payload(nullptr), state(HANDLE_ONLY),
+			   m_off(0), m_tag(0), m_p_spec(nullptr), m_opt_depth(0), p_root(&r) 
 			{
 				assert(this->is_root_position());
 			}
@@ -104,7 +124,8 @@ namespace dwarf
 			// this constructor sets us up using a handle -- 
 			// this does the exploitation of the sticky set
 			iterator_base(abstract_die&& d, opt<unsigned short> opt_depth, root_die& r)
-			 : cur_handle(Die(nullptr, nullptr)), cur_payload(nullptr) // will be replaced in function body...
+			 : cur_handle(Die(nullptr, nullptr)), cur_payload(nullptr), // will be replaced in function body...
+			   m_off(0), m_tag(0), m_p_spec(nullptr)
 			{
 				// get the offset of the handle we've been passed
 				Dwarf_Off off = d.get_offset(); 
@@ -117,6 +138,7 @@ namespace dwarf
 					state = WITH_PAYLOAD;
 					cur_payload = found->second;
 					assert(cur_payload);
+					r.note_payload_use(found->second);
 					//m_opt_depth = found->second->get_depth(); assert(depth == m_opt_depth);
 					//p_root = &found->second->get_root();
 				}
@@ -127,7 +149,8 @@ namespace dwarf
 					state = WITH_PAYLOAD;
 					cur_payload = factory::for_spec(d.get_spec(r)).make_payload(std::move(d), r);
 					assert(cur_payload);
-					r.sticky_dies[off] = cur_payload;
+					// a frozen root already made its sticky DIEs; don't touch the set
+					if (!r.is_frozen()) r.sticky_dies[off] = cur_payload;
 				}
 				else
 				{
@@ -139,9 +162,16 @@ namespace dwarf
 				p_root = &r;
 			}
 			
+			/* Construct us OFFSET_ONLY from scratch, for a reader that knows
+			 * the tag without a handle (see root_die::set_reader()). */
+			iterator_base(Dwarf_Off off, Dwarf_Half tag, spec& s, opt<unsigned short> opt_depth, root_die& r)
+			 : cur_handle(Die(nullptr, nullptr)), cur_payload(nullptr), state(OFFSET_ONLY),
+			   m_off(off), m_tag(tag), m_p_spec(&s), m_opt_depth(opt_depth), p_root(&r) {}
+			
 			/* Construct us from a basic_die? Why not.... */
 			iterator_base(const basic_die& d, opt<unsigned short> opt_depth = opt<unsigned short>())
-			 : cur_handle(Die(nullptr, nullptr)), cur_payload(const_cast<basic_die*>(&d))
+			 : cur_handle(Die(nullptr, nullptr)), cur_payload(const_cast<basic_die*>(&d)),
+			   m_off(0), m_tag(0), m_p_spec(nullptr)
 			{
 				state = WITH_PAYLOAD;
 				m_opt_depth = opt_depth;
@@ -152,8 +182,9 @@ namespace dwarf
 			// copy constructor
 			iterator_base(const iterator_base& arg)
 				/* We used to always make payload on copying.
-				 * We no longer do that; instead, if we're a handle, just ask libdwarf
-				 * for a fresh handle. This still does an allocation (in libdwarf, not
+				 * We no longer do that; instead, if we're a handle, we become
+				 * OFFSET_ONLY, and ask libdwarf for a fresh handle only if
+				 * somebody needs one. That is an allocation (in libdwarf, not
 				 * in our code) and will cause our code to do *another* allocation if
 				 * we dereference the iterator -- UNLESS the DIE at that offset has
 				 * already been materialised via another iterator, in which case we'll
@@ -165,6 +196,7 @@ namespace dwarf
 				 * cannot rely on a payload's handle being the only live handle
 				 * on that DIE (but we can rely on its being the only payload). */
 			 : cur_handle(nullptr, nullptr),
+			   m_off(0), m_tag(0), m_p_spec(nullptr),
 			   m_opt_depth(arg.m_opt_depth), 
 			   p_root(arg.is_end_position() ? nullptr : &arg.get_root())
 			{
@@ -188,12 +220,12 @@ namespace dwarf
 						this->state = WITH_PAYLOAD;
 						this->cur_payload = arg.cur_payload;
 						break;
-					case HANDLE_ONLY: {
-						Die tmp(*p_root, arg.offset_here());
-						this->state = HANDLE_ONLY;
-						this->cur_handle = std::move(tmp);
+					case HANDLE_ONLY:
+					case OFFSET_ONLY:
+						/* Don't ask libdwarf for a handle until we need one. */
+						copy_offset_only(arg);
 						this->cur_payload = nullptr;
-					} break;
+						break;
 					default: assert(false);
 				}
 			}
@@ -203,6 +235,7 @@ namespace dwarf
 			 : cur_handle(std::move(arg.cur_handle)),
 			   cur_payload(arg.cur_payload),
 			   state(arg.state),
+			   m_off(arg.m_off), m_tag(arg.m_tag), m_p_spec(arg.m_p_spec),
 			   m_opt_depth(arg.m_opt_depth),
 			   p_root(arg.is_end_position() ? nullptr : &arg.get_root())
 			{}
@@ -241,12 +274,13 @@ namespace dwarf
 						this->state = WITH_PAYLOAD;
 						this->cur_payload = arg.cur_payload;
 						break;
-					case HANDLE_ONLY: {
-						this->state = HANDLE_ONLY;
-						Die tmp(*p_root, arg.offset_here());
-						this->cur_handle = std::move(tmp);
+					case HANDLE_ONLY:
+					case OFFSET_ONLY:
+						if (&arg == this) break;
+						copy_offset_only(arg);
+						this->cur_handle = std::move(Die(nullptr, nullptr));
 						this->cur_payload = nullptr;
-					} break;
+						break;
 					default: assert(false);
 				}
 
@@ -259,6 +293,9 @@ namespace dwarf
 				this->cur_handle = std::move(arg.cur_handle);
 				this->cur_payload = std::move(arg.cur_payload);
 				this->state = std::move(arg.state);
+				this->m_off = arg.m_off;
+				this->m_tag = arg.m_tag;
+				this->m_p_spec = arg.m_p_spec;
 				this->m_opt_depth = std::move(arg.m_opt_depth);
 				this->p_root = std::move(arg.p_root);
 				return *this;
@@ -282,6 +319,10 @@ namespace dwarf
 			name_here() const;
 			opt<string> 
 			global_name_here() const;
+			/* Like the above, but without making a string; see
+			 * basic_die::get_name_view(). data() is null if there's no name. */
+			string_view name_view_here() const;
+			string_view global_name_view_here() const;
 			
 			inline spec& spec_here() const;
 			
@@ -306,6 +347,7 @@ namespace dwarf
 			inline encap::attribute_map copy_attrs() const
 			{
 				if (is_root_position()) return encap::attribute_map();
+				ensure_handle();
 				if (state == HANDLE_ONLY)
 				{
 					return encap::attribute_map(
@@ -323,17 +365,14 @@ namespace dwarf
 			inline encap::attribute_value attr(Dwarf_Half attr) const
 			{
 				if (is_root_position()) return encap::attribute_value();
+				ensure_handle();
 				if (state == HANDLE_ONLY)
 				{
-					AttributeList l(dynamic_cast<Die&>(get_handle()));
-					for (auto i = l.copied_list.begin(); i != l.copied_list.end(); ++i)
-					{
-						if (i->attr_here() == attr)
-						{
-							return encap::attribute_value(*i, dynamic_cast<Die&>(get_handle()), get_root());
-						}
-					}
-					return encap::attribute_value();
+					// ask for just this attribute, not the whole list
+					Die& h = dynamic_cast<Die&>(get_handle());
+					Attribute::handle_type found = Attribute::try_construct(h, attr);
+					if (!found) return encap::attribute_value();
+					return encap::attribute_value(Attribute(std::move(found)), h, get_root());
 				} 
 				else 
 				{
@@ -452,13 +491,34 @@ namespace dwarf
 		/* Now we can define that pesky template operator function. 
 		 * The factory exposes a dummy method (NOT type-level though! it's 
 		 * polymorphic!) that returns us a fake singleton of any instantiable  
-		 * DIE type. */
+		 * DIE type. Whether the dummy is a Payload depends only on the tag, 
+		 * so we ask once per tag, the first time we're used, and keep the 
+		 * answers in a table. Tags past the factory's last all get the
+		 * basic_die dummy, so share one answer. */
+		template <typename Payload>
+		struct tag_is_a_table
+		{
+			std::vector<bool> by_tag;
+			bool other;
+			tag_is_a_table(factory& f) : by_tag(f.max_tag() + 1),
+				other(dynamic_cast<Payload *>(f.dummy_for_tag(0)) != nullptr)
+			{
+				for (unsigned tag = 0; tag < by_tag.size(); ++tag)
+				{
+					by_tag[tag] = dynamic_cast<Payload *>(f.dummy_for_tag(tag)) != nullptr;
+				}
+			}
+			bool operator()(Dwarf_Half tag) const
+			{ return tag < by_tag.size() ? by_tag[tag] : other; }
+		};
 		template <typename Payload>
 		inline bool is_a_t<Payload>::operator()(const iterator_base& it) const
 		{
-			return dynamic_cast<Payload *>(
-				factory::for_spec(it.spec_here()).dummy_for_tag(it.tag_here())
-			) ? true : false;
+			/* There is only one factory so far (see for_spec()), so we
+			 * needn't find the DIE's spec. */
+			static const tag_is_a_table<Payload> table(
+				factory::for_spec(dwarf::spec::dwarf_current));
+			return table(it.tag_here());
 		}
 		
 
@@ -571,17 +631,18 @@ namespace dwarf
 			void increment()
 			{
 				Dwarf_Off start_offset = offset_here();
+				const root_die *p_start_root = &get_root();
 				if (get_root().move_to_first_child(base_reference()))
 				{
-					// our offsets should only go up
-					assert(offset_here() > start_offset);
+					// our offsets should only go up (unless a splice took us to another root)
+					assert(&get_root() != p_start_root || offset_here() > start_offset);
 					return;
 				}
 				do
 				{
 					if (get_root().move_to_next_sibling(base_reference()))
 					{
-						assert(offset_here() > start_offset);
+						assert(&get_root() != p_start_root || offset_here() > start_offset);
 						return;
 					}
 				} while (get_root().move_to_parent(base_reference()));
@@ -598,7 +659,7 @@ namespace dwarf
 			bool equal(const self& arg) const { return this->base() == arg.base(); }
 			
 			DerefAs& dereference() const
-			{ return dynamic_cast<DerefAs&>(this->iterator_base::dereference()); }
+			{ return payload_cast<DerefAs>(this->iterator_base::dereference()); }
 		};
 		/* assert that our opt<> specialization for subclasses of iterator_base 
 		 * has had its effect. */
@@ -619,7 +680,48 @@ namespace dwarf
 			friend class boost::iterator_core_access;
 
 			// extra state needed!
-			deque< iterator_base > m_queue;
+			/* We queue positions, not iterators, so that a queued DIE holds
+			 * neither a libdwarf handle nor a payload. The root gives us an
+			 * iterator back when the position comes off the queue. Meanwhile
+			 * it's pinned, so that the cache budget can't evict what we'll
+			 * need to carry on from it. */
+			struct queued_pos
+			{
+				Dwarf_Off off;
+				unsigned short depth; // 0 if we didn't know it; the root is never queued
+				bool pinned;
+			};
+			deque< queued_pos > m_queue;
+			void enqueue(const iterator_base& i)
+			{
+				m_queue.push_back((queued_pos) { i.offset_here(),
+					i.maybe_depth() ? *i.maybe_depth() : (unsigned short) 0,
+					get_root().pin_position(i.offset_here()) });
+			}
+			void dequeue()
+			{
+				queued_pos q = m_queue.front();
+				m_queue.pop_front();
+				if (q.pinned) get_root().unpin_position(q.off);
+				this->base_reference() = get_root().pos<iterator_base>(q.off,
+					q.depth ? opt<unsigned short>(q.depth) : opt<unsigned short>());
+			}
+			/* Whenever the queue is non-empty, we're at a real position. */
+			void pin_queue()
+			{
+				for (auto i = m_queue.begin(); i != m_queue.end(); ++i)
+				{
+					if (i->pinned) i->pinned = get_root().pin_position(i->off);
+				}
+			}
+			void clear_queue()
+			{
+				for (auto i = m_queue.begin(); i != m_queue.end(); ++i)
+				{
+					if (i->pinned) get_root().unpin_position(i->off);
+				}
+				m_queue.clear();
+			}
 			
 			iterator_base& base_reference()
 			{ return static_cast<iterator_base&>(*this); }
@@ -632,18 +734,33 @@ namespace dwarf
 			iterator_bf(iterator_base&& arg)
 			 : iterator_base(arg) {}
 			iterator_bf(const iterator_bf<DerefAs>& arg)
-			 : iterator_base(arg), m_queue(arg.m_queue) {}// this COPIES so avoid
+			 : iterator_base(arg), m_queue(arg.m_queue) { pin_queue(); }// this COPIES so avoid
 			iterator_bf(iterator_bf<DerefAs>&& arg)
-			 : iterator_base(arg), m_queue(std::move(arg.m_queue)) {}
+			 : iterator_base(arg), m_queue(std::move(arg.m_queue)) { arg.m_queue.clear(); }
+			~iterator_bf() { clear_queue(); }
 			
 			iterator_bf& operator=(const iterator_base& arg) 
-			{ this->base_reference() = arg; this->m_queue.clear(); return *this; }
+			{ clear_queue(); this->base_reference() = arg; return *this; }
 			iterator_bf& operator=(iterator_base&& arg) 
-			{ this->base_reference() = std::move(arg); this->m_queue.clear(); return *this; }
+			{ clear_queue(); this->base_reference() = std::move(arg); return *this; }
 			iterator_bf& operator=(const iterator_bf<DerefAs>& arg) 
-			{ this->base_reference() = arg; this->m_queue = arg.m_queue; return *this; }
+			{
+				if (&arg == this) return *this;
+				clear_queue();
+				this->base_reference() = arg;
+				this->m_queue = arg.m_queue;
+				pin_queue();
+				return *this;
+			}
 			iterator_bf& operator=(iterator_bf<DerefAs>&& arg) 
-			{ this->base_reference() = std::move(arg); this->m_queue =std::move(arg.m_queue); return *this; }
+			{
+				if (&arg == this) return *this;
+				clear_queue();
+				this->base_reference() = std::move(arg);
+				this->m_queue = std::move(arg.m_queue);
+				arg.m_queue.clear();
+				return *this;
+			}
 
 			void increment()
 			{
@@ -663,7 +780,7 @@ namespace dwarf
 				//   ^-- might be END
 				
 				// we ALWAYS enqueue the first child if there is one
-				if (first_child != iterator_base::END) m_queue.push_back(first_child);
+				if (first_child != iterator_base::END) enqueue(first_child);
 				
 				if (get_root().move_to_next_sibling(this->base_reference()))
 				{
@@ -673,10 +790,7 @@ namespace dwarf
 				else
 				{
 					// no more siblings; use the queue
-					if (m_queue.size() > 0)
-					{
-						this->base_reference() = m_queue.front(); m_queue.pop_front();
-					}
+					if (m_queue.size() > 0) dequeue();
 					else
 					{
 						this->base_reference() = iterator_base::END;
@@ -688,13 +802,9 @@ namespace dwarf
 				auto first_child = get_root().first_child(this->base_reference()); 
 				//   ^-- might be END
 				// we ALWAYS enqueue the first child if there is one
-				if (first_child != iterator_base::END) m_queue.push_back(first_child);
+				if (first_child != iterator_base::END) enqueue(first_child);
 				// no more siblings; use the queue
-				if (m_queue.size() > 0)
-				{
-					this->base_reference() = m_queue.front();
-					m_queue.pop_front();
-				}
+				if (m_queue.size() > 0) dequeue();
 				else
 				{
 					this->base_reference() = iterator_base::END;
@@ -715,7 +825,7 @@ namespace dwarf
 				}
 				else if (m_queue.size() > 0)
 				{
-					this->base_reference() = m_queue.front(); m_queue.pop_front();
+					dequeue();
 					assert(!is_real_die_position() || offset_here() > 0);
 				}
 				else
@@ -730,7 +840,7 @@ namespace dwarf
 				assert(false); // FIXME
 			}
 			DerefAs& dereference() const
-			{ return dynamic_cast<DerefAs&>(this->iterator_base::dereference()); }
+			{ return payload_cast<DerefAs>(this->iterator_base::dereference()); }
 		};
 		
 		template <typename DerefAs /* = basic_die*/>
@@ -786,7 +896,7 @@ namespace dwarf
 			
 			bool equal(const self& arg) const { return this->base() == arg.base(); }
 			DerefAs& dereference() const
-			{ return dynamic_cast<DerefAs&>(this->iterator_base::dereference()); }
+			{ return payload_cast<DerefAs>(this->iterator_base::dereference()); }
 		};
 		
 		inline unsigned short iterator_base::depth() const
@@ -828,10 +938,7 @@ namespace dwarf
 				if (ret)
 				{
 					/* install in cache */
-					string name = *i_g.name_here();
-					r.visible_named_grandchildren_cache.insert(
-						make_pair(name, i_g.offset_here())
-					);
+					r.note_visible_named_grandchild(i_g.name_view_here(), i_g.offset_here());
 				}
 				/* Have we now swept the entire sequence of grandchildren? 
 				 * If so, we can mark the cache as exhaustive. */
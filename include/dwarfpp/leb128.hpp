@@ -0,0 +1,183 @@
+/* dwarfpp: C++ binding for a useful subset of libdwarf, plus extra goodies.
+ *
+ * leb128.hpp: decoding and encoding (U|S)LEB128 numbers
+ *
+ * Copyright (c) 2008--17, Stephen Kell. For licensing information, see the
+ * LICENSE file in the root of the libdwarfpp tree.
+ */
+
+#ifndef DWARFPP_LEB128_HPP_
+#define DWARFPP_LEB128_HPP_
+
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+#include <string>
+
+namespace dwarf
+{
+	namespace core
+	{
+		/* Everything that walks raw DWARF bytes (CFI, location expressions,
+		 * the native DIE reader) decodes its LEB128s here. Decoding never
+		 * reads at or past end: a number running into end is an error,
+		 * leaving p where it was. Bits beyond the 64th are dropped, as
+		 * others do for over-long encodings.
+		 *
+		 * Most numbers are one byte, so that's tested first. After that,
+		 * if there are eight bytes to read, we read them as one word, find
+		 * the terminating byte from the high bits, and squeeze out the
+		 * continuation bits with masks and shifts; that's without branches
+		 * on the bytes, for anything up to 56 bits. Longer numbers (or
+		 * ones near the end of the data, or on big-endian hosts) go a byte
+		 * at a time. That only pays off on runs of one-byte numbers, which
+		 * decode about three times faster than bytewise; with lengths
+		 * mixed, the mispredicted length branches cost about the same
+		 * either way.
+		 *
+		 * We take and give unsigned long long and long long, which are what
+		 * libdwarf's Dwarf_Unsigned and Dwarf_Signed are, so callers can pass
+		 * pointers to those. */
+		static_assert(sizeof (unsigned long long) == 8, "LEB128 numbers are 64 bits");
+		namespace leb128_detail
+		{
+			inline bool decode_slow(const unsigned char *&p, const unsigned char *end,
+				uint64_t *out, unsigned *out_nbits)
+			{
+				const unsigned char *pos = p;
+				uint64_t v = 0;
+				unsigned shift = 0;
+				while (pos < end)
+				{
+					unsigned char b = *pos++;
+					if (shift < 64) v |= (uint64_t) (b & 0x7f) << shift;
+					shift += 7;
+					if (!(b & 0x80))
+					{
+						*out = v;
+						*out_nbits = shift;
+						p = pos;
+						return true;
+					}
+				}
+				return false;
+			}
+			/* The first n bytes' low 7 bits each, packed, from a
+			 * little-endian word; n is 1 to 8. */
+			inline uint64_t squeeze(uint64_t word, unsigned n)
+			{
+				uint64_t x = (n == 8) ? word : (word & ((((uint64_t) 1) << (8 * n)) - 1));
+				x &= 0x7f7f7f7f7f7f7f7fULL;
+				x = ((x & 0x7f007f007f007f00ULL) >> 1) | (x & 0x007f007f007f007fULL);
+				x = ((x & 0x3fff00003fff0000ULL) >> 2) | (x & 0x00003fff00003fffULL);
+				x = ((x & 0x0fffffff00000000ULL) >> 4) | (x & 0x000000000fffffffULL);
+				return x;
+			}
+			inline bool decode(const unsigned char *&p, const unsigned char *end,
+				uint64_t *out, unsigned *out_nbits)
+			{
+				if (p < end && !(*p & 0x80))
+				{
+					*out = *p++;
+					*out_nbits = 7;
+					return true;
+				}
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+				if (end - p >= 8)
+				{
+					uint64_t word;
+					memcpy(&word, p, sizeof word);
+					uint64_t stops = ~word & 0x8080808080808080ULL;
+					if (stops)
+					{
+						unsigned n = (__builtin_ctzll(stops) >> 3) + 1;
+						*out = squeeze(word, n);
+						*out_nbits = 7 * n;
+						p += n;
+						return true;
+					}
+				}
+#endif
+				return decode_slow(p, end, out, out_nbits);
+			}
+		}
+
+		inline bool read_uleb128(const unsigned char *&p, const unsigned char *end, unsigned long long *out)
+		{
+			uint64_t v;
+			unsigned nbits;
+			if (!leb128_detail::decode(p, end, &v, &nbits)) return false;
+			if (out) *out = v;
+			return true;
+		}
+		inline bool read_sleb128(const unsigned char *&p, const unsigned char *end, long long *out)
+		{
+			uint64_t v;
+			unsigned nbits;
+			if (!leb128_detail::decode(p, end, &v, &nbits)) return false;
+			if (nbits < 64 && (v >> (nbits - 1)) & 1) v |= ~(uint64_t) 0 << nbits;
+			if (out) *out = (long long) v;
+			return true;
+		}
+		/* Runs of operands, e.g. an opcode's register and offset, or an
+		 * abbrev's attribute-form pairs: up to n numbers into out, stopping
+		 * at the first that doesn't decode. Returns how many did. A word
+		 * with no continuation bits is eight one-byte numbers at once. */
+		inline size_t read_uleb128s(const unsigned char *&p, const unsigned char *end,
+			unsigned long long *out, size_t n)
+		{
+			size_t i = 0;
+			while (i < n)
+			{
+				if (n - i >= 8 && end - p >= 8)
+				{
+					uint64_t word;
+					memcpy(&word, p, sizeof word);
+					if (!(word & 0x8080808080808080ULL))
+					{
+						for (unsigned j = 0; j < 8; ++j) out[i + j] = p[j];
+						i += 8;
+						p += 8;
+						continue;
+					}
+				}
+				if (!read_uleb128(p, end, &out[i])) break;
+				++i;
+			}
+			return i;
+		}
+		inline size_t read_sleb128s(const unsigned char *&p, const unsigned char *end,
+			long long *out, size_t n)
+		{
+			size_t i = 0;
+			while (i < n && read_sleb128(p, end, &out[i])) ++i;
+			return i;
+		}
+
+		/* Encoding appends the fewest bytes that will do. */
+		inline void write_uleb128(std::string& out, unsigned long long v)
+		{
+			do
+			{
+				unsigned char byte = v & 0x7f;
+				v >>= 7;
+				if (v) byte |= 0x80;
+				out += (char) byte;
+			} while (v);
+		}
+		inline void write_sleb128(std::string& out, long long v)
+		{
+			bool more = true;
+			while (more)
+			{
+				unsigned char byte = v & 0x7f;
+				v >>= 7; // arithmetic, so the sign comes along
+				more = !((v == 0 && !(byte & 0x40)) || (v == -1 && (byte & 0x40)));
+				if (more) byte |= 0x80;
+				out += (char) byte;
+			}
+		}
+	}
+}
+
+#endif
@@ -0,0 +1,62 @@
+/* dwarfpp: C++ binding for a useful subset of libdwarf, plus extra goodies.
+ *
+ * libdw-reader.hpp: navigating with elfutils' libdw instead of libdwarf
+ *
+ * Copyright (c) 2008--17, Stephen Kell. For licensing information, see the
+ * LICENSE file in the root of the libdwarfpp tree.
+ */
+
+#ifndef DWARFPP_LIBDW_READER_HPP_
+#define DWARFPP_LIBDW_READER_HPP_
+
+#include <vector>
+#include "die-reader.hpp"
+
+namespace dwarf
+{
+	namespace core
+	{
+		namespace libdw_glue { struct session; }
+
+		/* A die_reader over libdw, only there if we're configured
+		 * --with-libdw (HAVE_LIBDW). libdw decompresses sections itself,
+		 * so unlike native_reader this works on any root_die, including
+		 * one opened from just an fd; for one opened from an image, libdw
+		 * shares the image's Elf. Unit headers are read when constructed;
+		 * everything else is libdw's, including whatever it caches (its
+		 * abbreviations are decoded lazily, under its own locks). We only
+		 * navigate with it: attribute values are still libdwarf's, so the
+		 * file is decoded by both libraries, each for its own part. */
+		class libdw_reader : public die_reader
+		{
+			libdw_glue::session *s;
+			struct unit
+			{
+				Dwarf_Off offset;
+				Dwarf_Off end;
+				Dwarf_Off die_offset;
+			};
+			std::vector<unit> units;
+		public:
+			/* elf, if not null, is an ::Elf from elfutils' libelf. */
+			libdw_reader(int fd, ::Elf *elf);
+			~libdw_reader();
+			libdw_reader(const libdw_reader&) = delete;
+			libdw_reader& operator=(const libdw_reader&) = delete;
+			bool ok() const { return s != nullptr; }
+
+			root_die::reader_kind kind() const { return root_die::LIBDW_READER; }
+			unsigned unit_count() const { return units.size(); }
+			Dwarf_Off unit_die_offset(unsigned idx) const { return units[idx].die_offset; }
+			bool unit_index_for(Dwarf_Off off, unsigned *p_idx) const;
+			Dwarf_Half tag_at(unsigned u, Dwarf_Off off) const;
+			Dwarf_Off first_child(unsigned u, Dwarf_Off off) const;
+			Dwarf_Off next_sibling(unsigned u, Dwarf_Off off) const;
+			bool has_attr(unsigned u, Dwarf_Off off, Dwarf_Half attr) const;
+			/* Points into libdw's copy of the string sections. */
+			string_view name(unsigned u, Dwarf_Off off) const;
+		};
+	}
+}
+
+#endif
@@ -15,6 +15,8 @@
 #include <utility>
 #include <functional>
 #include <vector>
+#include <atomic>
+#include <mutex>
 
 namespace dwarf
 {
@@ -38,6 +40,25 @@ namespace dwarf
 		// typedef struct Dwarf_Error_s*      Dwarf_Error;
 		void exception_error_handler(Dwarf_Error error, Dwarf_Ptr errarg);
 
+		/* libdwarf is not thread-safe: anything that allocates or frees
+		 * (DIEs, attributes, lists, strings) updates state hanging off the
+		 * Dwarf_Debug. While some root_die is frozen for use by many threads
+		 * (see root_die::freeze()), we serialize those calls using one
+		 * process-wide lock. Otherwise the guard is a single atomic load.
+		 * It's recursive because deleters can run while we hold it. */
+		extern std::atomic<unsigned> frozen_root_count;
+		std::recursive_mutex& libdwarf_alloc_mutex();
+		struct libdwarf_alloc_guard
+		{
+			bool locked;
+			libdwarf_alloc_guard()
+			 : locked(frozen_root_count.load(std::memory_order_acquire) > 0)
+			{ if (locked) libdwarf_alloc_mutex().lock(); }
+			~libdwarf_alloc_guard() { if (locked) libdwarf_alloc_mutex().unlock(); }
+			libdwarf_alloc_guard(const libdwarf_alloc_guard&) = delete;
+			libdwarf_alloc_guard& operator=(const libdwarf_alloc_guard&) = delete;
+		};
+
 		/* What follows is a fairly mechanical translation of libdwarf,
 		 * plus destruction logic from the docs. */
 		typedef struct Dwarf_Debug_s*      Dwarf_Debug; // pasted from libdwarf.h
@@ -47,16 +68,23 @@ namespace dwarf
 			typedef Dwarf_Debug_s opaque_type;
 			struct deleter
 			{
+				bool via_object; // opened by dwarf_object_init(), so dwarf_object_finish()
+				deleter(bool via_object = false) : via_object(via_object) {}
 				void operator ()(raw_handle_type arg) const;
 			};
 			typedef unique_ptr<opaque_type, deleter> handle_type;
 			
 			handle_type handle;
+			/* libdwarf can only give us the Elf handle if it is reading
+			 * through libelf. When it's reading through our own object
+			 * interface, whoever opened us records one here. */
+			::Elf *object_elf;
 			
 			// define constructors analogous to the libdwarf resource-acquisition functions
 			Debug(int fd); /* FIXME: release Elf handle implicitly left open after dwarf_finish(). */
 			Debug(Elf *elf);
-			Debug() : handle(nullptr) {}
+			Debug(Dwarf_Obj_Access_Interface *obj, Elf *elf);
+			Debug() : handle(nullptr), object_elf(nullptr) {}
 			
 			raw_handle_type raw_handle()       { return handle.get(); }
 			raw_handle_type raw_handle() const { return handle.get(); }
@@ -76,6 +104,7 @@ namespace dwarf
 			{ 
 				if (dbg)
 				{
+					libdwarf_alloc_guard g;
 					dwarf_dealloc(dbg, 
 						const_cast<void*>(static_cast<const void *>(arg)), 
 						DW_DLA_STRING);
@@ -99,7 +128,7 @@ namespace dwarf
 				//deleter() : dbg(nullptr) {}
 				// temporarily DISABLED while we check we only use it where necessary
 				void operator ()(raw_handle_type arg) const 
-				{ if (!dbg) assert(!arg); else if (arg) dwarf_dealloc(dbg, arg, DW_DLA_DIE); }
+				{ if (!dbg) assert(!arg); else if (arg) { libdwarf_alloc_guard g; dwarf_dealloc(dbg, arg, DW_DLA_DIE); } }
 			};
 			typedef unique_ptr<opaque_type, deleter> handle_type;
 			handle_type handle;
@@ -142,6 +171,10 @@ namespace dwarf
 			Dwarf_Off offset_here() const;
 			Dwarf_Half tag_here() const;
 			std::unique_ptr<const char, string_deleter> name_here() const;
+			/* No copy and no allocation: this points straight into the
+			 * string section (or .debug_info), so it's good for as long as
+			 * the Dwarf_Debug. data() is null if we have no name. */
+			string_view name_view_here() const;
 			Dwarf_Off enclosing_cu_offset_here() const;
 			bool has_attr_here(Dwarf_Half attr) const;
 			bool has_attribute_here(Dwarf_Half attr) const { return has_attr_here(attr); }
@@ -157,7 +190,10 @@ namespace dwarf
 			inline Dwarf_Off get_offset() const { return offset_here(); }
 			inline Dwarf_Half get_tag() const { return tag_here(); }
 			inline opt<string> get_name() const 
-			{ return name_here() ? opt<string>(string(name_here().get())) : opt<string>(); }
+			{
+				string_view v = name_view_here();
+				return v.data() ? opt<string>(string(v.data(), v.size())) : opt<string>();
+			}
 			inline unique_ptr<const char, string_deleter> get_raw_name() const
 			{ return name_here(); }
 			inline Dwarf_Off get_enclosing_cu_offset() const 
@@ -198,6 +234,7 @@ namespace dwarf
 				deleter(Debug::raw_handle_type dbg) : dbg(dbg) {}
 				void operator()(raw_handle_type arg) const
 				{
+					libdwarf_alloc_guard g;
 					dwarf_dealloc(dbg, arg, DW_DLA_ATTR);
 				}
 			};
@@ -238,6 +275,7 @@ namespace dwarf
 				deleter(Debug::raw_handle_type dbg) : dbg(dbg) {}
 				void operator()(raw_handle_type arg) const
 				{
+					libdwarf_alloc_guard g;
 					dwarf_dealloc(dbg, arg->ld_s, DW_DLA_LOC_BLOCK);
 					dwarf_dealloc(dbg, arg, DW_DLA_LOCDESC);
 				}
@@ -270,6 +308,7 @@ namespace dwarf
 				deleter(Debug::raw_handle_type dbg) : dbg(dbg) {} 
 				void operator()(raw_handle_type arg) const 
 				{ 
+					libdwarf_alloc_guard g;
 					dwarf_dealloc(dbg, arg, DW_DLA_BLOCK); 
 				} 
 			}; 
@@ -302,6 +341,7 @@ namespace dwarf
 				deleter(Debug::raw_handle_type dbg) : dbg(dbg) {} \
 				void operator()(raw_handle_type arg) const \
 				{ \
+					libdwarf_alloc_guard g; \
 					dwarf_dealloc(dbg, arg, DEALLOC_TOKEN_ ## Fragment); \
 				} \
 			}; \
@@ -346,7 +386,7 @@ namespace dwarf
 				 : dbg(dbg), len(len) {} 
 				void operator()(raw_handle_type arg) const
 				{
-					if (len > 0) dwarf_dealloc(dbg, arg, DW_DLA_LIST);
+					if (len > 0) { libdwarf_alloc_guard g; dwarf_dealloc(dbg, arg, DW_DLA_LIST); }
 				}
 			};
 			
@@ -425,6 +465,7 @@ namespace dwarf
 				deleter(Debug::raw_handle_type dbg, Dwarf_Signed len) : dbg(dbg), len(len) {}  \
 				void operator()(raw_handle_type arg) const \
 				{ \
+					libdwarf_alloc_guard g; \
 					dwarf_dealloc(dbg, arg, DW_DLA_LIST); \
 				} \
 			}; \
@@ -509,7 +550,7 @@ namespace dwarf
 				deleter(Debug::raw_handle_type dbg, Dwarf_Signed len) : dbg(dbg), len(len) {} 
 				void operator()(raw_handle_type arg) const
 				{
-					if (arg && arg != (void*)-1) dwarf_ranges_dealloc(dbg, arg, len);
+					if (arg && arg != (void*)-1) { libdwarf_alloc_guard g; dwarf_ranges_dealloc(dbg, arg, len); }
 					else assert(len == 0);
 				}
 			};
@@ -551,7 +592,7 @@ namespace dwarf
 				 : dbg(dbg), len(len) {} 
 				void operator()(raw_handle_type arg) const
 				{
-					if (len > 0) dwarf_dealloc(dbg, arg, DW_DLA_LIST);
+					if (len > 0) { libdwarf_alloc_guard g; dwarf_dealloc(dbg, arg, DW_DLA_LIST); }
 				}
 			};
 			
@@ -617,6 +658,7 @@ namespace dwarf
 		Attribute::try_construct(const Die& h, Dwarf_Half attr)
 		{
 			raw_handle_type returned;
+			libdwarf_alloc_guard g;
 			int ret = dwarf_attr(h.raw_handle(), attr, &returned, &current_dwarf_error);
 			if (ret == DW_DLV_OK) return handle_type(returned, deleter(h.get_dbg()));
 			else return handle_type(nullptr, deleter(nullptr)); // could be ERROR or NO_ENTRY
@@ -631,6 +673,7 @@ namespace dwarf
 		{
 			Dwarf_Attribute *block_start;
 			Dwarf_Signed count;
+			libdwarf_alloc_guard g;
 			int ret = dwarf_attrlist(h.raw_handle(), &block_start, &count, &current_dwarf_error);
 			if (ret == DW_DLV_OK)
 			{
@@ -668,6 +711,7 @@ namespace dwarf
 		{
 			char **block_start;
 			Dwarf_Signed count;
+			libdwarf_alloc_guard g;
 			int ret = dwarf_srcfiles(h.raw_handle(), &block_start, &count, &current_dwarf_error);
 			if (ret == DW_DLV_OK)
 			{
@@ -696,6 +740,7 @@ namespace dwarf
 		{
 			Dwarf_Unsigned exprlen;
 			Dwarf_Ptr block_ptr;
+			libdwarf_alloc_guard g;
 			int ret = dwarf_formexprloc(a.handle.get(), &exprlen, &block_ptr, 
 				&core::current_dwarf_error);
 			assert(ret == DW_DLV_OK);
@@ -726,6 +771,7 @@ namespace dwarf
 			/* libdwarf can fail here if it doesn't understand an opcode in the 
 			 * expression (e.g. vendor extensions). We tolerate it by passing
 			 * back null to the caller. */
+			libdwarf_alloc_guard g;
 			int ret = dwarf_loclist_from_expr(dbg, bytes_in, bytes_len, &raw_handle, &listlen, &current_dwarf_error);
 			if (ret != DW_DLV_OK)
 			{
@@ -749,6 +795,7 @@ namespace dwarf
 			 * We will copy each pointer in the array into our vector of Locdesc handles. */
 			Dwarf_Locdesc **block_start;
 			Dwarf_Signed count = 0;
+			libdwarf_alloc_guard g;
 			int ret = dwarf_loclist_n(a.raw_handle(), &block_start, &count, &current_dwarf_error);
 			if (ret == DW_DLV_OK)
 			{
@@ -802,6 +849,7 @@ namespace dwarf
 				Dwarf_Ranges *block_start;
 				Dwarf_Signed count = 0;
 				Dwarf_Unsigned bytes = 0;
+				libdwarf_alloc_guard g;
 				int ret2 = dwarf_get_ranges(a.get_dbg(), ranges_off, &block_start, &count, &bytes, &current_dwarf_error);
 				if (ret2 == DW_DLV_OK)
 				{
@@ -829,6 +877,7 @@ namespace dwarf
 				Dwarf_Ranges *block_start;
 				Dwarf_Signed count = 0;
 				Dwarf_Unsigned bytes = 0;
+				libdwarf_alloc_guard g;
 				int ret2 = dwarf_get_ranges_a(a.get_dbg(), ranges_off, d.raw_handle(), 
 					&block_start, &count, &bytes, &current_dwarf_error);
 				if (ret2 == DW_DLV_OK)
@@ -852,6 +901,7 @@ namespace dwarf
 		Block::try_construct(const Attribute& a)
 		{
 			Dwarf_Block *returned;
+			libdwarf_alloc_guard g;
 			int ret = dwarf_formblock(a.raw_handle(), &returned, &current_dwarf_error);
 			if (ret == DW_DLV_OK)
 			{
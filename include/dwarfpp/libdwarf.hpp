@@ -19,6 +19,151 @@ namespace dwarf
 			#include "dwarf-lib.h"
 			#undef Elf
 		}
+/* temporary HACK while dwarf.h catches up: the forms and attributes new in DWARF 5. */
+#ifndef DW_FORM_strx
+#define DW_FORM_strx 0x1a
+#endif
+#ifndef DW_FORM_addrx
+#define DW_FORM_addrx 0x1b
+#endif
+#ifndef DW_FORM_ref_sup4
+#define DW_FORM_ref_sup4 0x1c
+#endif
+#ifndef DW_FORM_strp_sup
+#define DW_FORM_strp_sup 0x1d
+#endif
+#ifndef DW_FORM_data16
+#define DW_FORM_data16 0x1e
+#endif
+#ifndef DW_FORM_line_strp
+#define DW_FORM_line_strp 0x1f
+#endif
+#ifndef DW_FORM_implicit_const
+#define DW_FORM_implicit_const 0x21
+#endif
+#ifndef DW_FORM_loclistx
+#define DW_FORM_loclistx 0x22
+#endif
+#ifndef DW_FORM_rnglistx
+#define DW_FORM_rnglistx 0x23
+#endif
+#ifndef DW_FORM_ref_sup8
+#define DW_FORM_ref_sup8 0x24
+#endif
+#ifndef DW_FORM_strx1
+#define DW_FORM_strx1 0x25
+#endif
+#ifndef DW_FORM_strx2
+#define DW_FORM_strx2 0x26
+#endif
+#ifndef DW_FORM_strx3
+#define DW_FORM_strx3 0x27
+#endif
+#ifndef DW_FORM_strx4
+#define DW_FORM_strx4 0x28
+#endif
+#ifndef DW_FORM_addrx1
+#define DW_FORM_addrx1 0x29
+#endif
+#ifndef DW_FORM_addrx2
+#define DW_FORM_addrx2 0x2a
+#endif
+#ifndef DW_FORM_addrx3
+#define DW_FORM_addrx3 0x2b
+#endif
+#ifndef DW_FORM_addrx4
+#define DW_FORM_addrx4 0x2c
+#endif
+#ifndef DW_AT_string_length_bit_size
+#define DW_AT_string_length_bit_size 0x6f
+#endif
+#ifndef DW_AT_string_length_byte_size
+#define DW_AT_string_length_byte_size 0x70
+#endif
+#ifndef DW_AT_rank
+#define DW_AT_rank 0x71
+#endif
+#ifndef DW_AT_str_offsets_base
+#define DW_AT_str_offsets_base 0x72
+#endif
+#ifndef DW_AT_addr_base
+#define DW_AT_addr_base 0x73
+#endif
+#ifndef DW_AT_rnglists_base
+#define DW_AT_rnglists_base 0x74
+#endif
+#ifndef DW_AT_dwo_name
+#define DW_AT_dwo_name 0x76
+#endif
+#ifndef DW_AT_reference
+#define DW_AT_reference 0x77
+#endif
+#ifndef DW_AT_rvalue_reference
+#define DW_AT_rvalue_reference 0x78
+#endif
+#ifndef DW_AT_macros
+#define DW_AT_macros 0x79
+#endif
+#ifndef DW_AT_call_all_calls
+#define DW_AT_call_all_calls 0x7a
+#endif
+#ifndef DW_AT_call_all_source_calls
+#define DW_AT_call_all_source_calls 0x7b
+#endif
+#ifndef DW_AT_call_all_tail_calls
+#define DW_AT_call_all_tail_calls 0x7c
+#endif
+#ifndef DW_AT_call_return_pc
+#define DW_AT_call_return_pc 0x7d
+#endif
+#ifndef DW_AT_call_value
+#define DW_AT_call_value 0x7e
+#endif
+#ifndef DW_AT_call_origin
+#define DW_AT_call_origin 0x7f
+#endif
+#ifndef DW_AT_call_parameter
+#define DW_AT_call_parameter 0x80
+#endif
+#ifndef DW_AT_call_pc
+#define DW_AT_call_pc 0x81
+#endif
+#ifndef DW_AT_call_tail_call
+#define DW_AT_call_tail_call 0x82
+#endif
+#ifndef DW_AT_call_target
+#define DW_AT_call_target 0x83
+#endif
+#ifndef DW_AT_call_target_clobbered
+#define DW_AT_call_target_clobbered 0x84
+#endif
+#ifndef DW_AT_call_data_location
+#define DW_AT_call_data_location 0x85
+#endif
+#ifndef DW_AT_call_data_value
+#define DW_AT_call_data_value 0x86
+#endif
+#ifndef DW_AT_noreturn
+#define DW_AT_noreturn 0x87
+#endif
+#ifndef DW_AT_alignment
+#define DW_AT_alignment 0x88
+#endif
+#ifndef DW_AT_export_symbols
+#define DW_AT_export_symbols 0x89
+#endif
+#ifndef DW_AT_deleted
+#define DW_AT_deleted 0x8a
+#endif
+#ifndef DW_AT_defaulted
+#define DW_AT_defaulted 0x8b
+#endif
+#ifndef DW_AT_loclists_base
+#define DW_AT_loclists_base 0x8c
+#endif
+#ifndef DW_TAG_skeleton_unit
+#define DW_TAG_skeleton_unit 0x4a
+#endif
 		// forward decls
 		struct loclist;
 		
@@ -0,0 +1,225 @@
+/* dwarfpp: C++ binding for a useful subset of libdwarf, plus extra goodies.
+ *
+ * native-reader.hpp: decoding .debug_info ourselves, without libdwarf
+ *
+ * Copyright (c) 2008--17, Stephen Kell. For licensing information, see the
+ * LICENSE file in the root of the libdwarfpp tree.
+ */
+
+#ifndef DWARFPP_NATIVE_READER_HPP_
+#define DWARFPP_NATIVE_READER_HPP_
+
+#include <vector>
+#include <unordered_map>
+#include "die-reader.hpp"
+
+namespace dwarf
+{
+	namespace core
+	{
+		/* A reader for .debug_info that decodes DIEs straight out of the
+		 * section bytes (which a section_loader gives us, usually mapped).
+		 * We read every unit header, and every abbreviation table (once,
+		 * however many units share it), when constructed; after that,
+		 * nothing is allocated or written, so any number of threads can
+		 * read at once.
+		 *
+		 * We only do what navigation needs: tags, children, siblings (using
+		 * DW_AT_sibling where present), names, and finding attributes'
+		 * raw values. Turning attributes into encap::attribute_values is
+		 * still libdwarf's job; see reader_die::copy_attrs(). We know the
+		 * forms of DWARF 2 to 5, except for DW_FORM_strx names of split
+		 * units, which need .dwo files we don't open.
+		 *
+		 * DWARF 5's indexed forms (strx, addrx, loclistx, rnglistx) and its
+		 * list sections are the exception, which older libdwarfs don't
+		 * know: we resolve those here, and the attribute_value constructor
+		 * asks us to. Each unit's bases into the tables behind them are
+		 * looked up once, on construction, so each value is a lookup. */
+		class native_reader : public die_reader
+		{
+		public:
+			struct bytes
+			{
+				const unsigned char *data;
+				size_t size;
+			};
+			struct sections
+			{
+				bytes info;
+				bytes abbrev;
+				bytes str;         // may be empty, as may the rest
+				bytes line_str;
+				bytes str_offsets;
+				bytes ranges;
+				bytes rnglists;
+				bytes addr;
+				bytes loclists;
+			};
+			struct attr_spec
+			{
+				Dwarf_Half attr;
+				Dwarf_Half form;
+				Dwarf_Signed implicit_const; // for DW_FORM_implicit_const
+			};
+			struct abbrev
+			{
+				Dwarf_Half tag;
+				bool has_children;
+				bool has_sibling_attr;
+				unsigned first_attr; // in the table's attrs
+				unsigned n_attrs;
+			};
+			/* Codes are usually dense from 1, so we index by code where we can. */
+			struct abbrev_table
+			{
+				std::vector<abbrev> dense; // dense[code - 1]; tag 0 means no such code
+				std::unordered_map<Dwarf_Unsigned, abbrev> sparse;
+				std::vector<attr_spec> attrs;
+				const abbrev *find(Dwarf_Unsigned code) const;
+			};
+			struct unit
+			{
+				Dwarf_Off offset;     // of the header
+				Dwarf_Off end;        // one past the last byte
+				Dwarf_Off die_offset; // of the unit DIE, just after the header
+				Dwarf_Half version;
+				unsigned char address_size;
+				unsigned char offset_size;
+				const abbrev_table *p_abbrevs;
+				/* Where this unit's tables start, from its unit DIE (or, if it
+				 * hasn't the attribute, just after the section's first header). */
+				Dwarf_Off str_offsets_base; // for DW_FORM_strx
+				Dwarf_Off addr_base;        // for DW_FORM_addrx
+				Dwarf_Off rnglists_base;    // for DW_FORM_rnglistx
+				Dwarf_Off loclists_base;    // for DW_FORM_loclistx
+				Dwarf_Addr base_address;    // the unit DIE's low_pc; lists' offset pairs add it
+			};
+			/* A raw attribute value: u for constants, references (made
+			 * section-relative), offsets and indices; s for signed forms;
+			 * block for blocks and exprlocs; str for resolved strings. */
+			struct attr_value
+			{
+				Dwarf_Half form;
+				Dwarf_Unsigned u;
+				Dwarf_Signed s;
+				const unsigned char *block;
+				Dwarf_Unsigned block_len;
+				const char *str;
+			};
+			explicit native_reader(const sections& s);
+			/* Reading what loader has of our sections; null if it hasn't
+			 * .debug_info and .debug_abbrev, or we can't make sense of them. */
+			static shared_ptr<native_reader> from_loader(section_loader& loader);
+			bool ok() const { return m_ok; }
+
+			root_die::reader_kind kind() const { return root_die::NATIVE_READER; }
+			unsigned unit_count() const { return units.size(); }
+			const unit& get_unit(unsigned idx) const { return units[idx]; }
+			Dwarf_Off unit_die_offset(unsigned idx) const { return units[idx].die_offset; }
+			/* A binary search. */
+			bool unit_index_for(Dwarf_Off off, unsigned *p_idx) const;
+
+			/* The abbreviation at off, or null for a null entry or bad data. */
+			const abbrev *abbrev_at(unsigned u, Dwarf_Off off) const;
+			Dwarf_Half tag_at(unsigned u, Dwarf_Off off) const
+			{ const abbrev *a = abbrev_at(u, off); return a ? a->tag : 0; }
+			Dwarf_Off first_child(unsigned u, Dwarf_Off off) const;
+			Dwarf_Off next_sibling(unsigned u, Dwarf_Off off) const
+			{ Dwarf_Off ignored; return next_sibling_or_end(u, off, &ignored); }
+			Dwarf_Off next_sibling_or_end(unsigned u, Dwarf_Off off, Dwarf_Off *out_parent_end) const;
+			bool has_attr(unsigned u, Dwarf_Off off, Dwarf_Half attr) const;
+			bool find_attr(unsigned u, Dwarf_Off off, Dwarf_Half attr, attr_value *out) const;
+			/* Points into the string sections. */
+			string_view name(unsigned u, Dwarf_Off off) const;
+
+			/* What a value find_attr() gave for unit u means: the string of
+			 * a string form (null if it's bad), the address of an address
+			 * form, and the section offset of a list, which for
+			 * DW_FORM_loclistx and rnglistx is read from the unit's offset
+			 * table. The list offsets are into .debug_loclists and
+			 * .debug_rnglists from DWARF 5, .debug_loc and .debug_ranges
+			 * before. */
+			const char *string_of(unsigned u, const attr_value& v) const
+			{ return string_at(units[u], v); }
+			bool address_of(unsigned u, const attr_value& v, Dwarf_Addr *out) const;
+			bool list_offset_of(unsigned u, const attr_value& v, bool ranges, Dwarf_Off *out) const;
+			/* An entry of a DWARF 5 range or location list, covering
+			 * [lo, hi) in absolute addresses; a location list's default
+			 * entry has lo == hi == 0. expr is null for ranges. */
+			struct list_entry
+			{
+				Dwarf_Addr lo;
+				Dwarf_Addr hi;
+				const unsigned char *expr;
+				Dwarf_Unsigned expr_len;
+			};
+			/* Append the entries of unit u's list at off, in .debug_rnglists
+			 * or .debug_loclists, to out, following base address entries
+			 * and indexing .debug_addr as we go. Empty entries are left
+			 * out. False on bad data; for the older sections, ask libdwarf. */
+			bool read_list(unsigned u, Dwarf_Off off, bool ranges, std::vector<list_entry>& out) const;
+
+			/* Append unit u's DIEs, their parents and their references to
+			 * out, in one pass over its bytes, but with no edge_begin for
+			 * the end; see root_die::extract_ref_graph(). Edge indices are
+			 * out's. False on bad data, having appended what came before. */
+			bool read_unit_refs(unsigned u, ref_graph& out) const;
+			/* Likewise, append unit u's rows to out, whose columns say
+			 * which attributes we want; tags is which DIEs, or empty for all.
+			 * A STRING value is, for now, an index into out_strings, which
+			 * gets the string itself; see root_die::extract(). */
+			bool read_unit_columns(unsigned u, const std::vector<Dwarf_Half>& tags,
+				attr_columns& out, std::vector<const char *>& out_strings) const;
+			/* A hash of what unit u says, rather than of its bytes: every
+			 * DIE's offset within the unit, tag, attributes, forms and
+			 * values, with strings by content, references within the unit
+			 * relative to it, and range lists followed. So it survives the
+			 * unit moving, its abbreviations being renumbered and the string
+			 * sections being reshuffled, but not a change in any DIE's size.
+			 * Offsets into other sections (lines, locations, macros) are
+			 * hashed as they are, not followed. *out_closed says whether the
+			 * unit is self-contained: no DW_FORM_ref_addr leaving it, no
+			 * type signatures, and no declared types whose definitions we
+			 * might find elsewhere. Indexed forms are hashed as what they
+			 * index. False on bad data, or on forms whose values live in
+			 * other files (supplementary or split), which we don't read. */
+			bool unit_signature(unsigned u, uint64_t *out_hash, bool *out_closed) const;
+			/* The least and greatest offsets at which unit u's DIEs start a
+			 * location list (in .debug_loc, or .debug_loclists from DWARF 5)
+			 * and a range list (.debug_ranges or .debug_rnglists); lo > hi
+			 * if there are none. Lists given by index (DW_FORM_loclistx and
+			 * rnglistx) count where their offset table says. For prefetching; see
+			 * root_die::set_readahead(). False on bad data. */
+			struct offset_span
+			{
+				Dwarf_Off lo;
+				Dwarf_Off hi;
+			};
+			bool unit_list_offsets(unsigned u, offset_span *out_locs, offset_span *out_ranges) const;
+
+		private:
+			sections secs;
+			bool m_ok;
+			std::vector<unit> units;
+			std::unordered_map<Dwarf_Off, abbrev_table> abbrev_tables; // by .debug_abbrev offset
+
+			bool read_abbrev_table(Dwarf_Off off, abbrev_table& t);
+			/* Read or skip one attribute's value, returning where the next
+			 * one starts, or null on bad data. out may be null. */
+			const unsigned char *read_form(const unit& cu, Dwarf_Half form, Dwarf_Signed implicit_const,
+				const unsigned char *p, const unsigned char *end, attr_value *out) const;
+			/* Past the attributes of the entry at p, whose abbreviation is a. */
+			const unsigned char *skip_attrs(const unit& cu, const abbrev& a,
+				const unsigned char *p, const unsigned char *end) const;
+			/* The entry's abbreviation, and where its attributes start. */
+			const abbrev *decode(const unit& cu, Dwarf_Off off, const unsigned char **p_attrs) const;
+			const char *string_at(const unit& cu, const attr_value& v) const;
+			/* Entry idx of one of a unit's tables: at base in sec, of n-byte entries. */
+			bool table_entry(const bytes& sec, Dwarf_Off base, Dwarf_Unsigned idx, unsigned n,
+				Dwarf_Unsigned *out) const;
+		};
+	}
+}
+
+#endif
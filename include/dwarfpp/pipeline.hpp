@@ -0,0 +1,77 @@
+/* dwarfpp: C++ binding for a useful subset of libdwarf, plus extra goodies.
+ * 
+ * pipeline.hpp: walking all DIEs in producer, filter and consumer stages
+ *
+ * Copyright (c) 2008--17, Stephen Kell. For licensing information, see the
+ * LICENSE file in the root of the libdwarfpp tree.
+ */
+
+#ifndef DWARFPP_PIPELINE_HPP_
+#define DWARFPP_PIPELINE_HPP_
+
+#include <algorithm>
+#include <vector>
+#include <functional>
+#include "lib.hpp"
+
+namespace dwarf
+{
+	namespace core
+	{
+		/* What a consumer gets for each DIE. To see more of it, use
+		 * get_root().pos(off), which on a frozen root any thread may do. */
+		struct die_view
+		{
+			Dwarf_Off off;
+			Dwarf_Off cu_off;
+			Dwarf_Half tag;
+			unsigned short depth; // 1 for a CU
+		};
+
+		/* A pipeline walks every DIE under a root and hands those passing
+		 * its filters to a consumer, in batches. If the root is frozen,
+		 * producer threads each take whole CUs in turn, walk and filter
+		 * them, and pass batches through a bounded queue to consumer threads,
+		 * so decoding, filtering and consuming overlap on different cores;
+		 * stages that only took turns on one thread, as coroutines would,
+		 * would gain nothing over a plain walk. Otherwise it all happens
+		 * on the calling thread, in offset order.
+		 *
+		 * A batch holds DIEs of one CU, in offset order; batches from
+		 * different CUs arrive in no particular order. Filters run on
+		 * producer threads, so must be thread-safe; so must the consumer,
+		 * if there's more than one consumer thread. */
+		class die_pipeline
+		{
+		public:
+			typedef std::function<bool(const iterator_base&)> filter_fn;
+			typedef std::function<void(const std::vector<die_view>&)> consumer_fn;
+		private:
+			root_die *p_root;
+			std::vector<Dwarf_Half> tags; // any of these; empty means any tag
+			std::vector<Dwarf_Half> attrs; // all of these
+			std::vector<filter_fn> filters; // all of these
+			unsigned m_batch_size;
+			unsigned m_queue_depth; // in batches
+
+			bool passes(const iterator_base& i) const;
+			void walk_cu(Dwarf_Off cu_off, const std::function<void(std::vector<die_view>&&)>& emit) const;
+		public:
+			die_pipeline(root_die& r) : p_root(&r), m_batch_size(256), m_queue_depth(16) {}
+			root_die& get_root() const { return *p_root; }
+
+			die_pipeline& with_tag(Dwarf_Half tag) { tags.push_back(tag); return *this; }
+			die_pipeline& with_attr(Dwarf_Half attr) { attrs.push_back(attr); return *this; }
+			die_pipeline& with(const filter_fn& f) { filters.push_back(f); return *this; }
+			die_pipeline& batch_size(unsigned n) { m_batch_size = std::max(1u, n); return *this; }
+			die_pipeline& queue_depth(unsigned n) { m_queue_depth = std::max(1u, n); return *this; }
+
+			/* nproducers == 0 means one per core. Returns how many DIEs
+			 * the consumer was given. */
+			unsigned long run(const consumer_fn& consume, unsigned nproducers = 0,
+				unsigned nconsumers = 1) const;
+		};
+	}
+}
+
+#endif
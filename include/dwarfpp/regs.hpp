@@ -48,7 +48,123 @@ namespace dwarf
 		};
 		extern const char *dwarf_regnames_x86_64[];
 
+		// AArch64, from the ABI's "DWARF for the Arm 64-bit Architecture"
+		enum dwarf_regs_aarch64
+		{
+			DWARF_AARCH64_X0     = 0, // ... through x30
+			DWARF_AARCH64_X29    = 29, // frame pointer
+			DWARF_AARCH64_X30    = 30, // link register
+			DWARF_AARCH64_SP     = 31,
+			DWARF_AARCH64_PC     = 32,
+			DWARF_AARCH64_V0     = 64, // ... through v31
+			DWARF_AARCH64_V31    = 95
+		};
+		extern const char *dwarf_regnames_aarch64[]; // up to the pc; see the arch below for v0..v31
+
+		// RISC-V, from the psABI: integer then floating-point registers
+		enum dwarf_regs_riscv
+		{
+			DWARF_RISCV_X0       = 0, // ... through x31
+			DWARF_RISCV_RA       = 1, // x1
+			DWARF_RISCV_SP       = 2, // x2
+			DWARF_RISCV_FP       = 8, // x8, a.k.a. s0
+			DWARF_RISCV_F0       = 32, // ... through f31
+			DWARF_RISCV_F31      = 63
+		};
+		extern const char *dwarf_regnames_riscv[];
+
 		const char **dwarf_regnames_for_elf_machine(int e_machine);
+		/* -1 if we don't know the machine. */
+		int dwarf_sp_regnum_for_elf_machine(int e_machine);
+
+		/* Register files specialised to one architecture, for code that
+		 * knows which it's on: each arch_* gives, at compile time, the map
+		 * from DWARF register number to a slot in a dense array, so that
+		 * arch_regs<Arch> is a flat array with a validity bitmap. It is
+		 * still an expr::regs, but it's final, so calls through the type
+		 * itself (as in compiled_expr::eval_with()) needn't be virtual.
+		 * Vector registers get a slot for their low 64 bits, which is
+		 * what CFI saves (e.g. AArch64's d8 to d15). */
+		struct arch_x86_64
+		{
+			enum { ELF_MACHINE = 62, NSLOTS = DWARF_X86_64_RIP + 1,
+				SP = DWARF_X86_64_RSP, RA = DWARF_X86_64_RIP };
+			static constexpr int slot_of(int regnum)
+			{ return (regnum >= 0 && regnum <= DWARF_X86_64_RIP) ? regnum : -1; }
+		};
+		struct arch_aarch64
+		{
+			enum { ELF_MACHINE = 183, NSLOTS = DWARF_AARCH64_PC + 1 + 32,
+				SP = DWARF_AARCH64_SP, RA = DWARF_AARCH64_X30 };
+			static constexpr int slot_of(int regnum)
+			{
+				return (regnum >= 0 && regnum <= DWARF_AARCH64_PC) ? regnum
+					: (regnum >= DWARF_AARCH64_V0 && regnum <= DWARF_AARCH64_V31)
+						? DWARF_AARCH64_PC + 1 + (regnum - DWARF_AARCH64_V0)
+					: -1;
+			}
+		};
+		struct arch_riscv
+		{
+			enum { ELF_MACHINE = 243, NSLOTS = DWARF_RISCV_F31 + 1,
+				SP = DWARF_RISCV_SP, RA = DWARF_RISCV_RA };
+			static constexpr int slot_of(int regnum)
+			{ return (regnum >= 0 && regnum <= DWARF_RISCV_F31) ? regnum : -1; }
+		};
+
+		template <typename Arch>
+		struct arch_regs final : public expr::regs
+		{
+			typedef Arch arch;
+			enum { NSLOTS = Arch::NSLOTS };
+			Dwarf_Signed vals[NSLOTS];
+			uint64_t valid[(NSLOTS + 63) / 64];
+
+			arch_regs() : valid() {}
+			bool has(int regnum) const
+			{
+				int s = Arch::slot_of(regnum);
+				return s >= 0 && (valid[s / 64] & (1ull << (s % 64)));
+			}
+			Dwarf_Signed get(int regnum)
+			{
+				int s = Arch::slot_of(regnum);
+				if (s < 0 || !(valid[s / 64] & (1ull << (s % 64)))) throw No_entry();
+				return vals[s];
+			}
+			void set(int regnum, Dwarf_Signed val)
+			{
+				int s = Arch::slot_of(regnum);
+				if (s < 0) throw No_entry();
+				vals[s] = val;
+				valid[s / 64] |= (1ull << (s % 64));
+			}
+			void clear(int regnum)
+			{
+				int s = Arch::slot_of(regnum);
+				if (s >= 0) valid[s / 64] &= ~(1ull << (s % 64));
+			}
+			/* For a register known at compile time, there's no lookup at all. */
+			template <int Regnum>
+			Dwarf_Signed get() const
+			{
+				static_assert(Arch::slot_of(Regnum) >= 0, "no such register on this architecture");
+				constexpr int s = Arch::slot_of(Regnum);
+				if (!(valid[s / 64] & (1ull << (s % 64)))) throw No_entry();
+				return vals[s];
+			}
+			template <int Regnum>
+			void set(Dwarf_Signed val)
+			{
+				static_assert(Arch::slot_of(Regnum) >= 0, "no such register on this architecture");
+				constexpr int s = Arch::slot_of(Regnum);
+				vals[s] = val;
+				valid[s / 64] |= (1ull << (s % 64));
+			}
+		};
+		typedef arch_regs<arch_x86_64> x86_64_regs;
+		typedef arch_regs<arch_aarch64> aarch64_regs;
+		typedef arch_regs<arch_riscv> riscv_regs;
 		
 		dwarf::encap::loc_expr dwarf_stack_pointer_expr_for_elf_machine(int e_machine,
 			dwarf::lib::Dwarf_Addr lopc, dwarf::lib::Dwarf_Addr hipc);
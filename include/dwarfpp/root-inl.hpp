@@ -78,34 +78,58 @@ namespace dwarf
 				/* It's visible; use resolve_all from hereon. */
 				resolve_all(i, cur_plus_one, path_end, results, max);
 			};
+			/* Returns true if we've got as many results as we wanted. */
+			auto try_cached = [this, &hit_in_cache, &recurse, &results, max, path_pos]() -> bool {
+				/* A shared index has every grandchild from the file. */
+				if (!shared_names.empty())
+				{
+					std::vector<Dwarf_Off> shared;
+					shared_grandchildren_named(*path_pos, shared);
+					for (auto i_shared = shared.begin(); i_shared != shared.end(); ++i_shared)
+					{
+						if (!hit_in_cache.insert(*i_shared).second) continue;
+						recurse(pos(*i_shared, 2));
+						if (max != 0 && results.size() >= max) return true;
+					}
+				}
+				/* Names get interned as the cache fills, so look ours up afresh. */
+				unsigned id = names.lookup(*path_pos);
+				if (id == name_interner::NONE)
+				{
+					DWARFPP_STAT_HIT(*this, false, grandchildren_cache);
+					return false;
+				}
+				auto matching_cached = visible_named_grandchildren_cache.find(id);
+				DWARFPP_STAT_HIT(*this, matching_cached != visible_named_grandchildren_cache.end(), grandchildren_cache);
+				if (matching_cached == visible_named_grandchildren_cache.end()) return false;
+				/* Copied, since recursing may add to the cache. */
+				std::vector<Dwarf_Off> offs = matching_cached->second;
+				for (auto i_cached = offs.begin(); i_cached != offs.end(); ++i_cached)
+				{
+					if (!hit_in_cache.insert(*i_cached).second) continue;
+					recurse(pos(*i_cached, 2));
+					if (max != 0 && results.size() >= max) return true;
+				}
+				return false;
+			};
 			
-			auto matching_cached = visible_named_grandchildren_cache.equal_range(*path_pos);
-			for (auto i_cached = matching_cached.first;
-				i_cached != matching_cached.second; 
-				++i_cached)
+			if (try_cached()) return;
+			if (visible_named_grandchildren_is_complete) return;
+
+			/* Now we have to be exhaustive, but we go a CU at a time, starting
+			 * with any CUs that the accelerator tables say are worth a look. */
+			load_pubnames_hints();
+			auto hinted = pubnames_hints.equal_range(names.lookup(*path_pos));
+			for (auto i_hint = hinted.first; i_hint != hinted.second; ++i_hint)
 			{
-				hit_in_cache.insert(i_cached->second);
-				recurse(pos(i_cached->second, 2));
-				if (max != 0 && results.size() >= max) return;
+				if (visible_named_grandchildren_cus_done.find(i_hint->second)
+					!= visible_named_grandchildren_cus_done.end()) continue;
+				fill_visible_named_grandchildren_for_cu(cu_pos(i_hint->second));
 			}
-
-			/* Now we have to be exhaustive. But don't bother if we know that 
-			 * our cache is exhaustive. */
-			if (!visible_named_grandchildren_is_complete)
+			if (try_cached()) return;
+			while (fill_visible_named_grandchildren_step())
 			{
-				auto vg_seq = visible_named_grandchildren();
-				for (auto i_g = std::move(vg_seq.first); i_g != vg_seq.second; ++i_g)
-				{
-					// skip any with the wrong name.
-					if (!i_g.name_here() || *i_g.name_here() != *path_pos) continue;
-					
-					/* skip any we saw before.  */
-					if (hit_in_cache.find(i_g.offset_here()) != hit_in_cache.end()) continue;
-
-					/* It's visible; use resolve_all from hereon. */
-					recurse(i_g);
-					if (max != 0 && results.size() >= max) return;
-				}
+				if (try_cached()) return;
 			}
 		}
 
@@ -243,12 +267,14 @@ namespace dwarf
 			if (found != live_dies.end())
 			{
 				// it's there, so use find_upwards to get the iterator
-				return iterator_base(*found->second);
+				note_payload_use(found->second);
+				return iterator_base(*found->second, opt_depth);
 			}
 			
 			Die h(*this, off);
 			assert(h.handle.get());
 			iterator_base base(std::move(h), opt_depth, *this);
+			if (frozen) return Iter(std::move(base)); // caches are read-only
 			
 			if (opt_depth && *opt_depth == 1) parent_of[off] = 0UL;
 			else if (opt_depth && *opt_depth == 2) parent_of[off] = base.enclosing_cu_offset_here();
@@ -257,7 +283,12 @@ namespace dwarf
 			// do we know anything about the first_child_of and next_sibling_of?
 			// NO because we don't know where we are w.r.t. other siblings
 			
-			if (base && referencer) refers_to[*referencer] = base.offset_here();
+			if (base && referencer)
+			{
+				refers_to[*referencer] = base.offset_here();
+				DWARFPP_STAT_INC(*this, refers_to_recorded);
+			}
+			note_cache_growth(off);
 			
 			return Iter(std::move(base));
 		}		
@@ -280,7 +311,27 @@ namespace dwarf
 			   What we want is 
 			   - to search all the way to the top
 			   - when we hit offset 0, `height' should be the depth of `off'
+			   ... unless the dense table or a loaded nav index already told us.
 			 */
+			const dense_nav_cu_table *p_cu;
+			const dense_nav_record *p_rec = dense_nav_lookup(off, &p_cu);
+			if (p_rec)
+			{
+				// no need to fill parent_of; parent() will ask the dense table
+				if (!maybe_ptr) return pos(off, p_rec->depth);
+				else return iterator_base(*maybe_ptr, opt<unsigned short>(p_rec->depth));
+			}
+			auto found_depth = depth_of.find(off);
+			if (found_depth != depth_of.end())
+			{
+				auto found_parent = parent_of.find(off);
+				DWARFPP_STAT_HIT(*this, found_parent != parent_of.end(), parent_of);
+				if (found_parent != parent_of.end())
+				{
+					if (!maybe_ptr) return pos(off, found_depth->second, found_parent->second);
+					else return iterator_base(*maybe_ptr, opt<unsigned short>(found_depth->second));
+				}
+			}
 			for (auto i_found_parent = parent_of.find(cur);
 				cur != 0 && i_found_parent != parent_of.end();
 				i_found_parent = parent_of.find(cur))
@@ -293,7 +344,8 @@ namespace dwarf
 			{
 				// CARE: this recursion is safe because pos never calls back to us
 				// with a non-null maybe_ptr
-				if (!maybe_ptr) return pos(off, height, parent_of[off]);
+				if (!maybe_ptr) return pos(off, height,
+					height > 0 ? opt<Dwarf_Off>(parent_of.find(off)->second) : opt<Dwarf_Off>());
 				else return iterator_base(*maybe_ptr, opt<unsigned short>(height));
 			}
 			else
@@ -311,13 +363,21 @@ namespace dwarf
 			Iter found_up = find_upwards(off, maybe_ptr);
 			if (found_up != iterator_base::END)
 			{
-				if (referencer) refers_to[*referencer] = found_up.offset_here();
+				if (referencer && !frozen)
+				{
+					refers_to[*referencer] = found_up.offset_here();
+					DWARFPP_STAT_INC(*this, refers_to_recorded);
+				}
 				return found_up;
 			} 
 			else
 			{
 				auto found = find_downwards(off);
-				if (found && referencer) refers_to[*referencer] = found.offset_here();
+				if (found && referencer && !frozen)
+				{
+					refers_to[*referencer] = found.offset_here();
+					DWARFPP_STAT_INC(*this, refers_to_recorded);
+				}
 				return found;
 			}
 		}
@@ -338,6 +398,10 @@ namespace dwarf
 			 * easy. I think there is a neat way of expressing this by combining
 			 * dfs and bfs traversal. FIXME: work out the recipe. */
 			
+			/* This is the slow path, so it's worth knowing how often we take it. */
+			DWARFPP_STAT_INC(*this, find_downwards_calls);
+			DWARFPP_STAT_TIME(*this, find_downwards_ns);
+
 			/* I think we want bf traversal with a smart subtree-skipping test. */
 			iterator_bf<typename Iter::DerefType> pos = begin();
 			// debug(2) << "Searching for offset " << std::hex << off << std::dec << endl;
@@ -453,6 +517,65 @@ namespace dwarf
 		{
 			return std::make_pair(begin(), end());
 		}
+
+		template <typename Visitor>
+		inline bool root_die::stream(Visitor&& visit)
+		{
+			if (frozen || !dbg.handle) return false;
+			clear_cu_context();
+			Dwarf_Debug raw_dbg = dbg.handle.get();
+			auto handle_for = [raw_dbg, this](Dwarf_Die raw) {
+				return Die(Die::handle_type(raw, Die::deleter(raw_dbg, *this)));
+			};
+			std::vector<Die> path; // the current DIE and its ancestors
+			bool ok = true;
+			/* We keep our CU context current, so that making the CU's payload
+			 * (say, to get the spec when copying attributes) doesn't move it.
+			 * Even after an error we step over the remaining CUs, so that we
+			 * leave the CU context cleared, as we found it. */
+			while (advance_cu_context())
+			{
+				if (!ok) continue;
+				Dwarf_Die next;
+				int ret;
+				{
+					libdwarf_alloc_guard g;
+					ret = dwarf_siblingof(raw_dbg, nullptr, &next, &current_dwarf_error);
+				}
+				if (ret != DW_DLV_OK) { ok = false; continue; }
+				path.push_back(handle_for(next));
+				bool descend = visit(static_cast<const Die&>(path.back()),
+					(unsigned short) path.size());
+				while (!path.empty())
+				{
+					ret = DW_DLV_NO_ENTRY;
+					if (descend)
+					{
+						libdwarf_alloc_guard g;
+						ret = dwarf_child(path.back().raw_handle(), &next, &current_dwarf_error);
+					}
+					/* No children (or we're skipping them), so climb until we
+					 * find a sibling. The next CU comes from its header, not
+					 * as the CU DIE's sibling. */
+					while (ret == DW_DLV_NO_ENTRY && !path.empty())
+					{
+						if (path.size() > 1)
+						{
+							libdwarf_alloc_guard g;
+							ret = dwarf_siblingof(raw_dbg, path.back().raw_handle(),
+								&next, &current_dwarf_error);
+						}
+						path.pop_back();
+					}
+					if (ret == DW_DLV_ERROR) { ok = false; path.clear(); break; }
+					if (ret != DW_DLV_OK) break; // finished the CU
+					path.push_back(handle_for(next));
+					descend = visit(static_cast<const Die&>(path.back()),
+						(unsigned short) path.size());
+				}
+			}
+			return ok;
+		}
 	}
 }
 
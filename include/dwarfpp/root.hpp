@@ -13,8 +13,18 @@
 #include <utility>
 #include <map>
 #include <unordered_map>
+#include <unordered_set>
 #include <deque>
+#include <list>
+#include <vector>
+#include <atomic>
+#include <set>
+#include <chrono>
+#include <memory>
+#include <cstring>
+#include <typeinfo>
 #include <boost/intrusive_ptr.hpp>
+#include <boost/functional/hash.hpp>
 #include <srk31/selective_iterator.hpp>
 #include <srk31/transform_iterator.hpp>
 #include <srk31/concatenating_iterator.hpp>
@@ -35,6 +45,7 @@ namespace dwarf
 	using std::multimap;
 	using std::deque;
 	using std::dynamic_pointer_cast;
+	using std::shared_ptr;
 	using boost::intrusive_ptr;
 	
 	namespace core
@@ -56,6 +67,8 @@ namespace dwarf
 			bool operator==(const is_a_t<Payload>&) const { return true; }
 			bool operator!=(const is_a_t<Payload>&) const { return false; }
 		}; // defined below, once we have factory
+		template <typename Payload>
+		inline Payload& payload_cast(basic_die& d); // defined below, once we have basic_die
 		// We want to partially specialize a function template, 
 		// which we can't do. So pull out the core into a class
 		// template which we call from the (non-specialised) function template.
@@ -123,12 +136,13 @@ namespace dwarf
 		{
 			typedef srk31::selective_iterator< is_a_t<Payload>, Iter> filtered_iterator;
 
-			// transformer is just dynamic_cast, wrapped as a function
-			struct transformer : std::function<Payload&(basic_die&)>
+			// transformer is just a downcast, which the filter has said will work
+			struct transformer
 			{
-				transformer() : std::function<Payload&(basic_die&)>([](basic_die& arg) -> Payload& {
-					return dynamic_cast<Payload&>(arg);
-				}) {}
+				typedef basic_die& argument_type;
+				typedef Payload& result_type;
+				Payload& operator()(basic_die& arg) const
+				{ return payload_cast<Payload>(arg); }
 			};
 			typedef srk31::transform_iterator<transformer, filtered_iterator >
 				transformed_iterator;
@@ -201,14 +215,423 @@ namespace dwarf
 			inline handle_with_position& operator=(handle_with_position&& hwp);
 		};
 		
+		/* Payloads get made and destroyed a lot, so each root_die has a slab
+		 * allocator for them. Sizes are rounded up to a multiple of GRAIN, and
+		 * each resulting size class has its own freelist, so a payload of a
+		 * given tag always recycles the memory of an earlier one. Slabs are
+		 * only freed in bulk, when the arena (i.e. its root_die) goes away.
+		 * Not thread-safe, so frozen roots (see root_die::freeze()) don't
+		 * use it. See payload-arena.cpp. */
+		struct payload_arena
+		{
+			enum { GRAIN = 16, SLAB_SIZE = 64 * 1024 };
+		private:
+			std::vector<void *> freelists; // by size class; each links through its first word
+			std::vector<char *> slabs;
+			char *bump;
+			char *bump_end;
+		public:
+			payload_arena() : bump(nullptr), bump_end(nullptr) {}
+			~payload_arena();
+			payload_arena(const payload_arena&) = delete;
+			payload_arena& operator=(const payload_arena&) = delete;
+			static size_t size_class(size_t sz) { return (sz + GRAIN - 1) / GRAIN; }
+			void *allocate(size_t sz);
+			void deallocate(void *p, size_t sz);
+		};
+
+		/* How many non-sticky payloads a root_die keeps alive after their
+		 * last iterator goes, so that what they've cached (summary codes,
+		 * SCCs, definitions...) survives from one query to the next. We
+		 * keep the most recently used ones, up to max_payloads of them and
+		 * max_bytes of payload memory (0 meaning no limit; both 0, the
+		 * default, means keep nothing, as before). Each tag has a priority;
+		 * 0 means never keep, and when over a limit we evict from the
+		 * lowest priority first, least recently used first within it. See
+		 * root_die::set_retention_policy() and payload-cache.cpp. */
+		struct payload_retention_policy
+		{
+			unsigned max_payloads;
+			size_t max_bytes;
+			unsigned default_priority;
+			std::unordered_map<Dwarf_Half, unsigned> tag_priorities;
+			payload_retention_policy() : max_payloads(0), max_bytes(0), default_priority(1) {}
+			bool enabled() const { return max_payloads || max_bytes; }
+			unsigned priority_for(Dwarf_Half tag) const
+			{
+				auto found = tag_priorities.find(tag);
+				return found == tag_priorities.end() ? default_priority : found->second;
+			}
+		};
+
+		/* Counters for root_die's hot paths, for finding out why a query is
+		 * slow: how often we fall back to searching from the root, how many
+		 * payloads and libdwarf handles we make, and how well the navigation
+		 * caches do. They only count if we're built with DWARFPP_STATS (see
+		 * configure --enable-stats); otherwise the hooks compile to nothing
+		 * and stats() stays zero. Many threads (on a frozen root) can count
+		 * at once: the live counters are relaxed atomics (see
+		 * live_root_stats), and stats() copies them into a root_stats, each
+		 * field exact but not all read at the same instant. */
+#define DWARFPP_ROOT_STATS_FIELDS(f) \
+		f(find_downwards_calls) \
+		f(find_downwards_ns) \
+		f(payloads_made) \
+		f(payloads_evicted) /* by the retention policy */ \
+		f(handle_copies) /* libdwarf handles made by copying iterators */ \
+		f(parent_of_hits) f(parent_of_misses) \
+		f(first_child_of_hits) f(first_child_of_misses) \
+		f(next_sibling_of_hits) f(next_sibling_of_misses) \
+		f(subtree_end_of_hits) f(subtree_end_of_misses) \
+		f(refers_to_recorded) /* refers_to is only written, never read */ \
+		f(cache_shards_evicted) /* CUs' navigation entries, by the budget */ \
+		f(grandchildren_cache_hits) f(grandchildren_cache_misses) \
+		f(named_child_index_hits) f(named_child_index_misses) \
+		f(frame_locals_hits) f(frame_locals_misses) \
+		f(inline_tree_hits) f(inline_tree_misses) \
+		f(type_layout_hits) f(type_layout_misses) \
+		f(rep_compatible_hits) f(rep_compatible_misses) \
+		f(decoded_list_hits) f(decoded_list_misses) /* loclists and rangelists */ \
+		f(type_name_cus_indexed)
+		struct root_stats
+		{
+#define DWARFPP_ROOT_STATS_DECLARE(name) unsigned long name;
+			DWARFPP_ROOT_STATS_FIELDS(DWARFPP_ROOT_STATS_DECLARE)
+#undef DWARFPP_ROOT_STATS_DECLARE
+			root_stats() { memset(this, 0, sizeof *this); }
+			root_stats operator-(const root_stats& arg) const;
+			void print(std::ostream& s) const; // one "name value" per line
+		};
+		std::ostream& operator<<(std::ostream& s, const root_stats& st);
+		/* The counters themselves. Relaxed is enough: nothing is ordered by
+		 * a count, and each is only ever added to or read. */
+		struct live_root_stats
+		{
+#define DWARFPP_ROOT_STATS_DECLARE_LIVE(name) std::atomic<unsigned long> name;
+			DWARFPP_ROOT_STATS_FIELDS(DWARFPP_ROOT_STATS_DECLARE_LIVE)
+#undef DWARFPP_ROOT_STATS_DECLARE_LIVE
+			live_root_stats() { reset(); }
+			void reset();
+			root_stats load() const;
+		};
+		inline void stat_add(std::atomic<unsigned long>& counter, unsigned long n)
+		{ counter.fetch_add(n, std::memory_order_relaxed); }
+#if DWARFPP_STATS
+		/* Adds the scope's elapsed time to a counter. */
+		struct root_stats_timer
+		{
+			std::atomic<unsigned long> *p_ns;
+			std::chrono::steady_clock::time_point start;
+			explicit root_stats_timer(std::atomic<unsigned long> *p_ns)
+			 : p_ns(p_ns), start(std::chrono::steady_clock::now()) {}
+			~root_stats_timer()
+			{
+				stat_add(*p_ns, std::chrono::duration_cast<std::chrono::nanoseconds>(
+					std::chrono::steady_clock::now() - start).count());
+			}
+		};
+#define DWARFPP_STAT_INC(r, field) stat_add((r).m_stats.field, 1)
+#define DWARFPP_STAT_HIT(r, hit, cache) \
+	stat_add((hit) ? (r).m_stats.cache ## _hits : (r).m_stats.cache ## _misses, 1)
+#define DWARFPP_STAT_TIME(r, field) root_stats_timer stat_timer_ ## field(&(r).m_stats.field)
+#else
+#define DWARFPP_STAT_INC(r, field) ((void) 0)
+#define DWARFPP_STAT_HIT(r, hit, cache) ((void) 0)
+#define DWARFPP_STAT_TIME(r, field) do {} while (0)
+#endif
+
+		/* Gives each distinct name a small integer ID, so that name caches
+		 * can key on those rather than on heap strings. IDs count up from 0
+		 * and are never reused. Interned strings never move, so views of
+		 * them are good for as long as the interner. Not thread-safe, so
+		 * only lookup() while frozen. See names.cpp. */
+		struct name_interner
+		{
+			enum { NONE = 0xffffffffu };
+			unsigned intern(string_view s);
+			unsigned lookup(string_view s) const; // NONE if never interned
+			string_view name(unsigned id) const { return names.at(id); }
+			unsigned size() const { return names.size(); }
+			void clear() { ids.clear(); names.clear(); }
+		private:
+			struct view_hash { size_t operator()(string_view s) const; };
+			std::deque<string> names; // a deque, so that push_back doesn't move them
+			unordered_map<string_view, unsigned, view_hash> ids; // keys view names
+		};
+
+		/* An ELF file's bytes in memory, for opening a root_die without
+		 * libelf copying every section it reads. Either we map the file
+		 * ourselves, or we borrow a caller's buffer, which must outlive
+		 * the image. Several root_dies (and preload()'s workers) can share
+		 * one image, each holding its own libelf handle on it. The
+		 * mapping is private and writable: libelf may convert sections of
+		 * a foreign-endian file in place, and copy-on-write keeps that
+		 * from touching the file, while pages nobody writes stay shared
+		 * with the page cache. So a borrowed buffer of a foreign-endian
+		 * file must be writable too. See elf-image.cpp. */
+		class section_loader;
+		class die_reader;
+		class native_reader;
+		struct elf_image
+		{
+			const char *data;
+			size_t size;
+
+			static shared_ptr<elf_image> map(int fd); // null on failure
+			static shared_ptr<elf_image> borrow(const void *data, size_t size);
+			/* A fresh libelf handle on the image; the caller elf_end()s it. */
+			::Elf *open_elf() const;
+			~elf_image();
+		private:
+			bool mapped; // if so, we munmap it
+			elf_image(const char *data, size_t size, bool mapped)
+			 : data(data), size(size), mapped(mapped) {}
+			elf_image(const elf_image&) = delete;
+			elf_image& operator=(const elf_image&) = delete;
+		};
+
+		/* A CU's line number program, decoded once into a flat array of
+		 * rows. Sequences are sorted by start address, and each ends with an
+		 * end_sequence row, so a lookup is a binary search. File numbers are
+		 * IDs interned across the whole root (see root_die::line_file_name()),
+		 * not the CU's own file numbers. See line-table.cpp. */
+		struct line_table
+		{
+			struct row
+			{
+				Dwarf_Addr addr;
+				unsigned file;  // interned; see root_die::line_file_name()
+				unsigned line;  // 0 means no line
+				unsigned short column;
+				bool is_stmt;
+				bool end_sequence; // addr is one past the end of a sequence
+			};
+			std::vector<unsigned> files; // the CU's file number less its first, to interned ID
+			std::vector<row> rows;
+			/* The row covering addr, or null. */
+			const row *find(Dwarf_Addr addr) const { return find_in(rows, addr); }
+			static const row *find_in(const std::vector<row>& rows, Dwarf_Addr addr);
+			/* Put sequences in address order, dropping any that overlap an
+			 * earlier one (e.g. code the linker threw away, left at 0). */
+			static unsigned sort_sequences(std::vector<row>& rows);
+		};
+
+		/* A CU's source files, from its line program header, decoded once:
+		 * for each file number (less first_fileno), its name as given, and its path
+		 * made absolute as source_file_fq_pathname() makes it, both as IDs
+		 * interned with the line tables' (see root_die::line_file_name()).
+		 * A path is NONE if the name is relative and the CU has no
+		 * DW_AT_comp_dir. See compile_unit_die::get_source_files(). */
+		struct source_file_table
+		{
+			enum { NONE = 0xffffffffu };
+			std::vector<unsigned> names;
+			std::vector<unsigned> paths;
+			Dwarf_Unsigned first_fileno; // see compile_unit_die::source_file_base()
+			source_file_table() : first_fileno(1) {}
+			/* For DW_AT_decl_file, DW_AT_call_file and line table file
+			 * numbers, which count from 1 before DWARF 5, where 0 means
+			 * none, and from 0 after; junk gives NONE. */
+			unsigned path_id(Dwarf_Unsigned fileno) const
+			{ return (fileno >= first_fileno && fileno - first_fileno < paths.size()) ? paths[fileno - first_fileno] : NONE; }
+			unsigned name_id(Dwarf_Unsigned fileno) const
+			{ return (fileno >= first_fileno && fileno - first_fileno < names.size()) ? names[fileno - first_fileno] : NONE; }
+			/* Prefixing comp_dir to a relative name, resolving leading "../"s. */
+			static opt<string> fq_pathname(const opt<string>& comp_dir, const string& name);
+		};
+
+		/* Where the locals and formal parameters of a subprogram live in
+		 * its frame, for asking which one spans a given stack address.
+		 * Each that is located at a fixed offset from the frame base
+		 * (DW_OP_fbreg) throughout its loclist becomes a slot per loclist
+		 * entry. We split the vaddrs (relative to the CU's low_pc, as for
+		 * loclists) into intervals on which the same slots are live, and
+		 * keep each interval's slots sorted by offset, so a lookup is a
+		 * binary search for the interval and another for the slot. The
+		 * rest (register-relative, static, or of no known size) are in
+		 * "others", for the caller to test the slow way.
+		 * "order" is the position in the walk that
+		 * subprogram_die::spans_addr_in_frame_locals_or_args() makes, which
+		 * takes the first that spans; find() does the same. */
+		struct frame_locals_index
+		{
+			struct slot
+			{
+				Dwarf_Signed lo; // from the frame base
+				Dwarf_Unsigned size;
+				unsigned order;
+				Dwarf_Off var;
+			};
+			std::vector<Dwarf_Addr> starts; // one more than there are intervals
+			std::vector<unsigned> first_slot; // likewise, indexing slots
+			std::vector<Dwarf_Unsigned> max_size; // per interval
+			std::vector<slot> slots;
+			std::vector<std::pair<unsigned, Dwarf_Off> > others; // (order, var), in order
+			/* The first in order spanning frame_offset at vaddr, or null. */
+			const slot *find(Dwarf_Addr vaddr, Dwarf_Signed frame_offset) const;
+			size_t bytes() const;
+		};
+
+		/* The inlined subroutines of a subprogram, however deeply they nest
+		 * under each other and under lexical blocks, flattened: one frame
+		 * per address range of each, with its abstract origin and call site
+		 * copied out, so that expanding a pc into its inlined frames touches
+		 * no DIEs. Frames are sorted by lo, and then by depth, so each comes
+		 * after the frames enclosing it; "parent" is the index of the
+		 * innermost of those (NONE if there's none). Any frame covering a pc
+		 * encloses the last frame starting at or below it, so a lookup is a
+		 * binary search and then a walk up the parents. Addresses are as in
+		 * the address index. call_file numbers the CU's source files, as
+		 * source_file_table::path_id() takes them. See addr-index.cpp. */
+		struct inline_tree_index
+		{
+			enum { NONE = 0xffffffffu };
+			struct frame
+			{
+				Dwarf_Addr lo; // inclusive
+				Dwarf_Addr hi; // exclusive
+				Dwarf_Off off; // the DW_TAG_inlined_subroutine
+				Dwarf_Off origin; // its DW_AT_abstract_origin, or 0 if none
+				unsigned call_file; // 0 if none
+				unsigned call_line; // likewise
+				unsigned parent;
+				unsigned short depth;
+			};
+			std::vector<frame> frames;
+			/* Appends the frames covering vaddr, outermost first, and
+			 * returns how many. */
+			unsigned find(Dwarf_Addr vaddr, std::vector<const frame *>& out) const;
+			size_t bytes() const { return sizeof *this + frames.capacity() * sizeof (frame); }
+		};
+
+		/* The data members of a struct, class or union, flattened: one
+		 * field for each member and inheritance, and then, if its type is
+		 * itself a struct, class or union, for each of that's, and so on,
+		 * with offsets from the start of the outermost type. Arrays are
+		 * not expanded; find the element's layout for what's in them.
+		 * The outermost type's own members come first, then each field's
+		 * members in a contiguous run, each run sorted by byte offset, so
+		 * finding the innermost field covering a byte is a binary search
+		 * per level of nesting. A bitfield's bits are bit_offset upwards
+		 * from the start of its bytes, as for DW_AT_data_bit_offset, even
+		 * if the DIE says DW_AT_bit_offset. See type-layout.cpp. */
+		struct type_layout
+		{
+			enum { NONE = 0xffffffffu };
+			struct field
+			{
+				Dwarf_Unsigned byte_offset;
+				Dwarf_Unsigned byte_size; // 0 if unknown
+				Dwarf_Unsigned bit_offset; // within the bytes; 0 unless a bitfield
+				Dwarf_Unsigned bit_size; // 0 unless a bitfield
+				Dwarf_Off member; // the member or inheritance DIE
+				Dwarf_Off type; // its concrete type, or 0 if none
+				unsigned parent; // the containing field, or NONE
+				unsigned first_child; // its members are [first_child, first_child + n_children)
+				unsigned n_children;
+				unsigned short depth; // 0 for the outermost type's own members
+			};
+			Dwarf_Off type; // whose layout this is
+			opt<Dwarf_Unsigned> byte_size;
+			unsigned n_members; // fields[0, n_members) are the type's own
+			std::vector<field> fields;
+			/* The innermost field covering byte_offset, or null. Of union
+			 * members, we pick the last that covers. */
+			const field *find(Dwarf_Unsigned byte_offset) const;
+			size_t bytes() const
+			{ return sizeof *this + fields.capacity() * sizeof (field); }
+		};
+
+		/* Every DIE's outgoing references, in compressed sparse row form:
+		 * dies[i]'s edges are edges[edge_begin[i], edge_begin[i + 1]).
+		 * dies is every DIE in .debug_info, in offset order, and parents[i]
+		 * is the offset of dies[i]'s parent (0 for units). Edges are in
+		 * attribute order, and go to whatever offset the attribute says,
+		 * unchecked. We leave out DW_AT_sibling, which is navigation, and
+		 * references that needn't be into our .debug_info (by signature,
+		 * or into a supplementary or alternate file). Built by
+		 * root_die::extract_ref_graph(); see ref-graph.cpp. */
+		/* A read-only run of records, which may be a vector of ours or
+		 * may be in a shared index that we've mapped (see
+		 * root_die::attach_shared_index()). Whoever owns the records must
+		 * outlive the span. */
+		template <typename T>
+		struct record_span
+		{
+			const T *p;
+			size_t n;
+			record_span() : p(nullptr), n(0) {}
+			record_span(const T *p, size_t n) : p(p), n(n) {}
+			explicit record_span(const std::vector<T>& v) : p(v.data()), n(v.size()) {}
+			const T *begin() const { return p; }
+			const T *end() const { return p + n; }
+			const T *data() const { return p; }
+			size_t size() const { return n; }
+			bool empty() const { return n == 0; }
+			const T& front() const { return p[0]; }
+			const T& operator[](size_t i) const { return p[i]; }
+		};
+
+		struct ref_graph
+		{
+			enum { NONE = 0xffffffffu };
+			struct edge
+			{
+				Dwarf_Half attr;
+				Dwarf_Off target;
+			};
+			std::vector<Dwarf_Off> dies;
+			std::vector<Dwarf_Off> parents;
+			std::vector<unsigned> edge_begin; // one more than there are DIEs
+			std::vector<edge> edges;
+			/* A binary search; NONE if there's no DIE at off. */
+			unsigned index_of(Dwarf_Off off) const;
+			std::pair<const edge *, const edge *> edges_of(unsigned idx) const
+			{ return std::make_pair(edges.data() + edge_begin[idx], edges.data() + edge_begin[idx + 1]); }
+			size_t bytes() const;
+		};
+
+		/* Chosen attributes of every DIE with one of some tags, as columns,
+		 * for bulk jobs that would otherwise copy an attribute_map per DIE.
+		 * Row i is dies[i], with tag tags[i], in offset order; column j is
+		 * attrs[j] of the request, with one kind and one value per row.
+		 * What a value means goes by its kind, from the attribute's form:
+		 * an ID in our root's name_interner for strings, the section
+		 * offset for references, the number for flags and (signed or not)
+		 * constants, and the address for addresses (looked up, for
+		 * DW_FORM_addrx). OTHER is anything else (section offsets, type
+		 * signatures, blocks), with its raw number or 0 for blocks; ABSENT
+		 * means the DIE hasn't the attribute. Built by root_die::extract();
+		 * see extract.cpp. */
+		struct attr_columns
+		{
+			enum value_kind { ABSENT, STRING, REFERENCE, CONSTANT, SIGNED, FLAG, ADDRESS, OTHER };
+			struct column
+			{
+				Dwarf_Half attr;
+				std::vector<unsigned char> kinds; // value_kinds
+				std::vector<Dwarf_Unsigned> values; // signed ones as their bits
+			};
+			std::vector<Dwarf_Off> dies;
+			std::vector<Dwarf_Half> tags;
+			std::vector<column> columns;
+			/* Null if we weren't asked for attr. */
+			const column *column_for(Dwarf_Half attr) const;
+			/* A binary search; NONE if there's no row for off. */
+			enum { NONE = 0xffffffffu };
+			unsigned row_of(Dwarf_Off off) const;
+			size_t bytes() const;
+		};
+
 		class basic_die : public virtual abstract_die
 		{
 			friend struct iterator_base;
 			friend class root_die;
 			friend class Die; // FIXME: define handle_with_nav instead
 		protected:
-			// we need to embed a refcount
-			unsigned refcount;
+			// we need to embed a refcount -- atomic, so that a frozen root_die
+			// can hand out the same payload to many threads
+			std::atomic<unsigned> refcount;
 			
 			// we need this, if we're libdwarf-backed; if not, it's null
 			Die d;
@@ -236,6 +659,9 @@ namespace dwarf
 			virtual encap::attribute_map find_all_attrs() const;
 			// get a single attr, seeing through abstract_origin / specification links
 			virtual encap::attribute_value find_attr(Dwarf_Half a) const;
+			// helper for the above, for libdwarf-backed DIEs
+			static encap::attribute_value find_attr_on_handle(root_die& r, const Die& h,
+				Dwarf_Half a, const basic_die *p_payload, unsigned hops_left);
 			virtual root_die& get_root() const // NOT defaulted!
 			{
 				assert(d.handle);
@@ -253,7 +679,50 @@ namespace dwarf
 			inline basic_die() : refcount(0), d(nullptr, nullptr)
 			{ assert(false); }
 			friend struct dwarf_current_factory_t;
+
+			/* Every payload is preceded by a header saying where it came from
+			 * (an arena, or the heap if null), so that "delete" in
+			 * intrusive_ptr_release() can send it back there. */
+			struct alloc_header
+			{
+				payload_arena *p_arena;
+				size_t size; // including the header
+			};
+			enum { ALLOC_HEADER_SIZE = (sizeof (alloc_header) + payload_arena::GRAIN - 1)
+				/ payload_arena::GRAIN * payload_arena::GRAIN };
 		public:
+			static void *operator new(size_t sz, payload_arena& a)
+			{
+				size_t total = sz + ALLOC_HEADER_SIZE;
+				alloc_header *h = static_cast<alloc_header *>(a.allocate(total));
+				*h = (alloc_header) { .p_arena = &a, .size = total };
+				return reinterpret_cast<char *>(h) + ALLOC_HEADER_SIZE;
+			}
+			static void *operator new(size_t sz)
+			{
+				size_t total = sz + ALLOC_HEADER_SIZE;
+				alloc_header *h = static_cast<alloc_header *>(::operator new(total));
+				*h = (alloc_header) { .p_arena = nullptr, .size = total };
+				return reinterpret_cast<char *>(h) + ALLOC_HEADER_SIZE;
+			}
+			static void operator delete(void *p)
+			{
+				if (!p) return;
+				alloc_header *h = reinterpret_cast<alloc_header *>(
+					static_cast<char *>(p) - ALLOC_HEADER_SIZE);
+				if (h->p_arena) h->p_arena->deallocate(h, h->size);
+				else ::operator delete(h);
+			}
+			// only called if a constructor throws
+			static void operator delete(void *p, payload_arena& a) { operator delete(p); }
+			/* What operator new gave us, header and all. The header is in
+			 * front of the most-derived object, not necessarily of us. */
+			size_t allocated_size() const
+			{
+				return reinterpret_cast<const alloc_header *>(
+					static_cast<const char *>(dynamic_cast<const void *>(this)) - ALLOC_HEADER_SIZE)->size;
+			}
+
 			inline basic_die(spec& s, Die&& h);
 			
 			friend std::ostream& operator<<(std::ostream& s, const basic_die& d);
@@ -269,9 +738,11 @@ namespace dwarf
 			inline opt<string> get_name() const 
 			{ 
 				assert(d.handle); 
-				if (d.name_here()) return opt<string>(string(d.name_here().get()));
-				else return opt<string>();
+				return d.get_name();
 			}
+			/* See Die::name_view_here(). In-memory DIEs' names come from
+			 * the root's name interner, so they stay good too. */
+			inline string_view get_name_view() const;
 			inline unique_ptr<const char, string_deleter> get_raw_name() const
 			{ assert(d.handle); return d.name_here(); }
 			inline Dwarf_Off get_enclosing_cu_offset() const 
@@ -307,13 +778,33 @@ namespace dwarf
 		std::ostream& operator<<(std::ostream& s, const basic_die& d);
 		inline void intrusive_ptr_add_ref(basic_die *p)
 		{
-			++(p->refcount);
+			p->refcount.fetch_add(1, std::memory_order_relaxed);
 		}
 		inline void intrusive_ptr_release(basic_die *p)
 		{
-			--(p->refcount);
-			if (p->refcount == 0) delete p;
+			if (p->refcount.fetch_sub(1, std::memory_order_acq_rel) == 1) delete p;
+		}
+		/* Payload classes inherit virtually, so downcasting one needs
+		 * dynamic_cast. But the offset of the Payload within the payload
+		 * is the same for every object of one most-derived class, and
+		 * runs of DIEs tend to share a class, so each thread remembers
+		 * the last class it saw and its offset. */
+		template <typename Payload>
+		inline Payload& payload_cast(basic_die& d)
+		{
+			static thread_local const std::type_info *p_last_type;
+			static thread_local std::ptrdiff_t last_offset;
+			const std::type_info *p_type = &typeid(d);
+			if (p_type != p_last_type)
+			{
+				last_offset = reinterpret_cast<const char *>(&dynamic_cast<Payload&>(d))
+					- reinterpret_cast<const char *>(&d);
+				p_last_type = p_type;
+			}
+			return *reinterpret_cast<Payload *>(reinterpret_cast<char *>(&d) + last_offset);
 		}
+		template <>
+		inline basic_die& payload_cast<basic_die>(basic_die& d) { return d; }
 		
 		struct is_visible_and_named;
 		struct grandchild_die_at_offset;
@@ -344,14 +835,35 @@ namespace dwarf
 			friend struct GlobalList;
 			friend struct Arange;
 			friend struct ArangeList;
+			friend class encap::attribute_value; // for decoded_loclists and decoded_rangelists
 			
 			friend struct basic_die;
-			friend struct type_die; // for equal_to
+			friend struct type_die; // for type_equality
+			friend struct with_data_members_die; // the same
+			friend bool compute_all_type_summaries(root_die& r, unsigned nthreads);
 			friend class factory; // for visible_named_grandchildren_is_complete
 			
 		protected: // was protected -- consider changing back
 			typedef intrusive_ptr<basic_die> ptr_type;
+			/* If we were opened from an elf_image, our libelf handle on it,
+			 * and the section_loader libdwarf reads through if the image
+			 * suits one. It comes before dbg, so that it outlives the libdwarf
+			 * session. */
+			struct image_handle
+			{
+				shared_ptr<const elf_image> image;
+				::Elf *elf;
+				shared_ptr<section_loader> loader;
+				image_handle() : elf(nullptr) {}
+				image_handle(shared_ptr<const elf_image> image, const string& section_cache_dir);
+				~image_handle();
+				image_handle(const image_handle&) = delete;
+				image_handle& operator=(const image_handle&) = delete;
+			} img;
 			Debug dbg;
+			/* Must outlive every payload we own, so it comes before the
+			 * live and sticky sets (and everything else holding payloads). */
+			payload_arena arena;
 			
 			/* live DIEs -- any basic DIE that is instantiated registers itself here,
 			 * and deregisters itself when it is destructed.
@@ -364,24 +876,407 @@ namespace dwarf
 			 * destructed when a Dwarf_Debug is destructed. So our intrusive_ptrs
 			 * will be invalid if we destruct the latter first, and bad results follow. */
 			map<Dwarf_Off, ptr_type > sticky_dies; // compile_unit_die is always sticky
+
+			/* Recently used non-sticky payloads, kept alive by the retention
+			 * policy. Like sticky_dies, this must die before live_dies. */
+			struct retained_payloads
+			{
+				struct entry
+				{
+					ptr_type p;
+					size_t bytes;
+				};
+				typedef std::list<entry> lru_list; // most recently used first
+				payload_retention_policy policy;
+				map<unsigned, lru_list> by_priority; // lowest first, so evict from begin()
+				unordered_map<Dwarf_Off, pair<unsigned, lru_list::iterator> > where;
+				unsigned count;
+				size_t bytes;
+				retained_payloads() : count(0), bytes(0) {}
+			} retained;
+			void retain_slow(basic_die *p);
+			void evict_retained();
+			/* Called whenever we hand out a live payload (or make one). */
+			void note_payload_use(basic_die *p)
+			{ if (retained.policy.enabled() && !frozen) retain_slow(p); }
 			
 			/* Each of these caches also has an in-payload equivalent, in basic_die. */
 			unordered_map<Dwarf_Off, Dwarf_Off> parent_of;
 			unordered_map<Dwarf_Off, Dwarf_Off> first_child_of;
 			unordered_map<Dwarf_Off, Dwarf_Off> next_sibling_of;
+			/* Where a DIE's subtree ends, just past the null entry ending its
+			 * children. A reader tells us when we walk off its last child
+			 * (see die_reader::next_sibling_or_end()), so that climbing back
+			 * out of a subtree needn't rescan it to find what follows. There's
+			 * no payload equivalent. */
+			unordered_map<Dwarf_Off, Dwarf_Off> subtree_end_of;
 			
 			map<pair<Dwarf_Off, Dwarf_Half>, Dwarf_Off> refers_to;
-			map<Dwarf_Off, pair< Dwarf_Off, bool> > equal_to;
-			map<Dwarf_Off, opt<uint32_t> > type_summary_code_cache; // FIXME: delete this after summary_code() uses SCCs
+			/* Memo table for type_die::equal(). Types proven equal are kept as
+			 * union-find classes, and pairs proven unequal are kept under their
+			 * classes' representatives. While a test is in progress, "assumed"
+			 * holds the pairs currently under test (which we treat as equal, to
+			 * stop recursion) and "provisional" holds the pairs proven equal
+			 * under those assumptions; we commit them once the outermost test
+			 * succeeds. Pairs are unordered, so they're stored lowest first. */
+			struct type_equality_memo
+			{
+				typedef pair<Dwarf_Off, Dwarf_Off> off_pair;
+				static off_pair ordered(Dwarf_Off a, Dwarf_Off b)
+				{ return a < b ? make_pair(a, b) : make_pair(b, a); }
+				unordered_map<Dwarf_Off, Dwarf_Off> parent; // absent means a singleton
+				std::unordered_set<off_pair, boost::hash<off_pair> > unequal;
+				std::vector<off_pair> assumed;
+				std::vector<off_pair> provisional;
+				Dwarf_Off rep(Dwarf_Off off) const;
+				void unite(Dwarf_Off a, Dwarf_Off b);
+				bool is_assumed(Dwarf_Off a, Dwarf_Off b) const;
+				/* Take offs out of their classes, and anything unequal to them
+				 * out of "unequal", keeping what we know about the others. */
+				void forget(const std::unordered_set<Dwarf_Off>& offs);
+			} type_equality;
+			map<Dwarf_Off, opt<uint32_t> > type_summary_code_cache; // filled by compute_all_type_summaries()
+			/* What invalidate_types_reaching() needs to walk the type graph
+			 * backwards. "referrers" maps each referenced offset to the DIEs
+			 * referring to it; we build it on the first edit that might spoil
+			 * a cache, and edits keep it up to date after that. The other two
+			 * find_definition() fills, since a declaration means whatever its
+			 * definition means, and a new definition, or a new name, changes
+			 * which one it finds. Until something is cached, edits cost nothing. */
+			struct type_dependents_state
+			{
+				bool built;
+				bool may_have_cached; // any payload's summary code, SCC or definition
+				std::unordered_multimap<Dwarf_Off, Dwarf_Off> referrers;
+				std::set<pair<Dwarf_Off, Dwarf_Off> > declarations_of; // (definition, declaration)
+				std::set<pair<unsigned, Dwarf_Off> > declarations_named; // (name ID, declaration)
+				type_dependents_state() : built(false), may_have_cached(false) {}
+			} type_dependents;
+			void build_type_referrers();
+			void note_type_cached() { if (!frozen) type_dependents.may_have_cached = true; }
+			void note_definition_sought(Dwarf_Off decl, const string& name, const iterator_base& found);
+			void note_reference(Dwarf_Off from, Dwarf_Off to)
+			{ if (type_dependents.built) type_dependents.referrers.insert(make_pair(to, from)); }
+			/* Concrete type offset -> its type_layout; with a canonical type
+			 * table, by representative. An edit drops those of the types it
+			 * reaches; see invalidate_types_reaching(). */
+			unordered_map<Dwarf_Off, shared_ptr<const type_layout> > type_layouts;
+			size_t type_layouts_bytes() const;
+			/* (canonical ID, canonical ID) -> whether the first is
+			 * rep-compatible with the second; see rep_compatible(). It goes
+			 * whenever the IDs do. */
+			unordered_map<pair<unsigned, unsigned>, bool, boost::hash<pair<unsigned, unsigned> > >
+				rep_compatible_cache;
 			opt<Dwarf_Off> synthetic_cu;
 
-			multimap<string, Dwarf_Off> visible_named_grandchildren_cache;
+			/* Names DIEs, for the name caches below; see name_interner. */
+			name_interner names;
+			/* Name ID -> the grandchildren of that name, sorted by offset. We
+			 * mostly fill it in offset order, so a new entry mostly goes on
+			 * the end. */
+			unordered_map<unsigned, std::vector<Dwarf_Off> > visible_named_grandchildren_cache;
+			size_t visible_named_grandchildren_bytes() const;
 			bool visible_named_grandchildren_is_complete;
 			friend class in_memory_abstract_die::attribute_map;
+			/* Rather than scan every CU to fill the cache above, we fill it a
+			 * CU at a time, and steer towards the right CU using the accelerator
+			 * tables (.debug_pubnames, or .debug_names if libdwarf reads it).
+			 * Those only list external things, and may list DIEs that aren't
+			 * grandchildren, so we treat them as hints, never as the answer. */
+			std::set<Dwarf_Off> visible_named_grandchildren_cus_done;
+			std::unordered_multimap<unsigned, Dwarf_Off> pubnames_hints; // name ID -> enclosing CU offset
+			bool pubnames_hints_loaded;
+			opt<Dwarf_Off> visible_named_grandchildren_cursor; // next CU for the step below
+			void note_visible_named_grandchild(string_view name, Dwarf_Off off);
+			void load_pubnames_hints();
+			void fill_visible_named_grandchildren_for_cu(const iterator_base& cu);
+			bool fill_visible_named_grandchildren_step(); // false if nothing left to do
+			/* Name ID -> first child of that name, per parent, for the tags
+			 * that find_named_child() indexes. Built on a parent's first lookup;
+			 * a new child, or a new name on an in-memory child, drops its
+			 * parent's entry. */
+			typedef unordered_map<Dwarf_Off, unordered_map<unsigned, Dwarf_Off> > named_children_index;
+			named_children_index named_children_of;
+			named_children_index::iterator index_named_children(const iterator_base& start);
+			size_t named_children_bytes() const;
+			/* Qualified name ID -> the named types with that name, for
+			 * type_named(). We index a CU at a time, in offset order, only as
+			 * far as lookups need. A new name or declaration flag on an
+			 * in-memory DIE starts it again. See type-names.cpp. */
+			struct type_name_index
+			{
+				struct entry
+				{
+					Dwarf_Off off;
+					Dwarf_Half tag; // class types are filed as structure types
+					bool declaration;
+				};
+				unordered_map<unsigned, std::vector<entry> > by_name; // each in offset order
+				opt<Dwarf_Off> cursor; // next CU to index
+				bool complete;
+				size_t entry_bytes; // by_name's vectors', for get_cache_usage()
+				type_name_index() : complete(false), entry_bytes(0) {}
+			} type_names;
+			bool index_type_names_step(); // false if nothing left to do
+			void index_type_names_under(const iterator_base& start, const string& prefix);
+			/* Indexes as far as it must to find one; null if none. */
+			const type_name_index::entry *type_name_lookup(Dwarf_Half tag,
+				const string& qualified_name, bool want_definition);
+			size_t type_names_bytes() const;
+			/* Subprogram offset -> its frame_locals_index (see above). Built
+			 * on first query; a new DIE anywhere, or a new location or type
+			 * on an in-memory one, drops them all. */
+			unordered_map<Dwarf_Off, shared_ptr<const frame_locals_index> > frame_locals_of;
+			size_t frame_locals_bytes() const;
+			/* Subprogram offset -> its inline_tree_index (see above), likewise,
+			 * except that it's a new pc range or origin that drops them. */
+			unordered_map<Dwarf_Off, shared_ptr<const inline_tree_index> > inline_trees_of;
+			size_t inline_trees_bytes() const;
+			/* Loclists and rangelists that attribute_values have decoded, by
+			 * their .debug_loc or .debug_ranges offset, so that DIEs pointing
+			 * at the same one share it (see encap::list_refcount). DWARF 5's,
+			 * in .debug_loclists and .debug_rnglists, are keyed with the top
+			 * bit set, however they were named (offset or index). */
+			unordered_map<Dwarf_Off, intrusive_ptr<const encap::loclist> > decoded_loclists;
+			unordered_map<Dwarf_Off, intrusive_ptr<const encap::rangelist> > decoded_rangelists;
+			size_t decoded_lists_bytes() const;
+
+			/* Depths are only filled in from a loaded nav index (see below);
+			 * normally find_upwards() recovers depth by walking parent_of. */
+			unordered_map<Dwarf_Off, unsigned short> depth_of;
+
+			/* Memory budget for the caches above; see set_cache_budget().
+			 * Every SAMPLE_INTERVAL cache insertions we note which CU the
+			 * newest entry is in, at what tick, and check our usage. CUs not
+			 * sampled lately are the cold ones. */
+			struct cache_budget_state
+			{
+				enum { SAMPLE_INTERVAL = 1024 };
+				size_t bytes; // 0 means no budget
+				unsigned countdown;
+				unsigned long tick;
+				unordered_map<Dwarf_Off, unsigned long> cu_last_sampled;
+				unordered_map<Dwarf_Off, unsigned> pinned; // see pin_position()
+				/* What the per-entry caches' values hold beyond their hash
+				 * nodes, kept up to date as entries come and go (by the
+				 * cache_ and forget_ calls below), so that get_cache_usage()
+				 * needn't walk them. type_names keeps its own. */
+				size_t layouts_bytes, grandchildren_bytes, named_children_bytes,
+					frame_locals_bytes, inline_trees_bytes, lists_bytes;
+				cache_budget_state() : bytes(0), countdown(SAMPLE_INTERVAL), tick(0),
+					layouts_bytes(0), grandchildren_bytes(0), named_children_bytes(0),
+					frame_locals_bytes(0), inline_trees_bytes(0), lists_bytes(0) {}
+			} budget;
+			void cache_type_layout(Dwarf_Off off, const shared_ptr<const type_layout>& p_layout);
+			void forget_type_layout(Dwarf_Off off);
+			void forget_type_layouts();
+			named_children_index::iterator cache_named_children(Dwarf_Off parent,
+				unordered_map<unsigned, Dwarf_Off>&& index);
+			void forget_named_children(Dwarf_Off parent);
+			void forget_all_named_children();
+			void cache_frame_locals(Dwarf_Off subprogram, const shared_ptr<const frame_locals_index>& p_index);
+			void forget_frame_locals();
+			void cache_inline_tree(Dwarf_Off subprogram, const shared_ptr<const inline_tree_index>& p_index);
+			void forget_inline_trees();
+			void cache_loclist(Dwarf_Off key, const encap::loclist *p_list);
+			void cache_rangelist(Dwarf_Off key, const encap::rangelist *p_list);
+			void note_cache_growth(Dwarf_Off off)
+			{ if (budget.bytes && !frozen && --budget.countdown == 0) sample_cache_budget(off); }
+			void sample_cache_budget(Dwarf_Off off);
+			bool evict_caches(bool between_queries);
+			void evict_nav_shards(size_t target, bool spare_current);
+			/* The CU a DIE we've issued is in, from the sticky CUs. */
+			opt<Dwarf_Off> sticky_cu_containing(Dwarf_Off off) const;
+			/* Navigation's fallback when eviction has taken a DIE's parent
+			 * entry: search down from its CU, not from the root. */
+			opt<Dwarf_Off> recover_parent(Dwarf_Off off);
+
+			/* Readahead; see set_readahead(). Navigation tells us whenever it
+			 * enters a CU. */
+			struct readahead_state
+			{
+				unsigned n_cus; // 0 means off
+				bool whole_sections_done;
+				Dwarf_Off info_done; // .debug_info below here is already asked for
+				unsigned long n_calls;
+				unsigned long n_bytes;
+				readahead_state() : n_cus(0), whole_sections_done(false), info_done(0),
+					n_calls(0), n_bytes(0) {}
+			} readahead;
+			void note_cu_entered(Dwarf_Off cu_off)
+			{ if (readahead.n_cus && !frozen) read_ahead_of(cu_off); }
+			void read_ahead_of(Dwarf_Off cu_off);
+
+			/* Dense navigation mode. Instead of a bunch of hash nodes per DIE,
+			 * we can keep one contiguous, offset-sorted array of records per CU,
+			 * found by binary search. Links are indices within the same CU's
+			 * array. It's only built on request (build_dense_nav()); when present,
+			 * parent(), first_child(), next_sibling() and find_upwards() consult
+			 * it before the hash-based caches. It knows nothing about in-memory
+			 * DIEs, so anything it doesn't cover falls through to the old path. */
+			struct dense_nav_record
+			{
+				enum { NONE = 0xffffffffu };
+				Dwarf_Off offset;
+				unsigned parent;       // index of parent in this CU's table, or NONE for the CU
+				unsigned first_child;  // index, or NONE
+				unsigned next_sibling; // index, or NONE
+				unsigned short depth;
+				Dwarf_Half tag;
+			};
+			struct dense_nav_cu_table
+			{
+				Dwarf_Off cu_offset;
+				record_span<dense_nav_record> records; // records[0] is the CU DIE
+				/* Links might come from a shared index, so we check them as we
+				 * follow them; null for NONE or anything out of range. */
+				const dense_nav_record *at(unsigned idx) const
+				{ return idx < records.size() ? &records[idx] : nullptr; }
+			};
+			std::vector<dense_nav_cu_table> dense_nav; // sorted by cu_offset
+			/* Every CU's records, one after another, unless they're in a
+			 * shared index. */
+			std::vector<dense_nav_record> dense_nav_storage;
+			const dense_nav_record *dense_nav_lookup(Dwarf_Off off,
+				const dense_nav_cu_table **p_cu = nullptr) const;
+			/* Append one CU's records to out, as build_dense_nav() makes them,
+			 * with indices counting from where they start. */
+			bool build_dense_nav_table(Dwarf_Off cu_off, std::vector<dense_nav_record>& out);
+			/* Make dense_nav point into storage, in which each CU starts at
+			 * the index paired with its offset, in offset order. */
+			void set_dense_nav(std::vector<dense_nav_record>&& storage,
+				const std::vector<pair<Dwarf_Off, size_t> >& cu_starts);
+
+			/* Address index. A flat array of disjoint, address-sorted intervals,
+			 * each labelled with the innermost DIE covering it: a subprogram
+			 * or lexical block, or failing that, the CU that .debug_aranges
+			 * says covers it. Built on request by build_addr_index(), or on
+			 * first lookup unless we're frozen. */
+		public: // for the helpers in addr-index.cpp
+			struct addr_index_entry
+			{
+				Dwarf_Addr lo; // inclusive
+				Dwarf_Addr hi; // exclusive
+				Dwarf_Off off;
+				unsigned short depth;
+			};
+			/* Static variable index: likewise, except that each interval is
+			 * (a piece of) a variable with static storage, and they come from
+			 * file_relative_intervals(), so they're file-relative too. See
+			 * static-var-index.cpp. */
+			struct static_var_entry
+			{
+				Dwarf_Addr lo; // inclusive
+				Dwarf_Addr hi; // exclusive
+				Dwarf_Off off;
+				Dwarf_Off offset_within; // of lo, within the variable
+			};
+		protected:
+			record_span<addr_index_entry> addr_index; // sorted by lo
+			std::vector<addr_index_entry> addr_index_storage; // unless shared
+			/* The intervals build_addr_index() flattens, for just the CUs in
+			 * *p_only if it's given; and the flattening, which sorts raw. */
+			void collect_addr_intervals(const std::set<Dwarf_Off> *p_only,
+				std::vector<addr_index_entry>& raw);
+			void flatten_addr_index(std::vector<addr_index_entry>& raw);
+			std::vector<static_var_entry> static_var_index; // sorted by lo
+
+			/* Line index: every CU's line_table rows, merged; and the names
+			 * of source files in line tables, interned. */
+			std::vector<line_table::row> line_index;
+			std::vector<string> line_file_names;
+			unordered_map<string, unsigned> line_file_ids;
+			unsigned intern_line_file(const string& name);
+			/* Whether we've built each index above. Any of them can be
+			 * empty once built, so this isn't the same as having entries.
+			 * Edits to the attributes they come from clear them. */
+			bool addr_index_built;
+			bool static_var_index_built;
+			bool line_index_built;
+
+			/* Split DWARF: the full units of our skeleton CUs. Each .dwo gets
+			 * a root_die of its own; a .dwp gets one, shared by all its units,
+			 * which we index by DWO ID from its .debug_cu_index. See
+			 * split-dwarf.cpp. */
+			struct split_unit_entry
+			{
+				shared_ptr<root_die> p_root; // null if we couldn't find it
+				Dwarf_Off cu_offset;         // in *p_root
+			};
+			unordered_map<Dwarf_Off, split_unit_entry> split_units; // by skeleton offset
+			opt<string> dwp_path;
+			string dwo_search_dir;
+			shared_ptr<root_die> dwp_root; // opened on first use
+			bool dwp_tried;
+			bool unit_dwo_ids_read;
+			/* If we've spliced our split units' children under our skeletons,
+			 * each split unit's root records where it hangs in ours. */
+			bool split_units_spliced;
+			struct splice_point
+			{
+				root_die *p_host;
+				Dwarf_Off skeleton_off; // in *p_host
+			};
+			unordered_map<Dwarf_Off, splice_point> spliced_under; // by our unit offset
+			unordered_map<Dwarf_Unsigned, Dwarf_Off> dwp_units; // DWO ID -> CU offset in *dwp_root
+			unordered_map<Dwarf_Off, Dwarf_Unsigned> unit_dwo_ids; // by unit DIE offset, from DWARF 5 headers
+			bool open_dwp();
+
+			/* Canonical type table. Every type DIE gets a dense ID shared by
+			 * all the types equal to it, wherever they are in the file; ID 0
+			 * is void. canonical_type_reps[id] is the lowest-offset type with
+			 * that ID. See canonical-types.cpp. */
+			unordered_map<Dwarf_Off, unsigned> canonical_type_ids;
+			record_span<Dwarf_Off> canonical_type_reps;
+			std::vector<Dwarf_Off> canonical_type_reps_storage; // unless shared
+			struct shared_canonical_id
+			{
+				Dwarf_Off off;
+				uint32_t id;
+				uint32_t unused;
+			};
+			/* A shared index's IDs, sorted by offset, in place of
+			 * canonical_type_ids. */
+			record_span<shared_canonical_id> shared_canonical_ids;
+			/* As canonical_id(), but never building the table. */
+			opt<unsigned> lookup_canonical_id(Dwarf_Off off) const;
+			/* After an edit: these types have no ID any more. */
+			void forget_canonical_ids(const std::unordered_set<Dwarf_Off>& offs);
+
+			/* The mapping of the shared index we're attached to, if any,
+			 * and its grandchild names; see attach_shared_index(). */
+			shared_ptr<const void> shared_index_mapping;
+			struct shared_name_record
+			{
+				uint64_t name_pos; // in shared_names_pool
+				uint64_t name_len;
+				uint64_t off;
+			};
+			record_span<shared_name_record> shared_names; // sorted by name, then offset
+			record_span<char> shared_names_pool;
+			void shared_grandchildren_named(string_view name, std::vector<Dwarf_Off>& out) const;
+
+			/* The snapshots we've loaded, kept mapped for as long as we
+			 * are, since restored DIEs read their attributes from them. */
+			std::vector<shared_ptr<const snapshot_view> > snapshot_views;
+
+			/* Frozen mode: see freeze() below. */
+			bool frozen;
+			bool nav_complete; // set by a successful preload()
+			std::vector<ptr_type> frozen_pins;
 
 			FrameSection *p_fs;
+			/* Set if navigation goes through our own reader; see set_reader(). */
+			shared_ptr<die_reader> p_reader;
+			iterator_base reader_pos(unsigned unit_idx, Dwarf_Off off,
+				opt<unsigned short> opt_depth, Dwarf_Off parent_off);
+			bool reader_name_view(Dwarf_Off off, string_view *out) const;
+			bool reader_has_attr(Dwarf_Off off, Dwarf_Half attr, bool *out) const;
+			int fd; // -1 if we weren't opened from one
 			Dwarf_Off current_cu_offset; // 0 means none
 			::Elf *returned_elf;
+			/* See root_stats above; bumped through DWARFPP_STAT_*. */
+			mutable live_root_stats m_stats;
 		public:
 			FrameSection&       get_frame_section()       { assert(p_fs); return *p_fs; }
 			const FrameSection& get_frame_section() const { assert(p_fs); return *p_fs; }
@@ -395,15 +1290,438 @@ namespace dwarf
 			void get_referential_structure(
 				unordered_map<Dwarf_Off, Dwarf_Off>& parent_of,
 				map<pair<Dwarf_Off, Dwarf_Half>, Dwarf_Off>& refers_to) const;
+			/* The same graph, much faster: we decode only the references,
+			 * straight from .debug_info, with nthreads threads taking a unit
+			 * at a time (0 means one per core). This needs an image to
+			 * decode, as NATIVE_READER does (see set_reader()), though not
+			 * that we're using it; and it touches none of our caches, so
+			 * needn't wait for freeze(). False if there was nothing to
+			 * decode, or some unit had bad data (whose DIEs up to there we
+			 * still give). */
+			bool extract_ref_graph(ref_graph& out, unsigned nthreads = 0) const;
+			/* See attr_columns above. In the same way, we decode only the
+			 * DIEs with one of tags (or all of them, if tags is empty), and
+			 * only their attrs, straight from .debug_info, a unit at a time
+			 * on each of nthreads threads, into per-unit columns that we
+			 * then concatenate. Strings point into the sections until we
+			 * intern them at the end, on this thread, so nothing is
+			 * allocated per DIE bar the columns' growth. Interning writes
+			 * to the name_interner, so this returns false if we're frozen;
+			 * otherwise, false as for extract_ref_graph(). */
+			bool extract(const std::vector<Dwarf_Half>& tags, const std::vector<Dwarf_Half>& attrs,
+				attr_columns& out, unsigned nthreads = 0);
+
+			/* Persistent navigation index. We can dump the navigation caches
+			 * (parent_of, first_child_of, next_sibling_of, refers_to, plus
+			 * the depth of each DIE) to a sidecar file named after the ELF
+			 * build-id, and warm-start a later root_die on the same binary
+			 * by mapping it back in. We only save what is cached, so walk
+			 * the tree first if you want a complete index. In-memory DIEs
+			 * are never saved. See nav-index.cpp. */
+			opt<string> get_build_id(); // hex string, if we have a build-id note
+			static opt<string> get_build_id(::Elf *e); // likewise, for any ELF
+			opt<string> nav_index_filename(const string& dir);
+			bool save_nav_index(const string& dir);
+			bool load_nav_index(const string& dir);
+
+			/* Snapshots of in-memory DIEs. We write every in-memory DIE,
+			 * column by column (offsets, tags, parent and sibling indices,
+			 * then each attribute's number, kind and value, with strings in
+			 * a pool), so that a tree built with make_new() can be mapped
+			 * back into a fresh root_die, at the same offsets. Edges to DIEs
+			 * from the file are kept, so if there is a file, its build-id
+			 * must match. Every attribute form is saved, blocks and lists
+			 * included; saving fails on an attribute of unrecognised form.
+			 * Loading fails if any offset is already taken, or if we're
+			 * frozen. Every DIE is made, sticky, but its attributes stay in
+			 * the mapping, which we keep: reads decode them from there, and
+			 * only the first attrs() on a DIE (i.e. an edit) copies its own
+			 * into its attribute map. bench/microbench's load_snapshot
+			 * measures loading, per DIE. See snapshot.cpp. */
+			bool save_snapshot(const string& filename);
+			bool load_snapshot(const string& filename);
+
+			/* Incremental re-indexing, for when a binary is rebuilt and most
+			 * of its CUs haven't changed. save_incremental_index() writes,
+			 * for each CU, a signature of its contents (see
+			 * native_reader::unit_signature()), its dense navigation table,
+			 * the names it contributes to visible_named_grandchildren(), the
+			 * intervals it contributes to the address index and the type
+			 * summary codes we have cached for it, all relative to the CU's
+			 * offset. That means building the first three if we haven't.
+			 * load_incremental_index(), on a later build, matches CUs by
+			 * signature, takes the saved data for those that match, at their
+			 * new offsets, and computes the rest afresh, leaving the dense
+			 * tables, the address index and the grandchild names complete.
+			 * Summary codes only carry over for self-contained CUs; the rest
+			 * are left to compute_all_type_summaries(), which skips whatever
+			 * is cached. Both need a native_reader, so an image (as with
+			 * MAP_FILE), and neither works while frozen. *p_n_reused gets how
+			 * many CUs matched. See incremental-index.cpp. */
+			bool save_incremental_index(const string& filename);
+			bool load_incremental_index(const string& filename, unsigned *p_n_reused = nullptr);
+
+			/* Shared indexes, for when many processes open the same binary.
+			 * publish_shared_index() writes the dense navigation tables, the
+			 * address index, the visible grandchild names and (if we've
+			 * built it) the canonical type table into a file in dir named
+			 * after the build-id, building the first three if need be. They
+			 * hold only offsets and indices, never pointers, so
+			 * attach_shared_index() can map the file read-only and have us
+			 * look things up in it directly, rather than building our own
+			 * copies; the pages are shared with every other process that
+			 * has it mapped. Point dir at /dev/shm to keep it in memory.
+			 * Attaching replaces whatever tables we had, and fails if we're
+			 * frozen, or there's no file for our build-id. detach drops the
+			 * shared tables, leaving us with none. See shared-index.cpp. */
+			opt<string> shared_index_filename(const string& dir);
+			bool publish_shared_index(const string& dir);
+			bool attach_shared_index(const string& dir);
+			void detach_shared_index();
+			bool have_shared_index() const { return (bool) shared_index_mapping; }
+
+			/* See dense_nav above. Building walks every CU using libdwarf
+			 * directly, so it doesn't touch the hash-based caches. */
+			bool build_dense_nav();
+			void clear_dense_nav() { dense_nav.clear(); dense_nav_storage.clear(); }
+			bool have_dense_nav() const { return !dense_nav.empty(); }
+			/* Where a DIE is in the dense tables: which CU, and which record
+			 * within it. For clients wanting per-CU arrays indexed by DIE, e.g.
+			 * visited sets. False if the tables don't cover off. */
+			bool dense_nav_position(Dwarf_Off off, unsigned *p_cu_idx, unsigned *p_rec_idx) const;
+			unsigned dense_nav_cu_size(unsigned cu_idx) const
+			{ return dense_nav[cu_idx].records.size(); }
+
+			/* Fill parent_of, first_child_of, next_sibling_of and depth_of for
+			 * the whole file, using nthreads workers (0 means one per core).
+			 * Each worker opens its own Dwarf_Debug on our fd (or our image,
+			 * if we have one) and walks a disjoint share of the CUs; we merge
+			 * the shards at the end.
+			 * Returns false if we weren't opened from an fd or image, or if any
+			 * worker hit an error (in which case the caches are partial). */
+			bool preload(unsigned nthreads = 0);
+			int get_fd() const { return fd; }
+			/* Null unless we were opened from an image (or with MAP_FILE). */
+			shared_ptr<const elf_image> get_elf_image() const { return img.image; }
+			/* Null unless libdwarf is reading our image through a
+			 * section_loader, i.e. with compressed sections inflated lazily. */
+			shared_ptr<section_loader> get_section_loader() const { return img.loader; }
+
+			/* Which reader finds children and siblings. LIBDWARF_READER is
+			 * the default. The others (see die-reader.hpp) navigate without
+			 * a Dwarf_Die or libdwarf's CU context, and the iterators they
+			 * give us are OFFSET_ONLY until somebody wants their attributes;
+			 * names and has_attr() don't count. Attribute values themselves
+			 * (types, locations, ranges and the rest) still come from
+			 * libdwarf, whichever reader we pick: wanting one materializes a
+			 * Dwarf_Die by offset. So the readers speed up walking and
+			 * filtering, not decoding, and libdwarf must still open the file.
+			 * NATIVE_READER decodes .debug_info itself (see
+			 * native-reader.hpp); it needs a
+			 * section_loader, so is only available if we were opened from an
+			 * image. LIBDW_READER asks elfutils' libdw (libdw-reader.hpp),
+			 * and is only available if we were built --with-libdw. Returns
+			 * whether we now have the reader asked for. Not while frozen. */
+			enum reader_kind { LIBDWARF_READER, NATIVE_READER, LIBDW_READER };
+			bool set_reader(reader_kind k);
+			reader_kind get_reader() const;
+			shared_ptr<const die_reader> get_die_reader() const { return p_reader; }
+			shared_ptr<const native_reader> get_native_reader() const; // null unless NATIVE_READER
+
+			/* Streaming traversal, for dumps and other whole-file passes.
+			 * Calls visit(d, depth) on every DIE exactly once, in offset
+			 * order, where d is a const Die& (hence an abstract_die) that is
+			 * only borrowed for the call; depth is 1 for CUs. The visitor
+			 * returns true to descend into d's children, false to skip them.
+			 * We make no payloads and write nothing into the navigation
+			 * caches (bar the CU-level ones), and we hold only the handles of
+			 * d's ancestors. The visitor may copy d's attributes, but must not
+			 * otherwise navigate this root meanwhile, since we use its CU
+			 * context. Returns false on error, or if frozen. */
+			template <typename Visitor>
+			bool stream(Visitor&& visit);
+
+			/* Frozen mode. After preload() or build_dense_nav(), freeze() makes
+			 * navigation and payload lookup safe from many threads at once.
+			 * It materialises every CU, has libdwarf load every section
+			 * readers touch, and pins every live payload, so that
+			 * live_dies, sticky_dies and the navigation caches never change
+			 * while we're frozen; payloads made while frozen are never
+			 * registered, so concurrent readers may get distinct payloads for
+			 * the same DIE. Calls into libdwarf that allocate are serialized
+			 * (see libdwarf_alloc_guard). Anything else that writes a cache
+			 * (type equality, name resolution, make_new() etc.) is still not
+			 * thread-safe. Returns false if the navigation info is incomplete.
+			 * Call thaw() from one thread once the readers are done. */
+			bool freeze();
+			void thaw();
+			bool is_frozen() const { return frozen; }
+
+			/* See root_stats above. To attribute counts to one query, use
+			 * a root_stats_scope around it. */
+			root_stats stats() const { return m_stats.load(); }
+			void reset_stats() { m_stats.reset(); }
+
+			/* See addr_index above. Lookups are a binary search, building
+			 * first unless we're frozen. If we have no aranges, we walk every
+			 * CU; otherwise only the CUs they name. Returns END if nothing we
+			 * know about covers the address. */
+			bool build_addr_index();
+			void clear_addr_index()
+			{ addr_index = record_span<addr_index_entry>(); addr_index_storage.clear(); addr_index_built = false; }
+			bool have_addr_index() const { return addr_index_built; }
+			iterator_base innermost_die_for_pc(Dwarf_Addr file_relative_addr);
+
+			/* See static_var_index above. Building asks every DW_TAG_variable
+			 * with a location outside a type (see has_static_storage()) for
+			 * its intervals, once; of two that overlap, we keep the one that
+			 * starts first (or the longer, or the lower-offset). With nthreads > 1, a frozen
+			 * root divides the CUs among that many threads (0 means one per
+			 * core). Lookups build it unless we're frozen, then do a binary
+			 * search; they return END if no static covers the address, and
+			 * otherwise, if asked, where in the variable the address is. */
+			bool build_static_var_index(unsigned nthreads = 1);
+			void clear_static_var_index() { static_var_index.clear(); static_var_index_built = false; }
+			bool have_static_var_index() const { return static_var_index_built; }
+			iterator_base static_var_for_addr(Dwarf_Addr file_relative_addr,
+				Dwarf_Off *out_offset_within = nullptr);
+
+			/* See line_index above. Building decodes every CU's line table
+			 * (see compile_unit_die::get_line_table()). pc_to_line() builds
+			 * on first use, unless we're frozen; it returns null if no row
+			 * covers the address. The batched version wants sorted pcs, and
+			 * is faster than one lookup per pc. */
+			bool build_line_index();
+			void clear_line_index() { line_index.clear(); line_index_built = false; }
+			bool have_line_index() const { return line_index_built; }
+			const line_table::row *pc_to_line(Dwarf_Addr file_relative_addr);
+			void pc_to_line(const std::vector<Dwarf_Addr>& sorted_addrs,
+				std::vector<const line_table::row *>& out);
+			const string& line_file_name(unsigned id) const { return line_file_names.at(id); }
+
+			/* Batched symbolization, for profilers and the like. For each pc,
+			 * in the order given, the CU, the innermost subprogram and the
+			 * chain of inlined subroutines in it (outermost first) that cover
+			 * it, and its line row; zero offsets and null rows mean none.
+			 * The pcs needn't be sorted: we sort and dedup a copy, then
+			 * sweep the address index once, finding each DIE's subprogram
+			 * only once however many pcs it covers, and each pc's chain in
+			 * that subprogram's inline_tree(). We build the address and
+			 * line indexes if need be and we're not frozen. With nthreads > 1,
+			 * a frozen root sweeps that many slices of the address space at
+			 * once (0 means one per core); an unfrozen one ignores it. */
+			struct symbolized_pc
+			{
+				Dwarf_Off cu;
+				Dwarf_Off subprogram;
+				unsigned first_inlined; // index into symbolization::inlined
+				unsigned n_inlined;
+				const line_table::row *line;
+			};
+			struct symbolization
+			{
+				std::vector<symbolized_pc> pcs;
+				std::vector<Dwarf_Off> inlined;
+			};
+			void symbolize(const Dwarf_Addr *pcs, size_t n, symbolization& out,
+				unsigned nthreads = 1);
+			void symbolize(const std::vector<Dwarf_Addr>& pcs, symbolization& out,
+				unsigned nthreads = 1)
+			{ symbolize(pcs.data(), pcs.size(), out, nthreads); }
+
+			/* See frame_locals_index above. Null unless subprogram is one.
+			 * Cached unless we're frozen. */
+			shared_ptr<const frame_locals_index> frame_locals(const iterator_base& subprogram);
+
+			/* See inline_tree_index above. Null unless subprogram is one.
+			 * Cached unless we're frozen. symbolize() uses these. */
+			shared_ptr<const inline_tree_index> inline_tree(const iterator_base& subprogram);
+
+			/* Memory budget for the caches: parent_of, first_child_of,
+			 * next_sibling_of, depth_of, refers_to, the type equality memo,
+			 * type summary codes and layouts, child-name indexes, frame-locals and inline-tree indexes,
+			 * decoded loclists and rangelists, and the visible-named-grandchildren cache.
+			 * The byte counts are estimates from entry counts and node
+			 * sizes, not malloc's exact figures. Once we go over budget, we
+			 * drop what is cheapest to recompute first: refers_to, then the
+			 * type caches, the child-name and frame-locals indexes and the decoded
+			 * lists, then the grandchildren
+			 * cache, and then the navigation entries of whole CUs, coldest
+			 * first, sparing the CU we're in,
+			 * until we're at three quarters of the budget. We check as the
+			 * caches grow, but the grandchildren cache may be mid-fill then,
+			 * so only an explicit enforce_cache_budget(), say between
+			 * queries, trims that; it spares no CU either. Entries of live
+			 * DIEs and pinned positions always stay. Navigation finds
+			 * what's gone again by searching down from the CU, so
+			 * a budget also means preload()'s completeness is lost, and
+			 * we can't freeze() until the next preload(). set_cache_budget(0)
+			 * is no budget, the default. Payloads kept by the retention policy
+			 * have their own limits. Nothing is evicted while frozen. */
+			struct cache_usage
+			{
+				size_t nav;
+				size_t refers_to;
+				size_t types;
+				size_t names;
+				size_t locals; // frame_locals() and inline_tree() indexes
+				size_t lists; // decoded loclists and rangelists
+				size_t total() const { return nav + refers_to + types + names + locals + lists; }
+			};
+			void set_cache_budget(size_t bytes) { budget.bytes = bytes; enforce_cache_budget(); }
+			/* A traversal holding a position as a bare offset, as
+			 * iterator_bf's queue does, pins it, so that eviction spares
+			 * its entries (as it does those of live DIEs). Pins nest. While
+			 * frozen nothing is evicted, so pinning does nothing and returns
+			 * false; an unpin then does nothing either, leaving a stale pin
+			 * rather than writing to a shared root. */
+			bool pin_position(Dwarf_Off off)
+			{ if (frozen) return false; ++budget.pinned[off]; return true; }
+			void unpin_position(Dwarf_Off off)
+			{
+				if (frozen) return;
+				auto found = budget.pinned.find(off);
+				if (found != budget.pinned.end() && --found->second == 0) budget.pinned.erase(found);
+			}
+			size_t get_cache_budget() const { return budget.bytes; }
+			cache_usage get_cache_usage() const;
+			/* Returns whether we're now within budget. */
+			bool enforce_cache_budget();
+
+			/* Readahead, for cold files on slow (e.g. network) storage, where
+			 * a walk would otherwise fault in .debug_info and friends one
+			 * small read at a time. With set_readahead(n), whenever
+			 * navigation enters a CU we ask the kernel (madvise(), with
+			 * MADV_WILLNEED) to start reading the .debug_info bytes of the
+			 * next n CUs, so the walk runs at sequential throughput. The
+			 * first time, we ask for .debug_abbrev and the string sections
+			 * whole, since lookups in those jump about. With the native
+			 * reader (see set_reader()), we also find the offsets of the
+			 * location and range lists the CU's DIEs use, and ask for those
+			 * pages of .debug_loc and .debug_ranges (or their DWARF 5
+			 * counterparts); with other readers, finding them would mean
+			 * decoding the CU twice. This only works for sections stored
+			 * plainly in an image (with MAP_FILE, or an elf_image), so
+			 * returns false, and does nothing, otherwise. 0 turns it off.
+			 * Nothing is asked for while frozen. */
+			bool set_readahead(unsigned n_cus);
+			unsigned get_readahead() const { return readahead.n_cus; }
+			unsigned long readahead_call_count() const { return readahead.n_calls; }
+			unsigned long readahead_byte_count() const { return readahead.n_bytes; }
+
+			/* See payload_retention_policy above. Setting a policy evicts
+			 * down to its limits at once; a disabled one drops everything
+			 * we were keeping. Not while frozen. */
+			bool set_retention_policy(const payload_retention_policy& policy);
+			const payload_retention_policy& get_retention_policy() const { return retained.policy; }
+			unsigned retained_payload_count() const { return retained.count; }
+			size_t retained_payload_bytes() const { return retained.bytes; }
+
+			/* Split DWARF. A skeleton CU, i.e. a DWARF 5 DW_TAG_skeleton_unit
+			 * or a CU with DW_AT_GNU_dwo_name, has the rest of its DIEs in a
+			 * .dwo file, or in a .dwp package of them. split_unit() gives the full unit, as
+			 * a CU of a root_die of its own, opened the first time any of
+			 * its units is asked for and kept as long as we are; so its
+			 * iterators' get_root() is that root, and offsets are the .dwo's.
+			 * We look in the package set by set_dwp_path() first, if there
+			 * is one and the skeleton has a DWO ID; then for the .dwo name
+			 * relative to DW_AT_comp_dir; then in the set_dwo_search_dir().
+			 * END if cu isn't a skeleton or we can't find its unit (we
+			 * remember that, and don't look again). prefetch_split_units()
+			 * opens every skeleton's .dwo at once, on nthreads threads (0
+			 * means one per core), and returns how many skeletons we now have
+			 * the unit of. While frozen, split_unit() only answers from what
+			 * we've already opened, and prefetching does nothing. dwo_id()
+			 * is a skeleton's, or a split unit's, DWO ID, from its unit header
+			 * in DWARF 5 or its DW_AT_GNU_dwo_id before.
+			 *
+			 * splice_split_units() prefetches, then makes navigation treat each
+			 * split unit's children as its skeleton's: a skeleton's first child
+			 * is then its split unit's, and those children's parent is the
+			 * skeleton, so a walk of our tree goes through every split unit we
+			 * have. The spliced DIEs are still the split unit root's, with its
+			 * offsets, so only iterator-relative navigation crosses over;
+			 * looking up one of those offsets in our root won't. A split unit's
+			 * own CU DIE is reachable only by split_unit(). Returns how many
+			 * units we spliced; does nothing while frozen. */
+			void set_dwp_path(const string& path) { dwp_path = path; dwp_root.reset(); dwp_tried = false; }
+			void set_dwo_search_dir(const string& dir) { dwo_search_dir = dir; }
+			bool is_skeleton(const iterator_df<compile_unit_die>& cu);
+			iterator_df<compile_unit_die> split_unit(const iterator_df<compile_unit_die>& cu);
+			unsigned prefetch_split_units(unsigned nthreads = 0);
+			unsigned splice_split_units(unsigned nthreads = 0);
+			opt<Dwarf_Unsigned> dwo_id(const iterator_df<compile_unit_die>& cu);
+
+			name_interner& get_name_interner() { return names; }
+			const name_interner& get_name_interner() const { return names; }
+
+			/* See canonical_type_ids above. Building computes every summary
+			 * code (with nthreads workers; see compute_all_type_summaries())
+			 * and uses them to bucket the types, so that each type is compared
+			 * (by type_die::equal()) only against the one representative of
+			 * each ID in its bucket. canonical_id() builds on first use, and
+			 * returns no ID for non-types, for types an edit has reached since
+			 * we built (see invalidate_types_reaching()), or if we're frozen
+			 * and not built. */
+			bool build_canonical_type_table(unsigned nthreads = 0);
+			bool have_canonical_type_table() const { return !canonical_type_reps.empty(); }
+			unsigned canonical_type_count() const { return canonical_type_reps.size(); }
+			opt<unsigned> canonical_id(const iterator_base& t);
+			iterator_base canonical_representative(unsigned id);
+
+			/* After an edit to the DIE at off (making it, or giving it an
+			 * attribute), forget what we know about the types it might change:
+			 * the type enclosing it (or it, if it's a type), what refers to
+			 * those, transitively, and declarations resolving to any of them.
+			 * Their summary codes, SCCs, equality results and definitions go;
+			 * the rest of the type graph keeps its caches. The in-memory
+			 * attribute maps and make_new() call this themselves; call it after
+			 * editing any other way. Their layouts go too, and they lose their
+			 * canonical IDs, along with the rep-compatibility answers and
+			 * layouts memoized under those IDs, until the next
+			 * build_canonical_type_table(). Returns how many types we
+			 * invalidated. */
+			unsigned invalidate_types_reaching(Dwarf_Off off);
+
+			/* See type_layout above. Null unless t is, or has as its concrete
+			 * type, a struct, class or union. Built once per type, or if we
+			 * have a canonical type table, once per ID, in which case the
+			 * members are the representative's. Cached unless we're frozen. */
+			shared_ptr<const type_layout> layout_of(const iterator_base& t);
+
+			/* Whether a t1 can be read as a t2, after typedefs and qualifiers:
+			 * type_die::is_rep_compatible(), memoized by canonical ID (unless
+			 * we're frozen, or have no ID for one of them). Equal types are
+			 * compatible, and types of different byte sizes never are, so we
+			 * answer those without asking the types. Not symmetric: a t2 with
+			 * extra members can still be compatible. */
+			bool rep_compatible(const iterator_base& t1, const iterator_base& t2);
 
 		public: // HMM
 			virtual Dwarf_Off fresh_cu_offset();
 			virtual Dwarf_Off fresh_offset_under(const iterator_base& pos);
 		
 		public:
-			root_die() : dbg(), visible_named_grandchildren_is_complete(false), p_fs(nullptr),
-				current_cu_offset(0), returned_elf(nullptr) {}
+			root_die() : dbg(), visible_named_grandchildren_is_complete(false),
+				pubnames_hints_loaded(false), addr_index_built(false), static_var_index_built(false),
+				line_index_built(false), dwp_tried(false), unit_dwo_ids_read(false), split_units_spliced(false), frozen(false), nav_complete(false), p_fs(nullptr),
+				fd(-1), current_cu_offset(0), returned_elf(nullptr) {}
 			root_die(int fd);
+			/* COPY_SECTIONS is what root_die(fd) does: libelf reads each
+			 * section into a heap buffer. MAP_FILE maps the file and reads
+			 * sections in place, falling back to copying if mapping fails.
+			 * Compressed sections of a mapped image are inflated only when
+			 * first used (see section_loader), and if section_cache_dir is
+			 * given, the inflated bytes are cached there for later opens. */
+			enum open_mode { COPY_SECTIONS, MAP_FILE };
+			root_die(int fd, open_mode mode, const string& section_cache_dir = string());
+			/* Open an ELF file already in memory, e.g. one mapping shared
+			 * among several root_dies. We have no fd, so get_fd() is -1. */
+			explicit root_die(shared_ptr<const elf_image> image,
+				const string& section_cache_dir = string());
+		protected:
+			root_die(int fd, shared_ptr<const elf_image> image, const string& section_cache_dir);
+		public:
 			virtual ~root_die();
 		
 			template <typename Iter = iterator_df<> >
@@ -525,11 +1843,30 @@ namespace dwarf
 			 * into the iterator method.
 			 * BUT we do put a special find_named_child method, emphasising the linear
 			 * search (slow). This is the fallback implementation used by the iterator.
+			 * For CUs, namespaces, structs, classes, unions and subprograms it
+			 * builds a name index of the children on first use, so later lookups
+			 * under the same parent are a hash lookup (not while frozen).
 			 */
 			iterator_base find_named_child(const iterator_base& start, const string& name);
 			/* This one is only for searches anchored at the root, so no need for "start". */
 			iterator_base find_visible_grandchild_named(const string& name);
 			std::vector<iterator_base> find_all_visible_grandchildren_named(const string& name);
+			/* Named types by qualified name, e.g. "ns::Bar<int>", optionally
+			 * preceded by "struct ", "class ", "union " or "enum " to say
+			 * which kind; otherwise any kind will do. Classes and structs
+			 * are the same kind. Types local to subprograms aren't found.
+			 * We prefer the first definition, then the first declaration;
+			 * with a canonical type table, we give the representative of
+			 * the definition's ID, and type_named_all() gives one definition
+			 * per ID, not every copy. The tag versions take DW_TAG_*, or 0
+			 * for any. A frozen root only uses what's already indexed, so
+			 * call index_all_type_names() first if you'll freeze. */
+			iterator_base type_named(const string& name);
+			iterator_base type_named(Dwarf_Half tag, const string& qualified_name);
+			std::vector<iterator_base> type_named_all(Dwarf_Half tag, const string& qualified_name);
+			void index_all_type_names();
+			/* What type_named() would call t; empty if it wouldn't find it. */
+			string qualified_type_name(const iterator_base& t);
 			
 			bool is_under(const iterator_base& i1, const iterator_base& i2);
 			
@@ -586,6 +1923,28 @@ namespace dwarf
 		};	
 		std::ostream& operator<<(std::ostream& s, const root_die& d);
 
+		/* Gives the counts made during its lifetime, e.g. for one query.
+		 * If p_out is set, we store them there when we go away. Scopes can
+		 * nest, but counts made by other threads meanwhile get included. */
+		struct root_stats_scope
+		{
+			const root_die& r;
+			root_stats start;
+			root_stats *p_out;
+			explicit root_stats_scope(const root_die& r, root_stats *p_out = nullptr)
+			 : r(r), start(r.stats()), p_out(p_out) {}
+			~root_stats_scope() { if (p_out) *p_out = so_far(); }
+			root_stats so_far() const { return r.stats() - start; }
+		};
+
+		inline string_view basic_die::get_name_view() const
+		{
+			if (d.handle) return d.name_view_here();
+			opt<string> maybe_name = get_name(); // maybe an in-memory DIE's
+			if (!maybe_name) return string_view();
+			name_interner& names = get_root().names;
+			return names.name(names.intern(*maybe_name));
+		}
 		inline bool basic_die::is_dummy() const // dynamic_cast doesn't work til we're fully constructed
 		{
 			return !d.handle && !refcount && !dynamic_cast<const in_memory_abstract_die *>(this);
@@ -593,14 +1952,23 @@ namespace dwarf
 		inline basic_die::basic_die(spec& s, Die&& h)
 		 : refcount(0), d(std::move(h))
 		{
+			/* A frozen root's live set is read-only, so payloads made while
+			 * frozen stay private to whoever made them. */
+			if (get_root().is_frozen()) return;
 			assert(get_root().live_dies.find(get_offset()) == get_root().live_dies.end());
 			get_root().live_dies.insert(make_pair(get_offset(), this));
 		}
 
 		inline basic_die::~basic_die()
 		{
-			if (!is_dummy()) get_root().live_dies.erase(get_offset());
-			debug(5) << "Destructed basic DIE object at " << this << std::endl;
+			if (!is_dummy())
+			{
+				// we might be one of the unregistered payloads (see above)
+				auto& live = get_root().live_dies;
+				auto found = live.find(get_offset());
+				if (found != live.end() && found->second == this) live.erase(found);
+			}
+			debug_expensive(5, << "Destructed basic DIE object at " << this << std::endl);
 		}
 		
 		struct in_memory_root_die : public root_die
@@ -0,0 +1,99 @@
+/* dwarfpp: C++ binding for a useful subset of libdwarf, plus extra goodies.
+ *
+ * section-loader.hpp: feeding libdwarf sections from an ELF image, lazily
+ *
+ * Copyright (c) 2008--17, Stephen Kell. For licensing information, see the
+ * LICENSE file in the root of the libdwarfpp tree.
+ */
+
+#ifndef DWARFPP_SECTION_LOADER_HPP_
+#define DWARFPP_SECTION_LOADER_HPP_
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include "root.hpp"
+
+namespace dwarf
+{
+	namespace core
+	{
+		/* Gives libdwarf its sections straight out of an elf_image, using
+		 * libdwarf's object access interface instead of libelf. Sections
+		 * stored plainly are pointers into the image. Compressed ones
+		 * (SHF_COMPRESSED, or the older .zdebug_* naming) are inflated only
+		 * when libdwarf first loads them, so that e.g. .debug_loc costs
+		 * nothing until somebody asks for a location list. libdwarf sees
+		 * them under their .debug_* names and inflated sizes.
+		 *
+		 * Given a cache directory, we save each section we inflate to a
+		 * file named after the build-id and the section, and a later loader
+		 * on the same binary maps that file instead of inflating again.
+		 * Binaries without a build-id aren't cached.
+		 *
+		 * We don't do relocation, so we only take host-endian executables
+		 * and shared objects; can_load() says whether an image qualifies.
+		 * One loader can serve several Dwarf_Debugs at once (preload()'s
+		 * workers share their root's). */
+		class section_loader
+		{
+		public:
+			enum compression_kind { NONE, ELF_CHDR, ZDEBUG };
+			struct section
+			{
+				std::string name; // as libdwarf sees it
+				Dwarf_Addr addr;
+				Dwarf_Unsigned size; // as libdwarf sees it, i.e. once inflated
+				Dwarf_Unsigned link;
+				Dwarf_Unsigned entrysize;
+				const unsigned char *file_bytes; // in the image; null for SHT_NOBITS
+				size_t file_size;
+				compression_kind compression;
+				const unsigned char *loaded; // null until first loaded
+				std::vector<unsigned char> inflated;
+				void *cache_mapping; // if loaded from the cache, we munmap this
+			};
+		private:
+			std::shared_ptr<const elf_image> image;
+			std::string cache_dir;
+			opt<string> build_id;
+			bool is_64bit;
+			std::vector<section> sections;
+			std::mutex load_mutex;
+			unsigned n_inflated;
+			unsigned n_cache_hits;
+			lib::Dwarf_Obj_Access_Methods methods;
+			lib::Dwarf_Obj_Access_Interface iface;
+
+			static int get_section_info(void *obj, Dwarf_Half idx,
+				lib::Dwarf_Obj_Access_Section *ret, int *error);
+			static lib::Dwarf_Endianness get_byte_order(void *obj);
+			static Dwarf_Small get_length_size(void *obj);
+			static Dwarf_Small get_pointer_size(void *obj);
+			static Dwarf_Unsigned get_section_count(void *obj);
+			static int load_section(void *obj, Dwarf_Half idx, Dwarf_Small **ret, int *error);
+
+			const unsigned char *load(section& s); // with load_mutex held
+			bool inflate(section& s);
+			bool load_cached(section& s);
+			void save_cached(const section& s);
+		public:
+			static bool can_load(const elf_image& image);
+			section_loader(std::shared_ptr<const elf_image> image, const string& cache_dir = string());
+			~section_loader();
+			section_loader(const section_loader&) = delete;
+			section_loader& operator=(const section_loader&) = delete;
+
+			lib::Dwarf_Obj_Access_Interface *get_interface() { return &iface; }
+			const std::vector<section>& get_sections() const { return sections; }
+			bool is_loaded(const string& name);
+			/* Load a section by name for our own use, e.g. by a native_reader.
+			 * False if there's no such section, or it won't load. */
+			bool get_section(const string& name, const unsigned char **p_data, Dwarf_Unsigned *p_size);
+			unsigned inflated_count() const { return n_inflated; }
+			unsigned cache_hit_count() const { return n_cache_hits; }
+		};
+	}
+}
+
+#endif
@@ -30,7 +30,7 @@
  * - we build the final abstract_def object 
      as a singleton of a fresh class (so it can get its own code, inlined etc..)
      built CRTP-wise as an extension of a predecessor standard
- * - each such class includes (as static consts) its tables as std::maps
+ * - each such class includes (as static consts) its tables, built at compile time
  
  * FIXME: get rid of const methods in abstract_def?
  * Or will that stop us from passing them by ref?
@@ -92,22 +92,51 @@ namespace dwarf
 			}
 		};
 
+		/* The tables are constant, and we consult them for every attribute
+		 * we decode, so spec.cpp builds them at compile time. Those keyed by
+		 * DW_* value are dense arrays over the range of their keys, which is
+		 * small for any one standard or vendor; a null entry means no such
+		 * key. Those keyed by name are perfect hashes. */
+		template <typename V>
+		struct dense_table
+		{
+			int lo;
+			unsigned n;
+			const V *values;
+			V lookup(int k) const
+			{ return (k >= lo && (unsigned) (k - lo) < n) ? values[k - lo] : V(); }
+		};
+		struct name_table
+		{
+			typedef std::pair<const char *, int> entry;
+			const entry *entries;
+			unsigned n_entries;
+			/* A name's bucket holds the seed that hashes it to its slot,
+			 * and a slot holds the index of its entry plus one. Both
+			 * counts are powers of two. */
+			const unsigned short *displacements;
+			unsigned n_buckets;
+			const unsigned short *slots;
+			unsigned n_slots;
+			const entry *find(const char *name) const;
+		};
+
 #define DECLARE_MAPS \
-			static const std::map<const char *, int, string_comparator> tag_forward_map; \
-			static const std::map<int, const char *> tag_inverse_map; \
-			static const std::map<const char *, int, string_comparator> form_forward_map; \
-			static const std::map<int, const char *> form_inverse_map; \
-			static const std::map<const char *, int, string_comparator> attr_forward_map; \
-			static const std::map<int, const char *> attr_inverse_map; \
-			static const std::map<const char *, int, string_comparator> encoding_forward_map; \
-			static const std::map<int, const char *> encoding_inverse_map; \
-			static const std::map<const char *, int, string_comparator> op_forward_map; \
-			static const std::map<int, const char *> op_inverse_map; \
-			static const std::map<const char *, int, string_comparator> interp_forward_map; \
-			static const std::map<int, const char *> interp_inverse_map; \
-			static const std::map<int, const int *> op_operand_forms_map; \
-			static const std::map<int, const int *> attr_class_map; \
-			static const std::map<int, const int *> form_class_map; 
+			static const name_table tag_forward_map; \
+			static const dense_table<const char *> tag_inverse_map; \
+			static const name_table form_forward_map; \
+			static const dense_table<const char *> form_inverse_map; \
+			static const name_table attr_forward_map; \
+			static const dense_table<const char *> attr_inverse_map; \
+			static const name_table encoding_forward_map; \
+			static const dense_table<const char *> encoding_inverse_map; \
+			static const name_table op_forward_map; \
+			static const dense_table<const char *> op_inverse_map; \
+			static const name_table interp_forward_map; \
+			static const dense_table<const char *> interp_inverse_map; \
+			static const dense_table<const int *> op_operand_forms_map; \
+			static const dense_table<const int *> attr_class_map; \
+			static const dense_table<const int *> form_class_map; 
 
 #define DECLARE_BOILERPLATE(typename) \
 			static typename inst; \
@@ -147,6 +176,11 @@ namespace dwarf
 				macptr,
 				rangelistptr,
 				exprloc, 
+				/* DWARF 5's bases of a unit's tables, in sections of their own */
+				addrptr,
+				stroffsetsptr,
+				loclistsptr,
+				rnglistsptr,
 				block_as_dwarf_expr = 0x20, 
 				constant_to_make_location_expr, 
 				FLAGS = 0x7f000000,
@@ -254,25 +288,23 @@ namespace dwarf
 		struct extension_of : public virtual abstract_def
 		{
 			// try Extending's maps, else delegate to Extended's lookup method
-			/* Our maps use const char * but our methods take const string&,
-			 * so we want to allow convertibility between these. This means that
-			 * K (method signature) and MappedK (map type parameters) 
-			 * are not necessarily the same. */
-			template <typename K, typename V, typename Cmp>
+			/* The method may be one Extended inherits, so don't try to
+			 * deduce anything from its type. */
+			template <typename V, typename Method>
 			V
-			map_union_lookup(
-				const std::map<K, V, Cmp>& m1, 
-				V (Extended::*method)(K) const, 
-				const K& k) const
-			{
-				typename std::map<
-					K,
-					V
-				>::const_iterator found1 = m1.find(k);
-				if (found1 != m1.end())
-				{
-					return found1->second;
-				} else return (Extended::inst.*method)(k);
+			map_union_lookup(const dense_table<V>& t, Method method, int k) const
+			{
+				V found = t.lookup(k);
+				if (found) return found;
+				else return (Extended::inst.*method)(k);
+			}
+			template <typename Method>
+			int
+			map_union_lookup(const name_table& t, Method method, const char *name) const
+			{
+				const name_table::entry *found = t.find(name);
+				if (found) return found->second;
+				else return (Extended::inst.*method)(name);
 			}
 			
 			const char *tag_lookup(int tag) const 
@@ -365,11 +397,11 @@ namespace dwarf
 			size_t op_operand_count(int op) const
 			{
 				int count = 0;
-				std::map<int, const int *>::const_iterator found = Extending::inst.op_operand_forms_map.find(op);
-				if (found != Extending::inst.op_operand_forms_map.end())
+				const int *found = Extending::op_operand_forms_map.lookup(op);
+				if (found)
 				{
 					// linear count-up
-					for (const int *p_form = found->second; *p_form != 0; p_form++) count++;
+					for (const int *p_form = found; *p_form != 0; p_form++) count++;
 					return count;		
 				} else return Extended::inst.op_operand_count(op);
 			}
@@ -445,8 +477,8 @@ namespace dwarf
 	
 		void print_symmetric_map_pair(
 			std::ostream& o,
-			const std::map<const char *, int>& forward_map,
-			const std::map<int, const char *>& inverse_map);
+			const name_table& forward_map,
+			const dense_table<const char *>& inverse_map);
 		
 		template <class DefWithMaps>
 		std::ostream& print(std::ostream& o) 
@@ -470,28 +502,28 @@ namespace dwarf
 			print_symmetric_map_pair(o, DefWithMaps::interp_forward_map, DefWithMaps::interp_inverse_map);
 						
 			o << "Attribute classes: " << std::endl;
-			for (std::map<int, const int *>::const_iterator i = DefWithMaps::attr_class_tbl.begin();
-				i != DefWithMaps::attr_class_tbl.end();
-				i++)
+			for (unsigned i = 0; i < DefWithMaps::attr_class_map.n; i++)
 			{
-				o << DefWithMaps::attr_lookup(i->first) << ": ";
-				for (const int *p = i->second; *p != interp::EOL; p++)
+				const int *classes = DefWithMaps::attr_class_map.values[i];
+				if (!classes) continue;
+				o << DefWithMaps::inst.attr_lookup(DefWithMaps::attr_class_map.lo + i) << ": ";
+				for (const int *p = classes; *p != interp::EOL; p++)
 				{
-					o << DefWithMaps::interp_lookup(*p && ~interp::FLAGS);
+					o << DefWithMaps::inst.interp_lookup(*p & ~interp::FLAGS);
 					if (*(p+1) != interp::EOL) o << ", ";
 				}
 				o << std::endl;
 			}
 			
 			o << "Form classes: " << std::endl;
-			for (std::map<int, const int *>::const_iterator i = DefWithMaps::form_class_tbl.begin();
-				i != DefWithMaps::form_class_tbl.end();
-				i++)
+			for (unsigned i = 0; i < DefWithMaps::form_class_map.n; i++)
 			{
-				o << DefWithMaps::form_lookup(i->first) << ": ";
-				for (const int *p = i->second; *p != interp::EOL; p++)
+				const int *classes = DefWithMaps::form_class_map.values[i];
+				if (!classes) continue;
+				o << DefWithMaps::inst.form_lookup(DefWithMaps::form_class_map.lo + i) << ": ";
+				for (const int *p = classes; *p != interp::EOL; p++)
 				{
-					o << DefWithMaps::interp_lookup(*p && ~interp::FLAGS);
+					o << DefWithMaps::inst.interp_lookup(*p & ~interp::FLAGS);
 					if (*(p+1) != interp::EOL) o << ", ";
 				}
 				o << std::endl;
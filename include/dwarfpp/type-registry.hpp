@@ -0,0 +1,61 @@
+/* dwarfpp: C++ binding for a useful subset of libdwarf, plus extra goodies.
+ * 
+ * type-registry.hpp: canonical type IDs across several root DIEs
+ *
+ * Copyright (c) 2008--17, Stephen Kell. For licensing information, see the
+ * LICENSE file in the root of the libdwarfpp tree.
+ */
+
+#ifndef DWARFPP_TYPE_REGISTRY_HPP_
+#define DWARFPP_TYPE_REGISTRY_HPP_
+
+#include <vector>
+#include <unordered_map>
+#include "lib.hpp"
+
+namespace dwarf
+{
+	namespace core
+	{
+		/* A type registry gives global canonical IDs to the types of many
+		 * root_dies (say, an executable and its libraries), so that the
+		 * "same" struct gets the same ID in all of them. Each root first
+		 * builds its own canonical type table (see root_die); that's the
+		 * bulk of the work. We do one root at a time, since only frozen
+		 * roots may be used concurrently, but each root uses every thread.
+		 * We then merge the roots' representatives, bucketing them by a
+		 * key made from their structure and names -- not their offsets or
+		 * declaration coordinates, so anonymous types can match too -- and
+		 * confirming with type_die::equal(). After build(), looking up a
+		 * type is two hash lookups. ID 0 is void.
+		 *
+		 * The roots must outlive the registry, and mustn't be frozen. */
+		class type_registry
+		{
+			std::vector<root_die *> roots;
+			std::unordered_map<const root_die *, unsigned> root_index;
+			/* For each root, its local canonical ID -> our global ID. */
+			std::vector<std::vector<unsigned> > global_id_of_local;
+			/* For each global ID, a representative (root number, offset). */
+			std::vector<pair<unsigned, Dwarf_Off> > reps;
+		public:
+			type_registry() : reps(1, make_pair(0u, 0UL)) {}
+			/* Returns the root's number, which is stable. Adding a root
+			 * discards any previous build. */
+			unsigned add_root(root_die& r);
+			unsigned root_count() const { return roots.size(); }
+			root_die& get_root(unsigned n) const { return *roots.at(n); }
+			/* nthreads == 0 means one per core. Returns false if any root
+			 * failed to build its table (e.g. because it was frozen). */
+			bool build(unsigned nthreads = 0);
+			bool is_built() const { return global_id_of_local.size() == roots.size() && !roots.empty(); }
+			unsigned size() const { return reps.size(); } // including void
+			/* No ID if the registry isn't built, t isn't a type, or t's root
+			 * isn't one of ours. */
+			opt<unsigned> global_id(const iterator_df<type_die>& t) const;
+			iterator_df<type_die> representative(unsigned id) const;
+		};
+	}
+}
+
+#endif
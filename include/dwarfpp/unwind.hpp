@@ -0,0 +1,135 @@
+/* dwarfpp: C++ binding for a useful subset of libdwarf, plus extra goodies.
+ *
+ * unwind.hpp: stack unwinding over compiled call frame information
+ *
+ * Copyright (c) 2008--17, Stephen Kell. For licensing information, see the
+ * LICENSE file in the root of the libdwarfpp tree.
+ */
+
+#ifndef DWARFPP_UNWIND_HPP_
+#define DWARFPP_UNWIND_HPP_
+
+#include <vector>
+#include <cstring>
+#include "frame.hpp"
+#include "expr.hpp"
+
+namespace dwarf
+{
+	namespace core
+	{
+		/* Where an unwinder gets the contents of the stack from: a copy taken
+		 * with a sample, another process, or our own memory. Reads are of
+		 * one target word, or smaller. */
+		class memory_reader
+		{
+		public:
+			virtual bool read(Dwarf_Addr addr, unsigned size, Dwarf_Unsigned *out) = 0;
+			virtual ~memory_reader() {}
+		};
+		/* The common case of a profiler sample: a copy of the stack from
+		 * some address upwards. Host byte order. */
+		class captured_stack_reader : public memory_reader
+		{
+			Dwarf_Addr base;
+			const unsigned char *bytes;
+			size_t len;
+		public:
+			captured_stack_reader(Dwarf_Addr base, const unsigned char *bytes, size_t len)
+			 : base(base), bytes(bytes), len(len) {}
+			bool read(Dwarf_Addr addr, unsigned size, Dwarf_Unsigned *out)
+			{
+				if (addr < base || size > sizeof *out || addr - base + size > len) return false;
+				*out = 0;
+				memcpy(out, bytes + (addr - base), size);
+				return true;
+			}
+		};
+
+		/* A snapshot of a frame's registers, by DWARF register number. Only
+		 * some registers are known in any frame; we don't allocate. */
+		struct frame_regs : public expr::regs
+		{
+			enum { MAX_REGS = 64 };
+			Dwarf_Addr pc;
+			Dwarf_Addr cfa; // zero in the innermost frame, where we don't know it
+			uint64_t valid; // bitmask
+			Dwarf_Unsigned vals[MAX_REGS];
+
+			frame_regs() : pc(0), cfa(0), valid(0) {}
+			bool has(int regnum) const
+			{ return regnum >= 0 && regnum < MAX_REGS && (valid & (1ull << regnum)); }
+			Dwarf_Signed get(int regnum)
+			{
+				if (!has(regnum)) throw No_entry();
+				return vals[regnum];
+			}
+			void set(int regnum, Dwarf_Signed val)
+			{
+				if (regnum < 0 || regnum >= MAX_REGS) throw No_entry();
+				vals[regnum] = val;
+				valid |= (1ull << regnum);
+			}
+			void clear(int regnum)
+			{ if (regnum >= 0 && regnum < MAX_REGS) valid &= ~(1ull << regnum); }
+		};
+
+		/* An unwinder steps from a frame to its caller using a cfi_table, so
+		 * that each step is a binary search and a few rule applications,
+		 * with no decoding and no allocation. The table is read-only
+		 * once built, so one unwinder, or many sharing one table, can
+		 * unwind on any number of threads at once.
+		 *
+		 * In the caller, registers the table tracks get their rules applied
+		 * (having no rule means "same value"); the stack pointer gets the
+		 * CFA; every other register is forgotten, since it may have been
+		 * clobbered. So the table must track the return address column,
+		 * as the default set does. */
+		class unwinder
+		{
+			cfi_table own_table;
+			const cfi_table& table;
+			int sp_regnum;
+			int ra_regnum;
+			unsigned word_size;
+			void init(const FrameSection& fs);
+			bool eval_rule_expr(const cfi_table::rule& r, frame_regs& regs,
+				Dwarf_Addr cfa, bool push_cfa, Dwarf_Unsigned *out) const;
+		public:
+			/* Compile our own table... */
+			explicit unwinder(const FrameSection& fs) : own_table(fs), table(own_table) { init(fs); }
+			/* ... or share one, which must outlive us. */
+			unwinder(const FrameSection& fs, const cfi_table& shared) : table(shared) { init(fs); }
+
+			const cfi_table& get_table() const { return table; }
+			int get_sp_regnum() const { return sp_regnum; }
+			int get_ra_regnum() const { return ra_regnum; }
+
+			/* Replace regs by the caller's. Returns false at the outermost
+			 * frame, or if we can't go on (no CFI for the pc, a register or
+			 * memory we don't have, an expression we can't evaluate). In the
+			 * innermost frame, pass innermost = true so that we look up pc
+			 * itself rather than pc - 1, which is needed elsewhere since a
+			 * return address may be just past the end of its caller's FDE. */
+			bool step(frame_regs& regs, memory_reader& mem, bool innermost = false) const;
+			/* Append regs and up to max_frames - 1 callers to out. Returns the
+			 * number of frames appended. */
+			unsigned unwind(const frame_regs& regs, memory_reader& mem,
+				std::vector<frame_regs>& out, unsigned max_frames = 256) const;
+
+			struct sample
+			{
+				frame_regs regs; // of the innermost frame
+				memory_reader *p_mem;
+			};
+			/* Unwind many samples at once, on several threads (0 means one per
+			 * hardware thread). Gives the pcs of each sample's frames, innermost
+			 * first. The memory readers must be safe to use concurrently with
+			 * one another. */
+			std::vector<std::vector<Dwarf_Addr> > unwind_all(const std::vector<sample>& samples,
+				unsigned max_frames = 256, unsigned nthreads = 0) const;
+		};
+	}
+}
+
+#endif
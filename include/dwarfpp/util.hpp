@@ -11,20 +11,38 @@
 
 #include <fstream>
 #include <iostream>
+#include <boost/utility/string_view.hpp>
 
 namespace dwarf
 {
 	namespace core
 	{
+		using boost::string_view; // the same type whatever -std clients build with
 		extern std::ofstream null_out;
 		extern unsigned debug_level;
+		/* Messages above this level are compiled out, whatever
+		 * DWARFPP_DEBUG_LEVEL says. By default, none are. */
+#ifndef DWARFPP_DEBUG_MAX_LEVEL
+#define DWARFPP_DEBUG_MAX_LEVEL (~0u)
+#endif
+		#define debug_enabled(lvl) \
+			((unsigned) (lvl) <= DWARFPP_DEBUG_MAX_LEVEL && ::dwarf::core::debug_level >= (unsigned) (lvl))
 		inline std::ostream& debug(unsigned level = 1)
 		{
-			if (debug_level >= level) return std::cerr;
+			if (debug_enabled(level)) return std::cerr;
 			else return null_out;
 		}
+		/* debug(lvl) << ... still evaluates everything it streams, even
+		 * into null_out. On hot paths, write debug_expensive(lvl, << ...)
+		 * instead, which evaluates nothing unless the message is enabled. */
 		#define debug_expensive(lvl, args...) \
-			((debug_level >= (lvl)) ? (debug(lvl) args) : (debug(lvl)))
+			((debug_enabled(lvl)) ? (::dwarf::core::debug(lvl) args) : (::dwarf::core::debug(lvl)))
+		/* For messages too frequent to want every time: print the first of
+		 * each `every' that this call site (in this thread) would print. */
+		#define debug_sampled(lvl, every, args...) \
+			do { static thread_local unsigned long debug_sample_count; \
+				if (debug_enabled(lvl) && debug_sample_count++ % (every) == 0) \
+					::dwarf::core::debug(lvl) args; } while (0)
 	}
 }
 
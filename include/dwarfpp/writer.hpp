@@ -0,0 +1,115 @@
+/* dwarfpp: C++ binding for a useful subset of libdwarf, plus extra goodies.
+ *
+ * writer.hpp: writing a root_die's DIEs back out as DWARF
+ *
+ * Copyright (c) 2008--17, Stephen Kell. For licensing information, see the
+ * LICENSE file in the root of the libdwarfpp tree.
+ */
+
+#ifndef DWARFPP_WRITER_HPP_
+#define DWARFPP_WRITER_HPP_
+
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include "lib.hpp"
+
+namespace dwarf
+{
+	namespace core
+	{
+		/* A writer makes .debug_info, .debug_abbrev, .debug_str,
+		 * .debug_line, .debug_loc and .debug_ranges contents from the DIEs
+		 * under a root, whether from a file or in memory, walking each unit
+		 * once and appending as it goes. Output is DWARF 4, 32-bit,
+		 * little-endian. All units share one abbrev table, in which each
+		 * distinct shape of DIE (tag, children or not, attributes and their
+		 * forms) gets one code; each distinct string goes once in
+		 * .debug_str, and each distinct (shared) list once in its section.
+		 *
+		 * DIEs move, so references are written as DW_FORM_ref_addr and
+		 * patched by finish(), once everything they might point to has
+		 * been written. Until then the sections are incomplete.
+		 *
+		 * With dedup_types, a type that the canonical type table (see
+		 * root_die::build_canonical_type_table()) finds equal to an
+		 * earlier one is left out, along with its children; references to
+		 * it, or to any child that lines up with one of the
+		 * representative's, go to the representative instead.
+		 *
+		 * A CU's DW_AT_stmt_list gets a line program made from its
+		 * line_table, which is what we know of its lines: one file table
+		 * of full paths, no directories, and only standard opcodes. Range
+		 * lists are written with absolute addresses, and location lists
+		 * relative to the CU's base, as we hold them. What we can't write,
+		 * we drop: DW_AT_macro_info and DW_AT_sibling; DW_AT_stmt_list where
+		 * there's no line table to be had (while frozen, or in memory);
+		 * location lists with a "default" entry, which DWARF 4 can't say.
+		 * The get_stats() counts say what was dropped. */
+		class dwarf_writer
+		{
+		public:
+			struct stats
+			{
+				unsigned long n_units;
+				unsigned long n_dies;
+				unsigned long n_types_collapsed;
+				unsigned long n_attrs_dropped;
+				unsigned long n_refs_unresolved;
+			};
+		private:
+			root_die *p_root;
+			bool m_dedup_types;
+			bool m_finished;
+			std::string m_info;
+			std::string m_abbrev;
+			std::string m_str;
+			std::string m_line;
+			std::string m_loc;
+			std::string m_ranges;
+			/* Keyed by the abbrev's bytes, less its code. */
+			std::unordered_map<std::string, Dwarf_Unsigned> abbrev_codes;
+			std::unordered_map<std::string, Dwarf_Off> str_offsets;
+			/* Lists are often shared, so we write each once, keyed by address. */
+			std::unordered_map<const void *, Dwarf_Off> loc_offsets;
+			std::unordered_map<const void *, Dwarf_Off> range_offsets;
+			std::vector<encap::attribute_value> kept_lists; // so those addresses stay theirs
+			/* Input offset -> output offset. */
+			std::unordered_map<Dwarf_Off, Dwarf_Off> out_offset_of;
+			/* Input offset of a DIE we left out -> the one that stands for it. */
+			std::unordered_map<Dwarf_Off, Dwarf_Off> alias_of;
+			/* Where in m_info a reference goes, and to which input DIE. */
+			std::vector<std::pair<size_t, Dwarf_Off> > fixups;
+			stats m_stats;
+
+			bool collapse(const iterator_base& i);
+			void alias_subtree(const iterator_base& from, const iterator_base& to);
+			void write_die(const iterator_base& i, unsigned addr_size);
+			Dwarf_Off str_offset(const std::string& s);
+			opt<Dwarf_Off> line_offset(const iterator_base& cu, unsigned addr_size);
+			opt<Dwarf_Off> loc_offset(const encap::loclist& ll, unsigned addr_size);
+			Dwarf_Off range_offset(const encap::rangelist& rl, unsigned addr_size);
+			opt<Dwarf_Off> resolve(Dwarf_Off target) const;
+		public:
+			dwarf_writer(root_die& r, bool dedup_types = false);
+			root_die& get_root() const { return *p_root; }
+
+			void write_unit(const iterator_base& cu);
+			void write_all();
+			/* False if some reference had nowhere to go, e.g. into a unit
+			 * we didn't write; those are left as zero. */
+			bool finish();
+
+			const std::string& info() const { return m_info; }
+			const std::string& abbrev() const { return m_abbrev; }
+			const std::string& str() const { return m_str; }
+			const std::string& line() const { return m_line; }
+			const std::string& loc() const { return m_loc; }
+			const std::string& ranges() const { return m_ranges; }
+			const stats& get_stats() const { return m_stats; }
+		};
+	}
+}
+
+#endif
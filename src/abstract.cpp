@@ -36,17 +36,26 @@ namespace dwarf
 		{
 			basic_die *p;
 			Die d(std::move(dynamic_cast<Die&&>(h)));
-			assert(d.tag_here() != DW_TAG_compile_unit);
+			assert(!tag_is_cu(d.tag_here()));
+			payload_arena *a = arena_for(r);
+			/* Each case's sizeof is a size class in the arena. */
 			switch (d.tag_here())
 			{
 #define factory_case(name, ...) \
-case DW_TAG_ ## name: p = new name ## _die(d.spec_here(), std::move(d.handle)); break; // FIXME: not "basic_die"...
+case DW_TAG_ ## name: p = a ? new (*a) name ## _die(d.spec_here(), std::move(d.handle)) \
+	: new name ## _die(d.spec_here(), std::move(d.handle)); break; // FIXME: not "basic_die"...
 #include "dwarf-current-factory.h"
 #undef factory_case
-				default: p = new basic_die(d.spec_here(), std::move(d.handle)); break;
+				default: p = a ? new (*a) basic_die(d.spec_here(), std::move(d.handle))
+					: new basic_die(d.spec_here(), std::move(d.handle)); break;
 			}
 			return p;
 		}
+
+		payload_arena *factory::arena_for(root_die& r)
+		{
+			return r.is_frozen() ? nullptr : &r.arena;
+		}
 		
 		compile_unit_die *factory::make_cu_payload(abstract_die&& h, root_die& r)
 		{
@@ -98,26 +107,42 @@ case DW_TAG_ ## name: p = new name ## _die(d.spec_here(), std::move(d.handle));
 		basic_die *factory::make_new(const iterator_base& parent, Dwarf_Half tag)
 		{
 			root_die& r = parent.root();
+			/* Offsets are issued only once we know we can make the DIE. */
+			return make_in_memory(r, parent.depth() >= 1 ? parent.spec_here() : DEFAULT_DWARF_SPEC,
+				tag, [&parent, &r]() -> pair<Dwarf_Off, Dwarf_Off> {
+					if (parent.is_root_position())
+					{
+						Dwarf_Off off = r.fresh_cu_offset();
+						return make_pair(off, off);
+					}
+					return make_pair(r.fresh_offset_under(/*r.enclosing_cu(parent)*/parent),
+						parent.enclosing_cu_offset_here());
+				});
+		}
+
+		basic_die *factory::make_restored(root_die& r, Dwarf_Half tag, Dwarf_Off off, Dwarf_Off cu_off)
+		{
+			return make_in_memory(r, DEFAULT_DWARF_SPEC, tag, [off, cu_off]() {
+				return make_pair(off, cu_off);
+			});
+		}
+
+		basic_die *factory::make_in_memory(root_die& r, spec& s, Dwarf_Half tag,
+			std::function<pair<Dwarf_Off, Dwarf_Off>()> where)
+		{
 // declare all the in-memory structs as local classes (for now)
 #define factory_case(name, ...) \
 			struct in_memory_ ## name ## _die : public in_memory_abstract_die, \
 			     public name ## _die \
 			{ \
-				in_memory_ ## name ## _die(const iterator_base& parent) \
+				in_memory_ ## name ## _die(root_die& r, spec& s, const pair<Dwarf_Off, Dwarf_Off>& where) \
 				: \
 					/* initialize basic_die directly, since it's a virtual base */ \
-					basic_die(parent.depth() >= 1 ? parent.spec_here() : DEFAULT_DWARF_SPEC, \
-					    parent.root()), \
-					in_memory_abstract_die(parent.root(), \
-							  parent.is_root_position() ? \
-							  parent.root().fresh_cu_offset() \
-							: parent.root().fresh_offset_under(/*parent.root().enclosing_cu(parent)*/parent), \
-						parent.is_root_position() ? 0 : parent.enclosing_cu_offset_here(), \
-						DW_TAG_ ## name), \
-					name ## _die(parent.depth() >= 1 ? parent.spec_here() : DEFAULT_DWARF_SPEC) \
+					basic_die(s, r), \
+					in_memory_abstract_die(r, where.first, where.second, DW_TAG_ ## name), \
+					name ## _die(s) \
 				{ \
-					if (parent.is_root_position()) m_cu_offset = m_offset; \
-					parent.root().live_dies.insert( \
+					r.live_dies.insert( \
 					    make_pair(this->in_memory_abstract_die::get_offset(), this) \
 					); \
 				 } \
@@ -146,7 +171,7 @@ case DW_TAG_ ## name: p = new name ## _die(d.spec_here(), std::move(d.handle));
 				{ return copy_attrs(); } \
 				/* get a single attr */ \
 				virtual encap::attribute_value attr(Dwarf_Half a) const \
-				{ if (has_attr(a)) return m_attrs.find(a)->second; else assert(false); } \
+				{ return this->in_memory_abstract_die::attr_value(a); } \
 				/* get all attrs in one go, seeing through abstract_origin / specification links */ \
 				/* -- this one should work already: virtual encap::attribute_map find_all_attrs() const; */ \
 				/* get a single attr, seeing through abstract_origin / specification links */ \
@@ -157,7 +182,7 @@ case DW_TAG_ ## name: p = new name ## _die(d.spec_here(), std::move(d.handle));
 
 			if (tag == DW_TAG_compile_unit)
 			{
-				return make_new_cu(r, [parent](){ return new in_memory_compile_unit_die(parent); });
+				return make_new_cu(r, [&r, &s, &where](){ return new in_memory_compile_unit_die(r, s, where()); });
 			}
 			
 			//Dwarf_Off parent_off = parent.offset_here();
@@ -169,21 +194,12 @@ case DW_TAG_ ## name: p = new name ## _die(d.spec_here(), std::move(d.handle));
 			{
 #define factory_case(name, ...) \
 case DW_TAG_ ## name: \
-			ret = new in_memory_ ## name ## _die(parent); break;
+			ret = new in_memory_ ## name ## _die(r, s, where()); break;
 #include "dwarf-current-factory.h"
 				default: return nullptr;
 			}
 #undef factory_case
 			return ret;
-			
-			if (parent.depth() == 1)
-			{
-				auto it = r.pos(ret->get_offset(), parent.depth() + 1);
-				if (it.global_name_here())
-				{
-					r.visible_named_grandchildren_cache.insert(make_pair(*it.global_name_here(), ret->get_offset()));
-				}
-			}
 		}
 		
 		basic_die *dwarf_current_factory_t::dummy_for_tag(Dwarf_Half tag)
@@ -199,28 +215,93 @@ static name ## _die dummy_ ## name(dwarf::spec::dwarf_current);
 case DW_TAG_ ## name: return &dummy_ ## name;
 #include "dwarf-current-factory.h"
 #undef factory_case
+				case DW_TAG_skeleton_unit: return &dummy_compile_unit; // see make_payload()
 				default: return &dummy_basic;
 			}
 		}
 		
+		Dwarf_Half dwarf_current_factory_t::max_tag()
+		{
+			Dwarf_Half max = DW_TAG_skeleton_unit;
+#define factory_case(name, ...) \
+if (DW_TAG_ ## name > max) max = DW_TAG_ ## name;
+#include "dwarf-current-factory.h"
+#undef factory_case
+			return max;
+		}
+		
+		void in_memory_abstract_die::attribute_map::forget_compiled_location()
+		{
+			/* The payload caches its location lowered for evaluation.
+			 * In-memory DIEs are sticky, so without this it would outlive
+			 * the attribute it came from. */
+			auto p_dyn = dynamic_cast<with_dynamic_location_die *>(p_owner);
+			if (p_dyn) p_dyn->forget_compiled_location();
+		}
+		
 		void in_memory_abstract_die::attribute_map::update_cache_on_insert(
 			attribute_map::iterator inserted
 		)
 		{
+			switch (inserted->first)
+			{
+				case DW_AT_location:
+					p_owner->p_root->forget_frame_locals();
+					p_owner->p_root->clear_static_var_index();
+					forget_compiled_location();
+					break;
+				case DW_AT_stmt_list:
+					p_owner->p_root->clear_line_index();
+					break;
+				case DW_AT_type:
+					p_owner->p_root->forget_frame_locals();
+					break;
+				case DW_AT_byte_size:
+				case DW_AT_data_member_location:
+				case DW_AT_bit_size:
+				case DW_AT_bit_offset:
+				case DW_AT_data_bit_offset:
+				case DW_AT_declaration:
+					p_owner->p_root->type_names = root_die::type_name_index();
+					if (inserted->first == DW_AT_data_member_location) forget_compiled_location();
+					break;
+				case DW_AT_low_pc:
+				case DW_AT_high_pc:
+				case DW_AT_ranges:
+				case DW_AT_abstract_origin:
+				case DW_AT_call_file:
+				case DW_AT_call_line:
+					p_owner->p_root->forget_inline_trees();
+					if (inserted->first == DW_AT_low_pc || inserted->first == DW_AT_high_pc
+						|| inserted->first == DW_AT_ranges) p_owner->p_root->clear_addr_index();
+					break;
+				default: break;
+			}
+			if (inserted->first != DW_AT_sibling
+				&& inserted->second.get_form() == encap::attribute_value::REF)
+			{
+				const encap::attribute_value::weak_ref& ref = inserted->second.get_ref();
+				p_owner->p_root->note_reference(p_owner->m_offset,
+					ref.abs ? ref.off : p_owner->m_cu_offset + ref.off);
+			}
 			if (inserted->first == DW_AT_name)
 			{
+				p_owner->p_root->type_names = root_die::type_name_index();
 				auto found = p_owner->p_root->pos(p_owner->m_offset);
 				assert(found);
+				/* Our parent's child-name index, if any, doesn't know the new name. */
+				p_owner->p_root->forget_named_children(p_owner->p_root->parent(found).offset_here());
 				if (found.depth() == 2 && found.global_name_here())
 				{
 					// we can either invalidate the whole thing...
 					// this->visible_named_grandchildren_is_complete = false;
 					// ... or we can preserve the completeness invariant if it holds!
-					p_owner->p_root->visible_named_grandchildren_cache.insert(
-						make_pair(*found.name_here(), p_owner->m_offset)
-					);
+					p_owner->p_root->note_visible_named_grandchild(
+						*found.name_here(), p_owner->m_offset);
 				}
 			}
+			/* Any attribute might change what a type means, or its layout. */
+			p_owner->p_root->invalidate_types_reaching(p_owner->m_offset);
 		}
 	}
 }
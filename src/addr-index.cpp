@@ -0,0 +1,461 @@
+/* dwarfpp: C++ binding for a useful subset of libdwarf, plus extra goodies.
+ *
+ * addr-index.cpp: address-to-innermost-DIE interval index
+ *
+ * Copyright (c) 2008--17, Stephen Kell. For licensing information, see the
+ * LICENSE file in the root of the libdwarfpp tree.
+ */
+
+#include <algorithm>
+#include <set>
+#include <thread>
+#include <unordered_map>
+
+#include "dwarfpp/root.hpp"
+#include "dwarfpp/root-inl.hpp"
+#include "dwarfpp/iter.hpp"
+#include "dwarfpp/iter-inl.hpp"
+#include "dwarfpp/dies.hpp"
+
+namespace dwarf
+{
+	using std::endl;
+	using std::vector;
+	namespace core
+	{
+		/* Append one entry per address range covered by the DIE at i.
+		 * This is the low_pc/high_pc/ranges part of
+		 * with_static_location_die::file_relative_intervals, which we can't
+		 * use because lexical blocks aren't with_static_location_dies. */
+		static void add_die_intervals(root_die& r, const iterator_base& i,
+			const encap::attribute_map& attrs, vector<root_die::addr_index_entry>& out)
+		{
+			auto found_low_pc = attrs.find(DW_AT_low_pc);
+			auto found_high_pc = attrs.find(DW_AT_high_pc);
+			auto found_ranges = attrs.find(DW_AT_ranges);
+			auto add = [&out, &i](Dwarf_Addr lo, Dwarf_Addr hi) {
+				if (hi > lo) out.push_back((root_die::addr_index_entry) {
+					.lo = lo,
+					.hi = hi,
+					.off = i.offset_here(),
+					.depth = (unsigned short) i.depth()
+				});
+			};
+			if (found_ranges != attrs.end())
+			{
+				iterator_df<compile_unit_die> i_cu = r.cu_pos(i.enclosing_cu_offset_here());
+				auto rangelist = i_cu->normalize_rangelist(found_ranges->second.get_rangelist());
+				for (auto i_r = rangelist.begin(); i_r != rangelist.end(); ++i_r)
+				{
+					add(i_r->dwr_addr1, i_r->dwr_addr2); // skips the end entry
+				}
+			}
+			else if (found_low_pc != attrs.end() && found_high_pc != attrs.end())
+			{
+				auto lopc = found_low_pc->second.get_address().addr;
+				if (found_high_pc->second.get_form() == encap::attribute_value::ADDR)
+				{
+					add(lopc, found_high_pc->second.get_address().addr);
+				}
+				else if (found_high_pc->second.get_form() == encap::attribute_value::UNSIGNED)
+				{
+					add(lopc, lopc + found_high_pc->second.get_unsigned());
+				}
+			}
+		}
+		static void add_die_intervals(root_die& r, const iterator_base& i,
+			vector<root_die::addr_index_entry>& out)
+		{
+			add_die_intervals(r, i, i.copy_attrs(), out);
+		}
+
+		/* Subprograms can hide under namespaces and classes, and lexical
+		 * blocks under each other and under inlined subroutines, but we never
+		 * need to look inside types or variables. */
+		static bool may_contain_code(Dwarf_Half tag)
+		{
+			switch (tag)
+			{
+				case DW_TAG_compile_unit:
+				case DW_TAG_partial_unit:
+				case DW_TAG_namespace:
+				case DW_TAG_module:
+				case DW_TAG_structure_type:
+				case DW_TAG_class_type:
+				case DW_TAG_union_type:
+				case DW_TAG_subprogram:
+				case DW_TAG_lexical_block:
+				case DW_TAG_inlined_subroutine:
+					return true;
+				default:
+					return false;
+			}
+		}
+
+		static void add_subtree_intervals(root_die& r, const iterator_base& start,
+			vector<root_die::addr_index_entry>& out)
+		{
+			auto children = start.children_here();
+			for (auto i = std::move(children.first); i != children.second; ++i)
+			{
+				Dwarf_Half tag = i.tag_here();
+				if (tag == DW_TAG_subprogram || tag == DW_TAG_lexical_block)
+				{
+					add_die_intervals(r, i, out);
+				}
+				if (may_contain_code(tag)) add_subtree_intervals(r, i, out);
+			}
+		}
+
+		void root_die::collect_addr_intervals(const std::set<Dwarf_Off> *p_only,
+			vector<addr_index_entry>& raw)
+		{
+			auto wanted = [p_only](Dwarf_Off cu_off) {
+				return !p_only || p_only->find(cu_off) != p_only->end();
+			};
+			/* Aranges give us CU-level coverage cheaply, and tell us which
+			 * CUs have any code at all. */
+			std::set<Dwarf_Off> cus_with_code;
+			bool have_aranges = false;
+			Dwarf_Arange *aranges;
+			Dwarf_Signed n_aranges;
+			if (DW_DLV_OK == dwarf_get_aranges(dbg.handle.get(), &aranges, &n_aranges,
+				&current_dwarf_error))
+			{
+				for (Dwarf_Signed i = 0; i < n_aranges; ++i)
+				{
+					Dwarf_Addr start;
+					Dwarf_Unsigned length;
+					Dwarf_Off cu_die_offset;
+					if (DW_DLV_OK == dwarf_get_arange_info(aranges[i], &start, &length,
+						&cu_die_offset, &current_dwarf_error) && length > 0)
+					{
+						have_aranges = true;
+						if (wanted(cu_die_offset))
+						{
+							raw.push_back((addr_index_entry) {
+								.lo = start,
+								.hi = start + length,
+								.off = cu_die_offset,
+								.depth = 1
+							});
+							cus_with_code.insert(cu_die_offset);
+						}
+					}
+					dwarf_dealloc(dbg.handle.get(), aranges[i], DW_DLA_ARANGE);
+				}
+				dwarf_dealloc(dbg.handle.get(), aranges, DW_DLA_LIST);
+			}
+			if (!have_aranges)
+			{
+				/* No aranges (some compilers don't emit them), so use the CUs'
+				 * own ranges, which means looking at every CU. */
+				auto cus = begin().children_here();
+				for (auto i_cu = std::move(cus.first); i_cu != cus.second; ++i_cu)
+				{
+					if (!wanted(i_cu.offset_here())) continue;
+					add_die_intervals(*this, i_cu, raw);
+					cus_with_code.insert(i_cu.offset_here());
+				}
+			}
+			for (auto i_off = cus_with_code.begin(); i_off != cus_with_code.end(); ++i_off)
+			{
+				iterator_base i_cu = cu_pos(*i_off);
+				if (i_cu) add_subtree_intervals(*this, i_cu, raw);
+			}
+		}
+
+		void root_die::flatten_addr_index(vector<addr_index_entry>& raw)
+		{
+			clear_addr_index();
+			vector<addr_index_entry>& flat = addr_index_storage;
+			/* Sorting by start and then by depth means that any interval
+			 * nested inside another comes after it, so a sweep with a stack
+			 * of open intervals (innermost on top) gives us the innermost
+			 * DIE for each piece of the address space. If DIEs aren't
+			 * properly nested (they should be), the later one wins. */
+			std::sort(raw.begin(), raw.end(),
+				[](const addr_index_entry& a, const addr_index_entry& b) {
+					return a.lo < b.lo || (a.lo == b.lo && a.depth < b.depth);
+				});
+			vector<addr_index_entry> open;
+			Dwarf_Addr cur = 0;
+			auto emit = [&flat](Dwarf_Addr lo, Dwarf_Addr hi, const addr_index_entry& e) {
+				if (hi <= lo) return;
+				if (!flat.empty() && flat.back().hi == lo && flat.back().off == e.off)
+				{
+					flat.back().hi = hi; // coalesce
+				}
+				else flat.push_back((addr_index_entry) {
+					.lo = lo,
+					.hi = hi,
+					.off = e.off,
+					.depth = e.depth
+				});
+			};
+			/* Emit everything open up to (not including) x. */
+			auto advance_to = [&](Dwarf_Addr x) {
+				while (!open.empty() && cur < x)
+				{
+					if (open.back().hi <= cur) { open.pop_back(); continue; }
+					Dwarf_Addr stop = std::min(x, open.back().hi);
+					emit(cur, stop, open.back());
+					cur = stop;
+				}
+				cur = std::max(cur, x);
+			};
+			for (auto i_e = raw.begin(); i_e != raw.end(); ++i_e)
+			{
+				advance_to(i_e->lo);
+				open.push_back(*i_e);
+			}
+			advance_to(~(Dwarf_Addr)0);
+			flat.shrink_to_fit();
+			addr_index = record_span<addr_index_entry>(flat);
+			addr_index_built = true;
+		}
+
+		bool root_die::build_addr_index()
+		{
+			clear_addr_index();
+			if (!dbg.handle) return false;
+			vector<addr_index_entry> raw;
+			collect_addr_intervals(nullptr, raw);
+			flatten_addr_index(raw);
+			debug(2) << "Built address index of " << addr_index.size()
+				<< " intervals from " << raw.size() << " ranges" << endl;
+			return true;
+		}
+
+		iterator_base root_die::innermost_die_for_pc(Dwarf_Addr file_relative_addr)
+		{
+			/* As static_var_for_addr(): readers of a frozen root mustn't
+			 * race to build it, so they make do with what's there. */
+			if (!frozen && !addr_index_built) build_addr_index();
+			auto found = std::upper_bound(addr_index.begin(), addr_index.end(),
+				file_relative_addr,
+				[](Dwarf_Addr a, const addr_index_entry& e) { return a < e.lo; });
+			if (found == addr_index.begin()) return iterator_base::END;
+			--found;
+			if (file_relative_addr >= found->hi) return iterator_base::END;
+			return pos(found->off, found->depth);
+		}
+
+		namespace
+		{
+			/* What every pc covered by one address index DIE shares. */
+			struct symbolize_memo
+			{
+				Dwarf_Off cu;
+				Dwarf_Off subprogram;
+				shared_ptr<const inline_tree_index> inlined; // the subprogram's
+			};
+
+			unsigned attr_as_unsigned(const encap::attribute_map& attrs, Dwarf_Half attr)
+			{
+				auto found = attrs.find(attr);
+				if (found == attrs.end()) return 0;
+				switch (found->second.get_form())
+				{
+					case encap::attribute_value::UNSIGNED: return found->second.get_unsigned();
+					case encap::attribute_value::SIGNED: return found->second.get_signed();
+					default: return 0;
+				}
+			}
+		}
+
+		/* Inlined subroutines hide under lexical blocks and under each
+		 * other; a nested subprogram has a tree of its own. */
+		static void add_inlined_frames(root_die& r, const iterator_base& start,
+			vector<inline_tree_index::frame>& out)
+		{
+			auto children = start.children_here();
+			for (auto i = std::move(children.first); i != children.second; ++i)
+			{
+				Dwarf_Half tag = i.tag_here();
+				if (tag != DW_TAG_inlined_subroutine && tag != DW_TAG_lexical_block) continue;
+				if (tag == DW_TAG_inlined_subroutine)
+				{
+					encap::attribute_map attrs = i.copy_attrs();
+					vector<root_die::addr_index_entry> ranges;
+					add_die_intervals(r, i, attrs, ranges);
+					Dwarf_Off origin = 0;
+					auto found_origin = attrs.find(DW_AT_abstract_origin);
+					if (found_origin != attrs.end()
+						&& found_origin->second.get_form() == encap::attribute_value::REF)
+					{
+						const encap::attribute_value::weak_ref& ref = found_origin->second.get_ref();
+						origin = ref.abs ? ref.off : i.enclosing_cu_offset_here() + ref.off;
+					}
+					for (auto i_r = ranges.begin(); i_r != ranges.end(); ++i_r)
+					{
+						out.push_back((inline_tree_index::frame) {
+							.lo = i_r->lo,
+							.hi = i_r->hi,
+							.off = i_r->off,
+							.origin = origin,
+							.call_file = attr_as_unsigned(attrs, DW_AT_call_file),
+							.call_line = attr_as_unsigned(attrs, DW_AT_call_line),
+							.parent = inline_tree_index::NONE,
+							.depth = i_r->depth
+						});
+					}
+				}
+				add_inlined_frames(r, i, out);
+			}
+		}
+
+		shared_ptr<const inline_tree_index> root_die::inline_tree(const iterator_base& subprogram)
+		{
+			if (subprogram.tag_here() != DW_TAG_subprogram) return shared_ptr<const inline_tree_index>();
+			auto found = inline_trees_of.find(subprogram.offset_here());
+			DWARFPP_STAT_HIT(*this, found != inline_trees_of.end(), inline_tree);
+			if (found != inline_trees_of.end()) return found->second;
+
+			auto p_index = std::make_shared<inline_tree_index>();
+			vector<inline_tree_index::frame>& frames = p_index->frames;
+			add_inlined_frames(*this, subprogram, frames);
+			std::sort(frames.begin(), frames.end(),
+				[](const inline_tree_index::frame& a, const inline_tree_index::frame& b) {
+					return a.lo < b.lo || (a.lo == b.lo && a.depth < b.depth);
+				});
+			/* As in flatten_addr_index(), a stack of the frames still open
+			 * (innermost on top) gives each frame its parent. */
+			vector<unsigned> open;
+			for (unsigned i = 0; i < frames.size(); ++i)
+			{
+				while (!open.empty() && (frames[open.back()].hi <= frames[i].lo
+					|| frames[open.back()].depth >= frames[i].depth)) open.pop_back();
+				if (!open.empty()) frames[i].parent = open.back();
+				open.push_back(i);
+			}
+			frames.shrink_to_fit();
+			debug_expensive(2, << "Indexed " << frames.size() << " inlined frames for "
+				<< subprogram.summary() << endl);
+			if (!frozen)
+			{
+				cache_inline_tree(subprogram.offset_here(), p_index);
+				note_cache_growth(subprogram.offset_here());
+			}
+			return p_index;
+		}
+
+		unsigned inline_tree_index::find(Dwarf_Addr vaddr, vector<const frame *>& out) const
+		{
+			auto found = std::upper_bound(frames.begin(), frames.end(), vaddr,
+				[](Dwarf_Addr a, const frame& f) { return a < f.lo; });
+			if (found == frames.begin()) return 0;
+			size_t first = out.size();
+			for (unsigned i = (found - frames.begin()) - 1; i != NONE; i = frames[i].parent)
+			{
+				if (vaddr < frames[i].hi) out.push_back(&frames[i]);
+			}
+			std::reverse(out.begin() + first, out.end());
+			return out.size() - first;
+		}
+
+		static void symbolize_slice(root_die& r,
+			const record_span<root_die::addr_index_entry>& index,
+			vector<Dwarf_Addr>::const_iterator begin, vector<Dwarf_Addr>::const_iterator end,
+			root_die::symbolized_pc *out, vector<Dwarf_Off>& inlined)
+		{
+			std::unordered_map<Dwarf_Off, symbolize_memo> memos;
+			/* Frozen, the root won't keep the trees, so we do. */
+			std::unordered_map<Dwarf_Off, shared_ptr<const inline_tree_index> > trees;
+			auto get_memo = [&r, &memos, &trees](const root_die::addr_index_entry& e) -> const symbolize_memo& {
+				auto found = memos.find(e.off);
+				if (found != memos.end()) return found->second;
+				symbolize_memo m;
+				iterator_base die = r.pos(e.off, e.depth);
+				m.cu = die.enclosing_cu_offset_here();
+				m.subprogram = 0;
+				for (iterator_base i = die; i && i.tag_here() != DW_TAG_compile_unit; i = i.parent())
+				{
+					if (i.tag_here() != DW_TAG_subprogram) continue;
+					m.subprogram = i.offset_here();
+					auto found_tree = trees.find(m.subprogram);
+					m.inlined = (found_tree != trees.end()) ? found_tree->second
+						: trees.insert(make_pair(m.subprogram, r.inline_tree(i))).first->second;
+					break;
+				}
+				return memos.insert(make_pair(e.off, std::move(m))).first->second;
+			};
+			vector<const inline_tree_index::frame *> frames;
+			/* pcs are sorted, so each search starts where the last left off. */
+			auto i_idx = index.begin();
+			for (auto i_pc = begin; i_pc != end; ++i_pc, ++out)
+			{
+				*out = (root_die::symbolized_pc) {
+					.cu = 0, .subprogram = 0,
+					.first_inlined = (unsigned) inlined.size(), .n_inlined = 0,
+					.line = nullptr
+				};
+				i_idx = std::upper_bound(i_idx, index.end(), *i_pc,
+					[](Dwarf_Addr a, const root_die::addr_index_entry& e) { return a < e.lo; });
+				if (i_idx == index.begin() || *i_pc >= (i_idx - 1)->hi) continue;
+				const symbolize_memo& m = get_memo(*(i_idx - 1));
+				out->cu = m.cu;
+				out->subprogram = m.subprogram;
+				if (m.inlined)
+				{
+					frames.clear();
+					m.inlined->find(*i_pc, frames);
+					for (auto i_f = frames.begin(); i_f != frames.end(); ++i_f) inlined.push_back((*i_f)->off);
+				}
+				out->n_inlined = inlined.size() - out->first_inlined;
+			}
+		}
+
+		void root_die::symbolize(const Dwarf_Addr *pcs, size_t n, symbolization& out, unsigned nthreads)
+		{
+			if (!frozen && !addr_index_built) build_addr_index();
+			vector<Dwarf_Addr> sorted(pcs, pcs + n);
+			std::sort(sorted.begin(), sorted.end());
+			sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+			vector<const line_table::row *> lines;
+			pc_to_line(sorted, lines);
+
+			vector<symbolized_pc> by_unique(sorted.size());
+			if (!frozen) nthreads = 1;
+			else if (nthreads == 0) nthreads = std::max(1u, std::thread::hardware_concurrency());
+			nthreads = std::max(1u, std::min(nthreads, (unsigned) (sorted.size() / 1024 + 1)));
+			/* Each slice keeps its own chains, which we append after. */
+			vector<vector<Dwarf_Off> > slice_inlined(nthreads);
+			vector<size_t> slice_begin(nthreads + 1);
+			for (unsigned i = 0; i <= nthreads; ++i) slice_begin[i] = sorted.size() * i / nthreads;
+			auto run_slice = [&](unsigned i) {
+				symbolize_slice(*this, addr_index, sorted.begin() + slice_begin[i],
+					sorted.begin() + slice_begin[i + 1], &by_unique[slice_begin[i]], slice_inlined[i]);
+			};
+			if (nthreads == 1) run_slice(0);
+			else
+			{
+				vector<std::thread> workers;
+				for (unsigned i = 0; i < nthreads; ++i) workers.push_back(std::thread(run_slice, i));
+				for (auto i_w = workers.begin(); i_w != workers.end(); ++i_w) i_w->join();
+			}
+			out.inlined.clear();
+			for (unsigned i = 0; i < nthreads; ++i)
+			{
+				unsigned base = out.inlined.size();
+				for (size_t j = slice_begin[i]; j < slice_begin[i + 1]; ++j)
+				{
+					by_unique[j].first_inlined += base;
+					by_unique[j].line = lines[j];
+				}
+				out.inlined.insert(out.inlined.end(), slice_inlined[i].begin(), slice_inlined[i].end());
+			}
+
+			/* Back to the order we were given. */
+			out.pcs.clear();
+			out.pcs.reserve(n);
+			for (const Dwarf_Addr *i_pc = pcs; i_pc != pcs + n; ++i_pc)
+			{
+				out.pcs.push_back(by_unique[std::lower_bound(sorted.begin(), sorted.end(), *i_pc)
+					- sorted.begin()]);
+			}
+			debug(2) << "Symbolized " << n << " pcs (" << sorted.size() << " distinct) using "
+				<< nthreads << " threads" << endl;
+		}
+	}
+}
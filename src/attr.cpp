@@ -10,6 +10,7 @@
 #include "attr.hpp"
 #include "expr.hpp"
 #include "lib.hpp"
+#include "native-reader.hpp"
 
 #include <utility>
 using std::make_pair;
@@ -19,6 +20,85 @@ namespace dwarf
 {
 	namespace encap
 	{
+		void intrusive_ptr_add_ref(const loclist *p)
+		{
+			p->refcount.fetch_add(1, std::memory_order_relaxed);
+		}
+		void intrusive_ptr_release(const loclist *p)
+		{
+			if (p->refcount.fetch_sub(1, std::memory_order_acq_rel) == 1) delete p;
+		}
+		void intrusive_ptr_add_ref(const rangelist *p)
+		{
+			p->refcount.fetch_add(1, std::memory_order_relaxed);
+		}
+		void intrusive_ptr_release(const rangelist *p)
+		{
+			if (p->refcount.fetch_sub(1, std::memory_order_acq_rel) == 1) delete p;
+		}
+		/* Take a reference for an attribute_value to hold. */
+		template <typename List>
+		static const List *share(const List *p)
+		{
+			intrusive_ptr_add_ref(p);
+			return p;
+		}
+		/* The .debug_loc offset of a loclistptr, if that's what we have.
+		 * Blocks and exprlocs are in the DIE itself, and so have none. */
+		static opt<Dwarf_Off> loclist_offset(const core::Attribute& a, Dwarf_Half form)
+		{
+			Dwarf_Off off;
+			Dwarf_Unsigned u;
+			switch (form)
+			{
+				case DW_FORM_sec_offset:
+					if (dwarf_global_formref(a.handle.get(), &off, &core::current_dwarf_error) == DW_DLV_OK)
+					{
+						return opt<Dwarf_Off>(off);
+					}
+					break;
+				case DW_FORM_data4:
+				case DW_FORM_data8:
+					if (dwarf_formudata(a.handle.get(), &u, &core::current_dwarf_error) == DW_DLV_OK)
+					{
+						return opt<Dwarf_Off>(u);
+					}
+					break;
+				default: break;
+			}
+			return opt<Dwarf_Off>();
+		}
+		/* From DWARF 5, lists are in .debug_loclists and .debug_rnglists,
+		 * whose offsets we keep apart from .debug_loc's and .debug_ranges's
+		 * in the decoded-list caches by setting this bit. */
+		static const Dwarf_Off DWARF5_LIST_KEY = (Dwarf_Off) 1 << 63;
+		/* DWARF 5's indexed forms, and its lists, we leave to a native
+		 * reader when we have one: it has each unit's bases to hand, so
+		 * each value is a lookup, and older libdwarfs don't know them.
+		 * Says whether this value is one of those, and if so, gets its
+		 * unit and raw value. */
+		static bool find_native_value(root_die& r, const core::Die& d, Dwarf_Half attr,
+			Dwarf_Half form, int cls, std::shared_ptr<const core::native_reader>& p_native,
+			unsigned *p_unit, core::native_reader::attr_value *p_v)
+		{
+			switch (form)
+			{
+				case DW_FORM_strx: case DW_FORM_strx1: case DW_FORM_strx2: case DW_FORM_strx3: case DW_FORM_strx4:
+				case DW_FORM_addrx: case DW_FORM_addrx1: case DW_FORM_addrx2: case DW_FORM_addrx3: case DW_FORM_addrx4:
+				case DW_FORM_loclistx: case DW_FORM_rnglistx: case DW_FORM_data16:
+					break;
+				case DW_FORM_sec_offset: // if it's a list in a DWARF 5 unit; see below
+					if (cls == spec::interp::loclistptr || cls == spec::interp::rangelistptr) break;
+					return false;
+				default:
+					return false;
+			}
+			p_native = r.get_native_reader();
+			return p_native && p_native->unit_index_for(d.offset_here(), p_unit)
+				&& p_native->get_unit(*p_unit).version >= 5
+				&& p_native->find_attr(*p_unit, d.offset_here(), attr, p_v);
+		}
+
 		void attribute_value::print_raw(std::ostream& s) const
 		{
 			switch (f)
@@ -266,6 +346,10 @@ namespace dwarf
 			Dwarf_Addr addr;
 			char *str;
 			int cls = spec::interp::EOL; // dummy initialization
+			std::shared_ptr<const core::native_reader> p_native;
+			unsigned unit_idx;
+			core::native_reader::attr_value native_v;
+			bool native = false;
 			
 			// find our dwarf spec
 			Dwarf_Off cu_offset = d.enclosing_cu_offset_here();
@@ -277,9 +361,19 @@ namespace dwarf
 			if (retval != DW_DLV_OK) goto fail;
 			
 			cls = spec.get_interp(attr, orig_form);
+			native = find_native_value(r, d, attr, orig_form, cls & ~spec::interp::FLAGS,
+				p_native, &unit_idx, &native_v);
 			switch(cls & ~spec::interp::FLAGS)
 			{
 				case spec::interp::string:
+					if (native)
+					{
+						const char *native_str = p_native->string_of(unit_idx, native_v);
+						if (!native_str) goto fail;
+						this->f = STRING;
+						this->v_string = new string(native_str);
+						break;
+					}
 					dwarf_formstring(a.handle.get(), &str, &core::current_dwarf_error);
 					this->f = STRING; 
 					this->v_string = new string(str);
@@ -290,11 +384,22 @@ namespace dwarf
 					this->v_flag = flag;
 					break;
 				case spec::interp::address:
-					dwarf_formaddr(a.handle.get(), &addr, &core::current_dwarf_error);
+					if (native)
+					{
+						if (!p_native->address_of(unit_idx, native_v, &addr)) goto fail;
+					}
+					else dwarf_formaddr(a.handle.get(), &addr, &core::current_dwarf_error);
 					this->f = ADDR;
 					this->v_addr.addr = addr;
 					break;
 				case spec::interp::block:
+					if (native) // a data16
+					{
+						this->f = BLOCK;
+						this->v_block = new vector<unsigned char>(native_v.block,
+							native_v.block + native_v.block_len);
+						break;
+					}
 					{
 						core::Block b(a);
 						this->f = BLOCK;
@@ -337,6 +442,7 @@ namespace dwarf
 					 || orig_form == DW_FORM_data2
 					 || orig_form == DW_FORM_data4
 					 || orig_form == DW_FORM_data8
+					 || orig_form == DW_FORM_implicit_const
 					 )
 					{
 						/* We don't know whether these are signed or unsigned. */
@@ -369,18 +475,78 @@ namespace dwarf
 					int ret = dwarf_formudata(a.handle.get(), &u, &core::current_dwarf_error);
 					assert(ret == DW_DLV_OK);
 					this->f = LOCLIST;
-					this->v_loclist = new loclist(loc_expr((Dwarf_Unsigned[]) { DW_OP_plus_uconst, u }, 0, 0, spec));
+					this->v_loclist = share(new loclist(loc_expr((Dwarf_Unsigned[]) { DW_OP_plus_uconst, u }, 0, 0, spec)));
 				} break;
 				case spec::interp::block_as_dwarf_expr: // dwarf_loclist_n works for both of these
 				case spec::interp::loclistptr:
+					if (native)
+					{
+						try
+						{
+							this->f = LOCLIST;
+							Dwarf_Off list_off;
+							if (!p_native->list_offset_of(unit_idx, native_v, false, &list_off)) goto fail;
+							auto found = r.decoded_loclists.find(list_off | DWARF5_LIST_KEY);
+							DWARFPP_STAT_HIT(r, found != r.decoded_loclists.end(), decoded_list);
+							if (found != r.decoded_loclists.end())
+							{
+								this->v_loclist = share(found->second.get());
+								break;
+							}
+							vector<core::native_reader::list_entry> entries;
+							if (!p_native->read_list(unit_idx, list_off, false, entries)) goto fail;
+							/* Our loc_exprs' vaddrs are relative to the CU's base;
+							 * a default entry's are both zero, as from libdwarf. */
+							Dwarf_Addr cu_base = p_native->get_unit(unit_idx).base_address;
+							std::unique_ptr<loclist> p_list(new loclist());
+							for (auto i_e = entries.begin(); i_e != entries.end(); ++i_e)
+							{
+								if (i_e->expr_len) p_list->push_back(loc_expr(a.get_dbg(),
+									(Dwarf_Ptr) i_e->expr, i_e->expr_len, spec));
+								else p_list->push_back(loc_expr(spec));
+								bool is_default = (i_e->lo == 0 && i_e->hi == 0);
+								p_list->back().lopc = is_default ? 0 : i_e->lo - cu_base;
+								p_list->back().hipc = is_default ? 0 : i_e->hi - cu_base;
+							}
+							this->v_loclist = share(p_list.release());
+							if (!r.frozen)
+							{
+								r.cache_loclist(list_off | DWARF5_LIST_KEY, this->v_loclist);
+								r.note_cache_growth(d.offset_here());
+							}
+							break;
+						}
+						catch (...)
+						{
+							goto fail; // as below
+						}
+					}
 					try
 					{
 						this->f = LOCLIST;
+						/* Lists in .debug_loc are often shared, and are decoded
+						 * raw, so the same offset means the same list. */
+						opt<Dwarf_Off> opt_off = loclist_offset(a, orig_form);
+						if (opt_off)
+						{
+							auto found = r.decoded_loclists.find(*opt_off);
+							DWARFPP_STAT_HIT(r, found != r.decoded_loclists.end(), decoded_list);
+							if (found != r.decoded_loclists.end())
+							{
+								this->v_loclist = share(found->second.get());
+								break;
+							}
+						}
 						// replaced lib::loclist with core::LocdescList
 						//this->v_loclist = new loclist(dwarf::lib::loclist(a, a.get_dbg()));
 						auto handle = core::LocdescList::try_construct(a);
-						if (handle) this->v_loclist = new loclist(core::LocdescList(std::move(handle)));
-						else this->v_loclist = new loclist();
+						if (handle) this->v_loclist = share(new loclist(core::LocdescList(std::move(handle))));
+						else this->v_loclist = share(new loclist());
+						if (opt_off && !r.frozen)
+						{
+							r.cache_loclist(*opt_off, this->v_loclist);
+							r.note_cache_growth(d.offset_here());
+						}
 						break;
 					}
 					catch (...)
@@ -394,8 +560,8 @@ namespace dwarf
 					{
 						this->f = LOCLIST;
 						auto handle = core::Locdesc::try_construct(a);
-						if (handle) this->v_loclist = new loclist(core::Locdesc(std::move(handle)));
-						else this->v_loclist = new loclist();
+						if (handle) this->v_loclist = share(new loclist(core::Locdesc(std::move(handle))));
+						else this->v_loclist = share(new loclist());
 						break;
 					}
 					catch (...)
@@ -407,9 +573,63 @@ namespace dwarf
 				}
 				case spec::interp::rangelistptr: {
 					this->f = RANGELIST;
-					this->v_rangelist = new rangelist(core::RangeList(a, d));
+					if (native)
+					{
+						/* As from libdwarf, but with no base address entries
+						 * (our addresses are absolute) and an end entry. */
+						Dwarf_Off list_off;
+						if (!p_native->list_offset_of(unit_idx, native_v, true, &list_off)) goto fail;
+						auto found = r.decoded_rangelists.find(list_off | DWARF5_LIST_KEY);
+						DWARFPP_STAT_HIT(r, found != r.decoded_rangelists.end(), decoded_list);
+						if (found != r.decoded_rangelists.end())
+						{
+							this->v_rangelist = share(found->second.get());
+							break;
+						}
+						vector<core::native_reader::list_entry> entries;
+						if (!p_native->read_list(unit_idx, list_off, true, entries)) goto fail;
+						std::unique_ptr<rangelist> p_list(new rangelist());
+						for (auto i_e = entries.begin(); i_e != entries.end(); ++i_e)
+						{
+							p_list->push_back((Dwarf_Ranges) { .dwr_addr1 = i_e->lo,
+								.dwr_addr2 = i_e->hi, .dwr_type = DW_RANGES_ENTRY });
+						}
+						p_list->push_back((Dwarf_Ranges) { .dwr_addr1 = 0, .dwr_addr2 = 0,
+							.dwr_type = DW_RANGES_END });
+						this->v_rangelist = share(p_list.release());
+						if (!r.frozen)
+						{
+							r.cache_rangelist(list_off | DWARF5_LIST_KEY, this->v_rangelist);
+							r.note_cache_growth(d.offset_here());
+						}
+						break;
+					}
+					/* Without a native reader, libdwarf can only find lists by offset. */
+					if (orig_form == DW_FORM_rnglistx) goto fail;
+					Dwarf_Unsigned off = core::RangeList::get_rangelist_offset(a);
+					bool have_off = (off != (Dwarf_Unsigned) -1);
+					if (have_off)
+					{
+						auto found = r.decoded_rangelists.find(off);
+						DWARFPP_STAT_HIT(r, found != r.decoded_rangelists.end(), decoded_list);
+						if (found != r.decoded_rangelists.end())
+						{
+							this->v_rangelist = share(found->second.get());
+							break;
+						}
+					}
+					this->v_rangelist = share(new rangelist(core::RangeList(a, d)));
+					if (have_off && !r.frozen)
+					{
+						r.cache_rangelist(off, this->v_rangelist);
+						r.note_cache_growth(d.offset_here());
+					}
 				} break;
 				case spec::interp::lineptr:
+				case spec::interp::addrptr:
+				case spec::interp::stroffsetsptr:
+				case spec::interp::loclistsptr:
+				case spec::interp::rnglistsptr:
 					goto as_reference;
 				case spec::interp::macptr:
 					goto as_if_unsigned;
@@ -483,6 +703,7 @@ namespace dwarf
 		attribute_map::attribute_map(const core::AttributeList& l, const core::Die& d, 
 			root_die& r, spec::abstract_def& spec /* = 0 */)
 		{
+			this->reserve(l.copied_list.size());
 			for (auto i = l.copied_list.begin(); i != l.copied_list.end(); ++i)
 			{
 				this->insert(make_pair(i->attr_here(), attribute_value(*i, d, r)));
@@ -504,11 +725,23 @@ namespace dwarf
 			return s;
 		}
 		
+		static_assert(sizeof (attribute_value::address) <= sizeof (Dwarf_Unsigned),
+			"attribute_value's move constructor relies on this");
+		attribute_value::attribute_value(const loclist& l)
+		 : orig_form(DW_FORM_sec_offset), f(LOCLIST), v_loclist(share(new loclist(l))) {}
+		attribute_value::attribute_value(const rangelist& l)
+		 : orig_form(DW_FORM_sec_offset), f(RANGELIST), v_rangelist(share(new rangelist(l))) {}
+		attribute_value::attribute_value(const std::vector<unsigned char>& b)
+		 : orig_form(DW_FORM_block), f(BLOCK), v_block(new std::vector<unsigned char>(b)) {}
+
 		attribute_value::attribute_value(const attribute_value& av) : f(av.f)
 		{
 			this->orig_form = av.orig_form;
 			switch (f)
 			{
+				case NO_ATTR: // e.g. we're copying a moved-from value
+					v_u = 0U;
+				break;
 				case FLAG:
 					v_flag = av.v_flag;
 				break;
@@ -537,10 +770,10 @@ namespace dwarf
 					v_addr = av.v_addr;
 				break;
 				case LOCLIST:
-					v_loclist = new loclist(*av.v_loclist);
+					v_loclist = share(av.v_loclist);
 				break;
 				case RANGELIST:
-					v_rangelist = new rangelist(*av.v_rangelist);
+					v_rangelist = share(av.v_rangelist);
 				break;
 				case UNRECOG:
 					debug() << "Warning: copy-constructing a dwarf::encap::attribute_value of unknown form " << f << std::endl;
@@ -574,9 +807,9 @@ namespace dwarf
 				case ADDR:
 					return this->v_addr == v.v_addr;
 				case LOCLIST:
-					return *(this->v_loclist) == *(v.v_loclist);
+					return this->v_loclist == v.v_loclist || *(this->v_loclist) == *(v.v_loclist);
 				case RANGELIST:
-					return *(this->v_rangelist) == *(v.v_rangelist);
+					return this->v_rangelist == v.v_rangelist || *(this->v_rangelist) == *(v.v_rangelist);
 				default: 
 					debug() << "Warning: comparing a dwarf::encap::attribute_value of unknown form " << v.f << std::endl;
 					return false;
@@ -602,10 +835,10 @@ namespace dwarf
 					delete v_ref;
 				break;
 				case LOCLIST:
-					delete v_loclist;
+					intrusive_ptr_release(v_loclist);
 				break;
 				case RANGELIST:
-					delete v_rangelist;
+					intrusive_ptr_release(v_rangelist);
 				break;
 				default: break;
 			} // end switch
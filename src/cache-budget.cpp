@@ -0,0 +1,378 @@
+/* dwarfpp: C++ binding for a useful subset of libdwarf, plus extra goodies.
+ *
+ * cache-budget.cpp: bounding the memory used by root_die's caches
+ *
+ * Copyright (c) 2008--17, Stephen Kell. For licensing information, see the
+ * LICENSE file in the root of the libdwarfpp tree.
+ */
+
+#include <algorithm>
+
+#include "dwarfpp/root.hpp"
+#include "dwarfpp/root-inl.hpp"
+#include "dwarfpp/expr.hpp"
+
+namespace dwarf
+{
+	using std::endl;
+	using std::vector;
+	namespace core
+	{
+		namespace
+		{
+			/* Roughly what malloc adds to each node it gives us. */
+			const size_t MALLOC_OVERHEAD = 2 * sizeof (void*);
+
+			template <typename M>
+			size_t hashed_bytes(const M& m)
+			{
+				return m.size() * (sizeof (void*) + sizeof (typename M::value_type) + MALLOC_OVERHEAD)
+					+ m.bucket_count() * sizeof (void*);
+			}
+			template <typename M>
+			size_t tree_bytes(const M& m)
+			{
+				return m.size() * (4 * sizeof (void*) + sizeof (typename M::value_type) + MALLOC_OVERHEAD);
+			}
+			template <typename V>
+			size_t vector_bytes(const V& v)
+			{ return v.capacity() * sizeof (typename V::value_type); }
+		}
+
+		root_die::cache_usage root_die::get_cache_usage() const
+		{
+			return (cache_usage) {
+				.nav = hashed_bytes(parent_of) + hashed_bytes(first_child_of)
+					+ hashed_bytes(next_sibling_of) + hashed_bytes(subtree_end_of)
+					+ hashed_bytes(depth_of),
+				.refers_to = tree_bytes(refers_to),
+				.types = hashed_bytes(type_equality.parent) + hashed_bytes(type_equality.unequal)
+					+ vector_bytes(type_equality.assumed) + vector_bytes(type_equality.provisional)
+					+ tree_bytes(type_summary_code_cache) + type_layouts_bytes()
+					+ hashed_bytes(rep_compatible_cache)
+					+ hashed_bytes(type_dependents.referrers),
+				.names = visible_named_grandchildren_bytes()
+					+ tree_bytes(visible_named_grandchildren_cus_done)
+					+ hashed_bytes(pubnames_hints) + named_children_bytes()
+					+ type_names_bytes(),
+				.locals = frame_locals_bytes() + inline_trees_bytes(),
+				.lists = decoded_lists_bytes()
+			};
+		}
+
+		/* The value parts of each cache are counted as they come and go,
+		 * below, so these are constant-time. */
+		size_t root_die::named_children_bytes() const
+		{ return hashed_bytes(named_children_of) + budget.named_children_bytes; }
+
+		size_t root_die::visible_named_grandchildren_bytes() const
+		{ return hashed_bytes(visible_named_grandchildren_cache) + budget.grandchildren_bytes; }
+
+		size_t root_die::type_layouts_bytes() const
+		{ return hashed_bytes(type_layouts) + budget.layouts_bytes; }
+
+		size_t root_die::type_names_bytes() const
+		{ return hashed_bytes(type_names.by_name) + type_names.entry_bytes; }
+
+		size_t root_die::frame_locals_bytes() const
+		{ return hashed_bytes(frame_locals_of) + budget.frame_locals_bytes; }
+
+		size_t root_die::inline_trees_bytes() const
+		{ return hashed_bytes(inline_trees_of) + budget.inline_trees_bytes; }
+
+		size_t root_die::decoded_lists_bytes() const
+		{ return hashed_bytes(decoded_loclists) + hashed_bytes(decoded_rangelists) + budget.lists_bytes; }
+
+		void root_die::cache_type_layout(Dwarf_Off off, const shared_ptr<const type_layout>& p_layout)
+		{
+			if (type_layouts.insert(make_pair(off, p_layout)).second) budget.layouts_bytes += p_layout->bytes();
+		}
+
+		void root_die::forget_type_layout(Dwarf_Off off)
+		{
+			auto found = type_layouts.find(off);
+			if (found == type_layouts.end()) return;
+			budget.layouts_bytes -= found->second->bytes();
+			type_layouts.erase(found);
+		}
+
+		void root_die::forget_type_layouts()
+		{
+			type_layouts.clear();
+			budget.layouts_bytes = 0;
+		}
+
+		root_die::named_children_index::iterator
+		root_die::cache_named_children(Dwarf_Off parent, unordered_map<unsigned, Dwarf_Off>&& index)
+		{
+			auto inserted = named_children_of.insert(make_pair(parent, std::move(index)));
+			if (inserted.second) budget.named_children_bytes += hashed_bytes(inserted.first->second);
+			return inserted.first;
+		}
+
+		void root_die::forget_named_children(Dwarf_Off parent)
+		{
+			auto found = named_children_of.find(parent);
+			if (found == named_children_of.end()) return;
+			budget.named_children_bytes -= hashed_bytes(found->second);
+			named_children_of.erase(found);
+		}
+
+		void root_die::forget_all_named_children()
+		{
+			named_children_of = named_children_index();
+			budget.named_children_bytes = 0;
+		}
+
+		void root_die::cache_frame_locals(Dwarf_Off subprogram, const shared_ptr<const frame_locals_index>& p_index)
+		{
+			if (frame_locals_of.insert(make_pair(subprogram, p_index)).second)
+			{ budget.frame_locals_bytes += p_index->bytes(); }
+		}
+
+		void root_die::forget_frame_locals()
+		{
+			frame_locals_of.clear();
+			budget.frame_locals_bytes = 0;
+		}
+
+		void root_die::cache_inline_tree(Dwarf_Off subprogram, const shared_ptr<const inline_tree_index>& p_index)
+		{
+			if (inline_trees_of.insert(make_pair(subprogram, p_index)).second)
+			{ budget.inline_trees_bytes += p_index->bytes(); }
+		}
+
+		void root_die::forget_inline_trees()
+		{
+			inline_trees_of.clear();
+			budget.inline_trees_bytes = 0;
+		}
+
+		/* Lists don't change once decoded, so we count them once. */
+		void root_die::cache_loclist(Dwarf_Off key, const encap::loclist *p_list)
+		{
+			if (!decoded_loclists.insert(make_pair(key, intrusive_ptr<const encap::loclist>(p_list))).second) return;
+			budget.lists_bytes += sizeof (encap::loclist) + vector_bytes(*p_list);
+			for (auto i_e = p_list->begin(); i_e != p_list->end(); ++i_e)
+			{
+				budget.lists_bytes += vector_bytes(*i_e);
+			}
+		}
+
+		void root_die::cache_rangelist(Dwarf_Off key, const encap::rangelist *p_list)
+		{
+			if (!decoded_rangelists.insert(make_pair(key, intrusive_ptr<const encap::rangelist>(p_list))).second) return;
+			budget.lists_bytes += sizeof (encap::rangelist) + vector_bytes(*p_list);
+		}
+
+		void root_die::sample_cache_budget(Dwarf_Off off)
+		{
+			budget.countdown = cache_budget_state::SAMPLE_INTERVAL;
+			++budget.tick;
+			auto cu = sticky_cu_containing(off);
+			if (cu) budget.cu_last_sampled[*cu] = budget.tick;
+			if (get_cache_usage().total() <= budget.bytes) return;
+			/* We may be in the middle of filling the grandchildren cache, and
+			 * its completeness flag would then be wrong, so leave it alone;
+			 * only explicit calls to enforce_cache_budget() trim it. */
+			evict_caches(false);
+		}
+
+		opt<Dwarf_Off> root_die::sticky_cu_containing(Dwarf_Off off) const
+		{
+			/* The CUs we've been in are sticky. */
+			auto found = sticky_dies.upper_bound(off);
+			while (found != sticky_dies.begin())
+			{
+				--found;
+				if (tag_is_cu(found->second->get_tag())) return found->first;
+			}
+			return opt<Dwarf_Off>();
+		}
+
+		opt<Dwarf_Off> root_die::recover_parent(Dwarf_Off off)
+		{
+			/* Go down from the CU, at each level taking the last child that
+			 * starts at or before off. That costs the depth times the
+			 * fan-out, not a search of everything before off. We note each
+			 * child's parent as we pass, so that moving to its sibling never
+			 * comes back here. */
+			auto cu = sticky_cu_containing(off);
+			if (!cu || *cu == off) return opt<Dwarf_Off>();
+			iterator_base cur = pos(*cu, 1);
+			while (cur)
+			{
+				iterator_base child = first_child(cur);
+				if (!child || child.offset_here() > off) break;
+				Dwarf_Off parent_off = cur.offset_here();
+				parent_of[child.offset_here()] = parent_off;
+				iterator_base next = child;
+				while (move_to_next_sibling(next) && next.offset_here() <= off)
+				{
+					parent_of[next.offset_here()] = parent_off;
+					child = next;
+				}
+				if (child.offset_here() == off) return parent_off;
+				cur = std::move(child);
+			}
+			return opt<Dwarf_Off>();
+		}
+
+		bool root_die::enforce_cache_budget()
+		{
+			if (!budget.bytes) return true;
+			if (frozen || get_cache_usage().total() <= budget.bytes)
+			{
+				return get_cache_usage().total() <= budget.bytes;
+			}
+			return evict_caches(true);
+		}
+
+		bool root_die::evict_caches(bool between_queries)
+		{
+			size_t target = budget.bytes / 4 * 3;
+			cache_usage before = get_cache_usage();
+
+			refers_to.clear();
+			if (get_cache_usage().total() <= target) goto done;
+			/* Not while a type_die::equal() is in progress. */
+			if (type_equality.assumed.empty()) type_equality = type_equality_memo();
+			type_summary_code_cache.clear();
+			type_layouts = decltype(type_layouts)();
+			budget.layouts_bytes = 0;
+			rep_compatible_cache = decltype(rep_compatible_cache)();
+			/* The next edit rebuilds this. */
+			type_dependents.referrers = decltype(type_dependents.referrers)();
+			type_dependents.built = false;
+			/* Nothing holds on to these between lookups. */
+			forget_all_named_children();
+			/* Callers hold their own references to these. */
+			frame_locals_of = decltype(frame_locals_of)();
+			inline_trees_of = decltype(inline_trees_of)();
+			decoded_loclists = decltype(decoded_loclists)();
+			decoded_rangelists = decltype(decoded_rangelists)();
+			budget.frame_locals_bytes = budget.inline_trees_bytes = budget.lists_bytes = 0;
+			if (get_cache_usage().total() <= target) goto done;
+			if (between_queries)
+			{
+				visible_named_grandchildren_cache = decltype(visible_named_grandchildren_cache)();
+				budget.grandchildren_bytes = 0;
+				visible_named_grandchildren_cus_done.clear();
+				visible_named_grandchildren_is_complete = false;
+				visible_named_grandchildren_cursor = opt<Dwarf_Off>();
+				pubnames_hints = decltype(pubnames_hints)();
+				pubnames_hints_loaded = false;
+				/* A lookup may be stepping through this one too. */
+				type_names = type_name_index();
+				if (get_cache_usage().total() <= target) goto done;
+			}
+			/* Between queries there's no current CU to spare. */
+			evict_nav_shards(target, !between_queries);
+		done:
+			cache_usage after = get_cache_usage();
+			debug(2) << "Cache budget of " << budget.bytes << " bytes: evicted down from "
+				<< before.total() << " to " << after.total() << " bytes" << endl;
+			return after.total() <= budget.bytes;
+		}
+
+		void root_die::evict_nav_shards(size_t target, bool spare_current)
+		{
+			/* A shard is the entries keyed by the DIEs strictly inside one
+			 * CU. The CU-level edges stay, as does anything touching an
+			 * in-memory DIE, since we couldn't find those again. So do the
+			 * entries of live DIEs and pinned positions: someone is about to
+			 * navigate from those. */
+			vector<Dwarf_Off> cus;
+			for (auto i = sticky_dies.begin(); i != sticky_dies.end(); ++i)
+			{
+				if (tag_is_cu(i->second->get_tag())
+					&& !dynamic_cast<in_memory_abstract_die *>(i->second.get())) cus.push_back(i->first);
+			}
+			if (cus.empty()) return;
+			auto is_in_memory = [this](Dwarf_Off off) {
+				auto found = live_dies.find(off);
+				return found != live_dies.end()
+					&& dynamic_cast<in_memory_abstract_die *>(found->second);
+			};
+			auto is_held = [this](Dwarf_Off off) {
+				return live_dies.find(off) != live_dies.end()
+					|| budget.pinned.find(off) != budget.pinned.end();
+			};
+			const unsigned NONE = (unsigned) -1;
+			auto shard_of = [&cus, &is_in_memory, &is_held, NONE](Dwarf_Off key, Dwarf_Off value) -> unsigned {
+				auto found = std::upper_bound(cus.begin(), cus.end(), key);
+				if (found == cus.begin()) return NONE;
+				--found;
+				if (*found == key || is_held(key) || is_in_memory(value)) return NONE;
+				return found - cus.begin();
+			};
+			/* Count each shard's entries, to know how many shards to drop. */
+			vector<unsigned long> n_entries(cus.size());
+			auto count = [&](const unordered_map<Dwarf_Off, Dwarf_Off>& m) {
+				for (auto i = m.begin(); i != m.end(); ++i)
+				{
+					unsigned s = shard_of(i->first, i->second);
+					if (s != NONE) ++n_entries[s];
+				}
+			};
+			count(parent_of);
+			count(first_child_of);
+			count(next_sibling_of);
+			count(subtree_end_of);
+			size_t total_entries = parent_of.size() + first_child_of.size() + next_sibling_of.size()
+				+ subtree_end_of.size();
+			cache_usage usage = get_cache_usage();
+			size_t bytes_per_entry = total_entries ? usage.nav / total_entries : 0;
+
+			/* Coldest first, perhaps sparing the CU sampled most recently. */
+			vector<unsigned> order;
+			for (unsigned i = 0; i < cus.size(); ++i) if (n_entries[i]) order.push_back(i);
+			auto last_sampled = [this, &cus](unsigned i) -> unsigned long {
+				auto found = budget.cu_last_sampled.find(cus[i]);
+				return found == budget.cu_last_sampled.end() ? 0 : found->second;
+			};
+			std::sort(order.begin(), order.end(), [&](unsigned a, unsigned b) {
+				return last_sampled(a) < last_sampled(b);
+			});
+			if (spare_current && !order.empty() && last_sampled(order.back()) == budget.tick)
+			{
+				order.pop_back();
+			}
+			vector<bool> evict(cus.size());
+			size_t projected = usage.total();
+			unsigned n_evicted = 0;
+			for (auto i_s = order.begin(); i_s != order.end() && projected > target; ++i_s)
+			{
+				evict[*i_s] = true;
+				projected -= std::min(projected, n_entries[*i_s] * bytes_per_entry);
+				budget.cu_last_sampled.erase(cus[*i_s]);
+				++n_evicted;
+				DWARFPP_STAT_INC(*this, cache_shards_evicted);
+			}
+			if (n_evicted == 0) return;
+
+			auto erase_from = [&](unordered_map<Dwarf_Off, Dwarf_Off>& m) {
+				for (auto i = m.begin(); i != m.end(); )
+				{
+					unsigned s = shard_of(i->first, i->second);
+					if (s != NONE && evict[s]) i = m.erase(i); else ++i;
+				}
+				m.rehash(0);
+			};
+			erase_from(parent_of);
+			erase_from(first_child_of);
+			erase_from(next_sibling_of);
+			erase_from(subtree_end_of);
+			for (auto i = depth_of.begin(); i != depth_of.end(); )
+			{
+				unsigned s = shard_of(i->first, i->first);
+				if (s != NONE && evict[s]) i = depth_of.erase(i); else ++i;
+			}
+			depth_of.rehash(0);
+			/* What preload() gave us is no longer complete. */
+			nav_complete = false;
+			debug(2) << "Evicted the navigation entries of " << n_evicted << " of "
+				<< cus.size() << " CUs" << endl;
+		}
+	}
+}
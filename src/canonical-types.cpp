@@ -0,0 +1,138 @@
+/* dwarfpp: C++ binding for a useful subset of libdwarf, plus extra goodies.
+ *
+ * canonical-types.cpp: dense, deduplicated IDs for the types in a root
+ *
+ * Copyright (c) 2008--17, Stephen Kell. For licensing information, see the
+ * LICENSE file in the root of the libdwarfpp tree.
+ */
+
+#include <algorithm>
+#include <unordered_set>
+
+#include "dwarfpp/root.hpp"
+#include "dwarfpp/root-inl.hpp"
+#include "dwarfpp/iter.hpp"
+#include "dwarfpp/iter-inl.hpp"
+#include "dwarfpp/dies.hpp"
+#include "dwarfpp/dies-inl.hpp"
+
+namespace dwarf
+{
+	using std::endl;
+	using std::vector;
+	namespace core
+	{
+		bool root_die::build_canonical_type_table(unsigned nthreads)
+		{
+			if (frozen) return false;
+			compute_all_type_summaries(*this, nthreads);
+			canonical_type_ids.clear();
+			shared_canonical_ids = record_span<shared_canonical_id>();
+			rep_compatible_cache.clear();
+			vector<Dwarf_Off>& reps = canonical_type_reps_storage;
+			reps.assign(1, 0UL); // ID 0 is void
+
+			/* Equal types have equal summary codes, so we only need compare
+			 * within a bucket. Types with no code (incompletes, and things
+			 * reaching them) we bucket by abstract name instead. Each bucket
+			 * holds one representative per ID, so with a good hash, most
+			 * types are compared exactly once. */
+			unordered_map<uint32_t, vector<unsigned> > by_code;
+			unordered_map<string, vector<unsigned> > by_name;
+			unsigned long n_types = 0;
+			unsigned long n_compared = 0;
+			for (iterator_df<> i = begin(); i != end(); ++i)
+			{
+				if (!i.is_a<type_die>()) continue;
+				++n_types;
+				iterator_df<type_die> t = i.as_a<type_die>();
+				opt<uint32_t> code = t->summary_code();
+				vector<unsigned>& bucket = code ? by_code[*code] : by_name[abstract_name_for_type(t)];
+				unsigned id = 0;
+				for (auto i_id = bucket.begin(); i_id != bucket.end(); ++i_id)
+				{
+					++n_compared;
+					auto rep = pos(reps[*i_id]).as_a<type_die>();
+					if (t->equal(rep, {})) { id = *i_id; break; }
+				}
+				if (id == 0)
+				{
+					id = reps.size();
+					reps.push_back(t.offset_here());
+					bucket.push_back(id);
+				}
+				canonical_type_ids.insert(make_pair(t.offset_here(), id));
+			}
+			canonical_type_reps = record_span<Dwarf_Off>(reps);
+			debug(2) << "Built canonical type table of " << reps.size() - 1
+				<< " IDs for " << n_types << " types, using " << n_compared
+				<< " comparisons" << endl;
+			return true;
+		}
+
+		opt<unsigned> root_die::canonical_id(const iterator_base& t)
+		{
+			if (!t) return opt<unsigned>(0);
+			if (!have_canonical_type_table() && !frozen) build_canonical_type_table();
+			return lookup_canonical_id(t.offset_here());
+		}
+
+		opt<unsigned> root_die::lookup_canonical_id(Dwarf_Off off) const
+		{
+			if (!shared_canonical_ids.empty())
+			{
+				auto found = std::lower_bound(shared_canonical_ids.begin(), shared_canonical_ids.end(),
+					off, [](const shared_canonical_id& e, Dwarf_Off o) { return e.off < o; });
+				if (found == shared_canonical_ids.end() || found->off != off) return opt<unsigned>();
+				return found->id;
+			}
+			auto found = canonical_type_ids.find(off);
+			if (found == canonical_type_ids.end()) return opt<unsigned>();
+			return found->second;
+		}
+
+		void root_die::forget_canonical_ids(const std::unordered_set<Dwarf_Off>& offs)
+		{
+			/* A shared index's table is read-only, so first take a copy. */
+			if (!shared_canonical_ids.empty())
+			{
+				canonical_type_ids.clear();
+				for (auto i = shared_canonical_ids.begin(); i != shared_canonical_ids.end(); ++i)
+				{
+					canonical_type_ids.insert(make_pair(i->off, (unsigned) i->id));
+				}
+				shared_canonical_ids = record_span<shared_canonical_id>();
+			}
+			vector<Dwarf_Off>& reps = canonical_type_reps_storage;
+			if (canonical_type_reps.data() != reps.data())
+			{
+				reps.assign(canonical_type_reps.begin(), canonical_type_reps.end());
+				canonical_type_reps = record_span<Dwarf_Off>(reps);
+			}
+			bool reps_forgotten = false;
+			for (auto i = offs.begin(); i != offs.end(); ++i)
+			{
+				auto found = canonical_type_ids.find(*i);
+				if (found == canonical_type_ids.end()) continue;
+				if (reps[found->second] == *i) { reps[found->second] = 0; reps_forgotten = true; }
+				canonical_type_ids.erase(found);
+			}
+			/* An ID that lost its representative takes the lowest-offset type
+			 * it has left, if any; reps are lowest already, so only those
+			 * change. */
+			for (auto i = canonical_type_ids.begin(); reps_forgotten && i != canonical_type_ids.end(); ++i)
+			{
+				Dwarf_Off& rep = reps[i->second];
+				if (rep == 0 || i->first < rep) rep = i->first;
+			}
+			debug(2) << "Forgot the canonical IDs of " << offs.size() << " edited types" << endl;
+		}
+
+		iterator_base root_die::canonical_representative(unsigned id)
+		{
+			/* An edit can leave an ID with no types. */
+			if (id == 0 || id >= canonical_type_reps.size() || canonical_type_reps[id] == 0) return iterator_base::END;
+			return pos(canonical_type_reps[id]);
+		}
+	}
+}
@@ -0,0 +1,383 @@
+/* dwarfpp: C++ binding for a useful subset of libdwarf, plus extra goodies.
+ *
+ * cfi-table.cpp: compiled, flat call frame information row tables
+ *
+ * Copyright (c) 2008--17, Stephen Kell. For licensing information, see the
+ * LICENSE file in the root of the libdwarfpp tree.
+ */
+
+#include <cstddef>
+#include <cstring>
+#include <strings.h>
+#include <fstream>
+#include <sstream>
+#include <map>
+#include <algorithm>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <elf.h>
+
+#include "dwarfpp/frame.hpp"
+
+namespace dwarf
+{
+	using std::endl;
+	using std::vector;
+	namespace core
+	{
+		namespace
+		{
+			const char cfi_table_magic[8] = { 'D', 'W', 'P', 'P', 'C', 'F', 'I', '2' };
+
+			/* As with the shared index: this header, the build-id bytes
+			 * (padded to 8), then the arrays in the order below. */
+			struct cfi_table_header
+			{
+				char magic[8];
+				uint32_t row_size;
+				uint32_t instr_record_size;
+				uint64_t build_id_len; // in bytes of the hex string
+				uint64_t n_tracked_regs;
+				uint64_t n_rows;
+				uint64_t n_exprs;
+				uint64_t n_instrs; // over all exprs
+			};
+			struct cfi_table_instr_record
+			{
+				uint64_t number;
+				uint64_t number2;
+				uint64_t offset;
+				uint8_t atom;
+				uint8_t unused[7];
+			};
+			inline uint64_t padded_len(uint64_t len) { return (len + 7) & ~(uint64_t) 7; }
+			/* Add n records of size bytes to len; true if that overflows. */
+			inline bool add_array_len(uint64_t& len, uint64_t n, uint64_t size)
+			{
+				uint64_t bytes;
+				return __builtin_mul_overflow(n, size, &bytes)
+					|| __builtin_add_overflow(len, bytes, &len);
+			}
+
+			bool same_rules(const cfi_table::row& r1, const cfi_table::row& r2)
+			{
+				// rows are bzero'd before filling, so padding compares equal too
+				return 0 == memcmp(&r1.cfa, &r2.cfa,
+					sizeof (cfi_table::row) - offsetof(cfi_table::row, cfa));
+			}
+		}
+
+		vector<int> cfi_table::default_tracked_regs(const FrameSection& fs)
+		{
+			/* DWARF register numbers of the callee-saved registers,
+			 * then the return address column. */
+			switch (fs.get_elf_machine())
+			{
+				case EM_X86_64: return { 3 /* rbx */, 6 /* rbp */, 12, 13, 14, 15, 16 /* rip */ };
+				case EM_386:    return { 3 /* ebx */, 5 /* ebp */, 6 /* esi */, 7 /* edi */, 8 /* eip */ };
+				default: break;
+			}
+			/* Otherwise, just the return address, which the first CIE will tell us. */
+			auto i_cie = fs.cie_begin();
+			if (i_cie == fs.cie_end()) return vector<int>();
+			return vector<int>(1, (*i_cie).get_return_address_register_rule());
+		}
+
+		opt<unsigned> cfi_table::tracked_index(int regnum) const
+		{
+			auto found = std::find(tracked_regs.begin(), tracked_regs.end(), regnum);
+			if (found == tracked_regs.end()) return opt<unsigned>();
+			return found - tracked_regs.begin();
+		}
+
+		bool cfi_table::compile(const FrameSection& fs, const vector<int>& regs)
+		{
+			rows.clear();
+			exprs.clear();
+			build_id = root_die::get_build_id(fs.get_elf());
+			tracked_regs = regs.empty() ? default_tracked_regs(fs) : regs;
+			if (tracked_regs.size() > MAX_TRACKED_REGS) return false;
+
+			std::map<vector<encap::expr_instr>, unsigned> expr_index;
+			auto intern_expr = [this, &expr_index](const encap::loc_expr& e) -> int32_t {
+				auto found = expr_index.find(e);
+				if (found != expr_index.end()) return found->second;
+				unsigned idx = exprs.size();
+				exprs.push_back(e);
+				expr_index.insert(make_pair(vector<encap::expr_instr>(e), idx));
+				return idx;
+			};
+			Dwarf_Debug dbg = fs.get_dbg().raw_handle();
+			auto make_row = [this, &intern_expr, dbg](Dwarf_Addr pc,
+				const FrameSection::compact_rule *begin, const FrameSection::compact_rule *end) -> row {
+				row r;
+				bzero(&r, sizeof r); // all rules INDETERMINATE
+				r.pc = pc;
+				for (auto i_def = begin; i_def != end; ++i_def)
+				{
+					rule *p;
+					if (i_def->regnum == DW_FRAME_CFA_COL3) p = &r.cfa;
+					else
+					{
+						auto idx = tracked_index(i_def->regnum);
+						if (!idx)
+						{
+							if (i_def->k != FrameSection::register_def::INDETERMINATE) ++r.n_untracked;
+							continue;
+						}
+						p = &r.regs[*idx];
+					}
+					p->k = i_def->k;
+					switch (i_def->k)
+					{
+						case FrameSection::register_def::SAVED_AT_OFFSET_FROM_CFA:
+						case FrameSection::register_def::VAL_IS_OFFSET_FROM_CFA:
+							p->offset = i_def->u.offset;
+							break;
+						case FrameSection::register_def::REGISTER:
+							p->reg = i_def->u.reg_plus_offset.reg;
+							p->offset = i_def->u.reg_plus_offset.offset;
+							break;
+						case FrameSection::register_def::SAVED_AT_EXPR:
+						case FrameSection::register_def::VAL_OF_EXPR:
+							p->offset = intern_expr(encap::loc_expr(dbg,
+								const_cast<Dwarf_Small *>(i_def->u.expr), i_def->expr_len));
+							break;
+						default:
+							break;
+					}
+				}
+				return r;
+			};
+			row gap;
+			bzero(&gap, sizeof gap);
+
+			/* Decode each FDE into its own run of rows. Decoding drops
+			 * rows with no rules at all, so fill any holes it leaves with
+			 * gap rows. */
+			struct fde_rows { Dwarf_Addr lo; Dwarf_Addr hi; vector<row> rows; };
+			vector<fde_rows> per_fde;
+			for (auto i_fde = fs.fde_begin(); i_fde != fs.fde_end(); ++i_fde)
+			{
+				if (i_fde->get_func_length() == 0) continue;
+				fde_rows f;
+				f.lo = i_fde->get_low_pc();
+				f.hi = f.lo + i_fde->get_func_length();
+				auto p_decoded = i_fde->decoded();
+				const FrameSection::instrs_results& decoded = *p_decoded;
+				Dwarf_Addr next_pc = f.lo;
+				for (auto i_r = decoded.rows.begin(); i_r != decoded.rows.end(); ++i_r)
+				{
+					if (i_r->lo >= f.hi) break;
+					if (i_r->lo > next_pc) { gap.pc = next_pc; f.rows.push_back(gap); }
+					f.rows.push_back(make_row(i_r->lo, decoded.rules_begin(*i_r), decoded.rules_end(*i_r)));
+					next_pc = i_r->hi;
+				}
+				/* decoded() gives no rows if the FDE never advances. */
+				if (f.rows.empty() && !decoded.unfinished_row.empty())
+				{
+					f.rows.push_back(make_row(f.lo, decoded.unfinished_row.data(),
+						decoded.unfinished_row.data() + decoded.unfinished_row.size()));
+				}
+				per_fde.push_back(std::move(f));
+			}
+			std::sort(per_fde.begin(), per_fde.end(),
+				[](const fde_rows& f1, const fde_rows& f2) { return f1.lo < f2.lo; });
+
+			/* Concatenate, with a gap row wherever the FDEs don't abut, and
+			 * coalescing rows whose rules are all the same. */
+			Dwarf_Addr prev_hi = 0;
+			for (auto i_f = per_fde.begin(); i_f != per_fde.end(); ++i_f)
+			{
+				if (!rows.empty() && prev_hi < i_f->lo) { gap.pc = prev_hi; rows.push_back(gap); }
+				for (auto i_r = i_f->rows.begin(); i_r != i_f->rows.end(); ++i_r)
+				{
+					if (!rows.empty() && same_rules(rows.back(), *i_r)) continue;
+					if (!rows.empty() && rows.back().pc >= i_r->pc) rows.back() = *i_r; // overlap
+					else rows.push_back(*i_r);
+				}
+				prev_hi = std::max(prev_hi, i_f->hi);
+			}
+			if (!rows.empty()) { gap.pc = prev_hi; rows.push_back(gap); }
+			rows.shrink_to_fit();
+			unsigned n_lossy = std::count_if(rows.begin(), rows.end(),
+				[](const row& r) { return r.n_untracked > 0; });
+			debug(2) << "Compiled " << per_fde.size() << " FDEs into " << rows.size()
+				<< " CFI rows (" << n_lossy << " with rules for untracked registers) and "
+				<< exprs.size() << " expressions" << endl;
+			return true;
+		}
+
+		const cfi_table::row *cfi_table::find_row(Dwarf_Addr pc) const
+		{
+			auto found = std::upper_bound(rows.begin(), rows.end(), pc,
+				[](Dwarf_Addr a, const row& r) { return a < r.pc; });
+			if (found == rows.begin()) return nullptr;
+			--found;
+			if (found->cfa.k == FrameSection::register_def::INDETERMINATE) return nullptr;
+			return &*found;
+		}
+
+		bool cfi_table::save(const string& filename) const
+		{
+			if (!build_id)
+			{
+				debug(1) << "Not saving CFI table: no build-id" << endl;
+				return false;
+			}
+			cfi_table_header hdr;
+			bzero(&hdr, sizeof hdr);
+			memcpy(hdr.magic, cfi_table_magic, sizeof hdr.magic);
+			hdr.row_size = sizeof (row);
+			hdr.instr_record_size = sizeof (cfi_table_instr_record);
+			hdr.build_id_len = build_id->size();
+			hdr.n_tracked_regs = tracked_regs.size();
+			hdr.n_rows = rows.size();
+			hdr.n_exprs = exprs.size();
+			vector<uint64_t> expr_lengths;
+			vector<cfi_table_instr_record> instrs;
+			for (auto i_e = exprs.begin(); i_e != exprs.end(); ++i_e)
+			{
+				expr_lengths.push_back(i_e->size());
+				for (auto i_instr = i_e->begin(); i_instr != i_e->end(); ++i_instr)
+				{
+					cfi_table_instr_record rec;
+					bzero(&rec, sizeof rec);
+					rec.atom = i_instr->lr_atom;
+					rec.number = i_instr->lr_number;
+					rec.number2 = i_instr->lr_number2;
+					rec.offset = i_instr->lr_offset;
+					instrs.push_back(rec);
+				}
+			}
+			hdr.n_instrs = instrs.size();
+			vector<int64_t> regs(tracked_regs.begin(), tracked_regs.end());
+
+			/* As with the nav index, write to a temporary and rename. */
+			std::ostringstream tmp;
+			tmp << filename << ".tmp." << getpid();
+			string tmp_filename = tmp.str();
+			{
+				std::ofstream out(tmp_filename, std::ios::binary | std::ios::trunc);
+				if (!out) return false;
+				string padded_build_id = *build_id;
+				padded_build_id.resize(padded_len(build_id->size()), '\0');
+				out.write(reinterpret_cast<const char *>(&hdr), sizeof hdr);
+				out.write(padded_build_id.data(), padded_build_id.size());
+				out.write(reinterpret_cast<const char *>(regs.data()), regs.size() * sizeof (int64_t));
+				out.write(reinterpret_cast<const char *>(rows.data()), rows.size() * sizeof (row));
+				out.write(reinterpret_cast<const char *>(expr_lengths.data()),
+					expr_lengths.size() * sizeof (uint64_t));
+				out.write(reinterpret_cast<const char *>(instrs.data()),
+					instrs.size() * sizeof (cfi_table_instr_record));
+				if (!out) { unlink(tmp_filename.c_str()); return false; }
+			}
+			if (0 != rename(tmp_filename.c_str(), filename.c_str()))
+			{
+				unlink(tmp_filename.c_str());
+				return false;
+			}
+			debug(2) << "Saved " << rows.size() << " CFI rows to " << filename << endl;
+			return true;
+		}
+
+		bool cfi_table::load(const string& filename, const FrameSection& fs)
+		{
+			std::ifstream in(filename, std::ios::binary);
+			if (!in) return false;
+			struct stat st;
+			if (0 != stat(filename.c_str(), &st)) return false;
+			uint64_t len = st.st_size;
+			cfi_table_header hdr;
+			if (!in.read(reinterpret_cast<char *>(&hdr), sizeof hdr)
+				|| 0 != memcmp(hdr.magic, cfi_table_magic, sizeof hdr.magic)
+				|| hdr.row_size != sizeof (row)
+				|| hdr.instr_record_size != sizeof (cfi_table_instr_record)
+				|| hdr.n_tracked_regs > MAX_TRACKED_REGS)
+			{
+				debug(1) << "Did not understand CFI table " << filename << endl;
+				return false;
+			}
+			/* The counts are the file's to say, so check them against its
+			 * length before we allocate anything. */
+			uint64_t expected_len = sizeof (cfi_table_header);
+			bool overflowed = hdr.build_id_len > len
+				|| add_array_len(expected_len, padded_len(hdr.build_id_len), 1)
+				|| add_array_len(expected_len, hdr.n_tracked_regs, sizeof (int64_t))
+				|| add_array_len(expected_len, hdr.n_rows, sizeof (row))
+				|| add_array_len(expected_len, hdr.n_exprs, sizeof (uint64_t))
+				|| add_array_len(expected_len, hdr.n_instrs, sizeof (cfi_table_instr_record));
+			if (overflowed || expected_len != len)
+			{
+				debug(1) << "CFI table " << filename << " is truncated" << endl;
+				return false;
+			}
+			string file_build_id(padded_len(hdr.build_id_len), '\0');
+			in.read(&file_build_id[0], file_build_id.size());
+			file_build_id.resize(hdr.build_id_len);
+			opt<string> our_build_id = root_die::get_build_id(fs.get_elf());
+			if (!in || !our_build_id || file_build_id != *our_build_id)
+			{
+				debug(1) << "CFI table " << filename << " is for a different build" << endl;
+				return false;
+			}
+			vector<int64_t> regs(hdr.n_tracked_regs);
+			vector<row> new_rows(hdr.n_rows);
+			vector<uint64_t> expr_lengths(hdr.n_exprs);
+			vector<cfi_table_instr_record> instrs(hdr.n_instrs);
+			in.read(reinterpret_cast<char *>(regs.data()), regs.size() * sizeof (int64_t));
+			in.read(reinterpret_cast<char *>(new_rows.data()), new_rows.size() * sizeof (row));
+			in.read(reinterpret_cast<char *>(expr_lengths.data()), expr_lengths.size() * sizeof (uint64_t));
+			in.read(reinterpret_cast<char *>(instrs.data()), instrs.size() * sizeof (cfi_table_instr_record));
+			if (!in)
+			{
+				debug(1) << "CFI table " << filename << " is truncated" << endl;
+				return false;
+			}
+			uint64_t total = 0;
+			for (auto i_len = expr_lengths.begin(); i_len != expr_lengths.end(); ++i_len)
+			{
+				if (__builtin_add_overflow(total, *i_len, &total)) return false;
+			}
+			if (total != hdr.n_instrs) return false;
+			/* Expression rules index the expressions, so check that they can. */
+			for (auto i_r = new_rows.begin(); i_r != new_rows.end(); ++i_r)
+			{
+				for (unsigned i = 0; i <= hdr.n_tracked_regs; ++i)
+				{
+					const rule& rl = (i == 0) ? i_r->cfa : i_r->regs[i - 1];
+					if ((rl.k == FrameSection::register_def::SAVED_AT_EXPR
+							|| rl.k == FrameSection::register_def::VAL_OF_EXPR)
+						&& (rl.offset < 0 || (uint64_t) rl.offset >= hdr.n_exprs))
+					{
+						debug(1) << "CFI table " << filename << " has a bad expression index" << endl;
+						return false;
+					}
+				}
+			}
+
+			build_id = our_build_id;
+			tracked_regs.assign(regs.begin(), regs.end());
+			rows = std::move(new_rows);
+			exprs.clear();
+			auto i_rec = instrs.begin();
+			for (auto i_len = expr_lengths.begin(); i_len != expr_lengths.end(); ++i_len)
+			{
+				vector<encap::expr_instr> e;
+				for (uint64_t n = 0; n < *i_len; ++n, ++i_rec)
+				{
+					encap::expr_instr instr;
+					bzero(&instr, sizeof instr);
+					instr.lr_atom = i_rec->atom;
+					instr.lr_number = i_rec->number;
+					instr.lr_number2 = i_rec->number2;
+					instr.lr_offset = i_rec->offset;
+					e.push_back(instr);
+				}
+				exprs.push_back(encap::loc_expr(e));
+			}
+			debug(2) << "Loaded " << rows.size() << " CFI rows from " << filename << endl;
+			return true;
+		}
+	}
+}
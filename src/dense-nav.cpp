@@ -0,0 +1,142 @@
+/* dwarfpp: C++ binding for a useful subset of libdwarf, plus extra goodies.
+ *
+ * dense-nav.cpp: flat, offset-sorted per-CU navigation tables
+ *
+ * Copyright (c) 2008--17, Stephen Kell. For licensing information, see the
+ * LICENSE file in the root of the libdwarfpp tree.
+ */
+
+#include <algorithm>
+
+#include "dwarfpp/root.hpp"
+#include "dwarfpp/root-inl.hpp"
+#include "dwarfpp/iter.hpp"
+#include "dwarfpp/iter-inl.hpp"
+
+namespace dwarf
+{
+	using std::endl;
+	namespace core
+	{
+		/* DIEs are laid out in preorder, so walking depth-first gives us
+		 * records already sorted by offset. We use raw libdwarf calls so that
+		 * we don't pay for iterators (and their caches) during the build.
+		 * Indices count from base, where the CU's records start in out. */
+		static unsigned
+		add_dense_nav_subtree(Dwarf_Debug dbg, Dwarf_Die die, unsigned parent_idx,
+			unsigned short depth, std::vector<root_die::dense_nav_record>& out, size_t base)
+		{
+			Dwarf_Off off;
+			Dwarf_Half tag;
+			int ret = dwarf_dieoffset(die, &off, &current_dwarf_error);
+			assert(ret == DW_DLV_OK);
+			ret = dwarf_tag(die, &tag, &current_dwarf_error);
+			assert(ret == DW_DLV_OK);
+			assert(out.size() == base || out.back().offset < off);
+			unsigned idx = out.size() - base;
+			out.push_back((root_die::dense_nav_record) {
+				.offset = off,
+				.parent = parent_idx,
+				.first_child = root_die::dense_nav_record::NONE,
+				.next_sibling = root_die::dense_nav_record::NONE,
+				.depth = depth,
+				.tag = tag
+			});
+			Dwarf_Die child;
+			unsigned prev_idx = root_die::dense_nav_record::NONE;
+			ret = dwarf_child(die, &child, &current_dwarf_error);
+			while (ret == DW_DLV_OK)
+			{
+				unsigned child_idx = add_dense_nav_subtree(dbg, child, idx, depth + 1, out, base);
+				// careful: "out" may have been reallocated, so index afresh
+				if (prev_idx == root_die::dense_nav_record::NONE) out[base + idx].first_child = child_idx;
+				else out[base + prev_idx].next_sibling = child_idx;
+				prev_idx = child_idx;
+				Dwarf_Die next;
+				ret = dwarf_siblingof(dbg, child, &next, &current_dwarf_error);
+				dwarf_dealloc(dbg, child, DW_DLA_DIE);
+				child = next;
+			}
+			return idx;
+		}
+
+		void root_die::set_dense_nav(std::vector<dense_nav_record>&& storage,
+			const std::vector<pair<Dwarf_Off, size_t> >& cu_starts)
+		{
+			dense_nav_storage = std::move(storage);
+			dense_nav_storage.shrink_to_fit();
+			dense_nav.clear();
+			dense_nav.reserve(cu_starts.size());
+			for (auto i = cu_starts.begin(); i != cu_starts.end(); ++i)
+			{
+				size_t end = (i + 1 == cu_starts.end()) ? dense_nav_storage.size() : (i + 1)->second;
+				assert(dense_nav.empty() || dense_nav.back().cu_offset < i->first);
+				dense_nav.push_back((dense_nav_cu_table) {
+					.cu_offset = i->first,
+					.records = record_span<dense_nav_record>(dense_nav_storage.data() + i->second,
+						end - i->second)
+				});
+			}
+		}
+
+		bool root_die::build_dense_nav()
+		{
+			clear_dense_nav();
+			if (!dbg.handle) return false;
+			bool ret = clear_cu_context();
+			assert(ret);
+			std::vector<dense_nav_record> storage;
+			std::vector<pair<Dwarf_Off, size_t> > cu_starts;
+			/* This leaves us with no CU context, just like clear_cu_context(). */
+			while (advance_cu_context())
+			{
+				auto cu_handle = Die::try_construct(*this); // doesn't touch the caches
+				if (!cu_handle) break;
+				cu_starts.push_back(make_pair(current_cu_offset, storage.size()));
+				add_dense_nav_subtree(dbg.handle.get(), cu_handle.get(),
+					dense_nav_record::NONE, 1, storage, storage.size());
+			}
+			set_dense_nav(std::move(storage), cu_starts);
+			debug(2) << "Built dense navigation tables for " << dense_nav.size() << " CUs" << endl;
+			return true;
+		}
+
+		bool root_die::build_dense_nav_table(Dwarf_Off cu_off, std::vector<dense_nav_record>& out)
+		{
+			if (!dbg.handle) return false;
+			auto cu_handle = Die::try_construct(*this, cu_off);
+			if (!cu_handle) return false;
+			add_dense_nav_subtree(dbg.handle.get(), cu_handle.get(),
+				dense_nav_record::NONE, 1, out, out.size());
+			return true;
+		}
+
+		const root_die::dense_nav_record *
+		root_die::dense_nav_lookup(Dwarf_Off off, const dense_nav_cu_table **p_cu) const
+		{
+			if (dense_nav.empty()) return nullptr;
+			// find the last CU starting at or before off
+			auto found_cu = std::upper_bound(dense_nav.begin(), dense_nav.end(), off,
+				[](Dwarf_Off o, const dense_nav_cu_table& t) { return o < t.cu_offset; });
+			if (found_cu == dense_nav.begin()) return nullptr;
+			--found_cu;
+			auto& recs = found_cu->records;
+			auto found = std::lower_bound(recs.begin(), recs.end(), off,
+				[](const dense_nav_record& r, Dwarf_Off o) { return r.offset < o; });
+			if (found == recs.end() || found->offset != off) return nullptr;
+			if (p_cu) *p_cu = &*found_cu;
+			return &*found;
+		}
+
+		bool
+		root_die::dense_nav_position(Dwarf_Off off, unsigned *p_cu_idx, unsigned *p_rec_idx) const
+		{
+			const dense_nav_cu_table *p_cu;
+			const dense_nav_record *p_rec = dense_nav_lookup(off, &p_cu);
+			if (!p_rec) return false;
+			*p_cu_idx = p_cu - dense_nav.data();
+			*p_rec_idx = p_rec - p_cu->records.data();
+			return true;
+		}
+	}
+}
@@ -0,0 +1,113 @@
+/* dwarfpp: C++ binding for a useful subset of libdwarf, plus extra goodies.
+ *
+ * die-reader.cpp: navigating a root_die with a reader other than libdwarf
+ *
+ * Copyright (c) 2008--17, Stephen Kell. For licensing information, see the
+ * LICENSE file in the root of the libdwarfpp tree.
+ */
+
+#include "dwarfpp/die-reader.hpp"
+#include "dwarfpp/native-reader.hpp"
+#if HAVE_LIBDW
+#include "dwarfpp/libdw-reader.hpp"
+#endif
+#include "dwarfpp/section-loader.hpp"
+#include "dwarfpp/root-inl.hpp"
+#include "dwarfpp/iter.hpp"
+#include "dwarfpp/iter-inl.hpp"
+
+namespace dwarf
+{
+	namespace core
+	{
+		opt<string> reader_die::get_name() const
+		{
+			string_view v = p_reader->name(unit_idx, off);
+			if (v.data()) return string(v.data(), v.size());
+			/* Maybe it's a name the reader can't resolve; libdwarf might. */
+			if (p_reader->has_attr(unit_idx, off, DW_AT_name)) return Die(*p_root, off).get_name();
+			return opt<string>();
+		}
+
+		encap::attribute_map reader_die::copy_attrs() const
+		{
+			return Die(*p_root, off).copy_attrs();
+		}
+
+		spec& reader_die::get_spec(root_die& r) const
+		{
+			/* As Die::spec_here(): it's the CU's spec. */
+			return r.pos(get_enclosing_cu_offset(), 1, opt<Dwarf_Off>(0UL)).spec_here();
+		}
+
+		bool root_die::set_reader(reader_kind k)
+		{
+			if (frozen) return get_reader() == k;
+			if (k == LIBDWARF_READER) { p_reader.reset(); return true; }
+			if (get_reader() == k) return true;
+			shared_ptr<die_reader> p;
+			switch (k)
+			{
+				case NATIVE_READER:
+					if (img.loader) p = native_reader::from_loader(*img.loader);
+					break;
+				case LIBDW_READER:
+#if HAVE_LIBDW
+					if (img.elf || fd != -1)
+					{
+						auto p_dw = std::make_shared<libdw_reader>(fd, img.elf);
+						if (p_dw->ok()) p = p_dw;
+					}
+#endif
+					break;
+				default: break;
+			}
+			if (!p) return false;
+			/* Our caches are offset-keyed, so they hold for any reader. */
+			p_reader = p;
+			return true;
+		}
+
+		root_die::reader_kind root_die::get_reader() const
+		{
+			return p_reader ? p_reader->kind() : LIBDWARF_READER;
+		}
+
+		shared_ptr<const native_reader> root_die::get_native_reader() const
+		{
+			return std::dynamic_pointer_cast<const native_reader>(p_reader);
+		}
+
+		iterator_base root_die::reader_pos(unsigned unit_idx, Dwarf_Off off,
+			opt<unsigned short> opt_depth, Dwarf_Off parent_off)
+		{
+			if (!frozen) { parent_of[off] = parent_off; note_cache_growth(off); }
+			auto found_live = live_dies.find(off);
+			if (found_live != live_dies.end())
+			{
+				return iterator_base(static_cast<abstract_die&&>(*found_live->second), opt_depth, *this);
+			}
+			reader_die d(*this, *p_reader, unit_idx, off);
+			/* Sticky DIEs need a payload, hence a libdwarf handle. */
+			if (is_sticky(d)) return pos(off, opt_depth, opt<Dwarf_Off>(parent_off));
+			return iterator_base(off, d.get_tag(), d.get_spec(*this), opt_depth, *this);
+		}
+
+		bool root_die::reader_name_view(Dwarf_Off off, string_view *out) const
+		{
+			unsigned u;
+			if (!p_reader || !p_reader->unit_index_for(off, &u)) return false;
+			*out = p_reader->name(u, off);
+			/* If there's a name the reader couldn't resolve, let libdwarf try. */
+			return out->data() || !p_reader->has_attr(u, off, DW_AT_name);
+		}
+
+		bool root_die::reader_has_attr(Dwarf_Off off, Dwarf_Half attr, bool *out) const
+		{
+			unsigned u;
+			if (!p_reader || !p_reader->unit_index_for(off, &u)) return false;
+			*out = p_reader->has_attr(u, off, attr);
+			return true;
+		}
+	}
+}
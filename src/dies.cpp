@@ -16,6 +16,7 @@
 #include "dwarfpp/dies-inl.hpp"
 
 #include <memory>
+#include <algorithm>
 #include <boost/regex.hpp>
 #include <srk31/algorithm.hpp>
 
@@ -32,6 +33,14 @@ namespace dwarf
 		
 		opt<std::string> compile_unit_die::source_file_fq_pathname(unsigned o) const
 		{
+			auto p_files = get_source_files();
+			if (p_files)
+			{
+				unsigned id = p_files->path_id(o);
+				if (id == source_file_table::NONE) return opt<string>();
+				return opt<string>(get_root().line_file_name(id));
+			}
+			/* Frozen, with nothing decoded beforehand: the slow way. */
 			string filepath;
 			try
 			{
@@ -42,26 +51,7 @@ namespace dwarf
 					<< dwarf_errmsg(current_dwarf_error) << std::endl;
 				return opt<string>();
 			}
-			opt<string> maybe_dir = this->get_comp_dir();
-			if (filepath.length() > 0 && filepath.at(0) == '/') return opt<string>(filepath);
-			else if (!maybe_dir) return opt<string>();
-			else
-			{
-				// we want to do 
-				// return dir + "/" + path;
-				// BUT "path" can contain "../".
-				string ourdir = *maybe_dir;
-				string ourpath = filepath;
-				while (boost::starts_with(ourpath, "../"))
-				{
-					char *buf = strdup(ourdir.c_str());
-					ourdir = dirname(buf); /* modifies buf! */
-					free(buf);
-					ourpath = ourpath.substr(3);
-				}
-
-				return opt<string>(ourdir + "/" + ourpath);
-			}
+			return source_file_table::fq_pathname(this->get_comp_dir(), filepath);
 		}
 
 		iterator_base
@@ -71,7 +61,7 @@ namespace dwarf
 			 * been called via the payload, we have the added inefficiency of 
 			 * searching for ourselves first. This shouldn't happen, though 
 			 * I'm not sure if we explicitly avoid it. Warn. */
-			debug(2) << "Warning: inefficient usage of with_named_children_die::named_child" << endl;
+			debug_sampled(2, 1000, << "Warning: inefficient usage of with_named_children_die::named_child" << endl);
 
 			/* NOTE: the idea about payloads knowing about their children is 
 			 * already dodgy because it breaks our "no knowledge of structure" 
@@ -476,7 +466,7 @@ namespace dwarf
 			 * (reaching a black node).
 			 */
 			pair<iterator_base, iterator_base> sideways_target, deeper_target;
-			debug(5) << "Trying to move deeper..." << std::endl;
+			debug_expensive(5, << "Trying to move deeper..." << std::endl);
 			deeper_target = first_outgoing_edge_target();
 			if (!skip_dependencies && (deeper_target.first || deeper_target.second))
 			{
@@ -484,11 +474,11 @@ namespace dwarf
 				 * Don't descend to something we're already visiting (grey; back edge).
 				 * BUT because we're silly (emulating walk_type), we *do* re-push
 				 * cross-edge targets that we have already finished visiting (black). */
-				debug(5) << "Found deeper (" << deeper_target.first.summary() << "); are we walking it already?...";
+				debug_expensive(5, << "Found deeper (" << deeper_target.first.summary() << "); are we walking it already?...");
 				colour col = colour_of(deeper_target.first);
 				if (col == WHITE || col == BLACK)
 				{
-					debug(5) << "no, so descending." << std::endl;
+					debug_expensive(5, << "no, so descending." << std::endl);
 					/* continue and push it on the stack again
 					 * -- NOTE that this will re-explore a blackened subtree! */
 					this->m_stack.push_back(deeper_target);
@@ -498,7 +488,7 @@ namespace dwarf
 				}
 				else // grey -- it's a back-edge
 				{
-					debug(5) << "yes, so pretending we can't move deeper..." << std::endl;
+					debug_expensive(5, << "yes, so pretending we can't move deeper..." << std::endl);
 					// silently ignore it -- it's as if we can't go deeper
 					deeper_target = make_pair(END, END);
 				}
@@ -506,11 +496,11 @@ namespace dwarf
 			
 			while (true)
 			{
-				debug(5) << "Trying to move sideways..." << std::endl;
+				debug_expensive(5, << "Trying to move sideways..." << std::endl);
 				sideways_target = predecessor_node_next_outgoing_edge_target();
 				if (sideways_target.first || sideways_target.second)
 				{
-					debug(5) << "Found sideways, so moving there..." << std::endl;
+					debug_expensive(5, << "Found sideways, so moving there..." << std::endl);
 					// blacken the old top
 					black_offsets.insert(this->m_stack.back().first);
 					/* replace the top element */
@@ -521,7 +511,7 @@ namespace dwarf
 					return;
 				}
 			//force_backtrack:
-				debug(5) << "Nowhere sideways to move... backtracking" << std::endl;
+				debug_expensive(5, << "Nowhere sideways to move... backtracking" << std::endl);
 				assert(!m_stack.empty());
 				// else backtrack
 				black_offsets.insert(this->m_stack.back().first);
@@ -1025,6 +1015,9 @@ namespace dwarf
 
 			abort(); // we should not reach here
 		}
+		// compute_all_type_summaries() uses this too
+		template opt<uint32_t> type_die::containment_summary_code<uint32_t>(
+			std::function<opt<uint32_t>(iterator_df<type_die>)> recursive_call) const;
 		opt<uint16_t> type_die::traversal_summary_code() const
 		{
 			return opt<uint16_t>(); // FIXME
@@ -1606,6 +1599,7 @@ namespace dwarf
 				output_word << abstract_name_for_type(self);
 			}
 
+			get_root().note_type_cached();
 			this->cached_summary_code = output_word.val;
 			//get_root().type_summary_code_cache.insert(
 			//	make_pair(get_offset(), output_word.val)
@@ -1615,7 +1609,7 @@ namespace dwarf
 
 		opt<uint32_t> type_die::summary_code_using_walk_type() const
 		{
-			debug(2) << "Computing summary code for " << *this << std::endl;
+			debug_expensive(2, << "Computing summary code for " << *this << std::endl);
 			/* Here we compute a 4-byte hash-esque summary of a data type's 
 			 * definition. The intentions here are that 
 			 *
@@ -1683,8 +1677,11 @@ namespace dwarf
 			 * in the relevant sequence, "<<" in its code.  */
 			walk_type(outer_t, outer_t, /* pre_f */ [&output_word, name_for_type_die](
 				iterator_df<type_die> t, iterator_df<program_element_die> reason) {
-				debug(2) << "Pre-walking ";
-				t.print(debug(2), 0); debug(2) << std::endl;
+				if (debug_enabled(2))
+				{
+					debug(2) << "Pre-walking ";
+					t.print(debug(2), 0); debug(2) << std::endl;
+				}
 				// don't want concrete_t to be defined for most of this function...
 				{
 					auto concrete_t = t ? t->get_concrete_type() : t;
@@ -1717,9 +1714,12 @@ namespace dwarf
 				 * */
 				if (reason && (reason.is_a<data_member_die>()))
 				{
-					debug(2) << "This type is walked for reason of a member: ";
-					reason.print(debug(2), 0);
-					debug(2) << std::endl;
+					if (debug_enabled(2))
+					{
+						debug(2) << "This type is walked for reason of a member: ";
+						reason.print(debug(2), 0);
+						debug(2) << std::endl;
+					}
 					// skip members that are mere declarations 
 					if (reason->get_declaration() && *reason->get_declaration()) return false;
 
@@ -1872,8 +1872,11 @@ namespace dwarf
 			},
 			/* post_f */ [&output_word](
 				iterator_df<type_die> t, iterator_df<program_element_die> reason) -> void {
-				debug(2) << "Post-walking ";
-				t.print(debug(2), 0); debug(2) << std::endl;
+				if (debug_enabled(2))
+				{
+					debug(2) << "Post-walking ";
+					t.print(debug(2), 0); debug(2) << std::endl;
+				}
 				if (t && t != t->get_concrete_type()) return;
 				if (t.is_a<type_describing_subprogram_die>())
 				{
@@ -1904,22 +1907,33 @@ namespace dwarf
 				assert (!t || !(output_word.val) || *output_word.val != 0);
 			}
 			); /* end call to walk_type */
-			debug(2) << "Finished walk" << std::endl;
+			debug_expensive(2, << "Finished walk" << std::endl);
 			code_to_return = output_word.val; 
 		out:
 			//get_root().type_summary_code_cache.insert(
 			//	make_pair(get_offset(), code_to_return)
 			//);
-			debug(2) << "Got summary code: ";
-			if (code_to_return) debug(2) << std::hex << *code_to_return << std::dec;
-			else debug(2) << "(no code)";
-			debug(2) << endl;
+			if (debug_enabled(2))
+			{
+				debug(2) << "Got summary code: ";
+				if (code_to_return) debug(2) << std::hex << *code_to_return << std::dec;
+				else debug(2) << "(no code)";
+				debug(2) << endl;
+			}
+			get_root().note_type_cached();
 			this->cached_summary_code = code_to_return;
 			return code_to_return;
 		}
 		opt<uint32_t> type_die::summary_code() const
 		{
 			if (this->cached_summary_code) return this->cached_summary_code;
+			/* compute_all_type_summaries() may have done the work already. */
+			auto found_cached = get_root().type_summary_code_cache.find(get_offset());
+			if (found_cached != get_root().type_summary_code_cache.end())
+			{
+				this->cached_summary_code = found_cached->second;
+				return found_cached->second;
+			}
 			//return this->summary_code_using_walk_type();
 			// return this->combined_summary_code_using_iterators<uint32_t>();
 			
@@ -2058,6 +2072,7 @@ namespace dwarf
 					return summary_code_for_type(arg);
 				}
 			);
+			get_root().note_type_cached();
 			this->cached_summary_code = computed;
 			return computed;
 		}
@@ -2400,7 +2415,7 @@ namespace dwarf
 								switch (colour_of(i_succ))
 								{
 									case WHITE:
-										debug(5) << "Edge target is white" << std::endl;
+										debug_expensive(5, << "Edge target is white" << std::endl);
 										// okay -- we move here
 										// next increment() will recursively search
 										this->base_reference() = std::move(i_succ);
@@ -2410,7 +2425,7 @@ namespace dwarf
 										return;
 									case GREY:
 									case BLACK:
-										debug(5) << "Edge target is grey or black" << std::endl;
+										debug_expensive(5, << "Edge target is grey or black" << std::endl);
 										// we got some other node w
 										// "if w has not yet been assigned..."
 										if (component_numbers.find(i_succ)
@@ -2434,7 +2449,7 @@ namespace dwarf
 							debug_expensive(5, << "Exhausted children of "
 									<< base().summary() << "; stack is: ");
 							print_stack();
-							debug(5) << std::endl;
+							debug_expensive(5, << std::endl);
 							// if we got here, we exhausted the children so we're onto step 4
 							if (perhaps_same_scc.back() == base())
 							{
@@ -2481,8 +2496,8 @@ namespace dwarf
 					<< "; reason: " << i_white.reason().summary() << "; stack is: ");
 				i_white.print_stack();
 			}
-			debug(5) << "Explored all reachable nodes. Total SCCs: "
-				<< i_white.component_count << std::endl;
+			debug_expensive(5, << "Explored all reachable nodes. Total SCCs: "
+				<< i_white.component_count << std::endl);
 
 			/* We've now built a load of SCCs. */
 			std::vector< shared_ptr<type_scc_t> > created_sccs;
@@ -2547,6 +2562,7 @@ namespace dwarf
 			}
 
 			/* Install the SCCs in the relevant type DIEs. */
+			get_root().note_type_cached();
 			for (unsigned i = 0; i < i_white.component_count; ++i)
 			{
 				auto types = i_white.component_members.equal_range(i);
@@ -2586,7 +2602,7 @@ namespace dwarf
 						<< std::endl);
 				}
 			}
-			debug(5) << "Finished installing SCCs" << std::endl;
+			debug_expensive(5, << "Finished installing SCCs" << std::endl);
 
 			if (this->opt_cached_scc && *this->opt_cached_scc)
 			{
@@ -2602,11 +2618,53 @@ namespace dwarf
 			
 			return t.tag_here() == get_tag(); // will be refined in subclasses
 		}
+		Dwarf_Off root_die::type_equality_memo::rep(Dwarf_Off off) const
+		{
+			for (auto found = parent.find(off); found != parent.end(); found = parent.find(off))
+			{
+				off = found->second;
+			}
+			return off;
+		}
+		void root_die::type_equality_memo::unite(Dwarf_Off a, Dwarf_Off b)
+		{
+			Dwarf_Off ra = rep(a);
+			Dwarf_Off rb = rep(b);
+			if (ra == rb) return;
+			// the lower offset is the representative; point everything on both paths at it
+			Dwarf_Off new_rep = std::min(ra, rb);
+			Dwarf_Off starts[] = { a, b };
+			for (unsigned i = 0; i < 2; ++i)
+			{
+				Dwarf_Off off = starts[i];
+				while (off != new_rep)
+				{
+					auto found = parent.find(off);
+					Dwarf_Off next = (found == parent.end()) ? new_rep : found->second;
+					parent[off] = new_rep;
+					off = next;
+				}
+			}
+		}
+		bool root_die::type_equality_memo::is_assumed(Dwarf_Off a, Dwarf_Off b) const
+		{
+			// the stack is only as deep as the nesting of the types under test
+			return std::find(assumed.begin(), assumed.end(), ordered(a, b)) != assumed.end();
+		}
+		static set<pair< iterator_df<type_die>, iterator_df<type_die> > >
+		flip_assumptions(const set< pair< iterator_df<type_die>, iterator_df<type_die> > >& assuming_equal)
+		{
+			set<pair< iterator_df<type_die>, iterator_df<type_die> > > flipped_set;
+			for (auto i_pair = assuming_equal.begin(); i_pair != assuming_equal.end(); ++i_pair)
+			{
+				flipped_set.insert(make_pair(i_pair->second, i_pair->first));
+			}
+			return flipped_set;
+		}
 		bool type_die::equal(iterator_df<type_die> t, 
 			const set< pair< iterator_df<type_die>, iterator_df<type_die> > >& assuming_equal
 			) const
 		{
-			set<pair< iterator_df<type_die>, iterator_df<type_die> > > flipped_set;
 			auto& r = get_root();
 			auto self = find_self();
 			
@@ -2617,43 +2675,51 @@ namespace dwarf
 			{
 				return true;
 			}
-			/* If the two iterators share a root, check the cache */
-			if (t && &t.root() == &self.root())
+			/* If the two iterators share a root, use its memo table. A frozen
+			 * root's table is read-only, so there we can only test afresh. */
+			bool use_memo = t && &t.root() == &r;
+			Dwarf_Off self_off = self.offset_here();
+			Dwarf_Off t_off = use_memo ? t.offset_here() : 0;
+			auto& m = r.type_equality;
+			if (use_memo)
 			{
-				auto found_seq = self.root().equal_to.equal_range(t.offset_here());
-				for (auto i_found = found_seq.first; i_found != found_seq.second; ++i_found)
-				{
-					if (i_found->second.first == self.offset_here())
-					{
-						return i_found->second.second;
-					}
-				}
+				Dwarf_Off self_rep = m.rep(self_off);
+				Dwarf_Off t_rep = m.rep(t_off);
+				if (self_rep == t_rep) return true;
+				if (m.unequal.find(m.ordered(self_rep, t_rep)) != m.unequal.end()) return false;
+				if (m.is_assumed(self_off, t_off)) return true;
+				use_memo = !r.is_frozen();
 			}
-			// we have to find t
-			bool ret;
-			bool t_may_equal_self;
-			bool self_may_equal_t = this->may_equal(t, assuming_equal);
-			if (!self_may_equal_t) { ret = false; goto out; }
+			unsigned provisional_mark = m.provisional.size();
 			
-			// we need to flip our set of pairs
-			for (auto i_pair = assuming_equal.begin(); i_pair != assuming_equal.end(); ++i_pair)
-			{
-				flipped_set.insert(make_pair(i_pair->second, i_pair->first));
-			}
+			// we have to test both ways round, so we need to flip our set of pairs
+			bool ret = this->may_equal(t, assuming_equal)
+				&& t->may_equal(self, assuming_equal.empty() ? assuming_equal
+					: flip_assumptions(assuming_equal));
 			
-			t_may_equal_self = t->may_equal(self, flipped_set);
-			if (!t_may_equal_self) { ret = false; goto out; }
-			ret = true;
-			// if we're unequal then we should not be the same DIE (equality is reflexive)
-		out:
 			/* If we're returning false, we'd better not be the same DIE. */
 			assert(ret || !t || 
 				!(&t.get_root() == &self.get_root() && t.offset_here() == self.offset_here()));
-			/* If the two iterators share a root, cache the result */
-			if (t && &t.root() == &self.root())
+			if (use_memo)
 			{
-				self.root().equal_to.insert(make_pair(self.offset_here(), make_pair(t.offset_here(), ret)));
-				self.root().equal_to.insert(make_pair(t.offset_here(), make_pair(self.offset_here(), ret)));
+				if (!ret)
+				{
+					/* Adding assumptions can only make more things equal, so
+					 * "unequal" holds regardless of what's assumed. But anything
+					 * proven equal beneath us may have relied on us being equal. */
+					m.provisional.resize(provisional_mark);
+					m.unequal.insert(m.ordered(m.rep(self_off), m.rep(t_off)));
+				}
+				else if (m.assumed.empty())
+				{
+					for (auto i_p = m.provisional.begin(); i_p != m.provisional.end(); ++i_p)
+					{
+						m.unite(i_p->first, i_p->second);
+					}
+					m.provisional.clear();
+					m.unite(self_off, t_off);
+				}
+				else m.provisional.push_back(m.ordered(self_off, t_off));
 			}
 			
 			return ret;
@@ -2765,8 +2831,8 @@ namespace dwarf
 		{
 			if (!t) return false;
 			
-			debug(2) << "Testing ptr_to_member_type_die::may_equal(" << this->summary() << ", " << t->summary() << ")"
-				<< " assuming " << assuming_equal.size() << " pairs equal" << endl;
+			debug_expensive(2, << "Testing ptr_to_member_type_die::may_equal(" << this->summary() << ", " << t->summary() << ")"
+				<< " assuming " << assuming_equal.size() << " pairs equal" << endl);
 			
 			auto other_t = t->get_concrete_type();
 			auto other_t_as_pmem = other_t.as_a<ptr_to_member_type_die>();
@@ -2784,8 +2850,8 @@ namespace dwarf
 		{
 			if (!t) return false;
 			
-			debug(2) << "Testing array_type_die::may_equal(" << this->summary() << ", " << t->summary() << ")"
-				<< " assuming " << assuming_equal.size() << " pairs equal" << endl;
+			debug_expensive(2, << "Testing array_type_die::may_equal(" << this->summary() << ", " << t->summary() << ")"
+				<< " assuming " << assuming_equal.size() << " pairs equal" << endl);
 			
 			if (get_tag() != t.tag_here()) return false;
 			if (get_name() != t.name_here()) return false;
@@ -2859,8 +2925,8 @@ namespace dwarf
 		{
 			if (!t) return false;
 			
-			debug(2) << "Testing string_type_die::may_equal(" << this->summary() << ", " << t->summary() << ")"
-				<< " assuming " << assuming_equal.size() << " pairs equal" << endl;
+			debug_expensive(2, << "Testing string_type_die::may_equal(" << this->summary() << ", " << t->summary() << ")"
+				<< " assuming " << assuming_equal.size() << " pairs equal" << endl);
 			
 			if (get_tag() != t.tag_here()) return false;
 			if (get_name() != t.name_here()) return false;
@@ -2897,8 +2963,8 @@ namespace dwarf
 		bool subrange_type_die::may_equal(iterator_df<type_die> t, const set< pair< iterator_df<type_die>, iterator_df<type_die> > >& assuming_equal) const
 		{
 			if (!t) return false;
-			debug(2) << "Testing subrange_type_die::may_equal(" << this->summary() << ", " << t->summary() << ")"
-				<< " assuming " << assuming_equal.size() << " pairs equal" << endl;
+			debug_expensive(2, << "Testing subrange_type_die::may_equal(" << this->summary() << ", " << t->summary() << ")"
+				<< " assuming " << assuming_equal.size() << " pairs equal" << endl);
 			
 			if (get_tag() != t.tag_here()) return false;
 			
@@ -2930,8 +2996,8 @@ namespace dwarf
 		bool enumeration_type_die::may_equal(iterator_df<type_die> t, const set< pair< iterator_df<type_die>, iterator_df<type_die> > >& assuming_equal) const
 		{
 			if (!t) return false;
-			debug(2) << "Testing enumeration_type_die::may_equal(" << this->summary() << ", " << t->summary() << ")"
-				<< " assuming " << assuming_equal.size() << " pairs equal" << endl;
+			debug_expensive(2, << "Testing enumeration_type_die::may_equal(" << this->summary() << ", " << t->summary() << ")"
+				<< " assuming " << assuming_equal.size() << " pairs equal" << endl);
 			
 			if (get_tag() != t.tag_here()) return false;
 			
@@ -2990,20 +3056,20 @@ namespace dwarf
 				auto to_return = next_type->calculate_byte_size();
 				if (!to_return)
 				{
-					debug(2) << "Type chain concrete type " << *get_concrete_type()
-						<< " returned no byte size" << endl;
+					debug_expensive(2, << "Type chain concrete type " << *get_concrete_type()
+						<< " returned no byte size" << endl);
 				}
 				return to_return;
 			}
 			else
 			{
-				debug(2) << "Type with no concrete type: " << *this << endl;
+				debug_expensive(2, << "Type with no concrete type: " << *this << endl);
 				return opt<Dwarf_Unsigned>();
 			}
 		}
 		bool type_chain_die::may_equal(iterator_df<type_die> t, const set< pair< iterator_df<type_die>, iterator_df<type_die> > >& assuming_equal) const
 		{
-			debug(2) << "Testing type_chain_die::may_equal() (default case)" << endl;
+			debug_expensive(2, << "Testing type_chain_die::may_equal() (default case)" << endl);
 			
 			return get_tag() == t.tag_here() && 
 				(
@@ -3024,7 +3090,7 @@ namespace dwarf
 			if (!opt_next_type) return iterator_base::END; // a.k.a. None
 			if (!get_spec(r).tag_is_type(opt_next_type.tag_here()))
 			{
-				debug(2) << "Warning: following type chain found non-type " << opt_next_type << endl;
+				debug_expensive(2, << "Warning: following type chain found non-type " << opt_next_type << endl);
 				return find_self();
 			} 
 			else return opt_next_type->get_concrete_type();
@@ -3187,8 +3253,8 @@ namespace dwarf
 		bool with_data_members_die::may_equal(iterator_df<type_die> t, const set< pair< iterator_df<type_die>, iterator_df<type_die> > >& assuming_equal) const
 		{
 			if (!t) return false;
-			debug(2) << "Testing with_data_members_die::may_equal(" << this->summary() << ", " << t->summary() << ")"
-				<< " assuming " << assuming_equal.size() << " pairs equal" << endl;
+			debug_expensive(2, << "Testing with_data_members_die::may_equal(" << this->summary() << ", " << t->summary() << ")"
+				<< " assuming " << assuming_equal.size() << " pairs equal" << endl);
 			
 			if (get_tag() != t.tag_here()) return false;
 			
@@ -3201,6 +3267,26 @@ namespace dwarf
 			
 			/* Another GAH: recursive structures. What to do about them? */
 			
+			/* Don't recursively begin the test we're already doing. Within a
+			 * (non-frozen) root, the root keeps a stack of the pairs under test;
+			 * otherwise we have to pass down a copy of our assumptions plus us. */
+			root_die& r = get_root();
+			struct assumption_guard
+			{
+				root_die::type_equality_memo *p_memo;
+				~assumption_guard() { if (p_memo) p_memo->assumed.pop_back(); }
+			} guard = { (&t.root() == &r && !r.is_frozen()) ? &r.type_equality : nullptr };
+			set< pair< iterator_df<type_die>, iterator_df<type_die> > > copied_test_set;
+			if (guard.p_memo) guard.p_memo->assumed.push_back(
+				root_die::type_equality_memo::ordered(get_offset(), t.offset_here()));
+			else
+			{
+				copied_test_set = assuming_equal;
+				copied_test_set.insert(make_pair(find_self().as_a<type_die>(), t));
+			}
+			const set< pair< iterator_df<type_die>, iterator_df<type_die> > >& recursive_test_set
+			 = guard.p_memo ? assuming_equal : copied_test_set;
+			
 			auto our_member_children = children().subseq_of<member_die>();
 			auto their_member_children = t->children().subseq_of<member_die>();
 			auto i_theirs = their_member_children.first;
@@ -3210,12 +3296,6 @@ namespace dwarf
 				// if they have fewer, we're unequal
 				if (i_theirs == their_member_children.second) return false;
 				
-				auto this_test_pair = make_pair(
-					find_self().as_a<type_die>(),
-					t
-				);
-				auto recursive_test_set = assuming_equal; recursive_test_set.insert(this_test_pair);
-				
 				bool types_equal = 
 				// presence equal
 					(!i_memb->get_type() == !i_theirs->get_type())
@@ -3256,7 +3336,7 @@ namespace dwarf
 			// if we have a cached result, use that
 			if (this->maybe_cached_definition) return *maybe_cached_definition;
 			
-			debug(2) << "Looking for definition of declaration " << summary() << endl;
+			debug_expensive(2, << "Looking for definition of declaration " << summary() << endl);
 			
 			// if we don't have a name, we have no way to proceed
 			auto opt_name = get_name(/*r*/);
@@ -3285,8 +3365,9 @@ namespace dwarf
 				   
 				
 				*/
-				if (iter.depth() != 2) goto return_no_result;
+				if (iter.depth() != 2) goto use_type_names;
 
+				{
 				iterator_sibs<with_data_members_die> i_sib = iter; ++i_sib;/* i.e. don't check ourselves */; 
 				for (; i_sib != iterator_base::END; ++i_sib)
 				{
@@ -3296,15 +3377,33 @@ namespace dwarf
 						&& (opt_decl_flag = i_sib->get_declaration(), 
 							!opt_decl_flag || !*opt_decl_flag))
 					{
-						debug(2) << "Found definition " << i_sib->summary() << endl;
+						debug_expensive(2, << "Found definition " << i_sib->summary() << endl);
 						this->maybe_cached_definition = i_sib;
+						r.note_definition_sought(get_offset(), my_name, i_sib);
 						return i_sib;
 					}
 				}
+				}
+			use_type_names:
+				/* Not in our CU, or not at top level, so ask the root-wide
+				 * index, which also knows about nested and namespaced ones. */
+				string qualified_name = r.qualified_type_name(iter);
+				if (qualified_name.empty()) goto return_no_result;
+				iterator_base found = r.type_named(get_tag(), qualified_name);
+				if (found && found.is_a<with_data_members_die>()
+					&& !found.has_attr(DW_AT_declaration))
+				{
+					debug_expensive(2, << "Found definition " << found.summary() << " by qualified name" << endl);
+					this->maybe_cached_definition = found;
+					r.note_definition_sought(get_offset(), my_name, found);
+					return found;
+				}
 			}
 		return_no_result:
-			debug(2) << "Failed to find definition of declaration " << summary() << endl;
+			debug_expensive(2, << "Failed to find definition of declaration " << summary() << endl);
 			this->maybe_cached_definition = iterator_base::END;
+			if (opt_name) r.note_definition_sought(get_offset(), *opt_name, iterator_base::END);
+			else r.note_type_cached();
 			return iterator_base::END;
 		}
 
@@ -3611,7 +3710,7 @@ namespace dwarf
 					Dwarf_Unsigned byte_size = *opt_byte_size;
 					if (byte_size == 0)
 					{
-						debug(2) << "Zero-length object: " << summary() << endl;
+						debug_expensive(2, << "Zero-length object: " << summary() << endl);
 						goto out;
 					}
 					
@@ -3625,9 +3724,9 @@ namespace dwarf
 					{
 						if (loclist.size() > 0)
 						{
-							debug(2) << "Vaddr-dependent static location " << *this << endl;
+							debug_expensive(2, << "Vaddr-dependent static location " << *this << endl);
 						}
-						else debug(2) << "Static var with no location: " << *this << endl;
+						else debug_expensive(2, << "Static var with no location: " << *this << endl);
 						//if (loclist.size() > 0)
 						//{
 						//	expr_pieces = loclist.begin()->pieces();
@@ -3693,7 +3792,7 @@ namespace dwarf
 
 			}
 		out:
-			debug(6) << "Intervals of " << this->summary() << ": " << retval << endl;
+			debug_expensive(6, << "Intervals of " << this->summary() << ": " << retval << endl);
 			return retval;
 		}
 
@@ -3854,7 +3953,7 @@ namespace dwarf
 			auto frame_base_loclist = *get_frame_base();
 			iterator_df<compile_unit_die> enclosing_cu
 			 = r.cu_pos(i.enclosing_cu_offset_here());
-			debug(2) << "Enclosing CU is " << enclosing_cu->summary() << endl;
+			debug_expensive(2, << "Enclosing CU is " << enclosing_cu->summary() << endl);
 			Dwarf_Addr low_pc = enclosing_cu->get_low_pc()->addr;
 			assert(low_pc <= dieset_relative_ip);
 			Dwarf_Addr vaddr = dieset_relative_ip - low_pc;
@@ -3866,38 +3965,176 @@ namespace dwarf
 				p_regs).tos();
 			if (out_frame_base) *out_frame_base = frame_base_addr;
 			
-			auto child = r.first_child(i);
-			if (child == iterator_base::END) return return_type();
-			/* Now we walk children
-			 * (not just immediate children, because more might hide under lexical_blocks), 
-			 * looking for with_dynamic_location_dies, and 
-			 * call spans_addr on what we find.
-			 * We skip contained DIEs that do not contain objects located in this frame. 
-			 */
-			frame_subobject_iterator start_iter(child);
-			debug(2) << "Exploring stack-located children of " << summary() << std::endl;
-			unsigned initial_depth = start_iter.depth();
-			for (auto i_bfs = start_iter;
-					i_bfs.depth() >= initial_depth;
-					++i_bfs)
+			/* The index has most of our locals and args; the ones it
+			 * couldn't take, we ask one by one, but only those that come
+			 * before its answer in the walk, since the first that spans wins. */
+			shared_ptr<const frame_locals_index> p_index = r.frame_locals(i);
+			assert(p_index);
+			Dwarf_Signed frame_offset = (Dwarf_Signed) absolute_addr - frame_base_addr;
+			const frame_locals_index::slot *p_slot = p_index->find(vaddr, frame_offset);
+			for (auto i_other = p_index->others.begin(); i_other != p_index->others.end()
+				&& (!p_slot || i_other->first < p_slot->order); ++i_other)
 			{
-				debug(2) << "Considering whether DIE has stack location: " 
-					<< i_bfs->summary() << std::endl;
-				auto with_stack_loc = dynamic_cast<with_dynamic_location_die*>(&i_bfs.dereference());
-				if (!with_stack_loc) continue;
-				
-				opt<Dwarf_Off> result = with_stack_loc->spans_addr(absolute_addr,
+				iterator_df<with_dynamic_location_die> i_var = r.pos(i_other->second);
+				debug_expensive(2, << "Asking unindexed DIE whether it spans the address: " 
+					<< i_var->summary() << std::endl);
+				opt<Dwarf_Off> result = i_var->spans_addr(absolute_addr,
 					frame_base_addr,
 					r, 
 					dieset_relative_ip,
 					p_regs);
-				if (result) return make_pair(
-					*result, 
-					iterator_df<with_dynamic_location_die>(i_bfs)
-				);
+				if (result) return make_pair(*result, i_var);
 			}
+			if (p_slot) return make_pair(
+				(Dwarf_Off) (frame_offset - p_slot->lo),
+				iterator_df<with_dynamic_location_die>(r.pos(p_slot->var))
+			);
 			return return_type();
 		}
+/* for subprogram_die::spans_addr_in_frame_locals_or_args */
+		shared_ptr<const frame_locals_index>
+		root_die::frame_locals(const iterator_base& subprogram)
+		{
+			if (subprogram.tag_here() != DW_TAG_subprogram) return shared_ptr<const frame_locals_index>();
+			auto found = frame_locals_of.find(subprogram.offset_here());
+			DWARFPP_STAT_HIT(*this, found != frame_locals_of.end(), frame_locals);
+			if (found != frame_locals_of.end()) return found->second;
+
+			auto p_index = std::make_shared<frame_locals_index>();
+			struct located_slot
+			{
+				Dwarf_Addr lo;
+				Dwarf_Addr hi;
+				frame_locals_index::slot s;
+			};
+			vector<located_slot> located;
+			auto child = first_child(subprogram);
+			if (child != iterator_base::END)
+			{
+				/* Walk children
+				 * (not just immediate children, because more might hide under lexical_blocks), 
+				 * looking for with_dynamic_location_dies.
+				 * We skip contained DIEs that do not contain objects located in this frame. 
+				 */
+				frame_subobject_iterator start_iter(child);
+				unsigned initial_depth = start_iter.depth();
+				unsigned order = 0;
+				for (auto i_bfs = start_iter;
+						i_bfs.depth() >= initial_depth;
+						++i_bfs)
+				{
+					auto with_stack_loc = dynamic_cast<with_dynamic_location_die*>(&i_bfs.dereference());
+					if (!with_stack_loc) continue;
+					unsigned this_order = order++;
+					Dwarf_Off off = i_bfs.offset_here();
+					if (with_stack_loc->location_requires_object_base())
+					{
+						p_index->others.push_back(make_pair(this_order, off));
+						continue;
+					}
+					auto compiled = with_stack_loc->get_compiled_location();
+					/* No location means it spans nothing. */
+					if (!compiled) continue;
+					// we only want the type, so don't build the whole attribute map
+					encap::attribute_value v_type = with_stack_loc->find_attr(DW_AT_type);
+					opt<Dwarf_Unsigned> size;
+					if (v_type.is_ref()) size = v_type.get_refiter_is_type()->calculate_byte_size();
+					bool all_fbreg = !compiled->entries.empty();
+					for (auto i_e = compiled->entries.begin(); i_e != compiled->entries.end(); ++i_e)
+					{
+						if (i_e->expr.kind != expr::compiled_expr::FBREG) { all_fbreg = false; break; }
+					}
+					if (!size || !all_fbreg)
+					{
+						p_index->others.push_back(make_pair(this_order, off));
+						continue;
+					}
+					for (auto i_e = compiled->entries.begin(); i_e != compiled->entries.end(); ++i_e)
+					{
+						if (i_e->lo >= i_e->hi) continue;
+						located.push_back((located_slot) {
+							.lo = i_e->lo,
+							.hi = i_e->hi,
+							.s = (frame_locals_index::slot) {
+								.lo = i_e->expr.offset,
+								.size = *size,
+								.order = this_order,
+								.var = off
+							}
+						});
+					}
+				}
+			}
+
+			/* Each pair of adjacent range bounds is an interval on which
+			 * the same slots are live. */
+			vector<Dwarf_Addr>& starts = p_index->starts;
+			for (auto i_l = located.begin(); i_l != located.end(); ++i_l)
+			{
+				starts.push_back(i_l->lo);
+				starts.push_back(i_l->hi);
+			}
+			std::sort(starts.begin(), starts.end());
+			starts.erase(std::unique(starts.begin(), starts.end()), starts.end());
+			for (unsigned k = 0; k + 1 < starts.size(); ++k)
+			{
+				unsigned first = p_index->slots.size();
+				p_index->first_slot.push_back(first);
+				Dwarf_Unsigned max_size = 0;
+				for (auto i_l = located.begin(); i_l != located.end(); ++i_l)
+				{
+					if (i_l->lo > starts[k] || i_l->hi < starts[k + 1]) continue;
+					p_index->slots.push_back(i_l->s);
+					max_size = std::max(max_size, i_l->s.size);
+				}
+				std::sort(p_index->slots.begin() + first, p_index->slots.end(),
+					[](const frame_locals_index::slot& a, const frame_locals_index::slot& b) {
+						return a.lo < b.lo;
+					});
+				p_index->max_size.push_back(max_size);
+			}
+			p_index->first_slot.push_back(p_index->slots.size());
+			debug_expensive(2, << "Indexed " << p_index->slots.size() << " frame slots in "
+				<< p_index->max_size.size() << " intervals, leaving " << p_index->others.size()
+				<< " locals unindexed, for " << subprogram.summary() << endl);
+			if (!frozen)
+			{
+				cache_frame_locals(subprogram.offset_here(), p_index);
+				note_cache_growth(subprogram.offset_here());
+			}
+			return p_index;
+		}
+		const frame_locals_index::slot *
+		frame_locals_index::find(Dwarf_Addr vaddr, Dwarf_Signed frame_offset) const
+		{
+			auto i_start = std::upper_bound(starts.begin(), starts.end(), vaddr);
+			if (i_start == starts.begin() || i_start == starts.end()) return nullptr;
+			unsigned k = (i_start - starts.begin()) - 1;
+			auto begin = slots.begin() + first_slot[k];
+			auto end = slots.begin() + first_slot[k + 1];
+			/* Walk down from the highest slot starting at or below
+			 * frame_offset, until no slot that low could reach it. */
+			auto i_slot = std::upper_bound(begin, end, frame_offset,
+				[](Dwarf_Signed off, const slot& s) { return off < s.lo; });
+			const slot *p_best = nullptr;
+			while (i_slot != begin)
+			{
+				--i_slot;
+				Dwarf_Unsigned gap = (Dwarf_Unsigned) (frame_offset - i_slot->lo);
+				if (gap >= max_size[k]) break;
+				if (gap < i_slot->size && (!p_best || i_slot->order < p_best->order)) p_best = &*i_slot;
+			}
+			return p_best;
+		}
+		size_t frame_locals_index::bytes() const
+		{
+			return sizeof *this
+				+ starts.capacity() * sizeof (Dwarf_Addr)
+				+ first_slot.capacity() * sizeof (unsigned)
+				+ max_size.capacity() * sizeof (Dwarf_Unsigned)
+				+ slots.capacity() * sizeof (slot)
+				+ others.capacity() * sizeof (std::pair<unsigned, Dwarf_Off>);
+		}
 		iterator_df<type_die> subprogram_die::get_return_type() const
 		{
 			return get_type(); 
@@ -3914,8 +4151,8 @@ namespace dwarf
 		bool type_describing_subprogram_die::may_equal(iterator_df<type_die> t, const set< pair< iterator_df<type_die>, iterator_df<type_die> > >& assuming_equal) const
 		{
 			if (!t) return false;
-			debug(2) << "Testing type_describing_subprogram_die::may_equal(" << this->summary() << ", " << t->summary() << ")"
-				<< " assuming " << assuming_equal.size() << " pairs equal" << endl;
+			debug_expensive(2, << "Testing type_describing_subprogram_die::may_equal(" << this->summary() << ", " << t->summary() << ")"
+				<< " assuming " << assuming_equal.size() << " pairs equal" << endl);
 			
 			if (get_tag() != t.tag_here()) return false;
 			
@@ -4014,8 +4251,8 @@ namespace dwarf
 			auto attrs = find_all_attrs();
 			if (attrs.find(DW_AT_location) == attrs.end())
 			{
-				debug(2) << "Warning: " << this->summary() << " has no DW_AT_location; "
-					<< "assuming it does not cover any stack locations." << endl;
+				debug_expensive(2, << "Warning: " << this->summary() << " has no DW_AT_location; "
+					<< "assuming it does not cover any stack locations." << endl);
 				return opt<Dwarf_Off>();
 			}
 			auto base_addr = calculate_addr_on_stack(
@@ -4023,13 +4260,13 @@ namespace dwarf
 				r, 
 				dieset_relative_ip,
 				p_regs);
-			debug(2) << "Calculated that an instance of DIE" << summary()
-				<< " has base addr 0x" << std::hex << base_addr << std::dec;
+			debug_expensive(2, << "Calculated that an instance of DIE" << summary()
+				<< " has base addr 0x" << std::hex << base_addr << std::dec);
 			assert(attrs.find(DW_AT_type) != attrs.end());
 			auto size = *(attrs.find(DW_AT_type)->second.get_refiter_is_type()->calculate_byte_size());
-			debug(2) << " and size " << size
+			debug_expensive(2, << " and size " << size
 				<< ", to be tested against absolute addr 0x"
-				<< std::hex << absolute_addr << std::dec << std::endl;
+				<< std::hex << absolute_addr << std::dec << std::endl);
 			if (absolute_addr >= base_addr
 			&&  absolute_addr < base_addr + size)
 			{
@@ -4076,11 +4313,12 @@ namespace dwarf
 					Dwarf_Off dieset_relative_ip,
 					expr::regs *p_regs) const
 		{
-			auto attrs = find_all_attrs();
 			auto base_addr = calculate_addr_in_object(
 				object_base_addr, r, dieset_relative_ip, p_regs);
-			assert(attrs.find(DW_AT_type) != attrs.end());
-			auto size = *(attrs.find(DW_AT_type)->second.get_refiter_is_type()->calculate_byte_size());
+			// we only want the type, so don't build the whole attribute map
+			encap::attribute_value v_type = find_attr(DW_AT_type);
+			assert(v_type.is_ref());
+			auto size = *(v_type.get_refiter_is_type()->calculate_byte_size());
 			if (absolute_addr >= base_addr
 			&&  absolute_addr < base_addr + size)
 			{
@@ -4128,8 +4366,8 @@ namespace dwarf
 			/* Just do find_type if we don't have the bitfield attributes. */
 			if (!get_bit_size() && !get_bit_offset() && !get_data_bit_offset()) return find_type();
 
-			debug(2) << "Handling bitfield member at 0x" << std::hex << get_offset() << std::dec
-				<< std::endl;
+			debug_expensive(2, << "Handling bitfield member at 0x" << std::hex << get_offset() << std::dec
+				<< std::endl);
 			
 			opt<Dwarf_Unsigned> opt_bsz = get_bit_size();
 			opt<Dwarf_Unsigned> opt_boff = get_bit_offset();
@@ -4196,7 +4434,7 @@ namespace dwarf
 					encap::attribute_value v_byte_size(effective_byte_size);
 					attrs.insert(make_pair(DW_AT_byte_size, v_byte_size));
 					// debugging
-					get_root().print_tree(std::move(cu), debug(2));
+					if (debug_enabled(2)) get_root().print_tree(std::move(cu), debug(2));
 					return created;
 				}
 				default:
@@ -4215,6 +4453,19 @@ namespace dwarf
 			return opt_location ? *opt_location : encap::loclist();
 		}
 /* from spec::with_dynamic_location_die */
+		shared_ptr<const expr::compiled_loclist>
+		with_dynamic_location_die::get_compiled_location() const
+		{
+			if (cached_compiled_location) return cached_compiled_location;
+			encap::attribute_value v_loc = find_attr(location_requires_object_base()
+				? DW_AT_data_member_location : DW_AT_location);
+			if (!v_loc.is_loclist()) return shared_ptr<const expr::compiled_loclist>();
+			/* Hold the attribute's shared loclist, since we borrow from it. */
+			auto compiled = std::make_shared<const expr::compiled_loclist>(
+				boost::intrusive_ptr<const encap::loclist>(&v_loc.get_loclist()));
+			if (!get_root().is_frozen()) cached_compiled_location = compiled;
+			return compiled;
+		}
 		Dwarf_Addr 
 		with_dynamic_location_die::calculate_addr_on_stack(
 				Dwarf_Addr frame_base_addr,
@@ -4222,9 +4473,6 @@ namespace dwarf
 				Dwarf_Off dieset_relative_ip,
 				expr::regs *p_regs/* = 0*/) const
 		{
-			auto attrs = find_all_attrs();
-			assert(attrs.find(DW_AT_location) != attrs.end());
-			
 			/* We have to find ourselves. Well, almost -- enclosing CU. */
 			auto found = r.cu_pos(get_enclosing_cu_offset());
 			iterator_df<compile_unit_die> i_cu = found;
@@ -4241,6 +4489,27 @@ namespace dwarf
 				throw No_entry();
 			}
 			
+			/* The common shapes don't need rewriting in terms of the CFA.
+			 * A breg does, unless we've been given registers to read: the
+			 * rewrite is what lets it work from the frame base alone. */
+			auto compiled = get_compiled_location();
+			assert(compiled);
+			const expr::compiled_expr *p_expr = compiled->find(
+				dieset_relative_ip - dieset_relative_cu_base_ip);
+			if (!p_expr) throw No_entry();
+			switch (p_expr->kind)
+			{
+				case expr::compiled_expr::BREG:
+					if (!p_regs) break;
+					/* else fall through */
+				case expr::compiled_expr::FBREG:
+				case expr::compiled_expr::ADDR:
+					return (Dwarf_Addr) p_expr->eval(p_regs, opt<Dwarf_Signed>(frame_base_addr));
+				default: break;
+			}
+			
+			auto attrs = find_all_attrs();
+			assert(attrs.find(DW_AT_location) != attrs.end());
 			auto& loclist = attrs.find(DW_AT_location)->second.get_loclist();
 			auto intervals = loclist.intervals();
 			assert(intervals.begin() != intervals.end());
@@ -4255,15 +4524,21 @@ namespace dwarf
 				r.get_frame_section(),
 				fb_loclist
 			);
-			debug(2) << "After rewriting, loclist is " << rewritten_loclist << endl;
+			debug_expensive(2, << "After rewriting, loclist is " << rewritten_loclist << endl);
 			
-			return (Dwarf_Addr) expr::evaluator(
-				rewritten_loclist,
+			expr::compiled_loclist compiled_rewritten(rewritten_loclist);
+			const expr::compiled_expr *p_rewritten = compiled_rewritten.find(
 				dieset_relative_ip // needs to be CU-relative
-				 - dieset_relative_cu_base_ip,
-				found.spec_here(),
-				p_regs,
-				frame_base_addr).tos();
+				 - dieset_relative_cu_base_ip);
+			if (!p_rewritten)
+			{
+				debug(2) << "Vaddr 0x" << std::hex << dieset_relative_ip - dieset_relative_cu_base_ip
+					<< std::dec << " is not covered by any loc expr in " << rewritten_loclist << endl;
+				throw No_entry();
+			}
+			expr::evaluator ev(found.spec_here());
+			return (Dwarf_Addr) p_rewritten->eval(p_regs, opt<Dwarf_Signed>(frame_base_addr),
+				opt<Dwarf_Unsigned>(), &ev);
 		}
 		Dwarf_Addr
 		with_dynamic_location_die::calculate_addr_in_object(
@@ -4272,18 +4547,36 @@ namespace dwarf
 				Dwarf_Off dieset_relative_ip,
 				expr::regs *p_regs /*= 0*/) const
 		{
-			auto attrs = find_all_attrs();
-			iterator_df<compile_unit_die> i_cu = r.cu_pos(get_enclosing_cu_offset());
-			assert(attrs.find(DW_AT_data_member_location) != attrs.end());
-			return (Dwarf_Addr) expr::evaluator(
-				attrs.find(DW_AT_data_member_location)->second.get_loclist(),
-				dieset_relative_ip == 0 ? 0 : // if we specify it, needs to be CU-relative
-				 - (i_cu->get_low_pc() ? 
-				 	i_cu->get_low_pc()->addr : (Dwarf_Addr)0),
-				i_cu.spec_here(), 
-				p_regs,
-				object_base_addr, // ignored
-				std::stack<Dwarf_Unsigned>(std::deque<Dwarf_Unsigned>(1, object_base_addr))).tos();
+			auto compiled = get_compiled_location();
+			assert(compiled);
+			/* Member locations rarely depend on the vaddr, so only pay for
+			 * finding the CU when that one does. */
+			const expr::compiled_expr *p_expr;
+			if (compiled->entries.size() == 1 && compiled->entries[0].lo == 0
+				&& compiled->entries[0].hi == std::numeric_limits<Dwarf_Addr>::max())
+			{
+				p_expr = &compiled->entries[0].expr;
+			}
+			else
+			{
+				iterator_df<compile_unit_die> i_cu = r.cu_pos(get_enclosing_cu_offset());
+				p_expr = compiled->find(
+					dieset_relative_ip == 0 ? 0 : // if we specify it, needs to be CU-relative
+					 - (i_cu->get_low_pc() ? 
+					 	i_cu->get_low_pc()->addr : (Dwarf_Addr)0));
+			}
+			if (!p_expr) throw No_entry();
+			if (p_expr->kind != expr::compiled_expr::GENERAL)
+			{
+				return (Dwarf_Addr) p_expr->eval(p_regs,
+					opt<Dwarf_Signed>(object_base_addr), // ignored
+					opt<Dwarf_Unsigned>(object_base_addr));
+			}
+			/* Only the interpreter needs the CU's spec. */
+			expr::evaluator ev(r.cu_pos(get_enclosing_cu_offset()).spec_here());
+			return (Dwarf_Addr) p_expr->eval(p_regs,
+				opt<Dwarf_Signed>(object_base_addr), // ignored
+				opt<Dwarf_Unsigned>(object_base_addr), &ev);
 		}
 /* from spec::with_named_children_die */
 //         std::shared_ptr<spec::basic_die>
@@ -0,0 +1,70 @@
+/* dwarfpp: C++ binding for a useful subset of libdwarf, plus extra goodies.
+ *
+ * elf-image.cpp: opening ELF files from memory, including our own mappings
+ *
+ * Copyright (c) 2008--17, Stephen Kell. For licensing information, see the
+ * LICENSE file in the root of the libdwarfpp tree.
+ */
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "dwarfpp/root.hpp"
+#include "dwarfpp/section-loader.hpp"
+
+namespace dwarf
+{
+	using std::endl;
+	namespace core
+	{
+		shared_ptr<elf_image> elf_image::map(int fd)
+		{
+			struct stat s;
+			if (fd == -1 || 0 != fstat(fd, &s) || s.st_size <= 0) return shared_ptr<elf_image>();
+			void *ret = mmap(nullptr, s.st_size, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
+			if (ret == MAP_FAILED)
+			{
+				debug(1) << "Could not map ELF file (fd " << fd << "); will copy sections" << endl;
+				return shared_ptr<elf_image>();
+			}
+			return shared_ptr<elf_image>(new elf_image(static_cast<const char *>(ret), s.st_size, true));
+		}
+
+		shared_ptr<elf_image> elf_image::borrow(const void *data, size_t size)
+		{
+			return shared_ptr<elf_image>(new elf_image(static_cast<const char *>(data), size, false));
+		}
+
+		elf_image::~elf_image()
+		{
+			if (mapped) munmap(const_cast<char *>(data), size);
+		}
+
+		::Elf *elf_image::open_elf() const
+		{
+			/* dwarf_init() does this for us, but we're bypassing it. */
+			if (elf_version(EV_CURRENT) == EV_NONE) return nullptr;
+			/* libelf wants a writable image; see the comment in root.hpp. */
+			return elf_memory(const_cast<char *>(data), size);
+		}
+
+		root_die::image_handle::image_handle(shared_ptr<const elf_image> image,
+			const string& section_cache_dir)
+		 : image(image), elf(image ? image->open_elf() : nullptr)
+		{
+			if (image && !elf) debug(1) << "libelf could not open ELF image" << endl;
+			/* We still want the Elf handle, for FrameSection and the like. */
+			if (elf && section_loader::can_load(*image))
+			{
+				loader = std::make_shared<section_loader>(image, section_cache_dir);
+				if (loader->get_sections().empty()) loader.reset();
+			}
+		}
+
+		root_die::image_handle::~image_handle()
+		{
+			if (elf) elf_end(elf);
+		}
+	}
+}
@@ -0,0 +1,132 @@
+/* dwarfpp: C++ binding for a useful subset of libdwarf, plus extra goodies.
+ *
+ * extract.cpp: extracting chosen attributes of many DIEs as columns
+ *
+ * Copyright (c) 2008--17, Stephen Kell. For licensing information, see the
+ * LICENSE file in the root of the libdwarfpp tree.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+#include "dwarfpp/root.hpp"
+#include "dwarfpp/native-reader.hpp"
+
+namespace dwarf
+{
+	using std::endl;
+	using std::vector;
+	namespace core
+	{
+		const attr_columns::column *attr_columns::column_for(Dwarf_Half attr) const
+		{
+			for (auto i_c = columns.begin(); i_c != columns.end(); ++i_c)
+			{
+				if (i_c->attr == attr) return &*i_c;
+			}
+			return nullptr;
+		}
+
+		unsigned attr_columns::row_of(Dwarf_Off off) const
+		{
+			auto found = std::lower_bound(dies.begin(), dies.end(), off);
+			return (found != dies.end() && *found == off) ? found - dies.begin() : NONE;
+		}
+
+		size_t attr_columns::bytes() const
+		{
+			size_t n = sizeof *this + dies.capacity() * sizeof (Dwarf_Off)
+				+ tags.capacity() * sizeof (Dwarf_Half)
+				+ columns.capacity() * sizeof (column);
+			for (auto i_c = columns.begin(); i_c != columns.end(); ++i_c)
+			{
+				n += i_c->kinds.capacity() + i_c->values.capacity() * sizeof (Dwarf_Unsigned);
+			}
+			return n;
+		}
+
+		bool root_die::extract(const vector<Dwarf_Half>& tags, const vector<Dwarf_Half>& attrs,
+			attr_columns& out, unsigned nthreads)
+		{
+			out = attr_columns();
+			for (auto i_a = attrs.begin(); i_a != attrs.end(); ++i_a)
+			{
+				out.columns.push_back((attr_columns::column) { .attr = *i_a });
+			}
+			if (frozen) return false;
+			/* As in extract_ref_graph(), any native reader will do. */
+			shared_ptr<const native_reader> p_native = get_native_reader();
+			if (!p_native && img.loader) p_native = native_reader::from_loader(*img.loader);
+			if (!p_native) return false;
+			const native_reader& reader = *p_native;
+			unsigned n_units = reader.unit_count();
+			if (n_units == 0) return false;
+
+			if (nthreads == 0) nthreads = std::max(1u, std::thread::hardware_concurrency());
+			nthreads = std::min(nthreads, n_units);
+			vector<attr_columns> slices(n_units, out);
+			vector<vector<const char *> > strings(n_units);
+			vector<char> slice_ok(n_units);
+			std::atomic<unsigned> next_unit(0);
+			auto run = [&]() {
+				for (unsigned u; (u = next_unit++) < n_units; )
+				{
+					slice_ok[u] = reader.read_unit_columns(u, tags, slices[u], strings[u]);
+				}
+			};
+			if (nthreads == 1) run();
+			else
+			{
+				vector<std::thread> workers;
+				for (unsigned i = 0; i < nthreads; ++i) workers.push_back(std::thread(run));
+				for (auto i_w = workers.begin(); i_w != workers.end(); ++i_w) i_w->join();
+			}
+
+			size_t n_rows = 0;
+			bool ok = true;
+			for (unsigned u = 0; u < n_units; ++u)
+			{
+				n_rows += slices[u].dies.size();
+				if (!slice_ok[u])
+				{
+					ok = false;
+					debug(1) << "Bad data in unit at 0x" << std::hex << reader.get_unit(u).offset
+						<< std::dec << "; its columns are partial" << endl;
+				}
+			}
+			out.dies.reserve(n_rows);
+			out.tags.reserve(n_rows);
+			for (auto i_c = out.columns.begin(); i_c != out.columns.end(); ++i_c)
+			{
+				i_c->kinds.reserve(n_rows);
+				i_c->values.reserve(n_rows);
+			}
+			/* Units are in offset order, so concatenating keeps the rows so.
+			 * Strings become IDs as they go past. */
+			for (unsigned u = 0; u < n_units; ++u)
+			{
+				attr_columns& slice = slices[u];
+				out.dies.insert(out.dies.end(), slice.dies.begin(), slice.dies.end());
+				out.tags.insert(out.tags.end(), slice.tags.begin(), slice.tags.end());
+				for (unsigned j = 0; j < out.columns.size(); ++j)
+				{
+					attr_columns::column& from = slice.columns[j];
+					attr_columns::column& to = out.columns[j];
+					for (unsigned i = 0; i < from.kinds.size(); ++i)
+					{
+						if (from.kinds[i] != attr_columns::STRING) continue;
+						from.values[i] = names.intern(string_view(strings[u][from.values[i]]));
+					}
+					to.kinds.insert(to.kinds.end(), from.kinds.begin(), from.kinds.end());
+					to.values.insert(to.values.end(), from.values.begin(), from.values.end());
+				}
+				slice = attr_columns(); // free as we go
+				vector<const char *>().swap(strings[u]);
+			}
+			debug(2) << "Extracted " << out.columns.size() << " columns of " << out.dies.size()
+				<< " DIEs from " << n_units << " units using " << nthreads << " threads" << endl;
+			return ok;
+		}
+	}
+}
@@ -6,6 +6,7 @@
  * LICENSE file in the root of the libdwarfpp tree.
  */
 
+#include <algorithm>
 #include <limits>
 #include <map>
 #include <set>
@@ -23,6 +24,7 @@
 #include "lib.hpp"
 #include "frame.hpp"
 #include "regs.hpp"
+#include "leb128.hpp"
 
 using std::map;
 using std::pair;
@@ -52,6 +54,7 @@ namespace dwarf
 	{
 		::Elf *FrameSection::get_elf() const
 		{
+			if (dbg.object_elf) return dbg.object_elf;
 			lib::Elf_opaque_in_libdwarf *e;
 			int elf_ret = dwarf_get_elf(dbg.raw_handle(), &e, &core::current_dwarf_error);
 			assert(elf_ret == DW_DLV_OK);
@@ -256,34 +259,19 @@ namespace dwarf
 			s << "]";
 			return s;
 		}
+		/* These are for callers who know the number is there; see
+		 * leb128.hpp for the checked versions that they use. */
 		Dwarf_Unsigned read_uleb128(unsigned char const **cur, unsigned char const *limit)
 		{
-			Dwarf_Unsigned working = 0;
-			unsigned char const *start = *cur;
-			do 
-			{
-				assert(*cur < limit);
-				// the bit offset is 7 * the number of bytes we've already read
-				int n7bits = *cur - start;
-				// add in the low-order 7 bits
-				working |= ((**cur) & ~0x80) << (7 * n7bits);
-				
-			} while (*(*cur)++ & 0x80);
-			unsigned nbits_read = 7 * (*cur - start);
-			assert(nbits_read < 8 * sizeof (Dwarf_Unsigned));
-			return working;
+			Dwarf_Unsigned v;
+			if (!core::read_uleb128(*cur, limit, &v)) { assert(false); v = 0; }
+			return v;
 		}
 		Dwarf_Signed read_sleb128(unsigned char const **cur, unsigned char const *limit)
 		{
-			unsigned char const *start = *cur;
-			Dwarf_Unsigned working = read_uleb128(cur, limit);
-			// sign-extend the result...
-			unsigned nbits_read = 7 * (*cur - start);
-			unsigned top_bits = 8 * (sizeof (Dwarf_Signed)) - nbits_read;
-			// ... by shifting up so that we have a 1 in the top position...
-			Dwarf_Signed scaled_up = (Dwarf_Signed) (working << top_bits);
-			// ... then shifting back down, now as a *signed* number
-			return scaled_up >> top_bits;
+			Dwarf_Signed v;
+			if (!core::read_sleb128(*cur, limit, &v)) { assert(false); v = 0; }
+			return v;
 		}
 		uint64_t read_8byte_le(unsigned char const **cur, unsigned char const *limit)
 		{
@@ -651,6 +639,183 @@ namespace dwarf
 			this->hdr_vaddr = 0;
 		}
 
+		void FrameSection::build_indexes() const
+		{
+			indexes_built = true;
+			for (Dwarf_Fde *p_fde = fde_data; p_fde != fde_data + fde_element_count; ++p_fde)
+			{
+				const Fde& f = fde_at(p_fde - fde_data);
+				fde_offsets_by_cie_offset[f.get_cie_offset()].insert(f.get_fde_offset());
+				lib::Dwarf_Signed index;
+				lib::Dwarf_Cie cie;
+				int cie_ret = dwarf_get_cie_of_fde(*p_fde, &cie, &core::current_dwarf_error);
+				if (LIBDWARF_OK(cie_ret))
+				{
+					int index_ret = dwarf_get_cie_index(cie, &index, &core::current_dwarf_error);
+					assert(index_ret == DW_DLV_OK);
+					if (LIBDWARF_OK(index_ret))
+					{
+						cie_offsets_by_index[index] = f.get_cie_offset();
+					}
+				}
+			}
+			/* We've made every Fde above; make every Cie too, so that after
+			 * this, find_cie() and the like only read. */
+			for (Dwarf_Signed i = 0; i < cie_element_count; ++i) cie_at(i);
+			debug(2) << "Indexed " << fde_element_count << " FDEs by CIE" << endl;
+		}
+
+		namespace
+		{
+			/* Lay out sorted in Eytzinger order, by an in-order walk of the
+			 * implicit tree. Positions past the end of sorted keep the
+			 * padding value they were given, and ranks from sorted.size(). */
+			void fill_eytzinger(const std::vector<Dwarf_Addr>& sorted, Dwarf_Addr *eyt,
+				std::vector<uint32_t>& rank, size_t k, size_t& next)
+			{
+				if (k >= rank.size()) return;
+				fill_eytzinger(sorted, eyt, rank, 2 * k, next);
+				if (next < sorted.size()) eyt[k] = sorted[next];
+				rank[k] = next++;
+				fill_eytzinger(sorted, eyt, rank, 2 * k + 1, next);
+			}
+			/* Having gone depth steps down from the root, turning right
+			 * wherever the node was <= pc, the upper bound is the last node
+			 * where we turned left; drop the trailing right turns and that
+			 * left one. If we never turned left, there's none, so it's the
+			 * end. The FDE we want, if any, is the one before. */
+			inline Dwarf_Signed hdr_index_for(const FrameSection::decoded_hdr_table& t,
+				size_t k, Dwarf_Addr pc)
+			{
+				k >>= __builtin_ffsll(~k);
+				size_t upper = k ? t.eyt_rank[k] : t.lo.size();
+				if (upper > t.lo.size()) upper = t.lo.size();
+				if (upper == 0 || pc >= t.hi[upper - 1]) return -1;
+				return upper - 1;
+			}
+		}
+
+		void FrameSection::decode_hdr_table() const
+		{
+			/* Only say it's decoded once it is, so that nobody sees the
+			 * arrays half-filled. */
+			fill_decoded_hdr_table(hdr_decoded);
+			hdr_tbl_decoded = true;
+		}
+
+		void FrameSection::fill_decoded_hdr_table(decoded_hdr_table& t) const
+		{
+			t.lo.clear();
+			t.hi.clear();
+			t.fde_offset.clear();
+			t.eyt_storage.clear();
+			t.eyt = nullptr;
+			t.eyt_rank.clear();
+			t.depth = 0;
+			t.usable = false;
+			/* libdwarf sorts its FDEs by initial location, as the table is
+			 * sorted, so if the counts agree, the indices should too. We
+			 * check every entry, so that lookups needn't. */
+			if (!hdr_tbl || hdr_tbl_encoded_value_size == 0
+				|| hdr_tbl_fde_count == 0
+				|| hdr_tbl_fde_count != (Dwarf_Unsigned) fde_element_count
+				|| hdr_tbl_fde_count >= std::numeric_limits<uint32_t>::max()
+				|| hdr_tbl_fde_count * 2 * hdr_tbl_encoded_value_size > hdr_tbl_nbytes) return;
+			unsigned char interp = hdr_tbl_encoding & 0xf0;
+			if (interp != DW_EH_PE_absptr && interp != DW_EH_PE_datarel) return;
+			size_t n = hdr_tbl_fde_count;
+			t.lo.reserve(n);
+			t.hi.reserve(n);
+			t.fde_offset.reserve(n);
+			auto i_entry = hdr_tbl_begin();
+			for (size_t i = 0; i < n; ++i, ++i_entry)
+			{
+				Dwarf_Addr lopc;
+				Dwarf_Unsigned func_length;
+				Dwarf_Ptr fde_bytes;
+				Dwarf_Unsigned fde_byte_length;
+				Dwarf_Off cie_offset;
+				Dwarf_Signed cie_index;
+				Dwarf_Off fde_offset;
+				int ret = dwarf_get_fde_range(fde_data[i], &lopc, &func_length, &fde_bytes,
+					&fde_byte_length, &cie_offset, &cie_index, &fde_offset, &core::current_dwarf_error);
+				if (!LIBDWARF_OK(ret) || lopc != (*i_entry).first
+					|| (i > 0 && lopc < t.lo.back()))
+				{
+					debug(2) << ".eh_frame_hdr disagrees with libdwarf at FDE " << i
+						<< "; not using it" << endl;
+					t.lo.clear();
+					t.hi.clear();
+					t.fde_offset.clear();
+					return;
+				}
+				t.lo.push_back(lopc);
+				t.hi.push_back(lopc + func_length);
+				t.fde_offset.push_back(fde_offset);
+			}
+			/* Pad to a complete tree, 2^depth - 1 nodes, with the largest
+			 * address, which no pc is beyond. */
+			while ((((size_t) 1) << t.depth) - 1 < n) ++t.depth;
+			size_t n_nodes = ((size_t) 1) << t.depth; // counting the unused eyt[0]
+			const size_t per_line = 64 / sizeof (Dwarf_Addr);
+			t.eyt_storage.assign(n_nodes + per_line, std::numeric_limits<Dwarf_Addr>::max());
+			uintptr_t aligned = ((uintptr_t) t.eyt_storage.data() + 63) & ~(uintptr_t) 63;
+			Dwarf_Addr *eyt = reinterpret_cast<Dwarf_Addr *>(aligned);
+			t.eyt_rank.assign(n_nodes, 0);
+			size_t next = 0;
+			fill_eytzinger(t.lo, eyt, t.eyt_rank, 1, next);
+			t.eyt = eyt;
+			t.usable = true;
+			debug(2) << "Decoded " << n << " .eh_frame_hdr entries, depth " << t.depth << endl;
+		}
+
+		bool FrameSection::find_fde_index_by_hdr(Dwarf_Addr pc, Dwarf_Signed *out_index) const
+		{
+			/* A usable table can also say there's no FDE: -1. */
+			const decoded_hdr_table& t = get_decoded_hdr_table();
+			if (!t.usable) return false;
+			size_t k = 1;
+			for (unsigned d = 0; d < t.depth; ++d) k = 2 * k + (t.eyt[k] <= pc);
+			*out_index = hdr_index_for(t, k, pc);
+			return true;
+		}
+
+		void FrameSection::find_fde_indices_for_pcs(const Dwarf_Addr *pcs, size_t n, Dwarf_Signed *out) const
+		{
+			const decoded_hdr_table& t = get_decoded_hdr_table();
+			if (!t.usable)
+			{
+				for (size_t i = 0; i < n; ++i)
+				{
+					auto found = find_fde_for_pc(pcs[i]);
+					out[i] = (found == fde_end()) ? -1 : found - fde_begin();
+				}
+				return;
+			}
+			size_t k[BATCH_SIZE];
+			for (size_t base = 0; base < n; base += BATCH_SIZE)
+			{
+				size_t m = std::min<size_t>(BATCH_SIZE, n - base);
+				const Dwarf_Addr *batch = pcs + base;
+				for (size_t j = 0; j < m; ++j) k[j] = 1;
+				/* Each step is a load whose address the last one chose, so
+				 * it's the misses that cost. Doing the compares four at a
+				 * time in GCC vectors, loading the nodes one by one, was 5
+				 * to 20% slower than this for trees of 2^10 to 2^18 nodes. */
+				for (unsigned d = 0; d < t.depth; ++d)
+				{
+					for (size_t j = 0; j < m; ++j)
+					{
+						k[j] = 2 * k[j] + (t.eyt[k[j]] <= batch[j]);
+						/* Four levels down, our sixteen descendants are two
+						 * cache lines, if the tree goes that deep. */
+						if (d + 6 <= t.depth) __builtin_prefetch(t.eyt + 16 * k[j]);
+					}
+				}
+				for (size_t j = 0; j < m; ++j) out[base + j] = hdr_index_for(t, k[j], batch[j]);
+			}
+		}
+
 		void Fde::init_augmentation_bytes()
 		{
 			/* 
@@ -734,31 +899,201 @@ namespace dwarf
 		FrameSection::instrs_results
 		Fde::decode() const
 		{
+			return *decoded();
+		}
+
+		std::shared_ptr<const FrameSection::instrs_results>
+		Fde::decoded() const
+		{
+			auto& c = owner.decode_cache;
+			{
+				std::lock_guard<std::mutex> lock(c.mutex);
+				auto found = c.where.find(fde_offset);
+				if (found != c.where.end())
+				{
+					++c.hits;
+					c.lru.splice(c.lru.begin(), c.lru, found->second);
+					return found->second->second;
+				}
+				++c.misses;
+			}
 			unsigned char *instr_bytes_begin = instr_bytes_seq().first;
 			unsigned char *instr_bytes_end = instr_bytes_seq().second;
 			
 			/* Get the CIE for this FDE. */
 			const core::Cie& cie = *find_cie();
 
-			typedef opt< const FrameSection::instrs_results & > initial_instrs_results_t;
 			/* Invoke the interpreter. */
 			
 			/* Walk the CIE initial instructions. */
-			auto initial_result = owner.interpret_instructions(cie, get_low_pc(),
-				cie.get_initial_instructions(), cie.get_initial_instructions_length(), initial_instrs_results_t());
+			auto initial_result = owner.cie_initial_results(cie, get_low_pc());
 			/* Walk the FDE instructions. */
-			auto final_result = owner.interpret_instructions(cie, initial_result.unfinished_row_addr,
-				instr_bytes_begin, instr_bytes_end - instr_bytes_begin, initial_result);
+			auto final_result = std::make_shared<FrameSection::instrs_results>(
+				owner.interpret_instructions(cie, initial_result.unfinished_row_addr,
+					instr_bytes_begin, instr_bytes_end - instr_bytes_begin, initial_result));
 			/* Add any unfinished row, using the FDE high pc */
-			if (final_result.rows.size() > 0)
+			if (final_result->rows.size() > 0)
 			{
-				final_result.add_unfinished_row(get_low_pc() + get_func_length() + 1);
+				final_result->add_unfinished_row(get_low_pc() + get_func_length() + 1);
 			}
 			
 			// that's it! (no unfinished rows now)
+			std::lock_guard<std::mutex> lock(c.mutex);
+			if (c.max_entries == 0 || c.where.find(fde_offset) != c.where.end()) return final_result;
+			c.lru.push_front(make_pair(fde_offset, final_result));
+			c.where[fde_offset] = c.lru.begin();
+			while (c.where.size() > c.max_entries)
+			{
+				c.where.erase(c.lru.back().first);
+				c.lru.pop_back();
+			}
 			return final_result;
 		}
+
+		FrameSection::instrs_results
+		FrameSection::cie_initial_results(const Cie& cie, Dwarf_Addr initial_row_addr) const
+		{
+			typedef opt< const FrameSection::instrs_results & > initial_instrs_results_t;
+			auto& c = decode_cache;
+			{
+				std::lock_guard<std::mutex> lock(c.mutex);
+				auto found = c.cie_initial.find(cie.raw_handle());
+				if (found != c.cie_initial.end())
+				{
+					/* We only keep results with no rows, whose one unfinished
+					 * row starts wherever the FDE does. */
+					instrs_results result = *found->second;
+					result.unfinished_row_addr = initial_row_addr;
+					return result;
+				}
+			}
+			instrs_results result = interpret_instructions(cie, initial_row_addr,
+				cie.get_initial_instructions(), cie.get_initial_instructions_length(),
+				initial_instrs_results_t());
+			/* Initial instructions that advance the location are odd, and
+			 * their rows depend on the FDE, so don't share those. */
+			if (result.rows.size() > 0 || result.unfinished_row_addr != initial_row_addr) return result;
+			std::lock_guard<std::mutex> lock(c.mutex);
+			if (c.max_entries == 0) return result;
+			if (c.cie_initial.size() >= c.max_entries) c.cie_initial.clear();
+			c.cie_initial.insert(make_pair(cie.raw_handle(),
+				std::make_shared<const instrs_results>(result)));
+			return result;
+		}
+
+		void FrameSection::set_decode_cache_size(unsigned max_entries)
+		{
+			std::lock_guard<std::mutex> lock(decode_cache.mutex);
+			decode_cache.max_entries = max_entries;
+			/* Simplest to start afresh. Anyone holding a decoded() result
+			 * keeps it alive meanwhile. */
+			decode_cache.lru.clear();
+			decode_cache.where.clear();
+			decode_cache.cie_initial.clear();
+		}
 		
+		namespace
+		{
+			typedef FrameSection::compact_rule compact_rule;
+			/* The rule for regnum in a row sorted by register number,
+			 * inserting an INDETERMINATE one if there is none. */
+			compact_rule& rule_for(std::vector<compact_rule>& row, int regnum)
+			{
+				auto found = std::lower_bound(row.begin(), row.end(), regnum,
+					[](const compact_rule& r, int n) { return r.regnum < n; });
+				if (found != row.end() && found->regnum == regnum) return *found;
+				compact_rule r;
+				bzero(&r, sizeof r);
+				r.regnum = regnum;
+				return *row.insert(found, r);
+			}
+			const compact_rule *find_in(const compact_rule *begin, const compact_rule *end, int regnum)
+			{
+				auto found = std::lower_bound(begin, end, regnum,
+					[](const compact_rule& r, int n) { return r.regnum < n; });
+				return (found != end && found->regnum == regnum) ? found : nullptr;
+			}
+			/* Set a rule's kind and clear its value, so that rules which
+			 * mean the same compare equal. */
+			compact_rule& reset_rule(compact_rule& r, FrameSection::register_def::kind k)
+			{
+				unsigned regnum = r.regnum;
+				bzero(&r, sizeof r);
+				r.regnum = regnum;
+				r.k = k;
+				return r;
+			}
+			compact_rule& reg_plus_offset_rule(std::vector<compact_rule>& row, int regnum)
+			{
+				compact_rule& r = rule_for(row, regnum);
+				if (r.k != FrameSection::register_def::REGISTER) reset_rule(r, FrameSection::register_def::REGISTER);
+				return r;
+			}
+		}
+
+		void FrameSection::instrs_results::add_row(Dwarf_Addr lo, Dwarf_Addr hi,
+			const std::vector<compact_rule>& row_rules)
+		{
+			if (hi <= lo || row_rules.empty()) return;
+			if (!rows.empty() && rows.back().hi == lo
+				&& rows.back().n_rules == row_rules.size()
+				&& std::equal(row_rules.begin(), row_rules.end(), rules_begin(rows.back())))
+			{
+				rows.back().hi = hi;
+				return;
+			}
+			assert(rows.empty() || rows.back().hi <= lo);
+			rows.push_back((row) { .lo = lo, .hi = hi,
+				.first_rule = (unsigned) rules.size(), .n_rules = (unsigned) row_rules.size() });
+			rules.insert(rules.end(), row_rules.begin(), row_rules.end());
+		}
+
+		const FrameSection::instrs_results::row *
+		FrameSection::instrs_results::find_row(Dwarf_Addr pc) const
+		{
+			auto found = std::upper_bound(rows.begin(), rows.end(), pc,
+				[](Dwarf_Addr a, const row& r) { return a < r.lo; });
+			if (found == rows.begin()) return nullptr;
+			--found;
+			return pc < found->hi ? &*found : nullptr;
+		}
+
+		const FrameSection::compact_rule *
+		FrameSection::instrs_results::find_rule(const row& r, int regnum) const
+		{
+			const compact_rule *found = find_in(rules_begin(r), rules_end(r), regnum);
+			if (!found || found->k == register_def::INDETERMINATE) return nullptr;
+			return found;
+		}
+
+		FrameSection::register_def
+		FrameSection::compact_rule::expand(Dwarf_Debug dbg) const
+		{
+			register_def d = register_def();
+			d.k = (register_def::kind) k;
+			switch (d.k)
+			{
+				case register_def::SAVED_AT_OFFSET_FROM_CFA:
+					d.value.m_saved_at_offset_from_cfa = u.offset;
+					break;
+				case register_def::VAL_IS_OFFSET_FROM_CFA:
+					d.value.m_val_is_offset_from_cfa = u.offset;
+					break;
+				case register_def::REGISTER:
+					d.value.m_register_plus_offset = make_pair(u.reg_plus_offset.reg, u.reg_plus_offset.offset);
+					break;
+				case register_def::SAVED_AT_EXPR:
+					d.value.m_saved_at_expr = encap::loc_expr(dbg, const_cast<Dwarf_Small *>(u.expr), expr_len);
+					break;
+				case register_def::VAL_OF_EXPR:
+					d.value.m_val_of_expr = encap::loc_expr(dbg, const_cast<Dwarf_Small *>(u.expr), expr_len);
+					break;
+				default:
+					break;
+			}
+			return d;
+		}
+
 		FrameSection::instrs_results
 		FrameSection::interpret_instructions(const Cie& cie, 
 				Dwarf_Addr initial_row_addr, 
@@ -775,7 +1110,6 @@ namespace dwarf
 			
 			// create container for return values & working storage
 			instrs_results result;
-			auto& working = result.rows;
 			auto& current_row_defs = result.unfinished_row;
 			Dwarf_Addr& current_row_addr = result.unfinished_row_addr;
 			
@@ -790,7 +1124,7 @@ namespace dwarf
 				// others are initialized to empty
 				current_row_addr = initial_row_addr;
 			}
-			std::stack< map<int, register_def> > remembered_row_defs;
+			std::stack< std::vector<compact_rule> > remembered_row_defs;
 
 			debug() << "Interpreting instrlist " << instrlist << endl;
 			for (auto i_op = instrlist.begin(); i_op != instrlist.end(); ++i_op)
@@ -811,103 +1145,91 @@ namespace dwarf
 					add_new_row: {
 						// assert greater than current
 						assert(new_row_addr > current_row_addr);
-						set< pair< int, register_def > > current_row_defs_set(current_row_defs.begin(), current_row_defs.end());
-
-						// add the old row to the interval map
-						working += make_pair( 
-							interval<Dwarf_Addr>::right_open(current_row_addr, new_row_addr),
-							current_row_defs_set
-						);
+						result.add_row(current_row_addr, new_row_addr, current_row_defs);
 						current_row_addr = new_row_addr;
 						} break;
 					// CFA definition
 					case DW_CFA_def_cfa:
-						current_row_defs[DW_FRAME_CFA_COL3].register_plus_offset_w() = make_pair(i_op->fp_register, i_op->fp_offset_or_block_len);
-						break;
-					case DW_CFA_def_cfa_sf: // signed, factored
-						current_row_defs[DW_FRAME_CFA_COL3].register_plus_offset_w() = make_pair(i_op->fp_register, i_op->fp_offset_or_block_len);
-						break;
+					case DW_CFA_def_cfa_sf: { // signed, factored
+						compact_rule& r = reg_plus_offset_rule(current_row_defs, DW_FRAME_CFA_COL3);
+						r.u.reg_plus_offset.reg = i_op->fp_register;
+						r.u.reg_plus_offset.offset = i_op->fp_offset_or_block_len;
+					} break;
 					case DW_CFA_def_cfa_register:
-						assert(current_row_defs.find(DW_FRAME_CFA_COL3) != current_row_defs.end());
+						assert(find_in(current_row_defs.data(), current_row_defs.data() + current_row_defs.size(),
+							DW_FRAME_CFA_COL3));
 						// FIXME: also assert that it's a reg+off def, not a locexpr def
-						current_row_defs[DW_FRAME_CFA_COL3].register_plus_offset_w().first = i_op->fp_register;
+						reg_plus_offset_rule(current_row_defs, DW_FRAME_CFA_COL3).u.reg_plus_offset.reg
+						 = i_op->fp_register;
 						break;
 					case DW_CFA_def_cfa_offset:
-						assert(current_row_defs.find(DW_FRAME_CFA_COL3) != current_row_defs.end());
-						// FIXME: also assert that it's a reg+off def, not a locexpr def
-						current_row_defs[DW_FRAME_CFA_COL3].register_plus_offset_w().second = i_op->fp_offset_or_block_len;
-						break;
 					case DW_CFA_def_cfa_offset_sf:
-						assert(current_row_defs.find(DW_FRAME_CFA_COL3) != current_row_defs.end());
+						assert(find_in(current_row_defs.data(), current_row_defs.data() + current_row_defs.size(),
+							DW_FRAME_CFA_COL3));
 						// FIXME: also assert that it's a reg+off def, not a locexpr def
-						current_row_defs[DW_FRAME_CFA_COL3].register_plus_offset_w().second = i_op->fp_offset_or_block_len;
-						break;
-					case DW_CFA_def_cfa_expression: 
-						current_row_defs[DW_FRAME_CFA_COL3].saved_at_expr_w() = encap::loc_expr(get_dbg().raw_handle(), i_op->fp_expr_block, i_op->fp_offset_or_block_len);
+						reg_plus_offset_rule(current_row_defs, DW_FRAME_CFA_COL3).u.reg_plus_offset.offset
+						 = i_op->fp_offset_or_block_len;
 						break;
+					case DW_CFA_def_cfa_expression: {
+						compact_rule& r = reset_rule(rule_for(current_row_defs, DW_FRAME_CFA_COL3),
+							register_def::SAVED_AT_EXPR);
+						r.expr_len = i_op->fp_offset_or_block_len;
+						r.u.expr = i_op->fp_expr_block;
+					} break;
 					// register rule
 					case DW_CFA_undefined:
 						// mark the specified register as undefined
-						current_row_defs[i_op->fp_register].undefined_w();
+						reset_rule(rule_for(current_row_defs, i_op->fp_register), register_def::UNDEFINED);
 						break;
 					case DW_CFA_same_value:
-						current_row_defs[i_op->fp_register].same_value_w();
+						reset_rule(rule_for(current_row_defs, i_op->fp_register), register_def::SAME_VALUE);
 						break;
 					case DW_CFA_offset:
 					case DW_CFA_offset_extended:
 					case DW_CFA_offset_extended_sf:
-						current_row_defs[i_op->fp_register].saved_at_offset_from_cfa_w() = i_op->fp_offset_or_block_len;;
-						current_row_defs[i_op->fp_register].saved_at_offset_from_cfa_w() = i_op->fp_offset_or_block_len;;
+						reset_rule(rule_for(current_row_defs, i_op->fp_register),
+							register_def::SAVED_AT_OFFSET_FROM_CFA).u.offset = (int) i_op->fp_offset_or_block_len;
 						break;
 					case DW_CFA_val_offset: 
 					case DW_CFA_val_offset_sf:
-						current_row_defs[i_op->fp_register].val_is_offset_from_cfa_w() = i_op->fp_offset_or_block_len;
-						break;
-					case DW_CFA_register: // FIXME: second register goes where? I've put it in fp_offset_or_block_len
-						current_row_defs[i_op->fp_register].register_plus_offset_w()
-						 = make_pair(i_op->fp_offset_or_block_len, 0);
+						reset_rule(rule_for(current_row_defs, i_op->fp_register),
+							register_def::VAL_IS_OFFSET_FROM_CFA).u.offset = (int) i_op->fp_offset_or_block_len;
 						break;
+					case DW_CFA_register: { // FIXME: second register goes where? I've put it in fp_offset_or_block_len
+						compact_rule& r = reset_rule(rule_for(current_row_defs, i_op->fp_register),
+							register_def::REGISTER);
+						r.u.reg_plus_offset.reg = i_op->fp_offset_or_block_len;
+					} break;
 					case DW_CFA_expression:
-						current_row_defs[i_op->fp_register].saved_at_expr_w() = encap::loc_expr(get_dbg().raw_handle(), i_op->fp_expr_block, i_op->fp_offset_or_block_len);
-						break;
-					case DW_CFA_val_expression:
-						current_row_defs[i_op->fp_register].val_of_expr_w() = encap::loc_expr(get_dbg().raw_handle(), i_op->fp_expr_block, i_op->fp_offset_or_block_len);
-						break;
+					case DW_CFA_val_expression: {
+						compact_rule& r = reset_rule(rule_for(current_row_defs, i_op->fp_register),
+							(i_op->fp_extended_op == DW_CFA_expression)
+								? register_def::SAVED_AT_EXPR : register_def::VAL_OF_EXPR);
+						r.expr_len = i_op->fp_offset_or_block_len;
+						r.u.expr = i_op->fp_expr_block;
+					} break;
 					case DW_CFA_restore:
 					case DW_CFA_restore_extended: {
 						// look in the unfinished row
 						auto &initial_results = *initial_instrs_results;
-						const register_def *opt_previous_def = nullptr;
-						auto found_in_unfinished = initial_results.unfinished_row.find(i_op->fp_register);
-						if (found_in_unfinished != initial_results.unfinished_row.end())
-						{
-							opt_previous_def = &found_in_unfinished->second;
-						}
-						else 
+						const compact_rule *opt_previous_def = find_in(initial_results.unfinished_row.data(),
+							initial_results.unfinished_row.data() + initial_results.unfinished_row.size(),
+							i_op->fp_register);
+						if (!opt_previous_def)
 						{
-							auto found_row = initial_results.rows.find(current_row_addr);
-							if (found_row != initial_results.rows.end())
-							{
-								// look for the register
-								auto& inner_set = initial_results.rows.find(current_row_addr)->second;
-								// HACK: we build a map, rather than searching the set
-								map<int, register_def> inner_map(inner_set.begin(), inner_set.end());
-								auto found = inner_map.find(i_op->fp_register);
-								if (found != inner_map.end())
-								{
-									opt_previous_def = &found->second;
-								}
-							}
+							auto found_row = initial_results.find_row(current_row_addr);
+							if (found_row) opt_previous_def = find_in(initial_results.rules_begin(*found_row),
+								initial_results.rules_end(*found_row), i_op->fp_register);
 						}
 						if (opt_previous_def)
 						{
-							current_row_defs[i_op->fp_register] = *opt_previous_def;
+							rule_for(current_row_defs, i_op->fp_register) = *opt_previous_def;
 						}
 						else
 						{
 							/* What does it mean if we're not defined in the initial instructions? 
 							 * Answer: "indeterminate" (not "undefined") */
-							current_row_defs[i_op->fp_register] = (register_def) { .k = register_def::INDETERMINATE };
+							reset_rule(rule_for(current_row_defs, i_op->fp_register), register_def::INDETERMINATE);
 						}
 
 					} break;
@@ -935,7 +1257,7 @@ namespace dwarf
 			// there might be an unfinished row in result.unfinished_row; if so we'll fix it up outside
 			return result;
 		}
-		
+
 	}
 	namespace encap
 	{
@@ -1136,7 +1458,8 @@ namespace dwarf
 
 					assert(i_fde->get_low_pc() >= prev_fde_lopc); // I have seen the == case
 
-					FrameSection::instrs_results current_decoded = i_fde->decode();
+					auto p_current_decoded = i_fde->decoded();
+					const FrameSection::instrs_results& current_decoded = *p_current_decoded;
 					boost::icl::discrete_interval<Dwarf_Addr> current_fde_overlap_interval
 					 = interval<Dwarf_Addr>::right_open(
 										/* intersection of our loc_expr's interval and the FDE's interval */
@@ -1151,8 +1474,8 @@ namespace dwarf
 						// how much does it overlap the loc_expr interval?
 						auto row_overlap_interval = interval<Dwarf_Addr>::right_open(
 								/* intersection of our loc_expr's interval and the *row*'s (not FDE's) interval */
-								std::max(i_row->first.lower(), i_int->lower()), 
-								std::min(i_row->first.upper(), i_int->upper())
+								std::max(i_row->lo, i_int->lower()), 
+								std::min(i_row->hi, i_int->upper())
 							);
 						if (row_overlap_interval.upper() <= row_overlap_interval.lower())
 						{
@@ -1164,12 +1487,13 @@ namespace dwarf
 						// - register_plus_offset register definitions
 						// - CFA definitions? FIXME.
 						register_graph g;
-						for (auto i_ent = i_row->second.begin(); i_ent != i_row->second.end(); ++i_ent)
+						for (auto i_ent = current_decoded.rules_begin(*i_row);
+							i_ent != current_decoded.rules_end(*i_row); ++i_ent)
 						{
-							if (i_ent->second.k == FrameSection::register_def::REGISTER)
+							if (i_ent->k == FrameSection::register_def::REGISTER)
 							{
-								int source = i_ent->second.register_plus_offset_r().first;
-								int target = i_ent->first;
+								int source = i_ent->u.reg_plus_offset.reg;
+								int target = i_ent->regnum;
 
 								// we want source + difference = target
 								// ... cf. the meaning of register_plus_offset is that 
@@ -1179,12 +1503,12 @@ namespace dwarf
 								g.insert(make_pair(source, (register_edge){
 									.from_reg = source,
 									.to_reg = target,
-									.difference = i_ent->second.register_plus_offset_r().second,
+									.difference = i_ent->u.reg_plus_offset.offset,
 								}));
 								g.insert(make_pair(target, (register_edge){
 									.from_reg = target,
 									.to_reg = source,
-									.difference = - i_ent->second.register_plus_offset_r().second,
+									.difference = - i_ent->u.reg_plus_offset.offset,
 								}));
 							}
 						}
@@ -0,0 +1,452 @@
+/* dwarfpp: C++ binding for a useful subset of libdwarf, plus extra goodies.
+ *
+ * incremental-index.cpp: per-CU indexes that carry over to a rebuilt binary
+ *
+ * Copyright (c) 2008--17, Stephen Kell. For licensing information, see the
+ * LICENSE file in the root of the libdwarfpp tree.
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <strings.h>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <set>
+#include <unordered_map>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "dwarfpp/root.hpp"
+#include "dwarfpp/root-inl.hpp"
+#include "dwarfpp/iter.hpp"
+#include "dwarfpp/iter-inl.hpp"
+#include "dwarfpp/native-reader.hpp"
+
+namespace dwarf
+{
+	using std::endl;
+	using std::vector;
+	namespace core
+	{
+		/* Like the nav index: a fixed header, then flat arrays in host byte
+		 * order. There's one record per CU, naming a contiguous run of each
+		 * of the other arrays. Offsets in those are relative to the CU's
+		 * own offset, so that they hold wherever the CU ends up; names are
+		 * spans of a string pool. There's no build-id, since the whole
+		 * point is to load the index against a different build. */
+		namespace
+		{
+			const char incremental_index_magic[8] = { 'D', 'W', 'P', 'P', 'I', 'N', 'C', '1' };
+
+			struct incremental_index_header
+			{
+				char magic[8];
+				uint32_t cu_record_size;
+				uint32_t nav_record_size;
+				uint32_t name_record_size;
+				uint32_t type_record_size;
+				uint32_t addr_record_size;
+				uint32_t unused;
+				uint64_t n_cu_records;
+				uint64_t n_nav_records;
+				uint64_t n_name_records;
+				uint64_t n_type_records;
+				uint64_t n_addr_records;
+				uint64_t strings_len;
+			};
+			struct incremental_index_cu_record
+			{
+				enum { CLOSED = 1 };
+				uint64_t signature;
+				uint64_t cu_offset;
+				uint64_t nav_begin, n_nav;
+				uint64_t names_begin, n_names;
+				uint64_t types_begin, n_types;
+				uint64_t addrs_begin, n_addrs;
+				uint32_t flags;
+				uint32_t unused;
+			};
+			/* As a dense_nav_record, but with a relative offset. */
+			struct incremental_index_nav_record
+			{
+				uint64_t rel_off;
+				uint32_t parent;
+				uint32_t first_child;
+				uint32_t next_sibling;
+				uint16_t depth;
+				uint16_t tag;
+			};
+			struct incremental_index_name_record
+			{
+				uint64_t rel_off;
+				uint64_t name_pos; // in the string pool
+				uint64_t name_len;
+			};
+			struct incremental_index_type_record
+			{
+				enum { HAVE_CODE = 1 };
+				uint64_t rel_off;
+				uint32_t code;
+				uint32_t flags;
+			};
+			struct incremental_index_addr_record
+			{
+				uint64_t lo;
+				uint64_t hi;
+				uint64_t rel_off;
+				uint16_t depth;
+				uint16_t unused[3];
+			};
+
+			/* The reader we're using, or one made just for this. */
+			shared_ptr<const native_reader> reader_for(const root_die& r)
+			{
+				auto p = r.get_native_reader();
+				if (p) return p;
+				auto loader = r.get_section_loader();
+				return loader ? native_reader::from_loader(*loader) : nullptr;
+			}
+		}
+
+		bool root_die::save_incremental_index(const string& filename)
+		{
+			if (frozen || !dbg.handle) return false;
+			auto p_reader = reader_for(*this);
+			if (!p_reader)
+			{
+				debug(1) << "Not saving incremental index: no image to read natively" << endl;
+				return false;
+			}
+			if (!have_dense_nav() && !build_dense_nav()) return false;
+			while (fill_visible_named_grandchildren_step());
+			vector<addr_index_entry> raw;
+			collect_addr_intervals(nullptr, raw);
+
+			/* Share everything out by unit. In-memory DIEs belong to none. */
+			auto is_in_memory = [this](Dwarf_Off off) {
+				auto found = live_dies.find(off);
+				return found != live_dies.end()
+					&& dynamic_cast<in_memory_abstract_die *>(found->second);
+			};
+			unsigned n_units = p_reader->unit_count();
+			vector<vector<incremental_index_name_record> > names_of(n_units);
+			vector<vector<incremental_index_type_record> > types_of(n_units);
+			vector<vector<incremental_index_addr_record> > addrs_of(n_units);
+			string strings;
+			std::unordered_map<unsigned, uint64_t> string_pos; // by name ID
+			unsigned u;
+			for (auto i = visible_named_grandchildren_cache.begin();
+				i != visible_named_grandchildren_cache.end(); ++i)
+			{
+				for (auto i_off = i->second.begin(); i_off != i->second.end(); ++i_off)
+				{
+					if (is_in_memory(*i_off) || !p_reader->unit_index_for(*i_off, &u)) continue;
+					string_view name = this->names.name(i->first);
+					auto inserted = string_pos.insert(make_pair(i->first, (uint64_t) strings.size()));
+					if (inserted.second) strings.append(name.data(), name.size());
+					names_of[u].push_back((incremental_index_name_record) {
+						.rel_off = *i_off - p_reader->unit_die_offset(u),
+						.name_pos = inserted.first->second,
+						.name_len = name.size()
+					});
+				}
+			}
+			for (auto i = type_summary_code_cache.begin(); i != type_summary_code_cache.end(); ++i)
+			{
+				if (is_in_memory(i->first) || !p_reader->unit_index_for(i->first, &u)) continue;
+				types_of[u].push_back((incremental_index_type_record) {
+					.rel_off = i->first - p_reader->unit_die_offset(u),
+					.code = i->second ? *i->second : 0,
+					.flags = i->second ? (uint32_t) incremental_index_type_record::HAVE_CODE : 0
+				});
+			}
+			for (auto i = raw.begin(); i != raw.end(); ++i)
+			{
+				if (!p_reader->unit_index_for(i->off, &u)) continue;
+				incremental_index_addr_record rec;
+				bzero(&rec, sizeof rec);
+				rec.lo = i->lo;
+				rec.hi = i->hi;
+				rec.rel_off = i->off - p_reader->unit_die_offset(u);
+				rec.depth = i->depth;
+				addrs_of[u].push_back(rec);
+			}
+
+			vector<incremental_index_cu_record> cu_records;
+			vector<incremental_index_nav_record> nav_records;
+			vector<incremental_index_name_record> name_records;
+			vector<incremental_index_type_record> type_records;
+			vector<incremental_index_addr_record> addr_records;
+			for (u = 0; u < n_units; ++u)
+			{
+				Dwarf_Off cu_off = p_reader->unit_die_offset(u);
+				uint64_t signature;
+				bool closed;
+				/* A unit we can't sign could never match, so needn't be saved. */
+				if (!p_reader->unit_signature(u, &signature, &closed)) continue;
+				auto found_nav = std::lower_bound(dense_nav.begin(), dense_nav.end(), cu_off,
+					[](const dense_nav_cu_table& t, Dwarf_Off o) { return t.cu_offset < o; });
+				if (found_nav == dense_nav.end() || found_nav->cu_offset != cu_off) continue;
+				incremental_index_cu_record rec;
+				bzero(&rec, sizeof rec);
+				rec.signature = signature;
+				rec.cu_offset = cu_off;
+				rec.flags = closed ? (uint32_t) incremental_index_cu_record::CLOSED : 0;
+				rec.nav_begin = nav_records.size();
+				rec.n_nav = found_nav->records.size();
+				for (auto i = found_nav->records.begin(); i != found_nav->records.end(); ++i)
+				{
+					nav_records.push_back((incremental_index_nav_record) {
+						.rel_off = i->offset - cu_off,
+						.parent = i->parent,
+						.first_child = i->first_child,
+						.next_sibling = i->next_sibling,
+						.depth = i->depth,
+						.tag = i->tag
+					});
+				}
+				rec.names_begin = name_records.size();
+				rec.n_names = names_of[u].size();
+				name_records.insert(name_records.end(), names_of[u].begin(), names_of[u].end());
+				rec.types_begin = type_records.size();
+				rec.n_types = types_of[u].size();
+				type_records.insert(type_records.end(), types_of[u].begin(), types_of[u].end());
+				rec.addrs_begin = addr_records.size();
+				rec.n_addrs = addrs_of[u].size();
+				addr_records.insert(addr_records.end(), addrs_of[u].begin(), addrs_of[u].end());
+				cu_records.push_back(rec);
+			}
+
+			incremental_index_header hdr;
+			bzero(&hdr, sizeof hdr);
+			memcpy(hdr.magic, incremental_index_magic, sizeof hdr.magic);
+			hdr.cu_record_size = sizeof (incremental_index_cu_record);
+			hdr.nav_record_size = sizeof (incremental_index_nav_record);
+			hdr.name_record_size = sizeof (incremental_index_name_record);
+			hdr.type_record_size = sizeof (incremental_index_type_record);
+			hdr.addr_record_size = sizeof (incremental_index_addr_record);
+			hdr.n_cu_records = cu_records.size();
+			hdr.n_nav_records = nav_records.size();
+			hdr.n_name_records = name_records.size();
+			hdr.n_type_records = type_records.size();
+			hdr.n_addr_records = addr_records.size();
+			hdr.strings_len = strings.size();
+
+			std::ostringstream tmp;
+			tmp << filename << ".tmp." << getpid();
+			string tmp_filename = tmp.str();
+			{
+				std::ofstream out(tmp_filename, std::ios::binary | std::ios::trunc);
+				if (!out)
+				{
+					debug(1) << "Could not open " << tmp_filename << " for writing incremental index" << endl;
+					return false;
+				}
+				auto write_array = [&out](const void *data, size_t len) {
+					out.write(reinterpret_cast<const char *>(data), len);
+				};
+				write_array(&hdr, sizeof hdr);
+				write_array(cu_records.data(), cu_records.size() * sizeof (incremental_index_cu_record));
+				write_array(nav_records.data(), nav_records.size() * sizeof (incremental_index_nav_record));
+				write_array(name_records.data(), name_records.size() * sizeof (incremental_index_name_record));
+				write_array(type_records.data(), type_records.size() * sizeof (incremental_index_type_record));
+				write_array(addr_records.data(), addr_records.size() * sizeof (incremental_index_addr_record));
+				write_array(strings.data(), strings.size());
+				if (!out) { unlink(tmp_filename.c_str()); return false; }
+			}
+			if (0 != rename(tmp_filename.c_str(), filename.c_str()))
+			{
+				unlink(tmp_filename.c_str());
+				return false;
+			}
+			debug(2) << "Saved incremental index of " << cu_records.size() << " of " << n_units
+				<< " CUs to " << filename << endl;
+			return true;
+		}
+
+		bool root_die::load_incremental_index(const string& filename, unsigned *p_n_reused)
+		{
+			if (p_n_reused) *p_n_reused = 0;
+			if (frozen || !dbg.handle) return false;
+			auto p_reader = reader_for(*this);
+			if (!p_reader) return false;
+			int fd = open(filename.c_str(), O_RDONLY);
+			if (fd == -1) return false;
+			struct stat st;
+			if (0 != fstat(fd, &st) || (size_t) st.st_size < sizeof (incremental_index_header))
+			{ close(fd); return false; }
+			size_t len = st.st_size;
+			void *mapping = mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, 0);
+			close(fd);
+			if (mapping == MAP_FAILED) return false;
+
+			bool success = false;
+			const char *base = reinterpret_cast<const char *>(mapping);
+			const incremental_index_header *hdr = reinterpret_cast<const incremental_index_header *>(base);
+			const incremental_index_cu_record *cu_records;
+			const incremental_index_nav_record *nav_records;
+			const incremental_index_name_record *name_records;
+			const incremental_index_type_record *type_records;
+			const incremental_index_addr_record *addr_records;
+			const char *strings;
+			uint64_t expected_len;
+			std::unordered_multimap<uint64_t, unsigned> by_signature;
+			vector<bool> used;
+			vector<dense_nav_record> new_dense_nav;
+			vector<pair<Dwarf_Off, size_t> > cu_starts;
+			vector<addr_index_entry> raw;
+			std::set<Dwarf_Off> changed;
+			unsigned n_reused = 0;
+			if (0 != memcmp(hdr->magic, incremental_index_magic, sizeof hdr->magic)
+				|| hdr->cu_record_size != sizeof (incremental_index_cu_record)
+				|| hdr->nav_record_size != sizeof (incremental_index_nav_record)
+				|| hdr->name_record_size != sizeof (incremental_index_name_record)
+				|| hdr->type_record_size != sizeof (incremental_index_type_record)
+				|| hdr->addr_record_size != sizeof (incremental_index_addr_record))
+			{
+				debug(1) << "Did not understand incremental index " << filename << endl;
+				goto out;
+			}
+			expected_len = sizeof (incremental_index_header)
+				+ hdr->n_cu_records * sizeof (incremental_index_cu_record)
+				+ hdr->n_nav_records * sizeof (incremental_index_nav_record)
+				+ hdr->n_name_records * sizeof (incremental_index_name_record)
+				+ hdr->n_type_records * sizeof (incremental_index_type_record)
+				+ hdr->n_addr_records * sizeof (incremental_index_addr_record)
+				+ hdr->strings_len;
+			if (expected_len != len)
+			{
+				debug(1) << "Incremental index " << filename << " is truncated" << endl;
+				goto out;
+			}
+			cu_records = reinterpret_cast<const incremental_index_cu_record *>(hdr + 1);
+			nav_records = reinterpret_cast<const incremental_index_nav_record *>(
+				cu_records + hdr->n_cu_records);
+			name_records = reinterpret_cast<const incremental_index_name_record *>(
+				nav_records + hdr->n_nav_records);
+			type_records = reinterpret_cast<const incremental_index_type_record *>(
+				name_records + hdr->n_name_records);
+			addr_records = reinterpret_cast<const incremental_index_addr_record *>(
+				type_records + hdr->n_type_records);
+			strings = reinterpret_cast<const char *>(addr_records + hdr->n_addr_records);
+			/* Check every run and every link, so that below we needn't. */
+			for (uint64_t i = 0; i < hdr->n_cu_records; ++i)
+			{
+				const incremental_index_cu_record& c = cu_records[i];
+				bool ok = c.nav_begin <= hdr->n_nav_records && c.n_nav <= hdr->n_nav_records - c.nav_begin
+					&& c.n_nav > 0 && nav_records[c.nav_begin].rel_off == 0
+					&& c.names_begin <= hdr->n_name_records && c.n_names <= hdr->n_name_records - c.names_begin
+					&& c.types_begin <= hdr->n_type_records && c.n_types <= hdr->n_type_records - c.types_begin
+					&& c.addrs_begin <= hdr->n_addr_records && c.n_addrs <= hdr->n_addr_records - c.addrs_begin;
+				for (uint64_t j = c.nav_begin; ok && j < c.nav_begin + c.n_nav; ++j)
+				{
+					const incremental_index_nav_record& n = nav_records[j];
+					auto fine = [&c](uint32_t idx, bool may_be_none) {
+						return (may_be_none && idx == dense_nav_record::NONE) || idx < c.n_nav;
+					};
+					ok = fine(n.parent, j == c.nav_begin) && fine(n.first_child, true)
+						&& fine(n.next_sibling, true)
+						&& (j == c.nav_begin || n.rel_off > nav_records[j - 1].rel_off);
+				}
+				for (uint64_t j = c.names_begin; ok && j < c.names_begin + c.n_names; ++j)
+				{
+					ok = name_records[j].name_pos <= hdr->strings_len
+						&& name_records[j].name_len <= hdr->strings_len - name_records[j].name_pos;
+				}
+				if (!ok)
+				{
+					debug(1) << "Incremental index " << filename << " is corrupt" << endl;
+					goto out;
+				}
+				by_signature.insert(make_pair(c.signature, (unsigned) i));
+			}
+
+			/* Take what we can from the index, at the CUs' new offsets. */
+			used.resize(hdr->n_cu_records);
+			for (unsigned u = 0; u < p_reader->unit_count(); ++u)
+			{
+				Dwarf_Off cu_off = p_reader->unit_die_offset(u);
+				uint64_t signature;
+				bool closed;
+				const incremental_index_cu_record *p_c = nullptr;
+				if (p_reader->unit_signature(u, &signature, &closed))
+				{
+					auto found = by_signature.equal_range(signature);
+					for (auto i = found.first; i != found.second; ++i)
+					{
+						if (!used[i->second]) { p_c = &cu_records[i->second]; used[i->second] = true; break; }
+					}
+				}
+				cu_starts.push_back(make_pair(cu_off, new_dense_nav.size()));
+				if (!p_c)
+				{
+					changed.insert(cu_off);
+					if (!build_dense_nav_table(cu_off, new_dense_nav)) goto out;
+					continue;
+				}
+				for (uint64_t j = p_c->nav_begin; j < p_c->nav_begin + p_c->n_nav; ++j)
+				{
+					const incremental_index_nav_record& n = nav_records[j];
+					new_dense_nav.push_back((dense_nav_record) {
+						.offset = cu_off + n.rel_off,
+						.parent = n.parent,
+						.first_child = n.first_child,
+						.next_sibling = n.next_sibling,
+						.depth = n.depth,
+						.tag = n.tag
+					});
+				}
+				for (uint64_t j = p_c->names_begin; j < p_c->names_begin + p_c->n_names; ++j)
+				{
+					note_visible_named_grandchild(string_view(strings + name_records[j].name_pos,
+						name_records[j].name_len), cu_off + name_records[j].rel_off);
+				}
+				visible_named_grandchildren_cus_done.insert(cu_off);
+				/* Don't clobber anything we already know: it ought to agree. */
+				if (closed && (p_c->flags & incremental_index_cu_record::CLOSED))
+				{
+					for (uint64_t j = p_c->types_begin; j < p_c->types_begin + p_c->n_types; ++j)
+					{
+						const incremental_index_type_record& ty = type_records[j];
+						type_summary_code_cache.insert(make_pair(cu_off + ty.rel_off,
+							(ty.flags & incremental_index_type_record::HAVE_CODE)
+								? opt<uint32_t>(ty.code) : opt<uint32_t>()));
+					}
+				}
+				for (uint64_t j = p_c->addrs_begin; j < p_c->addrs_begin + p_c->n_addrs; ++j)
+				{
+					raw.push_back((addr_index_entry) {
+						.lo = addr_records[j].lo,
+						.hi = addr_records[j].hi,
+						.off = cu_off + addr_records[j].rel_off,
+						.depth = addr_records[j].depth
+					});
+				}
+				++n_reused;
+			}
+
+			/* Now the rest, with the dense tables to help. */
+			set_dense_nav(std::move(new_dense_nav), cu_starts);
+			for (auto i_off = changed.begin(); i_off != changed.end(); ++i_off)
+			{
+				iterator_base i_cu = cu_pos(*i_off);
+				if (i_cu) fill_visible_named_grandchildren_for_cu(i_cu);
+			}
+			if (!changed.empty()) collect_addr_intervals(&changed, raw);
+			flatten_addr_index(raw);
+			/* Finish off the names, in case there are in-memory CUs too. */
+			while (fill_visible_named_grandchildren_step());
+			if (p_n_reused) *p_n_reused = n_reused;
+			debug(2) << "Loaded incremental index from " << filename << ": reused "
+				<< n_reused << " CUs and recomputed " << changed.size() << endl;
+			success = true;
+		out:
+			munmap(mapping, len);
+			return success;
+		}
+	}
+}
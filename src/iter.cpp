@@ -85,14 +85,31 @@ namespace dwarf
 		}
 		Dwarf_Off iterator_base::offset_here() const
 		{
+			if (state == OFFSET_ONLY) return m_off;
 			if (!is_real_die_position()) { assert(is_root_position()); return 0; }
 			return get_handle().get_offset();
 		}
 		Dwarf_Half iterator_base::tag_here() const
 		{
+			if (state == OFFSET_ONLY) return m_tag;
 			if (!is_real_die_position()) return 0;
 			return get_handle().get_tag();
 		}
+		void iterator_base::materialize() const
+		{
+			assert(state == OFFSET_ONLY);
+			/* Maybe somebody made a payload since we were copied. */
+			auto found = p_root->live_dies.find(m_off);
+			if (found != p_root->live_dies.end())
+			{
+				cur_payload = found->second;
+				state = WITH_PAYLOAD;
+				return;
+			}
+			DWARFPP_STAT_INC(*p_root, handle_copies);
+			cur_handle = Die(*p_root, m_off);
+			state = HANDLE_ONLY;
+		}
 		//std::unique_ptr<const char, string_deleter>
 		opt<string>
 		iterator_base::name_here() const
@@ -110,9 +127,31 @@ namespace dwarf
 							 != DW_VIS_local)) return maybe_name;
 			else return opt<string>();
 		}
+		string_view
+		iterator_base::name_view_here() const
+		{
+			if (!is_real_die_position()) return string_view();
+			string_view from_reader;
+			if (state == OFFSET_ONLY && p_root->reader_name_view(m_off, &from_reader)) return from_reader;
+			ensure_handle();
+			if (state == HANDLE_ONLY) return cur_handle.name_view_here();
+			return cur_payload->get_name_view();
+		}
+		string_view
+		iterator_base::global_name_view_here() const
+		{
+			string_view name = name_view_here();
+			if (name.data() &&
+					(!has_attr_here(DW_AT_visibility) 
+						|| attr(DW_AT_visibility).get_unsigned()
+							 != DW_VIS_local)) return name;
+			else return string_view();
+		}
 		bool iterator_base::has_attr_here(Dwarf_Half attr) const
 		{
 			if (!is_real_die_position()) return false;
+			bool from_reader;
+			if (state == OFFSET_ONLY && p_root->reader_has_attr(m_off, attr, &from_reader)) return from_reader;
 			return get_handle().has_attr(attr);
 		}		
 		iterator_base iterator_base::nearest_enclosing(Dwarf_Half tag) const
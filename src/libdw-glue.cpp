@@ -0,0 +1,96 @@
+/* dwarfpp: C++ binding for a useful subset of libdwarf, plus extra goodies.
+ *
+ * libdw-glue.cpp: the few libdw calls libdw_reader makes
+ *
+ * Copyright (c) 2008--17, Stephen Kell. For licensing information, see the
+ * LICENSE file in the root of the libdwarfpp tree.
+ */
+
+/* Nothing of ours but the glue header; see there for why. */
+#include <elfutils/libdw.h>
+#include "libdw-glue.hpp"
+
+namespace dwarf
+{
+	namespace core
+	{
+		namespace libdw_glue
+		{
+			static ::Dwarf *dbg(session *s) { return reinterpret_cast< ::Dwarf *>(s); }
+
+			session *begin(int fd, void *elf)
+			{
+				::Dwarf *d = elf ? dwarf_begin_elf(static_cast< ::Elf *>(elf), DWARF_C_READ, nullptr)
+					: dwarf_begin(fd, DWARF_C_READ);
+				return reinterpret_cast<session *>(d);
+			}
+
+			void end(session *s)
+			{
+				/* libdw doesn't elf_end() an Elf it was given, so our image
+				 * handle still owns it. */
+				if (s) dwarf_end(dbg(s));
+			}
+
+			bool read_units(session *s, std::vector<unit_info>& out)
+			{
+				Dwarf_Off off = 0, next_off;
+				size_t header_size;
+				int ret;
+				/* dwarf_next_unit knows DWARF 5's unit headers, which
+				 * dwarf_nextcu doesn't (in older elfutils, anyway). */
+				while ((ret = dwarf_next_unit(dbg(s), off, &next_off, &header_size,
+					nullptr, nullptr, nullptr, nullptr, nullptr, nullptr)) == 0)
+				{
+					out.push_back((unit_info) { .offset = off, .end = next_off,
+						.die_offset = off + header_size });
+					off = next_off;
+				}
+				return ret == 1; // 1 means we ran out of units; -1 is an error
+			}
+
+			unsigned tag_at(session *s, uint64_t off)
+			{
+				Dwarf_Die d;
+				if (!dwarf_offdie(dbg(s), off, &d)) return 0;
+				int tag = dwarf_tag(&d);
+				return tag == DW_TAG_invalid ? 0 : tag;
+			}
+
+			uint64_t first_child(session *s, uint64_t off)
+			{
+				Dwarf_Die d, child;
+				if (!dwarf_offdie(dbg(s), off, &d)) return 0;
+				if (dwarf_child(&d, &child) != 0) return 0;
+				return dwarf_dieoffset(&child);
+			}
+
+			uint64_t next_sibling(session *s, uint64_t off)
+			{
+				/* Like us, libdw uses DW_AT_sibling where it's there. */
+				Dwarf_Die d, sib;
+				if (!dwarf_offdie(dbg(s), off, &d)) return 0;
+				if (dwarf_siblingof(&d, &sib) != 0) return 0;
+				return dwarf_dieoffset(&sib);
+			}
+
+			bool has_attr(session *s, uint64_t off, unsigned attr)
+			{
+				Dwarf_Die d;
+				if (!dwarf_offdie(dbg(s), off, &d)) return false;
+				return dwarf_hasattr(&d, attr);
+			}
+
+			const char *name(session *s, uint64_t off)
+			{
+				/* Not dwarf_diename(), which in newer elfutils follows
+				 * DW_AT_abstract_origin and DW_AT_specification; libdwarf
+				 * and our other readers only give a DIE's own name. */
+				Dwarf_Die d;
+				Dwarf_Attribute a;
+				if (!dwarf_offdie(dbg(s), off, &d)) return nullptr;
+				return dwarf_formstring(dwarf_attr(&d, DW_AT_name, &a));
+			}
+		}
+	}
+}
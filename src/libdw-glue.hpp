@@ -0,0 +1,52 @@
+/* dwarfpp: C++ binding for a useful subset of libdwarf, plus extra goodies.
+ *
+ * libdw-glue.hpp: the few libdw calls libdw_reader makes, without libdw's headers
+ *
+ * Copyright (c) 2008--17, Stephen Kell. For licensing information, see the
+ * LICENSE file in the root of the libdwarfpp tree.
+ */
+
+#ifndef DWARFPP_LIBDW_GLUE_HPP_
+#define DWARFPP_LIBDW_GLUE_HPP_
+
+/* elfutils' dwarf.h defines the DW_* constants as enumerators, and
+ * libdwarf's defines them as macros, so no file can include both. This
+ * header is the wall between them: libdw-glue.cpp includes libdw.h and
+ * nothing of ours, and libdw-reader.cpp includes this and nothing of
+ * libdw's. Hence plain integer types. Not installed. */
+
+#include <cstdint>
+#include <vector>
+
+namespace dwarf
+{
+	namespace core
+	{
+		namespace libdw_glue
+		{
+			struct session; // a ::Dwarf *, really
+			struct unit_info
+			{
+				uint64_t offset;     // of the header
+				uint64_t end;        // one past the last byte
+				uint64_t die_offset; // of the unit DIE
+			};
+
+			/* libdw reads elf if it's non-null, else opens fd itself.
+			 * Null if libdw won't, e.g. there's no .debug_info. */
+			session *begin(int fd, void *elf);
+			void end(session *s);
+			/* The units in .debug_info, in offset order. */
+			bool read_units(session *s, std::vector<unit_info>& out);
+
+			/* As in die_reader, 0 means no DIE, and a null name no name. */
+			unsigned tag_at(session *s, uint64_t off);
+			uint64_t first_child(session *s, uint64_t off);
+			uint64_t next_sibling(session *s, uint64_t off);
+			bool has_attr(session *s, uint64_t off, unsigned attr);
+			const char *name(session *s, uint64_t off);
+		}
+	}
+}
+
+#endif
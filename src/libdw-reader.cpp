@@ -0,0 +1,68 @@
+/* dwarfpp: C++ binding for a useful subset of libdwarf, plus extra goodies.
+ *
+ * libdw-reader.cpp: navigating with elfutils' libdw instead of libdwarf
+ *
+ * Copyright (c) 2008--17, Stephen Kell. For licensing information, see the
+ * LICENSE file in the root of the libdwarfpp tree.
+ */
+
+#include <algorithm>
+
+#include "dwarfpp/libdw-reader.hpp"
+#include "libdw-glue.hpp"
+
+namespace dwarf
+{
+	namespace core
+	{
+		libdw_reader::libdw_reader(int fd, ::Elf *elf) : s(libdw_glue::begin(fd, elf))
+		{
+			if (!s) return;
+			std::vector<libdw_glue::unit_info> found;
+			if (!libdw_glue::read_units(s, found))
+			{
+				debug(1) << "libdw couldn't read all the unit headers" << std::endl;
+				libdw_glue::end(s);
+				s = nullptr;
+				return;
+			}
+			for (auto i = found.begin(); i != found.end(); ++i)
+			{
+				units.push_back((unit) { .offset = i->offset, .end = i->end,
+					.die_offset = i->die_offset });
+			}
+		}
+
+		libdw_reader::~libdw_reader()
+		{
+			libdw_glue::end(s);
+		}
+
+		bool libdw_reader::unit_index_for(Dwarf_Off off, unsigned *p_idx) const
+		{
+			auto found = std::upper_bound(units.begin(), units.end(), off,
+				[](Dwarf_Off o, const unit& u) { return o < u.offset; });
+			if (found == units.begin()) return false;
+			--found;
+			if (off < found->die_offset || off >= found->end) return false;
+			*p_idx = found - units.begin();
+			return true;
+		}
+
+		/* libdw finds the unit from the offset itself, so we ignore u. */
+		Dwarf_Half libdw_reader::tag_at(unsigned u, Dwarf_Off off) const
+		{ return libdw_glue::tag_at(s, off); }
+		Dwarf_Off libdw_reader::first_child(unsigned u, Dwarf_Off off) const
+		{ return libdw_glue::first_child(s, off); }
+		Dwarf_Off libdw_reader::next_sibling(unsigned u, Dwarf_Off off) const
+		{ return libdw_glue::next_sibling(s, off); }
+		bool libdw_reader::has_attr(unsigned u, Dwarf_Off off, Dwarf_Half attr) const
+		{ return libdw_glue::has_attr(s, off, attr); }
+
+		string_view libdw_reader::name(unsigned u, Dwarf_Off off) const
+		{
+			const char *n = libdw_glue::name(s, off);
+			return n ? string_view(n) : string_view();
+		}
+	}
+}
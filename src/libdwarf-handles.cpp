@@ -24,11 +24,19 @@ namespace dwarf
 {
 	namespace core
 	{
+		std::atomic<unsigned> frozen_root_count(0);
+		std::recursive_mutex& libdwarf_alloc_mutex()
+		{
+			static std::recursive_mutex m;
+			return m;
+		}
+
 		Die::handle_type 
 		Die::try_construct(root_die& r, const iterator_base& it) /* siblingof */
 		{
 			raw_handle_type returned;
 			if (!dynamic_cast<Die *>(&it.get_handle())) return handle_type(nullptr, deleter(nullptr, r));
+			libdwarf_alloc_guard g;
 			int ret = dwarf_siblingof(r.dbg.handle.get(), dynamic_cast<Die&>(it.get_handle()).handle.get(), 
 			    &returned, &current_dwarf_error);
 			if (ret == DW_DLV_OK) return handle_type(returned, deleter(r.dbg.handle.get(), r));
@@ -39,6 +47,7 @@ namespace dwarf
 		{
 			raw_handle_type returned;
 			if (!r.dbg.handle) return handle_type(nullptr, deleter(nullptr, r));
+			libdwarf_alloc_guard g;
 			int ret = dwarf_siblingof(r.dbg.handle.get(), nullptr, &returned, &current_dwarf_error);
 			if (ret == DW_DLV_OK) return handle_type(returned, deleter(r.dbg.handle.get(), r));
 			else return handle_type(nullptr, deleter(nullptr, r));
@@ -49,6 +58,7 @@ namespace dwarf
 			raw_handle_type returned;
 			root_die& r = it.get_root();
 			if (!dynamic_cast<Die *>(&it.get_handle())) return handle_type(nullptr, deleter(nullptr, r));
+			libdwarf_alloc_guard g;
 			int ret = dwarf_child(dynamic_cast<Die&>(it.get_handle()).handle.get(), &returned, &current_dwarf_error);
 			if (ret == DW_DLV_OK) return handle_type(returned, deleter(it.get_root().dbg.handle.get(), r));
 			else return handle_type(nullptr, deleter(nullptr, r));
@@ -58,6 +68,7 @@ namespace dwarf
 		{
 			raw_handle_type returned;
 			if (!r.dbg.handle) return handle_type(nullptr, deleter(nullptr, r));
+			libdwarf_alloc_guard g;
 			int ret = dwarf_offdie(r.dbg.handle.get(), off, &returned, &current_dwarf_error);
 			if (ret == DW_DLV_OK) return handle_type(returned, deleter(r.dbg.handle.get(), r));
 			else return handle_type(nullptr, deleter(nullptr, r));
@@ -77,6 +88,7 @@ namespace dwarf
 		 : handle(try_construct(r, it))
 		{ 
 			if (!this->handle) throw Error(current_dwarf_error, 0);
+			if (r.is_frozen()) return; // caches are read-only
 			// also update the parent cache and sibling cache.
 			// 1. "it"'s parent is our parent; what is "it"'s parent?
 			Dwarf_Off off = this->offset_here();
@@ -85,6 +97,7 @@ namespace dwarf
 			else
 			{
 				auto found = r.parent_of.find(it.offset_here());
+				DWARFPP_STAT_HIT(r, found != r.parent_of.end(), parent_of);
 				if (found != r.parent_of.end()) it_parent_off = opt<Dwarf_Off>(found->second);
 			}
 			if (it_parent_off)
@@ -103,6 +116,7 @@ namespace dwarf
 		 : handle(try_construct(r))
 		{ 
 			if (!this->handle) throw Error(current_dwarf_error, 0); 
+			if (r.is_frozen()) return;
 			// update parent cache
 			Dwarf_Off off = this->offset_here();
 			r.parent_of[off] = 0UL; // FIXME: looks wrong
@@ -119,6 +133,7 @@ namespace dwarf
 		{
 			root_die& r = it.get_root();
 			if (!this->handle) throw Error(current_dwarf_error, 0);
+			if (r.is_frozen()) return;
 			Dwarf_Off off = this->offset_here();
 			r.parent_of[off] = it.offset_here();
 			// first_child_of, next_sibling_of
@@ -141,7 +156,7 @@ namespace dwarf
 
 			// this spec_here() is only used from the factory, and not 
 			// used in the CU case because the factory handles that specially
-			assert(tag_here() != DW_TAG_compile_unit); 
+			assert(!tag_is_cu(tag_here())); 
 			
 			Dwarf_Off cu_offset = enclosing_cu_offset_here();
 			// this should be sticky, hence fast to find
@@ -168,7 +183,7 @@ namespace dwarf
 // 				// return nearest_enclosing(DW_TAG_compile_unit).spec_here();
 		
 		}
-		Debug::Debug(int fd)
+		Debug::Debug(int fd) : object_elf(nullptr)
 		{
 			Dwarf_Debug returned;
 			int ret = dwarf_init(fd, DW_DLC_READ, exception_error_handler, 
@@ -177,7 +192,7 @@ namespace dwarf
 			this->handle = handle_type(returned);
 		}
 		
-		Debug::Debug(Elf *elf)
+		Debug::Debug(Elf *elf) : object_elf(nullptr)
 		{
 			Dwarf_Debug returned;
 			int ret = dwarf_elf_init(reinterpret_cast<dwarf::lib::Elf_opaque_in_libdwarf*>(elf), 
@@ -187,10 +202,20 @@ namespace dwarf
 			this->handle = handle_type(returned);
 		}
 		
+		Debug::Debug(Dwarf_Obj_Access_Interface *obj, Elf *elf) : object_elf(elf)
+		{
+			Dwarf_Debug returned;
+			int ret = dwarf_object_init(obj, exception_error_handler, 
+				nullptr, &returned, &current_dwarf_error);
+			assert(ret == DW_DLV_OK);
+			this->handle = handle_type(returned, deleter(true));
+		}
+		
 		void 
 		Debug::deleter::operator()(raw_handle_type arg) const
 		{
-			dwarf_finish(arg, &current_dwarf_error);
+			if (via_object) dwarf_object_finish(arg, &current_dwarf_error);
+			else dwarf_finish(arg, &current_dwarf_error);
 		}
 		
 		std::ostream& operator<<(std::ostream& s, const AttributeList& attrs)
@@ -221,6 +246,7 @@ namespace dwarf
 		Die::name_here() const
 		{
 			char *str;
+			libdwarf_alloc_guard g;
 			int ret = dwarf_diename(raw_handle(), &str, &current_dwarf_error);
 			if (ret == DW_DLV_NO_ENTRY) return nullptr;
 			if (ret == DW_DLV_OK) return unique_ptr<const char, string_deleter>(
@@ -229,6 +255,18 @@ namespace dwarf
 			//	<< dwarf_errormsg(current_dwarf_error) << ")" << std::endl; 
 			abort();
 		}
+		string_view
+		Die::name_view_here() const
+		{
+			/* libdwarf hands back a pointer into the section data, not a copy,
+			 * so there's nothing to dealloc (that's a no-op for these). */
+			char *str;
+			libdwarf_alloc_guard g;
+			int ret = dwarf_diename(raw_handle(), &str, &current_dwarf_error);
+			if (ret == DW_DLV_NO_ENTRY) return string_view();
+			if (ret == DW_DLV_OK) return string_view(str);
+			abort();
+		}
 		bool Die::has_attr_here(Dwarf_Half attr) const
 		{
 			Dwarf_Bool returned;
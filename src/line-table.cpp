@@ -0,0 +1,242 @@
+/* dwarfpp: C++ binding for a useful subset of libdwarf, plus extra goodies.
+ *
+ * line-table.cpp: decoded line number programs, and a pc-to-line index
+ *
+ * Copyright (c) 2008--17, Stephen Kell. For licensing information, see the
+ * LICENSE file in the root of the libdwarfpp tree.
+ */
+
+#include <algorithm>
+
+#include "dwarfpp/root.hpp"
+#include "dwarfpp/root-inl.hpp"
+#include "dwarfpp/iter.hpp"
+#include "dwarfpp/iter-inl.hpp"
+#include "dwarfpp/dies.hpp"
+#include "dwarfpp/dies-inl.hpp"
+
+namespace dwarf
+{
+	using std::endl;
+	using std::vector;
+	using std::string;
+	namespace core
+	{
+		typedef line_table::row row;
+
+		const row *line_table::find_in(const vector<row>& rows, Dwarf_Addr addr)
+		{
+			/* Of several rows at one address, the last one wins, and that
+			 * includes the start of a sequence beginning where another ends. */
+			auto found = std::upper_bound(rows.begin(), rows.end(), addr,
+				[](Dwarf_Addr a, const row& r) { return a < r.addr; });
+			if (found == rows.begin()) return nullptr;
+			--found;
+			if (found->end_sequence) return nullptr;
+			return &*found;
+		}
+
+		unsigned line_table::sort_sequences(vector<row>& rows)
+		{
+			/* [begin, end) index pairs, each end row included */
+			vector<std::pair<unsigned, unsigned> > seqs;
+			unsigned start = 0;
+			for (unsigned i = 0; i < rows.size(); ++i)
+			{
+				if (rows[i].end_sequence)
+				{
+					seqs.push_back(std::make_pair(start, i + 1));
+					start = i + 1;
+				}
+			}
+			// trailing rows without an end_sequence are malformed; drop them
+			std::stable_sort(seqs.begin(), seqs.end(),
+				[&rows](const std::pair<unsigned, unsigned>& a, const std::pair<unsigned, unsigned>& b) {
+					return rows[a.first].addr < rows[b.first].addr;
+				});
+			vector<row> sorted;
+			sorted.reserve(rows.size());
+			unsigned n_dropped = 0;
+			for (auto i_seq = seqs.begin(); i_seq != seqs.end(); ++i_seq)
+			{
+				const row& first = rows[i_seq->first];
+				const row& last = rows[i_seq->second - 1];
+				if (last.addr <= first.addr) { ++n_dropped; continue; } // empty
+				if (!sorted.empty() && first.addr < sorted.back().addr) { ++n_dropped; continue; }
+				sorted.insert(sorted.end(), rows.begin() + i_seq->first, rows.begin() + i_seq->second);
+			}
+			sorted.shrink_to_fit();
+			rows = std::move(sorted);
+			return n_dropped;
+		}
+
+		unsigned root_die::intern_line_file(const string& name)
+		{
+			auto found = line_file_ids.find(name);
+			if (found != line_file_ids.end()) return found->second;
+			unsigned id = line_file_names.size();
+			line_file_names.push_back(name);
+			line_file_ids.insert(make_pair(name, id));
+			return id;
+		}
+
+		/* What dirname(3) would say, without copying into a buffer. */
+		static string parent_dir(const string& dir)
+		{
+			size_t last = dir.find_last_not_of('/');
+			if (last == string::npos) return dir.empty() ? "." : "/";
+			size_t slash = dir.rfind('/', last);
+			if (slash == string::npos) return ".";
+			size_t end = dir.find_last_not_of('/', slash);
+			return (end == string::npos) ? "/" : dir.substr(0, end + 1);
+		}
+
+		opt<string> source_file_table::fq_pathname(const opt<string>& comp_dir, const string& name)
+		{
+			if (!name.empty() && name[0] == '/') return opt<string>(name);
+			if (!comp_dir) return opt<string>();
+			/* The name can start with "../"s, each taking us up a level. */
+			string dir = *comp_dir;
+			size_t pos = 0;
+			for (; name.compare(pos, 3, "../") == 0; pos += 3) dir = parent_dir(dir);
+			return opt<string>(dir + "/" + name.substr(pos));
+		}
+
+		shared_ptr<const source_file_table>
+		compile_unit_die::get_source_files() const
+		{
+			if (cached_source_files) return cached_source_files;
+			root_die& r = get_root();
+			if (r.is_frozen() || !d.handle) return shared_ptr<const source_file_table>();
+			auto p_files = std::make_shared<source_file_table>();
+			/* libdwarf gives us DWARF 5's file 0 as well, so the list
+			 * starts at whichever number the CU's version counts from.
+			 * We take the CU's version for its line program's, since
+			 * dwarf_srclines() doesn't tell us the latter. */
+			p_files->first_fileno = source_file_base();
+			opt<string> maybe_dir = get_comp_dir();
+			char **files;
+			Dwarf_Signed n_files;
+			if (DW_DLV_OK == dwarf_srcfiles(d.raw_handle(), &files, &n_files, &current_dwarf_error))
+			{
+				p_files->names.reserve(n_files);
+				p_files->paths.reserve(n_files);
+				for (Dwarf_Signed i = 0; i < n_files; ++i)
+				{
+					string name = files[i];
+					p_files->names.push_back(r.intern_line_file(name));
+					opt<string> path = source_file_table::fq_pathname(maybe_dir, name);
+					p_files->paths.push_back(path ? r.intern_line_file(*path) : source_file_table::NONE);
+					dwarf_dealloc(d.get_dbg(), files[i], DW_DLA_STRING);
+				}
+				dwarf_dealloc(d.get_dbg(), files, DW_DLA_LIST);
+			}
+			cached_source_files = p_files;
+			return cached_source_files;
+		}
+
+		shared_ptr<const line_table>
+		compile_unit_die::get_line_table() const
+		{
+			if (cached_line_table) return cached_line_table;
+			root_die& r = get_root();
+			if (r.is_frozen() || !d.handle) return shared_ptr<const line_table>();
+			auto p_t = std::make_shared<line_table>();
+
+			/* File names: as in source_file_fq_pathname(), or as given if
+			 * we can't make them absolute. */
+			auto p_files = get_source_files();
+			for (unsigned i = 0; i < p_files->paths.size(); ++i)
+			{
+				p_t->files.push_back((p_files->paths[i] != source_file_table::NONE)
+					? p_files->paths[i] : p_files->names[i]);
+			}
+
+			Dwarf_Line *lines;
+			Dwarf_Signed n_lines;
+			if (DW_DLV_OK == dwarf_srclines(d.raw_handle(), &lines, &n_lines, &current_dwarf_error))
+			{
+				p_t->rows.reserve(n_lines);
+				for (Dwarf_Signed i = 0; i < n_lines; ++i)
+				{
+					Dwarf_Addr addr = 0;
+					Dwarf_Unsigned lineno = 0, fileno = 0;
+					Dwarf_Signed column = 0;
+					Dwarf_Bool is_stmt = 0, end_sequence = 0;
+					if (DW_DLV_OK != dwarf_lineaddr(lines[i], &addr, &current_dwarf_error)) continue;
+					dwarf_lineno(lines[i], &lineno, &current_dwarf_error);
+					dwarf_line_srcfileno(lines[i], &fileno, &current_dwarf_error);
+					dwarf_lineoff(lines[i], &column, &current_dwarf_error);
+					dwarf_linebeginstatement(lines[i], &is_stmt, &current_dwarf_error);
+					dwarf_lineendsequence(lines[i], &end_sequence, &current_dwarf_error);
+					/* File numbers count from the table's first; before
+					 * DWARF 5, 0 means no file. */
+					Dwarf_Unsigned base = p_files->first_fileno;
+					unsigned file = (fileno >= base && fileno - base < p_t->files.size())
+						? p_t->files[fileno - base] : r.intern_line_file("");
+					p_t->rows.push_back((row) {
+						.addr = addr,
+						.file = file,
+						.line = (unsigned) lineno,
+						.column = (unsigned short) (column < 0 ? 0 : column),
+						.is_stmt = (bool) is_stmt,
+						.end_sequence = (bool) end_sequence
+					});
+				}
+				dwarf_srclines_dealloc(d.get_dbg(), lines, n_lines);
+			}
+			unsigned n_dropped = line_table::sort_sequences(p_t->rows);
+			if (n_dropped > 0)
+			{
+				debug(2) << "Dropped " << n_dropped << " empty or overlapping line sequences in CU "
+					<< summary() << endl;
+			}
+			cached_line_table = p_t;
+			return cached_line_table;
+		}
+
+		bool root_die::build_line_index()
+		{
+			clear_line_index();
+			if (!dbg.handle || frozen) return false;
+			auto cus = begin().children_here();
+			unsigned n_cus = 0;
+			for (auto i_cu = std::move(cus.first); i_cu != cus.second; ++i_cu)
+			{
+				auto p_t = i_cu.as_a<compile_unit_die>()->get_line_table();
+				if (!p_t) continue;
+				line_index.insert(line_index.end(), p_t->rows.begin(), p_t->rows.end());
+				++n_cus;
+			}
+			unsigned n_dropped = line_table::sort_sequences(line_index);
+			line_index_built = true;
+			debug(2) << "Built line index of " << line_index.size() << " rows from "
+				<< n_cus << " CUs, dropping " << n_dropped << " overlapping sequences" << endl;
+			return true;
+		}
+
+		const line_table::row *root_die::pc_to_line(Dwarf_Addr file_relative_addr)
+		{
+			if (!line_index_built && !frozen) build_line_index();
+			return line_table::find_in(line_index, file_relative_addr);
+		}
+
+		void root_die::pc_to_line(const vector<Dwarf_Addr>& sorted_addrs,
+			vector<const line_table::row *>& out)
+		{
+			if (!line_index_built && !frozen) build_line_index();
+			out.clear();
+			out.reserve(sorted_addrs.size());
+			/* Each search starts where the last left off. */
+			auto lo = line_index.begin();
+			for (auto i_addr = sorted_addrs.begin(); i_addr != sorted_addrs.end(); ++i_addr)
+			{
+				assert(i_addr == sorted_addrs.begin() || *(i_addr - 1) <= *i_addr);
+				lo = std::upper_bound(lo, line_index.end(), *i_addr,
+					[](Dwarf_Addr a, const row& r) { return a < r.addr; });
+				if (lo == line_index.begin() || (lo - 1)->end_sequence) out.push_back(nullptr);
+				else out.push_back(&*(lo - 1));
+			}
+		}
+	}
+}
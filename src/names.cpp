@@ -0,0 +1,44 @@
+/* dwarfpp: C++ binding for a useful subset of libdwarf, plus extra goodies.
+ *
+ * names.cpp: interning DIE names
+ *
+ * Copyright (c) 2008--17, Stephen Kell. For licensing information, see the
+ * LICENSE file in the root of the libdwarfpp tree.
+ */
+
+#include "dwarfpp/root.hpp"
+
+namespace dwarf
+{
+	namespace core
+	{
+		size_t name_interner::view_hash::operator()(string_view s) const
+		{
+			/* FNV-1a. std::hash would want a std::string. */
+			size_t h = 14695981039346656037ull;
+			for (auto i = s.begin(); i != s.end(); ++i)
+			{
+				h ^= (unsigned char) *i;
+				h *= 1099511628211ull;
+			}
+			return h;
+		}
+
+		unsigned name_interner::intern(string_view s)
+		{
+			auto found = ids.find(s);
+			if (found != ids.end()) return found->second;
+			unsigned id = names.size();
+			assert(id != NONE);
+			names.push_back(string(s.data(), s.size()));
+			ids.insert(make_pair(string_view(names.back()), id));
+			return id;
+		}
+
+		unsigned name_interner::lookup(string_view s) const
+		{
+			auto found = ids.find(s);
+			return (found == ids.end()) ? (unsigned) NONE : found->second;
+		}
+	}
+}
@@ -0,0 +1,928 @@
+/* dwarfpp: C++ binding for a useful subset of libdwarf, plus extra goodies.
+ *
+ * native-reader.cpp: decoding .debug_info ourselves, without libdwarf
+ *
+ * Copyright (c) 2008--17, Stephen Kell. For licensing information, see the
+ * LICENSE file in the root of the libdwarfpp tree.
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <srk31/endian.hpp>
+
+#include "dwarfpp/native-reader.hpp"
+#include "dwarfpp/section-loader.hpp"
+#include "dwarfpp/leb128.hpp"
+
+namespace dwarf
+{
+	using std::endl;
+	namespace core
+	{
+		namespace
+		{
+			/* DWARF 5 (and GNU) forms and unit types, which an older dwarf.h
+			 * may not define for us. */
+			enum
+			{
+				FORM_strx = 0x1a, FORM_addrx = 0x1b, FORM_ref_sup4 = 0x1c,
+				FORM_strp_sup = 0x1d, FORM_data16 = 0x1e, FORM_line_strp = 0x1f,
+				FORM_ref_sig8 = 0x20, FORM_implicit_const = 0x21, FORM_loclistx = 0x22,
+				FORM_rnglistx = 0x23, FORM_ref_sup8 = 0x24,
+				FORM_strx1 = 0x25, FORM_strx2 = 0x26, FORM_strx3 = 0x27, FORM_strx4 = 0x28,
+				FORM_addrx1 = 0x29, FORM_addrx2 = 0x2a, FORM_addrx3 = 0x2b, FORM_addrx4 = 0x2c,
+				FORM_GNU_addr_index = 0x1f01, FORM_GNU_str_index = 0x1f02,
+				FORM_GNU_ref_alt = 0x1f20, FORM_GNU_strp_alt = 0x1f21
+			};
+			enum
+			{
+				UT_compile = 1, UT_type = 2, UT_partial = 3, UT_skeleton = 4,
+				UT_split_compile = 5, UT_split_type = 6
+			};
+			enum
+			{
+				AT_str_offsets_base = 0x72, AT_addr_base = 0x73, AT_rnglists_base = 0x74,
+				AT_loclists_base = 0x8c, AT_GNU_addr_base = 0x2133
+			};
+			/* The location list kinds are these too, except that
+			 * DW_LLE_default_location comes at 5, pushing the last three
+			 * up by one. LIST_default is ours, for it. */
+			enum
+			{
+				RLE_end_of_list = 0, RLE_base_addressx = 1, RLE_startx_endx = 2,
+				RLE_startx_length = 3, RLE_offset_pair = 4, RLE_base_address = 5,
+				RLE_start_end = 6, RLE_start_length = 7,
+				LLE_default_location = 5, LLE_start_length = 8, LLE_GNU_view_pair = 9,
+				LIST_default = 0x100
+			};
+
+			/* Host-endian, like the section_loader that gives us our bytes. */
+			inline bool read_fixed(const unsigned char *&p, const unsigned char *end,
+				unsigned n, Dwarf_Unsigned *out)
+			{
+				if ((size_t) (end - p) < n) return false;
+				Dwarf_Unsigned v = 0;
+				switch (n)
+				{
+					case 1: v = *p; break;
+					case 2: { uint16_t x; memcpy(&x, p, 2); v = x; } break;
+					case 3: // only for strx3 and addrx3
+						v = srk31::host_is_little_endian()
+							? (p[0] | (p[1] << 8) | (p[2] << 16))
+							: ((p[0] << 16) | (p[1] << 8) | p[2]);
+						break;
+					case 4: { uint32_t x; memcpy(&x, p, 4); v = x; } break;
+					case 8: { uint64_t x; memcpy(&x, p, 8); v = x; } break;
+					default: return false;
+				}
+				p += n;
+				if (out) *out = v;
+				return true;
+			}
+			/* Forms naming a DIE in our own .debug_info. */
+			inline bool is_die_ref_form(Dwarf_Half form)
+			{
+				switch (form)
+				{
+					case DW_FORM_ref1: case DW_FORM_ref2: case DW_FORM_ref4: case DW_FORM_ref8:
+					case DW_FORM_ref_udata: case DW_FORM_ref_addr:
+						return true;
+					default:
+						return false;
+				}
+			}
+
+			/* Where the range list at off in .debug_ranges ends: just past
+			 * its (0, 0) pair. (.debug_rnglists we decode; see read_list().) */
+			const unsigned char *range_list_end(const native_reader::bytes& sec,
+				unsigned address_size, Dwarf_Unsigned off)
+			{
+				if (!sec.data || off >= sec.size) return nullptr;
+				const unsigned char *p = sec.data + off;
+				const unsigned char *end = sec.data + sec.size;
+				Dwarf_Unsigned a, b;
+				while (true)
+				{
+					if (!read_fixed(p, end, address_size, &a)
+						|| !read_fixed(p, end, address_size, &b)) return nullptr;
+					if (a == 0 && b == 0) return p;
+				}
+			}
+
+			/* FNV-1a, as in names.cpp, but 64 bits wide. */
+			struct fnv_hash
+			{
+				uint64_t h;
+				fnv_hash() : h(14695981039346656037ull) {}
+				void add(const void *p, size_t n)
+				{
+					const unsigned char *c = (const unsigned char *) p;
+					for (size_t i = 0; i < n; ++i) { h ^= c[i]; h *= 1099511628211ull; }
+				}
+				void add_u(Dwarf_Unsigned v) { add(&v, sizeof v); }
+			};
+
+			/* Types whose declarations find_definition() may look for elsewhere. */
+			inline bool is_definable_type_tag(Dwarf_Half tag)
+			{
+				switch (tag)
+				{
+					case DW_TAG_structure_type: case DW_TAG_class_type:
+					case DW_TAG_union_type: case DW_TAG_enumeration_type:
+						return true;
+					default:
+						return false;
+				}
+			}
+		}
+
+		const native_reader::abbrev *native_reader::abbrev_table::find(Dwarf_Unsigned code) const
+		{
+			if (code >= 1 && code <= dense.size())
+			{
+				const abbrev& a = dense[code - 1];
+				return a.tag ? &a : nullptr;
+			}
+			auto found = sparse.find(code);
+			return (found == sparse.end()) ? nullptr : &found->second;
+		}
+
+		bool native_reader::read_abbrev_table(Dwarf_Off off, abbrev_table& t)
+		{
+			if (off >= secs.abbrev.size) return false;
+			const unsigned char *p = secs.abbrev.data + off;
+			const unsigned char *end = secs.abbrev.data + secs.abbrev.size;
+			while (true)
+			{
+				Dwarf_Unsigned code;
+				if (!read_uleb128(p, end, &code)) return false;
+				if (code == 0) break;
+				Dwarf_Unsigned tag;
+				if (!read_uleb128(p, end, &tag) || p == end) return false;
+				abbrev a = (abbrev) {
+					.tag = (Dwarf_Half) tag,
+					.has_children = (*p++ != 0),
+					.has_sibling_attr = false,
+					.first_attr = (unsigned) t.attrs.size(),
+					.n_attrs = 0
+				};
+				while (true)
+				{
+					Dwarf_Unsigned attr_form[2];
+					if (read_uleb128s(p, end, attr_form, 2) != 2) return false;
+					Dwarf_Unsigned attr = attr_form[0], form = attr_form[1];
+					if (attr == 0 && form == 0) break;
+					Dwarf_Signed implicit_const = 0;
+					if (form == FORM_implicit_const && !read_sleb128(p, end, &implicit_const)) return false;
+					if (attr == DW_AT_sibling) a.has_sibling_attr = true;
+					t.attrs.push_back((attr_spec) {
+						.attr = (Dwarf_Half) attr,
+						.form = (Dwarf_Half) form,
+						.implicit_const = implicit_const
+					});
+					++a.n_attrs;
+				}
+				/* Don't let one silly code make a huge dense table. */
+				if (code <= t.dense.size() + 64)
+				{
+					if (code > t.dense.size()) t.dense.resize(code, (abbrev) { .tag = 0 });
+					t.dense[code - 1] = a;
+				}
+				else t.sparse.insert(std::make_pair(code, a));
+			}
+			return true;
+		}
+
+		shared_ptr<native_reader> native_reader::from_loader(section_loader& loader)
+		{
+			native_reader::sections s;
+			native_reader::bytes *secs[] = { &s.info, &s.abbrev, &s.str, &s.line_str, &s.str_offsets,
+				&s.ranges, &s.rnglists, &s.addr, &s.loclists };
+			const char *names[] = { ".debug_info", ".debug_abbrev", ".debug_str", ".debug_line_str",
+				".debug_str_offsets", ".debug_ranges", ".debug_rnglists", ".debug_addr", ".debug_loclists" };
+			for (unsigned i = 0; i < sizeof secs / sizeof secs[0]; ++i)
+			{
+				Dwarf_Unsigned size = 0;
+				if (!loader.get_section(names[i], &secs[i]->data, &size)) secs[i]->data = nullptr;
+				secs[i]->size = secs[i]->data ? size : 0;
+			}
+			if (!s.info.data || !s.abbrev.data) return nullptr;
+			auto p = std::make_shared<native_reader>(s);
+			return p->ok() ? p : nullptr;
+		}
+
+		native_reader::native_reader(const sections& s) : secs(s), m_ok(false)
+		{
+			const unsigned char *begin = secs.info.data;
+			const unsigned char *end = secs.info.data + secs.info.size;
+			const unsigned char *p = begin;
+			while (begin && p < end)
+			{
+				unit cu;
+				cu.offset = p - begin;
+				Dwarf_Unsigned length;
+				if (!read_fixed(p, end, 4, &length)) return;
+				cu.offset_size = 4;
+				if (length == 0xffffffffu)
+				{
+					if (!read_fixed(p, end, 8, &length)) return;
+					cu.offset_size = 8;
+				}
+				if (length > (Dwarf_Unsigned) (end - p)) return;
+				const unsigned char *unit_end = p + length;
+				cu.end = unit_end - begin;
+				Dwarf_Unsigned version, abbrev_off, address_size, unit_type = UT_compile;
+				if (!read_fixed(p, unit_end, 2, &version)) return;
+				cu.version = version;
+				if (version >= 5)
+				{
+					if (!read_fixed(p, unit_end, 1, &unit_type)
+						|| !read_fixed(p, unit_end, 1, &address_size)
+						|| !read_fixed(p, unit_end, cu.offset_size, &abbrev_off)) return;
+					if (unit_type == UT_skeleton || unit_type == UT_split_compile) p += 8; // dwo_id
+					else if (unit_type == UT_type || unit_type == UT_split_type) p += 8 + cu.offset_size;
+				}
+				else if (version >= 2)
+				{
+					if (!read_fixed(p, unit_end, cu.offset_size, &abbrev_off)
+						|| !read_fixed(p, unit_end, 1, &address_size)) return;
+				}
+				else return;
+				if (p > unit_end) return;
+				cu.address_size = address_size;
+				cu.die_offset = p - begin;
+				cu.str_offsets_base = cu.addr_base = cu.rnglists_base = cu.loclists_base = 0;
+				cu.base_address = 0;
+				auto found = abbrev_tables.find(abbrev_off);
+				if (found == abbrev_tables.end())
+				{
+					found = abbrev_tables.insert(std::make_pair(abbrev_off, abbrev_table())).first;
+					if (!read_abbrev_table(abbrev_off, found->second)) return;
+				}
+				cu.p_abbrevs = &found->second; // unordered_map elements don't move
+				units.push_back(cu);
+				p = unit_end;
+			}
+			/* DW_FORM_strx needs the unit DIE's DW_AT_str_offsets_base, and
+			 * so on, which themselves can't be indexed, so we can look them
+			 * up now. Without one, assume the table starts just after the
+			 * section's first header: 8 or 16 bytes for strings and
+			 * addresses, plus an offset count for lists. */
+			for (unsigned i = 0; i < units.size(); ++i)
+			{
+				unit& cu = units[i];
+				Dwarf_Off header_size = (cu.offset_size == 8) ? 16 : 8;
+				attr_value v;
+				cu.str_offsets_base = find_attr(i, cu.die_offset, AT_str_offsets_base, &v) ? v.u : header_size;
+				cu.addr_base = (find_attr(i, cu.die_offset, AT_addr_base, &v)
+					|| find_attr(i, cu.die_offset, AT_GNU_addr_base, &v)) ? v.u : header_size;
+				cu.rnglists_base = find_attr(i, cu.die_offset, AT_rnglists_base, &v) ? v.u : header_size + 4;
+				cu.loclists_base = find_attr(i, cu.die_offset, AT_loclists_base, &v) ? v.u : header_size + 4;
+				/* The low_pc may be an addrx, so this comes last. */
+				if (find_attr(i, cu.die_offset, DW_AT_low_pc, &v)) address_of(i, v, &cu.base_address);
+			}
+			m_ok = true;
+			debug(2) << "Native reader found " << units.size() << " units using "
+				<< abbrev_tables.size() << " abbreviation tables" << endl;
+		}
+
+		bool native_reader::unit_index_for(Dwarf_Off off, unsigned *p_idx) const
+		{
+			auto found = std::upper_bound(units.begin(), units.end(), off,
+				[](Dwarf_Off o, const unit& u) { return o < u.offset; });
+			if (found == units.begin()) return false;
+			--found;
+			if (off < found->die_offset || off >= found->end) return false;
+			*p_idx = found - units.begin();
+			return true;
+		}
+
+		const unsigned char *native_reader::read_form(const unit& cu, Dwarf_Half form,
+			Dwarf_Signed implicit_const, const unsigned char *p, const unsigned char *end,
+			attr_value *out) const
+		{
+			attr_value v = (attr_value) { .form = form, .u = 0, .s = 0, .block = nullptr, .block_len = 0, .str = nullptr };
+			Dwarf_Unsigned len;
+			bool ok = true;
+			switch (form)
+			{
+				case DW_FORM_addr: ok = read_fixed(p, end, cu.address_size, &v.u); break;
+				case DW_FORM_data1: case DW_FORM_ref1: case DW_FORM_flag: case FORM_strx1: case FORM_addrx1:
+					ok = read_fixed(p, end, 1, &v.u); break;
+				case DW_FORM_data2: case DW_FORM_ref2: case FORM_strx2: case FORM_addrx2:
+					ok = read_fixed(p, end, 2, &v.u); break;
+				case FORM_strx3: case FORM_addrx3:
+					ok = read_fixed(p, end, 3, &v.u); break;
+				case DW_FORM_data4: case DW_FORM_ref4: case FORM_ref_sup4: case FORM_strx4: case FORM_addrx4:
+					ok = read_fixed(p, end, 4, &v.u); break;
+				case DW_FORM_data8: case DW_FORM_ref8: case FORM_ref_sig8: case FORM_ref_sup8:
+					ok = read_fixed(p, end, 8, &v.u); break;
+				case FORM_data16:
+					ok = ((size_t) (end - p) >= 16); v.block = p; v.block_len = 16; p += 16; break;
+				case DW_FORM_sdata: ok = read_sleb128(p, end, &v.s); v.u = v.s; break;
+				case DW_FORM_udata: case DW_FORM_ref_udata: case FORM_strx: case FORM_addrx:
+				case FORM_loclistx: case FORM_rnglistx: case FORM_GNU_addr_index: case FORM_GNU_str_index:
+					ok = read_uleb128(p, end, &v.u); break;
+				case DW_FORM_strp: case DW_FORM_sec_offset: case FORM_line_strp: case FORM_strp_sup:
+				case FORM_GNU_ref_alt: case FORM_GNU_strp_alt:
+					ok = read_fixed(p, end, cu.offset_size, &v.u); break;
+				case DW_FORM_ref_addr:
+					ok = read_fixed(p, end, (cu.version <= 2) ? cu.address_size : cu.offset_size, &v.u); break;
+				case DW_FORM_string:
+				{
+					const unsigned char *nul = (const unsigned char *) memchr(p, 0, end - p);
+					if (!nul) return nullptr;
+					v.str = (const char *) p;
+					p = nul + 1;
+				} break;
+				case DW_FORM_block1: ok = read_fixed(p, end, 1, &len); goto block;
+				case DW_FORM_block2: ok = read_fixed(p, end, 2, &len); goto block;
+				case DW_FORM_block4: ok = read_fixed(p, end, 4, &len); goto block;
+				case DW_FORM_block: case DW_FORM_exprloc: ok = read_uleb128(p, end, &len);
+				block:
+					if (!ok || len > (Dwarf_Unsigned) (end - p)) return nullptr;
+					v.block = p; v.block_len = len; p += len;
+					break;
+				case DW_FORM_flag_present: v.u = 1; break;
+				case FORM_implicit_const: v.s = implicit_const; v.u = implicit_const; break;
+				case DW_FORM_indirect:
+				{
+					Dwarf_Unsigned real_form;
+					if (!read_uleb128(p, end, &real_form) || real_form == DW_FORM_indirect) return nullptr;
+					return read_form(cu, real_form, implicit_const, p, end, out);
+				}
+				default:
+					debug(2) << "Native reader doesn't know form 0x" << std::hex << form << std::dec << endl;
+					return nullptr;
+			}
+			if (!ok) return nullptr;
+			/* Make unit-relative references section-relative. */
+			switch (form)
+			{
+				case DW_FORM_ref1: case DW_FORM_ref2: case DW_FORM_ref4: case DW_FORM_ref8:
+				case DW_FORM_ref_udata:
+					v.u += cu.offset;
+					break;
+				default: break;
+			}
+			if (out) *out = v;
+			return p;
+		}
+
+		const unsigned char *native_reader::skip_attrs(const unit& cu, const abbrev& a,
+			const unsigned char *p, const unsigned char *end) const
+		{
+			const attr_spec *specs = &cu.p_abbrevs->attrs[a.first_attr];
+			for (unsigned i = 0; i < a.n_attrs && p; ++i)
+			{
+				p = read_form(cu, specs[i].form, specs[i].implicit_const, p, end, nullptr);
+			}
+			return p;
+		}
+
+		const native_reader::abbrev *native_reader::decode(const unit& cu, Dwarf_Off off,
+			const unsigned char **p_attrs) const
+		{
+			if (off < cu.die_offset || off >= cu.end) return nullptr;
+			const unsigned char *p = secs.info.data + off;
+			Dwarf_Unsigned code;
+			if (!read_uleb128(p, secs.info.data + cu.end, &code) || code == 0) return nullptr;
+			if (p_attrs) *p_attrs = p;
+			return cu.p_abbrevs->find(code);
+		}
+
+		const native_reader::abbrev *native_reader::abbrev_at(unsigned u, Dwarf_Off off) const
+		{
+			return decode(units[u], off, nullptr);
+		}
+
+		Dwarf_Off native_reader::first_child(unsigned u, Dwarf_Off off) const
+		{
+			const unit& cu = units[u];
+			const unsigned char *p;
+			const abbrev *a = decode(cu, off, &p);
+			if (!a || !a->has_children) return NONE;
+			p = skip_attrs(cu, *a, p, secs.info.data + cu.end);
+			if (!p) return NONE;
+			Dwarf_Off child = p - secs.info.data;
+			return decode(cu, child, nullptr) ? child : NONE; // a null entry means no children
+		}
+
+		Dwarf_Off native_reader::next_sibling_or_end(unsigned u, Dwarf_Off off,
+			Dwarf_Off *out_parent_end) const
+		{
+			*out_parent_end = NONE;
+			const unit& cu = units[u];
+			const unsigned char *end = secs.info.data + cu.end;
+			const unsigned char *p;
+			const abbrev *a = decode(cu, off, &p);
+			if (!a) return NONE;
+			attr_value v;
+			Dwarf_Off next;
+			if (a->has_sibling_attr && find_attr(u, off, DW_AT_sibling, &v) && v.u > off && v.u < cu.end)
+			{
+				next = v.u;
+			}
+			else
+			{
+				/* Walk past our attributes, then past our children, jumping
+				 * over grandchildren by DW_AT_sibling where we can. */
+				p = skip_attrs(cu, *a, p, end);
+				unsigned depth = a->has_children ? 1 : 0;
+				while (p && depth > 0)
+				{
+					if (p >= end) return NONE;
+					Dwarf_Off here = p - secs.info.data;
+					if (*p == 0) { ++p; --depth; continue; } // null entry: one-byte code 0
+					const unsigned char *attrs;
+					const abbrev *child = decode(cu, here, &attrs);
+					if (!child) return NONE;
+					if (child->has_children && child->has_sibling_attr
+						&& find_attr(u, here, DW_AT_sibling, &v) && v.u > here && v.u < cu.end)
+					{
+						p = secs.info.data + v.u;
+						continue;
+					}
+					p = skip_attrs(cu, *child, attrs, end);
+					if (child->has_children) ++depth;
+				}
+				if (!p) return NONE;
+				next = p - secs.info.data;
+			}
+			if (decode(cu, next, nullptr)) return next;
+			/* A null entry ends the siblings, and so our parent's subtree. */
+			if (next < cu.end && secs.info.data[next] == 0) *out_parent_end = next + 1;
+			return NONE;
+		}
+
+		bool native_reader::find_attr(unsigned u, Dwarf_Off off, Dwarf_Half attr, attr_value *out) const
+		{
+			const unit& cu = units[u];
+			const unsigned char *end = secs.info.data + cu.end;
+			const unsigned char *p;
+			const abbrev *a = decode(cu, off, &p);
+			if (!a) return false;
+			const attr_spec *specs = &cu.p_abbrevs->attrs[a->first_attr];
+			for (unsigned i = 0; i < a->n_attrs && p; ++i)
+			{
+				if (specs[i].attr == attr)
+				{
+					return nullptr != read_form(cu, specs[i].form, specs[i].implicit_const, p, end, out);
+				}
+				p = read_form(cu, specs[i].form, specs[i].implicit_const, p, end, nullptr);
+			}
+			return false;
+		}
+
+		bool native_reader::has_attr(unsigned u, Dwarf_Off off, Dwarf_Half attr) const
+		{
+			const abbrev *a = abbrev_at(u, off);
+			if (!a) return false;
+			const attr_spec *specs = &units[u].p_abbrevs->attrs[a->first_attr];
+			for (unsigned i = 0; i < a->n_attrs; ++i) if (specs[i].attr == attr) return true;
+			return false;
+		}
+
+		const char *native_reader::string_at(const unit& cu, const attr_value& v) const
+		{
+			const bytes *p_sec;
+			Dwarf_Unsigned str_off = v.u;
+			switch (v.form)
+			{
+				case DW_FORM_string: return v.str;
+				case DW_FORM_strp: p_sec = &secs.str; break;
+				case FORM_line_strp: p_sec = &secs.line_str; break;
+				case FORM_strx: case FORM_strx1: case FORM_strx2: case FORM_strx3: case FORM_strx4:
+					if (!table_entry(secs.str_offsets, cu.str_offsets_base, v.u, cu.offset_size,
+						&str_off)) return nullptr;
+					p_sec = &secs.str;
+					break;
+				default: return nullptr;
+			}
+			if (!p_sec->data || str_off >= p_sec->size) return nullptr;
+			const char *s = (const char *) p_sec->data + str_off;
+			return memchr(s, 0, p_sec->size - str_off) ? s : nullptr;
+		}
+
+		string_view native_reader::name(unsigned u, Dwarf_Off off) const
+		{
+			attr_value v;
+			if (!find_attr(u, off, DW_AT_name, &v)) return string_view();
+			const char *s = string_at(units[u], v);
+			return s ? string_view(s) : string_view();
+		}
+
+		bool native_reader::table_entry(const bytes& sec, Dwarf_Off base, Dwarf_Unsigned idx,
+			unsigned n, Dwarf_Unsigned *out) const
+		{
+			if (!sec.data || base > sec.size || idx >= (sec.size - base) / n) return false;
+			const unsigned char *p = sec.data + base + idx * n;
+			return read_fixed(p, sec.data + sec.size, n, out);
+		}
+
+		bool native_reader::address_of(unsigned u, const attr_value& v, Dwarf_Addr *out) const
+		{
+			const unit& cu = units[u];
+			switch (v.form)
+			{
+				case DW_FORM_addr: *out = v.u; return true;
+				case FORM_addrx: case FORM_addrx1: case FORM_addrx2: case FORM_addrx3: case FORM_addrx4:
+				case FORM_GNU_addr_index:
+					return table_entry(secs.addr, cu.addr_base, v.u, cu.address_size, out);
+				default: return false;
+			}
+		}
+
+		bool native_reader::list_offset_of(unsigned u, const attr_value& v, bool ranges, Dwarf_Off *out) const
+		{
+			const unit& cu = units[u];
+			switch (v.form)
+			{
+				case DW_FORM_sec_offset: *out = v.u; return true;
+				/* Before DWARF 4, offsets came as data4 or data8. */
+				case DW_FORM_data4: case DW_FORM_data8:
+					if (cu.version >= 4) return false;
+					*out = v.u;
+					return true;
+				case FORM_loclistx: case FORM_rnglistx:
+				{
+					/* The offset table's entries are relative to the base, which
+					 * is just past it. */
+					if ((v.form == FORM_rnglistx) != ranges) return false;
+					Dwarf_Off base = ranges ? cu.rnglists_base : cu.loclists_base;
+					Dwarf_Unsigned rel;
+					if (!table_entry(ranges ? secs.rnglists : secs.loclists, base, v.u,
+						cu.offset_size, &rel)) return false;
+					*out = base + rel;
+					return true;
+				}
+				default: return false;
+			}
+		}
+
+		bool native_reader::read_list(unsigned u, Dwarf_Off off, bool ranges,
+			std::vector<list_entry>& out) const
+		{
+			const unit& cu = units[u];
+			const bytes& sec = ranges ? secs.rnglists : secs.loclists;
+			if (!sec.data || off >= sec.size) return false;
+			const unsigned char *p = sec.data + off;
+			const unsigned char *end = sec.data + sec.size;
+			Dwarf_Unsigned base = cu.base_address;
+			while (p < end)
+			{
+				Dwarf_Unsigned kind = *p++;
+				Dwarf_Unsigned a = 0, b = 0;
+				bool ok = true;
+				if (!ranges)
+				{
+					if (kind == LLE_GNU_view_pair)
+					{
+						/* Views go with the next entry; we have no use for them. */
+						if (!read_uleb128(p, end, &a) || !read_uleb128(p, end, &b)) return false;
+						continue;
+					}
+					if (kind == LLE_default_location) kind = LIST_default;
+					else if (kind > LLE_default_location && kind <= LLE_start_length) --kind;
+				}
+				switch (kind)
+				{
+					case RLE_end_of_list: return true;
+					case RLE_base_addressx:
+						if (!read_uleb128(p, end, &a)
+							|| !table_entry(secs.addr, cu.addr_base, a, cu.address_size, &base)) return false;
+						continue;
+					case RLE_base_address:
+						if (!read_fixed(p, end, cu.address_size, &base)) return false;
+						continue;
+					case RLE_startx_endx:
+						ok = read_uleb128(p, end, &a) && read_uleb128(p, end, &b)
+							&& table_entry(secs.addr, cu.addr_base, a, cu.address_size, &a)
+							&& table_entry(secs.addr, cu.addr_base, b, cu.address_size, &b);
+						break;
+					case RLE_startx_length:
+						ok = read_uleb128(p, end, &a) && read_uleb128(p, end, &b)
+							&& table_entry(secs.addr, cu.addr_base, a, cu.address_size, &a);
+						b += a;
+						break;
+					case RLE_offset_pair:
+						ok = read_uleb128(p, end, &a) && read_uleb128(p, end, &b);
+						a += base;
+						b += base;
+						break;
+					case RLE_start_end:
+						ok = read_fixed(p, end, cu.address_size, &a) && read_fixed(p, end, cu.address_size, &b);
+						break;
+					case RLE_start_length:
+						ok = read_fixed(p, end, cu.address_size, &a) && read_uleb128(p, end, &b);
+						b += a;
+						break;
+					case LIST_default: break;
+					default: return false; // junk, or a vendor kind we don't know the size of
+				}
+				if (!ok) return false;
+				list_entry e = (list_entry) { .lo = a, .hi = b, .expr = nullptr, .expr_len = 0 };
+				if (!ranges)
+				{
+					Dwarf_Unsigned len;
+					if (!read_uleb128(p, end, &len) || len > (Dwarf_Unsigned) (end - p)) return false;
+					e.expr = p;
+					e.expr_len = len;
+					p += len;
+				}
+				if (e.lo < e.hi || kind == LIST_default) out.push_back(e);
+			}
+			return false; // no end of list
+		}
+
+		bool native_reader::read_unit_refs(unsigned u, ref_graph& out) const
+		{
+			const unit& cu = units[u];
+			const unsigned char *end = secs.info.data + cu.end;
+			const unsigned char *p = secs.info.data + cu.die_offset;
+			/* The parents of whatever comes next; the unit's is 0. */
+			std::vector<Dwarf_Off> parents(1, 0);
+			while (p < end)
+			{
+				Dwarf_Off here = p - secs.info.data;
+				if (*p == 0) // null entry, or padding after the unit DIE's children
+				{
+					++p;
+					if (parents.size() > 1) parents.pop_back();
+					continue;
+				}
+				const unsigned char *attrs;
+				const abbrev *a = decode(cu, here, &attrs);
+				if (!a) return false;
+				out.dies.push_back(here);
+				out.parents.push_back(parents.back());
+				out.edge_begin.push_back(out.edges.size());
+				const attr_spec *specs = &cu.p_abbrevs->attrs[a->first_attr];
+				p = attrs;
+				for (unsigned i = 0; i < a->n_attrs; ++i)
+				{
+					/* Only references (and what might be one) need their value. */
+					bool want = specs[i].attr != DW_AT_sibling
+						&& (is_die_ref_form(specs[i].form) || specs[i].form == DW_FORM_indirect);
+					attr_value v;
+					p = read_form(cu, specs[i].form, specs[i].implicit_const, p, end, want ? &v : nullptr);
+					if (!p) return false;
+					if (want && is_die_ref_form(v.form))
+					{
+						out.edges.push_back((ref_graph::edge) { .attr = specs[i].attr, .target = v.u });
+					}
+				}
+				if (a->has_children) parents.push_back(here);
+			}
+			return true;
+		}
+
+		bool native_reader::read_unit_columns(unsigned u, const std::vector<Dwarf_Half>& tags,
+			attr_columns& out, std::vector<const char *>& out_strings) const
+		{
+			const unit& cu = units[u];
+			const unsigned char *end = secs.info.data + cu.end;
+			const unsigned char *p = secs.info.data + cu.die_offset;
+			unsigned n_cols = out.columns.size();
+			while (p < end)
+			{
+				Dwarf_Off here = p - secs.info.data;
+				if (*p == 0) { ++p; continue; }
+				const unsigned char *attrs;
+				const abbrev *a = decode(cu, here, &attrs);
+				if (!a) return false;
+				if (!tags.empty() && std::find(tags.begin(), tags.end(), a->tag) == tags.end())
+				{
+					p = skip_attrs(cu, *a, attrs, end);
+					if (!p) return false;
+					continue;
+				}
+				out.dies.push_back(here);
+				out.tags.push_back(a->tag);
+				for (unsigned j = 0; j < n_cols; ++j)
+				{
+					out.columns[j].kinds.push_back(attr_columns::ABSENT);
+					out.columns[j].values.push_back(0);
+				}
+				const attr_spec *specs = &cu.p_abbrevs->attrs[a->first_attr];
+				p = attrs;
+				for (unsigned i = 0; i < a->n_attrs; ++i)
+				{
+					unsigned j = 0;
+					while (j < n_cols && out.columns[j].attr != specs[i].attr) ++j;
+					attr_value v;
+					p = read_form(cu, specs[i].form, specs[i].implicit_const, p, end, (j < n_cols) ? &v : nullptr);
+					if (!p) return false;
+					if (j == n_cols) continue;
+					unsigned char kind;
+					Dwarf_Unsigned value = v.u;
+					switch (v.form) // after DW_FORM_indirect
+					{
+						case DW_FORM_string: case DW_FORM_strp: case FORM_line_strp:
+						case FORM_strx: case FORM_strx1: case FORM_strx2: case FORM_strx3: case FORM_strx4:
+						{
+							const char *str = string_at(cu, v);
+							if (!str) return false;
+							kind = attr_columns::STRING;
+							value = out_strings.size();
+							out_strings.push_back(str);
+						} break;
+						case DW_FORM_ref1: case DW_FORM_ref2: case DW_FORM_ref4: case DW_FORM_ref8:
+						case DW_FORM_ref_udata: case DW_FORM_ref_addr:
+							kind = attr_columns::REFERENCE;
+							break;
+						case DW_FORM_data1: case DW_FORM_data2: case DW_FORM_data4: case DW_FORM_data8:
+						case DW_FORM_udata:
+							kind = attr_columns::CONSTANT;
+							break;
+						case DW_FORM_sdata: case FORM_implicit_const:
+							kind = attr_columns::SIGNED;
+							value = (Dwarf_Unsigned) v.s;
+							break;
+						case DW_FORM_flag: case DW_FORM_flag_present:
+							kind = attr_columns::FLAG;
+							break;
+						case DW_FORM_addr: case FORM_addrx: case FORM_addrx1: case FORM_addrx2:
+						case FORM_addrx3: case FORM_addrx4: case FORM_GNU_addr_index:
+						{
+							Dwarf_Addr addr;
+							if (!address_of(u, v, &addr)) return false;
+							kind = attr_columns::ADDRESS;
+							value = addr;
+						} break;
+						default:
+							kind = attr_columns::OTHER;
+							if (v.block) value = 0;
+							break;
+					}
+					out.columns[j].kinds.back() = kind;
+					out.columns[j].values.back() = value;
+				}
+			}
+			return true;
+		}
+
+		bool native_reader::unit_signature(unsigned u, uint64_t *out_hash, bool *out_closed) const
+		{
+			const unit& cu = units[u];
+			const unsigned char *end = secs.info.data + cu.end;
+			const unsigned char *p = secs.info.data + cu.die_offset;
+			fnv_hash h;
+			h.add_u(cu.version);
+			h.add_u(cu.address_size);
+			h.add_u(cu.die_offset - cu.offset);
+			bool closed = true;
+			while (p < end)
+			{
+				Dwarf_Off here = p - secs.info.data;
+				/* Offsets within the unit must stay put, for what we key on them. */
+				h.add_u(here - cu.offset);
+				if (*p == 0) { ++p; h.add_u(0); continue; }
+				const unsigned char *attrs;
+				const abbrev *a = decode(cu, here, &attrs);
+				if (!a) return false;
+				h.add_u(a->tag);
+				h.add_u(a->has_children);
+				const attr_spec *specs = &cu.p_abbrevs->attrs[a->first_attr];
+				p = attrs;
+				for (unsigned i = 0; i < a->n_attrs; ++i)
+				{
+					attr_value v;
+					p = read_form(cu, specs[i].form, specs[i].implicit_const, p, end, &v);
+					if (!p) return false;
+					h.add_u(specs[i].attr);
+					h.add_u(v.form); // after DW_FORM_indirect
+					switch (v.form)
+					{
+						case DW_FORM_string: case DW_FORM_strp: case FORM_line_strp:
+						case FORM_strx: case FORM_strx1: case FORM_strx2: case FORM_strx3: case FORM_strx4:
+						{
+							const char *s = string_at(cu, v);
+							if (!s) return false;
+							h.add(s, strlen(s) + 1);
+						} break;
+						case DW_FORM_ref1: case DW_FORM_ref2: case DW_FORM_ref4: case DW_FORM_ref8:
+						case DW_FORM_ref_udata:
+							h.add_u(v.u - cu.offset);
+							break;
+						case DW_FORM_ref_addr:
+							if (v.u >= cu.offset && v.u < cu.end) h.add_u(v.u - cu.offset);
+							else closed = false; // its target may move without us changing
+							break;
+						case FORM_ref_sig8:
+							h.add_u(v.u);
+							closed = false;
+							break;
+						case DW_FORM_block1: case DW_FORM_block2: case DW_FORM_block4:
+						case DW_FORM_block: case DW_FORM_exprloc: case FORM_data16:
+							h.add_u(v.block_len);
+							h.add(v.block, v.block_len);
+							break;
+						case DW_FORM_data4: case DW_FORM_data8: case DW_FORM_sec_offset:
+						case FORM_loclistx: case FORM_rnglistx:
+							/* Range lists bear on the address index, so follow them.
+							 * (DWARF 2 and 3 give their offsets as data4 or data8.)
+							 * Other sections' offsets we hash as they are, and
+							 * indices as the offset they give. */
+							if (specs[i].attr == DW_AT_ranges)
+							{
+								Dwarf_Off off = v.u;
+								if (v.form == FORM_rnglistx && !list_offset_of(u, v, true, &off)) return false;
+								if (cu.version >= 5)
+								{
+									/* These may index .debug_addr, so hash what they say. */
+									std::vector<list_entry> entries;
+									if (!read_list(u, off, true, entries)) return false;
+									for (auto i_e = entries.begin(); i_e != entries.end(); ++i_e)
+									{
+										h.add_u(i_e->lo);
+										h.add_u(i_e->hi);
+									}
+								}
+								else
+								{
+									const unsigned char *list_end = range_list_end(secs.ranges,
+										cu.address_size, off);
+									if (!list_end) return false;
+									h.add(secs.ranges.data + off, list_end - (secs.ranges.data + off));
+								}
+							}
+							else if (v.form == FORM_loclistx || v.form == FORM_rnglistx)
+							{
+								Dwarf_Off off;
+								if (!list_offset_of(u, v, v.form == FORM_rnglistx, &off)) return false;
+								h.add_u(off);
+							}
+							else h.add_u(v.u);
+							break;
+						case FORM_addrx: case FORM_addrx1: case FORM_addrx2: case FORM_addrx3: case FORM_addrx4:
+						case FORM_GNU_addr_index:
+						{
+							Dwarf_Addr addr;
+							if (!address_of(u, v, &addr)) return false;
+							h.add_u(addr);
+						} break;
+						case FORM_GNU_str_index: case FORM_ref_sup4: case FORM_ref_sup8: case FORM_strp_sup:
+						case FORM_GNU_ref_alt: case FORM_GNU_strp_alt:
+							return false; // values in files we don't open
+						default:
+							h.add_u(v.u);
+							break;
+					}
+					if (specs[i].attr == DW_AT_declaration && v.u && is_definable_type_tag(a->tag))
+					{
+						closed = false;
+					}
+				}
+			}
+			*out_hash = h.h;
+			*out_closed = closed;
+			return true;
+		}
+
+		bool native_reader::unit_list_offsets(unsigned u, offset_span *out_locs, offset_span *out_ranges) const
+		{
+			const unit& cu = units[u];
+			const unsigned char *end = secs.info.data + cu.end;
+			const unsigned char *p = secs.info.data + cu.die_offset;
+			offset_span locs = (offset_span) { .lo = (Dwarf_Off) -1, .hi = 0 };
+			offset_span ranges = locs;
+			while (p < end)
+			{
+				if (*p == 0) { ++p; continue; }
+				const unsigned char *attrs;
+				const abbrev *a = decode(cu, p - secs.info.data, &attrs);
+				if (!a) return false;
+				const attr_spec *specs = &cu.p_abbrevs->attrs[a->first_attr];
+				p = attrs;
+				for (unsigned i = 0; i < a->n_attrs; ++i)
+				{
+					attr_value v;
+					p = read_form(cu, specs[i].form, specs[i].implicit_const, p, end, &v);
+					if (!p) return false;
+					Dwarf_Off off;
+					if (!list_offset_of(u, v, v.form == FORM_rnglistx, &off)) continue;
+					offset_span *p_span;
+					switch (specs[i].attr)
+					{
+						case DW_AT_location: case DW_AT_frame_base: case DW_AT_data_member_location:
+						case DW_AT_string_length: case DW_AT_return_addr: case DW_AT_static_link:
+						case DW_AT_use_location: case DW_AT_vtable_elem_location: case DW_AT_segment:
+							p_span = &locs;
+							break;
+						case DW_AT_ranges: case DW_AT_start_scope:
+							p_span = &ranges;
+							break;
+						default:
+							continue;
+					}
+					if (off < p_span->lo) p_span->lo = off;
+					if (off > p_span->hi) p_span->hi = off;
+				}
+			}
+			*out_locs = locs;
+			*out_ranges = ranges;
+			return true;
+		}
+	}
+}
@@ -0,0 +1,316 @@
+/* dwarfpp: C++ binding for a useful subset of libdwarf, plus extra goodies.
+ *
+ * nav-index.cpp: persistent on-disk index of root_die navigation caches
+ *
+ * Copyright (c) 2008--17, Stephen Kell. For licensing information, see the
+ * LICENSE file in the root of the libdwarfpp tree.
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <strings.h>
+#include <functional>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <set>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <gelf.h>
+
+#include "dwarfpp/root.hpp"
+#include "dwarfpp/root-inl.hpp"
+#include "dwarfpp/iter.hpp"
+#include "dwarfpp/iter-inl.hpp"
+
+namespace dwarf
+{
+	using std::endl;
+	namespace core
+	{
+		/* The file format is deliberately dumb: a fixed header, the build-id
+		 * bytes (padded to 8), then two flat arrays. Everything is in host
+		 * byte order; an index is only meaningful on the machine that made it,
+		 * and we check the magic, the byte order and the record sizes before
+		 * trusting it. Loading copies the records into our caches, since
+		 * those are what navigation consults; to navigate from the mapped
+		 * records themselves, use a shared index (see shared-index.cpp). */
+		namespace
+		{
+			const char nav_index_magic[8] = { 'D', 'W', 'P', 'P', 'N', 'A', 'V', '2' };
+			const uint32_t nav_index_byte_order = 0x01020304; // reads otherwise if swapped
+
+			struct nav_index_header
+			{
+				char magic[8];
+				uint32_t die_record_size;
+				uint32_t ref_record_size;
+				uint32_t byte_order; // nav_index_byte_order, as we wrote it
+				uint32_t unused;
+				uint64_t build_id_len; // in bytes of the hex string
+				uint64_t n_die_records;
+				uint64_t n_ref_records;
+			};
+			struct nav_index_die_record
+			{
+				enum { HAVE_PARENT = 1, HAVE_FIRST_CHILD = 2, HAVE_NEXT_SIBLING = 4, HAVE_DEPTH = 8 };
+				uint64_t off;
+				uint64_t parent;
+				uint64_t first_child;
+				uint64_t next_sibling;
+				uint16_t depth;
+				uint16_t flags;
+				uint32_t unused;
+			};
+			struct nav_index_ref_record
+			{
+				uint64_t from;
+				uint64_t to;
+				uint16_t attr;
+				uint16_t unused[3];
+			};
+			inline uint64_t padded_len(uint64_t len) { return (len + 7) & ~(uint64_t) 7; }
+			/* Add n records of size bytes to len; true if that overflows. */
+			inline bool add_array_len(uint64_t& len, uint64_t n, uint64_t size)
+			{
+				uint64_t bytes;
+				return __builtin_mul_overflow(n, size, &bytes)
+					|| __builtin_add_overflow(len, bytes, &len);
+			}
+		}
+
+		opt<string> root_die::get_build_id()
+		{
+			if (!dbg.handle) return opt<string>();
+			return get_build_id(get_elf());
+		}
+
+		opt<string> root_die::get_build_id(::Elf *e)
+		{
+			if (!e) return opt<string>();
+			Elf_Scn *scn = nullptr;
+			while (nullptr != (scn = elf_nextscn(e, scn)))
+			{
+				GElf_Shdr shdr;
+				if (!gelf_getshdr(scn, &shdr) || shdr.sh_type != SHT_NOTE) continue;
+				Elf_Data *data = elf_getdata(scn, nullptr);
+				if (!data) continue;
+				size_t note_off = 0;
+				GElf_Nhdr nhdr;
+				size_t name_off;
+				size_t desc_off;
+				while (note_off < data->d_size
+					&& 0 != (note_off = gelf_getnote(data, note_off, &nhdr, &name_off, &desc_off)))
+				{
+					if (nhdr.n_type == NT_GNU_BUILD_ID && nhdr.n_namesz == 4
+						&& 0 == memcmp((char*) data->d_buf + name_off, "GNU", 4))
+					{
+						std::ostringstream s;
+						const unsigned char *desc = (const unsigned char *) data->d_buf + desc_off;
+						for (unsigned i = 0; i < nhdr.n_descsz; ++i)
+						{
+							s << std::hex << std::setw(2) << std::setfill('0') << (unsigned) desc[i];
+						}
+						return s.str();
+					}
+				}
+			}
+			return opt<string>();
+		}
+
+		opt<string> root_die::nav_index_filename(const string& dir)
+		{
+			auto build_id = get_build_id();
+			if (!build_id) return opt<string>();
+			return dir + "/" + *build_id + ".dwarfpp-nav";
+		}
+
+		bool root_die::save_nav_index(const string& dir)
+		{
+			auto build_id = get_build_id();
+			if (!build_id)
+			{
+				debug(1) << "Not saving nav index: no build-id" << endl;
+				return false;
+			}
+			/* Don't save anything touching an in-memory DIE. Their offsets
+			 * are issued afresh each time, so they would poison the index. */
+			auto is_in_memory = [this](Dwarf_Off off) {
+				auto found = live_dies.find(off);
+				return found != live_dies.end()
+					&& dynamic_cast<in_memory_abstract_die *>(found->second);
+			};
+			std::set<Dwarf_Off> offsets;
+			for (auto i = parent_of.begin(); i != parent_of.end(); ++i) offsets.insert(i->first);
+			for (auto i = first_child_of.begin(); i != first_child_of.end(); ++i) offsets.insert(i->first);
+			for (auto i = next_sibling_of.begin(); i != next_sibling_of.end(); ++i) offsets.insert(i->first);
+			/* Depth is recovered by walking parent_of to the root; memoise. */
+			unordered_map<Dwarf_Off, unsigned short> depths = depth_of;
+			depths[0UL] = 0;
+			std::function<opt<unsigned short>(Dwarf_Off)> depth_for
+			 = [&depth_for, &depths, this](Dwarf_Off off) -> opt<unsigned short> {
+				auto found = depths.find(off);
+				if (found != depths.end()) return found->second;
+				auto found_parent = parent_of.find(off);
+				if (found_parent == parent_of.end()) return opt<unsigned short>();
+				auto parent_depth = depth_for(found_parent->second);
+				if (!parent_depth) return opt<unsigned short>();
+				unsigned short depth = *parent_depth + 1;
+				depths[off] = depth;
+				return depth;
+			};
+			std::vector<nav_index_die_record> die_records;
+			for (auto i_off = offsets.begin(); i_off != offsets.end(); ++i_off)
+			{
+				if (is_in_memory(*i_off)) continue;
+				nav_index_die_record rec;
+				bzero(&rec, sizeof rec);
+				rec.off = *i_off;
+				auto found_parent = parent_of.find(*i_off);
+				if (found_parent != parent_of.end() && !is_in_memory(found_parent->second))
+				{ rec.parent = found_parent->second; rec.flags |= nav_index_die_record::HAVE_PARENT; }
+				auto found_first_child = first_child_of.find(*i_off);
+				if (found_first_child != first_child_of.end() && !is_in_memory(found_first_child->second))
+				{ rec.first_child = found_first_child->second; rec.flags |= nav_index_die_record::HAVE_FIRST_CHILD; }
+				auto found_next_sibling = next_sibling_of.find(*i_off);
+				if (found_next_sibling != next_sibling_of.end() && !is_in_memory(found_next_sibling->second))
+				{ rec.next_sibling = found_next_sibling->second; rec.flags |= nav_index_die_record::HAVE_NEXT_SIBLING; }
+				auto depth = depth_for(*i_off);
+				if (depth) { rec.depth = *depth; rec.flags |= nav_index_die_record::HAVE_DEPTH; }
+				die_records.push_back(rec);
+			}
+			std::vector<nav_index_ref_record> ref_records;
+			for (auto i_ref = refers_to.begin(); i_ref != refers_to.end(); ++i_ref)
+			{
+				if (is_in_memory(i_ref->first.first) || is_in_memory(i_ref->second)) continue;
+				nav_index_ref_record rec;
+				bzero(&rec, sizeof rec);
+				rec.from = i_ref->first.first;
+				rec.attr = i_ref->first.second;
+				rec.to = i_ref->second;
+				ref_records.push_back(rec);
+			}
+
+			nav_index_header hdr;
+			bzero(&hdr, sizeof hdr);
+			memcpy(hdr.magic, nav_index_magic, sizeof hdr.magic);
+			hdr.die_record_size = sizeof (nav_index_die_record);
+			hdr.ref_record_size = sizeof (nav_index_ref_record);
+			hdr.byte_order = nav_index_byte_order;
+			hdr.build_id_len = build_id->size();
+			hdr.n_die_records = die_records.size();
+			hdr.n_ref_records = ref_records.size();
+
+			/* Write to a temporary and rename, so that a concurrent reader
+			 * never maps a half-written index. */
+			string filename = *nav_index_filename(dir);
+			std::ostringstream tmp;
+			tmp << filename << ".tmp." << getpid();
+			string tmp_filename = tmp.str();
+			{
+				std::ofstream out(tmp_filename, std::ios::binary | std::ios::trunc);
+				if (!out)
+				{
+					debug(1) << "Could not open " << tmp_filename << " for writing nav index" << endl;
+					return false;
+				}
+				string padded_build_id = *build_id;
+				padded_build_id.resize(padded_len(build_id->size()), '\0');
+				out.write(reinterpret_cast<const char *>(&hdr), sizeof hdr);
+				out.write(padded_build_id.data(), padded_build_id.size());
+				out.write(reinterpret_cast<const char *>(die_records.data()),
+					die_records.size() * sizeof (nav_index_die_record));
+				out.write(reinterpret_cast<const char *>(ref_records.data()),
+					ref_records.size() * sizeof (nav_index_ref_record));
+				if (!out) { unlink(tmp_filename.c_str()); return false; }
+			}
+			if (0 != rename(tmp_filename.c_str(), filename.c_str()))
+			{
+				unlink(tmp_filename.c_str());
+				return false;
+			}
+			debug(2) << "Saved nav index of " << die_records.size() << " DIEs and "
+				<< ref_records.size() << " references to " << filename << endl;
+			return true;
+		}
+
+		bool root_die::load_nav_index(const string& dir)
+		{
+			auto filename = nav_index_filename(dir);
+			if (!filename) return false;
+			int fd = open(filename->c_str(), O_RDONLY);
+			if (fd == -1) return false;
+			struct stat st;
+			if (0 != fstat(fd, &st) || (size_t) st.st_size < sizeof (nav_index_header))
+			{ close(fd); return false; }
+			size_t len = st.st_size;
+			void *mapping = mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, 0);
+			close(fd);
+			if (mapping == MAP_FAILED) return false;
+
+			bool success = false;
+			const char *base = reinterpret_cast<const char *>(mapping);
+			const nav_index_header *hdr = reinterpret_cast<const nav_index_header *>(base);
+			const char *build_id_pos = base + sizeof (nav_index_header);
+			const nav_index_die_record *die_records = nullptr;
+			const nav_index_ref_record *ref_records = nullptr;
+			uint64_t expected_len = sizeof (nav_index_header);
+			bool overflowed;
+			auto build_id = get_build_id();
+			if (0 != memcmp(hdr->magic, nav_index_magic, sizeof hdr->magic)
+				|| hdr->byte_order != nav_index_byte_order
+				|| hdr->die_record_size != sizeof (nav_index_die_record)
+				|| hdr->ref_record_size != sizeof (nav_index_ref_record))
+			{
+				debug(1) << "Did not understand nav index " << *filename << endl;
+				goto out;
+			}
+			overflowed = hdr->build_id_len > len
+				|| add_array_len(expected_len, padded_len(hdr->build_id_len), 1)
+				|| add_array_len(expected_len, hdr->n_die_records, sizeof (nav_index_die_record))
+				|| add_array_len(expected_len, hdr->n_ref_records, sizeof (nav_index_ref_record));
+			if (overflowed || expected_len != len)
+			{
+				debug(1) << "Nav index " << *filename << " is truncated" << endl;
+				goto out;
+			}
+			/* The name says which build-id we're for, but check anyway:
+			 * someone might have copied the file around. */
+			if (!build_id || hdr->build_id_len != build_id->size()
+				|| 0 != memcmp(build_id_pos, build_id->data(), build_id->size()))
+			{
+				debug(1) << "Nav index " << *filename << " is for a different build" << endl;
+				goto out;
+			}
+
+			die_records = reinterpret_cast<const nav_index_die_record *>(
+				build_id_pos + padded_len(hdr->build_id_len));
+			ref_records = reinterpret_cast<const nav_index_ref_record *>(
+				die_records + hdr->n_die_records);
+			/* Don't clobber anything we already know: cache entries made
+			 * by this root_die take precedence (they ought to agree). */
+			parent_of.reserve(parent_of.size() + hdr->n_die_records);
+			depth_of.reserve(depth_of.size() + hdr->n_die_records);
+			for (const nav_index_die_record *p = die_records; p != die_records + hdr->n_die_records; ++p)
+			{
+				if (p->flags & nav_index_die_record::HAVE_PARENT) parent_of.insert(make_pair(p->off, p->parent));
+				if (p->flags & nav_index_die_record::HAVE_FIRST_CHILD) first_child_of.insert(make_pair(p->off, p->first_child));
+				if (p->flags & nav_index_die_record::HAVE_NEXT_SIBLING) next_sibling_of.insert(make_pair(p->off, p->next_sibling));
+				if (p->flags & nav_index_die_record::HAVE_DEPTH) depth_of.insert(make_pair(p->off, p->depth));
+			}
+			for (const nav_index_ref_record *p = ref_records; p != ref_records + hdr->n_ref_records; ++p)
+			{
+				refers_to.insert(make_pair(make_pair(p->from, p->attr), p->to));
+			}
+			debug(2) << "Loaded nav index of " << hdr->n_die_records << " DIEs and "
+				<< hdr->n_ref_records << " references from " << *filename << endl;
+			success = true;
+		out:
+			munmap(mapping, len);
+			return success;
+		}
+	}
+}
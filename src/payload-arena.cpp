@@ -0,0 +1,60 @@
+/* dwarfpp: C++ binding for a useful subset of libdwarf, plus extra goodies.
+ *
+ * payload-arena.cpp: per-root_die slab allocation of basic_die payloads
+ *
+ * Copyright (c) 2008--17, Stephen Kell. For licensing information, see the
+ * LICENSE file in the root of the libdwarfpp tree.
+ */
+
+#include <cassert>
+#include <new>
+
+#include "dwarfpp/root.hpp"
+
+namespace dwarf
+{
+	namespace core
+	{
+		void *payload_arena::allocate(size_t sz)
+		{
+			size_t cls = size_class(sz);
+			size_t rounded = cls * GRAIN;
+			assert(rounded <= SLAB_SIZE);
+			// a freed block of the same class is the cheapest thing going
+			if (cls < freelists.size() && freelists[cls])
+			{
+				void *p = freelists[cls];
+				freelists[cls] = *static_cast<void **>(p);
+				return p;
+			}
+			if ((size_t)(bump_end - bump) < rounded)
+			{
+				/* Start a new slab. Whatever was left of the old one is lost
+				 * until we go away; that's at most one payload's worth. */
+				char *slab = static_cast<char *>(::operator new(SLAB_SIZE));
+				slabs.push_back(slab);
+				bump = slab;
+				bump_end = slab + SLAB_SIZE;
+			}
+			void *p = bump;
+			bump += rounded;
+			return p;
+		}
+
+		void payload_arena::deallocate(void *p, size_t sz)
+		{
+			size_t cls = size_class(sz);
+			if (cls >= freelists.size()) freelists.resize(cls + 1, nullptr);
+			*static_cast<void **>(p) = freelists[cls];
+			freelists[cls] = p;
+		}
+
+		payload_arena::~payload_arena()
+		{
+			/* Anything still allocated goes with the slabs. By now the root_die
+			 * has destroyed its sticky set; any other surviving payload was
+			 * being used after its root_die went away, which is a bug anyway. */
+			for (auto i_s = slabs.begin(); i_s != slabs.end(); ++i_s) ::operator delete(*i_s);
+		}
+	}
+}
@@ -0,0 +1,88 @@
+/* dwarfpp: C++ binding for a useful subset of libdwarf, plus extra goodies.
+ *
+ * payload-cache.cpp: keeping recently used payloads alive, within a budget
+ *
+ * Copyright (c) 2008--17, Stephen Kell. For licensing information, see the
+ * LICENSE file in the root of the libdwarfpp tree.
+ */
+
+#include "dwarfpp/root.hpp"
+
+namespace dwarf
+{
+	using std::endl;
+	namespace core
+	{
+		void root_die::retain_slow(basic_die *p)
+		{
+			Dwarf_Off off = p->get_offset();
+			auto found = retained.where.find(off);
+			if (found != retained.where.end())
+			{
+				/* Already kept; now it's the most recent of its priority. */
+				auto& l = retained.by_priority[found->second.first];
+				l.splice(l.begin(), l, found->second.second);
+				return;
+			}
+			/* Sticky payloads are kept anyway. */
+			if (sticky_dies.find(off) != sticky_dies.end()) return;
+			unsigned prio = retained.policy.priority_for(p->get_tag());
+			if (prio == 0) return;
+			size_t bytes = p->allocated_size();
+			auto& l = retained.by_priority[prio];
+			l.push_front((retained_payloads::entry) { .p = ptr_type(p), .bytes = bytes });
+			retained.where.insert(make_pair(off, make_pair(prio, l.begin())));
+			++retained.count;
+			retained.bytes += bytes;
+			evict_retained();
+		}
+
+		void root_die::evict_retained()
+		{
+			const payload_retention_policy& pol = retained.policy;
+			while (retained.count > 0
+				&& ((pol.max_payloads && retained.count > pol.max_payloads)
+					|| (pol.max_bytes && retained.bytes > pol.max_bytes)))
+			{
+				auto i_prio = retained.by_priority.begin();
+				assert(i_prio != retained.by_priority.end());
+				if (i_prio->second.empty()) { retained.by_priority.erase(i_prio); continue; }
+				retained_payloads::entry& victim = i_prio->second.back();
+				retained.where.erase(victim.p->get_offset());
+				--retained.count;
+				retained.bytes -= victim.bytes;
+				DWARFPP_STAT_INC(*this, payloads_evicted);
+				/* This may free the payload, which takes it out of live_dies. */
+				i_prio->second.pop_back();
+			}
+		}
+
+		bool root_die::set_retention_policy(const payload_retention_policy& policy)
+		{
+			if (frozen) return false;
+			/* Priorities may have changed, so re-file what we have, oldest
+			 * first so that pushing each to the front keeps the order. We
+			 * hold them meanwhile, so that none is freed on the way. */
+			std::vector<ptr_type> kept;
+			for (auto i_prio = retained.by_priority.begin(); i_prio != retained.by_priority.end(); ++i_prio)
+			{
+				for (auto i_e = i_prio->second.rbegin(); i_e != i_prio->second.rend(); ++i_e)
+				{
+					kept.push_back(i_e->p);
+				}
+			}
+			retained.by_priority.clear();
+			retained.where.clear();
+			retained.count = 0;
+			retained.bytes = 0;
+			retained.policy = policy;
+			if (policy.enabled())
+			{
+				for (auto i_k = kept.begin(); i_k != kept.end(); ++i_k) retain_slow(i_k->get());
+			}
+			debug(2) << "Retention policy now keeps " << retained.count << " payloads ("
+				<< retained.bytes << " bytes)" << endl;
+			return true;
+		}
+	}
+}
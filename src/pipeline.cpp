@@ -0,0 +1,161 @@
+/* dwarfpp: C++ binding for a useful subset of libdwarf, plus extra goodies.
+ *
+ * pipeline.cpp: walking all DIEs in producer, filter and consumer stages
+ *
+ * Copyright (c) 2008--17, Stephen Kell. For licensing information, see the
+ * LICENSE file in the root of the libdwarfpp tree.
+ */
+
+#include <algorithm>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+
+#include "dwarfpp/pipeline.hpp"
+
+namespace dwarf
+{
+	using std::endl;
+	using std::vector;
+	namespace core
+	{
+		namespace
+		{
+			/* Producers block when it's full, consumers when it's empty
+			 * and some producer is still going. */
+			struct batch_queue
+			{
+				std::mutex m;
+				std::condition_variable not_full;
+				std::condition_variable not_empty;
+				std::deque<vector<die_view> > batches;
+				unsigned capacity;
+				unsigned producers_left;
+
+				batch_queue(unsigned capacity, unsigned producers)
+				 : capacity(capacity), producers_left(producers) {}
+				void push(vector<die_view>&& batch)
+				{
+					std::unique_lock<std::mutex> lock(m);
+					not_full.wait(lock, [this]() { return batches.size() < capacity; });
+					batches.push_back(std::move(batch));
+					not_empty.notify_one();
+				}
+				bool pop(vector<die_view>& out)
+				{
+					std::unique_lock<std::mutex> lock(m);
+					not_empty.wait(lock, [this]() { return !batches.empty() || producers_left == 0; });
+					if (batches.empty()) return false;
+					out = std::move(batches.front());
+					batches.pop_front();
+					not_full.notify_one();
+					return true;
+				}
+				void producer_done()
+				{
+					std::unique_lock<std::mutex> lock(m);
+					--producers_left;
+					not_empty.notify_all();
+				}
+			};
+		}
+
+		bool die_pipeline::passes(const iterator_base& i) const
+		{
+			if (!tags.empty() && std::find(tags.begin(), tags.end(), i.tag_here()) == tags.end())
+			{
+				return false;
+			}
+			for (auto i_attr = attrs.begin(); i_attr != attrs.end(); ++i_attr)
+			{
+				if (!i.has_attr_here(*i_attr)) return false;
+			}
+			for (auto i_f = filters.begin(); i_f != filters.end(); ++i_f)
+			{
+				if (!(*i_f)(i)) return false;
+			}
+			return true;
+		}
+
+		void die_pipeline::walk_cu(Dwarf_Off cu_off,
+			const std::function<void(vector<die_view>&&)>& emit) const
+		{
+			vector<die_view> batch;
+			batch.reserve(m_batch_size);
+			for (iterator_df<> i = p_root->cu_pos<iterator_df<> >(cu_off);
+				i && (i.offset_here() == cu_off || i.depth() > 1); ++i)
+			{
+				if (!passes(i)) continue;
+				batch.push_back((die_view) {
+					.off = i.offset_here(),
+					.cu_off = cu_off,
+					.tag = i.tag_here(),
+					.depth = i.depth()
+				});
+				if (batch.size() == m_batch_size)
+				{
+					emit(std::move(batch));
+					batch = vector<die_view>();
+					batch.reserve(m_batch_size);
+				}
+			}
+			if (!batch.empty()) emit(std::move(batch));
+		}
+
+		unsigned long die_pipeline::run(const consumer_fn& consume, unsigned nproducers,
+			unsigned nconsumers) const
+		{
+			vector<Dwarf_Off> cus;
+			auto cu_seq = p_root->begin().children_here();
+			for (auto i_cu = std::move(cu_seq.first); i_cu != cu_seq.second; ++i_cu)
+			{
+				cus.push_back(i_cu.offset_here());
+			}
+			std::atomic<unsigned long> n_consumed(0);
+
+			/* As in symbolize(): only a frozen root is safe to share. */
+			if (!p_root->is_frozen())
+			{
+				for (auto i_cu = cus.begin(); i_cu != cus.end(); ++i_cu)
+				{
+					walk_cu(*i_cu, [&](vector<die_view>&& batch) {
+						n_consumed += batch.size();
+						consume(batch);
+					});
+				}
+				return n_consumed.load();
+			}
+			if (nproducers == 0) nproducers = std::max(1u, std::thread::hardware_concurrency());
+			nproducers = std::max(1u, std::min(nproducers, (unsigned) cus.size()));
+			nconsumers = std::max(1u, nconsumers);
+
+			batch_queue q(m_queue_depth, nproducers);
+			std::atomic<size_t> next_cu(0);
+			auto produce = [&]() {
+				for (size_t i; (i = next_cu++) < cus.size(); )
+				{
+					walk_cu(cus[i], [&q](vector<die_view>&& batch) { q.push(std::move(batch)); });
+				}
+				q.producer_done();
+			};
+			auto consume_all = [&]() {
+				vector<die_view> batch;
+				while (q.pop(batch))
+				{
+					n_consumed += batch.size();
+					consume(batch);
+				}
+			};
+			vector<std::thread> workers;
+			for (unsigned i = 0; i < nproducers; ++i) workers.push_back(std::thread(produce));
+			for (unsigned i = 0; i < nconsumers; ++i) workers.push_back(std::thread(consume_all));
+			for (auto i_w = workers.begin(); i_w != workers.end(); ++i_w) i_w->join();
+			debug(2) << "Pipeline consumed " << n_consumed.load() << " DIEs from " << cus.size()
+				<< " CUs using " << nproducers << " producer and " << nconsumers
+				<< " consumer threads" << endl;
+			return n_consumed.load();
+		}
+	}
+}
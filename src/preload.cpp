@@ -0,0 +1,265 @@
+/* dwarfpp: C++ binding for a useful subset of libdwarf, plus extra goodies.
+ *
+ * preload.cpp: parallel whole-tree preload of root_die navigation caches,
+ * and frozen (read-only, shareable) mode
+ *
+ * Copyright (c) 2008--17, Stephen Kell. For licensing information, see the
+ * LICENSE file in the root of the libdwarfpp tree.
+ */
+
+#include <thread>
+#include <algorithm>
+#include <functional>
+
+#include "dwarfpp/root.hpp"
+#include "dwarfpp/root-inl.hpp"
+#include "dwarfpp/iter.hpp"
+#include "dwarfpp/iter-inl.hpp"
+#include "dwarfpp/dies.hpp"
+#include "dwarfpp/frame.hpp"
+#include "dwarfpp/section-loader.hpp"
+
+namespace dwarf
+{
+	using std::endl;
+	using std::vector;
+	namespace core
+	{
+		/* libdwarf's CU API is stateful per Dwarf_Debug, so each worker opens
+		 * its own over the same fd. Workers share nothing until the merge;
+		 * current_dwarf_error is thread-local, so using it here is fine. We
+		 * install no error handler, because throwing out of a worker thread
+		 * would just terminate us. */
+		namespace
+		{
+			struct preload_shard
+			{
+				vector<pair<Dwarf_Off, Dwarf_Off> > parent_edges;
+				vector<pair<Dwarf_Off, Dwarf_Off> > first_child_edges;
+				vector<pair<Dwarf_Off, Dwarf_Off> > next_sibling_edges;
+				vector<pair<Dwarf_Off, unsigned short> > depths;
+				vector<Dwarf_Off> cu_offsets; // only worker 0 fills this
+				bool ok;
+				preload_shard() : ok(true) {}
+			};
+
+			void preload_subtree(Dwarf_Debug dbg, Dwarf_Die die, Dwarf_Off off,
+				unsigned short depth, preload_shard& s)
+			{
+				Dwarf_Die child;
+				Dwarf_Off prev_off = 0UL;
+				int ret = dwarf_child(die, &child, &current_dwarf_error);
+				while (ret == DW_DLV_OK)
+				{
+					Dwarf_Off child_off;
+					if (DW_DLV_OK != dwarf_dieoffset(child, &child_off, &current_dwarf_error))
+					{
+						dwarf_dealloc(dbg, child, DW_DLA_DIE);
+						s.ok = false;
+						return;
+					}
+					s.parent_edges.push_back(make_pair(child_off, off));
+					s.depths.push_back(make_pair(child_off, (unsigned short)(depth + 1)));
+					if (prev_off == 0UL) s.first_child_edges.push_back(make_pair(off, child_off));
+					else s.next_sibling_edges.push_back(make_pair(prev_off, child_off));
+					prev_off = child_off;
+
+					preload_subtree(dbg, child, child_off, depth + 1, s);
+
+					Dwarf_Die next;
+					ret = dwarf_siblingof(dbg, child, &next, &current_dwarf_error);
+					dwarf_dealloc(dbg, child, DW_DLA_DIE);
+					child = next;
+				}
+				if (ret == DW_DLV_ERROR) s.ok = false;
+			}
+
+			void preload_worker(int fd, const elf_image *p_image, section_loader *p_loader,
+				unsigned worker, unsigned nworkers, preload_shard& s)
+			{
+				Dwarf_Debug dbg;
+				/* With an image, every worker reads the same bytes in place;
+				 * with a loader, they also share whatever it has inflated. */
+				::Elf *elf = (p_image && !p_loader) ? p_image->open_elf() : nullptr;
+				int ret = p_loader
+					? dwarf_object_init(p_loader->get_interface(),
+						nullptr, nullptr, &dbg, &current_dwarf_error)
+					: elf
+					? dwarf_elf_init(reinterpret_cast<Elf_opaque_in_libdwarf *>(elf), DW_DLC_READ,
+						nullptr, nullptr, &dbg, &current_dwarf_error)
+					: dwarf_init(fd, DW_DLC_READ, nullptr, nullptr, &dbg, &current_dwarf_error);
+				if (DW_DLV_OK != ret)
+				{
+					if (elf) elf_end(elf);
+					s.ok = false;
+					return;
+				}
+				Dwarf_Unsigned cu_header_length;
+				Dwarf_Half version_stamp;
+				Dwarf_Unsigned abbrev_offset;
+				Dwarf_Half address_size;
+				Dwarf_Half offset_size;
+				Dwarf_Half extension_size;
+				Dwarf_Unsigned next_cu_header;
+				/* We have to step over every CU header to keep libdwarf's CU
+				 * context moving, but we only walk our share of the CUs. Dealing
+				 * them out round-robin spreads big and small CUs fairly evenly. */
+				for (unsigned i = 0; DW_DLV_OK == dwarf_next_cu_header_b(dbg,
+						&cu_header_length, &version_stamp, &abbrev_offset,
+						&address_size, &offset_size, &extension_size,
+						&next_cu_header, &current_dwarf_error); ++i)
+				{
+					bool mine = (i % nworkers == worker);
+					if (!mine && worker != 0) continue;
+					Dwarf_Die cu_die;
+					if (DW_DLV_OK != dwarf_siblingof(dbg, nullptr, &cu_die, &current_dwarf_error))
+					{
+						s.ok = false;
+						continue;
+					}
+					Dwarf_Off cu_off;
+					int ret = dwarf_dieoffset(cu_die, &cu_off, &current_dwarf_error);
+					if (ret == DW_DLV_OK)
+					{
+						if (worker == 0) s.cu_offsets.push_back(cu_off);
+						if (mine) preload_subtree(dbg, cu_die, cu_off, 1, s);
+					} else s.ok = false;
+					dwarf_dealloc(dbg, cu_die, DW_DLA_DIE);
+				}
+				if (p_loader) dwarf_object_finish(dbg, &current_dwarf_error);
+				else dwarf_finish(dbg, &current_dwarf_error);
+				if (elf) elf_end(elf);
+			}
+
+			/* libdwarf loads a section the first time something reads it,
+			 * writing to the Dwarf_Debug as it does, and readers hold no
+			 * lock for that. So before we're shared, we load whatever they
+			 * might read: .debug_str for names, .debug_loc and
+			 * .debug_ranges for lists, and .debug_line for file names. The
+			 * CU walk has read .debug_info and .debug_abbrev, and the frame
+			 * section reads .eh_frame. */
+			void load_reader_sections(root_die& r, Dwarf_Debug dbg)
+			{
+				try
+				{
+					char *str;
+					Dwarf_Signed str_len;
+					dwarf_get_str(dbg, 0, &str, &str_len, &current_dwarf_error);
+					Dwarf_Addr hipc, lopc;
+					Dwarf_Ptr data;
+					Dwarf_Unsigned entry_len, next_entry;
+					dwarf_get_loclist_entry(dbg, 0, &hipc, &lopc, &data, &entry_len,
+						&next_entry, &current_dwarf_error);
+					Dwarf_Ranges *ranges;
+					Dwarf_Signed n_ranges;
+					Dwarf_Unsigned n_bytes;
+					if (DW_DLV_OK == dwarf_get_ranges(dbg, 0, &ranges, &n_ranges, &n_bytes,
+						&current_dwarf_error)) dwarf_ranges_dealloc(dbg, ranges, n_ranges);
+					/* Any CU's file names will do; the section loads whole. */
+					auto cus = r.begin().children_here();
+					for (auto i_cu = std::move(cus.first); i_cu != cus.second; ++i_cu)
+					{
+						if (!i_cu.has_attr(DW_AT_stmt_list)) continue;
+						auto p_cu = i_cu.as_a<compile_unit_die>();
+						if (p_cu) { p_cu->get_source_files(); break; }
+					}
+				} catch (dwarf::lib::Error e)
+				{
+					debug(1) << "Warning: libdwarf error loading sections to freeze: "
+						<< dwarf_errmsg(current_dwarf_error) << endl;
+				}
+			}
+		}
+
+		bool root_die::preload(unsigned nthreads)
+		{
+			if ((fd == -1 && !img.elf) || !dbg.handle) return false;
+			if (nthreads == 0) nthreads = std::max(1u, std::thread::hardware_concurrency());
+			vector<preload_shard> shards(nthreads);
+			vector<std::thread> workers;
+			for (unsigned i = 0; i < nthreads; ++i)
+			{
+				workers.push_back(std::thread(preload_worker, fd,
+					img.elf ? img.image.get() : nullptr, img.loader.get(),
+					i, nthreads, std::ref(shards[i])));
+			}
+			for (auto i_t = workers.begin(); i_t != workers.end(); ++i_t) i_t->join();
+
+			/* Merge. Don't overwrite anything we already have (it ought to agree). */
+			unsigned long n_dies = 0;
+			bool ok = true;
+			for (auto i_s = shards.begin(); i_s != shards.end(); ++i_s)
+			{
+				n_dies += i_s->parent_edges.size();
+				ok &= i_s->ok;
+			}
+			auto& cu_offsets = shards.front().cu_offsets;
+			parent_of.reserve(parent_of.size() + n_dies + cu_offsets.size());
+			first_child_of.reserve(first_child_of.size() + n_dies / 2);
+			next_sibling_of.reserve(next_sibling_of.size() + n_dies / 2);
+			depth_of.reserve(depth_of.size() + n_dies + cu_offsets.size());
+			for (auto i_s = shards.begin(); i_s != shards.end(); ++i_s)
+			{
+				parent_of.insert(i_s->parent_edges.begin(), i_s->parent_edges.end());
+				first_child_of.insert(i_s->first_child_edges.begin(), i_s->first_child_edges.end());
+				next_sibling_of.insert(i_s->next_sibling_edges.begin(), i_s->next_sibling_edges.end());
+				depth_of.insert(i_s->depths.begin(), i_s->depths.end());
+				// free as we go; these can be big
+				vector<pair<Dwarf_Off, Dwarf_Off> >().swap(i_s->parent_edges);
+				vector<pair<Dwarf_Off, Dwarf_Off> >().swap(i_s->first_child_edges);
+				vector<pair<Dwarf_Off, Dwarf_Off> >().swap(i_s->next_sibling_edges);
+				vector<pair<Dwarf_Off, unsigned short> >().swap(i_s->depths);
+			}
+			/* The CU-level edges come from worker 0, which saw every header. */
+			for (auto i_cu = cu_offsets.begin(); i_cu != cu_offsets.end(); ++i_cu)
+			{
+				parent_of.insert(make_pair(*i_cu, 0UL));
+				depth_of.insert(make_pair(*i_cu, (unsigned short) 1));
+				if (i_cu == cu_offsets.begin()) first_child_of.insert(make_pair(0UL, *i_cu));
+				else next_sibling_of.insert(make_pair(*(i_cu - 1), *i_cu));
+			}
+			debug(2) << "Preloaded navigation caches for " << n_dies << " DIEs in "
+				<< cu_offsets.size() << " CUs using " << nthreads << " threads" << endl;
+			nav_complete = ok;
+			return ok;
+		}
+
+		bool root_die::freeze()
+		{
+			if (frozen) return true;
+			if (!nav_complete && !have_dense_nav()) return false;
+			/* Walking the CUs makes their (sticky) payloads, and caches the
+			 * CU-level edges, so frozen navigation never needs libdwarf's
+			 * CU context, which is per-Dwarf_Debug state. */
+			auto cus = begin().children_here();
+			unsigned ncus = 0;
+			for (auto i_cu = std::move(cus.first); i_cu != cus.second; ++i_cu, ++ncus);
+			if (dbg.handle) load_reader_sections(*this, dbg.raw_handle());
+			/* The frame section builds its indexes, and decodes .eh_frame_hdr,
+			 * on demand; not once we're shared. */
+			if (p_fs) p_fs->ensure_indexes();
+			/* Pin everything live, so that no payload deregisters itself
+			 * (i.e. writes to live_dies) while we're frozen. */
+			frozen_pins.reserve(live_dies.size());
+			for (auto i = live_dies.begin(); i != live_dies.end(); ++i)
+			{
+				frozen_pins.push_back(ptr_type(i->second));
+			}
+			frozen = true;
+			++frozen_root_count;
+			debug(2) << "Froze root DIE with " << ncus << " CUs and "
+				<< frozen_pins.size() << " live payloads" << endl;
+			return true;
+		}
+
+		void root_die::thaw()
+		{
+			if (!frozen) return;
+			frozen = false; // first, so that unpinned payloads deregister
+			frozen_pins.clear();
+			--frozen_root_count;
+			/* Readers may have cached into payloads without telling us. */
+			type_dependents.may_have_cached = true;
+		}
+	}
+}
@@ -0,0 +1,158 @@
+/* dwarfpp: C++ binding for a useful subset of libdwarf, plus extra goodies.
+ *
+ * readahead.cpp: asking for section bytes ahead of a traversal
+ *
+ * Copyright (c) 2008--17, Stephen Kell. For licensing information, see the
+ * LICENSE file in the root of the libdwarfpp tree.
+ */
+
+#include <cstring>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "dwarfpp/root.hpp"
+#include "dwarfpp/section-loader.hpp"
+#include "dwarfpp/native-reader.hpp"
+
+namespace dwarf
+{
+	using std::endl;
+	namespace core
+	{
+		namespace
+		{
+			const char *const whole_section_names[]
+			 = { ".debug_abbrev", ".debug_str", ".debug_line_str", nullptr };
+
+			/* Only a section stored plainly has its bytes in the image, where
+			 * madvise() can do any good; an inflated one is on our heap. */
+			bool plain_section(const section_loader& loader, const char *name,
+				const unsigned char **p_data, size_t *p_size)
+			{
+				auto& secs = loader.get_sections();
+				for (auto i_s = secs.begin(); i_s != secs.end(); ++i_s)
+				{
+					if (i_s->name != name) continue;
+					if (i_s->compression != section_loader::NONE || !i_s->file_bytes) return false;
+					*p_data = i_s->file_bytes;
+					*p_size = i_s->file_size;
+					return true;
+				}
+				return false;
+			}
+
+			/* Where the unit whose header is at off ends, or 0 if we can't say. */
+			Dwarf_Off unit_end(const unsigned char *info, size_t info_size, Dwarf_Off off)
+			{
+				uint32_t len32;
+				if (off + 4 > info_size) return 0;
+				memcpy(&len32, info + off, 4);
+				if (len32 < 0xfffffff0u) return off + 4 + len32;
+				if (len32 != 0xffffffffu || off + 12 > info_size) return 0;
+				uint64_t len64;
+				memcpy(&len64, info + off + 4, 8);
+				return off + 12 + len64;
+			}
+		}
+
+		bool root_die::set_readahead(unsigned n_cus)
+		{
+			if (n_cus == 0) { readahead.n_cus = 0; return true; }
+			const unsigned char *info;
+			size_t info_size;
+			if (!img.loader || !plain_section(*img.loader, ".debug_info", &info, &info_size))
+			{
+				debug(2) << "No plainly stored .debug_info to read ahead in" << endl;
+				return false;
+			}
+			readahead.n_cus = n_cus;
+			return true;
+		}
+
+		void root_die::read_ahead_of(Dwarf_Off cu_off)
+		{
+			assert(img.loader);
+			const section_loader& loader = *img.loader;
+			static const uintptr_t page_size = sysconf(_SC_PAGESIZE);
+			auto advise = [this](const unsigned char *data, size_t size, Dwarf_Off begin, Dwarf_Off end) {
+				if (end > size) end = size;
+				if (begin >= end) return;
+				uintptr_t from = (uintptr_t) (data + begin) & ~(page_size - 1);
+				uintptr_t to = (uintptr_t) (data + end);
+				/* Failure only means the kernel won't help; carry on regardless. */
+				if (madvise((void *) from, to - from, MADV_WILLNEED) == 0)
+				{
+					++readahead.n_calls;
+					readahead.n_bytes += to - from;
+				}
+			};
+
+			const unsigned char *data;
+			size_t size;
+			if (!readahead.whole_sections_done)
+			{
+				readahead.whole_sections_done = true;
+				for (const char *const *p_name = whole_section_names; *p_name; ++p_name)
+				{
+					if (plain_section(loader, *p_name, &data, &size)) advise(data, size, 0, size);
+				}
+			}
+
+			const unsigned char *info;
+			size_t info_size;
+			if (!plain_section(loader, ".debug_info", &info, &info_size)) return;
+			/* The rest of this CU and the next n: a reader knows where every
+			 * unit starts; with libdwarf, we know where the next header is,
+			 * having just advanced past it, and read the lengths of those
+			 * after. Last time we asked for all of it bar the newest CU;
+			 * the first time, it's this CU too. */
+			Dwarf_Off begin = cu_off;
+			Dwarf_Off end;
+			unsigned unit_idx;
+			bool have_unit_idx = p_reader && p_reader->unit_index_for(cu_off, &unit_idx);
+			if (have_unit_idx)
+			{
+				unsigned n = p_reader->unit_count();
+				end = (unit_idx + 1 + readahead.n_cus < n)
+					? p_reader->unit_die_offset(unit_idx + 1 + readahead.n_cus) : info_size;
+			}
+			else if (cu_off == current_cu_offset && last_seen_next_cu_header)
+			{
+				end = *last_seen_next_cu_header;
+				for (unsigned i = 0; i < readahead.n_cus; ++i)
+				{
+					Dwarf_Off next = unit_end(info, info_size, end);
+					if (next <= end) break;
+					end = next;
+				}
+			}
+			else return;
+			/* We only go forwards; what we asked for before, we leave be. */
+			if (begin < readahead.info_done) begin = readahead.info_done;
+			if (begin < end)
+			{
+				advise(info, info_size, begin, end);
+				readahead.info_done = end;
+			}
+
+			/* The location and range lists this CU uses. We have no idea how
+			 * long the last list is, but one page will usually do. */
+			shared_ptr<const native_reader> p_native = get_native_reader();
+			if (!p_native || !have_unit_idx) return;
+			native_reader::offset_span locs;
+			native_reader::offset_span ranges;
+			if (!p_native->unit_list_offsets(unit_idx, &locs, &ranges)) return;
+			bool v5 = p_native->get_unit(unit_idx).version >= 5;
+			if (locs.lo <= locs.hi
+				&& plain_section(loader, v5 ? ".debug_loclists" : ".debug_loc", &data, &size))
+			{
+				advise(data, size, locs.lo, locs.hi + page_size);
+			}
+			if (ranges.lo <= ranges.hi
+				&& plain_section(loader, v5 ? ".debug_rnglists" : ".debug_ranges", &data, &size))
+			{
+				advise(data, size, ranges.lo, ranges.hi + page_size);
+			}
+		}
+	}
+}
@@ -0,0 +1,105 @@
+/* dwarfpp: C++ binding for a useful subset of libdwarf, plus extra goodies.
+ *
+ * ref-graph.cpp: extracting the whole reference graph in one parallel pass
+ *
+ * Copyright (c) 2008--17, Stephen Kell. For licensing information, see the
+ * LICENSE file in the root of the libdwarfpp tree.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+#include "dwarfpp/root.hpp"
+#include "dwarfpp/native-reader.hpp"
+
+namespace dwarf
+{
+	using std::endl;
+	using std::vector;
+	namespace core
+	{
+		unsigned ref_graph::index_of(Dwarf_Off off) const
+		{
+			auto found = std::lower_bound(dies.begin(), dies.end(), off);
+			return (found != dies.end() && *found == off) ? found - dies.begin() : NONE;
+		}
+
+		size_t ref_graph::bytes() const
+		{
+			return sizeof *this + dies.capacity() * sizeof (Dwarf_Off)
+				+ parents.capacity() * sizeof (Dwarf_Off)
+				+ edge_begin.capacity() * sizeof (unsigned)
+				+ edges.capacity() * sizeof (edge);
+		}
+
+		bool root_die::extract_ref_graph(ref_graph& out, unsigned nthreads) const
+		{
+			out = ref_graph();
+			/* Any native reader will do, even one we're not navigating with. */
+			shared_ptr<const native_reader> p_native = get_native_reader();
+			if (!p_native && img.loader) p_native = native_reader::from_loader(*img.loader);
+			if (!p_native) return false;
+			const native_reader& reader = *p_native;
+			unsigned n_units = reader.unit_count();
+			if (n_units == 0) return false;
+
+			/* Each unit into its own slice, taken in turn by whichever
+			 * thread is free; nothing here is shared but the reader. */
+			if (nthreads == 0) nthreads = std::max(1u, std::thread::hardware_concurrency());
+			nthreads = std::min(nthreads, n_units);
+			vector<ref_graph> slices(n_units);
+			vector<char> slice_ok(n_units);
+			std::atomic<unsigned> next_unit(0);
+			auto run = [&]() {
+				for (unsigned u; (u = next_unit++) < n_units; )
+				{
+					slice_ok[u] = reader.read_unit_refs(u, slices[u]);
+				}
+			};
+			if (nthreads == 1) run();
+			else
+			{
+				vector<std::thread> workers;
+				for (unsigned i = 0; i < nthreads; ++i) workers.push_back(std::thread(run));
+				for (auto i_w = workers.begin(); i_w != workers.end(); ++i_w) i_w->join();
+			}
+
+			/* Units are in offset order, so concatenating keeps the DIEs so. */
+			size_t n_dies = 0, n_edges = 0;
+			bool ok = true;
+			for (unsigned u = 0; u < n_units; ++u)
+			{
+				n_dies += slices[u].dies.size();
+				n_edges += slices[u].edges.size();
+				if (!slice_ok[u])
+				{
+					ok = false;
+					debug(1) << "Bad data in unit at 0x" << std::hex << reader.get_unit(u).offset
+						<< std::dec << "; its reference graph is partial" << endl;
+				}
+			}
+			out.dies.reserve(n_dies);
+			out.parents.reserve(n_dies);
+			out.edge_begin.reserve(n_dies + 1);
+			out.edges.reserve(n_edges);
+			for (auto i_s = slices.begin(); i_s != slices.end(); ++i_s)
+			{
+				unsigned base = out.edges.size();
+				out.dies.insert(out.dies.end(), i_s->dies.begin(), i_s->dies.end());
+				out.parents.insert(out.parents.end(), i_s->parents.begin(), i_s->parents.end());
+				for (auto i_b = i_s->edge_begin.begin(); i_b != i_s->edge_begin.end(); ++i_b)
+				{
+					out.edge_begin.push_back(base + *i_b);
+				}
+				out.edges.insert(out.edges.end(), i_s->edges.begin(), i_s->edges.end());
+				*i_s = ref_graph(); // free as we go
+			}
+			out.edge_begin.push_back(out.edges.size());
+			debug(2) << "Extracted reference graph of " << out.dies.size() << " DIEs and "
+				<< out.edges.size() << " edges from " << n_units << " units using "
+				<< nthreads << " threads" << endl;
+			return ok;
+		}
+	}
+}
@@ -43,6 +43,27 @@ const char *dwarf_regnames_x86_64[] = {
 	nullptr
 };
 
+const char *dwarf_regnames_aarch64[] = {
+	"x0", "x1", "x2", "x3", "x4", "x5", "x6", "x7",
+	"x8", "x9", "x10", "x11", "x12", "x13", "x14", "x15",
+	"x16", "x17", "x18", "x19", "x20", "x21", "x22", "x23",
+	"x24", "x25", "x26", "x27", "x28", "x29", "x30", "sp",
+	"pc",
+	nullptr
+};
+
+const char *dwarf_regnames_riscv[] = {
+	"zero", "ra", "sp", "gp", "tp", "t0", "t1", "t2",
+	"s0", "s1", "a0", "a1", "a2", "a3", "a4", "a5",
+	"a6", "a7", "s2", "s3", "s4", "s5", "s6", "s7",
+	"s8", "s9", "s10", "s11", "t3", "t4", "t5", "t6",
+	"ft0", "ft1", "ft2", "ft3", "ft4", "ft5", "ft6", "ft7",
+	"fs0", "fs1", "fa0", "fa1", "fa2", "fa3", "fa4", "fa5",
+	"fa6", "fa7", "fs2", "fs3", "fs4", "fs5", "fs6", "fs7",
+	"fs8", "fs9", "fs10", "fs11", "ft8", "ft9", "ft10", "ft11",
+	nullptr
+};
+
 const char **dwarf_regnames_for_elf_machine(int e_machine)
 {
 	switch (e_machine)
@@ -51,11 +72,27 @@ const char **dwarf_regnames_for_elf_machine(int e_machine)
 			return dwarf_regnames_x86;
 		case /* EM_X86_64 */       62:              /* AMD x86-64 architecture */
 			return dwarf_regnames_x86_64;
+		case /* EM_AARCH64 */     183:              /* ARM AARCH64 */
+			return dwarf_regnames_aarch64;
+		case /* EM_RISCV */       243:              /* RISC-V */
+			return dwarf_regnames_riscv;
 		default:
 		return nullptr;
 	}
 }
 
+int dwarf_sp_regnum_for_elf_machine(int e_machine)
+{
+	switch (e_machine)
+	{
+		case /* EM_386 */           3: return DWARF_X86_ESP;
+		case arch_x86_64::ELF_MACHINE: return arch_x86_64::SP;
+		case arch_aarch64::ELF_MACHINE: return arch_aarch64::SP;
+		case arch_riscv::ELF_MACHINE: return arch_riscv::SP;
+		default: return -1;
+	}
+}
+
 dwarf::encap::loc_expr dwarf_stack_pointer_expr_for_elf_machine(int e_machine,
 	dwarf::lib::Dwarf_Addr lopc, dwarf::lib::Dwarf_Addr hipc)
 {
@@ -67,6 +104,10 @@ dwarf::encap::loc_expr dwarf_stack_pointer_expr_for_elf_machine(int e_machine,
 			return loc_expr((Dwarf_Unsigned[]) { DW_OP_breg0 + DWARF_X86_ESP, 0 }, lopc, hipc);
 		case /* EM_X86_64 */       62:              /* AMD x86-64 architecture */
 			return loc_expr((Dwarf_Unsigned[]) { DW_OP_breg0 + DWARF_X86_64_RSP, 0 }, lopc, hipc);
+		case /* EM_AARCH64 */     183:              /* ARM AARCH64 */
+			return loc_expr((Dwarf_Unsigned[]) { DW_OP_breg0 + DWARF_AARCH64_SP, 0 }, lopc, hipc);
+		case /* EM_RISCV */       243:              /* RISC-V */
+			return loc_expr((Dwarf_Unsigned[]) { DW_OP_breg0 + DWARF_RISCV_SP, 0 }, lopc, hipc);
 		default:
 		return loc_expr();
 	}
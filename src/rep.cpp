@@ -1,277 +1,242 @@
+/* dwarfpp: C++ binding for a useful subset of libdwarf, plus extra goodies.
+ *
+ * rep.cpp: rep-compatibility of types, memoized over canonical type IDs
+ *
+ * Copyright (c) 2008--17, Stephen Kell. For licensing information, see the
+ * LICENSE file in the root of the libdwarfpp tree.
+ */
+
+#include "dwarfpp/root.hpp"
+#include "dwarfpp/root-inl.hpp"
+#include "dwarfpp/iter.hpp"
+#include "dwarfpp/iter-inl.hpp"
+#include "dwarfpp/dies.hpp"
+#include "dwarfpp/dies-inl.hpp"
+
 /* FIXME: this logic (and the is_rep_compatible() API call) doesn't really belong
- * in libdwarfpp. Instead, once clients can thread factories to diesets, 
+ * in libdwarfpp. Instead, once clients can thread factories to diesets,
  * clients which need this sort of horizontal extension should be able to add it
  * in their factory implementations. */
 
 namespace dwarf
 {
-	namespace spec
+	using std::endl;
+	namespace core
 	{
-		// utility shared between class, struct and (HACK) union types
-		static
-		bool
-		is_structurally_rep_compatible(
-			std::shared_ptr<type_die> arg1, std::shared_ptr<type_die> arg2)
+		namespace
 		{
-			// we are always structurally compatible with ourselves
-			if (arg1 == arg2) return true;
-		
-			auto arg1_with_data_members = std::dynamic_pointer_cast<with_data_members_die>(arg1);
-			auto arg2_with_data_members = std::dynamic_pointer_cast<with_data_members_die>(arg2);
-			if (!(arg1_with_data_members && arg2_with_data_members)) return false;
-			
-			// HACK: approximately, we require same tags
-			// (both structs, or both classes, or both unions...)
-			if (arg1->get_tag() != arg2->get_tag()) return false;
-			
-			// if we're both empty, we're compatible
-			if (arg1_with_data_members->member_children_begin() 
-				== arg1_with_data_members->member_children_end()
-			 && arg2_with_data_members->member_children_begin()
-			  == arg2_with_data_members->member_children_end()) return true;
-			
-			// else if we don't know the byte size, we're not compatible
-			if (!arg1->calculate_byte_size() || !arg2->calculate_byte_size()
-			|| *arg1->calculate_byte_size() != *arg2->calculate_byte_size())
-			{
-				std::cerr << "Warning: encountered DWARF structured type with indeterminate size."
-					<< std::endl;
-				return false;
-			}
-			
-			// HACK: our rep-compatibility relation is slightly asymmetric here
-			// in that if the arg defines extra fields that don't interfere with
-			// ours, we don't consider it incompatible. But it would consider
-			// us incompatible with it....
+			/* The overrides below compare concrete types. Given anything
+			 * else, they go via the root, which gets rid of typedefs and
+			 * qualifiers on both sides (and remembers the answer). */
+			bool is_concrete(iterator_df<type_die> t)
+			{ return t && t->get_concrete_type() == t; }
 
-			for (auto i_child = arg1_with_data_members->member_children_begin();
-				i_child != arg1_with_data_members->member_children_end();
-				++i_child)
+			// utility shared between class, struct and (HACK) union types
+			bool is_structurally_rep_compatible(iterator_df<type_die> t1, iterator_df<type_die> t2)
 			{
-				if ((*i_child)->get_tag() != DW_TAG_member) continue;
-				
-				auto p_member = *i_child;
-				auto i_member = i_child;
-				
-				if (!(*i_member)->get_name())
+				// we are always structurally compatible with ourselves
+				if (t1 == t2) return true;
+				// HACK: approximately, we require same tags
+				// (both structs, or both classes, or both unions...)
+				if (!t2.is_a<with_data_members_die>() || t1.tag_here() != t2.tag_here()) return false;
+				root_die& r = t1.root();
+				auto members1 = t1.children_here().subseq_of<member_die>();
+				auto members2 = t2.children_here().subseq_of<member_die>();
+				// if we're both empty, we're compatible
+				if (members1.first == members1.second && members2.first == members2.second) return true;
+				// else if we don't know the byte size, we're not compatible
+				opt<Dwarf_Unsigned> size1 = t1->calculate_byte_size();
+				opt<Dwarf_Unsigned> size2 = t2->calculate_byte_size();
+				if (!size1 || !size2 || *size1 != *size2)
 				{
-					std::cerr << "Warning: encountered DWARF structured type with nameless members."
-						<< std::endl;
+					debug(2) << "Warning: encountered DWARF structured type with indeterminate size: "
+						<< (size1 ? t2 : t1).summary() << endl;
 					return false;
 				}
-				auto like_named_element = 
-				 arg2_with_data_members->named_child(*(*i_member)->get_name());
-				if (!like_named_element)
+				// HACK: our rep-compatibility relation is slightly asymmetric here
+				// in that if t2 defines extra fields that don't interfere with
+				// ours, we don't consider it incompatible. But it would consider
+				// us incompatible with it....
+				for (auto i_member = members1.first; i_member != members1.second; ++i_member)
 				{
-					// other type doesn't have a like-named member, so false
-					return false;
+					opt<string> name = i_member.name_here();
+					if (!name)
+					{
+						debug(2) << "Warning: encountered DWARF structured type with nameless members: "
+							<< t1.summary() << endl;
+						return false;
+					}
 					// FIXME: support a name-mapping in here, so that field renamings
 					// can recover rep-compatibility
+					iterator_base found = r.find_named_child(t2, *name);
+					if (!found || !found.is_a<member_die>()) return false;
+					auto like_named_member = found.as_a<member_die>();
+					opt<Dwarf_Unsigned> off1 = i_member->byte_offset_in_enclosing_type();
+					opt<Dwarf_Unsigned> off2 = like_named_member->byte_offset_in_enclosing_type();
+					if (!off1 || !off2 || *off1 != *off2) return false;
+					if (!i_member->get_type() || !like_named_member->get_type()
+						|| !r.rep_compatible(i_member->get_type(), like_named_member->get_type()))
+					{ return false; }
+					// else we're good so far
 				}
-				auto like_named_member = std::dynamic_pointer_cast<member_die>(
-					like_named_element);
-				if (!like_named_member) return false;
-				
-				auto like_named_byte_offset
-				= like_named_member->byte_offset_in_enclosing_type();
-				
-				if (!like_named_byte_offset
-				|| !(*i_member)->byte_offset_in_enclosing_type()
-				|| *like_named_byte_offset != *(*i_member)->byte_offset_in_enclosing_type())
-				{ return false; }
-				
-				if (!like_named_member->get_type() || !(*i_member)->get_type()
-				|| !like_named_member->get_type()->is_rep_compatible((*i_member)->get_type()))
-				{ return false; }
-				
-				// else we're good so far
+				return true;
 			}
-			return true;
 		}
 
-	
-        bool type_die::is_rep_compatible(std::shared_ptr<type_die> arg) const
-        {
-        	// first, try to make ourselves concrete to
+		bool root_die::rep_compatible(const iterator_base& t1_arg, const iterator_base& t2_arg)
+		{
+			iterator_df<type_die> t1 = t1_arg.as_a<type_die>();
+			iterator_df<type_die> t2 = t2_arg.as_a<type_die>();
+			if (t1) t1 = t1->get_concrete_type();
+			if (t2) t2 = t2->get_concrete_type();
+			if (!t1 || !t2) return false;
+			if (t1 == t2) return true;
+			/* Equal types are compatible, whatever they are, and types with
+			 * equal IDs are compatible with the same things. */
+			opt<unsigned> id1 = canonical_id(t1);
+			opt<unsigned> id2 = id1 ? canonical_id(t2) : opt<unsigned>();
+			if (id1 && id2 && *id1 == *id2) return true;
+			pair<unsigned, unsigned> key;
+			if (id1 && id2)
+			{
+				key = make_pair(*id1, *id2);
+				auto found = rep_compatible_cache.find(key);
+				DWARFPP_STAT_HIT(*this, found != rep_compatible_cache.end(), rep_compatible);
+				if (found != rep_compatible_cache.end()) return found->second;
+			}
+			/* None of the overrides admits a difference in size, so that
+			 * rules out most pairs without looking at their members. */
+			opt<Dwarf_Unsigned> size1 = t1->calculate_byte_size();
+			opt<Dwarf_Unsigned> size2 = t2->calculate_byte_size();
+			bool result = !(size1 && size2 && *size1 != *size2)
+				&& t1->is_rep_compatible(t2);
+			if (id1 && id2 && !frozen)
+			{
+				rep_compatible_cache.insert(make_pair(key, result));
+				note_cache_growth(t1.offset_here());
+			}
+			return result;
+		}
+
+		bool type_die::is_rep_compatible(iterator_df<type_die> arg) const
+		{
+			// first, try to make ourselves concrete to
 			// get rid of typedefs and qualifiers
-			if (!this->get_concrete_type() || !arg->get_concrete_type()) return false;
-			if (this->get_concrete_type()->get_offset() != this->get_offset()
-			||  arg->get_concrete_type()->get_offset() != arg->get_offset())
+			if (!is_concrete(find_self()) || !is_concrete(arg))
 			{
-				return this->get_concrete_type()->is_rep_compatible(arg->get_concrete_type());
+				return get_root().rep_compatible(find_self(), arg);
 			}
 			// if we're already concrete, default is not rep-compatible
 			// -- overrides will refine this appropriately
-			std::cerr << "Warning: is_rep_compatible bailing out with default false." << std::endl;
+			debug(2) << "Warning: is_rep_compatible bailing out with default false for "
+				<< summary() << endl;
 			return false;
-        }
-		bool array_type_die::is_rep_compatible(std::shared_ptr<type_die> arg) const
+		}
+		bool array_type_die::is_rep_compatible(iterator_df<type_die> arg) const
 		{
-        	// first, try to make arg concrete
-			if (arg->get_concrete_type()->get_offset() != arg->get_offset()) return this->is_rep_compatible(
-				arg->get_concrete_type());			
-			// HMM: do we want singleton arrays to be rep-compatible wit
+			if (!is_concrete(arg)) return get_root().rep_compatible(find_self(), arg);
+			// HMM: do we want singleton arrays to be rep-compatible with
 			// non-array single objects? Not so at present.
-			auto arg_array_type = std::dynamic_pointer_cast<array_type_die>(arg);
-			if (!arg_array_type) return false;
-			
-			return this->calculate_byte_size() && arg_array_type->calculate_byte_size()
-				&& *this->calculate_byte_size() == *arg_array_type->calculate_byte_size()
-				&& this->get_type() && arg_array_type->get_type()
-				&& this->get_type()->is_rep_compatible(arg_array_type->get_type());
+			if (!arg.is_a<array_type_die>()) return false;
+			auto arg_array_type = arg.as_a<array_type_die>();
+			opt<Dwarf_Unsigned> size = calculate_byte_size();
+			opt<Dwarf_Unsigned> arg_size = arg_array_type->calculate_byte_size();
+			return size && arg_size && *size == *arg_size
+				&& get_type() && arg_array_type->get_type()
+				&& get_root().rep_compatible(get_type(), arg_array_type->get_type());
 		}
-		bool pointer_type_die::is_rep_compatible(std::shared_ptr<type_die> arg) const
+		bool pointer_type_die::is_rep_compatible(iterator_df<type_die> arg) const
 		{
-        	// first, try to make arg concrete
-			if (arg->get_concrete_type()->get_offset() != arg->get_offset()) return this->is_rep_compatible(
-				arg->get_concrete_type());			
+			if (!is_concrete(arg)) return get_root().rep_compatible(find_self(), arg);
 			// HMM: do we want pointers and references to be mutually
 			// rep-compatible? Not so at present.
-			auto arg_pointer_type = std::dynamic_pointer_cast<pointer_type_die>(arg);
-			if (!arg_pointer_type) return false;
-			else return true; // all pointers are rep-compatible
+			return arg.is_a<pointer_type_die>(); // all pointers are rep-compatible
 		}
-		bool reference_type_die::is_rep_compatible(std::shared_ptr<type_die> arg) const
+		bool reference_type_die::is_rep_compatible(iterator_df<type_die> arg) const
 		{
-        	// first, try to make arg concrete
-			if (arg->get_concrete_type()->get_offset() != arg->get_offset()) return this->is_rep_compatible(
-				arg->get_concrete_type());			
-			// HMM: do we want pointers and references to be mutually
-			// rep-compatible? Not so at present.
-			auto arg_reference_type = std::dynamic_pointer_cast<reference_type_die>(arg);
-			if (!arg_reference_type) return false;
-			else return true; // all references are rep-compatible		
+			if (!is_concrete(arg)) return get_root().rep_compatible(find_self(), arg);
+			return arg.is_a<reference_type_die>(); // all references are rep-compatible
 		}
-		bool base_type_die::is_rep_compatible(std::shared_ptr<type_die> arg) const
+		bool base_type_die::is_rep_compatible(iterator_df<type_die> arg) const
 		{
-        	// first, try to make arg concrete
-			// HACK: strange infinite recursion bug here, so try using get_offset
-			if (!arg->get_concrete_type()) return false;
-			if (arg->get_concrete_type()->get_offset() != arg->get_offset()) return this->is_rep_compatible(
-				arg->get_concrete_type());			
-			auto arg_base_type = std::dynamic_pointer_cast<base_type_die>(arg);
-			if (!arg_base_type) return false;
-			
-			return arg_base_type->get_encoding() == this->get_encoding()
-				&& arg_base_type->get_byte_size() == this->get_byte_size()
-				&& arg_base_type->get_bit_size () == this->get_bit_size()
-				&& arg_base_type->get_bit_offset() == this->get_bit_offset();
+			if (!is_concrete(arg)) return get_root().rep_compatible(find_self(), arg);
+			if (!arg.is_a<base_type_die>()) return false;
+			auto arg_base_type = arg.as_a<base_type_die>();
+			return arg_base_type->get_encoding() == get_encoding()
+				&& arg_base_type->get_byte_size() == get_byte_size()
+				&& arg_base_type->bit_size_and_offset() == bit_size_and_offset();
 		}
-		bool structure_type_die::is_rep_compatible(std::shared_ptr<type_die> arg) const
+		bool structure_type_die::is_rep_compatible(iterator_df<type_die> arg) const
 		{
-        	// first, try to make arg concrete
-			if (arg->get_concrete_type()->get_offset() != arg->get_offset()) return this->is_rep_compatible(
-				arg->get_concrete_type());			
-			auto nonconst_this = const_cast<structure_type_die *>(this); // HACK: remove
-			return is_structurally_rep_compatible(
-				std::dynamic_pointer_cast<type_die>(nonconst_this->get_this()), 
-				arg);
+			if (!is_concrete(arg)) return get_root().rep_compatible(find_self(), arg);
+			return is_structurally_rep_compatible(find_self(), arg);
 		}
-		bool union_type_die::is_rep_compatible(std::shared_ptr<type_die> arg) const
+		bool union_type_die::is_rep_compatible(iterator_df<type_die> arg) const
 		{
-        	// first, try to make arg concrete
-			if (arg->get_concrete_type()->get_offset() != arg->get_offset()) return this->is_rep_compatible(
-				arg->get_concrete_type());			
-			auto nonconst_this = const_cast<union_type_die *>(this); // HACK: remove
-			return is_structurally_rep_compatible(
-				std::dynamic_pointer_cast<type_die>(nonconst_this->get_this()), 
-				arg);
+			if (!is_concrete(arg)) return get_root().rep_compatible(find_self(), arg);
+			return is_structurally_rep_compatible(find_self(), arg);
 		}
-		bool class_type_die::is_rep_compatible(std::shared_ptr<type_die> arg) const
+		bool class_type_die::is_rep_compatible(iterator_df<type_die> arg) const
 		{
-        	// first, try to make arg concrete
-			if (arg->get_concrete_type()->get_offset() != arg->get_offset()) return this->is_rep_compatible(
-				arg->get_concrete_type());			
-			auto nonconst_this = const_cast<class_type_die *>(this); // HACK: remove
-			return is_structurally_rep_compatible(
-				std::dynamic_pointer_cast<type_die>(nonconst_this->get_this()), 
-				arg);
+			if (!is_concrete(arg)) return get_root().rep_compatible(find_self(), arg);
+			return is_structurally_rep_compatible(find_self(), arg);
 		}
-		bool enumeration_type_die::is_rep_compatible(std::shared_ptr<type_die> arg) const
+		bool enumeration_type_die::is_rep_compatible(iterator_df<type_die> arg) const
 		{
-			auto nonconst_this = const_cast<enumeration_type_die *>(this);
-			// first, try to make arg concrete
-			if (arg->get_concrete_type()->get_offset() != arg->get_offset()) return this->is_rep_compatible(
-				arg->get_concrete_type());			
-			auto arg_enumeration_type = std::dynamic_pointer_cast<enumeration_type_die>(arg);
-			auto arg_base_type = std::dynamic_pointer_cast<base_type_die>(arg);
-			if (!arg_enumeration_type && !arg_base_type) return false;
-			if (arg_enumeration_type) 
+			if (!is_concrete(arg)) return get_root().rep_compatible(find_self(), arg);
+			if (!arg.is_a<enumeration_type_die>() && !arg.is_a<base_type_die>()) return false;
+			// FIXME: test enumerators too!
+			iterator_df<type_die> my_base_type = get_type();
+			if (!my_base_type) my_base_type = find_self().enclosing_cu()->implicit_enum_base_type();
+			if (!my_base_type) return false;
+			iterator_df<type_die> arg_base_type = arg;
+			if (arg.is_a<enumeration_type_die>())
 			{
-				// FIXME: test enumerators too!
-				shared_ptr<type_die> my_base_type = this->get_type();
-				shared_ptr<type_die> arg_base_type = arg_enumeration_type->get_type();
-				bool result;
-				if (!my_base_type) my_base_type
-				 = nonconst_this->enclosing_compile_unit()->implicit_enum_base_type();
-				assert(my_base_type);
-				if (!arg_base_type) arg_base_type
-				 = arg->enclosing_compile_unit()->implicit_enum_base_type();
-				assert(arg_base_type);
-				result = my_base_type->is_rep_compatible(arg_base_type);
-				if (!result)
-				{
-					cerr << "My base type: " << *my_base_type << endl
-						<< "Arg base type: " << *arg_base_type << endl;
-				}
-				return result;
+				arg_base_type = arg.as_a<enumeration_type_die>()->get_type();
+				if (!arg_base_type) arg_base_type = arg.enclosing_cu()->implicit_enum_base_type();
+				if (!arg_base_type) return false;
 			}
-			else return this->get_type()->is_rep_compatible(arg_base_type);
+			return get_root().rep_compatible(my_base_type, arg_base_type);
 		}
-		bool subroutine_type_die::is_rep_compatible(std::shared_ptr<type_die> arg) const
+		bool subroutine_type_die::is_rep_compatible(iterator_df<type_die> arg) const
 		{
-			//cerr << "Testing this subroutine type at 0x" << std::hex << get_offset()
-			//	<< " against arg subroutine type at 0x" << arg->get_offset() << std::dec << endl;
-			auto subt_arg = dynamic_pointer_cast<subroutine_type_die>(arg);
-			auto nonconst_this = const_cast<subroutine_type_die *>(this);
-			if (!subt_arg) return false;
-			// first, try to make arg concrete
-			if (subt_arg->get_concrete_type()->get_offset() != subt_arg->get_offset()) return nonconst_this->is_rep_compatible(
-				subt_arg->get_concrete_type());
-			
+			if (!is_concrete(arg)) return get_root().rep_compatible(find_self(), arg);
+			if (!arg.is_a<subroutine_type_die>()) return false;
+			auto subt_arg = arg.as_a<subroutine_type_die>();
+			root_die& r = get_root();
+
 			// we're rep-compatible if our arg types are rep-compatible...
-			subroutine_type_die::formal_parameter_iterator 
-				i_arg_fp = subt_arg->formal_parameter_children_begin(),
-				i_this_fp = nonconst_this->formal_parameter_children_begin();
-			for (; i_arg_fp != subt_arg->formal_parameter_children_end(); ++i_arg_fp, ++i_this_fp)
+			auto this_fps = find_self().children_here().subseq_of<formal_parameter_die>();
+			auto arg_fps = arg.children_here().subseq_of<formal_parameter_die>();
+			auto i_this_fp = this_fps.first;
+			for (auto i_arg_fp = arg_fps.first; i_arg_fp != arg_fps.second; ++i_arg_fp, ++i_this_fp)
 			{
-				if (i_this_fp == nonconst_this->formal_parameter_children_end()) return false;
-			
-				if (!(
-					(*i_this_fp)->get_type() && (*i_arg_fp)->get_type()
-					&& (*i_this_fp)->get_type()->is_rep_compatible((*i_arg_fp)->get_type())))
+				if (i_this_fp == this_fps.second) return false;
+				if (!(i_this_fp->get_type() && i_arg_fp->get_type()
+					&& r.rep_compatible(i_this_fp->get_type(), i_arg_fp->get_type())))
 					return false;
 			}
-			
+			if (i_this_fp != this_fps.second) return false;
+
 			// and agree on varargs
-			if (!
-			(nonconst_this->unspecified_parameters_children_begin() == nonconst_this->unspecified_parameters_children_end())
-			== (subt_arg->unspecified_parameters_children_begin() == subt_arg->unspecified_parameters_children_end()))
-				return false;
-			
+			if (is_variadic() != subt_arg->is_variadic()) return false;
+
 			// ... and our return type
-			if (!((bool) nonconst_this->get_type() == (bool) subt_arg->get_type())) return false;
-			// we still may or may not have a return type (but we agree on this)
-			if (nonconst_this->get_type())
-			{
-				assert(subt_arg->get_type());
-				auto this_conc = nonconst_this->get_type()->get_concrete_type();
-				auto arg_conc = subt_arg->get_type()->get_concrete_type();
-				if ((bool) arg_conc != (bool) this_conc) return false;
-				else if (arg_conc)
-				{
-					assert(this_conc);
-					if (!this_conc->is_rep_compatible(arg_conc)) return false;
-				}
-			}
-			
+			// we may or may not have a return type, but we must agree on this
+			iterator_df<type_die> ret = get_type();
+			iterator_df<type_die> arg_ret = subt_arg->get_type();
+			if (ret) ret = ret->get_concrete_type();
+			if (arg_ret) arg_ret = arg_ret->get_concrete_type();
+			if ((bool) ret != (bool) arg_ret) return false;
+			if (ret && !r.rep_compatible(ret, arg_ret)) return false;
+
 			// ... and our languages
-			if (nonconst_this->enclosing_compile_unit()->get_language()
-				!= subt_arg->enclosing_compile_unit()->get_language()) return false;
-			
+			if (find_self().enclosing_cu()->get_language()
+				!= arg.enclosing_cu()->get_language()) return false;
+
 			// ... and our calling conventions
-			if (nonconst_this->get_calling_convention() != subt_arg->get_calling_convention()) return false;
-				
+			if (get_calling_convention() != subt_arg->get_calling_convention()) return false;
+
 			return true;
 		}
 	}
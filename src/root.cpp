@@ -11,8 +11,11 @@
 #include "dwarfpp/iter.hpp"
 #include "dwarfpp/iter-inl.hpp"
 #include "dwarfpp/frame.hpp"
+#include "dwarfpp/section-loader.hpp"
+#include "dwarfpp/die-reader.hpp"
 
 #include <iostream>
+#include <algorithm>
 #include <srk31/indenting_ostream.hpp>
 #include <srk31/algorithm.hpp>
 
@@ -57,6 +60,40 @@ namespace dwarf
 			d.print(s);
 			return s;
 		}
+		/* root_stats */
+		root_stats root_stats::operator-(const root_stats& arg) const
+		{
+			root_stats diff;
+#define DWARFPP_ROOT_STATS_SUBTRACT(name) diff.name = name - arg.name;
+			DWARFPP_ROOT_STATS_FIELDS(DWARFPP_ROOT_STATS_SUBTRACT)
+#undef DWARFPP_ROOT_STATS_SUBTRACT
+			return diff;
+		}
+		void root_stats::print(std::ostream& s) const
+		{
+#define DWARFPP_ROOT_STATS_PRINT(name) s << #name " " << name << endl;
+			DWARFPP_ROOT_STATS_FIELDS(DWARFPP_ROOT_STATS_PRINT)
+#undef DWARFPP_ROOT_STATS_PRINT
+		}
+		std::ostream& operator<<(std::ostream& s, const root_stats& st)
+		{
+			st.print(s);
+			return s;
+		}
+		void live_root_stats::reset()
+		{
+#define DWARFPP_ROOT_STATS_RESET(name) name.store(0, std::memory_order_relaxed);
+			DWARFPP_ROOT_STATS_FIELDS(DWARFPP_ROOT_STATS_RESET)
+#undef DWARFPP_ROOT_STATS_RESET
+		}
+		root_stats live_root_stats::load() const
+		{
+			root_stats st;
+#define DWARFPP_ROOT_STATS_LOAD(name) st.name = name.load(std::memory_order_relaxed);
+			DWARFPP_ROOT_STATS_FIELDS(DWARFPP_ROOT_STATS_LOAD)
+#undef DWARFPP_ROOT_STATS_LOAD
+			return st;
+		}
 		/* print a whole tree of DIEs -- only defined on iterators. 
 		 * If we made it a method on iterator_base, it would have
 		 * to copy itself. f we make it a method on root_die, it does
@@ -124,8 +161,54 @@ namespace dwarf
 			}
 			return m;
 		}
+		/* The fast path for find_attr. We ask libdwarf for just the one
+		 * attribute, and follow abstract_origin and specification links on
+		 * bare handles, so we neither materialise an attribute list nor make
+		 * a payload at each hop. A live target might be an in-memory DIE or
+		 * override find_attr, so we defer to its payload. The declaration
+		 * case needs find_definition(), which is virtual, so it does need a
+		 * payload; p_payload is the one for h, if we have it. */
+		encap::attribute_value
+		basic_die::find_attr_on_handle(root_die& r, const Die& h, Dwarf_Half a,
+			const basic_die *p_payload, unsigned hops_left)
+		{
+			Attribute::handle_type found = Attribute::try_construct(h, a);
+			if (found) return encap::attribute_value(Attribute(std::move(found)), h, r);
+			Attribute::handle_type link = Attribute::try_construct(h, DW_AT_abstract_origin);
+			bool is_origin = (bool) link;
+			if (!is_origin) link = Attribute::try_construct(h, DW_AT_specification);
+			if (!link)
+			{
+				if (!h.has_attr_here(DW_AT_declaration)) return encap::attribute_value();
+				Dwarf_Off off = h.offset_here();
+				iterator_base found_def = p_payload ? p_payload->find_definition()
+					: r.pos(off)->find_definition();
+				if (found_def && found_def.offset_here() != off) return found_def->find_attr(a);
+				return encap::attribute_value();
+			}
+			Dwarf_Off target_off;
+			int ret = dwarf_global_formref(link.get(), &target_off, &current_dwarf_error);
+			if (ret != DW_DLV_OK || hops_left == 0) return encap::attribute_value();
+			auto found_live = r.live_dies.find(target_off);
+			if (found_live != r.live_dies.end())
+			{
+				basic_die *p_target = found_live->second;
+				if (is_origin) return p_target->find_attr(a);
+				// see the note about specifications below
+				return p_target->has_attr(a) ? p_target->attr(a) : encap::attribute_value();
+			}
+			Die target(Die::try_construct(r, target_off)); // touches no caches
+			if (!target.handle) return encap::attribute_value();
+			if (is_origin) return find_attr_on_handle(r, target, a, nullptr, hops_left - 1);
+			Attribute::handle_type found_in_decl = Attribute::try_construct(target, a);
+			if (found_in_decl) return encap::attribute_value(
+				Attribute(std::move(found_in_decl)), target, r);
+			return encap::attribute_value();
+		}
 		encap::attribute_value basic_die::find_attr(Dwarf_Half a) const
 		{
+			if (d.handle) return find_attr_on_handle(get_root(), d, a, this, 8);
+			/* In-memory DIEs override has_attr() and attr(), so go through those. */
 			if (has_attr(a)) { return attr(a); }
 			else if (has_attr(DW_AT_abstract_origin))
 			{
@@ -169,10 +252,25 @@ namespace dwarf
 // 			} else return find_self();
 		}
 		
-		root_die::root_die(int fd)
-		 :  dbg(fd), 
+		root_die::root_die(int fd) : root_die(fd, shared_ptr<const elf_image>(), string()) {}
+		root_die::root_die(int fd, open_mode mode, const string& section_cache_dir)
+		 : root_die(fd, mode == MAP_FILE ? elf_image::map(fd) : shared_ptr<elf_image>(),
+			section_cache_dir) {}
+		root_die::root_die(shared_ptr<const elf_image> image, const string& section_cache_dir)
+		 : root_die(-1, image, section_cache_dir)
+		{ assert(image); }
+		root_die::root_die(int fd, shared_ptr<const elf_image> image, const string& section_cache_dir)
+		 :  img(image, section_cache_dir),
+			dbg(img.loader ? Debug(img.loader->get_interface(), img.elf)
+				: img.elf ? Debug(img.elf) : Debug(fd)), 
 			visible_named_grandchildren_is_complete(false),
-			p_fs(new FrameSection(get_dbg(), true)), 
+			pubnames_hints_loaded(false),
+			visible_named_grandchildren_cursor(),
+			addr_index_built(false), static_var_index_built(false), line_index_built(false),
+			dwp_tried(false), unit_dwo_ids_read(false), split_units_spliced(false),
+			frozen(false), nav_complete(false),
+			p_fs(new FrameSection(get_dbg(), true, /* lazy */ true)), 
+			fd(fd),
 			current_cu_offset(0UL), returned_elf(nullptr), 
 			first_cu_offset(),
 			last_seen_cu_header_length(),
@@ -184,11 +282,12 @@ namespace dwarf
 			last_seen_next_cu_header()
 		{ assert(p_fs != 0); }
 		
-		root_die::~root_die() { delete p_fs; }
+		root_die::~root_die() { thaw(); delete p_fs; }
 		
 		::Elf *root_die::get_elf()
 		{
 			if (returned_elf) return returned_elf;
+			else if (dbg.object_elf) return returned_elf = dbg.object_elf;
 			else 
 			{
 				int ret = dwarf_get_elf(dbg.raw_handle(), reinterpret_cast<Elf_opaque_in_libdwarf **>(&returned_elf), &core::current_dwarf_error);
@@ -217,7 +316,7 @@ namespace dwarf
 		root_die::parent(const iterator_base& it)
 		{
 			assert(&it.get_root() == this);
-			if (it.tag_here() == DW_TAG_compile_unit) 
+			if (tag_is_cu(it.tag_here()))
 			{
 				assert(it.get_depth() == 1);
 				return it.get_root().begin();
@@ -226,13 +325,39 @@ namespace dwarf
 			else
 			{
 				assert(it.get_depth() > 0);
+				// if our unit is spliced under a skeleton, that's its children's parent
+				if (!spliced_under.empty() && it.depth() == 2)
+				{
+					auto found_splice = spliced_under.find(it.enclosing_cu_offset_here());
+					if (found_splice != spliced_under.end())
+					{
+						return found_splice->second.p_host->pos(found_splice->second.skeleton_off,
+							1, opt<Dwarf_Off>(0UL));
+					}
+				}
+				const dense_nav_cu_table *p_cu;
+				const dense_nav_record *p_rec = dense_nav_lookup(it.offset_here(), &p_cu);
+				const dense_nav_record *p_parent = p_rec ? p_cu->at(p_rec->parent) : nullptr;
+				if (p_parent)
+				{
+					return pos(p_parent->offset, it.depth() - 1, opt<Dwarf_Off>());
+				}
 				auto found = parent_of.find(it.offset_here());
+				DWARFPP_STAT_HIT(*this, found != parent_of.end(), parent_of);
 				if (found == parent_of.end()) 
 				{
-					// find ourselves downwards, then try again
-					debug(2) << "Warning: searching for parent of " << it << " all the way from root." << endl;
-					auto found_again = find_downwards(it.offset_here());
-					found = parent_of.find(it.offset_here());
+					// freeze() promised complete navigation info
+					assert(!frozen);
+					// the budget may have evicted it; look down from our CU
+					auto recovered = recover_parent(it.offset_here());
+					if (recovered) found = parent_of.insert(make_pair(it.offset_here(), *recovered)).first;
+					else
+					{
+						// find ourselves downwards, then try again
+						debug_sampled(2, 1000, << "Warning: searching for parent of " << it << " all the way from root." << endl);
+						auto found_again = find_downwards(it.offset_here());
+						found = parent_of.find(it.offset_here());
+					}
 				}
 				assert(found != parent_of.end());
 				assert(found->first == it.offset_here());
@@ -265,9 +390,14 @@ namespace dwarf
 			auto maybe_parent = parent(it); 
 			if (maybe_parent != iterator_base::END) 
 			{
-				/* check we really got the parent! */
-				assert(parent_of.find(it.offset_here()) != parent_of.end());
-				assert(maybe_parent.offset_here() == parent_of[it.offset_here()]);
+				/* check we really got the parent! (The dense table isn't mirrored
+				 * in parent_of, so we can only check the latter if we used it;
+				 * nor is a splice, which takes us to another root.) */
+				if (&maybe_parent.get_root() == this && !dense_nav_lookup(it.offset_here()))
+				{
+					assert(parent_of.find(it.offset_here()) != parent_of.end());
+					assert(maybe_parent.offset_here() == parent_of[it.offset_here()]);
+				}
 				it = std::move(maybe_parent); 
 				return true; 
 			}
@@ -287,9 +417,21 @@ namespace dwarf
 			assert(&it.get_root() == this);
 			Dwarf_Off start_offset = it.offset_here();
 			Die::handle_type maybe_handle(nullptr, Die::deleter(nullptr)); // TODO: reenable deleter's default constructor
+
+			// a skeleton with its split unit spliced in has that unit's children
+			if (split_units_spliced && start_offset != 0UL)
+			{
+				auto found_split = split_units.find(start_offset);
+				if (found_split != split_units.end() && found_split->second.p_root)
+				{
+					root_die& sr = *found_split->second.p_root;
+					return sr.first_child(sr.pos(found_split->second.cu_offset, 1, opt<Dwarf_Off>(0UL)));
+				}
+			}
 			
 			// check for cached edges 
 			auto found = first_child_of.find(start_offset);
+			DWARFPP_STAT_HIT(*this, found != first_child_of.end(), first_child_of);
 			if (found != first_child_of.end())
 			{
 				auto found_live = live_dies.find(found->second);
@@ -298,12 +440,58 @@ namespace dwarf
 					return iterator_base(static_cast<abstract_die&&>(*found_live->second),
 						it.maybe_depth() ? opt<unsigned short>(it.depth() + 1u) : opt<unsigned short>(),
 						*this);
-				} // else fall through
+				}
+				// when frozen, nobody can have added children behind our back
+				if (frozen) return pos(found->second,
+					it.maybe_depth() ? opt<unsigned short>(it.depth() + 1u) : opt<unsigned short>());
+				// else fall through
+			}
+			
+			// check the dense table, if we have one
+			if (start_offset == 0UL && have_dense_nav())
+			{
+				return pos(dense_nav.front().cu_offset, 1);
+			}
+			const dense_nav_cu_table *p_cu;
+			const dense_nav_record *p_rec = dense_nav_lookup(start_offset, &p_cu);
+			const dense_nav_record *p_child = p_rec ? p_cu->at(p_rec->first_child) : nullptr;
+			if (p_child)
+			{
+				const dense_nav_record& child = *p_child;
+				auto found_live = live_dies.find(child.offset);
+				if (found_live != live_dies.end())
+				{
+					return iterator_base(static_cast<abstract_die&&>(*found_live->second),
+						opt<unsigned short>(child.depth), *this);
+				}
+				return pos(child.offset, child.depth);
+			} // else fall through -- maybe we have in-memory children
+			
+			// a reader other than libdwarf, if we're using one, needs no CU context or handles
+			unsigned unit_idx;
+			if (p_reader && start_offset == 0UL)
+			{
+				if (p_reader->unit_count() == 0) return iterator_base::END;
+				Dwarf_Off cu_off = p_reader->unit_die_offset(0);
+				if (!frozen) first_child_of[0UL] = cu_off;
+				note_cu_entered(cu_off);
+				return pos(cu_off, 1, opt<Dwarf_Off>(0UL));
+			}
+			else if (p_reader && p_reader->unit_index_for(start_offset, &unit_idx))
+			{
+				Dwarf_Off child_off = p_reader->first_child(unit_idx, start_offset);
+				if (child_off == die_reader::NONE) return iterator_base::END;
+				if (!frozen) first_child_of[start_offset] = child_off;
+				return reader_pos(unit_idx, child_off,
+					it.maybe_depth() ? opt<unsigned short>(it.depth() + 1u) : opt<unsigned short>(),
+					start_offset);
 			}
 			
 			// populate maybe_handle with the first child DIE's handle
 			if (start_offset == 0UL) 
 			{
+				// CU context is shared state; freeze() cached the CUs for us
+				if (frozen) return iterator_base::END;
 				// do the CU thing
 				bool ret1 = clear_cu_context();
 				assert(ret1);
@@ -317,6 +505,7 @@ namespace dwarf
 				maybe_handle = std::move(Die::try_construct(*this));
 				
 				if (maybe_handle) first_child_of[0UL] = current_cu_offset;
+				note_cu_entered(current_cu_offset);
 			}
 			else
 			{
@@ -331,8 +520,12 @@ namespace dwarf
 					it.maybe_depth() ? opt<unsigned short>(it.depth() + 1u) : opt<unsigned short>(),
 					it.get_root());
 				// install in parent cache, first_child_of
-				parent_of[new_it.offset_here()] = start_offset;
-				first_child_of[start_offset] = new_it.offset_here();
+				if (!frozen)
+				{
+					parent_of[new_it.offset_here()] = start_offset;
+					first_child_of[start_offset] = new_it.offset_here();
+					note_cache_growth(new_it.offset_here());
+				}
 				return new_it;
 			} else return iterator_base::END;
 		}
@@ -347,13 +540,61 @@ namespace dwarf
 			{ it = std::move(maybe_child); assert(it.depth() == start_depth + 1); return true; }
 			else return false;
 		}
+		/* Parents whose children are many, and often looked up by name. */
+		static bool indexes_named_children(Dwarf_Half tag)
+		{
+			switch (tag)
+			{
+				case 0: // the root, whose children are CUs
+				case DW_TAG_compile_unit:
+				case DW_TAG_partial_unit:
+				case DW_TAG_namespace:
+				case DW_TAG_structure_type:
+				case DW_TAG_class_type:
+				case DW_TAG_union_type:
+				case DW_TAG_subprogram:
+					return true;
+				default:
+					return false;
+			}
+		}
+		root_die::named_children_index::iterator
+		root_die::index_named_children(const iterator_base& start)
+		{
+			/* Like the linear search below, the first child with a name wins. */
+			unordered_map<unsigned, Dwarf_Off> index;
+			auto children = start.children_here();
+			for (auto i_child = std::move(children.first); i_child != children.second; ++i_child)
+			{
+				string_view child_name = i_child.name_view_here();
+				if (child_name.data()) index.insert(make_pair(names.intern(child_name), i_child.offset_here()));
+			}
+			return cache_named_children(start.offset_here(), std::move(index));
+		}
 		iterator_base
 		root_die::find_named_child(const iterator_base& start, const string& name)
 		{
+			Dwarf_Off start_off = start.offset_here();
+			auto found_index = named_children_of.find(start_off);
+			if (found_index == named_children_of.end() && !frozen
+				&& indexes_named_children(start.tag_here()))
+			{
+				found_index = index_named_children(start);
+			}
+			DWARFPP_STAT_HIT(*this, found_index != named_children_of.end(), named_child_index);
+			if (found_index != named_children_of.end())
+			{
+				unsigned id = names.lookup(name);
+				if (id == name_interner::NONE) return iterator_base::END;
+				auto found = found_index->second.find(id);
+				if (found == found_index->second.end()) return iterator_base::END;
+				return pos(found->second, (unsigned short) (start.depth() + 1), opt<Dwarf_Off>(start_off));
+			}
 			auto children = start.children_here();
 			for (auto i_child = std::move(children.first); i_child != children.second; ++i_child)
 			{
-				if (i_child.name_here() && *i_child.name_here() == name)
+				string_view child_name = i_child.name_view_here();
+				if (child_name.data() && child_name == name)
 				{
 					return std::move(i_child);
 				}
@@ -381,6 +622,92 @@ namespace dwarf
 			return found;
 		}
 		
+		void
+		root_die::note_visible_named_grandchild(string_view name, Dwarf_Off off)
+		{
+			/* We might see the same grandchild more than once, e.g. once through
+			 * the per-CU fill and once through a visible_named_grandchildren()
+			 * pass, so don't insert duplicates. Keeping each name's offsets
+			 * sorted means that's a check of the last one, unless we're
+			 * filling out of order. */
+			std::vector<Dwarf_Off>& offs = visible_named_grandchildren_cache[names.intern(name)];
+			size_t capacity_before = offs.capacity();
+			if (offs.empty() || offs.back() < off) offs.push_back(off);
+			else
+			{
+				auto found = std::lower_bound(offs.begin(), offs.end(), off);
+				if (*found != off) offs.insert(found, off);
+			}
+			budget.grandchildren_bytes += (offs.capacity() - capacity_before) * sizeof (Dwarf_Off);
+		}
+		
+		void
+		root_die::load_pubnames_hints()
+		{
+			if (pubnames_hints_loaded) return;
+			pubnames_hints_loaded = true;
+			if (!dbg.handle) return;
+			Dwarf_Global *globals;
+			Dwarf_Signed count;
+			int ret = dwarf_get_globals(dbg.handle.get(), &globals, &count, &current_dwarf_error);
+			if (ret != DW_DLV_OK) return; // no accelerator tables; that's fine
+			for (Dwarf_Signed i = 0; i < count; ++i)
+			{
+				char *name;
+				Dwarf_Off die_off;
+				Dwarf_Off cu_off;
+				ret = dwarf_global_name_offsets(globals[i], &name, &die_off, &cu_off, &current_dwarf_error);
+				if (ret != DW_DLV_OK) continue;
+				/* libdwarf gives us the CU DIE's offset here (not its header's,
+				 * which is dwarf_global_cu_offset()), so no need to make the DIE. */
+				pubnames_hints.insert(make_pair(names.intern(name), cu_off));
+				dwarf_dealloc(dbg.handle.get(), name, DW_DLA_STRING);
+			}
+			dwarf_globals_dealloc(dbg.handle.get(), globals, count);
+			debug(2) << "Loaded " << pubnames_hints.size() << " accelerator-table name hints" << endl;
+		}
+		
+		void
+		root_die::fill_visible_named_grandchildren_for_cu(const iterator_base& cu)
+		{
+			if (!visible_named_grandchildren_cus_done.insert(cu.offset_here()).second) return;
+			auto children = cu.children_here();
+			for (auto i_child = std::move(children.first); i_child != children.second; ++i_child)
+			{
+				string_view name = i_child.global_name_view_here();
+				if (name.data()) note_visible_named_grandchild(name, i_child.offset_here());
+			}
+		}
+		
+		bool
+		root_die::fill_visible_named_grandchildren_step()
+		{
+			if (visible_named_grandchildren_is_complete) return false;
+			/* Resume from where we left off, so that a whole sequence of steps
+			 * is linear in the number of CUs. */
+			iterator_base i_cu = visible_named_grandchildren_cursor
+				? iterator_base(cu_pos(*visible_named_grandchildren_cursor))
+				: first_child(begin());
+			while (i_cu)
+			{
+				bool already_done = visible_named_grandchildren_cus_done.find(i_cu.offset_here())
+					!= visible_named_grandchildren_cus_done.end();
+				if (!already_done) fill_visible_named_grandchildren_for_cu(i_cu);
+				iterator_base next = next_sibling(i_cu);
+				if (!next)
+				{
+					// that was the last CU, so everything is done
+					visible_named_grandchildren_is_complete = true;
+					return !already_done;
+				}
+				visible_named_grandchildren_cursor = next.offset_here();
+				if (!already_done) return true;
+				i_cu = std::move(next);
+			}
+			visible_named_grandchildren_is_complete = true;
+			return false;
+		}
+		
 		bool root_die::is_under(const iterator_base& i1, const iterator_base& i2)
 		{
 			// is i1 under i2?
@@ -523,6 +850,7 @@ namespace dwarf
 			Dwarf_Off offset_here = it.offset_here();
 			// check for cached edges 
 			auto found_cached_sibling = next_sibling_of.find(offset_here);
+			DWARFPP_STAT_HIT(*this, found_cached_sibling != next_sibling_of.end(), next_sibling_of);
 			if (found_cached_sibling != next_sibling_of.end())
 			{
 				auto found_live = live_dies.find(found_cached_sibling->second);
@@ -530,18 +858,108 @@ namespace dwarf
 				{
 					assert(found_live->second->get_offset() == found_cached_sibling->second);
 					return iterator_base(static_cast<abstract_die&&>(*found_live->second), it.depth(), *this);
-				} // else fall through
+				}
+				if (frozen) return pos(found_cached_sibling->second, it.depth());
+				// else fall through
 			}
 			
-			auto found_cached_parent = parent_of.find(offset_here);
-			// if we issued `it', we should have recorded its parent
-			// FIXME: relax this policy perhaps, to allow soft cache?
-			assert(found_cached_parent != parent_of.end());
-			Dwarf_Off common_parent_offset = found_cached_parent->second;
+			// check the dense table, if we have one
+			opt<Dwarf_Off> opt_parent_offset;
+			const dense_nav_cu_table *p_cu;
+			const dense_nav_record *p_rec = dense_nav_lookup(offset_here, &p_cu);
+			if (p_rec)
+			{
+				if (p_rec->parent == dense_nav_record::NONE) // i.e. we're a CU
+				{
+					if (p_cu + 1 != dense_nav.data() + dense_nav.size())
+					{
+						return pos((p_cu + 1)->cu_offset, 1);
+					}
+				}
+				else if (p_cu->at(p_rec->next_sibling))
+				{
+					const dense_nav_record& sib = *p_cu->at(p_rec->next_sibling);
+					auto found_live = live_dies.find(sib.offset);
+					if (found_live != live_dies.end())
+					{
+						return iterator_base(static_cast<abstract_die&&>(*found_live->second),
+							opt<unsigned short>(sib.depth), *this);
+					}
+					return pos(sib.offset, sib.depth);
+				}
+				/* Fall through, e.g. to find in-memory siblings. The slow path
+				 * wants to know our parent, so tell it. */
+				if (p_rec->parent == dense_nav_record::NONE) opt_parent_offset = 0UL;
+				else if (p_cu->at(p_rec->parent)) opt_parent_offset = p_cu->at(p_rec->parent)->offset;
+			}
+			if (!opt_parent_offset)
+			{
+				auto found_cached_parent = parent_of.find(offset_here);
+				DWARFPP_STAT_HIT(*this, found_cached_parent != parent_of.end(), parent_of);
+				// if we issued `it', we recorded its parent, but the cache
+				// budget may have evicted it since; as in parent(), search
+				if (found_cached_parent == parent_of.end())
+				{
+					assert(!frozen);
+					auto recovered = recover_parent(offset_here);
+					if (recovered) found_cached_parent = parent_of.insert(make_pair(offset_here, *recovered)).first;
+					else
+					{
+						debug_sampled(2, 1000, << "Warning: searching for parent of " << it << " all the way from root." << endl);
+						find_downwards(offset_here);
+						found_cached_parent = parent_of.find(offset_here);
+					}
+				}
+				assert(found_cached_parent != parent_of.end());
+				opt_parent_offset = found_cached_parent->second;
+			}
+			Dwarf_Off common_parent_offset = *opt_parent_offset;
 			Die::handle_type maybe_handle(nullptr, Die::deleter(nullptr)); // TODO: reenable deleter default constructor
 			
-			if (it.tag_here() == DW_TAG_compile_unit)
+			// as in first_child(), another reader needs no CU context or handles
+			unsigned unit_idx;
+			if (p_reader && p_reader->unit_index_for(offset_here, &unit_idx))
 			{
+				Dwarf_Off next_off;
+				if (tag_is_cu(it.tag_here()))
+				{
+					next_off = (unit_idx + 1 < p_reader->unit_count())
+						? p_reader->unit_die_offset(unit_idx + 1) : die_reader::NONE;
+				}
+				else
+				{
+					auto found_end = subtree_end_of.find(offset_here);
+					DWARFPP_STAT_HIT(*this, found_end != subtree_end_of.end(), subtree_end_of);
+					if (found_end != subtree_end_of.end())
+					{
+						next_off = p_reader->tag_at(unit_idx, found_end->second)
+							? found_end->second : die_reader::NONE;
+					}
+					else
+					{
+						Dwarf_Off parent_end;
+						next_off = p_reader->next_sibling_or_end(unit_idx, offset_here, &parent_end);
+						if (parent_end != die_reader::NONE && !frozen)
+						{
+							subtree_end_of[common_parent_offset] = parent_end;
+							note_cache_growth(common_parent_offset);
+						}
+					}
+				}
+				if (next_off == die_reader::NONE) return iterator_base::END;
+				if (!frozen) next_sibling_of[offset_here] = next_off;
+				if (tag_is_cu(it.tag_here()))
+				{
+					note_cu_entered(next_off);
+					return pos(next_off, 1, opt<Dwarf_Off>(0UL));
+				}
+				return reader_pos(unit_idx, next_off, it.get_depth(), common_parent_offset);
+			}
+			
+			if (tag_is_cu(it.tag_here()))
+			{
+				// as in first_child(), freeze() cached all the CU edges
+				if (frozen) return iterator_base::END;
 				// do the CU thing
 				bool ret = set_cu_context(it.offset_here());
 				if (!ret) return iterator_base::END; // i.e. we're not a libdwarf-backed CU
@@ -549,6 +967,7 @@ namespace dwarf
 				if (!ret) return iterator_base::END;
 				maybe_handle = Die::try_construct(*this);
 				if (maybe_handle) next_sibling_of[it.offset_here()] = current_cu_offset;
+				note_cu_entered(current_cu_offset);
 			}
 			else
 			{
@@ -560,12 +979,15 @@ namespace dwarf
 			if (maybe_handle)
 			{
 				auto new_it = iterator_base(Die(std::move(maybe_handle)), it.get_depth(), *this);
-				// install in parent cache
-				parent_of[new_it.offset_here()] = common_parent_offset;
-				// ditto for sibling cache -- but check we agree with what's already there
+				// check we agree with what's already there
 				assert(found_cached_sibling == next_sibling_of.end()
 					|| found_cached_sibling->second == new_it.offset_here());
+				if (frozen) return new_it;
+				// install in parent cache
+				parent_of[new_it.offset_here()] = common_parent_offset;
+				// ditto for sibling cache
 				next_sibling_of[offset_here] = new_it.offset_here();
+				note_cache_growth(new_it.offset_here());
 				return new_it;
 			} else return iterator_base::END;
 		}
@@ -593,6 +1015,7 @@ namespace dwarf
 			 * and upgrade the iterator so that it is copyable. There are some exceptions:
 			 * root and END iterators have no handle, so they can be copied directly. */
 
+			it.ensure_handle();
 			if (it.state == iterator_base::WITH_PAYLOAD) return it.cur_payload;
 			else // we're a handle
 			{
@@ -607,18 +1030,21 @@ namespace dwarf
 				auto found_live = live_dies.find(it.offset_here());
 				if (found_live != live_dies.end())
 				{
+					note_payload_use(found_live->second);
 					return found_live->second;
 				}
 				
 				/* heap-allocate the right kind of basic_die, 
 				 * creating the intrusive ptr, hence bumping the refcount */
+				DWARFPP_STAT_INC(*this, payloads_made);
 				it.cur_payload = core::factory::for_spec(it.spec_here())
 					.make_payload(std::move(it.get_handle()), *this);
 				it.state = iterator_base::WITH_PAYLOAD;
+				note_payload_use(it.cur_payload.get());
 				
-				if (it.tag_here() != DW_TAG_compile_unit)
+				if (!tag_is_cu(it.tag_here()))
 				{
-					debug(6) << "Warning: made payload for non-CU at 0x" << std::hex << it.offset_here() << std::dec << endl;
+					debug_expensive(6, << "Warning: made payload for non-CU at 0x" << std::hex << it.offset_here() << std::dec << endl);
 				}
 				return it.cur_payload;
 			}
@@ -651,12 +1077,14 @@ namespace dwarf
 		{
 			/* heap-allocate the right kind of (in-memory) DIE, 
 			 * creating the intrusive ptr, hence bumping the refcount */
+			assert(!frozen); // we'd have to write every cache we have
 			auto& spec = parent.is_root_position() ? DEFAULT_DWARF_SPEC : parent.enclosing_cu().spec_here();
 			root_die::ptr_type p = core::factory::for_spec(spec).make_new(parent, tag);
 			Dwarf_Off o = dynamic_cast<in_memory_abstract_die&>(*p).get_offset();
 			sticky_dies.insert(make_pair(o, p));
 			assert(live_dies.find(o) != live_dies.end());
 			parent_of.insert(make_pair(o, parent.offset_here()));
+			invalidate_types_reaching(o); // a new member, say, changes its structure
 			auto found = find(o);
 			assert(found);
 			return found;
@@ -681,7 +1109,7 @@ namespace dwarf
 			 * caller will still need the handle. 
 			 * HMM -- now tried changing it so the caller passes us the Die. */
 			
-			return d.get_tag() == DW_TAG_compile_unit;
+			return tag_is_cu(d.get_tag());
 		}
 		
 		void
@@ -819,6 +1247,15 @@ namespace dwarf
 			}
 			
 			parent_of[offset_to_issue] = pos.offset_here();
+			forget_named_children(pos.offset_here());
+			/* It may be a new local or inlined subroutine of some subprogram
+			 * we've indexed. (A new member of a type we've laid out is
+			 * make_new()'s invalidate_types_reaching() to deal with.) */
+			forget_frame_locals();
+			forget_inline_trees();
+			/* Likewise it may be a new block or static variable. */
+			clear_addr_index();
+			clear_static_var_index();
 			
 			return offset_to_issue;
 		}
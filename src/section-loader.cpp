@@ -0,0 +1,304 @@
+/* dwarfpp: C++ binding for a useful subset of libdwarf, plus extra goodies.
+ *
+ * section-loader.cpp: feeding libdwarf sections from an ELF image, lazily
+ *
+ * Copyright (c) 2008--17, Stephen Kell. For licensing information, see the
+ * LICENSE file in the root of the libdwarfpp tree.
+ */
+
+#include <sstream>
+#include <iomanip>
+#include <cstdio>
+#include <elf.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+#include <srk31/endian.hpp>
+
+#include "dwarfpp/section-loader.hpp"
+
+namespace dwarf
+{
+	using std::endl;
+	using std::vector;
+	using std::string;
+	namespace core
+	{
+		namespace
+		{
+			/* The image may not be aligned for its structs, so copy them out. */
+			template <typename T>
+			bool read_at(const elf_image& image, size_t off, T *out)
+			{
+				if (off > image.size || image.size - off < sizeof (T)) return false;
+				memcpy(out, image.data + off, sizeof (T));
+				return true;
+			}
+
+			template <typename Ehdr, typename Shdr, typename Chdr>
+			bool read_sections(const elf_image& image, vector<section_loader::section>& out,
+				opt<string>& build_id)
+			{
+				Ehdr ehdr;
+				if (!read_at(image, 0, &ehdr) || ehdr.e_shoff == 0
+					|| ehdr.e_shentsize != sizeof (Shdr)) return false;
+				Shdr shdr0;
+				if (!read_at(image, ehdr.e_shoff, &shdr0)) return false;
+				/* Many sections, or a high string table index, spill into section 0. */
+				size_t shnum = (ehdr.e_shnum == 0) ? shdr0.sh_size : ehdr.e_shnum;
+				size_t shstrndx = (ehdr.e_shstrndx == SHN_XINDEX) ? shdr0.sh_link : ehdr.e_shstrndx;
+				if (shnum > 0xffff || shstrndx >= shnum) return false; // libdwarf indexes by Dwarf_Half
+				vector<Shdr> shdrs(shnum);
+				for (size_t i = 0; i < shnum; ++i)
+				{
+					if (!read_at(image, ehdr.e_shoff + i * sizeof (Shdr), &shdrs[i])) return false;
+				}
+				const Shdr& strtab = shdrs[shstrndx];
+				if (strtab.sh_offset > image.size || image.size - strtab.sh_offset < strtab.sh_size) return false;
+				const char *strs = image.data + strtab.sh_offset;
+
+				out.clear();
+				for (size_t i = 0; i < shnum; ++i)
+				{
+					const Shdr& sh = shdrs[i];
+					section_loader::section s;
+					s.name = (sh.sh_name < strtab.sh_size)
+						? string(strs + sh.sh_name, strnlen(strs + sh.sh_name, strtab.sh_size - sh.sh_name))
+						: string();
+					s.addr = sh.sh_addr;
+					s.size = sh.sh_size;
+					s.link = sh.sh_link;
+					s.entrysize = sh.sh_entsize;
+					s.file_bytes = nullptr;
+					s.file_size = 0;
+					s.compression = section_loader::NONE;
+					s.loaded = nullptr;
+					s.cache_mapping = nullptr;
+					if (sh.sh_type != SHT_NOBITS && sh.sh_type != SHT_NULL)
+					{
+						if (sh.sh_offset > image.size || image.size - sh.sh_offset < sh.sh_size) return false;
+						s.file_bytes = reinterpret_cast<const unsigned char *>(image.data + sh.sh_offset);
+						s.file_size = sh.sh_size;
+					}
+					if (s.file_bytes && (sh.sh_flags & SHF_COMPRESSED))
+					{
+						Chdr chdr;
+						if (s.file_size < sizeof chdr) return false;
+						memcpy(&chdr, s.file_bytes, sizeof chdr);
+						if (chdr.ch_type == ELFCOMPRESS_ZLIB)
+						{
+							s.compression = section_loader::ELF_CHDR;
+							s.size = chdr.ch_size;
+						} // else leave it alone; libdwarf will find it unreadable
+					}
+					else if (s.file_bytes && s.name.compare(0, 8, ".zdebug_") == 0
+						&& s.file_size >= 12 && 0 == memcmp(s.file_bytes, "ZLIB", 4))
+					{
+						/* Big-endian size, then the zlib stream. */
+						Dwarf_Unsigned size = 0;
+						for (unsigned j = 4; j < 12; ++j) size = (size << 8) | s.file_bytes[j];
+						s.compression = section_loader::ZDEBUG;
+						s.size = size;
+						s.name = "." + s.name.substr(2);
+					}
+					if (sh.sh_type == SHT_NOTE && s.name == ".note.gnu.build-id" && s.file_size >= 12)
+					{
+						/* Elf32_Nhdr and Elf64_Nhdr are the same. */
+						Elf32_Nhdr nhdr;
+						memcpy(&nhdr, s.file_bytes, sizeof nhdr);
+						size_t desc_off = sizeof nhdr + ((nhdr.n_namesz + 3) & ~3u);
+						if (nhdr.n_type == NT_GNU_BUILD_ID && desc_off <= s.file_size
+							&& s.file_size - desc_off >= nhdr.n_descsz)
+						{
+							std::ostringstream str;
+							for (unsigned j = 0; j < nhdr.n_descsz; ++j)
+							{
+								str << std::hex << std::setw(2) << std::setfill('0')
+									<< (unsigned) s.file_bytes[desc_off + j];
+							}
+							build_id = str.str();
+						}
+					}
+					out.push_back(std::move(s));
+				}
+				return true;
+			}
+		}
+
+		bool section_loader::can_load(const elf_image& image)
+		{
+			if (image.size < EI_NIDENT || 0 != memcmp(image.data, ELFMAG, SELFMAG)) return false;
+			unsigned char data = image.data[EI_DATA];
+			if (data != (srk31::host_is_little_endian() ? ELFDATA2LSB : ELFDATA2MSB)) return false;
+			Elf32_Half type; // e_type is at the same offset in both classes
+			if (!read_at(image, EI_NIDENT, &type)) return false;
+			return type == ET_EXEC || type == ET_DYN;
+		}
+
+		section_loader::section_loader(std::shared_ptr<const elf_image> image, const string& cache_dir)
+		 : image(image), cache_dir(cache_dir), is_64bit(false), n_inflated(0), n_cache_hits(0)
+		{
+			assert(image && can_load(*image));
+			is_64bit = (image->data[EI_CLASS] == ELFCLASS64);
+			bool ok = is_64bit ? read_sections<Elf64_Ehdr, Elf64_Shdr, Elf64_Chdr>(*image, sections, build_id)
+				: read_sections<Elf32_Ehdr, Elf32_Shdr, Elf32_Chdr>(*image, sections, build_id);
+			if (!ok)
+			{
+				debug(1) << "Could not read section headers of ELF image" << endl;
+				sections.clear();
+			}
+			methods = (lib::Dwarf_Obj_Access_Methods) {
+				.get_section_info = get_section_info,
+				.get_byte_order = get_byte_order,
+				.get_length_size = get_length_size,
+				.get_pointer_size = get_pointer_size,
+				.get_section_count = get_section_count,
+				.load_section = load_section,
+				.relocate_a_section = nullptr
+			};
+			iface = (lib::Dwarf_Obj_Access_Interface) { .object = this, .methods = &methods };
+		}
+
+		section_loader::~section_loader()
+		{
+			for (auto i_s = sections.begin(); i_s != sections.end(); ++i_s)
+			{
+				if (i_s->cache_mapping) munmap(i_s->cache_mapping, i_s->size);
+			}
+		}
+
+		int section_loader::get_section_info(void *obj, Dwarf_Half idx,
+			lib::Dwarf_Obj_Access_Section *ret, int *error)
+		{
+			section_loader *l = static_cast<section_loader *>(obj);
+			if (idx >= l->sections.size()) { *error = DW_DLE_MDE; return DW_DLV_ERROR; }
+			const section& s = l->sections[idx];
+			/* Fill in field-wise; libdwarf versions differ in what else there is. */
+			memset(ret, 0, sizeof *ret);
+			ret->addr = s.addr;
+			ret->size = s.size;
+			ret->name = s.name.c_str();
+			ret->link = s.link;
+			ret->entrysize = s.entrysize;
+			return DW_DLV_OK;
+		}
+
+		lib::Dwarf_Endianness section_loader::get_byte_order(void *obj)
+		{ return srk31::host_is_little_endian() ? lib::DW_OBJECT_LSB : lib::DW_OBJECT_MSB; }
+
+		/* As libdwarf's own ELF reader does. */
+		Dwarf_Small section_loader::get_length_size(void *obj)
+		{ return static_cast<section_loader *>(obj)->is_64bit ? 8 : 4; }
+		Dwarf_Small section_loader::get_pointer_size(void *obj)
+		{ return static_cast<section_loader *>(obj)->is_64bit ? 8 : 4; }
+
+		Dwarf_Unsigned section_loader::get_section_count(void *obj)
+		{ return static_cast<section_loader *>(obj)->sections.size(); }
+
+		int section_loader::load_section(void *obj, Dwarf_Half idx, Dwarf_Small **ret, int *error)
+		{
+			section_loader *l = static_cast<section_loader *>(obj);
+			if (idx >= l->sections.size()) { *error = DW_DLE_MDE; return DW_DLV_ERROR; }
+			std::lock_guard<std::mutex> g(l->load_mutex);
+			section& s = l->sections[idx];
+			if (!s.file_bytes) return DW_DLV_NO_ENTRY;
+			if (!l->load(s)) { *error = DW_DLE_MDE; return DW_DLV_ERROR; }
+			/* libdwarf doesn't write to sections it doesn't relocate. */
+			*ret = const_cast<Dwarf_Small *>(s.loaded);
+			return DW_DLV_OK;
+		}
+
+		const unsigned char *section_loader::load(section& s)
+		{
+			if (s.loaded || !s.file_bytes) return s.loaded;
+			if (s.compression == NONE) s.loaded = s.file_bytes;
+			else if (!load_cached(s) && inflate(s)) save_cached(s);
+			return s.loaded;
+		}
+
+		bool section_loader::get_section(const string& name, const unsigned char **p_data,
+			Dwarf_Unsigned *p_size)
+		{
+			std::lock_guard<std::mutex> g(load_mutex);
+			for (auto i_s = sections.begin(); i_s != sections.end(); ++i_s)
+			{
+				if (i_s->name != name) continue;
+				if (!load(*i_s)) return false;
+				*p_data = i_s->loaded;
+				*p_size = i_s->size;
+				return true;
+			}
+			return false;
+		}
+
+		bool section_loader::inflate(section& s)
+		{
+			size_t hdr_size = (s.compression == ZDEBUG) ? 12
+				: is_64bit ? sizeof (Elf64_Chdr) : sizeof (Elf32_Chdr);
+			s.inflated.resize(s.size);
+			uLongf out_len = s.size;
+			int ret = uncompress(s.inflated.data(), &out_len,
+				s.file_bytes + hdr_size, s.file_size - hdr_size);
+			if (ret != Z_OK || out_len != s.size)
+			{
+				debug(1) << "Could not inflate section " << s.name << endl;
+				s.inflated = vector<unsigned char>();
+				return false;
+			}
+			s.loaded = s.inflated.data();
+			++n_inflated;
+			debug(2) << "Inflated section " << s.name << " to " << s.size << " bytes" << endl;
+			return true;
+		}
+
+		bool section_loader::load_cached(section& s)
+		{
+			if (cache_dir.empty() || !build_id || s.size == 0) return false;
+			string filename = cache_dir + "/" + *build_id + s.name;
+			int fd = open(filename.c_str(), O_RDONLY);
+			if (fd == -1) return false;
+			struct stat st;
+			void *mapping = MAP_FAILED;
+			if (0 == fstat(fd, &st) && (Dwarf_Unsigned) st.st_size == s.size)
+			{
+				mapping = mmap(nullptr, s.size, PROT_READ, MAP_PRIVATE, fd, 0);
+			}
+			close(fd);
+			if (mapping == MAP_FAILED) return false;
+			s.cache_mapping = mapping;
+			s.loaded = static_cast<const unsigned char *>(mapping);
+			++n_cache_hits;
+			return true;
+		}
+
+		void section_loader::save_cached(const section& s)
+		{
+			if (cache_dir.empty() || !build_id || s.size == 0) return;
+			/* Write then rename, so that nobody maps a partial file. */
+			string filename = cache_dir + "/" + *build_id + s.name;
+			std::ostringstream tmp;
+			tmp << filename << ".tmp." << getpid();
+			FILE *f = fopen(tmp.str().c_str(), "wb");
+			if (!f) return;
+			bool ok = (fwrite(s.loaded, 1, s.size, f) == s.size);
+			ok = (0 == fclose(f)) && ok;
+			if (!ok || 0 != rename(tmp.str().c_str(), filename.c_str()))
+			{
+				debug(1) << "Could not cache section " << s.name << " in " << cache_dir << endl;
+				unlink(tmp.str().c_str());
+			}
+		}
+
+		bool section_loader::is_loaded(const string& name)
+		{
+			std::lock_guard<std::mutex> g(load_mutex);
+			for (auto i_s = sections.begin(); i_s != sections.end(); ++i_s)
+			{
+				if (i_s->name == name) return i_s->loaded != nullptr;
+			}
+			return false;
+		}
+	}
+}
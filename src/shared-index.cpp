@@ -0,0 +1,411 @@
+/* dwarfpp: C++ binding for a useful subset of libdwarf, plus extra goodies.
+ *
+ * shared-index.cpp: read-only indexes that many processes can map at once
+ *
+ * Copyright (c) 2008--17, Stephen Kell. For licensing information, see the
+ * LICENSE file in the root of the libdwarfpp tree.
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <strings.h>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "dwarfpp/root.hpp"
+#include "dwarfpp/root-inl.hpp"
+#include "dwarfpp/iter.hpp"
+#include "dwarfpp/iter-inl.hpp"
+
+namespace dwarf
+{
+	using std::endl;
+	using std::vector;
+	namespace core
+	{
+		/* As with the nav index: a fixed header, the build-id bytes (padded
+		 * to 8), then flat arrays in host byte order. Here the arrays are
+		 * the very records we look things up in, so once mapped, nothing
+		 * is copied: navigation records are dense_nav_records, with each
+		 * CU's links indexing its own run of them; address intervals are
+		 * addr_index_entrys; names are spans of a string pool. */
+		namespace
+		{
+			const char shared_index_magic[8] = { 'D', 'W', 'P', 'P', 'S', 'H', 'R', '1' };
+
+			struct shared_index_header
+			{
+				char magic[8];
+				uint32_t nav_record_size;
+				uint32_t addr_record_size;
+				uint32_t name_record_size;
+				uint32_t canonical_record_size;
+				uint64_t build_id_len; // in bytes of the hex string
+				uint64_t n_cus;
+				uint64_t n_nav_records;
+				uint64_t n_addr_records;
+				uint64_t n_name_records;
+				uint64_t n_canonical_ids;
+				uint64_t n_canonical_reps; // 0 if there's no canonical type table
+				uint64_t strings_len;
+			};
+			struct shared_index_cu_record
+			{
+				uint64_t cu_offset;
+				uint64_t first; // in the nav records
+				uint64_t n;
+			};
+			inline uint64_t padded_len(uint64_t len) { return (len + 7) & ~(uint64_t) 7; }
+			/* Add n records of size bytes to len; true if that overflows. */
+			inline bool add_array_len(uint64_t& len, uint64_t n, uint64_t size)
+			{
+				uint64_t bytes;
+				return __builtin_mul_overflow(n, size, &bytes)
+					|| __builtin_add_overflow(len, bytes, &len);
+			}
+		}
+
+		opt<string> root_die::shared_index_filename(const string& dir)
+		{
+			auto build_id = get_build_id();
+			if (!build_id) return opt<string>();
+			return dir + "/" + *build_id + ".dwarfpp-shared";
+		}
+
+		void root_die::shared_grandchildren_named(string_view name, std::vector<Dwarf_Off>& out) const
+		{
+			auto name_of = [this](const shared_name_record& r) {
+				return string_view(shared_names_pool.data() + r.name_pos, r.name_len);
+			};
+			auto found = std::lower_bound(shared_names.begin(), shared_names.end(), name,
+				[&name_of](const shared_name_record& r, string_view n) { return name_of(r) < n; });
+			for (; found != shared_names.end() && name_of(*found) == name; ++found)
+			{
+				out.push_back(found->off);
+			}
+		}
+
+		bool root_die::publish_shared_index(const string& dir)
+		{
+			if (frozen) return false;
+			auto build_id = get_build_id();
+			if (!build_id)
+			{
+				debug(1) << "Not publishing shared index: no build-id" << endl;
+				return false;
+			}
+			if (!have_dense_nav() && !build_dense_nav()) return false;
+			if (!have_addr_index()) build_addr_index();
+			while (fill_visible_named_grandchildren_step());
+
+			/* In-memory DIEs are ours alone. */
+			auto is_in_memory = [this](Dwarf_Off off) {
+				auto found = live_dies.find(off);
+				return found != live_dies.end()
+					&& dynamic_cast<in_memory_abstract_die *>(found->second);
+			};
+			vector<shared_index_cu_record> cu_records;
+			vector<dense_nav_record> nav_records;
+			for (auto i_cu = dense_nav.begin(); i_cu != dense_nav.end(); ++i_cu)
+			{
+				cu_records.push_back((shared_index_cu_record) {
+					.cu_offset = i_cu->cu_offset,
+					.first = nav_records.size(),
+					.n = i_cu->records.size()
+				});
+				nav_records.insert(nav_records.end(), i_cu->records.begin(), i_cu->records.end());
+			}
+			vector<addr_index_entry> addr_records;
+			addr_records.reserve(addr_index.size());
+			for (auto i = addr_index.begin(); i != addr_index.end(); ++i)
+			{
+				addr_index_entry e;
+				bzero(&e, sizeof e); // no junk in the padding
+				e.lo = i->lo;
+				e.hi = i->hi;
+				e.off = i->off;
+				e.depth = i->depth;
+				addr_records.push_back(e);
+			}
+			/* The names might be ours, or from a shared index we're attached to. */
+			vector<pair<string_view, Dwarf_Off> > names_found;
+			for (auto i = visible_named_grandchildren_cache.begin();
+				i != visible_named_grandchildren_cache.end(); ++i)
+			{
+				for (auto i_off = i->second.begin(); i_off != i->second.end(); ++i_off)
+				{
+					if (!is_in_memory(*i_off)) names_found.push_back(make_pair(names.name(i->first), *i_off));
+				}
+			}
+			for (auto i = shared_names.begin(); i != shared_names.end(); ++i)
+			{
+				names_found.push_back(make_pair(
+					string_view(shared_names_pool.data() + i->name_pos, i->name_len), i->off));
+			}
+			std::sort(names_found.begin(), names_found.end());
+			names_found.erase(std::unique(names_found.begin(), names_found.end()), names_found.end());
+			vector<shared_name_record> name_records;
+			string strings;
+			for (auto i = names_found.begin(); i != names_found.end(); ++i)
+			{
+				/* Sorted, so a repeated name follows its first. */
+				if (i == names_found.begin() || (i - 1)->first != i->first) strings.append(i->first.data(), i->first.size());
+				name_records.push_back((shared_name_record) {
+					.name_pos = (uint64_t) (strings.size() - i->first.size()),
+					.name_len = i->first.size(),
+					.off = i->second
+				});
+			}
+			/* The canonical table goes in whole or not at all. */
+			vector<shared_canonical_id> canonical_records;
+			bool have_canonical = have_canonical_type_table();
+			for (auto i = canonical_type_reps.begin(); have_canonical && i != canonical_type_reps.end(); ++i)
+			{
+				if (is_in_memory(*i)) have_canonical = false;
+			}
+			if (have_canonical && !shared_canonical_ids.empty())
+			{
+				canonical_records.assign(shared_canonical_ids.begin(), shared_canonical_ids.end());
+			}
+			else if (have_canonical)
+			{
+				for (auto i = canonical_type_ids.begin(); i != canonical_type_ids.end(); ++i)
+				{
+					if (is_in_memory(i->first)) continue;
+					canonical_records.push_back((shared_canonical_id) {
+						.off = i->first, .id = i->second, .unused = 0 });
+				}
+				std::sort(canonical_records.begin(), canonical_records.end(),
+					[](const shared_canonical_id& a, const shared_canonical_id& b) { return a.off < b.off; });
+			}
+
+			shared_index_header hdr;
+			bzero(&hdr, sizeof hdr);
+			memcpy(hdr.magic, shared_index_magic, sizeof hdr.magic);
+			hdr.nav_record_size = sizeof (dense_nav_record);
+			hdr.addr_record_size = sizeof (addr_index_entry);
+			hdr.name_record_size = sizeof (shared_name_record);
+			hdr.canonical_record_size = sizeof (shared_canonical_id);
+			hdr.build_id_len = build_id->size();
+			hdr.n_cus = cu_records.size();
+			hdr.n_nav_records = nav_records.size();
+			hdr.n_addr_records = addr_records.size();
+			hdr.n_name_records = name_records.size();
+			hdr.n_canonical_ids = canonical_records.size();
+			hdr.n_canonical_reps = have_canonical ? canonical_type_reps.size() : 0;
+			hdr.strings_len = strings.size();
+
+			/* Write to a temporary and rename, so that nobody ever maps a
+			 * half-written index. The temporary is ours alone, since two
+			 * processes may well be saving the same index at once. */
+			string filename = *shared_index_filename(dir);
+			std::ostringstream tmp;
+			tmp << filename << ".tmp." << getpid();
+			string tmp_filename = tmp.str();
+			{
+				std::ofstream out(tmp_filename, std::ios::binary | std::ios::trunc);
+				if (!out)
+				{
+					debug(1) << "Could not open " << tmp_filename << " for writing shared index" << endl;
+					return false;
+				}
+				auto write_array = [&out](const void *data, size_t len) {
+					out.write(reinterpret_cast<const char *>(data), len);
+				};
+				string padded_build_id = *build_id;
+				padded_build_id.resize(padded_len(build_id->size()), '\0');
+				write_array(&hdr, sizeof hdr);
+				write_array(padded_build_id.data(), padded_build_id.size());
+				write_array(cu_records.data(), cu_records.size() * sizeof (shared_index_cu_record));
+				write_array(nav_records.data(), nav_records.size() * sizeof (dense_nav_record));
+				write_array(addr_records.data(), addr_records.size() * sizeof (addr_index_entry));
+				write_array(name_records.data(), name_records.size() * sizeof (shared_name_record));
+				write_array(canonical_records.data(), canonical_records.size() * sizeof (shared_canonical_id));
+				if (have_canonical) write_array(canonical_type_reps.data(),
+					canonical_type_reps.size() * sizeof (Dwarf_Off));
+				write_array(strings.data(), strings.size());
+				if (!out) { unlink(tmp_filename.c_str()); return false; }
+			}
+			/* Whatever our umask, only we may write it, or attaching refuses. */
+			if (0 != chmod(tmp_filename.c_str(), 0644)
+				|| 0 != rename(tmp_filename.c_str(), filename.c_str()))
+			{
+				unlink(tmp_filename.c_str());
+				return false;
+			}
+			debug(2) << "Published shared index of " << nav_records.size() << " DIEs in "
+				<< cu_records.size() << " CUs, " << addr_records.size() << " intervals, "
+				<< name_records.size() << " names and " << canonical_records.size()
+				<< " canonical type IDs to " << filename << endl;
+			return true;
+		}
+
+		bool root_die::attach_shared_index(const string& dir)
+		{
+			if (frozen) return false;
+			auto filename = shared_index_filename(dir);
+			if (!filename) return false;
+			int fd = open(filename->c_str(), O_RDONLY);
+			if (fd == -1) return false;
+			struct stat st;
+			if (0 != fstat(fd, &st) || (size_t) st.st_size < sizeof (shared_index_header))
+			{ close(fd); return false; }
+			/* We trust what's in the file, so it has to be ours, and nobody
+			 * else's to write. */
+			if (!S_ISREG(st.st_mode) || st.st_uid != geteuid()
+				|| (st.st_mode & (S_IWGRP | S_IWOTH)))
+			{
+				debug(1) << "Not attaching shared index " << *filename
+					<< ": not a file of ours that only we can write" << endl;
+				close(fd);
+				return false;
+			}
+			size_t len = st.st_size;
+			/* Shared and read-only, so every process gets the same pages. */
+			void *addr = mmap(nullptr, len, PROT_READ, MAP_SHARED, fd, 0);
+			close(fd);
+			if (addr == MAP_FAILED) return false;
+			shared_ptr<const void> mapping(addr, [len](const void *p) { munmap(const_cast<void *>(p), len); });
+
+			const char *base = reinterpret_cast<const char *>(addr);
+			const shared_index_header *hdr = reinterpret_cast<const shared_index_header *>(base);
+			const char *build_id_pos = base + sizeof (shared_index_header);
+			auto build_id = get_build_id();
+			if (0 != memcmp(hdr->magic, shared_index_magic, sizeof hdr->magic)
+				|| hdr->nav_record_size != sizeof (dense_nav_record)
+				|| hdr->addr_record_size != sizeof (addr_index_entry)
+				|| hdr->name_record_size != sizeof (shared_name_record)
+				|| hdr->canonical_record_size != sizeof (shared_canonical_id))
+			{
+				debug(1) << "Did not understand shared index " << *filename << endl;
+				return false;
+			}
+			/* The counts are the file's to say, so add up carefully. */
+			uint64_t expected_len = sizeof (shared_index_header);
+			bool overflowed = hdr->build_id_len > len
+				|| add_array_len(expected_len, padded_len(hdr->build_id_len), 1)
+				|| add_array_len(expected_len, hdr->n_cus, sizeof (shared_index_cu_record))
+				|| add_array_len(expected_len, hdr->n_nav_records, sizeof (dense_nav_record))
+				|| add_array_len(expected_len, hdr->n_addr_records, sizeof (addr_index_entry))
+				|| add_array_len(expected_len, hdr->n_name_records, sizeof (shared_name_record))
+				|| add_array_len(expected_len, hdr->n_canonical_ids, sizeof (shared_canonical_id))
+				|| add_array_len(expected_len, hdr->n_canonical_reps, sizeof (Dwarf_Off))
+				|| add_array_len(expected_len, hdr->strings_len, 1);
+			if (overflowed || expected_len != len)
+			{
+				debug(1) << "Shared index " << *filename << " is truncated" << endl;
+				return false;
+			}
+			if (!build_id || hdr->build_id_len != build_id->size()
+				|| 0 != memcmp(build_id_pos, build_id->data(), build_id->size()))
+			{
+				debug(1) << "Shared index " << *filename << " is for a different build" << endl;
+				return false;
+			}
+			const shared_index_cu_record *cu_records = reinterpret_cast<const shared_index_cu_record *>(
+				build_id_pos + padded_len(hdr->build_id_len));
+			const dense_nav_record *nav_records = reinterpret_cast<const dense_nav_record *>(
+				cu_records + hdr->n_cus);
+			const addr_index_entry *addr_records = reinterpret_cast<const addr_index_entry *>(
+				nav_records + hdr->n_nav_records);
+			const shared_name_record *name_records = reinterpret_cast<const shared_name_record *>(
+				addr_records + hdr->n_addr_records);
+			const shared_canonical_id *canonical_records = reinterpret_cast<const shared_canonical_id *>(
+				name_records + hdr->n_name_records);
+			const Dwarf_Off *canonical_reps = reinterpret_cast<const Dwarf_Off *>(
+				canonical_records + hdr->n_canonical_ids);
+			const char *strings = reinterpret_cast<const char *>(canonical_reps + hdr->n_canonical_reps);
+			/* We check the CUs' runs and the names, which is cheap, but not
+			 * every navigation record: reading every record would fault in
+			 * every page, which attaching means to avoid. Instead, their
+			 * links are checked as navigation follows them (see
+			 * dense_nav_cu_table::at()). */
+			for (uint64_t i = 0; i < hdr->n_cus; ++i)
+			{
+				const shared_index_cu_record& c = cu_records[i];
+				if (c.first > hdr->n_nav_records || c.n > hdr->n_nav_records - c.first || c.n == 0
+					|| (i > 0 && c.cu_offset <= cu_records[i - 1].cu_offset))
+				{
+					debug(1) << "Shared index " << *filename << " is corrupt" << endl;
+					return false;
+				}
+			}
+			for (uint64_t i = 0; i < hdr->n_name_records; ++i)
+			{
+				if (name_records[i].name_pos > hdr->strings_len
+					|| name_records[i].name_len > hdr->strings_len - name_records[i].name_pos)
+				{
+					debug(1) << "Shared index " << *filename << " is corrupt" << endl;
+					return false;
+				}
+			}
+
+			/* Out with the old, in with the new. */
+			detach_shared_index();
+			dense_nav.clear();
+			dense_nav_storage.clear();
+			dense_nav_storage.shrink_to_fit();
+			dense_nav.reserve(hdr->n_cus);
+			for (uint64_t i = 0; i < hdr->n_cus; ++i)
+			{
+				dense_nav.push_back((dense_nav_cu_table) {
+					.cu_offset = cu_records[i].cu_offset,
+					.records = record_span<dense_nav_record>(nav_records + cu_records[i].first, cu_records[i].n)
+				});
+			}
+			addr_index_storage.clear();
+			addr_index_storage.shrink_to_fit();
+			addr_index = record_span<addr_index_entry>(addr_records, hdr->n_addr_records);
+			addr_index_built = true;
+			shared_names = record_span<shared_name_record>(name_records, hdr->n_name_records);
+			shared_names_pool = record_span<char>(strings, hdr->strings_len);
+			if (hdr->n_canonical_reps)
+			{
+				canonical_type_ids.clear();
+				canonical_type_reps_storage.clear();
+				canonical_type_reps_storage.shrink_to_fit();
+				canonical_type_reps = record_span<Dwarf_Off>(canonical_reps, hdr->n_canonical_reps);
+				shared_canonical_ids = record_span<shared_canonical_id>(canonical_records, hdr->n_canonical_ids);
+				rep_compatible_cache.clear();
+			}
+			shared_index_mapping = mapping;
+			/* The shared names cover every CU from the file; any others
+			 * (in-memory ones) still go in our own cache. */
+			for (uint64_t i = 0; i < hdr->n_cus; ++i)
+			{
+				visible_named_grandchildren_cus_done.insert(cu_records[i].cu_offset);
+			}
+			while (fill_visible_named_grandchildren_step());
+			debug(2) << "Attached shared index " << *filename << " of " << hdr->n_nav_records
+				<< " DIEs in " << hdr->n_cus << " CUs" << endl;
+			return true;
+		}
+
+		void root_die::detach_shared_index()
+		{
+			if (!shared_index_mapping) return;
+			/* Whatever doesn't point at our own storage points into the mapping. */
+			if (dense_nav_storage.empty()) dense_nav.clear();
+			if (addr_index.data() != addr_index_storage.data()) clear_addr_index();
+			if (!shared_canonical_ids.empty() || canonical_type_reps.data() != canonical_type_reps_storage.data())
+			{
+				shared_canonical_ids = record_span<shared_canonical_id>();
+				canonical_type_reps = record_span<Dwarf_Off>(canonical_type_reps_storage);
+				rep_compatible_cache.clear();
+			}
+			/* Names we only had from the mapping have to be found again. */
+			shared_names = record_span<shared_name_record>();
+			shared_names_pool = record_span<char>();
+			visible_named_grandchildren_cus_done.clear();
+			visible_named_grandchildren_is_complete = false;
+			visible_named_grandchildren_cursor = opt<Dwarf_Off>();
+			shared_index_mapping.reset();
+		}
+	}
+}
@@ -0,0 +1,766 @@
+/* dwarfpp: C++ binding for a useful subset of libdwarf, plus extra goodies.
+ *
+ * snapshot.cpp: saving in-memory DIEs to a columnar file, and mapping them back
+ *
+ * Copyright (c) 2008--17, Stephen Kell. For licensing information, see the
+ * LICENSE file in the root of the libdwarfpp tree.
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <strings.h>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "dwarfpp/root.hpp"
+#include "dwarfpp/root-inl.hpp"
+#include "dwarfpp/iter.hpp"
+#include "dwarfpp/iter-inl.hpp"
+#include "dwarfpp/abstract.hpp"
+
+namespace dwarf
+{
+	using std::endl;
+	using std::vector;
+	namespace core
+	{
+		/* As with the nav index: a fixed header, the build-id bytes, then
+		 * flat arrays in host byte order, each padded to 8. Here the arrays
+		 * are columns, one value per DIE (or per attribute) in each, so a
+		 * DIE is the same index into all of them; DIEs are in offset
+		 * order. Edges to DIEs that aren't in the snapshot (the root, or
+		 * DIEs from the file) can't be indices, so go in a separate array
+		 * of links. Strings are offsets into a pool of NUL-terminated
+		 * strings, each stored once. A block, location list or range list
+		 * is an index into the extents: each says where its bytes, its
+		 * expressions or its ranges are, in the pools after the strings.
+		 * A list shared by several attributes is stored once. */
+		namespace
+		{
+			const char snapshot_magic[8] = { 'D', 'W', 'P', 'P', 'S', 'N', 'P', '2' };
+			const uint32_t SNAPSHOT_NONE = (uint32_t) -1;
+			/* The low byte of an attribute's kind is its attribute_value::form. */
+			const uint16_t SNAPSHOT_FORM_MASK = 0xff;
+			const uint16_t SNAPSHOT_REF_ABS = 0x100;
+
+			struct snapshot_header
+			{
+				enum { HAVE_FILE = 1 };
+				char magic[8];
+				uint32_t link_record_size;
+				uint32_t flags;
+				uint32_t extent_record_size;
+				uint32_t loc_expr_record_size;
+				uint32_t instr_record_size;
+				uint32_t range_record_size;
+				uint64_t build_id_len; // in bytes of the hex string; 0 if none
+				uint64_t n_dies;
+				uint64_t n_attrs;
+				uint64_t n_links;
+				uint64_t strings_len;
+				uint64_t synthetic_cu; // 0 if none
+				uint64_t n_extents;
+				uint64_t block_bytes_len;
+				uint64_t n_loc_exprs;
+				uint64_t n_instrs;
+				uint64_t n_ranges;
+			};
+			struct snapshot_link_record
+			{
+				enum { PARENT, FIRST_CHILD, NEXT_SIBLING };
+				uint64_t from;
+				uint64_t to;
+				uint16_t kind;
+				uint16_t unused[3];
+			};
+			struct snapshot_extent_record
+			{
+				uint64_t first; // in the pool for the attribute's form
+				uint64_t n;
+			};
+			struct snapshot_loc_expr_record
+			{
+				uint64_t lopc;
+				uint64_t hipc;
+				uint64_t first_instr;
+				uint64_t n_instrs;
+			};
+			struct snapshot_instr_record
+			{
+				uint64_t number;
+				uint64_t number2;
+				uint64_t offset;
+				uint8_t atom;
+				uint8_t unused[7];
+			};
+			struct snapshot_range_record
+			{
+				uint64_t addr1;
+				uint64_t addr2;
+				uint32_t type;
+				uint32_t unused;
+			};
+			inline uint64_t padded_len(uint64_t len) { return (len + 7) & ~(uint64_t) 7; }
+
+			struct snapshot_columns
+			{
+				const uint64_t *offs;
+				const uint64_t *cu_offs;
+				const uint32_t *parents;
+				const uint32_t *first_children;
+				const uint32_t *next_siblings;
+				const uint16_t *tags;
+				const uint32_t *attrs_begin; // n_dies + 1 of these
+				const uint16_t *attr_nums;
+				const uint16_t *attr_kinds;
+				const uint64_t *attr_values;
+				const snapshot_link_record *links;
+				const char *strings;
+				const snapshot_extent_record *extents;
+				const unsigned char *block_bytes;
+				const snapshot_loc_expr_record *loc_exprs;
+				const snapshot_instr_record *instrs;
+				const snapshot_range_record *ranges;
+			};
+			/* Where each column starts, given the file's base; returns the
+			 * length the file should have. This fixes the order of columns
+			 * that save_snapshot() writes them in. */
+			uint64_t snapshot_layout(const snapshot_header& hdr, const char *base, snapshot_columns *out)
+			{
+				uint64_t pos = sizeof (snapshot_header) + padded_len(hdr.build_id_len);
+				auto column = [base, &pos](uint64_t n, size_t size) -> const char * {
+					const char *start = base + pos;
+					pos += padded_len(n * size);
+					return start;
+				};
+				out->offs = reinterpret_cast<const uint64_t *>(column(hdr.n_dies, sizeof (uint64_t)));
+				out->cu_offs = reinterpret_cast<const uint64_t *>(column(hdr.n_dies, sizeof (uint64_t)));
+				out->parents = reinterpret_cast<const uint32_t *>(column(hdr.n_dies, sizeof (uint32_t)));
+				out->first_children = reinterpret_cast<const uint32_t *>(column(hdr.n_dies, sizeof (uint32_t)));
+				out->next_siblings = reinterpret_cast<const uint32_t *>(column(hdr.n_dies, sizeof (uint32_t)));
+				out->tags = reinterpret_cast<const uint16_t *>(column(hdr.n_dies, sizeof (uint16_t)));
+				out->attrs_begin = reinterpret_cast<const uint32_t *>(column(hdr.n_dies + 1, sizeof (uint32_t)));
+				out->attr_nums = reinterpret_cast<const uint16_t *>(column(hdr.n_attrs, sizeof (uint16_t)));
+				out->attr_kinds = reinterpret_cast<const uint16_t *>(column(hdr.n_attrs, sizeof (uint16_t)));
+				out->attr_values = reinterpret_cast<const uint64_t *>(column(hdr.n_attrs, sizeof (uint64_t)));
+				out->links = reinterpret_cast<const snapshot_link_record *>(
+					column(hdr.n_links, sizeof (snapshot_link_record)));
+				out->strings = column(hdr.strings_len, 1);
+				out->extents = reinterpret_cast<const snapshot_extent_record *>(
+					column(hdr.n_extents, sizeof (snapshot_extent_record)));
+				out->block_bytes = reinterpret_cast<const unsigned char *>(column(hdr.block_bytes_len, 1));
+				out->loc_exprs = reinterpret_cast<const snapshot_loc_expr_record *>(
+					column(hdr.n_loc_exprs, sizeof (snapshot_loc_expr_record)));
+				out->instrs = reinterpret_cast<const snapshot_instr_record *>(
+					column(hdr.n_instrs, sizeof (snapshot_instr_record)));
+				out->ranges = reinterpret_cast<const snapshot_range_record *>(
+					column(hdr.n_ranges, sizeof (snapshot_range_record)));
+				return pos;
+			}
+
+			template <typename T>
+			void write_column(std::ofstream& out, const vector<T>& v)
+			{
+				static const char zeroes[8] = { 0 };
+				uint64_t len = v.size() * sizeof (T);
+				out.write(reinterpret_cast<const char *>(v.data()), len);
+				out.write(zeroes, padded_len(len) - len);
+			}
+
+			/* Whether an attribute's value is in range, for its kind. */
+			bool is_snapshot_value(const snapshot_header& hdr, const snapshot_columns& c,
+				uint16_t kind, uint64_t value)
+			{
+				auto extent_within = [&hdr, &c, value](uint64_t pool_n) {
+					return value < hdr.n_extents && c.extents[value].first <= pool_n
+						&& c.extents[value].n <= pool_n - c.extents[value].first;
+				};
+				switch (kind & SNAPSHOT_FORM_MASK)
+				{
+					case encap::attribute_value::FLAG:
+					case encap::attribute_value::ADDR:
+					case encap::attribute_value::UNSIGNED:
+					case encap::attribute_value::SIGNED:
+					case encap::attribute_value::REF:
+						return true;
+					case encap::attribute_value::STRING:
+						return value < hdr.strings_len;
+					case encap::attribute_value::BLOCK:
+						return extent_within(hdr.block_bytes_len);
+					case encap::attribute_value::LOCLIST:
+						if (!extent_within(hdr.n_loc_exprs)) return false;
+						for (uint64_t i = c.extents[value].first;
+							i != c.extents[value].first + c.extents[value].n; ++i)
+						{
+							if (c.loc_exprs[i].first_instr > hdr.n_instrs
+								|| c.loc_exprs[i].n_instrs > hdr.n_instrs - c.loc_exprs[i].first_instr) return false;
+						}
+						return true;
+					case encap::attribute_value::RANGELIST:
+						return extent_within(hdr.n_ranges);
+					default:
+						return false;
+				}
+			}
+		}
+
+		/* A loaded snapshot: the mapping, and where its columns are. */
+		struct snapshot_view
+		{
+			shared_ptr<const void> mapping;
+			root_die *p_root;
+			snapshot_columns c;
+
+			/* The attribute's index in [begin, end), or end if there's none.
+			 * Each DIE's attributes are in number order. */
+			uint32_t find(uint32_t begin, uint32_t end, Dwarf_Half attr) const
+			{
+				const uint16_t *found = std::lower_bound(c.attr_nums + begin, c.attr_nums + end, attr);
+				return (found != c.attr_nums + end && *found == attr) ? found - c.attr_nums : end;
+			}
+			encap::attribute_value value(Dwarf_Off referencing_off, uint32_t i) const;
+		};
+
+		encap::attribute_value snapshot_view::value(Dwarf_Off referencing_off, uint32_t i) const
+		{
+			uint16_t kind = c.attr_kinds[i];
+			uint64_t value = c.attr_values[i];
+			switch (kind & SNAPSHOT_FORM_MASK)
+			{
+				case encap::attribute_value::FLAG:
+					return encap::attribute_value((Dwarf_Bool) value);
+				case encap::attribute_value::ADDR:
+					return encap::attribute_value(encap::attribute_value::address(value));
+				case encap::attribute_value::UNSIGNED:
+					return encap::attribute_value((Dwarf_Unsigned) value);
+				case encap::attribute_value::SIGNED:
+					return encap::attribute_value((Dwarf_Signed) value);
+				case encap::attribute_value::STRING:
+					return encap::attribute_value(c.strings + value);
+				case encap::attribute_value::REF:
+					return encap::attribute_value(encap::attribute_value::weak_ref(*p_root, value,
+						kind & SNAPSHOT_REF_ABS, referencing_off, c.attr_nums[i]));
+				case encap::attribute_value::BLOCK: {
+					const snapshot_extent_record& x = c.extents[value];
+					return encap::attribute_value(vector<unsigned char>(
+						c.block_bytes + x.first, c.block_bytes + x.first + x.n));
+				}
+				case encap::attribute_value::LOCLIST: {
+					const snapshot_extent_record& x = c.extents[value];
+					encap::loclist l;
+					l.reserve(x.n);
+					for (const snapshot_loc_expr_record *p = c.loc_exprs + x.first;
+						p != c.loc_exprs + x.first + x.n; ++p)
+					{
+						vector<encap::expr_instr> instrs;
+						instrs.reserve(p->n_instrs);
+						for (const snapshot_instr_record *p_i = c.instrs + p->first_instr;
+							p_i != c.instrs + p->first_instr + p->n_instrs; ++p_i)
+						{
+							encap::expr_instr instr;
+							bzero(&instr, sizeof instr);
+							instr.lr_atom = p_i->atom;
+							instr.lr_number = p_i->number;
+							instr.lr_number2 = p_i->number2;
+							instr.lr_offset = p_i->offset;
+							instrs.push_back(instr);
+						}
+						encap::loc_expr e(instrs);
+						e.lopc = p->lopc;
+						e.hipc = p->hipc;
+						l.push_back(e);
+					}
+					return encap::attribute_value(l);
+				}
+				case encap::attribute_value::RANGELIST: {
+					const snapshot_extent_record& x = c.extents[value];
+					encap::rangelist l;
+					l.reserve(x.n);
+					for (const snapshot_range_record *p = c.ranges + x.first;
+						p != c.ranges + x.first + x.n; ++p)
+					{
+						lib::Dwarf_Ranges r;
+						bzero(&r, sizeof r);
+						r.dwr_addr1 = p->addr1;
+						r.dwr_addr2 = p->addr2;
+						r.dwr_type = (decltype(r.dwr_type)) p->type;
+						l.push_back(r);
+					}
+					return encap::attribute_value(l);
+				}
+				default:
+					assert(false); abort();
+			}
+		}
+
+		bool in_memory_abstract_die::restored_has_attr(Dwarf_Half attr) const
+		{
+			return p_restored->find(restored_begin, restored_end, attr) != restored_end;
+		}
+		opt<string> in_memory_abstract_die::restored_name() const
+		{
+			uint32_t i = p_restored->find(restored_begin, restored_end, DW_AT_name);
+			if (i == restored_end) return opt<string>();
+			assert((p_restored->c.attr_kinds[i] & SNAPSHOT_FORM_MASK) == encap::attribute_value::STRING);
+			return string(p_restored->c.strings + p_restored->c.attr_values[i]);
+		}
+		encap::attribute_value in_memory_abstract_die::restored_attr(Dwarf_Half attr) const
+		{
+			uint32_t i = p_restored->find(restored_begin, restored_end, attr);
+			assert(i != restored_end);
+			return p_restored->value(m_offset, i);
+		}
+		encap::attribute_map in_memory_abstract_die::restored_attrs() const
+		{
+			encap::attribute_map m;
+			m.reserve(restored_end - restored_begin);
+			for (uint32_t i = restored_begin; i != restored_end; ++i)
+			{
+				m.insert(m.end(), make_pair(p_restored->c.attr_nums[i], p_restored->value(m_offset, i)));
+			}
+			return m;
+		}
+		void in_memory_abstract_die::unrestore()
+		{
+			/* Our caches already agree with these attributes, so we
+			 * bypass the per-insert maintenance. */
+			encap::attribute_map_base& attrs = m_attrs;
+			attrs.reserve(restored_end - restored_begin);
+			for (uint32_t i = restored_begin; i != restored_end; ++i)
+			{
+				attrs.insert(attrs.end(), make_pair(p_restored->c.attr_nums[i], p_restored->value(m_offset, i)));
+			}
+			p_restored = nullptr;
+		}
+
+		bool root_die::save_snapshot(const string& filename)
+		{
+			vector<in_memory_abstract_die *> dies;
+			unordered_map<Dwarf_Off, uint32_t> index_of;
+			for (auto i = sticky_dies.begin(); i != sticky_dies.end(); ++i)
+			{
+				auto p = dynamic_cast<in_memory_abstract_die *>(i->second.get());
+				if (!p) continue;
+				index_of.insert(make_pair(i->first, (uint32_t) dies.size()));
+				dies.push_back(p);
+			}
+
+			vector<snapshot_link_record> links;
+			auto add_link = [&links](Dwarf_Off from, Dwarf_Off to, uint16_t kind) {
+				snapshot_link_record rec;
+				bzero(&rec, sizeof rec);
+				rec.from = from;
+				rec.to = to;
+				rec.kind = kind;
+				links.push_back(rec);
+			};
+			/* An edge out of a snapshot DIE is an index if it can be. */
+			auto edge_from = [&](const unordered_map<Dwarf_Off, Dwarf_Off>& m,
+				Dwarf_Off from, uint16_t kind) -> uint32_t {
+				auto found = m.find(from);
+				if (found == m.end()) return SNAPSHOT_NONE;
+				auto found_idx = index_of.find(found->second);
+				if (found_idx != index_of.end()) return found_idx->second;
+				add_link(from, found->second, kind);
+				return SNAPSHOT_NONE;
+			};
+			vector<uint64_t> offs;
+			vector<uint64_t> cu_offs;
+			vector<uint32_t> parents;
+			vector<uint32_t> first_children;
+			vector<uint32_t> next_siblings;
+			vector<uint16_t> tags;
+			vector<uint32_t> attrs_begin;
+			vector<uint16_t> attr_nums;
+			vector<uint16_t> attr_kinds;
+			vector<uint64_t> attr_values;
+			string strings;
+			unordered_map<string, uint64_t> string_offsets;
+			vector<snapshot_extent_record> extents;
+			vector<unsigned char> block_bytes;
+			vector<snapshot_loc_expr_record> loc_exprs;
+			vector<snapshot_instr_record> instrs;
+			vector<snapshot_range_record> ranges;
+			/* Lists are shared between values, so we store each once. We
+			 * keep a value holding each, so that none is freed (and its
+			 * address reused) while we're still looking them up. */
+			unordered_map<const void *, uint64_t> list_extents;
+			vector<encap::attribute_value> lists_kept;
+			for (auto i_d = dies.begin(); i_d != dies.end(); ++i_d)
+			{
+				Dwarf_Off off = (*i_d)->get_offset();
+				offs.push_back(off);
+				cu_offs.push_back((*i_d)->get_enclosing_cu_offset());
+				tags.push_back((*i_d)->get_tag());
+				parents.push_back(edge_from(parent_of, off, snapshot_link_record::PARENT));
+				first_children.push_back(edge_from(first_child_of, off, snapshot_link_record::FIRST_CHILD));
+				next_siblings.push_back(edge_from(next_sibling_of, off, snapshot_link_record::NEXT_SIBLING));
+				attrs_begin.push_back(attr_nums.size());
+				/* A DIE we restored, and haven't edited, has its attributes
+				 * in the snapshot it came from, not its map. */
+				const encap::attribute_map attrs = (*i_d)->copy_attrs();
+				for (auto i_a = attrs.begin(); i_a != attrs.end(); ++i_a)
+				{
+					const encap::attribute_value& v = i_a->second;
+					uint16_t kind = v.get_form();
+					uint64_t value;
+					switch (v.get_form())
+					{
+						case encap::attribute_value::FLAG: value = v.get_flag(); break;
+						case encap::attribute_value::ADDR: value = v.get_address().addr; break;
+						case encap::attribute_value::UNSIGNED: value = v.get_unsigned(); break;
+						case encap::attribute_value::SIGNED: value = (uint64_t) v.get_signed(); break;
+						case encap::attribute_value::STRING: {
+							auto inserted = string_offsets.insert(make_pair(v.get_string(), strings.size()));
+							if (inserted.second) { strings += v.get_string(); strings += '\0'; }
+							value = inserted.first->second;
+						} break;
+						case encap::attribute_value::REF:
+							value = v.get_ref().off;
+							if (v.get_ref().abs) kind |= SNAPSHOT_REF_ABS;
+							break;
+						case encap::attribute_value::BLOCK: {
+							const vector<unsigned char>& b = *v.get_block();
+							value = extents.size();
+							extents.push_back((snapshot_extent_record) { .first = block_bytes.size(), .n = b.size() });
+							block_bytes.insert(block_bytes.end(), b.begin(), b.end());
+						} break;
+						case encap::attribute_value::LOCLIST: {
+							const encap::loclist& l = v.get_loclist();
+							auto inserted = list_extents.insert(make_pair((const void *) &l, extents.size()));
+							value = inserted.first->second;
+							if (!inserted.second) break;
+							lists_kept.push_back(v);
+							extents.push_back((snapshot_extent_record) { .first = loc_exprs.size(), .n = l.size() });
+							for (auto i_e = l.begin(); i_e != l.end(); ++i_e)
+							{
+								loc_exprs.push_back((snapshot_loc_expr_record) {
+									.lopc = i_e->lopc, .hipc = i_e->hipc,
+									.first_instr = instrs.size(), .n_instrs = i_e->size() });
+								for (auto i_instr = i_e->begin(); i_instr != i_e->end(); ++i_instr)
+								{
+									snapshot_instr_record rec;
+									bzero(&rec, sizeof rec);
+									rec.atom = i_instr->lr_atom;
+									rec.number = i_instr->lr_number;
+									rec.number2 = i_instr->lr_number2;
+									rec.offset = i_instr->lr_offset;
+									instrs.push_back(rec);
+								}
+							}
+						} break;
+						case encap::attribute_value::RANGELIST: {
+							const encap::rangelist& l = v.get_rangelist();
+							auto inserted = list_extents.insert(make_pair((const void *) &l, extents.size()));
+							value = inserted.first->second;
+							if (!inserted.second) break;
+							lists_kept.push_back(v);
+							extents.push_back((snapshot_extent_record) { .first = ranges.size(), .n = l.size() });
+							for (auto i_r = l.begin(); i_r != l.end(); ++i_r)
+							{
+								snapshot_range_record rec;
+								bzero(&rec, sizeof rec);
+								rec.addr1 = i_r->dwr_addr1;
+								rec.addr2 = i_r->dwr_addr2;
+								rec.type = i_r->dwr_type;
+								ranges.push_back(rec);
+							}
+						} break;
+						default:
+							/* We'd rather not save than save something lossy. */
+							debug(1) << "Cannot snapshot attribute 0x" << std::hex << i_a->first
+								<< " of DIE at 0x" << off << std::dec << ": unrecognised form" << endl;
+							return false;
+					}
+					attr_nums.push_back(i_a->first);
+					attr_kinds.push_back(kind);
+					attr_values.push_back(value);
+				}
+			}
+			attrs_begin.push_back(attr_nums.size());
+			/* Edges into the snapshot from outside it: the root's first CU,
+			 * or one after a CU from the file. */
+			auto edges_in = [&](const unordered_map<Dwarf_Off, Dwarf_Off>& m, uint16_t kind) {
+				for (auto i = m.begin(); i != m.end(); ++i)
+				{
+					if (index_of.find(i->first) == index_of.end()
+						&& index_of.find(i->second) != index_of.end()) add_link(i->first, i->second, kind);
+				}
+			};
+			edges_in(first_child_of, snapshot_link_record::FIRST_CHILD);
+			edges_in(next_sibling_of, snapshot_link_record::NEXT_SIBLING);
+			/* Hash order isn't worth preserving; this way the same tree
+			 * always makes the same file. */
+			std::sort(links.begin(), links.end(),
+				[](const snapshot_link_record& a, const snapshot_link_record& b) {
+					return a.kind < b.kind || (a.kind == b.kind && a.from < b.from);
+				});
+
+			auto build_id = get_build_id();
+			snapshot_header hdr;
+			bzero(&hdr, sizeof hdr);
+			memcpy(hdr.magic, snapshot_magic, sizeof hdr.magic);
+			hdr.link_record_size = sizeof (snapshot_link_record);
+			hdr.extent_record_size = sizeof (snapshot_extent_record);
+			hdr.loc_expr_record_size = sizeof (snapshot_loc_expr_record);
+			hdr.instr_record_size = sizeof (snapshot_instr_record);
+			hdr.range_record_size = sizeof (snapshot_range_record);
+			hdr.flags = dbg.handle ? snapshot_header::HAVE_FILE : 0;
+			hdr.build_id_len = build_id ? build_id->size() : 0;
+			hdr.n_dies = dies.size();
+			hdr.n_attrs = attr_nums.size();
+			hdr.n_links = links.size();
+			hdr.strings_len = strings.size();
+			hdr.synthetic_cu = (synthetic_cu && index_of.find(*synthetic_cu) != index_of.end())
+				? *synthetic_cu : 0;
+			hdr.n_extents = extents.size();
+			hdr.block_bytes_len = block_bytes.size();
+			hdr.n_loc_exprs = loc_exprs.size();
+			hdr.n_instrs = instrs.size();
+			hdr.n_ranges = ranges.size();
+
+			/* As in section_loader::save_cached(), the temporary is ours
+			 * alone, so concurrent savers don't write into each other's. */
+			std::ostringstream tmp;
+			tmp << filename << ".tmp." << getpid();
+			string tmp_filename = tmp.str();
+			{
+				std::ofstream out(tmp_filename, std::ios::binary | std::ios::trunc);
+				if (!out)
+				{
+					debug(1) << "Could not open " << tmp_filename << " for writing snapshot" << endl;
+					return false;
+				}
+				string padded_build_id = build_id ? *build_id : string();
+				padded_build_id.resize(padded_len(padded_build_id.size()), '\0');
+				out.write(reinterpret_cast<const char *>(&hdr), sizeof hdr);
+				out.write(padded_build_id.data(), padded_build_id.size());
+				write_column(out, offs);
+				write_column(out, cu_offs);
+				write_column(out, parents);
+				write_column(out, first_children);
+				write_column(out, next_siblings);
+				write_column(out, tags);
+				write_column(out, attrs_begin);
+				write_column(out, attr_nums);
+				write_column(out, attr_kinds);
+				write_column(out, attr_values);
+				write_column(out, links);
+				write_column(out, vector<char>(strings.begin(), strings.end()));
+				write_column(out, extents);
+				write_column(out, block_bytes);
+				write_column(out, loc_exprs);
+				write_column(out, instrs);
+				write_column(out, ranges);
+				if (!out) { unlink(tmp_filename.c_str()); return false; }
+			}
+			if (0 != rename(tmp_filename.c_str(), filename.c_str()))
+			{
+				unlink(tmp_filename.c_str());
+				return false;
+			}
+			debug(2) << "Saved snapshot of " << dies.size() << " DIEs, " << attr_nums.size()
+				<< " attributes and " << strings.size() << " bytes of strings to "
+				<< filename << endl;
+			return true;
+		}
+
+		bool root_die::load_snapshot(const string& filename)
+		{
+			if (frozen) return false;
+			int fd = open(filename.c_str(), O_RDONLY);
+			if (fd == -1) return false;
+			struct stat st;
+			if (0 != fstat(fd, &st) || (size_t) st.st_size < sizeof (snapshot_header))
+			{ close(fd); return false; }
+			size_t len = st.st_size;
+			void *addr = mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, 0);
+			close(fd);
+			if (addr == MAP_FAILED) return false;
+			shared_ptr<const void> mapping(addr, [len](const void *p) { munmap(const_cast<void *>(p), len); });
+
+			const char *base = reinterpret_cast<const char *>(addr);
+			const snapshot_header *hdr = reinterpret_cast<const snapshot_header *>(base);
+			const char *build_id_pos = base + sizeof (snapshot_header);
+			auto view = std::make_shared<snapshot_view>();
+			snapshot_columns& c = view->c;
+			vector<basic_die *> made;
+			auto build_id = get_build_id();
+			auto map_for = [this](uint16_t kind) -> unordered_map<Dwarf_Off, Dwarf_Off>& {
+				return kind == snapshot_link_record::PARENT ? parent_of
+					: kind == snapshot_link_record::FIRST_CHILD ? first_child_of
+					: next_sibling_of;
+			};
+			if (0 != memcmp(hdr->magic, snapshot_magic, sizeof hdr->magic)
+				|| hdr->link_record_size != sizeof (snapshot_link_record)
+				|| hdr->extent_record_size != sizeof (snapshot_extent_record)
+				|| hdr->loc_expr_record_size != sizeof (snapshot_loc_expr_record)
+				|| hdr->instr_record_size != sizeof (snapshot_instr_record)
+				|| hdr->range_record_size != sizeof (snapshot_range_record))
+			{
+				debug(1) << "Did not understand snapshot " << filename << endl;
+				return false;
+			}
+			/* Guard the arithmetic below against silly counts. */
+			if (hdr->build_id_len > len || hdr->n_dies >= SNAPSHOT_NONE || hdr->n_dies > len
+				|| hdr->n_attrs > len || hdr->n_links > len || hdr->strings_len > len
+				|| hdr->n_extents > len || hdr->block_bytes_len > len || hdr->n_loc_exprs > len
+				|| hdr->n_instrs > len || hdr->n_ranges > len
+				|| snapshot_layout(*hdr, base, &c) != len)
+			{
+				debug(1) << "Snapshot " << filename << " is truncated" << endl;
+				return false;
+			}
+			/* The offsets are only ours to use if we have the same file (or
+			 * no file) as whoever saved it. */
+			if (!!(hdr->flags & snapshot_header::HAVE_FILE) != !!dbg.handle
+				|| hdr->build_id_len != (build_id ? build_id->size() : 0)
+				|| (build_id && 0 != memcmp(build_id_pos, build_id->data(), build_id->size())))
+			{
+				debug(1) << "Snapshot " << filename << " is for a different file" << endl;
+				return false;
+			}
+			/* Check everything before changing anything. */
+			if (c.attrs_begin[0] != 0 || c.attrs_begin[hdr->n_dies] != hdr->n_attrs
+				|| (hdr->strings_len && c.strings[hdr->strings_len - 1] != '\0'))
+			{
+				debug(1) << "Snapshot " << filename << " is corrupt" << endl;
+				return false;
+			}
+			for (uint64_t i = 0; i < hdr->n_dies; ++i)
+			{
+				if (c.offs[i] == 0 || (i > 0 && c.offs[i] <= c.offs[i - 1])
+					|| (c.parents[i] != SNAPSHOT_NONE && c.parents[i] >= hdr->n_dies)
+					|| (c.first_children[i] != SNAPSHOT_NONE && c.first_children[i] >= hdr->n_dies)
+					|| (c.next_siblings[i] != SNAPSHOT_NONE && c.next_siblings[i] >= hdr->n_dies)
+					|| c.attrs_begin[i + 1] < c.attrs_begin[i])
+				{
+					debug(1) << "Snapshot " << filename << " is corrupt" << endl;
+					return false;
+				}
+				if (live_dies.find(c.offs[i]) != live_dies.end()
+					|| sticky_dies.find(c.offs[i]) != sticky_dies.end())
+				{
+					debug(1) << "Snapshot " << filename << " would clobber DIE at 0x"
+						<< std::hex << c.offs[i] << std::dec << endl;
+					return false;
+				}
+			}
+			/* Reads find attributes by binary search, so each DIE's must
+			 * be in order. */
+			for (uint64_t i = 0; i < hdr->n_dies; ++i)
+			{
+				for (uint32_t j = c.attrs_begin[i] + 1; j < c.attrs_begin[i + 1]; ++j)
+				{
+					if (c.attr_nums[j] <= c.attr_nums[j - 1])
+					{
+						debug(1) << "Snapshot " << filename << " is corrupt" << endl;
+						return false;
+					}
+				}
+			}
+			for (uint64_t i = 0; i < hdr->n_attrs; ++i)
+			{
+				if (!is_snapshot_value(*hdr, c, c.attr_kinds[i], c.attr_values[i]))
+				{
+					debug(1) << "Snapshot " << filename << " is corrupt" << endl;
+					return false;
+				}
+			}
+			for (const snapshot_link_record *p = c.links; p != c.links + hdr->n_links; ++p)
+			{
+				if (p->kind > snapshot_link_record::NEXT_SIBLING)
+				{
+					debug(1) << "Snapshot " << filename << " is corrupt" << endl;
+					return false;
+				}
+				auto& m = map_for(p->kind);
+				auto found = m.find(p->from);
+				if (found != m.end() && found->second != p->to)
+				{
+					debug(1) << "Snapshot " << filename << " disagrees with our tree at 0x"
+						<< std::hex << p->from << std::dec << endl;
+					return false;
+				}
+			}
+
+			/* Make the DIEs, all sticky as make_new() leaves them... */
+			made.reserve(hdr->n_dies);
+			for (uint64_t i = 0; i < hdr->n_dies; ++i)
+			{
+				basic_die *p = factory::for_spec(DEFAULT_DWARF_SPEC).make_restored(*this,
+					c.tags[i], c.offs[i], c.cu_offs[i]);
+				if (!p)
+				{
+					debug(1) << "Snapshot " << filename << " has unknown tag 0x"
+						<< std::hex << c.tags[i] << std::dec << endl;
+					for (uint64_t j = 0; j < i; ++j) sticky_dies.erase(c.offs[j]);
+					return false;
+				}
+				sticky_dies.insert(make_pair(c.offs[i], ptr_type(p)));
+				made.push_back(p);
+			}
+			/* ... then link them up. */
+			parent_of.reserve(parent_of.size() + hdr->n_dies);
+			for (uint64_t i = 0; i < hdr->n_dies; ++i)
+			{
+				if (c.parents[i] != SNAPSHOT_NONE) parent_of[c.offs[i]] = c.offs[c.parents[i]];
+				if (c.first_children[i] != SNAPSHOT_NONE) first_child_of[c.offs[i]] = c.offs[c.first_children[i]];
+				if (c.next_siblings[i] != SNAPSHOT_NONE) next_sibling_of[c.offs[i]] = c.offs[c.next_siblings[i]];
+			}
+			for (const snapshot_link_record *p = c.links; p != c.links + hdr->n_links; ++p)
+			{
+				map_for(p->kind)[p->from] = p->to;
+			}
+			/* Attributes stay in the mapping, which we keep; each DIE
+			 * reads its own from there until it's edited. We bypass the
+			 * per-insert cache maintenance and do it once, below. */
+			view->mapping = mapping;
+			view->p_root = this;
+			for (uint64_t i = 0; i < hdr->n_dies; ++i)
+			{
+				in_memory_abstract_die& d = dynamic_cast<in_memory_abstract_die&>(*made[i]);
+				d.p_restored = view.get();
+				d.restored_begin = c.attrs_begin[i];
+				d.restored_end = c.attrs_begin[i + 1];
+			}
+			snapshot_views.push_back(view);
+			if (hdr->synthetic_cu && !synthetic_cu) synthetic_cu = hdr->synthetic_cu;
+			forget_all_named_children();
+			type_names = type_name_index();
+			forget_frame_locals();
+			forget_inline_trees();
+			forget_type_layouts();
+			clear_addr_index();
+			clear_static_var_index();
+			/* Keep the grandchildren index's completeness invariant, as
+			 * inserting a name would. */
+			for (uint64_t i = 0; i < hdr->n_dies; ++i)
+			{
+				if (!dynamic_cast<in_memory_abstract_die&>(*made[i]).has_attr(DW_AT_name)) continue;
+				auto found = pos(c.offs[i]);
+				assert(found);
+				if (found.depth() == 2 && found.global_name_here())
+				{
+					note_visible_named_grandchild(*found.name_here(), c.offs[i]);
+				}
+			}
+			/* Nor does the type dependency index know the new references.
+			 * Only DIEs hung under ones we had can change our types. */
+			type_dependents.built = false;
+			for (uint64_t i = 0; i < hdr->n_dies; ++i)
+			{
+				if (c.parents[i] == SNAPSHOT_NONE) invalidate_types_reaching(c.offs[i]);
+			}
+			debug(2) << "Loaded snapshot of " << hdr->n_dies << " DIEs and "
+				<< hdr->n_attrs << " attributes from " << filename << endl;
+			return true;
+		}
+	}
+}
@@ -9,11 +9,11 @@
 #include "dwarfpp/util.hpp"
 #include "dwarfpp/spec.hpp"
 #include <vector>
+#include <cstring>
 
 using std::endl;
 using std::string;
 using std::vector;
-using std::map;
 using std::make_pair; 
 
 namespace dwarf
@@ -104,22 +104,148 @@ namespace dwarf
 		typedef std::pair<int, const int *> form_class_mapping_t;       
 		typedef std::pair<int, const int *> op_operand_forms_mapping_t;
 
+		/* Building the tables at compile time. The int-keyed ones are
+		 * indexed from their lowest key, keeping the first of any
+		 * duplicates, as std::map used to. */
+		template <typename T, size_t M>
+		constexpr unsigned table_size(const T (&)[M]) { return M; }
+		template <typename V, size_t M>
+		constexpr int min_key(const std::pair<int, V> (&tbl)[M])
+		{
+			int lo = tbl[0].first;
+			for (size_t i = 1; i < M; ++i) if (tbl[i].first < lo) lo = tbl[i].first;
+			return lo;
+		}
+		template <typename V, size_t M>
+		constexpr unsigned key_span(const std::pair<int, V> (&tbl)[M])
+		{
+			int hi = tbl[0].first;
+			for (size_t i = 1; i < M; ++i) if (tbl[i].first > hi) hi = tbl[i].first;
+			return hi - min_key(tbl) + 1;
+		}
+		template <typename V, unsigned N>
+		struct dense_values { V values[N]; };
+		template <unsigned N, typename V, size_t M>
+		constexpr dense_values<V, N> make_dense(const std::pair<int, V> (&tbl)[M])
+		{
+			dense_values<V, N> out = {};
+			int lo = min_key(tbl);
+			for (size_t i = 0; i < M; ++i)
+			{
+				if (!out.values[tbl[i].first - lo]) out.values[tbl[i].first - lo] = tbl[i].second;
+			}
+			return out;
+		}
+
+		/* The name-keyed ones hash and displace: each name's bucket is
+		 * chosen by one hash, then each bucket, biggest first, gets the
+		 * first seed that hashes all its names to free slots. */
+		constexpr unsigned name_hash(const char *s, unsigned seed)
+		{
+			unsigned h = 2166136261u ^ seed;
+			for (; *s; ++s) { h ^= (unsigned char) *s; h *= 16777619u; }
+			/* FNV's low bits are poor, and we use only those. */
+			h ^= h >> 16; h *= 0x85ebca6bu; h ^= h >> 13; h *= 0xc2b2ae35u; h ^= h >> 16;
+			return h;
+		}
+		constexpr bool names_equal(const char *a, const char *b)
+		{
+			for (; *a && *a == *b; ++a, ++b);
+			return *a == *b;
+		}
+		constexpr unsigned next_pow2(unsigned n)
+		{
+			unsigned p = 1;
+			while (p < n) p <<= 1;
+			return p;
+		}
+		constexpr unsigned name_hash_buckets(unsigned n_names) { return next_pow2(n_names / 2 + 1); }
+		constexpr unsigned name_hash_slots(unsigned n_names) { return next_pow2(2 * n_names); }
+		template <unsigned B, unsigned N>
+		struct name_hash_values
+		{
+			unsigned short displacements[B];
+			unsigned short slots[N];
+		};
+		template <unsigned B, unsigned N, size_t M>
+		constexpr name_hash_values<B, N> make_name_hash(const std::pair<const char *, int> (&tbl)[M])
+		{
+			name_hash_values<B, N> out = {};
+			unsigned bucket_of[M] = {};
+			unsigned bucket_size[B] = {};
+			unsigned max_size = 0;
+			for (size_t i = 0; i < M; ++i)
+			{
+				bucket_of[i] = B; // i.e. none, if we've seen the name before
+				bool seen = false;
+				for (size_t j = 0; j < i && !seen; ++j) seen = names_equal(tbl[i].first, tbl[j].first);
+				if (seen) continue;
+				bucket_of[i] = name_hash(tbl[i].first, 0) & (B - 1);
+				if (++bucket_size[bucket_of[i]] > max_size) max_size = bucket_size[bucket_of[i]];
+			}
+			for (unsigned size = max_size; size > 0; --size)
+			{
+				for (unsigned b = 0; b < B; ++b)
+				{
+					if (bucket_size[b] != size) continue;
+					for (unsigned short d = 1; !out.displacements[b]; ++d)
+					{
+						bool ok = true;
+						for (size_t i = 0; i < M && ok; ++i)
+						{
+							if (bucket_of[i] != b) continue;
+							unsigned s = name_hash(tbl[i].first, d) & (N - 1);
+							if (out.slots[s]) ok = false; else out.slots[s] = i + 1;
+						}
+						if (ok) { out.displacements[b] = d; break; }
+						/* Take back what we placed with this seed. */
+						for (size_t i = 0; i < M; ++i)
+						{
+							if (bucket_of[i] != b) continue;
+							unsigned s = name_hash(tbl[i].first, d) & (N - 1);
+							if (out.slots[s] == i + 1) out.slots[s] = 0;
+						}
+					}
+				}
+			}
+			return out;
+		}
+
+		const name_table::entry *name_table::find(const char *name) const
+		{
+			if (!n_entries) return nullptr;
+			unsigned short d = displacements[name_hash(name, 0) & (n_buckets - 1)];
+			unsigned short s = slots[name_hash(name, d) & (n_slots - 1)];
+			if (!s || 0 != strcmp(entries[s - 1].first, name)) return nullptr;
+			return &entries[s - 1];
+		}
+
+#define DEFINE_NAME_TABLE(classname, map, tbl) \
+	constexpr auto classname ## _ ## map ## _hash = make_name_hash< \
+		name_hash_buckets(table_size(tbl)), name_hash_slots(table_size(tbl))>(tbl); \
+	const name_table classname::map = { tbl, table_size(tbl), \
+		classname ## _ ## map ## _hash.displacements, name_hash_buckets(table_size(tbl)), \
+		classname ## _ ## map ## _hash.slots, name_hash_slots(table_size(tbl)) };
+#define DEFINE_DENSE_TABLE(classname, V, map, tbl) \
+	constexpr auto classname ## _ ## map ## _values = make_dense<key_span(tbl)>(tbl); \
+	const dense_table<V> classname::map = { min_key(tbl), key_span(tbl), \
+		classname ## _ ## map ## _values.values };
 #define DEFINE_MAPS(classname) \
-	const std::map<const char *, int, string_comparator> classname::tag_forward_map(&tag_forward_tbl[0], &tag_forward_tbl[sizeof tag_forward_tbl / sizeof (forward_name_mapping_t)]); \
-	const std::map<int, const char *> classname::tag_inverse_map(&tag_inverse_tbl[0], &tag_inverse_tbl[sizeof tag_inverse_tbl / sizeof (inverse_name_mapping_t)]); \
-	const std::map<const char *, int, string_comparator> classname::attr_forward_map(&attr_forward_tbl[0], &attr_forward_tbl[sizeof attr_forward_tbl / sizeof (forward_name_mapping_t)]); \
-	const std::map<int, const char *> classname::attr_inverse_map(&attr_inverse_tbl[0], &attr_inverse_tbl[sizeof attr_inverse_tbl / sizeof (inverse_name_mapping_t)]); \
-	const std::map<const char *, int, string_comparator> classname::form_forward_map(&form_forward_tbl[0], &form_forward_tbl[sizeof form_forward_tbl / sizeof (forward_name_mapping_t)]); \
-	const std::map<int, const char *> classname::form_inverse_map(&form_inverse_tbl[0], &form_inverse_tbl[sizeof form_inverse_tbl / sizeof (inverse_name_mapping_t)]); \
-	const std::map<const char *, int, string_comparator> classname::encoding_forward_map(&encoding_forward_tbl[0], &encoding_forward_tbl[sizeof encoding_forward_tbl / sizeof (forward_name_mapping_t)]); \
-	const std::map<int, const char *> classname::encoding_inverse_map(&encoding_inverse_tbl[0], &encoding_inverse_tbl[sizeof encoding_inverse_tbl / sizeof (inverse_name_mapping_t)]); \
-	const std::map<const char *, int, string_comparator> classname::op_forward_map(&op_forward_tbl[0], &op_forward_tbl[sizeof op_forward_tbl / sizeof (forward_name_mapping_t)]); \
-	const std::map<int, const char *> classname::op_inverse_map(&op_inverse_tbl[0], &op_inverse_tbl[sizeof op_inverse_tbl / sizeof (inverse_name_mapping_t)]); \
-	const std::map<const char *, int, string_comparator> classname::interp_forward_map(&interp_forward_tbl[0], &interp_forward_tbl[sizeof interp_forward_tbl / sizeof (forward_name_mapping_t)]); \
-	const std::map<int, const char *> classname::interp_inverse_map(&interp_inverse_tbl[0], &interp_inverse_tbl[sizeof interp_inverse_tbl / sizeof (inverse_name_mapping_t)]); \
-	const std::map<int, const int *>  classname::op_operand_forms_map(&op_operand_forms_tbl[0], &op_operand_forms_tbl[sizeof op_operand_forms_tbl / sizeof (op_operand_forms_mapping_t)]); \
-	const std::map<int, const int *>  classname::attr_class_map(&attr_class_tbl[0], &attr_class_tbl[sizeof attr_class_tbl / sizeof (attr_class_mapping_t)]); \
-	const std::map<int, const int *>  classname::form_class_map(&form_class_tbl[0], &form_class_tbl[sizeof form_class_tbl / sizeof (form_class_mapping_t)]);
+	DEFINE_NAME_TABLE(classname, tag_forward_map, tag_forward_tbl) \
+	DEFINE_DENSE_TABLE(classname, const char *, tag_inverse_map, tag_inverse_tbl) \
+	DEFINE_NAME_TABLE(classname, attr_forward_map, attr_forward_tbl) \
+	DEFINE_DENSE_TABLE(classname, const char *, attr_inverse_map, attr_inverse_tbl) \
+	DEFINE_NAME_TABLE(classname, form_forward_map, form_forward_tbl) \
+	DEFINE_DENSE_TABLE(classname, const char *, form_inverse_map, form_inverse_tbl) \
+	DEFINE_NAME_TABLE(classname, encoding_forward_map, encoding_forward_tbl) \
+	DEFINE_DENSE_TABLE(classname, const char *, encoding_inverse_map, encoding_inverse_tbl) \
+	DEFINE_NAME_TABLE(classname, op_forward_map, op_forward_tbl) \
+	DEFINE_DENSE_TABLE(classname, const char *, op_inverse_map, op_inverse_tbl) \
+	DEFINE_NAME_TABLE(classname, interp_forward_map, interp_forward_tbl) \
+	DEFINE_DENSE_TABLE(classname, const char *, interp_inverse_map, interp_inverse_tbl) \
+	DEFINE_DENSE_TABLE(classname, const int *, op_operand_forms_map, op_operand_forms_tbl) \
+	DEFINE_DENSE_TABLE(classname, const int *, attr_class_map, attr_class_tbl) \
+	DEFINE_DENSE_TABLE(classname, const int *, form_class_map, form_class_tbl)
 
 // generic list-making macros
 #define PAIR_ENTRY_FORWARDS(sym) (std::make_pair(#sym, (sym))),
@@ -138,7 +264,7 @@ namespace dwarf
 #define PAIR_ENTRY_BACKWARDS_VARARGS_LAST(sym, ...) (std::make_pair((sym), #sym))
 
 #define MAKE_LOOKUP(pair_type, name, make_pair, last_pair, list) \
-pair_type name[] = { \
+constexpr pair_type name[] = { \
 						list(make_pair, last_pair) \
 					}
 
@@ -371,7 +497,37 @@ pair_type name[] = { \
 							make_decl(DW_AT_data_bit_offset, interp::constant|interp::UNSIGNED ) \
 							make_decl(DW_AT_const_expr, interp::flag ) \
 							make_decl(DW_AT_enum_class, interp::flag ) \
-							last_decl(DW_AT_linkage_name, interp::string )
+							make_decl(DW_AT_linkage_name, interp::string ) \
+							/* DWARF5 */ \
+							make_decl(DW_AT_string_length_bit_size, interp::constant|interp::UNSIGNED ) \
+							make_decl(DW_AT_string_length_byte_size, interp::constant|interp::UNSIGNED ) \
+							make_decl(DW_AT_rank, interp::constant|interp::UNSIGNED, interp::exprloc ) \
+							make_decl(DW_AT_str_offsets_base, interp::stroffsetsptr ) \
+							make_decl(DW_AT_addr_base, interp::addrptr ) \
+							make_decl(DW_AT_rnglists_base, interp::rnglistsptr ) \
+							make_decl(DW_AT_dwo_name, interp::string ) \
+							make_decl(DW_AT_reference, interp::flag ) \
+							make_decl(DW_AT_rvalue_reference, interp::flag ) \
+							make_decl(DW_AT_macros, interp::macptr ) \
+							make_decl(DW_AT_call_all_calls, interp::flag ) \
+							make_decl(DW_AT_call_all_source_calls, interp::flag ) \
+							make_decl(DW_AT_call_all_tail_calls, interp::flag ) \
+							make_decl(DW_AT_call_return_pc, interp::address ) \
+							make_decl(DW_AT_call_value, interp::exprloc ) \
+							make_decl(DW_AT_call_origin, interp::reference, interp::exprloc ) \
+							make_decl(DW_AT_call_parameter, interp::reference ) \
+							make_decl(DW_AT_call_pc, interp::address ) \
+							make_decl(DW_AT_call_tail_call, interp::flag ) \
+							make_decl(DW_AT_call_target, interp::exprloc ) \
+							make_decl(DW_AT_call_target_clobbered, interp::exprloc ) \
+							make_decl(DW_AT_call_data_location, interp::exprloc ) \
+							make_decl(DW_AT_call_data_value, interp::exprloc ) \
+							make_decl(DW_AT_noreturn, interp::flag ) \
+							make_decl(DW_AT_alignment, interp::constant|interp::UNSIGNED ) \
+							make_decl(DW_AT_export_symbols, interp::flag ) \
+							make_decl(DW_AT_deleted, interp::flag ) \
+							make_decl(DW_AT_defaulted, interp::constant|interp::UNSIGNED ) \
+							last_decl(DW_AT_loclists_base, interp::loclistsptr )
 
 		MAKE_LOOKUP(forward_name_mapping_t, attr_forward_tbl, PAIR_ENTRY_FORWARDS_VARARGS, PAIR_ENTRY_FORWARDS_VARARGS_LAST, ATTR_DECL_LIST);
 		MAKE_LOOKUP(inverse_name_mapping_t, attr_inverse_tbl, PAIR_ENTRY_BACKWARDS_VARARGS, PAIR_ENTRY_BACKWARDS_VARARGS_LAST, ATTR_DECL_LIST);
@@ -417,10 +573,30 @@ pair_type name[] = { \
 							make_decl(DW_FORM_ref8, interp::reference)  \
 							make_decl(DW_FORM_ref_udata, interp::reference)  \
 							make_decl(DW_FORM_indirect, interp::EOL) \
-							make_decl(DW_FORM_sec_offset, interp::reference, interp::lineptr, interp::loclistptr, interp::macptr, interp::rangelistptr) \
+							make_decl(DW_FORM_sec_offset, interp::reference, interp::lineptr, interp::loclistptr, interp::macptr, interp::rangelistptr, \
+								interp::addrptr, interp::stroffsetsptr, interp::loclistsptr, interp::rnglistsptr) \
 							make_decl(DW_FORM_exprloc, interp::exprloc, interp::EOL ) \
 							make_decl(DW_FORM_flag_present, interp::flag ) \
-							last_decl(DW_FORM_ref_sig8, interp::reference ) 
+							/* DWARF5; a data16 is too big for a constant, so we keep it as a block */ \
+							make_decl(DW_FORM_strx, interp::string ) \
+							make_decl(DW_FORM_addrx, interp::address ) \
+							make_decl(DW_FORM_ref_sup4, interp::reference ) \
+							make_decl(DW_FORM_strp_sup, interp::string ) \
+							make_decl(DW_FORM_data16, interp::block ) \
+							make_decl(DW_FORM_line_strp, interp::string ) \
+							make_decl(DW_FORM_ref_sig8, interp::reference ) \
+							make_decl(DW_FORM_implicit_const, interp::constant ) \
+							make_decl(DW_FORM_loclistx, interp::loclistptr ) \
+							make_decl(DW_FORM_rnglistx, interp::rangelistptr ) \
+							make_decl(DW_FORM_ref_sup8, interp::reference ) \
+							make_decl(DW_FORM_strx1, interp::string ) \
+							make_decl(DW_FORM_strx2, interp::string ) \
+							make_decl(DW_FORM_strx3, interp::string ) \
+							make_decl(DW_FORM_strx4, interp::string ) \
+							make_decl(DW_FORM_addrx1, interp::address ) \
+							make_decl(DW_FORM_addrx2, interp::address ) \
+							make_decl(DW_FORM_addrx3, interp::address ) \
+							last_decl(DW_FORM_addrx4, interp::address ) 
 
 
 		MAKE_LOOKUP(forward_name_mapping_t, form_forward_tbl, PAIR_ENTRY_FORWARDS_VARARGS, PAIR_ENTRY_FORWARDS_VARARGS_LAST, FORM_DECL_LIST);
@@ -653,6 +829,10 @@ pair_type name[] = { \
 						make_decl(interp::, flag) \
 						make_decl(interp::, macptr) \
 						make_decl(interp::, rangelistptr) \
+						make_decl(interp::, addrptr) \
+						make_decl(interp::, stroffsetsptr) \
+						make_decl(interp::, loclistsptr) \
+						make_decl(interp::, rnglistsptr) \
 						make_decl(interp::, block_as_dwarf_expr) \
 
 		MAKE_LOOKUP(forward_name_mapping_t, interp_forward_tbl, PAIR_ENTRY_QUAL_FORWARDS, PAIR_ENTRY_QUAL_FORWARDS_LAST, INTERP_DECL_LIST);
@@ -706,18 +886,16 @@ pair_type name[] = { \
 	
 		void print_symmetric_map_pair(
 			std::ostream& o,
-			const map<const char *, int>& forward_map,
-			const map<int, const char *>& inverse_map)
+			const name_table& forward_map,
+			const dense_table<const char *>& inverse_map)
 		{
-			for (map<const char *, int>::const_iterator i = forward_map.begin();
-					i != forward_map.end();
-					i++)
+			for (unsigned i = 0; i < forward_map.n_entries; i++)
 			{
-				o << i->first << ": 0x" << std::hex << i->second << std::dec << std::endl;
-				//assert(std::find(inverse_map.begin(),
-				//		inverse_map.end(), 
-				 //   	std::make_pair<const int, const char *>(i->second, i->first))
-				//	!= inverse_map.end());
+				const name_table::entry& e = forward_map.entries[i];
+				/* Only the first of any duplicate names is in the hash. */
+				if (forward_map.find(e.first) != &e) continue;
+				o << e.first << ": 0x" << std::hex << e.second << std::dec << std::endl;
+				assert(inverse_map.lookup(e.second));
 			}
 		}
 		std::ostream& operator<<(std::ostream& o, const abstract_def& a)
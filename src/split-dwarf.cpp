@@ -0,0 +1,400 @@
+/* dwarfpp: C++ binding for a useful subset of libdwarf, plus extra goodies.
+ *
+ * split-dwarf.cpp: following skeleton CUs into .dwo files and .dwp packages
+ *
+ * Copyright (c) 2008--17, Stephen Kell. For licensing information, see the
+ * LICENSE file in the root of the libdwarfpp tree.
+ */
+
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <gelf.h>
+
+#include "dwarfpp/root.hpp"
+#include "dwarfpp/root-inl.hpp"
+#include "dwarfpp/iter.hpp"
+#include "dwarfpp/iter-inl.hpp"
+#include "dwarfpp/dies.hpp"
+#include "dwarfpp/dies-inl.hpp"
+
+namespace dwarf
+{
+	using std::endl;
+	using std::vector;
+	using std::string;
+	namespace core
+	{
+		namespace
+		{
+			/* Not in every libdwarf's dwarf.h, nor in our spec. */
+			const Dwarf_Half AT_dwo_name = 0x76;
+			const Dwarf_Half AT_GNU_dwo_name = 0x2130;
+			const Dwarf_Half AT_GNU_dwo_id = 0x2131;
+			const uint32_t SECT_INFO = 1; // column ID in .debug_cu_index, v2 and v5 alike
+			const unsigned char UT_skeleton = 4, UT_split_compile = 5;
+
+			/* What we need from a skeleton to find its unit. */
+			struct skeleton
+			{
+				Dwarf_Off off;
+				string dwo_name;
+				opt<string> comp_dir;
+				opt<Dwarf_Unsigned> dwo_id;
+			};
+
+			opt<string> string_attr(const Die& d, Dwarf_Half attr)
+			{
+				if (!d.has_attr_here(attr)) return opt<string>();
+				Attribute a(d, attr);
+				char *str;
+				libdwarf_alloc_guard g;
+				if (DW_DLV_OK != dwarf_formstring(a.raw_handle(), &str, &current_dwarf_error))
+				{ return opt<string>(); }
+				return string(str);
+			}
+
+			opt<Dwarf_Unsigned> unsigned_attr(const Die& d, Dwarf_Half attr)
+			{
+				if (!d.has_attr_here(attr)) return opt<Dwarf_Unsigned>();
+				Attribute a(d, attr);
+				Dwarf_Unsigned u;
+				libdwarf_alloc_guard g;
+				if (DW_DLV_OK != dwarf_formudata(a.raw_handle(), &u, &current_dwarf_error))
+				{ return opt<Dwarf_Unsigned>(); }
+				return u;
+			}
+
+			opt<skeleton> read_skeleton(root_die& r, const iterator_df<compile_unit_die>& cu)
+			{
+				Die d(r, cu.offset_here());
+				opt<string> dwo_name = string_attr(d, AT_GNU_dwo_name);
+				if (!dwo_name) dwo_name = string_attr(d, AT_dwo_name);
+				if (!dwo_name) return opt<skeleton>();
+				return (skeleton) { .off = cu.offset_here(), .dwo_name = *dwo_name,
+					.comp_dir = string_attr(d, DW_AT_comp_dir),
+					.dwo_id = r.dwo_id(cu) };
+			}
+
+			Elf_Scn *find_section(::Elf *e, const char *wanted)
+			{
+				size_t shstrndx;
+				if (!e || 0 != elf_getshdrstrndx(e, &shstrndx)) return nullptr;
+				Elf_Scn *scn = nullptr;
+				while (nullptr != (scn = elf_nextscn(e, scn)))
+				{
+					GElf_Shdr shdr;
+					if (!gelf_getshdr(scn, &shdr)) continue;
+					const char *name = elf_strptr(e, shstrndx, shdr.sh_name);
+					if (name && 0 == strcmp(name, wanted)) return scn;
+				}
+				return nullptr;
+			}
+
+			bool has_debug_info(const elf_image& image)
+			{
+				::Elf *e = image.open_elf();
+				bool ret = find_section(e, ".debug_info.dwo") || find_section(e, ".debug_info");
+				if (e) elf_end(e);
+				return ret;
+			}
+
+			/* Map the whole file, so as not to hold its fd open. */
+			shared_ptr<root_die> open_root(const string& path)
+			{
+				int fd = open(path.c_str(), O_RDONLY);
+				if (fd == -1) return shared_ptr<root_die>();
+				shared_ptr<elf_image> image = elf_image::map(fd);
+				close(fd);
+				if (!image || image->size < SELFMAG || 0 != memcmp(image->data, ELFMAG, SELFMAG)
+					|| !has_debug_info(*image)) return shared_ptr<root_die>();
+				/* Debug asserts if there's no DWARF at all, hence the check;
+				 * libdwarf throws at other bad data. */
+				try { return std::make_shared<root_die>(image); }
+				catch (lib::Error e) { return shared_ptr<root_die>(); }
+			}
+
+			/* DWARF 5 skeleton and split units have their DWO ID in the unit
+			 * header, which dwarf_next_cu_header_b() doesn't give us; so we
+			 * walk the headers ourselves. Keyed by unit DIE offset, which is
+			 * just past the ID. Host-endian and uncompressed only, like
+			 * read_cu_index(). */
+			void read_unit_dwo_ids(::Elf *e, unordered_map<Dwarf_Off, Dwarf_Unsigned>& out)
+			{
+				Elf_Scn *scn = find_section(e, ".debug_info.dwo");
+				if (!scn) scn = find_section(e, ".debug_info");
+				GElf_Shdr shdr;
+				if (!scn || !gelf_getshdr(scn, &shdr) || (shdr.sh_flags & SHF_COMPRESSED)) return;
+				Elf_Data *data = elf_getdata(scn, nullptr);
+				if (!data) return;
+				const unsigned char *p = static_cast<const unsigned char *>(data->d_buf);
+				size_t size = data->d_size;
+				auto u16 = [p](size_t off) { uint16_t v; memcpy(&v, p + off, sizeof v); return v; };
+				auto u32 = [p](size_t off) { uint32_t v; memcpy(&v, p + off, sizeof v); return v; };
+				auto u64 = [p](size_t off) { uint64_t v; memcpy(&v, p + off, sizeof v); return v; };
+				for (size_t off = 0; off + 4 <= size; )
+				{
+					uint64_t len = u32(off);
+					size_t hdr = off + 4, offset_size = 4;
+					if (len == 0xffffffffu)
+					{
+						if (off + 12 > size) return;
+						len = u64(off + 4);
+						hdr = off + 12;
+						offset_size = 8;
+					}
+					if (len > size - hdr) return;
+					/* version, unit type, address size, abbrev offset, DWO ID */
+					size_t id_at = hdr + 4 + offset_size;
+					if (len >= 4 + offset_size + 8 && u16(hdr) >= 5
+						&& (p[hdr + 2] == UT_skeleton || p[hdr + 2] == UT_split_compile))
+					{
+						out[id_at + 8] = u64(id_at);
+					}
+					off = hdr + len;
+				}
+			}
+
+			/* A .dwo has just the one CU (and maybe some type units, which
+			 * libdwarf keeps elsewhere). If both sides have a DWO ID, they
+			 * must agree, else the .dwo is stale. */
+			bool find_dwo_cu(root_die& dwo, const opt<Dwarf_Unsigned>& dwo_id, Dwarf_Off *out)
+			{
+				auto cus = dwo.begin().children_here();
+				for (auto i_cu = std::move(cus.first); i_cu != cus.second; ++i_cu)
+				{
+					if (i_cu.tag_here() != DW_TAG_compile_unit) continue;
+					opt<Dwarf_Unsigned> found_id = dwo.dwo_id(i_cu.as_a<compile_unit_die>());
+					if (dwo_id && found_id && *dwo_id != *found_id) return false;
+					*out = i_cu.offset_here();
+					return true;
+				}
+				return false;
+			}
+
+			vector<string> dwo_paths(const skeleton& s, const string& search_dir)
+			{
+				vector<string> paths;
+				if (!s.dwo_name.empty() && s.dwo_name[0] == '/') paths.push_back(s.dwo_name);
+				else if (s.comp_dir) paths.push_back(*s.comp_dir + "/" + s.dwo_name);
+				else paths.push_back(s.dwo_name);
+				if (!search_dir.empty())
+				{
+					string::size_type slash = s.dwo_name.rfind('/');
+					paths.push_back(search_dir + "/" + (slash == string::npos
+						? s.dwo_name : s.dwo_name.substr(slash + 1)));
+				}
+				return paths;
+			}
+
+			/* Touches no root but the ones it opens, so prefetch workers can
+			 * run it in parallel. */
+			root_die::split_unit_entry open_dwo(const skeleton& s, const string& search_dir)
+			{
+				vector<string> paths = dwo_paths(s, search_dir);
+				for (auto i_path = paths.begin(); i_path != paths.end(); ++i_path)
+				{
+					shared_ptr<root_die> p_dwo = open_root(*i_path);
+					if (!p_dwo) continue;
+					Dwarf_Off cu_off;
+					try
+					{
+						if (find_dwo_cu(*p_dwo, s.dwo_id, &cu_off))
+						{ return (root_die::split_unit_entry) { .p_root = p_dwo, .cu_offset = cu_off }; }
+					} catch (lib::Error e) {}
+					debug(2) << "Ignoring " << *i_path << ": no CU matching the skeleton at 0x"
+						<< std::hex << s.off << std::dec << endl;
+				}
+				return (root_die::split_unit_entry) { .p_root = shared_ptr<root_die>(), .cu_offset = 0 };
+			}
+
+			/* The .debug_info contributions of each unit in a .debug_cu_index,
+			 * by DWO ID. Host-endian only, like the section_loader. */
+			struct cu_contribution
+			{
+				Dwarf_Off offset;
+				Dwarf_Unsigned size;
+				Dwarf_Unsigned dwo_id;
+				bool operator<(const cu_contribution& c) const { return offset < c.offset; }
+			};
+
+			bool read_cu_index(::Elf *e, vector<cu_contribution>& out)
+			{
+				Elf_Scn *scn = find_section(e, ".debug_cu_index");
+				Elf_Data *data = scn ? elf_getdata(scn, nullptr) : nullptr;
+				if (!data || data->d_size < 16) return false;
+				const unsigned char *p = static_cast<const unsigned char *>(data->d_buf);
+				auto u32 = [p](size_t off) { uint32_t v; memcpy(&v, p + off, sizeof v); return v; };
+				auto u64 = [p](size_t off) { uint64_t v; memcpy(&v, p + off, sizeof v); return v; };
+				/* Version is a 4-byte 2 (GNU) or a 2-byte 5 and 2 of padding. */
+				if (u32(0) != 2 && (u32(0) & 0xffff) != 5) return false;
+				uint32_t n_columns = u32(4), n_units = u32(8), n_slots = u32(12);
+				size_t sigs = 16, rows = sigs + 8ul * n_slots, columns = rows + 4ul * n_slots;
+				size_t offsets = columns + 4ul * n_columns;
+				size_t sizes = offsets + 4ul * n_columns * n_units;
+				if (sizes + 4ul * n_columns * n_units > data->d_size) return false;
+				unsigned info_col = n_columns;
+				for (unsigned c = 0; c < n_columns; ++c) if (u32(columns + 4 * c) == SECT_INFO) info_col = c;
+				if (info_col == n_columns) return false;
+				for (unsigned slot = 0; slot < n_slots; ++slot)
+				{
+					uint32_t row = u32(rows + 4 * slot); // 1-based; 0 means empty
+					if (row == 0) continue;
+					if (row > n_units) return false;
+					size_t cell = 4ul * ((row - 1) * n_columns + info_col);
+					out.push_back((cu_contribution) { .offset = u32(offsets + cell),
+						.size = u32(sizes + cell), .dwo_id = u64(sigs + 8 * slot) });
+				}
+				std::sort(out.begin(), out.end());
+				return true;
+			}
+		}
+
+		bool root_die::open_dwp()
+		{
+			if (dwp_tried) return (bool) dwp_root;
+			dwp_tried = true;
+			if (!dwp_path) return false;
+			dwp_root = open_root(*dwp_path);
+			if (!dwp_root) return false;
+			vector<cu_contribution> contribs;
+			if (!read_cu_index(dwp_root->get_elf(), contribs))
+			{
+				debug(1) << "Could not read the unit index of " << *dwp_path << endl;
+				dwp_root.reset();
+				return false;
+			}
+			/* libdwarf gives us .debug_info.dwo offsets, so each CU is in
+			 * whichever contribution covers it. */
+			auto cus = dwp_root->begin().children_here();
+			for (auto i_cu = std::move(cus.first); i_cu != cus.second; ++i_cu)
+			{
+				Dwarf_Off off = i_cu.offset_here();
+				auto found = std::upper_bound(contribs.begin(), contribs.end(),
+					(cu_contribution) { .offset = off, .size = 0, .dwo_id = 0 });
+				if (found == contribs.begin()) continue;
+				--found;
+				if (off < found->offset + found->size) dwp_units[found->dwo_id] = off;
+			}
+			debug(2) << "Indexed " << dwp_units.size() << " units in " << *dwp_path << endl;
+			return true;
+		}
+
+		bool root_die::is_skeleton(const iterator_df<compile_unit_die>& cu)
+		{
+			assert(&cu.get_root() == this);
+			return cu.tag_here() == DW_TAG_skeleton_unit
+				|| cu.has_attr_here(AT_GNU_dwo_name) || cu.has_attr_here(AT_dwo_name);
+		}
+
+		opt<Dwarf_Unsigned> root_die::dwo_id(const iterator_df<compile_unit_die>& cu)
+		{
+			assert(&cu.get_root() == this);
+			if (cu.has_attr_here(AT_GNU_dwo_id)) return unsigned_attr(Die(*this, cu.offset_here()), AT_GNU_dwo_id);
+			unordered_map<Dwarf_Off, Dwarf_Unsigned> read_now;
+			unordered_map<Dwarf_Off, Dwarf_Unsigned> *p_ids = &unit_dwo_ids;
+			if (!unit_dwo_ids_read)
+			{
+				/* While frozen, read the headers but don't keep what we read. */
+				if (frozen) p_ids = &read_now;
+				else unit_dwo_ids_read = true;
+				read_unit_dwo_ids(get_elf(), *p_ids);
+			}
+			auto found = p_ids->find(cu.offset_here());
+			return (found != p_ids->end()) ? found->second : opt<Dwarf_Unsigned>();
+		}
+
+		iterator_df<compile_unit_die> root_die::split_unit(const iterator_df<compile_unit_die>& cu)
+		{
+			assert(&cu.get_root() == this);
+			auto found = split_units.find(cu.offset_here());
+			if (found == split_units.end())
+			{
+				if (frozen) return iterator_base::END;
+				opt<skeleton> s = read_skeleton(*this, cu);
+				if (!s) return iterator_base::END;
+				split_unit_entry e = (split_unit_entry) { .p_root = shared_ptr<root_die>(), .cu_offset = 0 };
+				if (s->dwo_id && open_dwp())
+				{
+					auto found_in_dwp = dwp_units.find(*s->dwo_id);
+					if (found_in_dwp != dwp_units.end()) e = (split_unit_entry) {
+						.p_root = dwp_root, .cu_offset = found_in_dwp->second };
+				}
+				if (!e.p_root) e = open_dwo(*s, dwo_search_dir);
+				found = split_units.insert(make_pair(cu.offset_here(), e)).first;
+			}
+			if (!found->second.p_root) return iterator_base::END;
+			root_die& r = *found->second.p_root;
+			return r.pos(found->second.cu_offset, 1, opt<Dwarf_Off>(0UL)).as_a<compile_unit_die>();
+		}
+
+		unsigned root_die::prefetch_split_units(unsigned nthreads)
+		{
+			if (frozen) return 0;
+			/* Reading the skeletons uses our libdwarf, so we do it here. */
+			vector<skeleton> todo;
+			auto cus = begin().children_here();
+			for (auto i_cu = std::move(cus.first); i_cu != cus.second; ++i_cu)
+			{
+				if (split_units.find(i_cu.offset_here()) != split_units.end()) continue;
+				auto cu = i_cu.as_a<compile_unit_die>();
+				if (!cu) continue;
+				opt<skeleton> s = read_skeleton(*this, cu);
+				if (!s) continue;
+				if (s->dwo_id && open_dwp())
+				{
+					auto found_in_dwp = dwp_units.find(*s->dwo_id);
+					if (found_in_dwp != dwp_units.end())
+					{
+						split_units[s->off] = (split_unit_entry) {
+							.p_root = dwp_root, .cu_offset = found_in_dwp->second };
+						continue;
+					}
+				}
+				todo.push_back(*s);
+			}
+			/* Each worker opens whole .dwos, sharing nothing but the counter. */
+			vector<split_unit_entry> opened(todo.size());
+			if (nthreads == 0) nthreads = std::max(1u, std::thread::hardware_concurrency());
+			nthreads = std::min<unsigned>(nthreads, todo.size());
+			std::atomic<unsigned> next(0);
+			const string& search_dir = dwo_search_dir;
+			auto work = [&todo, &opened, &next, &search_dir]() {
+				for (unsigned i; (i = next++) < todo.size(); ) opened[i] = open_dwo(todo[i], search_dir);
+			};
+			vector<std::thread> workers;
+			for (unsigned i = 0; i < nthreads; ++i) workers.push_back(std::thread(work));
+			for (auto i_w = workers.begin(); i_w != workers.end(); ++i_w) i_w->join();
+			for (unsigned i = 0; i < todo.size(); ++i) split_units[todo[i].off] = opened[i];
+
+			unsigned n_found = 0;
+			for (auto i_u = split_units.begin(); i_u != split_units.end(); ++i_u)
+			{
+				if (i_u->second.p_root) ++n_found;
+			}
+			debug(2) << "Have " << n_found << " of " << split_units.size() << " split units, having tried "
+				<< todo.size() << " more skeletons using " << nthreads << " threads" << endl;
+			return n_found;
+		}
+
+		unsigned root_die::splice_split_units(unsigned nthreads)
+		{
+			if (frozen) return 0;
+			prefetch_split_units(nthreads);
+			unsigned n_spliced = 0;
+			for (auto i_u = split_units.begin(); i_u != split_units.end(); ++i_u)
+			{
+				if (!i_u->second.p_root) continue;
+				i_u->second.p_root->spliced_under[i_u->second.cu_offset]
+				 = (splice_point) { .p_host = this, .skeleton_off = i_u->first };
+				++n_spliced;
+			}
+			split_units_spliced = (n_spliced > 0);
+			debug(2) << "Spliced " << n_spliced << " split units under their skeletons" << endl;
+			return n_spliced;
+		}
+	}
+}
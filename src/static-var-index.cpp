@@ -0,0 +1,165 @@
+/* dwarfpp: C++ binding for a useful subset of libdwarf, plus extra goodies.
+ *
+ * static-var-index.cpp: address-to-static-variable interval index
+ *
+ * Copyright (c) 2008--17, Stephen Kell. For licensing information, see the
+ * LICENSE file in the root of the libdwarfpp tree.
+ */
+
+#include <algorithm>
+#include <thread>
+
+#include "dwarfpp/root.hpp"
+#include "dwarfpp/root-inl.hpp"
+#include "dwarfpp/iter.hpp"
+#include "dwarfpp/iter-inl.hpp"
+#include "dwarfpp/dies.hpp"
+
+namespace dwarf
+{
+	using std::endl;
+	using std::vector;
+	namespace core
+	{
+		/* Statics can be at top level, in namespaces, or inside
+		 * subprograms and their blocks; we never look inside types, since
+		 * the definitions of static members are outside them. */
+		static bool may_contain_statics(Dwarf_Half tag)
+		{
+			switch (tag)
+			{
+				case DW_TAG_compile_unit:
+				case DW_TAG_partial_unit:
+				case DW_TAG_namespace:
+				case DW_TAG_module:
+				case DW_TAG_subprogram:
+				case DW_TAG_lexical_block:
+				case DW_TAG_inlined_subroutine:
+					return true;
+				default:
+					return false;
+			}
+		}
+
+		static void add_static_var_intervals(root_die& r, const iterator_base& i,
+			vector<root_die::static_var_entry>& out)
+		{
+			iterator_df<variable_die> i_var = i;
+			/* file_relative_intervals() insists on a size. */
+			auto t = i_var->find_type();
+			if (!t || !t->calculate_byte_size()) return;
+			try
+			{
+				/* This does the has_static_storage() test for us. */
+				auto intervals = i_var->file_relative_intervals(r, nullptr, nullptr);
+				for (auto i_int = intervals.begin(); i_int != intervals.end(); ++i_int)
+				{
+					Dwarf_Addr lo = i_int->first.lower();
+					Dwarf_Addr hi = i_int->first.upper();
+					/* The interval maps to the object offset at its end. */
+					out.push_back((root_die::static_var_entry) {
+						.lo = lo,
+						.hi = hi,
+						.off = i.offset_here(),
+						.offset_within = i_int->second - (hi - lo)
+					});
+				}
+			}
+			catch (No_entry)
+			{
+				debug(2) << "Couldn't locate static " << i_var->summary() << endl;
+			}
+		}
+
+		static void add_subtree_static_vars(root_die& r, const iterator_base& start,
+			vector<root_die::static_var_entry>& out)
+		{
+			auto children = start.children_here();
+			for (auto i = std::move(children.first); i != children.second; ++i)
+			{
+				Dwarf_Half tag = i.tag_here();
+				if (tag == DW_TAG_variable && i.has_attribute_here(DW_AT_location))
+				{
+					add_static_var_intervals(r, i, out);
+				}
+				else if (may_contain_statics(tag)) add_subtree_static_vars(r, i, out);
+			}
+		}
+
+		bool root_die::build_static_var_index(unsigned nthreads)
+		{
+			clear_static_var_index();
+			vector<Dwarf_Off> cus;
+			auto cu_seq = begin().children_here();
+			for (auto i_cu = std::move(cu_seq.first); i_cu != cu_seq.second; ++i_cu)
+			{
+				cus.push_back(i_cu.offset_here());
+			}
+			if (cus.empty()) return false;
+
+			/* As in symbolize(): only a frozen root is safe to share. */
+			if (!frozen) nthreads = 1;
+			else if (nthreads == 0) nthreads = std::max(1u, std::thread::hardware_concurrency());
+			nthreads = std::max(1u, std::min(nthreads, (unsigned) cus.size()));
+			vector<vector<static_var_entry> > slice_raw(nthreads);
+			auto run_slice = [&](unsigned i) {
+				for (size_t j = cus.size() * i / nthreads; j < cus.size() * (i + 1) / nthreads; ++j)
+				{
+					add_subtree_static_vars(*this, cu_pos(cus[j]), slice_raw[i]);
+				}
+			};
+			if (nthreads == 1) run_slice(0);
+			else
+			{
+				vector<std::thread> workers;
+				for (unsigned i = 0; i < nthreads; ++i) workers.push_back(std::thread(run_slice, i));
+				for (auto i_w = workers.begin(); i_w != workers.end(); ++i_w) i_w->join();
+			}
+			vector<static_var_entry> raw;
+			for (auto i_s = slice_raw.begin(); i_s != slice_raw.end(); ++i_s)
+			{
+				raw.insert(raw.end(), i_s->begin(), i_s->end());
+			}
+
+			/* Keep the intervals disjoint. The same static may be described
+			 * more than once (e.g. in each inlined copy of its function);
+			 * keep the lowest offset, and drop anything else that overlaps
+			 * something earlier. */
+			std::sort(raw.begin(), raw.end(),
+				[](const static_var_entry& a, const static_var_entry& b) {
+					return a.lo < b.lo || (a.lo == b.lo && (a.hi > b.hi
+						|| (a.hi == b.hi && a.off < b.off)));
+				});
+			unsigned n_dropped = 0;
+			for (auto i_e = raw.begin(); i_e != raw.end(); ++i_e)
+			{
+				if (!static_var_index.empty() && i_e->lo < static_var_index.back().hi)
+				{
+					++n_dropped;
+					continue;
+				}
+				static_var_index.push_back(*i_e);
+			}
+			static_var_index.shrink_to_fit();
+			static_var_index_built = true;
+			debug(2) << "Built static variable index of " << static_var_index.size()
+				<< " intervals (dropping " << n_dropped << " overlapping) from "
+				<< cus.size() << " CUs using " << nthreads << " threads" << endl;
+			return true;
+		}
+
+		iterator_base root_die::static_var_for_addr(Dwarf_Addr file_relative_addr,
+			Dwarf_Off *out_offset_within)
+		{
+			if (!frozen && !static_var_index_built) build_static_var_index();
+			auto found = std::upper_bound(static_var_index.begin(), static_var_index.end(),
+				file_relative_addr,
+				[](Dwarf_Addr a, const static_var_entry& e) { return a < e.lo; });
+			if (found == static_var_index.begin()) return iterator_base::END;
+			--found;
+			if (file_relative_addr >= found->hi) return iterator_base::END;
+			if (out_offset_within) *out_offset_within = found->offset_within + (file_relative_addr - found->lo);
+			return pos(found->off);
+		}
+	}
+}
@@ -0,0 +1,235 @@
+/* dwarfpp: C++ binding for a useful subset of libdwarf, plus extra goodies.
+ *
+ * type-edits.cpp: keeping the type caches right across in-memory edits
+ *
+ * Copyright (c) 2008--17, Stephen Kell. For licensing information, see the
+ * LICENSE file in the root of the libdwarfpp tree.
+ */
+
+#include <algorithm>
+#include <unordered_set>
+
+#include "dwarfpp/root.hpp"
+#include "dwarfpp/root-inl.hpp"
+#include "dwarfpp/iter.hpp"
+#include "dwarfpp/iter-inl.hpp"
+#include "dwarfpp/dies.hpp"
+#include "dwarfpp/dies-inl.hpp"
+
+namespace dwarf
+{
+	using std::endl;
+	using std::vector;
+	namespace core
+	{
+		namespace
+		{
+			void note_references(std::unordered_multimap<Dwarf_Off, Dwarf_Off>& referrers,
+				Dwarf_Off off, Dwarf_Off cu_off, const encap::attribute_map& attrs)
+			{
+				for (auto i_a = attrs.begin(); i_a != attrs.end(); ++i_a)
+				{
+					/* As in extract_ref_graph(), siblings are navigation. */
+					if (i_a->first == DW_AT_sibling
+						|| i_a->second.get_form() != encap::attribute_value::REF) continue;
+					const encap::attribute_value::weak_ref& ref = i_a->second.get_ref();
+					referrers.insert(make_pair(ref.abs ? ref.off : cu_off + ref.off, off));
+				}
+			}
+		}
+
+		void root_die::type_equality_memo::forget(const std::unordered_set<Dwarf_Off>& offs)
+		{
+			assert(assumed.empty() && provisional.empty());
+			/* Each class keeps the members that stay, under the lowest of them;
+			 * they're still equal, since nothing they reach has changed. */
+			unordered_map<Dwarf_Off, vector<Dwarf_Off> > staying; // by old representative
+			for (auto i = parent.begin(); i != parent.end(); ++i)
+			{
+				Dwarf_Off r = rep(i->first);
+				vector<Dwarf_Off>& members = staying[r];
+				if (members.empty() && offs.find(r) == offs.end()) members.push_back(r);
+				if (offs.find(i->first) == offs.end()) members.push_back(i->first);
+			}
+			unordered_map<Dwarf_Off, Dwarf_Off> new_parent;
+			unordered_map<Dwarf_Off, Dwarf_Off> new_rep; // by old representative
+			for (auto i = staying.begin(); i != staying.end(); ++i)
+			{
+				if (i->second.empty()) continue;
+				Dwarf_Off lowest = *std::min_element(i->second.begin(), i->second.end());
+				new_rep.insert(make_pair(i->first, lowest));
+				for (auto i_m = i->second.begin(); i_m != i->second.end(); ++i_m)
+				{
+					if (*i_m != lowest) new_parent.insert(make_pair(*i_m, lowest));
+				}
+			}
+			/* Unequal pairs stay unequal, as long as a member of each side does. */
+			auto rep_after = [&](Dwarf_Off off, Dwarf_Off *out) -> bool {
+				Dwarf_Off r = rep(off);
+				auto found = new_rep.find(r);
+				if (found != new_rep.end()) { *out = found->second; return true; }
+				if (staying.find(r) != staying.end() || offs.find(r) != offs.end()) return false;
+				*out = r; // a singleton that stays
+				return true;
+			};
+			decltype(unequal) new_unequal;
+			for (auto i = unequal.begin(); i != unequal.end(); ++i)
+			{
+				Dwarf_Off a, b;
+				if (rep_after(i->first, &a) && rep_after(i->second, &b)) new_unequal.insert(ordered(a, b));
+			}
+			parent.swap(new_parent);
+			unequal.swap(new_unequal);
+		}
+
+		void root_die::build_type_referrers()
+		{
+			auto& referrers = type_dependents.referrers;
+			referrers.clear();
+			ref_graph g;
+			if (extract_ref_graph(g))
+			{
+				for (unsigned i = 0; i < g.dies.size(); ++i)
+				{
+					auto edges = g.edges_of(i);
+					for (auto p = edges.first; p != edges.second; ++p)
+					{
+						referrers.insert(make_pair(p->target, g.dies[i]));
+					}
+				}
+				/* The graph is only .debug_info; whatever make_new() made is sticky. */
+				for (auto i_d = sticky_dies.begin(); i_d != sticky_dies.end(); ++i_d)
+				{
+					auto p_mem = dynamic_cast<in_memory_abstract_die *>(i_d->second.get());
+					if (p_mem) note_references(referrers, p_mem->get_offset(),
+						p_mem->get_enclosing_cu_offset(), p_mem->copy_attrs());
+				}
+			}
+			else
+			{
+				for (iterator_df<> i = begin(); i != end(); ++i)
+				{
+					if (i.is_root_position()) continue;
+					note_references(referrers, i.offset_here(), i.enclosing_cu_offset_here(), i.copy_attrs());
+				}
+			}
+			type_dependents.built = true;
+			debug(2) << "Indexed " << referrers.size() << " references for invalidating types" << endl;
+		}
+
+		void root_die::note_definition_sought(Dwarf_Off decl, const string& name, const iterator_base& found)
+		{
+			if (frozen) return;
+			type_dependents.may_have_cached = true;
+			type_dependents.declarations_named.insert(make_pair(names.intern(name), decl));
+			if (found) type_dependents.declarations_of.insert(make_pair(found.offset_here(), decl));
+		}
+
+		unsigned root_die::invalidate_types_reaching(Dwarf_Off off)
+		{
+			assert(!frozen);
+			/* Not while a type_die::equal() is in progress. */
+			assert(type_equality.assumed.empty());
+			if (!type_dependents.may_have_cached && type_summary_code_cache.empty()
+				&& type_equality.parent.empty() && type_equality.unequal.empty()
+				&& rep_compatible_cache.empty() && type_layouts.empty()
+				&& !have_canonical_type_table()) return 0;
+			if (!type_dependents.built) build_type_referrers();
+
+			/* A DIE matters to the type it's part of (a member to its structure,
+			 * say), or to itself if it's a type, and to any type it's nested in
+			 * directly. Beyond those, we only walk backwards along references;
+			 * a variable or subprogram, say, reaches us but isn't a type. */
+			std::unordered_set<Dwarf_Off> reaching;
+			vector<Dwarf_Off> pending;
+			auto add_enclosing_types = [this, &reaching, &pending](Dwarf_Off from) {
+				iterator_base i = pos(from);
+				while (i && i.depth() > 1 && !i.is_a<type_die>()) i = parent(i);
+				while (i && i.depth() > 1 && i.is_a<type_die>())
+				{
+					if (reaching.insert(i.offset_here()).second) pending.push_back(i.offset_here());
+					i = parent(i);
+				}
+			};
+			auto add_referrers = [this, &add_enclosing_types](Dwarf_Off to) {
+				auto refs = type_dependents.referrers.equal_range(to);
+				for (auto i_r = refs.first; i_r != refs.second; ++i_r) add_enclosing_types(i_r->second);
+				auto decls = type_dependents.declarations_of.lower_bound(make_pair(to, (Dwarf_Off) 0));
+				for (; decls != type_dependents.declarations_of.end() && decls->first == to; ++decls)
+				{
+					add_enclosing_types(decls->second);
+				}
+			};
+			add_enclosing_types(off);
+			add_referrers(off);
+			/* A named structure might now be what some declaration resolves to. */
+			iterator_base edited = pos(off);
+			opt<string> name = edited.name_here();
+			unsigned name_id;
+			if (edited.is_a<with_data_members_die>() && name
+				&& (name_id = names.lookup(*name)) != name_interner::NONE)
+			{
+				auto decls = type_dependents.declarations_named.lower_bound(make_pair(name_id, (Dwarf_Off) 0));
+				for (; decls != type_dependents.declarations_named.end() && decls->first == name_id; ++decls)
+				{
+					add_enclosing_types(decls->second);
+				}
+			}
+			while (!pending.empty())
+			{
+				Dwarf_Off t = pending.back();
+				pending.pop_back();
+				add_referrers(t);
+			}
+
+			for (auto i_t = reaching.begin(); i_t != reaching.end(); ++i_t)
+			{
+				type_summary_code_cache.erase(*i_t);
+				/* Only a live payload has caches of its own. */
+				auto found = live_dies.find(*i_t);
+				if (found == live_dies.end()) continue;
+				if (auto p_t = dynamic_cast<type_die *>(found->second))
+				{
+					p_t->cached_summary_code = opt<uint32_t>();
+					p_t->opt_cached_scc = optional<shared_ptr<type_scc_t> >();
+				}
+				if (auto p_w = dynamic_cast<with_data_members_die *>(found->second))
+				{
+					p_w->maybe_cached_definition = optional<iterator_df<> >();
+				}
+			}
+			type_equality.forget(reaching);
+			/* What we reached may no longer equal the rest of its canonical
+			 * ID. Compatibility and layouts are memoized by ID (layouts under
+			 * its representative), so forget every pair with one of those
+			 * IDs on either side, and those IDs' layouts; then the reached
+			 * types lose their IDs. */
+			std::unordered_set<unsigned> ids;
+			if (have_canonical_type_table())
+			{
+				for (auto i_t = reaching.begin(); i_t != reaching.end(); ++i_t)
+				{
+					opt<unsigned> id = lookup_canonical_id(*i_t);
+					if (id) ids.insert(*id);
+				}
+			}
+			if (!ids.empty())
+			{
+				for (auto i = rep_compatible_cache.begin(); i != rep_compatible_cache.end(); )
+				{
+					if (ids.count(i->first.first) || ids.count(i->first.second)) i = rep_compatible_cache.erase(i);
+					else ++i;
+				}
+				for (auto i_id = ids.begin(); i_id != ids.end(); ++i_id)
+				{
+					forget_type_layout(canonical_type_reps[*i_id]);
+				}
+				forget_canonical_ids(reaching);
+			}
+			for (auto i_t = reaching.begin(); i_t != reaching.end(); ++i_t) forget_type_layout(*i_t);
+			debug(3) << "Edit at 0x" << std::hex << off << std::dec << " invalidated "
+				<< reaching.size() << " types" << endl;
+			return reaching.size();
+		}
+	}
+}
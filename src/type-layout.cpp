@@ -0,0 +1,173 @@
+/* dwarfpp: C++ binding for a useful subset of libdwarf, plus extra goodies.
+ *
+ * type-layout.cpp: flattened, memoized layouts of structs, classes and unions
+ *
+ * Copyright (c) 2008--17, Stephen Kell. For licensing information, see the
+ * LICENSE file in the root of the libdwarfpp tree.
+ */
+
+#include <algorithm>
+
+#include "dwarfpp/root.hpp"
+#include "dwarfpp/root-inl.hpp"
+#include "dwarfpp/iter.hpp"
+#include "dwarfpp/iter-inl.hpp"
+#include "dwarfpp/dies.hpp"
+#include "dwarfpp/dies-inl.hpp"
+
+namespace dwarf
+{
+	using std::endl;
+	using std::vector;
+	namespace core
+	{
+		/* Nothing can contain itself, but broken DWARF might say otherwise. */
+		static const unsigned short MAX_LAYOUT_DEPTH = 64;
+
+		/* The fields for t's own members, at base, sorted by offset. */
+		static vector<type_layout::field> member_fields(iterator_df<with_data_members_die> t,
+			Dwarf_Unsigned base, unsigned parent, unsigned short depth)
+		{
+			vector<type_layout::field> out;
+			auto members = t->children().subseq_of<data_member_die>();
+			for (auto i_memb = members.first; i_memb != members.second; ++i_memb)
+			{
+				if (i_memb->get_declaration() && *i_memb->get_declaration()) continue;
+				iterator_df<type_die> memb_t = i_memb->find_type();
+				iterator_df<type_die> concrete = memb_t ? memb_t->get_concrete_type() : memb_t;
+				opt<Dwarf_Unsigned> opt_size = concrete ? concrete->calculate_byte_size()
+					: opt<Dwarf_Unsigned>();
+				type_layout::field f = {
+					.byte_offset = 0,
+					.byte_size = opt_size ? *opt_size : 0,
+					.bit_offset = 0,
+					.bit_size = 0,
+					.member = i_memb.offset_here(),
+					.type = concrete ? concrete.offset_here() : 0,
+					.parent = parent,
+					.first_child = 0,
+					.n_children = 0,
+					.depth = depth
+				};
+				auto i_bitfield = i_memb.as_a<member_die>();
+				opt<Dwarf_Unsigned> opt_bit_size = i_bitfield ? i_bitfield->get_bit_size()
+					: opt<Dwarf_Unsigned>();
+				opt<Dwarf_Unsigned> opt_data_bit_offset = i_bitfield ? i_bitfield->get_data_bit_offset()
+					: opt<Dwarf_Unsigned>();
+				opt<Dwarf_Unsigned> opt_offset;
+				/* Newer bitfields may have no DW_AT_data_member_location at
+				 * all, and the one below can't cope with that. */
+				if (!(opt_bit_size && opt_data_bit_offset)) opt_offset = i_memb->byte_offset_in_enclosing_type();
+				if (opt_bit_size)
+				{
+					Dwarf_Unsigned first_bit;
+					if (opt_data_bit_offset) first_bit = *opt_data_bit_offset;
+					else if (opt_offset && i_bitfield->get_bit_offset())
+					{
+						/* DW_AT_bit_offset counts from the most significant bit of
+						 * a storage unit the size of the type. FIXME: this is
+						 * only right for little-endian targets. */
+						first_bit = 8 * (*opt_offset + f.byte_size)
+							- *i_bitfield->get_bit_offset() - *opt_bit_size;
+					}
+					else if (opt_offset) first_bit = 8 * *opt_offset;
+					else goto no_offset;
+					f.byte_offset = base + first_bit / 8;
+					f.bit_offset = first_bit % 8;
+					f.bit_size = *opt_bit_size;
+					f.byte_size = (f.bit_offset + f.bit_size + 7) / 8;
+					out.push_back(f);
+					continue;
+				}
+				if (!opt_offset) goto no_offset;
+				f.byte_offset = base + *opt_offset;
+				out.push_back(f);
+				continue;
+			no_offset:
+				debug(2) << "Leaving member without a known offset out of layout: "
+					<< i_memb->summary() << endl;
+			}
+			/* Members are almost always in offset order already, but don't
+			 * rely on it. */
+			std::stable_sort(out.begin(), out.end(),
+				[](const type_layout::field& a, const type_layout::field& b) {
+					return a.byte_offset < b.byte_offset;
+				});
+			return out;
+		}
+
+		shared_ptr<const type_layout> root_die::layout_of(const iterator_base& t_arg)
+		{
+			iterator_df<type_die> t = t_arg.as_a<type_die>();
+			if (t) t = t->get_concrete_type();
+			if (!t || !t.is_a<with_data_members_die>()) return shared_ptr<const type_layout>();
+			/* Equal types have equal layouts, so share one per ID. */
+			if (have_canonical_type_table())
+			{
+				opt<unsigned> id = canonical_id(t);
+				if (id && *id) t = canonical_representative(*id).as_a<type_die>();
+			}
+			auto found = type_layouts.find(t.offset_here());
+			DWARFPP_STAT_HIT(*this, found != type_layouts.end(), type_layout);
+			if (found != type_layouts.end()) return found->second;
+
+			auto p_layout = std::make_shared<type_layout>();
+			p_layout->type = t.offset_here();
+			p_layout->byte_size = t->calculate_byte_size();
+			vector<type_layout::field>& fields = p_layout->fields;
+			fields = member_fields(t.as_a<with_data_members_die>(), 0, type_layout::NONE, 0);
+			p_layout->n_members = fields.size();
+			/* Breadth-first, so that each field's members are one run. */
+			for (unsigned i = 0; i < fields.size(); ++i)
+			{
+				if (!fields[i].type || fields[i].bit_size
+					|| fields[i].depth + 1 >= MAX_LAYOUT_DEPTH) continue;
+				iterator_df<type_die> field_t = pos(fields[i].type).as_a<type_die>();
+				if (!field_t.is_a<with_data_members_die>()) continue;
+				vector<type_layout::field> children = member_fields(
+					field_t.as_a<with_data_members_die>(), fields[i].byte_offset, i,
+					fields[i].depth + 1);
+				fields[i].first_child = fields.size();
+				fields[i].n_children = children.size();
+				fields.insert(fields.end(), children.begin(), children.end());
+			}
+			fields.shrink_to_fit();
+			debug(2) << "Laid out " << fields.size() << " fields of "
+				<< t.summary() << endl;
+			if (!frozen)
+			{
+				cache_type_layout(t.offset_here(), p_layout);
+				note_cache_growth(t.offset_here());
+			}
+			return p_layout;
+		}
+
+		const type_layout::field *type_layout::find(Dwarf_Unsigned byte_offset) const
+		{
+			const field *p_found = nullptr;
+			unsigned begin = 0;
+			unsigned end = n_members;
+			while (begin != end)
+			{
+				auto i_f = std::upper_bound(fields.begin() + begin, fields.begin() + end, byte_offset,
+					[](Dwarf_Unsigned off, const field& f) { return off < f.byte_offset; });
+				/* Of the fields starting at or before byte_offset, the last
+				 * would cover it, unless we're in a union, where several
+				 * start together. */
+				const field *p_covering = nullptr;
+				while (i_f != fields.begin() + begin)
+				{
+					--i_f;
+					if (byte_offset < i_f->byte_offset + i_f->byte_size) { p_covering = &*i_f; break; }
+					if (i_f == fields.begin() + begin
+						|| (i_f - 1)->byte_offset != i_f->byte_offset) break;
+				}
+				if (!p_covering) break;
+				p_found = p_covering;
+				begin = p_found->first_child;
+				end = begin + p_found->n_children;
+			}
+			return p_found;
+		}
+	}
+}
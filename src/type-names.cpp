@@ -0,0 +1,221 @@
+/* dwarfpp: C++ binding for a useful subset of libdwarf, plus extra goodies.
+ *
+ * type-names.cpp: finding types by qualified name, root-wide
+ *
+ * Copyright (c) 2008--17, Stephen Kell. For licensing information, see the
+ * LICENSE file in the root of the libdwarfpp tree.
+ */
+
+#include <set>
+
+#include "dwarfpp/root.hpp"
+#include "dwarfpp/root-inl.hpp"
+#include "dwarfpp/iter.hpp"
+#include "dwarfpp/iter-inl.hpp"
+#include "dwarfpp/dies.hpp"
+
+namespace dwarf
+{
+	using std::endl;
+	using std::vector;
+	namespace core
+	{
+		/* The kinds of type we index, with classes filed as structs. */
+		static Dwarf_Half type_name_tag(Dwarf_Half tag)
+		{
+			switch (tag)
+			{
+				case DW_TAG_class_type:
+					return DW_TAG_structure_type;
+				case DW_TAG_structure_type:
+				case DW_TAG_union_type:
+				case DW_TAG_enumeration_type:
+				case DW_TAG_typedef:
+				case DW_TAG_base_type:
+				case DW_TAG_unspecified_type:
+					return tag;
+				default:
+					return 0;
+			}
+		}
+
+		/* Where named types may be found, and what they add to the names
+		 * of what's inside them. */
+		static bool is_type_name_scope(Dwarf_Half tag)
+		{
+			switch (tag)
+			{
+				case DW_TAG_namespace:
+				case DW_TAG_structure_type:
+				case DW_TAG_class_type:
+				case DW_TAG_union_type:
+					return true;
+				default:
+					return false;
+			}
+		}
+
+		static string scope_prefix(const iterator_base& i, const string& prefix)
+		{
+			auto name = i.name_here();
+			if (name) return prefix + *name + "::";
+			if (i.tag_here() == DW_TAG_namespace) return prefix + "(anonymous namespace)::";
+			return string(); // unnamed types' members have no qualified name
+		}
+
+		void root_die::index_type_names_under(const iterator_base& start, const string& prefix)
+		{
+			auto children = start.children_here();
+			for (auto i = std::move(children.first); i != children.second; ++i)
+			{
+				Dwarf_Half tag = i.tag_here();
+				Dwarf_Half filed_tag = type_name_tag(tag);
+				if (filed_tag)
+				{
+					auto name = i.name_here();
+					if (name)
+					{
+						auto& entries = type_names.by_name[names.intern(prefix + *name)];
+						size_t capacity_before = entries.capacity();
+						entries.push_back((type_name_index::entry) {
+							.off = i.offset_here(),
+							.tag = filed_tag,
+							.declaration = i.has_attr(DW_AT_declaration)
+						});
+						type_names.entry_bytes += (entries.capacity() - capacity_before)
+							* sizeof (type_name_index::entry);
+					}
+				}
+				if (is_type_name_scope(tag))
+				{
+					string inner_prefix = scope_prefix(i, prefix);
+					if (!inner_prefix.empty()) index_type_names_under(i, inner_prefix);
+				}
+			}
+		}
+
+		bool root_die::index_type_names_step()
+		{
+			if (type_names.complete || frozen) return false;
+			iterator_base i_cu = type_names.cursor
+				? iterator_base(cu_pos(*type_names.cursor))
+				: first_child(begin());
+			if (!i_cu) { type_names.complete = true; return false; }
+			index_type_names_under(i_cu, string());
+			DWARFPP_STAT_INC(*this, type_name_cus_indexed);
+			iterator_base next = next_sibling(i_cu);
+			if (next) type_names.cursor = next.offset_here();
+			else
+			{
+				type_names.complete = true;
+				debug(2) << "Type name index is complete, with " << type_names.by_name.size()
+					<< " names" << endl;
+			}
+			return true;
+		}
+
+		void root_die::index_all_type_names()
+		{
+			while (index_type_names_step());
+		}
+
+		const root_die::type_name_index::entry *
+		root_die::type_name_lookup(Dwarf_Half tag, const string& qualified_name, bool want_definition)
+		{
+			Dwarf_Half filed_tag = type_name_tag(tag);
+			if (tag && !filed_tag) return nullptr;
+			/* CUs are indexed in offset order, so the first definition we
+			 * see is the first there is; a declaration might be followed by a
+			 * definition in a later CU, so to settle for one we need them all. */
+			const type_name_index::entry *p_decl = nullptr;
+			do
+			{
+				p_decl = nullptr;
+				unsigned id = names.lookup(qualified_name);
+				if (id == name_interner::NONE) continue;
+				auto found = type_names.by_name.find(id);
+				if (found == type_names.by_name.end()) continue;
+				for (auto i_e = found->second.begin(); i_e != found->second.end(); ++i_e)
+				{
+					if (filed_tag && i_e->tag != filed_tag) continue;
+					if (!i_e->declaration) return &*i_e;
+					if (!p_decl) p_decl = &*i_e;
+				}
+				if (p_decl && !want_definition) return p_decl;
+			} while (index_type_names_step());
+			return p_decl;
+		}
+
+		iterator_base root_die::type_named(Dwarf_Half tag, const string& qualified_name)
+		{
+			const type_name_index::entry *p_e = type_name_lookup(tag, qualified_name, true);
+			if (!p_e) return iterator_base::END;
+			iterator_base found = pos(p_e->off);
+			/* Declarations have no canonical ID worth having. */
+			if (!p_e->declaration && have_canonical_type_table())
+			{
+				opt<unsigned> id = canonical_id(found);
+				if (id && *id) return canonical_representative(*id);
+			}
+			return found;
+		}
+
+		iterator_base root_die::type_named(const string& name)
+		{
+			static const struct { const char *keyword; Dwarf_Half tag; } keywords[] = {
+				{ "struct ", DW_TAG_structure_type },
+				{ "class ", DW_TAG_class_type },
+				{ "union ", DW_TAG_union_type },
+				{ "enum ", DW_TAG_enumeration_type }
+			};
+			for (unsigned i = 0; i < sizeof keywords / sizeof keywords[0]; ++i)
+			{
+				string k = keywords[i].keyword;
+				if (name.compare(0, k.size(), k) == 0) return type_named(keywords[i].tag, name.substr(k.size()));
+			}
+			return type_named(0, name);
+		}
+
+		vector<iterator_base> root_die::type_named_all(Dwarf_Half tag, const string& qualified_name)
+		{
+			vector<iterator_base> out;
+			Dwarf_Half filed_tag = type_name_tag(tag);
+			if (tag && !filed_tag) return out;
+			index_all_type_names();
+			unsigned id = names.lookup(qualified_name);
+			if (id == name_interner::NONE) return out;
+			auto found = type_names.by_name.find(id);
+			if (found == type_names.by_name.end()) return out;
+			bool dedup = have_canonical_type_table();
+			std::set<unsigned> ids_seen;
+			for (auto i_e = found->second.begin(); i_e != found->second.end(); ++i_e)
+			{
+				if (i_e->declaration || (filed_tag && i_e->tag != filed_tag)) continue;
+				iterator_base i = pos(i_e->off);
+				if (dedup)
+				{
+					opt<unsigned> id = canonical_id(i);
+					if (id && *id && !ids_seen.insert(*id).second) continue;
+				}
+				out.push_back(std::move(i));
+			}
+			return out;
+		}
+
+		string root_die::qualified_type_name(const iterator_base& t)
+		{
+			auto name = t.name_here();
+			if (!name || !type_name_tag(t.tag_here())) return string();
+			string prefix;
+			for (iterator_base i = parent(t); i && i.tag_here() != DW_TAG_compile_unit
+				&& i.tag_here() != DW_TAG_partial_unit; i = parent(i))
+			{
+				if (!is_type_name_scope(i.tag_here())) return string();
+				string scope = scope_prefix(i, string());
+				if (scope.empty()) return string();
+				prefix = scope + prefix;
+			}
+			return prefix + *name;
+		}
+	}
+}
@@ -0,0 +1,151 @@
+/* dwarfpp: C++ binding for a useful subset of libdwarf, plus extra goodies.
+ *
+ * type-registry.cpp: canonical type IDs across several root DIEs
+ *
+ * Copyright (c) 2008--17, Stephen Kell. For licensing information, see the
+ * LICENSE file in the root of the libdwarfpp tree.
+ */
+
+#include <thread>
+#include <algorithm>
+#include <sstream>
+
+#include "dwarfpp/type-registry.hpp"
+
+namespace dwarf
+{
+	using std::endl;
+	using std::vector;
+	namespace core
+	{
+		namespace
+		{
+			/* A type's summary code names anonymous types by where they are
+			 * (see arbitrary_name()), which differs between roots. Across
+			 * roots we bucket by this instead: the tag, the name if there is
+			 * one, and the same of the type's target and of its members,
+			 * enumerators, parameters and subranges, down to a few levels.
+			 * Equal types (with equal summary codes) get equal keys; it's
+			 * only a bucket, so we still confirm with equal(). */
+			void write_structural_key(std::ostream& s, const iterator_df<> &i, unsigned depth)
+			{
+				if (!i) { s << "void"; return; }
+				opt<string> name = i.name_here();
+				s << i.tag_here() << ':' << (name ? *name : string()) << '(';
+				if (depth == 0) { s << ')'; return; }
+				encap::attribute_value v_type = i->find_attr(DW_AT_type);
+				if (v_type.is_ref()) write_structural_key(s, v_type.get_refiter_is_type(), depth - 1);
+				auto cs = i.children_here();
+				for (auto i_c = std::move(cs.first); i_c != cs.second; ++i_c)
+				{
+					switch (i_c.tag_here())
+					{
+						case DW_TAG_member:
+						case DW_TAG_enumerator:
+						case DW_TAG_formal_parameter:
+						case DW_TAG_unspecified_parameters:
+						case DW_TAG_subrange_type:
+							s << ',';
+							write_structural_key(s, i_c, depth - 1);
+							break;
+						default: break;
+					}
+				}
+				s << ')';
+			}
+			string structural_key(const iterator_df<type_die>& t)
+			{
+				std::ostringstream s;
+				write_structural_key(s, t, 3);
+				return s.str();
+			}
+		}
+
+		unsigned type_registry::add_root(root_die& r)
+		{
+			auto found = root_index.find(&r);
+			if (found != root_index.end()) return found->second;
+			unsigned n = roots.size();
+			roots.push_back(&r);
+			root_index.insert(make_pair(&r, n));
+			global_id_of_local.clear();
+			reps.assign(1, make_pair(0u, 0UL));
+			return n;
+		}
+
+		bool type_registry::build(unsigned nthreads)
+		{
+			global_id_of_local.clear();
+			reps.assign(1, make_pair(0u, 0UL));
+			if (roots.empty()) return false;
+			if (nthreads == 0) nthreads = std::max(1u, std::thread::hardware_concurrency());
+
+			/* An unfrozen root may call into libdwarf from anywhere, so we
+			 * can't build two roots' tables at once. Instead we build one
+			 * root at a time, each summarising its types with every thread
+			 * (and with itself frozen meanwhile; see compute_all_type_summaries()). */
+			unsigned n = roots.size();
+			for (unsigned i = 0; i < n; ++i)
+			{
+				bool ok;
+				try { ok = roots[i]->build_canonical_type_table(nthreads); }
+				catch (...) { ok = false; }
+				if (!ok) return false;
+			}
+
+			/* Merge. As in build_canonical_type_table(), but over the roots'
+			 * representatives. Two of one root's representatives are never
+			 * equal, so we only compare against other roots'. */
+			vector<vector<unsigned> > merged(n);
+			unordered_map<string, vector<unsigned> > by_key;
+			unsigned long n_compared = 0;
+			for (unsigned i_r = 0; i_r < n; ++i_r)
+			{
+				root_die& r = *roots[i_r];
+				merged[i_r].assign(r.canonical_type_count(), 0); // local 0 is global 0
+				for (unsigned local_id = 1; local_id < r.canonical_type_count(); ++local_id)
+				{
+					iterator_df<type_die> t = r.canonical_representative(local_id).as_a<type_die>();
+					vector<unsigned>& bucket = by_key[structural_key(t)];
+					unsigned id = 0;
+					for (auto i_id = bucket.begin(); i_id != bucket.end(); ++i_id)
+					{
+						if (reps[*i_id].first == i_r) continue;
+						++n_compared;
+						if (t->equal(representative(*i_id), {})) { id = *i_id; break; }
+					}
+					if (id == 0)
+					{
+						id = reps.size();
+						reps.push_back(make_pair(i_r, t.offset_here()));
+						bucket.push_back(id);
+					}
+					merged[i_r][local_id] = id;
+				}
+			}
+			global_id_of_local = std::move(merged);
+			debug(2) << "Built type registry of " << reps.size() - 1 << " global IDs over "
+				<< n << " roots, using " << n_compared << " cross-root comparisons" << endl;
+			return true;
+		}
+
+		opt<unsigned> type_registry::global_id(const iterator_df<type_die>& t) const
+		{
+			if (!is_built()) return opt<unsigned>();
+			if (!t) return opt<unsigned>(0);
+			auto found_root = root_index.find(&t.root());
+			if (found_root == root_index.end()) return opt<unsigned>();
+			opt<unsigned> local_id = roots[found_root->second]->canonical_id(t);
+			if (!local_id) return opt<unsigned>();
+			auto& local_to_global = global_id_of_local[found_root->second];
+			if (*local_id >= local_to_global.size()) return opt<unsigned>();
+			return local_to_global[*local_id];
+		}
+
+		iterator_df<type_die> type_registry::representative(unsigned id) const
+		{
+			if (id == 0 || id >= reps.size()) return iterator_base::END;
+			return roots[reps[id].first]->pos(reps[id].second).as_a<type_die>();
+		}
+	}
+}
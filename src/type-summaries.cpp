@@ -0,0 +1,246 @@
+/* dwarfpp: C++ binding for a useful subset of libdwarf, plus extra goodies.
+ *
+ * type-summaries.cpp: bulk, parallel computation of type summary codes
+ *
+ * Copyright (c) 2008--17, Stephen Kell. For licensing information, see the
+ * LICENSE file in the root of the libdwarfpp tree.
+ */
+
+#include <thread>
+#include <algorithm>
+#include <unordered_map>
+
+#include "dwarfpp/root.hpp"
+#include "dwarfpp/root-inl.hpp"
+#include "dwarfpp/iter.hpp"
+#include "dwarfpp/iter-inl.hpp"
+#include "dwarfpp/dies.hpp"
+#include "dwarfpp/dies-inl.hpp"
+
+namespace dwarf
+{
+	using std::endl;
+	using std::vector;
+	namespace core
+	{
+		namespace
+		{
+			const unsigned NONE = (unsigned) -1;
+
+			/* Tarjan's algorithm, without recursion since type graphs can be
+			 * deep. Components come out in reverse topological order, i.e.
+			 * each one after every component it depends on. */
+			vector<vector<unsigned> > find_sccs(const vector<vector<unsigned> >& deps)
+			{
+				unsigned n = deps.size();
+				vector<unsigned> index(n, NONE);
+				vector<unsigned> lowlink(n, 0);
+				vector<bool> on_stack(n, false);
+				vector<unsigned> stack;
+				vector<pair<unsigned, unsigned> > call_stack; // (node, next edge)
+				vector<vector<unsigned> > sccs;
+				unsigned next_index = 0;
+				auto visit = [&](unsigned v) {
+					index[v] = lowlink[v] = next_index++;
+					stack.push_back(v);
+					on_stack[v] = true;
+					call_stack.push_back(make_pair(v, 0u));
+				};
+				for (unsigned start = 0; start < n; ++start)
+				{
+					if (index[start] != NONE) continue;
+					visit(start);
+					while (!call_stack.empty())
+					{
+						unsigned v = call_stack.back().first;
+						if (call_stack.back().second < deps[v].size())
+						{
+							unsigned w = deps[v][call_stack.back().second++];
+							if (index[w] == NONE) visit(w);
+							else if (on_stack[w]) lowlink[v] = std::min(lowlink[v], index[w]);
+							continue;
+						}
+						call_stack.pop_back();
+						if (!call_stack.empty())
+						{
+							unsigned u = call_stack.back().first;
+							lowlink[u] = std::min(lowlink[u], lowlink[v]);
+						}
+						if (lowlink[v] == index[v])
+						{
+							sccs.push_back(vector<unsigned>());
+							unsigned w;
+							do
+							{
+								w = stack.back();
+								stack.pop_back();
+								on_stack[w] = false;
+								sccs.back().push_back(w);
+							} while (w != v);
+						}
+					}
+				}
+				return sccs;
+			}
+
+			/* Call f(i) for each i in [0, n), dealing them out round-robin to
+			 * up to nthreads threads. A worker that throws would terminate us,
+			 * so f must not throw. */
+			template <typename F>
+			void for_each_index_in_parallel(unsigned nthreads, unsigned n, F f)
+			{
+				unsigned nworkers = std::min(nthreads, n);
+				if (nworkers <= 1)
+				{
+					for (unsigned i = 0; i < n; ++i) f(i);
+					return;
+				}
+				vector<std::thread> workers;
+				for (unsigned w = 0; w < nworkers; ++w)
+				{
+					workers.push_back(std::thread([&f, w, n, nworkers]() {
+						for (unsigned i = w; i < n; i += nworkers) f(i);
+					}));
+				}
+				for (auto i_t = workers.begin(); i_t != workers.end(); ++i_t) i_t->join();
+			}
+		}
+
+		/* The summary code of a type depends on the codes of the types it
+		 * reaches by containment (see containment_summary_code), so
+		 * summary_code() recurses, and if the payloads don't stay live, it
+		 * recurses afresh every time. Instead we find every type's immediate
+		 * dependencies once, find the SCCs of that graph once, then hash
+		 * each level of the SCC DAG in parallel, bottom-up, so that every
+		 * recursive call is just a table lookup.
+		 *
+		 * The parallel parts run with the root frozen. Anything that lazily
+		 * caches into a shared payload (definitions of declarations, the CUs'
+		 * implicit base types) we warm up first, while still single-threaded.
+		 * The containment graph ought to be acyclic, since pointers are
+		 * summarised by abstract name; if we do find a cycle, its members
+		 * see one another as having no code, where summary_code() would have
+		 * recursed forever. */
+		bool compute_all_type_summaries(root_die& r, unsigned nthreads)
+		{
+			if (r.is_frozen()) return false; // we need to fill the root's cache
+			if (nthreads == 0) nthreads = std::max(1u, std::thread::hardware_concurrency());
+
+			/* Collect (and keep live) every type, warming caches as we go.
+			 * Types whose codes are cached already (say, from an incremental
+			 * index) are left out; depending on them is then a lookup. */
+			vector<root_die::ptr_type> types;
+			std::unordered_map<Dwarf_Off, unsigned> index_of;
+			for (iterator_df<> i = r.begin(); i != r.end(); ++i)
+			{
+				if (!i.is_a<type_die>()) continue;
+				if (r.type_summary_code_cache.find(i.offset_here()) != r.type_summary_code_cache.end()) continue;
+				iterator_df<type_die> t = i.as_a<type_die>();
+				index_of.insert(make_pair(t.offset_here(), (unsigned) types.size()));
+				types.push_back(root_die::ptr_type(&*t));
+				if (t.is_a<with_data_members_die>()) t->find_definition();
+				else if ((t.is_a<enumeration_type_die>() || t.is_a<subrange_type_die>())
+					&& !t->has_attr(DW_AT_type))
+				{
+					auto cu = t.enclosing_cu();
+					if (t.is_a<enumeration_type_die>()) cu->implicit_enum_base_type();
+					else cu->implicit_subrange_base_type();
+				}
+			}
+			unsigned n = types.size();
+			auto type_at = [&types](unsigned i) -> const type_die& {
+				return dynamic_cast<const type_die&>(*types[i]);
+			};
+
+			bool we_froze = false;
+			if (nthreads > 1)
+			{
+				if (!r.nav_complete && !r.have_dense_nav()) r.preload(nthreads);
+				we_froze = r.freeze();
+				if (!we_froze) nthreads = 1;
+			}
+
+			/* Find dependencies by running the summary computation with a
+			 * recursive call that just records its argument. */
+			vector<vector<unsigned> > deps(n);
+			for_each_index_in_parallel(nthreads, n, [&](unsigned i) {
+				try
+				{
+					type_at(i).containment_summary_code<uint32_t>(
+						[&deps, &index_of, i](iterator_df<type_die> t) -> opt<uint32_t> {
+							if (t)
+							{
+								auto found = index_of.find(t.offset_here());
+								if (found != index_of.end()) deps[i].push_back(found->second);
+							}
+							return opt<uint32_t>(0);
+						}
+					);
+				} catch (...) { deps[i].clear(); }
+			});
+
+			/* Level each SCC by its height in the DAG of SCCs. */
+			vector<vector<unsigned> > sccs = find_sccs(deps);
+			vector<unsigned> scc_of(n);
+			for (unsigned s = 0; s < sccs.size(); ++s)
+			{
+				for (auto i_m = sccs[s].begin(); i_m != sccs[s].end(); ++i_m) scc_of[*i_m] = s;
+			}
+			vector<vector<unsigned> > levels;
+			vector<unsigned> level_of(sccs.size(), 0);
+			for (unsigned s = 0; s < sccs.size(); ++s)
+			{
+				for (auto i_m = sccs[s].begin(); i_m != sccs[s].end(); ++i_m)
+				{
+					for (auto i_d = deps[*i_m].begin(); i_d != deps[*i_m].end(); ++i_d)
+					{
+						if (scc_of[*i_d] != s) level_of[s] = std::max(level_of[s],
+							level_of[scc_of[*i_d]] + 1);
+					}
+				}
+				if (level_of[s] >= levels.size()) levels.resize(level_of[s] + 1);
+				levels[level_of[s]].push_back(s);
+			}
+
+			/* Hash. One thread does a whole SCC, so "done" is only written
+			 * concurrently for entries that no other thread is reading. */
+			vector<opt<uint32_t> > codes(n);
+			vector<char> done(n, 0);
+			for (auto i_l = levels.begin(); i_l != levels.end(); ++i_l)
+			{
+				const vector<unsigned>& level = *i_l;
+				for_each_index_in_parallel(nthreads, level.size(), [&](unsigned k) {
+					const vector<unsigned>& scc = sccs[level[k]];
+					for (auto i_m = scc.begin(); i_m != scc.end(); ++i_m)
+					{
+						try
+						{
+							codes[*i_m] = type_at(*i_m).containment_summary_code<uint32_t>(
+								[&codes, &done, &index_of](iterator_df<type_die> t) -> opt<uint32_t> {
+									if (!t) return opt<uint32_t>(0);
+									auto found = index_of.find(t.offset_here());
+									if (found == index_of.end()) return summary_code_for_type(t);
+									if (done[found->second]) return codes[found->second];
+									return opt<uint32_t>(); // in our own (cyclic) SCC
+								}
+							);
+						} catch (...) { codes[*i_m] = opt<uint32_t>(); }
+						done[*i_m] = 1;
+					}
+				});
+			}
+			if (we_froze) r.thaw();
+
+			/* The payloads die with "types", so the root's cache is what lasts. */
+			for (unsigned i = 0; i < n; ++i)
+			{
+				type_at(i).cached_summary_code = codes[i];
+				r.type_summary_code_cache[types[i]->get_offset()] = codes[i];
+			}
+			debug(2) << "Computed summary codes for " << n << " types in "
+				<< sccs.size() << " SCCs over " << levels.size() << " levels using "
+				<< nthreads << " threads" << endl;
+			return true;
+		}
+	}
+}
@@ -0,0 +1,172 @@
+/* dwarfpp: C++ binding for a useful subset of libdwarf, plus extra goodies.
+ *
+ * unwind.cpp: stack unwinding over compiled call frame information
+ *
+ * Copyright (c) 2008--17, Stephen Kell. For licensing information, see the
+ * LICENSE file in the root of the libdwarfpp tree.
+ */
+
+#include <thread>
+#include <algorithm>
+#include <elf.h>
+
+#include "dwarfpp/unwind.hpp"
+#include "dwarfpp/regs.hpp"
+
+namespace dwarf
+{
+	using std::endl;
+	using std::vector;
+	namespace core
+	{
+		typedef FrameSection::register_def register_def;
+
+		void unwinder::init(const FrameSection& fs)
+		{
+			sp_regnum = dwarf_sp_regnum_for_elf_machine(fs.get_elf_machine());
+			auto i_cie = fs.cie_begin();
+			ra_regnum = (i_cie == fs.cie_end()) ? -1 : (int) (*i_cie).get_return_address_register_rule();
+			word_size = fs.get_address_size();
+			if (ra_regnum == -1 || !table.tracked_index(ra_regnum))
+			{
+				debug(0) << "Warning: CFI table does not track return address column "
+					<< ra_regnum << ", so we cannot unwind" << endl;
+			}
+		}
+
+		bool unwinder::eval_rule_expr(const cfi_table::rule& r, frame_regs& regs,
+			Dwarf_Addr cfa, bool push_cfa, Dwarf_Unsigned *out) const
+		{
+			try
+			{
+				expr::evaluator ev;
+				ev.reset(&regs, opt<Dwarf_Signed>(cfa));
+				if (push_cfa) ev.push(cfa);
+				ev.run(table.expr_for(r));
+				*out = ev.tos();
+				return true;
+			}
+			catch (No_entry) { return false; }
+			catch (expr::Not_supported) { return false; }
+		}
+
+		bool unwinder::step(frame_regs& regs, memory_reader& mem, bool innermost) const
+		{
+			if (ra_regnum == -1) return false;
+			const cfi_table::row *p_row = table.find_row(innermost ? regs.pc : regs.pc - 1);
+			if (!p_row) return false;
+
+			/* First the CFA. */
+			Dwarf_Unsigned cfa;
+			switch (p_row->cfa.k)
+			{
+				case register_def::REGISTER:
+					if (!regs.has(p_row->cfa.reg)) return false;
+					cfa = regs.vals[p_row->cfa.reg] + p_row->cfa.offset;
+					break;
+				case register_def::SAVED_AT_EXPR: // i.e. DW_CFA_def_cfa_expression
+					if (!eval_rule_expr(p_row->cfa, regs, 0, false, &cfa)) return false;
+					break;
+				default:
+					return false;
+			}
+
+			/* Then the tracked registers. */
+			frame_regs caller;
+			caller.cfa = cfa;
+			const vector<int>& tracked = table.tracked_regs;
+			for (unsigned i = 0; i < tracked.size(); ++i)
+			{
+				int regnum = tracked[i];
+				const cfi_table::rule& r = p_row->regs[i];
+				Dwarf_Unsigned val;
+				switch (r.k)
+				{
+					case register_def::INDETERMINATE:
+					case register_def::SAME_VALUE:
+						if (!regs.has(regnum)) continue;
+						val = regs.vals[regnum];
+						break;
+					case register_def::UNDEFINED:
+						continue;
+					case register_def::SAVED_AT_OFFSET_FROM_CFA:
+						if (!mem.read(cfa + r.offset, word_size, &val)) continue;
+						break;
+					case register_def::VAL_IS_OFFSET_FROM_CFA:
+						val = cfa + r.offset;
+						break;
+					case register_def::REGISTER:
+						if (!regs.has(r.reg)) continue;
+						val = regs.vals[r.reg];
+						break;
+					case register_def::SAVED_AT_EXPR: {
+						Dwarf_Unsigned addr;
+						if (!eval_rule_expr(r, regs, cfa, true, &addr)
+							|| !mem.read(addr, word_size, &val)) continue;
+					} break;
+					case register_def::VAL_OF_EXPR:
+						if (!eval_rule_expr(r, regs, cfa, true, &val)) continue;
+						break;
+					default:
+						continue;
+				}
+				caller.set(regnum, val);
+			}
+			if (sp_regnum != -1) caller.set(sp_regnum, cfa);
+
+			/* No return address means the outermost frame. So does a zero one,
+			 * by convention, and a frame that didn't move the stack would loop. */
+			if (!caller.has(ra_regnum) || caller.vals[ra_regnum] == 0) return false;
+			if (regs.cfa != 0 && cfa <= regs.cfa) return false;
+			caller.pc = caller.vals[ra_regnum];
+			regs = caller;
+			return true;
+		}
+
+		unsigned unwinder::unwind(const frame_regs& regs, memory_reader& mem,
+			vector<frame_regs>& out, unsigned max_frames) const
+		{
+			if (max_frames == 0) return 0;
+			frame_regs cur = regs;
+			out.push_back(cur);
+			unsigned n = 1;
+			while (n < max_frames && step(cur, mem, n == 1))
+			{
+				out.push_back(cur);
+				++n;
+			}
+			return n;
+		}
+
+		vector<vector<Dwarf_Addr> > unwinder::unwind_all(const vector<sample>& samples,
+			unsigned max_frames, unsigned nthreads) const
+		{
+			vector<vector<Dwarf_Addr> > results(samples.size());
+			if (nthreads == 0) nthreads = std::max(1u, std::thread::hardware_concurrency());
+			unsigned n = samples.size();
+			unsigned nworkers = std::min<unsigned>(nthreads, n);
+			/* The table is shared and read-only; each sample's results are
+			 * written by only one worker. */
+			auto work = [this, &samples, &results, max_frames, n](unsigned w, unsigned nworkers) {
+				for (unsigned i = w; i < n; i += nworkers)
+				{
+					const sample& s = samples[i];
+					vector<Dwarf_Addr>& pcs = results[i];
+					if (max_frames == 0 || !s.p_mem) continue;
+					frame_regs cur = s.regs;
+					pcs.push_back(cur.pc);
+					while (pcs.size() < max_frames && step(cur, *s.p_mem, pcs.size() == 1))
+					{
+						pcs.push_back(cur.pc);
+					}
+				}
+			};
+			if (nworkers <= 1) { work(0, 1); return results; }
+			vector<std::thread> workers;
+			for (unsigned w = 0; w < nworkers; ++w) workers.push_back(std::thread(work, w, nworkers));
+			for (auto i_t = workers.begin(); i_t != workers.end(); ++i_t) i_t->join();
+			debug(2) << "Unwound " << n << " samples using " << nworkers << " threads" << endl;
+			return results;
+		}
+	}
+}
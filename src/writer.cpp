@@ -0,0 +1,465 @@
+/* dwarfpp: C++ binding for a useful subset of libdwarf, plus extra goodies.
+ *
+ * writer.cpp: writing a root_die's DIEs back out as DWARF
+ *
+ * Copyright (c) 2008--17, Stephen Kell. For licensing information, see the
+ * LICENSE file in the root of the libdwarfpp tree.
+ */
+
+#include "dwarfpp/writer.hpp"
+#include "dwarfpp/leb128.hpp"
+
+namespace dwarf
+{
+	using std::endl;
+	using std::string;
+	namespace core
+	{
+		namespace
+		{
+			void write_fixed(string& out, Dwarf_Unsigned v, unsigned size)
+			{
+				for (unsigned i = 0; i < size; ++i) out += (char) ((v >> (8 * i)) & 0xff);
+			}
+			void patch_fixed(string& out, size_t pos, Dwarf_Unsigned v, unsigned size)
+			{
+				for (unsigned i = 0; i < size; ++i) out[pos + i] = (char) ((v >> (8 * i)) & 0xff);
+			}
+
+			/* Only the operand forms that the spec's op table uses. */
+			bool write_operand(string& out, int form, Dwarf_Unsigned v, unsigned addr_size)
+			{
+				switch (form)
+				{
+					case DW_FORM_addr: write_fixed(out, v, addr_size); return true;
+					case DW_FORM_data1: write_fixed(out, v, 1); return true;
+					case DW_FORM_data2: write_fixed(out, v, 2); return true;
+					case DW_FORM_data4: write_fixed(out, v, 4); return true;
+					case DW_FORM_data8: write_fixed(out, v, 8); return true;
+					case DW_FORM_udata: write_uleb128(out, v); return true;
+					case DW_FORM_sdata: write_sleb128(out, (Dwarf_Signed) v); return true;
+					default: return false;
+				}
+			}
+			bool write_expr(string& out, const encap::loc_expr& e, unsigned addr_size)
+			{
+				for (auto i = e.begin(); i != e.end(); ++i)
+				{
+					out += (char) i->lr_atom;
+					size_t n = e.spec.op_operand_count(i->lr_atom);
+					if (n == 0) continue;
+					const int *forms = e.spec.op_operand_form_list(i->lr_atom);
+					if (!write_operand(out, forms[0], i->lr_number, addr_size)) return false;
+					if (n > 1 && !write_operand(out, forms[1], i->lr_number2, addr_size)) return false;
+				}
+				return true;
+			}
+
+			/* These point into sections we don't write, or at DIEs that
+			 * won't be where they were. */
+			bool is_dropped_attr(Dwarf_Half attr)
+			{
+				switch (attr)
+				{
+					case DW_AT_sibling:
+					case DW_AT_macro_info:
+						return true;
+					default:
+						return false;
+				}
+			}
+		}
+
+		dwarf_writer::dwarf_writer(root_die& r, bool dedup_types)
+		 : p_root(&r), m_dedup_types(dedup_types), m_finished(false),
+		   m_stats((stats) { .n_units = 0, .n_dies = 0, .n_types_collapsed = 0,
+			.n_attrs_dropped = 0, .n_refs_unresolved = 0 })
+		{
+			if (m_dedup_types && !r.have_canonical_type_table()) r.build_canonical_type_table();
+		}
+
+		Dwarf_Off dwarf_writer::str_offset(const string& s)
+		{
+			auto inserted = str_offsets.insert(make_pair(s, (Dwarf_Off) m_str.size()));
+			if (inserted.second) { m_str += s; m_str += '\0'; }
+			return inserted.first->second;
+		}
+
+		opt<Dwarf_Off> dwarf_writer::line_offset(const iterator_base& cu, unsigned addr_size)
+		{
+			if (!cu.is_a<compile_unit_die>()) return opt<Dwarf_Off>();
+			shared_ptr<const line_table> p_t = cu.as_a<compile_unit_die>()->get_line_table();
+			if (!p_t) return opt<Dwarf_Off>();
+
+			/* Our files are the CU's, in its order but counting from 1 as
+			 * DWARF 4 does, so that decl_file and call_file carry over (see
+			 * write_die()). Any the rows name that the CU doesn't go after. */
+			std::vector<unsigned> files(p_t->files);
+			std::unordered_map<unsigned, unsigned> file_number;
+			for (unsigned j = 0; j < files.size(); ++j) file_number.insert(make_pair(files[j], j + 1));
+			for (auto i_r = p_t->rows.begin(); i_r != p_t->rows.end(); ++i_r)
+			{
+				if (file_number.insert(make_pair(i_r->file, files.size() + 1)).second) files.push_back(i_r->file);
+			}
+			string header;
+			write_fixed(header, 1, 1); // minimum_instruction_length
+			write_fixed(header, 1, 1); // maximum_operations_per_instruction
+			write_fixed(header, 1, 1); // default_is_stmt
+			header += (char) -5; // line_base, though we use no special opcodes
+			write_fixed(header, 14, 1); // line_range
+			write_fixed(header, 13, 1); // opcode_base
+			const char standard_opcode_lengths[] = { 0, 1, 1, 1, 1, 0, 0, 0, 1, 0, 0, 1 };
+			header.append(standard_opcode_lengths, sizeof standard_opcode_lengths);
+			header += '\0'; // no include_directories: our names are paths already
+			for (auto i_f = files.begin(); i_f != files.end(); ++i_f)
+			{
+				header += p_root->line_file_name(*i_f);
+				header += '\0';
+				write_uleb128(header, 0); // directory
+				write_uleb128(header, 0); // mtime
+				write_uleb128(header, 0); // length
+			}
+			header += '\0';
+
+			/* Each row is a copy, after whatever changed since the last. */
+			string prog;
+			Dwarf_Addr addr = 0;
+			unsigned file = 1;
+			unsigned line = 1;
+			unsigned column = 0;
+			bool is_stmt = true;
+			bool in_sequence = false;
+			for (auto i_r = p_t->rows.begin(); i_r != p_t->rows.end(); ++i_r)
+			{
+				if (!in_sequence)
+				{
+					prog += '\0';
+					write_uleb128(prog, 1 + addr_size);
+					prog += (char) DW_LNE_set_address;
+					write_fixed(prog, i_r->addr, addr_size);
+					addr = i_r->addr;
+					in_sequence = true;
+				}
+				else if (i_r->addr > addr)
+				{
+					prog += (char) DW_LNS_advance_pc;
+					write_uleb128(prog, i_r->addr - addr);
+					addr = i_r->addr;
+				}
+				if (i_r->end_sequence)
+				{
+					prog += '\0';
+					write_uleb128(prog, 1);
+					prog += (char) DW_LNE_end_sequence;
+					file = 1; line = 1; column = 0; is_stmt = true;
+					in_sequence = false;
+					continue;
+				}
+				unsigned f = file_number[i_r->file];
+				if (f != file) { prog += (char) DW_LNS_set_file; write_uleb128(prog, f); file = f; }
+				if (i_r->line != line)
+				{
+					prog += (char) DW_LNS_advance_line;
+					write_sleb128(prog, (long long) i_r->line - (long long) line);
+					line = i_r->line;
+				}
+				if (i_r->column != column)
+				{
+					prog += (char) DW_LNS_set_column;
+					write_uleb128(prog, i_r->column);
+					column = i_r->column;
+				}
+				if (i_r->is_stmt != is_stmt) { prog += (char) DW_LNS_negate_stmt; is_stmt = i_r->is_stmt; }
+				prog += (char) DW_LNS_copy;
+			}
+
+			Dwarf_Off off = m_line.size();
+			write_fixed(m_line, 0, 4); // unit_length, patched below
+			write_fixed(m_line, 4, 2); // version
+			write_fixed(m_line, header.size(), 4);
+			m_line += header;
+			m_line += prog;
+			patch_fixed(m_line, off, m_line.size() - off - 4, 4);
+			return off;
+		}
+
+		opt<Dwarf_Off> dwarf_writer::loc_offset(const encap::loclist& ll, unsigned addr_size)
+		{
+			auto found = loc_offsets.find(&ll);
+			if (found != loc_offsets.end()) return found->second;
+			Dwarf_Addr max_addr = (addr_size == 4) ? 0xffffffffULL : (Dwarf_Addr) -1;
+			string out;
+			for (auto i_e = ll.begin(); i_e != ll.end(); ++i_e)
+			{
+				if (i_e->lopc == max_addr || i_e->lopc == (Dwarf_Addr) -1) // base address selection
+				{
+					write_fixed(out, max_addr, addr_size);
+					write_fixed(out, i_e->hipc, addr_size);
+					continue;
+				}
+				// a default entry would read as the end of the list
+				if (i_e->lopc == 0 && i_e->hipc == 0) return opt<Dwarf_Off>();
+				string expr;
+				if (!write_expr(expr, *i_e, addr_size) || expr.size() > 0xffff) return opt<Dwarf_Off>();
+				write_fixed(out, i_e->lopc, addr_size);
+				write_fixed(out, i_e->hipc, addr_size);
+				write_fixed(out, expr.size(), 2);
+				out += expr;
+			}
+			write_fixed(out, 0, 2 * addr_size);
+			Dwarf_Off off = m_loc.size();
+			m_loc += out;
+			loc_offsets.insert(make_pair(&ll, off));
+			return off;
+		}
+
+		Dwarf_Off dwarf_writer::range_offset(const encap::rangelist& rl, unsigned addr_size)
+		{
+			auto found = range_offsets.find(&rl);
+			if (found != range_offsets.end()) return found->second;
+			Dwarf_Addr max_addr = (addr_size == 4) ? 0xffffffffULL : (Dwarf_Addr) -1;
+			Dwarf_Off off = m_ranges.size();
+			/* Our addresses are absolute, so first make the base zero. */
+			write_fixed(m_ranges, max_addr, addr_size);
+			write_fixed(m_ranges, 0, addr_size);
+			for (auto i_r = rl.begin(); i_r != rl.end(); ++i_r)
+			{
+				switch (i_r->dwr_type)
+				{
+					case DW_RANGES_ENTRY:
+						// an empty range would read as the end of the list
+						if (i_r->dwr_addr1 == i_r->dwr_addr2) continue;
+						write_fixed(m_ranges, i_r->dwr_addr1, addr_size);
+						write_fixed(m_ranges, i_r->dwr_addr2, addr_size);
+						break;
+					case DW_RANGES_ADDRESS_SELECTION:
+						write_fixed(m_ranges, max_addr, addr_size);
+						write_fixed(m_ranges, i_r->dwr_addr2, addr_size);
+						break;
+					default: // the end, which we write anyway
+						break;
+				}
+			}
+			write_fixed(m_ranges, 0, 2 * addr_size);
+			range_offsets.insert(make_pair(&rl, off));
+			return off;
+		}
+
+		bool dwarf_writer::collapse(const iterator_base& i)
+		{
+			if (!m_dedup_types) return false;
+			opt<unsigned> id = p_root->canonical_id(i);
+			if (!id || !*id) return false;
+			iterator_base rep = p_root->canonical_representative(*id);
+			if (!rep || rep.offset_here() == i.offset_here()) return false;
+			alias_subtree(i, rep);
+			++m_stats.n_types_collapsed;
+			return true;
+		}
+
+		void dwarf_writer::alias_subtree(const iterator_base& from, const iterator_base& to)
+		{
+			alias_of[from.offset_here()] = to.offset_here();
+			/* Children pair up as long as their tags do. Equal types have
+			 * the same members, but perhaps not the same everything else. */
+			auto from_children = from.children_here();
+			auto to_children = to.children_here();
+			auto i_to = std::move(to_children.first);
+			for (auto i_from = std::move(from_children.first);
+				i_from != from_children.second && i_to != to_children.second; ++i_from, ++i_to)
+			{
+				if (i_from.tag_here() != i_to.tag_here()) break;
+				alias_subtree(i_from, i_to);
+			}
+		}
+
+		void dwarf_writer::write_die(const iterator_base& i, unsigned addr_size)
+		{
+			out_offset_of[i.offset_here()] = m_info.size();
+			++m_stats.n_dies;
+			auto children = i.children_here();
+			bool has_children = children.first != children.second;
+			string abbrev;
+			write_uleb128(abbrev, i.tag_here());
+			abbrev += (char) (has_children ? DW_CHILDREN_yes : DW_CHILDREN_no);
+			string body;
+			std::vector<std::pair<size_t, Dwarf_Off> > body_fixups;
+			encap::attribute_map attrs = i.copy_attrs();
+			for (auto i_a = attrs.begin(); i_a != attrs.end(); ++i_a)
+			{
+				if (is_dropped_attr(i_a->first)) { ++m_stats.n_attrs_dropped; continue; }
+				const encap::attribute_value& v = i_a->second;
+				Dwarf_Half form;
+				if (i_a->first == DW_AT_stmt_list)
+				{
+					/* However it came, we write the unit's line program afresh. */
+					opt<Dwarf_Off> off = line_offset(i, addr_size);
+					if (!off) { ++m_stats.n_attrs_dropped; continue; }
+					form = DW_FORM_sec_offset;
+					write_fixed(body, *off, 4);
+				}
+				else if ((i_a->first == DW_AT_decl_file || i_a->first == DW_AT_call_file)
+					&& v.get_form() == encap::attribute_value::UNSIGNED)
+				{
+					/* Renumbered as line_offset() numbers the files. */
+					Dwarf_Unsigned base = i.enclosing_cu()->source_file_base();
+					form = DW_FORM_udata;
+					write_uleb128(body, (v.get_unsigned() >= base) ? v.get_unsigned() - base + 1 : 0);
+				}
+				else switch (v.get_form())
+				{
+					case encap::attribute_value::FLAG:
+						form = DW_FORM_flag;
+						body += (char) (v.get_flag() ? 1 : 0);
+						break;
+					case encap::attribute_value::ADDR:
+						form = DW_FORM_addr;
+						write_fixed(body, v.get_address().addr, addr_size);
+						break;
+					case encap::attribute_value::UNSIGNED:
+						form = DW_FORM_udata;
+						write_uleb128(body, v.get_unsigned());
+						break;
+					case encap::attribute_value::SIGNED:
+						form = DW_FORM_sdata;
+						write_sleb128(body, v.get_signed());
+						break;
+					case encap::attribute_value::STRING:
+						form = DW_FORM_strp;
+						write_fixed(body, str_offset(v.get_string()), 4);
+						break;
+					case encap::attribute_value::REF: {
+						form = DW_FORM_ref_addr;
+						const encap::attribute_value::weak_ref& ref = v.get_ref();
+						body_fixups.push_back(make_pair(body.size(),
+							ref.abs ? ref.off : i.enclosing_cu_offset_here() + ref.off));
+						write_fixed(body, 0, 4);
+					} break;
+					case encap::attribute_value::BLOCK:
+						form = DW_FORM_block;
+						write_uleb128(body, v.get_block()->size());
+						body.append(v.get_block()->begin(), v.get_block()->end());
+						break;
+					case encap::attribute_value::LOCLIST: {
+						/* A single expression for all vaddrs needs no .debug_loc. */
+						const encap::loclist& ll = v.get_loclist();
+						string expr;
+						if (ll.size() == 1 && ll[0].lopc == 0
+							&& (ll[0].hipc == 0 || ll[0].hipc == (Dwarf_Addr) -1)
+							&& write_expr(expr, ll[0], addr_size))
+						{
+							form = DW_FORM_exprloc;
+							write_uleb128(body, expr.size());
+							body += expr;
+							break;
+						}
+						opt<Dwarf_Off> off = loc_offset(ll, addr_size);
+						if (!off) { ++m_stats.n_attrs_dropped; continue; }
+						kept_lists.push_back(v);
+						form = DW_FORM_sec_offset;
+						write_fixed(body, *off, 4);
+					} break;
+					case encap::attribute_value::RANGELIST:
+						kept_lists.push_back(v);
+						form = DW_FORM_sec_offset;
+						write_fixed(body, range_offset(v.get_rangelist(), addr_size), 4);
+						break;
+					default:
+						++m_stats.n_attrs_dropped;
+						continue;
+				}
+				write_uleb128(abbrev, i_a->first);
+				write_uleb128(abbrev, form);
+			}
+
+			auto inserted = abbrev_codes.insert(make_pair(abbrev, abbrev_codes.size() + 1));
+			if (inserted.second)
+			{
+				write_uleb128(m_abbrev, inserted.first->second);
+				m_abbrev += abbrev;
+				m_abbrev += string(2, '\0');
+			}
+			write_uleb128(m_info, inserted.first->second);
+			size_t body_start = m_info.size();
+			m_info += body;
+			for (auto i_f = body_fixups.begin(); i_f != body_fixups.end(); ++i_f)
+			{
+				fixups.push_back(make_pair(body_start + i_f->first, i_f->second));
+			}
+			if (!has_children) return;
+			for (auto i_c = std::move(children.first); i_c != children.second; ++i_c)
+			{
+				if (!collapse(i_c)) write_die(i_c, addr_size);
+			}
+			m_info += '\0';
+		}
+
+		void dwarf_writer::write_unit(const iterator_base& cu)
+		{
+			assert(!m_finished);
+			auto i_cu = cu.as_a<compile_unit_die>();
+			assert(i_cu);
+			unsigned addr_size = i_cu->get_address_size();
+			size_t start = m_info.size();
+			write_fixed(m_info, 0, 4); // unit_length, patched below
+			write_fixed(m_info, 4, 2); // version
+			write_fixed(m_info, 0, 4); // debug_abbrev_offset: there's only one table
+			write_fixed(m_info, addr_size, 1);
+			write_die(cu, addr_size);
+			patch_fixed(m_info, start, m_info.size() - start - 4, 4);
+			++m_stats.n_units;
+		}
+
+		void dwarf_writer::write_all()
+		{
+			auto cus = p_root->begin().children_here();
+			for (auto i_cu = std::move(cus.first); i_cu != cus.second; ++i_cu)
+			{
+				write_unit(i_cu);
+			}
+		}
+
+		opt<Dwarf_Off> dwarf_writer::resolve(Dwarf_Off target) const
+		{
+			/* Aliases only ever go to lower offsets, but bound it anyway. */
+			for (unsigned n = 0; n < 64; ++n)
+			{
+				auto found = out_offset_of.find(target);
+				if (found != out_offset_of.end()) return found->second;
+				auto found_alias = alias_of.find(target);
+				if (found_alias == alias_of.end()) break;
+				target = found_alias->second;
+			}
+			return opt<Dwarf_Off>();
+		}
+
+		bool dwarf_writer::finish()
+		{
+			if (!m_finished)
+			{
+				m_abbrev += '\0'; // end of the table
+				m_finished = true;
+			}
+			unsigned long n_unresolved = 0;
+			for (auto i_f = fixups.begin(); i_f != fixups.end(); ++i_f)
+			{
+				opt<Dwarf_Off> out_off = resolve(i_f->second);
+				if (out_off) patch_fixed(m_info, i_f->first, *out_off, 4);
+				else
+				{
+					debug(2) << "Writer could not resolve reference to 0x"
+						<< std::hex << i_f->second << std::dec << endl;
+					++n_unresolved;
+				}
+			}
+			fixups.clear();
+			m_stats.n_refs_unresolved += n_unresolved;
+			debug(2) << "Wrote " << m_stats.n_dies << " DIEs in " << m_stats.n_units << " units ("
+				<< m_info.size() << " bytes of info, " << abbrev_codes.size() << " abbrevs, "
+				<< m_str.size() << " bytes of strings, " << m_line.size() << " of lines, "
+				<< m_loc.size() << " of locations, " << m_ranges.size() << " of ranges), collapsing " << m_stats.n_types_collapsed
+				<< " types and dropping " << m_stats.n_attrs_dropped << " attributes" << endl;
+			return n_unresolved == 0;
+		}
+	}
+}
@@ -0,0 +1,88 @@
+#undef NDEBUG // assert is part of our logic
+#include <fstream>
+#include <fileno.hpp>
+#include <dwarfpp/lib.hpp>
+#include <dwarfpp/attr.hpp>
+
+using std::cout;
+using std::endl;
+using namespace dwarf;
+using namespace dwarf::core;
+
+static encap::attribute_map& attrs_of(iterator_base& i)
+{ return dynamic_cast<in_memory_abstract_die&>(i.dereference()).attrs(); }
+
+int main(int argc, char **argv)
+{
+	// using our own debug info...
+	std::ifstream in(argv[0]);
+	assert(in);
+	root_die r(fileno(in));
+	bool built = r.build_addr_index();
+	assert(built);
+
+	/* Every subprogram's entry point should map to that subprogram, or to
+	 * something (a lexical block) underneath it. */
+	unsigned count = 0;
+	for (auto i = r.begin(); i != r.end(); ++i)
+	{
+		if (i.tag_here() != DW_TAG_subprogram) continue;
+		if (!i.has_attr(DW_AT_low_pc) || !i.has_attr(DW_AT_high_pc)) continue;
+		Dwarf_Addr low_pc = i.attr(DW_AT_low_pc).get_address().addr;
+		auto high_pc = i.attr(DW_AT_high_pc);
+		if (high_pc.get_form() == encap::attribute_value::ADDR
+			? high_pc.get_address().addr == low_pc
+			: high_pc.get_unsigned() == 0) continue;
+		auto found = r.innermost_die_for_pc(low_pc);
+		assert(found);
+		assert(found.depth() >= i.depth());
+		while (found.depth() > i.depth()) found = found.parent();
+		assert(found.offset_here() == i.offset_here());
+		++count;
+
+		/* Just before it is not us (either nothing, or something else). */
+		auto before = r.innermost_die_for_pc(low_pc - 1);
+		assert(!before || before.offset_here() != i.offset_here());
+	}
+	cout << "Looked up " << count << " subprograms by address" << endl;
+	assert(!r.innermost_die_for_pc(0));
+
+	/* Frozen, a cleared index stays cleared: lookups don't build it. */
+	r.clear_addr_index();
+	assert(!r.have_addr_index());
+	bool preloaded = r.preload();
+	assert(preloaded);
+	bool froze = r.freeze();
+	assert(froze);
+	r.innermost_die_for_pc(0);
+	assert(!r.have_addr_index());
+	r.thaw();
+
+	/* A new block inside a subprogram is found once it's added. */
+	in_memory_root_die m(fileno(in));
+	bool m_built = m.build_addr_index();
+	assert(m_built);
+	iterator_base sub = m.end();
+	Dwarf_Addr lo = 0, hi = 0;
+	for (auto i = m.begin(); i != m.end(); ++i)
+	{
+		if (i.tag_here() != DW_TAG_subprogram) continue;
+		if (!i.has_attr(DW_AT_low_pc) || !i.has_attr(DW_AT_high_pc)) continue;
+		auto high_pc = i.attr(DW_AT_high_pc);
+		if (high_pc.get_form() == encap::attribute_value::ADDR) continue;
+		if (high_pc.get_unsigned() < 4) continue;
+		lo = i.attr(DW_AT_low_pc).get_address().addr;
+		hi = lo + high_pc.get_unsigned();
+		sub = i;
+		break;
+	}
+	assert(sub != m.end());
+	assert(m.have_addr_index());
+	auto block = m.make_new(sub, DW_TAG_lexical_block);
+	attrs_of(block).insert(make_pair(DW_AT_low_pc, encap::attribute_value(encap::attribute_value::address(lo + 1))));
+	attrs_of(block).insert(make_pair(DW_AT_high_pc, encap::attribute_value((Dwarf_Unsigned) (hi - lo - 2))));
+	assert(!m.have_addr_index());
+	assert(m.innermost_die_for_pc(lo + 1).offset_here() == block.offset_here());
+	assert(m.innermost_die_for_pc(lo).offset_here() != block.offset_here());
+	return 0;
+}
@@ -0,0 +1,60 @@
+#undef NDEBUG // assert is part of our logic
+#include <iostream>
+#include <cstring>
+#include <dwarfpp/lib.hpp>
+#include <dwarfpp/regs.hpp>
+
+using std::cout;
+using std::endl;
+using namespace dwarf;
+using namespace dwarf::lib;
+
+/* The maps are compile-time, holes and all. */
+static_assert(arch_x86_64::slot_of(DWARF_X86_64_RSP) == DWARF_X86_64_RSP, "x86-64 rsp");
+static_assert(arch_x86_64::slot_of(DWARF_X86_64_RIP + 1) == -1, "x86-64 has no slot past rip");
+static_assert(arch_aarch64::slot_of(DWARF_AARCH64_V0 + 8) == DWARF_AARCH64_PC + 9, "AArch64 d8");
+static_assert(arch_aarch64::slot_of(DWARF_AARCH64_PC + 1) == -1, "AArch64 gap after the pc");
+static_assert(arch_riscv::slot_of(DWARF_RISCV_F31) == arch_riscv::NSLOTS - 1, "RISC-V f31");
+
+template <typename Regs>
+static void check_evaluation(Regs& rs, int regnum)
+{
+	rs.set(regnum, 0x1000);
+	Dwarf_Unsigned code[] = { (Dwarf_Unsigned) DW_OP_breg0 + regnum, 16 };
+	expr::compiled_expr e(encap::loc_expr(code, 0, 0));
+	assert(e.kind == expr::compiled_expr::BREG);
+	assert(e.eval_with(rs) == 0x1010);
+	assert(e.eval_with(rs) == e.eval(&rs));
+	rs.clear(regnum);
+	try { e.eval_with(rs); assert(false); } catch (No_entry) {}
+}
+
+int main(int argc, char **argv)
+{
+	x86_64_regs x;
+	aarch64_regs a;
+	riscv_regs r;
+	check_evaluation(x, arch_x86_64::SP);
+	check_evaluation(a, arch_aarch64::SP);
+	check_evaluation(r, arch_riscv::SP);
+
+	a.set<DWARF_AARCH64_V0 + 8>(42);
+	assert(a.has(DWARF_AARCH64_V0 + 8) && a.get(DWARF_AARCH64_V0 + 8) == 42);
+	assert(!a.has(DWARF_AARCH64_V0 + 9));
+	try { a.set(DWARF_AARCH64_PC + 1, 0); assert(false); } catch (No_entry) {}
+
+	/* The run-time lookups agree with the compile-time ones. */
+	const int machines[] = { arch_x86_64::ELF_MACHINE, arch_aarch64::ELF_MACHINE, arch_riscv::ELF_MACHINE };
+	const int sps[] = { arch_x86_64::SP, arch_aarch64::SP, arch_riscv::SP };
+	const char *sp_names[] = { "rsp", "sp", "sp" };
+	for (unsigned i = 0; i < 3; ++i)
+	{
+		assert(dwarf_sp_regnum_for_elf_machine(machines[i]) == sps[i]);
+		const char **names = dwarf_regnames_for_elf_machine(machines[i]);
+		assert(names && 0 == strcmp(names[sps[i]], sp_names[i]));
+		cout << "Machine " << machines[i] << " has its stack pointer in DWARF register "
+			<< sps[i] << endl;
+	}
+	assert(dwarf_sp_regnum_for_elf_machine(0) == -1);
+	return 0;
+}
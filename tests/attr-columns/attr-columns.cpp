@@ -0,0 +1,68 @@
+#undef NDEBUG // assert is part of our logic
+#include <fstream>
+#include <fileno.hpp>
+#include <dwarfpp/lib.hpp>
+
+using std::cout;
+using std::endl;
+using std::vector;
+using namespace dwarf;
+
+int main(int argc, char **argv)
+{
+	using namespace dwarf::core;
+
+	// using our own debug info...
+	std::ifstream in(argv[0]);
+	assert(in);
+	root_die r(fileno(in), root_die::MAP_FILE);
+
+	vector<Dwarf_Half> tags = { DW_TAG_structure_type };
+	vector<Dwarf_Half> attrs = { DW_AT_name, DW_AT_byte_size, DW_AT_declaration };
+	attr_columns c;
+	bool ok = r.extract(tags, attrs, c);
+	assert(ok);
+	assert(!c.dies.empty() && c.tags.size() == c.dies.size());
+	assert(std::is_sorted(c.dies.begin(), c.dies.end()));
+	assert(c.columns.size() == 3 && !c.column_for(DW_AT_type));
+	const attr_columns::column& names = *c.column_for(DW_AT_name);
+	const attr_columns::column& sizes = *c.column_for(DW_AT_byte_size);
+	const attr_columns::column& decls = *c.column_for(DW_AT_declaration);
+	assert(names.kinds.size() == c.dies.size() && sizes.values.size() == c.dies.size());
+
+	/* It agrees with a walk, row for row. */
+	unsigned n_structs = 0;
+	for (iterator_df<> i = r.begin(); i != r.end(); ++i)
+	{
+		if (i.tag_here() != DW_TAG_structure_type) continue;
+		++n_structs;
+		unsigned row = c.row_of(i.offset_here());
+		assert(row != attr_columns::NONE && c.tags[row] == DW_TAG_structure_type);
+		auto name = i.name_here();
+		assert((names.kinds[row] == attr_columns::STRING) == (bool) name);
+		if (name) assert(r.get_name_interner().name(names.values[row]) == *name);
+		auto size = i.as_a<structure_type_die>()->get_byte_size();
+		assert((sizes.kinds[row] != attr_columns::ABSENT) == (bool) size);
+		if (size) assert(sizes.kinds[row] == attr_columns::CONSTANT && sizes.values[row] == *size);
+		auto decl = i.as_a<structure_type_die>()->get_declaration();
+		assert((decls.kinds[row] == attr_columns::FLAG) == (bool) decl);
+		if (decl) assert((bool) decls.values[row] == *decl);
+	}
+	assert(n_structs == c.dies.size());
+
+	/* The same columns however many threads make them; no tags means
+	 * every DIE. */
+	attr_columns c1;
+	ok = r.extract(tags, attrs, c1, 1);
+	assert(ok && c1.dies == c.dies && c1.columns[0].values == c.columns[0].values);
+	attr_columns all;
+	ok = r.extract(vector<Dwarf_Half>(), { DW_AT_name }, all);
+	assert(ok && all.dies.size() > c.dies.size() && all.row_of(c.dies[0]) != attr_columns::NONE);
+	cout << "Extracted " << c.dies.size() << " structure types, of "
+		<< all.dies.size() << " DIEs" << endl;
+
+	/* Without an image, there's nothing to decode. */
+	root_die libdwarf_root(fileno(in));
+	assert(!libdwarf_root.extract(tags, attrs, c));
+	return 0;
+}
@@ -0,0 +1,74 @@
+#undef NDEBUG // assert is part of our logic
+#include <fstream>
+#include <fileno.hpp>
+#include <dwarfpp/lib.hpp>
+#include <dwarfpp/attr.hpp>
+#include <dwarfpp/frame.hpp>
+
+using std::cout;
+using std::endl;
+using namespace dwarf;
+using namespace dwarf::core;
+
+static encap::attribute_map& attrs_of(iterator_base& i)
+{ return dynamic_cast<in_memory_abstract_die&>(i.dereference()).attrs(); }
+
+int main(int argc, char **argv)
+{
+	// using our own frame info...
+	std::ifstream in(argv[0]);
+	assert(in);
+	in_memory_root_die r(fileno(in));
+
+	/* Find a pc whose CFA is a register plus an offset, as at most
+	 * function entries. */
+	auto& fs = r.get_frame_section();
+	Dwarf_Addr pc = 0;
+	int cfa_reg = -1;
+	int cfa_off = 0;
+	for (auto i_fde = fs.fde_begin(); i_fde != fs.fde_end() && cfa_reg == -1; ++i_fde)
+	{
+		auto p_decoded = i_fde->decoded();
+		auto p_row = p_decoded->find_row(i_fde->get_low_pc());
+		if (!p_row) continue;
+		auto p_cfa = p_decoded->find_rule(*p_row, DW_FRAME_CFA_COL3);
+		if (p_cfa && p_cfa->k == FrameSection::register_def::REGISTER)
+		{
+			pc = i_fde->get_low_pc();
+			cfa_reg = p_cfa->u.reg_plus_offset.reg;
+			cfa_off = p_cfa->u.reg_plus_offset.offset;
+		}
+	}
+	assert(cfa_reg >= 0 && cfa_reg < 32);
+
+	/* A local 16 bytes above that register, there. The synthetic CU
+	 * has no low_pc, so CU-relative is file-relative. */
+	auto cu = r.get_or_create_synthetic_cu();
+	auto var = r.make_new(cu, DW_TAG_variable);
+	encap::loc_expr e((Dwarf_Unsigned[]) { (Dwarf_Unsigned) (DW_OP_breg0 + cfa_reg), 16 }, pc, pc + 1);
+	attrs_of(var).insert(make_pair(DW_AT_location, encap::attribute_value(encap::loclist(e))));
+	auto i_var = var.as_a<with_dynamic_location_die>();
+	assert(i_var);
+
+	/* With no registers, we go via the CFA, i.e. the frame base. */
+	const Dwarf_Addr frame_base = 0x7ffe1000;
+	Dwarf_Addr addr = i_var->calculate_addr_on_stack(frame_base, r, pc);
+	assert(addr == frame_base - cfa_off + 16);
+
+	/* With them, we read the register. */
+	struct fake_regs : public expr::regs
+	{
+		Dwarf_Signed get(int regnum) { return 0x10000 * (regnum + 1); }
+	} regs;
+	addr = i_var->calculate_addr_on_stack(frame_base, r, pc, &regs);
+	assert(addr == (Dwarf_Addr) (0x10000 * (cfa_reg + 1) + 16));
+
+	/* An edit to the location is what we evaluate next time. */
+	attrs_of(var).erase(DW_AT_location);
+	encap::loc_expr e2((Dwarf_Unsigned[]) { (Dwarf_Unsigned) (DW_OP_breg0 + cfa_reg), 32 }, pc, pc + 1);
+	attrs_of(var).insert(make_pair(DW_AT_location, encap::attribute_value(encap::loclist(e2))));
+	addr = i_var->calculate_addr_on_stack(frame_base, r, pc, &regs);
+	assert(addr == (Dwarf_Addr) (0x10000 * (cfa_reg + 1) + 32));
+	cout << "breg" << cfa_reg << " local is at CFA" << std::showpos << (16 - cfa_off) << endl;
+	return 0;
+}
@@ -0,0 +1,74 @@
+#undef NDEBUG // assert is part of our logic
+#include <fstream>
+#include <vector>
+#include <algorithm>
+#include <fileno.hpp>
+#include <dwarfpp/lib.hpp>
+
+using std::cout;
+using std::endl;
+using std::vector;
+using std::pair;
+using std::make_pair;
+using namespace dwarf;
+
+int main(int argc, char **argv)
+{
+	using namespace dwarf::core;
+
+	// using our own debug info...
+	std::ifstream in(argv[0]);
+	assert(in);
+	root_die r(fileno(in));
+
+	/* No budget by default: a walk just fills the caches. */
+	assert(r.get_cache_budget() == 0);
+	vector<pair<Dwarf_Off, Dwarf_Half> > seen;
+	for (auto i = r.begin(); i != r.end(); ++i) seen.push_back(make_pair(i.offset_here(), i.tag_here()));
+	size_t unbounded = r.get_cache_usage().total();
+	cout << "Walked " << seen.size() << " DIEs with " << unbounded << " bytes of caches" << endl;
+	assert(r.enforce_cache_budget());
+	assert(r.get_cache_usage().total() == unbounded);
+
+	/* A tenth of that is met once we enforce it. */
+	size_t budget = unbounded / 10;
+	r.set_cache_budget(budget);
+	assert(r.get_cache_budget() == budget);
+	cout << "After eviction, " << r.get_cache_usage().total() << " bytes" << endl;
+	assert(r.get_cache_usage().total() <= budget);
+
+	/* Walking again gives the same DIEs, and stays near budget (we only
+	 * check every so many insertions). */
+	unsigned long downwards_before = r.stats().find_downwards_calls;
+	unsigned n = 0;
+	for (auto i = r.begin(); i != r.end(); ++i, ++n)
+	{
+		assert(n < seen.size());
+		assert(i.offset_here() == seen[n].first);
+		assert(i.tag_here() == seen[n].second);
+	}
+	assert(n == seen.size());
+	bool ok = r.enforce_cache_budget();
+	assert(ok);
+	assert(r.get_cache_usage().total() <= budget);
+	/* Evicted parents come back from their CU, not a search from the root. */
+	assert(r.stats().find_downwards_calls == downwards_before);
+
+	/* A breadth-first walk, evicting as hard as we can every so often,
+	 * sees every DIE still: its queued positions are pinned. */
+	vector<Dwarf_Off> bf_seen;
+	for (iterator_bf<> i = r.begin(); i != r.end(); ++i)
+	{
+		bf_seen.push_back(i.offset_here());
+		if (bf_seen.size() % 256 == 0) r.enforce_cache_budget();
+	}
+	std::sort(bf_seen.begin(), bf_seen.end());
+	assert(bf_seen.size() == seen.size());
+	for (unsigned i = 0; i < seen.size(); ++i) assert(bf_seen[i] == seen[i].first);
+
+	/* Lifting the budget lets the caches grow again. */
+	r.set_cache_budget(0);
+	for (auto i = r.begin(); i != r.end(); ++i);
+	assert(r.get_cache_usage().total() > budget);
+	return 0;
+}
@@ -0,0 +1,148 @@
+#undef NDEBUG // assert is part of our logic
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <cstring>
+#include <unistd.h>
+#include <fileno.hpp>
+#include <dwarfpp/lib.hpp>
+#include <dwarfpp/frame.hpp>
+
+using std::cout;
+using std::endl;
+using std::vector;
+using std::string;
+using namespace dwarf;
+using dwarf::core::FrameSection;
+using dwarf::core::cfi_table;
+typedef FrameSection::register_def register_def;
+
+/* Does the table's rule say what the decoded one (null if indeterminate) does? */
+static bool same_rule(const cfi_table& t, const cfi_table::rule& r, const FrameSection::compact_rule *p)
+{
+	if (!p) return r.k == register_def::INDETERMINATE;
+	if (r.k != p->k) return false;
+	switch (p->k)
+	{
+		case register_def::SAVED_AT_OFFSET_FROM_CFA:
+		case register_def::VAL_IS_OFFSET_FROM_CFA:
+			return r.offset == p->u.offset;
+		case register_def::REGISTER:
+			return r.reg == p->u.reg_plus_offset.reg && r.offset == p->u.reg_plus_offset.offset;
+		case register_def::SAVED_AT_EXPR:
+		case register_def::VAL_OF_EXPR:
+			return r.offset >= 0 && (unsigned) r.offset < t.exprs.size()
+				&& t.expr_for(r).size() > 0;
+		default:
+			return true;
+	}
+}
+
+int main(int argc, char **argv)
+{
+	using namespace dwarf::core;
+
+	// using our own .eh_frame...
+	std::ifstream in(argv[0]);
+	assert(in);
+	root_die r(fileno(in));
+	FrameSection fs(r.get_dbg(), true);
+	cfi_table t(fs);
+	assert(t.rows.size() > 0);
+	assert(t.tracked_regs == cfi_table::default_tracked_regs(fs));
+
+	/* Where FDEs overlap, one wins, so we only check those that don't. */
+	vector<std::pair<Dwarf_Addr, Dwarf_Addr> > ranges;
+	for (auto i_fde = fs.fde_begin(); i_fde != fs.fde_end(); ++i_fde)
+	{
+		if (i_fde->get_func_length() == 0) continue;
+		ranges.push_back(std::make_pair(i_fde->get_low_pc(),
+			i_fde->get_low_pc() + i_fde->get_func_length()));
+	}
+	std::sort(ranges.begin(), ranges.end());
+	auto overlaps = [&ranges](Dwarf_Addr lo, Dwarf_Addr hi) {
+		unsigned n = 0;
+		for (auto i_r = ranges.begin(); i_r != ranges.end() && i_r->first < hi; ++i_r)
+		{
+			if (i_r->second > lo) ++n;
+		}
+		return n > 1;
+	};
+
+	/* Every decoded row's rules for the CFA and the tracked registers are
+	 * the table's at the row's first and last pc, and the rest are counted. */
+	unsigned n_checked = 0;
+	unsigned n_lossy = 0;
+	for (auto i_fde = fs.fde_begin(); i_fde != fs.fde_end(); ++i_fde)
+	{
+		if (i_fde->get_func_length() == 0) continue;
+		Dwarf_Addr lo = i_fde->get_low_pc();
+		Dwarf_Addr hi = lo + i_fde->get_func_length();
+		if (overlaps(lo, hi)) continue;
+		auto p_decoded = i_fde->decoded();
+		const FrameSection::instrs_results& d = *p_decoded;
+		for (auto i_row = d.rows.begin(); i_row != d.rows.end() && i_row->lo < hi; ++i_row)
+		{
+			Dwarf_Addr pcs[] = { i_row->lo, std::min(i_row->hi, hi) - 1 };
+			for (unsigned i = 0; i < 2; ++i)
+			{
+				const cfi_table::row *p_row = t.find_row(pcs[i]);
+				assert(p_row);
+				assert(p_row->pc <= pcs[i]);
+				assert(same_rule(t, p_row->cfa, d.find_rule(*i_row, DW_FRAME_CFA_COL3)));
+				for (unsigned j = 0; j < t.tracked_regs.size(); ++j)
+				{
+					assert(same_rule(t, p_row->regs[j], d.find_rule(*i_row, t.tracked_regs[j])));
+				}
+				unsigned n_untracked = 0;
+				for (auto i_rule = d.rules_begin(*i_row); i_rule != d.rules_end(*i_row); ++i_rule)
+				{
+					if (i_rule->regnum != DW_FRAME_CFA_COL3 && !t.tracked_index(i_rule->regnum)
+						&& i_rule->k != register_def::INDETERMINATE) ++n_untracked;
+				}
+				assert(p_row->n_untracked == n_untracked);
+				if (n_untracked > 0) ++n_lossy;
+			}
+			++n_checked;
+		}
+	}
+	assert(n_checked > 0);
+	cout << "Checked " << n_checked << " decoded rows against " << t.rows.size()
+		<< " table rows (" << n_lossy << " lookups dropped untracked rules)" << endl;
+
+	/* Saving and loading gives the same table, but only for this binary. */
+	std::ostringstream s;
+	s << "/tmp/cfi-table-test." << getpid();
+	string filename = s.str();
+	if (!t.save(filename))
+	{
+		assert(!t.build_id);
+		cout << "No build-id, so not testing save and load" << endl;
+		return 0;
+	}
+	cfi_table loaded;
+	assert(loaded.load(filename, fs));
+	assert(loaded.build_id == t.build_id);
+	assert(loaded.tracked_regs == t.tracked_regs);
+	assert(loaded.rows.size() == t.rows.size());
+	assert(0 == memcmp(loaded.rows.data(), t.rows.data(), t.rows.size() * sizeof (cfi_table::row)));
+	assert(loaded.exprs.size() == t.exprs.size());
+
+	/* A truncated file is refused... */
+	std::ifstream whole(filename, std::ios::binary);
+	string bytes((std::istreambuf_iterator<char>(whole)), std::istreambuf_iterator<char>());
+	{
+		std::ofstream out(filename, std::ios::binary | std::ios::trunc);
+		out.write(bytes.data(), bytes.size() - 1);
+	}
+	cfi_table truncated;
+	assert(!truncated.load(filename, fs));
+	/* ... and so is a table for some other build. */
+	cfi_table other = t;
+	other.build_id = string(t.build_id->size(), '0');
+	assert(other.save(filename));
+	cfi_table foreign;
+	assert(!foreign.load(filename, fs));
+	unlink(filename.c_str());
+	return 0;
+}
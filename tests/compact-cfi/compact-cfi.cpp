@@ -0,0 +1,67 @@
+#undef NDEBUG // assert is part of our logic
+#include <fstream>
+#include <algorithm>
+#include <fileno.hpp>
+#include <dwarfpp/lib.hpp>
+#include <dwarfpp/frame.hpp>
+
+using std::cout;
+using std::endl;
+using namespace dwarf;
+using dwarf::core::FrameSection;
+
+int main(int argc, char **argv)
+{
+	using namespace dwarf::core;
+
+	// using our own .eh_frame...
+	std::ifstream in(argv[0]);
+	assert(in);
+	root_die r(fileno(in));
+	FrameSection fs(r.get_dbg(), true);
+	assert(sizeof (FrameSection::compact_rule) == 16);
+
+	/* Decoded rows are sorted, disjoint and joined where they can be;
+	 * each row's rules are sorted, and lookups agree with a scan. */
+	unsigned n_rows = 0;
+	size_t bytes = 0;
+	for (auto i_fde = fs.fde_begin(); i_fde != fs.fde_end(); ++i_fde)
+	{
+		auto p_decoded = i_fde->decoded();
+		const FrameSection::instrs_results& d = *p_decoded;
+		bytes += d.rows.size() * sizeof (FrameSection::instrs_results::row)
+			+ d.rules.size() * sizeof (FrameSection::compact_rule);
+		for (auto i_row = d.rows.begin(); i_row != d.rows.end(); ++i_row, ++n_rows)
+		{
+			assert(i_row->lo < i_row->hi);
+			assert(i_row->n_rules > 0);
+			assert(i_row->first_rule + i_row->n_rules <= d.rules.size());
+			if (i_row != d.rows.begin())
+			{
+				auto& prev = *(i_row - 1);
+				assert(prev.hi <= i_row->lo);
+				assert(!(prev.hi == i_row->lo && prev.n_rules == i_row->n_rules
+					&& std::equal(d.rules_begin(prev), d.rules_end(prev), d.rules_begin(*i_row))));
+			}
+			assert(d.find_row(i_row->lo) == &*i_row);
+			assert(d.find_row(i_row->hi - 1) == &*i_row);
+			for (auto i_rule = d.rules_begin(*i_row); i_rule != d.rules_end(*i_row); ++i_rule)
+			{
+				if (i_rule != d.rules_begin(*i_row)) assert((i_rule - 1)->regnum < i_rule->regnum);
+				auto p_found = d.find_rule(*i_row, i_rule->regnum);
+				if (i_rule->k == FrameSection::register_def::INDETERMINATE) assert(!p_found);
+				else assert(p_found == i_rule);
+				/* Expanding gives the rule's own kind, and its expression. */
+				auto def = i_rule->expand(r.get_dbg().raw_handle());
+				assert(def.k == i_rule->k);
+				if (def.k == FrameSection::register_def::SAVED_AT_EXPR)
+				{
+					assert(def.saved_at_expr_r().size() > 0);
+				}
+			}
+		}
+	}
+	assert(n_rows > 0);
+	cout << "Checked " << n_rows << " rows, " << bytes << " bytes decoded" << endl;
+	return 0;
+}
@@ -0,0 +1,41 @@
+#undef NDEBUG // assert is part of our logic
+#include <sstream>
+#include <dwarfpp/lib.hpp>
+
+using std::cout;
+using std::endl;
+using namespace dwarf::core;
+
+static unsigned n_evaluated;
+static int counted() { ++n_evaluated; return 42; }
+
+int main(int argc, char **argv)
+{
+	/* Disabled messages evaluate nothing. */
+	debug_level = 0;
+	debug_expensive(1, << "value " << counted() << endl);
+	debug_sampled(1, 10, << "value " << counted() << endl);
+	assert(n_evaluated == 0);
+
+#if DWARFPP_DEBUG_MAX_LEVEL >= 1
+	/* Enabled ones do... */
+	debug_level = 1;
+	std::streambuf *p_old = std::cerr.rdbuf();
+	std::ostringstream captured;
+	std::cerr.rdbuf(captured.rdbuf());
+	debug_expensive(1, << "value " << counted() << endl);
+	assert(n_evaluated == 1);
+	debug_expensive(2, << "value " << counted() << endl);
+	assert(n_evaluated == 1);
+
+	/* ... but sampled ones only once in each `every'. */
+	for (unsigned i = 0; i < 25; ++i) debug_sampled(1, 10, << "sampled " << counted() << endl);
+	assert(n_evaluated == 1 + 3);
+	std::cerr.rdbuf(p_old);
+	assert(captured.str() == "value 42\nsampled 42\nsampled 42\nsampled 42\n");
+	debug_level = 0;
+#endif
+
+	cout << "Evaluated " << n_evaluated << " debug arguments" << endl;
+	return 0;
+}
@@ -0,0 +1,46 @@
+#undef NDEBUG // assert is part of our logic
+#include <fstream>
+#include <vector>
+#include <fileno.hpp>
+#include <dwarfpp/lib.hpp>
+
+using std::cout;
+using std::endl;
+using std::vector;
+using std::pair;
+using std::make_pair;
+using namespace dwarf;
+
+int main(int argc, char **argv)
+{
+	using namespace dwarf::core;
+
+	// using our own debug info...
+	std::ifstream in(argv[0]);
+	assert(in);
+	std::ifstream in2(argv[0]);
+	assert(in2);
+	/* Walk the tree the old way, then with the dense table, and check
+	 * that we see the same DIEs at the same depths. */
+	root_die r(fileno(in));
+	vector<pair<Dwarf_Off, unsigned> > seen;
+	for (auto i = r.begin(); i != r.end(); ++i) seen.push_back(make_pair(i.offset_here(), i.depth()));
+
+	root_die r2(fileno(in2));
+	bool built = r2.build_dense_nav();
+	assert(built);
+	assert(r2.have_dense_nav());
+	vector<pair<Dwarf_Off, unsigned> > seen_dense;
+	for (auto i = r2.begin(); i != r2.end(); ++i) seen_dense.push_back(make_pair(i.offset_here(), i.depth()));
+	assert(seen == seen_dense);
+
+	/* Parents should agree too, including for DIEs we find from cold. */
+	Dwarf_Off last_off = seen.back().first;
+	auto found = r2.find(last_off);
+	assert(found);
+	assert(found.depth() == seen.back().second);
+	assert(found.parent().offset_here() == r.find(last_off).parent().offset_here());
+	cout << "Dense navigation agreed on " << seen.size() << " DIEs" << endl;
+
+	return 0;
+}
@@ -0,0 +1,278 @@
+#undef NDEBUG // assert is part of our logic
+#include <fstream>
+#include <map>
+#include <fileno.hpp>
+#include <dwarfpp/lib.hpp>
+#include <dwarfpp/writer.hpp>
+
+using std::cout;
+using std::endl;
+using std::string;
+using std::vector;
+using std::pair;
+using std::make_pair;
+using namespace dwarf;
+
+static Dwarf_Unsigned read_uleb(const string& s, size_t& pos)
+{
+	Dwarf_Unsigned v = 0;
+	unsigned shift = 0;
+	unsigned char byte;
+	do { byte = s.at(pos++); v |= (Dwarf_Unsigned) (byte & 0x7f) << shift; shift += 7; } while (byte & 0x80);
+	return v;
+}
+static Dwarf_Signed read_sleb(const string& s, size_t& pos)
+{
+	Dwarf_Signed v = 0;
+	unsigned shift = 0;
+	unsigned char byte;
+	do { byte = s.at(pos++); v |= (Dwarf_Signed) (byte & 0x7f) << shift; shift += 7; } while (byte & 0x80);
+	if (shift < 64 && (byte & 0x40)) v |= -((Dwarf_Signed) 1 << shift);
+	return v;
+}
+static Dwarf_Unsigned read_fixed(const string& s, size_t& pos, unsigned size)
+{
+	Dwarf_Unsigned v = 0;
+	for (unsigned i = 0; i < size; ++i) v |= (Dwarf_Unsigned) (unsigned char) s.at(pos++) << (8 * i);
+	return v;
+}
+
+struct abbrev { Dwarf_Half tag; bool children; vector<pair<Dwarf_Half, Dwarf_Half> > specs; };
+
+/* Decode what we wrote: each DIE's tag and name, in order, and if
+ * asked, its DW_AT_decl_file (0 if none). */
+static vector<pair<Dwarf_Half, string> > decode(const core::dwarf_writer& w,
+	vector<Dwarf_Unsigned> *p_decl_files = 0)
+{
+	std::map<Dwarf_Unsigned, abbrev> abbrevs;
+	size_t pos = 0;
+	while (Dwarf_Unsigned code = read_uleb(w.abbrev(), pos))
+	{
+		abbrev& a = abbrevs[code];
+		a.tag = read_uleb(w.abbrev(), pos);
+		a.children = w.abbrev().at(pos++);
+		while (true)
+		{
+			Dwarf_Half attr = read_uleb(w.abbrev(), pos);
+			Dwarf_Half form = read_uleb(w.abbrev(), pos);
+			if (!attr && !form) break;
+			a.specs.push_back(make_pair(attr, form));
+		}
+	}
+	assert(pos == w.abbrev().size());
+	vector<pair<Dwarf_Half, string> > out;
+	const string& info = w.info();
+	pos = 0;
+	while (pos < info.size())
+	{
+		size_t end = pos + 4 + read_fixed(info, pos, 4);
+		assert(read_fixed(info, pos, 2) == 4);
+		assert(read_fixed(info, pos, 4) == 0);
+		unsigned addr_size = read_fixed(info, pos, 1);
+		while (pos < end)
+		{
+			Dwarf_Unsigned code = read_uleb(info, pos);
+			if (!code) continue; // end of some children
+			assert(abbrevs.find(code) != abbrevs.end());
+			const abbrev& a = abbrevs[code];
+			string name;
+			Dwarf_Unsigned decl_file = 0;
+			for (auto i = a.specs.begin(); i != a.specs.end(); ++i)
+			{
+				switch (i->second)
+				{
+					case DW_FORM_flag: ++pos; break;
+					case DW_FORM_addr: pos += addr_size; break;
+					case DW_FORM_udata: case DW_FORM_sdata: {
+						Dwarf_Unsigned v = read_uleb(info, pos);
+						if (i->first == DW_AT_decl_file) decl_file = v;
+					} break;
+					case DW_FORM_strp: {
+						Dwarf_Unsigned off = read_fixed(info, pos, 4);
+						assert(off < w.str().size());
+						if (i->first == DW_AT_name) name = w.str().c_str() + off;
+					} break;
+					case DW_FORM_ref_addr: assert(read_fixed(info, pos, 4) < info.size()); break;
+					case DW_FORM_block: case DW_FORM_exprloc: pos += read_uleb(info, pos); break;
+					case DW_FORM_sec_offset: {
+						Dwarf_Unsigned off = read_fixed(info, pos, 4);
+						const string& section = (i->first == DW_AT_stmt_list) ? w.line()
+							: (i->first == DW_AT_ranges) ? w.ranges() : w.loc();
+						assert(off < section.size());
+					} break;
+					default: assert(false);
+				}
+			}
+			out.push_back(make_pair(a.tag, name));
+			if (p_decl_files) p_decl_files->push_back(decl_file);
+		}
+		assert(pos == end);
+	}
+	return out;
+}
+
+struct line_row
+{
+	Dwarf_Addr addr; string file; unsigned line; unsigned column; bool is_stmt; bool end_sequence;
+};
+
+/* Run the line program at pos, which uses only the opcodes we write. */
+static vector<line_row> decode_lines(const string& s, size_t& pos, unsigned addr_size,
+	vector<string> *p_files = 0)
+{
+	size_t end = pos + 4 + read_fixed(s, pos, 4);
+	assert(read_fixed(s, pos, 2) == 4);
+	size_t header_length = read_fixed(s, pos, 4);
+	size_t prog = pos + header_length;
+	pos += 6 + 12; // the fixed fields, then the standard opcode lengths
+	assert(s.at(pos++) == '\0'); // no include directories
+	vector<string> files;
+	while (s.at(pos))
+	{
+		files.push_back(s.c_str() + pos);
+		pos += files.back().size() + 1;
+		read_uleb(s, pos); read_uleb(s, pos); read_uleb(s, pos);
+	}
+	++pos;
+	assert(pos == prog);
+	if (p_files) *p_files = files;
+	const line_row initial = { 0, files.empty() ? string() : files[0], 1, 0, true, false };
+	line_row cur = initial;
+	vector<line_row> rows;
+	while (pos < end)
+	{
+		unsigned char op = s.at(pos++);
+		switch (op)
+		{
+			case 0: {
+				Dwarf_Unsigned len = read_uleb(s, pos);
+				unsigned char ext = s.at(pos++);
+				if (ext == DW_LNE_set_address) { assert(len == 1 + addr_size); cur.addr = read_fixed(s, pos, addr_size); }
+				else
+				{
+					assert(ext == DW_LNE_end_sequence && len == 1);
+					cur.end_sequence = true;
+					rows.push_back(cur);
+					cur = initial;
+				}
+			} break;
+			case DW_LNS_advance_pc: cur.addr += read_uleb(s, pos); break;
+			case DW_LNS_set_file: cur.file = files.at(read_uleb(s, pos) - 1); break;
+			case DW_LNS_advance_line: cur.line += read_sleb(s, pos); break;
+			case DW_LNS_set_column: cur.column = read_uleb(s, pos); break;
+			case DW_LNS_negate_stmt: cur.is_stmt = !cur.is_stmt; break;
+			case DW_LNS_copy: rows.push_back(cur); break;
+			default: assert(false);
+		}
+	}
+	assert(pos == end);
+	return rows;
+}
+
+int main(int argc, char **argv)
+{
+	using namespace dwarf::core;
+
+	// using our own debug info...
+	std::ifstream in(argv[0]);
+	assert(in);
+	root_die r(fileno(in));
+	vector<pair<Dwarf_Half, string> > expected;
+	for (auto i = r.begin(); i != r.end(); ++i)
+	{
+		if (i.is_root_position()) continue;
+		expected.push_back(make_pair(i.tag_here(), i.name_here() ? *i.name_here() : string()));
+	}
+
+	dwarf_writer w(r);
+	w.write_all();
+	bool ok = w.finish();
+	assert(ok);
+	assert(w.get_stats().n_dies == expected.size());
+	vector<Dwarf_Unsigned> decl_files;
+	assert(decode(w, &decl_files) == expected);
+	cout << "Wrote " << w.get_stats().n_dies << " DIEs as " << w.info().size() << " bytes of info, "
+		<< w.abbrev().size() << " of abbrevs and " << w.str().size() << " of strings" << endl;
+	/* We're built -O2 (see the Makefile), so there are location lists and
+	 * range lists to write, not drop. */
+	assert(!w.loc().empty() && !w.ranges().empty());
+	cout << "... and " << w.line().size() << " bytes of lines, " << w.loc().size()
+		<< " of locations, " << w.ranges().size() << " of ranges" << endl;
+
+	/* Each CU's line program, in the order we wrote them, gives its rows. */
+	size_t line_pos = 0;
+	unsigned n_programs = 0;
+	std::map<Dwarf_Off, vector<string> > files_of_cu;
+	auto cus = r.begin().children_here();
+	for (auto i_cu = std::move(cus.first); i_cu != cus.second; ++i_cu)
+	{
+		auto cu = i_cu.as_a<compile_unit_die>();
+		if (!cu->has_attr(DW_AT_stmt_list)) continue;
+		auto p_t = cu->get_line_table();
+		assert(p_t);
+		vector<line_row> rows = decode_lines(w.line(), line_pos, cu->get_address_size(),
+			&files_of_cu[cu.offset_here()]);
+		assert(rows.size() == p_t->rows.size());
+		for (unsigned i = 0; i < rows.size(); ++i)
+		{
+			const line_table::row& orig = p_t->rows[i];
+			assert(rows[i].addr == orig.addr && rows[i].end_sequence == orig.end_sequence);
+			if (orig.end_sequence) continue;
+			assert(rows[i].file == r.line_file_name(orig.file));
+			assert(rows[i].line == orig.line && rows[i].column == orig.column);
+			assert(rows[i].is_stmt == orig.is_stmt);
+		}
+		++n_programs;
+	}
+	assert(line_pos == w.line().size());
+	assert(n_programs > 0);
+
+	/* A decl_file names, in our line program, the file it named in the
+	 * input's, whichever number that counted from. */
+	unsigned k = 0, n_decl_files = 0;
+	for (auto i = r.begin(); i != r.end(); ++i)
+	{
+		if (i.is_root_position()) continue;
+		if (i.has_attr(DW_AT_decl_file))
+		{
+			auto cu = i.enclosing_cu();
+			auto p_files = cu->get_source_files();
+			Dwarf_Unsigned in_file = i.attr(DW_AT_decl_file).get_unsigned();
+			unsigned id = p_files->path_id(in_file);
+			if (id == source_file_table::NONE) id = p_files->name_id(in_file);
+			assert(id != source_file_table::NONE);
+			const vector<string>& files = files_of_cu.at(cu.offset_here());
+			assert(decl_files[k] >= 1 && files.at(decl_files[k] - 1) == r.line_file_name(id));
+			++n_decl_files;
+		}
+		++k;
+	}
+	assert(n_decl_files > 0);
+
+	/* Collapsing duplicate types can only make it smaller. */
+	dwarf_writer w_dedup(r, true);
+	w_dedup.write_all();
+	w_dedup.finish();
+	assert(w_dedup.get_stats().n_dies + w_dedup.get_stats().n_types_collapsed <= expected.size());
+	assert(w_dedup.info().size() <= w.info().size());
+	decode(w_dedup);
+	cout << "Collapsing " << w_dedup.get_stats().n_types_collapsed << " types left "
+		<< w_dedup.info().size() << " bytes of info" << endl;
+
+	/* In-memory DIEs write out the same way. */
+	in_memory_root_die m;
+	auto cu = m.get_or_create_synthetic_cu();
+	auto t = m.make_new(cu, DW_TAG_base_type);
+	dynamic_cast<in_memory_abstract_die&>(t.dereference()).attrs().insert(
+		make_pair(DW_AT_name, encap::attribute_value(string("int"))));
+	dwarf_writer w_mem(m);
+	w_mem.write_all();
+	ok = w_mem.finish();
+	assert(ok);
+	auto decoded = decode(w_mem);
+	assert(decoded.size() == 2);
+	assert(decoded[0] == make_pair((Dwarf_Half) DW_TAG_compile_unit, string("dwarfpp.synthetic")));
+	assert(decoded[1] == make_pair((Dwarf_Half) DW_TAG_base_type, string("int")));
+
+	return 0;
+}
@@ -0,0 +1,181 @@
+#undef NDEBUG // assert is part of our logic
+#include <iostream>
+#include <vector>
+#include <cstring>
+#include <dwarfpp/lib.hpp>
+#include <dwarfpp/native-reader.hpp>
+
+using std::cout;
+using std::endl;
+using std::vector;
+using namespace dwarf;
+using namespace dwarf::core;
+
+/* Host-endian, as the reader expects of its sections. */
+template <typename T>
+static void put(vector<unsigned char>& v, T x)
+{
+	unsigned char buf[sizeof x];
+	memcpy(buf, &x, sizeof x);
+	v.insert(v.end(), buf, buf + sizeof x);
+}
+static void put_uleb(vector<unsigned char>& v, Dwarf_Unsigned x)
+{
+	do
+	{
+		unsigned char c = x & 0x7f;
+		x >>= 7;
+		v.push_back(c | (x ? 0x80 : 0));
+	} while (x);
+}
+/* The 32-bit table header that .debug_str_offsets and .debug_addr share,
+ * and the list sections' longer one, with a single-entry offset table. */
+static void put_table_header(vector<unsigned char>& v, unsigned char address_size)
+{
+	put<uint32_t>(v, 0); // length; we don't look
+	put<uint16_t>(v, 5);
+	v.push_back(address_size);
+	v.push_back(0);
+}
+static void put_list_header(vector<unsigned char>& v, uint32_t first_list)
+{
+	put_table_header(v, 8);
+	put<uint32_t>(v, 1);
+	put<uint32_t>(v, first_list);
+}
+static native_reader::bytes bytes_of(const vector<unsigned char>& v)
+{ return (native_reader::bytes) { .data = v.data(), .size = v.size() }; }
+
+int main(int argc, char **argv)
+{
+	/* A unit whose names, addresses and lists all go by index. */
+	vector<unsigned char> abbrev;
+	Dwarf_Unsigned cu_abbrev[] = { 1, DW_TAG_compile_unit, 1,
+		DW_AT_name, DW_FORM_strx1, DW_AT_low_pc, DW_FORM_addrx1,
+		DW_AT_str_offsets_base, DW_FORM_sec_offset, DW_AT_addr_base, DW_FORM_sec_offset,
+		DW_AT_rnglists_base, DW_FORM_sec_offset, DW_AT_loclists_base, DW_FORM_sec_offset, 0, 0 };
+	Dwarf_Unsigned var_abbrev[] = { 2, DW_TAG_variable, 0,
+		DW_AT_name, DW_FORM_strx1, DW_AT_location, DW_FORM_loclistx, 0, 0 };
+	Dwarf_Unsigned block_abbrev[] = { 3, DW_TAG_lexical_block, 0,
+		DW_AT_ranges, DW_FORM_rnglistx, DW_AT_entry_pc, DW_FORM_addrx, 0, 0 };
+	/* Each has-children byte is small enough to be its own ULEB. */
+	for (Dwarf_Unsigned x : cu_abbrev) put_uleb(abbrev, x);
+	for (Dwarf_Unsigned x : var_abbrev) put_uleb(abbrev, x);
+	for (Dwarf_Unsigned x : block_abbrev) put_uleb(abbrev, x);
+	abbrev.push_back(0);
+
+	vector<unsigned char> info;
+	put<uint32_t>(info, 0);
+	put<uint16_t>(info, 5);
+	info.push_back(1); // DW_UT_compile
+	info.push_back(8);
+	put<uint32_t>(info, 0);
+	Dwarf_Off cu_die = info.size();
+	info.push_back(1); info.push_back(0); info.push_back(0);
+	put<uint32_t>(info, 8); put<uint32_t>(info, 8); put<uint32_t>(info, 12); put<uint32_t>(info, 12);
+	Dwarf_Off var_die = info.size();
+	info.push_back(2); info.push_back(1); put_uleb(info, 0);
+	Dwarf_Off block_die = info.size();
+	info.push_back(3); put_uleb(info, 0); put_uleb(info, 1);
+	info.push_back(0);
+	uint32_t length = info.size() - 4;
+	memcpy(&info[0], &length, 4);
+
+	vector<unsigned char> str;
+	const char strs[] = "cu\0x";
+	str.insert(str.end(), strs, strs + sizeof strs);
+	vector<unsigned char> str_offsets;
+	put_table_header(str_offsets, 0);
+	put<uint32_t>(str_offsets, 0);
+	put<uint32_t>(str_offsets, 3);
+	vector<unsigned char> addr;
+	put_table_header(addr, 8);
+	put<uint64_t>(addr, 0x1000);
+	put<uint64_t>(addr, 0x1100);
+
+	vector<unsigned char> rnglists;
+	put_list_header(rnglists, 4);
+	rnglists.push_back(4); put_uleb(rnglists, 0x10); put_uleb(rnglists, 0x20); // offset_pair
+	rnglists.push_back(3); put_uleb(rnglists, 1); put_uleb(rnglists, 8);       // startx_length
+	rnglists.push_back(4); put_uleb(rnglists, 0x30); put_uleb(rnglists, 0x30); // empty
+	rnglists.push_back(0);
+	vector<unsigned char> loclists;
+	put_list_header(loclists, 4);
+	loclists.push_back(1); put_uleb(loclists, 1);                             // base_addressx
+	loclists.push_back(4); put_uleb(loclists, 0); put_uleb(loclists, 4);      // offset_pair
+	put_uleb(loclists, 1); loclists.push_back(DW_OP_reg0);
+	loclists.push_back(8); put<uint64_t>(loclists, 0x2000); put_uleb(loclists, 0x10); // start_length
+	put_uleb(loclists, 2); loclists.push_back(DW_OP_lit1); loclists.push_back(DW_OP_stack_value);
+	loclists.push_back(5);                                                    // default_location
+	put_uleb(loclists, 1); loclists.push_back(DW_OP_reg1);
+	loclists.push_back(0);
+
+	native_reader::sections s = (native_reader::sections) {
+		.info = bytes_of(info), .abbrev = bytes_of(abbrev), .str = bytes_of(str),
+		.line_str = { nullptr, 0 }, .str_offsets = bytes_of(str_offsets),
+		.ranges = { nullptr, 0 }, .rnglists = bytes_of(rnglists),
+		.addr = bytes_of(addr), .loclists = bytes_of(loclists)
+	};
+	native_reader reader(s);
+	assert(reader.ok() && reader.unit_count() == 1);
+	const native_reader::unit& cu = reader.get_unit(0);
+	assert(cu.die_offset == cu_die && cu.version == 5);
+	assert(cu.str_offsets_base == 8 && cu.addr_base == 8);
+	assert(cu.rnglists_base == 12 && cu.loclists_base == 12);
+	assert(cu.base_address == 0x1000);
+
+	/* Strings and addresses. */
+	assert(reader.name(0, cu_die) == "cu");
+	assert(reader.name(0, var_die) == "x");
+	native_reader::attr_value v;
+	Dwarf_Addr a;
+	assert(reader.find_attr(0, block_die, DW_AT_entry_pc, &v) && reader.address_of(0, v, &a) && a == 0x1100);
+	v.u = 2; // past the end of the unit's addresses
+	assert(!reader.address_of(0, v, &a));
+
+	/* A range list, following the base address and .debug_addr. */
+	assert(reader.find_attr(0, block_die, DW_AT_ranges, &v));
+	Dwarf_Off off;
+	assert(!reader.list_offset_of(0, v, false, &off));
+	assert(reader.list_offset_of(0, v, true, &off) && off == 16);
+	vector<native_reader::list_entry> entries;
+	assert(reader.read_list(0, off, true, entries) && entries.size() == 2);
+	assert(entries[0].lo == 0x1010 && entries[0].hi == 0x1020 && !entries[0].expr);
+	assert(entries[1].lo == 0x1100 && entries[1].hi == 0x1108);
+
+	/* A location list, with a new base and a default. */
+	assert(reader.find_attr(0, var_die, DW_AT_location, &v));
+	assert(reader.list_offset_of(0, v, false, &off) && off == 16);
+	entries.clear();
+	assert(reader.read_list(0, off, false, entries) && entries.size() == 3);
+	assert(entries[0].lo == 0x1100 && entries[0].hi == 0x1104);
+	assert(entries[0].expr_len == 1 && entries[0].expr[0] == DW_OP_reg0);
+	assert(entries[1].lo == 0x2000 && entries[1].hi == 0x2010 && entries[1].expr_len == 2);
+	assert(entries[2].lo == 0 && entries[2].hi == 0 && entries[2].expr[0] == DW_OP_reg1);
+	native_reader::offset_span locs, ranges;
+	assert(reader.unit_list_offsets(0, &locs, &ranges));
+	assert(locs.lo == 16 && locs.hi == 16 && ranges.lo == 16 && ranges.hi == 16);
+
+	/* A list that runs off the end of its section is bad data. */
+	vector<unsigned char> truncated(loclists.begin(), loclists.end() - 1);
+	native_reader::sections s2 = s;
+	s2.loclists = bytes_of(truncated);
+	native_reader truncated_reader(s2);
+	entries.clear();
+	assert(!truncated_reader.read_list(0, off, false, entries));
+
+	/* Signatures now follow the indices, so a moved address shows. */
+	uint64_t h1, h2;
+	bool closed;
+	assert(reader.unit_signature(0, &h1, &closed) && closed);
+	vector<unsigned char> moved(addr);
+	Dwarf_Addr moved_base = 0x3000;
+	memcpy(&moved[8], &moved_base, 8);
+	s2 = s;
+	s2.addr = bytes_of(moved);
+	native_reader moved_reader(s2);
+	assert(moved_reader.get_unit(0).base_address == 0x3000);
+	assert(moved_reader.unit_signature(0, &h2, &closed) && h2 != h1);
+	cout << "Decoded " << entries.size() << " DWARF 5 location list entries" << endl;
+	return 0;
+}
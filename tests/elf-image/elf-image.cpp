@@ -0,0 +1,51 @@
+#undef NDEBUG // assert is part of our logic
+#include <fstream>
+#include <fileno.hpp>
+#include <dwarfpp/lib.hpp>
+
+using std::cout;
+using std::endl;
+using std::vector;
+using namespace dwarf;
+
+static vector<Dwarf_Off> all_offsets(dwarf::core::root_die& r)
+{
+	vector<Dwarf_Off> offs;
+	for (auto i = r.begin(); i != r.end(); ++i) offs.push_back(i.offset_here());
+	return offs;
+}
+
+int main(int argc, char **argv)
+{
+	using namespace dwarf::core;
+
+	// using our own debug info...
+	std::ifstream in(argv[0]);
+	assert(in);
+	root_die copied(fileno(in));
+	vector<Dwarf_Off> expected = all_offsets(copied);
+	assert(expected.size() > 0);
+
+	/* Mapping the file sees exactly the same DIEs. */
+	root_die mapped(fileno(in), root_die::MAP_FILE);
+	assert(mapped.get_elf_image());
+	assert(all_offsets(mapped) == expected);
+
+	/* Two roots can share one image, and outlive our reference to it. */
+	auto p_image = mapped.get_elf_image();
+	{
+		root_die shared1(p_image);
+		root_die shared2(p_image);
+		assert(shared1.get_fd() == -1);
+		p_image.reset();
+		assert(all_offsets(shared1) == expected);
+		assert(all_offsets(shared2) == expected);
+
+		/* Preloading works without an fd, reading the image. */
+		bool ok = shared2.preload(2);
+		assert(ok);
+		assert(all_offsets(shared2) == expected);
+	}
+	cout << "Saw " << expected.size() << " DIEs each way" << endl;
+	return 0;
+}
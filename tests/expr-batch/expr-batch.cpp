@@ -0,0 +1,73 @@
+#undef NDEBUG // assert is part of our logic
+#include <iostream>
+#include <vector>
+#include <dwarfpp/lib.hpp>
+#include <dwarfpp/expr.hpp>
+
+using std::cout;
+using std::endl;
+using std::vector;
+using namespace dwarf;
+using namespace dwarf::lib;
+
+int main(int argc, char **argv)
+{
+	const size_t n = 1000;
+	vector<Dwarf_Signed> rsp(n), rbp(n), fb(n);
+	vector<Dwarf_Addr> pcs(n);
+	for (size_t i = 0; i < n; ++i)
+	{
+		rsp[i] = 0x7fff0000 - 16 * i;
+		rbp[i] = rsp[i] + 64;
+		fb[i] = rbp[i] + 16;
+		pcs[i] = 0x1000 + (i % 3) * 0x100; // not sorted, so runs are short
+	}
+	expr::regs_block rs(n);
+	rs.set_column(7, rsp.data());
+	rs.set_column(6, rbp.data());
+
+	/* Each sort of expression gives what eval() gives, row by row. */
+	Dwarf_Unsigned breg[] = { DW_OP_breg7, 8 };
+	Dwarf_Unsigned fbreg[] = { DW_OP_fbreg, (Dwarf_Unsigned) -24 };
+	Dwarf_Unsigned general[] = { DW_OP_breg6, 0, DW_OP_breg7, 0, DW_OP_plus, DW_OP_stack_value };
+	Dwarf_Unsigned missing[] = { DW_OP_breg3, 0 };
+	encap::loc_expr exprs[] = {
+		encap::loc_expr(breg, 0, 0), encap::loc_expr(fbreg, 0, 0),
+		encap::loc_expr(general, 0, 0), encap::loc_expr(missing, 0, 0)
+	};
+	vector<Dwarf_Unsigned> out(n);
+	vector<unsigned char> ok(n);
+	for (unsigned k = 0; k < 4; ++k)
+	{
+		expr::compiled_expr e(exprs[k]);
+		size_t n_ok = e.eval_batch(rs, 0, n, fb.data(), nullptr, out.data(), ok.data());
+		assert(n_ok == (k == 3 ? 0 : n));
+		for (size_t i = 0; i < n; ++i)
+		{
+			assert(ok[i] == (k != 3));
+			if (!ok[i]) continue;
+			expr::regs_block_row row(rs, i);
+			assert(out[i] == e.eval(&row, fb[i]));
+		}
+	}
+	/* Without frame bases, fbreg gets nothing. */
+	assert(expr::compiled_expr(exprs[1]).eval_batch(rs, 0, n, nullptr, nullptr, out.data(), ok.data()) == 0);
+
+	/* A loclist picks each row's entry by pc, as find() does. */
+	encap::loclist ll;
+	ll.push_back(encap::loc_expr(breg, 0x1000, 0x1100));
+	ll.push_back(encap::loc_expr(fbreg, 0x1100, 0x1200));
+	expr::compiled_loclist cl(ll);
+	size_t n_ok = cl.eval_batch(pcs.data(), rs, fb.data(), nullptr, out.data(), ok.data());
+	cout << "Evaluated " << n_ok << " of " << n << " rows" << endl;
+	for (size_t i = 0; i < n; ++i)
+	{
+		const expr::compiled_expr *e = cl.find(pcs[i]);
+		assert(ok[i] == (e != nullptr));
+		if (!e) continue;
+		expr::regs_block_row row(rs, i);
+		assert(out[i] == e->eval(&row, fb[i]));
+	}
+	assert(n_ok == n - n / 3);
+	return 0;
+}
@@ -0,0 +1,75 @@
+#undef NDEBUG // assert is part of our logic
+#include <iostream>
+#include <stack>
+#include <deque>
+#include <dwarfpp/lib.hpp>
+#include <dwarfpp/expr.hpp>
+
+using std::cout;
+using std::endl;
+using namespace dwarf;
+using namespace dwarf::lib;
+
+struct fake_regs : public expr::regs
+{
+	Dwarf_Signed get(int regnum) { return 0x10000 * (regnum + 1); }
+};
+
+int main(int argc, char **argv)
+{
+	fake_regs regs;
+	const Dwarf_Signed frame_base = 0x7ffe1000;
+	Dwarf_Unsigned breg[] = { DW_OP_breg6, 8 };
+	Dwarf_Unsigned fbreg[] = { DW_OP_fbreg, (Dwarf_Unsigned) -24 };
+	Dwarf_Unsigned sum[] = { DW_OP_breg6, 0, DW_OP_breg7, 0, DW_OP_plus, DW_OP_stack_value };
+	Dwarf_Unsigned shl[] = { DW_OP_shl };
+	Dwarf_Unsigned two[] = { DW_OP_lit3, DW_OP_lit4 };
+	Dwarf_Unsigned plus5[] = { DW_OP_lit5, DW_OP_plus };
+	encap::loc_expr e_breg(breg, 0, 0), e_fbreg(fbreg, 0, 0), e_sum(sum, 0, 0),
+		e_shl(shl, 0, 0), e_two(two, 0, 0), e_plus5(plus5, 0, 0);
+
+	/* One evaluator, reset and run on each expression in turn, gives
+	 * what a fresh one constructed for each gives. */
+	expr::evaluator ev;
+	const encap::loc_expr *exprs[] = { &e_breg, &e_fbreg, &e_sum };
+	for (unsigned k = 0; k < 3; ++k)
+	{
+		ev.reset(&regs, frame_base);
+		ev.run(*exprs[k]);
+		assert(ev.finished());
+		assert(ev.tos() == expr::evaluator(*exprs[k], spec::DEFAULT_DWARF_SPEC, regs, frame_base).tos());
+	}
+
+	/* Initial entries go on bottom first, as the std::stack has them. */
+	std::stack<Dwarf_Unsigned> initial;
+	initial.push(10);
+	initial.push(3);
+	assert(expr::evaluator(e_shl, spec::DEFAULT_DWARF_SPEC, initial).tos() == 80);
+	ev.reset();
+	ev.push(10);
+	ev.push(3);
+	ev.run(e_shl);
+	assert(ev.tos() == 80);
+
+	/* Whatever a run leaves on the stack, reset() clears. */
+	ev.reset();
+	ev.run(e_two);
+	assert(ev.tos() == 4);
+	ev.reset();
+	bool underflowed = false;
+	try { ev.run(e_plus5); }
+	catch (No_entry) { underflowed = true; }
+	assert(underflowed);
+
+	/* Compiled expressions can borrow it, and agree. */
+	expr::compiled_expr c(e_sum);
+	assert(c.kind == expr::compiled_expr::GENERAL);
+	assert(c.eval(&regs, frame_base, spec::opt<Dwarf_Unsigned>(), &ev)
+		== expr::evaluator(e_sum, spec::DEFAULT_DWARF_SPEC, regs, frame_base).tos());
+	expr::compiled_expr c2(e_plus5);
+	assert(c2.kind == expr::compiled_expr::GENERAL);
+	assert(c2.eval(&regs, frame_base, spec::opt<Dwarf_Unsigned>(10), &ev) == 15);
+
+	cout << "Reused one evaluator throughout" << endl;
+	return 0;
+}
@@ -0,0 +1,65 @@
+#undef NDEBUG // assert is part of our logic
+#include <fstream>
+#include <fileno.hpp>
+#include <dwarfpp/lib.hpp>
+#include <dwarfpp/frame.hpp>
+
+using std::cout;
+using std::endl;
+using namespace dwarf;
+using dwarf::core::FrameSection;
+
+int main(int argc, char **argv)
+{
+	using namespace dwarf::core;
+
+	// using our own .eh_frame...
+	std::ifstream in(argv[0]);
+	assert(in);
+	root_die r(fileno(in));
+	FrameSection cached(r.get_dbg(), true);
+	FrameSection uncached(r.get_dbg(), true);
+	uncached.set_decode_cache_size(0);
+	cached.set_decode_cache_size(16);
+
+	/* Cached or not, we decode the same rows. */
+	unsigned n = 0;
+	auto i_other = uncached.fde_begin();
+	for (auto i_fde = cached.fde_begin(); i_fde != cached.fde_end(); ++i_fde, ++i_other, ++n)
+	{
+		assert(i_other != uncached.fde_end());
+		auto p_first = i_fde->decoded();
+		auto p_again = i_fde->decoded();
+		assert(p_first == p_again);
+		auto fresh = i_other->decode();
+		assert(p_first->rows == fresh.rows);
+		assert(p_first->rules == fresh.rules);
+		assert(p_first->unfinished_row == fresh.unfinished_row);
+		assert(uncached.decode_cache.where.empty());
+		assert(cached.decode_cache.where.size() <= 16);
+	}
+	assert(n > 0);
+	cout << "Decoded " << n << " FDEs; " << cached.decode_cache.hits << " hits, "
+		<< cached.decode_cache.misses << " misses" << endl;
+	assert(cached.decode_cache.hits >= n);
+	/* Some CIE is shared by more than one FDE, surely. */
+	assert(n < 2 || cached.decode_cache.cie_initial.size() < n);
+
+	/* Dereferencing gives the same parsed Fde and Cie every time. */
+	for (auto i_fde = cached.fde_begin(); i_fde != cached.fde_end(); ++i_fde)
+	{
+		assert(&*i_fde == &*i_fde);
+		assert(&*i_fde == cached.fdes.at(i_fde.base() - cached.fde_data).get());
+		assert(&*i_fde->find_cie() == &*i_fde->find_cie());
+	}
+	for (auto i_cie = cached.cie_begin(); i_cie != cached.cie_end(); ++i_cie)
+	{
+		assert(&*i_cie == cached.cies.at(i_cie.base() - cached.cie_data).get());
+	}
+
+	/* Clearing drops what we had, but leaves the bound. */
+	cached.clear_decode_cache();
+	assert(cached.decode_cache.where.empty());
+	assert(cached.get_decode_cache_size() == 16);
+	return 0;
+}
@@ -61,8 +61,8 @@ int main(int argc, char **argv)
 	// now diff this string against what readelf gives us
 	/* NOTE: readelf has an arguable bug whereby it doesn't deduplicate 
 	 * address ranges with identical register/CFA definitions. We *do*
-	 * this deduplication, as a side effect of our use of interval_map, 
-	 * so our output is more compact. To compensate for this, we use 
+	 * this deduplication, since decoding joins abutting rows with the
+	 * same rules, so our output is more compact. To compensate for this, we use 
 	 * uniq to filter out successive identical lines, ignoring the first
 	 * 16 characters i.e. the base address of the interval. */
 	FILE *pipein = popen((string("diff -u /dev/stdin /dev/fd/3 3<<END\n$( readelf -wF ") + argv[1] + " | uniq -s16 )\nEND").c_str(), "w");
@@ -139,28 +139,27 @@ void print_in_readelf_style(std::ostream& s, const FrameSection::instrs_results&
 	all_columns.insert(DW_FRAME_CFA_COL3);
 	for (auto i_row = result.rows.begin(); i_row != result.rows.end(); ++i_row)
 	{	
-		for (auto i_reg = i_row->second.begin(); i_reg != i_row->second.end(); ++i_reg)
+		for (auto i_reg = result.rules_begin(*i_row); i_reg != result.rules_end(*i_row); ++i_reg)
 		{
-			all_columns.insert(i_reg->first);
+			all_columns.insert(i_reg->regnum);
 		}
 	}
 	
 	typedef std::function<void(int, optional< pair<int, FrameSection::register_def> >)>
 	 visitor_function;
 	
-	auto visit_columns = [all_columns, ra_rule_number, &s](
+	auto visit_columns = [all_columns, ra_rule_number, &s, &result](
 		 visitor_function visit, 
-		 optional<const set< pair<int, FrameSection::register_def> > &> opt_i_row
+		 const FrameSection::instrs_results::row *opt_i_row
 		) {
 		
-		auto get_column = [&opt_i_row](int col) {
+		auto get_column = [&opt_i_row, &result](int col) {
 			
 			if (!opt_i_row) return optional< pair<int, FrameSection::register_def> >();
 			else
 			{
-				map<int, FrameSection::register_def> m(opt_i_row->begin(), opt_i_row->end());
-				auto found = m.find(col);
-				return found != m.end() ? make_pair(found->first, found->second) : optional< pair<int, FrameSection::register_def> >();
+				auto found = result.find_rule(*opt_i_row, col);
+				return found ? make_pair(col, found->expand(dbg)) : optional< pair<int, FrameSection::register_def> >();
 			}
 		};
 		
@@ -189,7 +188,7 @@ void print_in_readelf_style(std::ostream& s, const FrameSection::instrs_results&
 		s << std::right;
 	};
 	
-	visit_columns(column_header_visitor, /* nullptr */ optional<const set<pair<int, FrameSection::register_def> > &>());
+	visit_columns(column_header_visitor, nullptr);
 	s << endl;
 	
 	visitor_function print_row_column_visitor = [all_columns, ra_rule_number, &s]
@@ -242,9 +241,9 @@ void print_in_readelf_style(std::ostream& s, const FrameSection::instrs_results&
 	for (auto i_int = result.rows.begin(); i_int != result.rows.end(); ++i_int)
 	{
 		s << std::hex << setfill('0') << setw(2 * cie.get_address_size())
-			<< i_int->first.lower() << ' ';
+			<< i_int->lo << ' ';
 		
-		visit_columns(print_row_column_visitor, i_int->second);
+		visit_columns(print_row_column_visitor, &*i_int);
 		s << endl;
 	}
 }
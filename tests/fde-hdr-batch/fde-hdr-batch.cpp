@@ -0,0 +1,84 @@
+#undef NDEBUG // assert is part of our logic
+#include <fstream>
+#include <vector>
+#include <algorithm>
+#include <fileno.hpp>
+#include <dwarfpp/lib.hpp>
+#include <dwarfpp/frame.hpp>
+
+using std::cout;
+using std::endl;
+using std::vector;
+using namespace dwarf;
+using dwarf::core::FrameSection;
+
+int main(int argc, char **argv)
+{
+	using namespace dwarf::core;
+
+	// using our own .eh_frame...
+	std::ifstream in(argv[0]);
+	assert(in);
+	root_die r(fileno(in));
+	FrameSection fs(r.get_dbg(), true);
+	const FrameSection::decoded_hdr_table& t = fs.get_decoded_hdr_table();
+	cout << "Decoded table is " << (t.usable ? "" : "not ") << "usable, depth " << t.depth << endl;
+	if (t.usable)
+	{
+		assert(t.lo.size() == (size_t) fs.fde_element_count);
+		assert(((uintptr_t) t.eyt & 63) == 0);
+		for (unsigned i = 0; i < t.lo.size(); ++i)
+		{
+			const Fde& f = fs.fde_at(i);
+			assert(t.lo[i] == f.get_low_pc());
+			assert(t.hi[i] == f.get_low_pc() + f.get_func_length());
+			assert(t.fde_offset[i] == f.get_fde_offset());
+		}
+	}
+	/* ensure_indexes() leaves nothing to decode or make on first
+	 * lookup, as freeze() relies on. */
+	FrameSection lazy_fs(r.get_dbg(), true, /* lazy */ true);
+	assert(!lazy_fs.hdr_tbl_decoded);
+	lazy_fs.ensure_indexes();
+	assert(lazy_fs.hdr_tbl_decoded && lazy_fs.get_decoded_hdr_table().usable == t.usable);
+	for (auto i_cie = lazy_fs.cies.begin(); i_cie != lazy_fs.cies.end(); ++i_cie) assert(*i_cie);
+	for (auto i_fde = lazy_fs.fdes.begin(); i_fde != lazy_fs.fdes.end(); ++i_fde) assert(*i_fde);
+
+	/* Each FDE's ends, and just outside them, in no particular order,
+	 * more than one batch's worth. */
+	vector<Dwarf_Addr> pcs;
+	for (auto i_fde = fs.fde_begin(); i_fde != fs.fde_end(); ++i_fde)
+	{
+		pcs.push_back(i_fde->get_low_pc());
+		pcs.push_back(i_fde->get_low_pc() - 1);
+		pcs.push_back(i_fde->get_low_pc() + i_fde->get_func_length());
+		if (i_fde->get_func_length() > 0) pcs.push_back(i_fde->get_low_pc() + i_fde->get_func_length() - 1);
+	}
+	pcs.push_back(0);
+	pcs.push_back((Dwarf_Addr) -1);
+	assert(pcs.size() > FrameSection::BATCH_SIZE);
+	std::reverse(pcs.begin(), pcs.end());
+	std::rotate(pcs.begin(), pcs.begin() + pcs.size() / 3, pcs.end());
+
+	vector<Dwarf_Signed> indices(pcs.size());
+	fs.find_fde_indices_for_pcs(&pcs[0], pcs.size(), &indices[0]);
+	unsigned n_found = 0;
+	for (unsigned i = 0; i < pcs.size(); ++i)
+	{
+		/* Agree with a walk over every FDE, and with find_fde_for_pc(). */
+		Dwarf_Signed expected = -1;
+		for (auto i_fde = fs.fde_begin(); i_fde != fs.fde_end(); ++i_fde)
+		{
+			if (pcs[i] >= i_fde->get_low_pc()
+				&& pcs[i] < i_fde->get_low_pc() + i_fde->get_func_length())
+			{ expected = i_fde - fs.fde_begin(); break; }
+		}
+		assert(indices[i] == expected);
+		auto found = fs.find_fde_for_pc(pcs[i]);
+		assert(expected == -1 ? found == fs.fde_end() : found - fs.fde_begin() == expected);
+		if (expected != -1) ++n_found;
+	}
+	assert(n_found > 0);
+	cout << "Looked up " << pcs.size() << " pcs in a batch, " << n_found << " covered" << endl;
+	return 0;
+}
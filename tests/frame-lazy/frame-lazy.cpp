@@ -0,0 +1,48 @@
+#undef NDEBUG // assert is part of our logic
+#include <fstream>
+#include <fileno.hpp>
+#include <dwarfpp/lib.hpp>
+#include <dwarfpp/frame.hpp>
+
+using std::cout;
+using std::endl;
+using namespace dwarf;
+using dwarf::core::FrameSection;
+
+int main(int argc, char **argv)
+{
+	using namespace dwarf::core;
+
+	// using our own .eh_frame...
+	std::ifstream in(argv[0]);
+	assert(in);
+	root_die r(fileno(in));
+	FrameSection eager(r.get_dbg(), true);
+	FrameSection lazy(r.get_dbg(), true, /* lazy */ true);
+	assert(eager.indexes_built);
+	assert(!lazy.indexes_built);
+	assert(lazy.fde_offsets_by_cie_offset.empty());
+
+	/* Finding an FDE by pc agrees with the eager section, and builds
+	 * nothing. */
+	unsigned n = 0;
+	for (auto i_fde = eager.fde_begin(); i_fde != eager.fde_end(); ++i_fde, ++n)
+	{
+		if (i_fde->get_func_length() == 0) continue;
+		auto found = lazy.find_fde_for_pc(i_fde->get_low_pc());
+		assert(found != lazy.fde_end());
+		assert(found->get_fde_offset() == i_fde->get_fde_offset());
+		auto last = lazy.find_fde_for_pc(i_fde->get_low_pc() + i_fde->get_func_length() - 1);
+		assert(last != lazy.fde_end());
+		assert(last->get_fde_offset() == i_fde->get_fde_offset());
+	}
+	assert(n > 0);
+	assert(!lazy.indexes_built);
+	cout << "Found all " << n << " FDEs by pc without indexing" << endl;
+
+	/* Asking for the indexes builds them, the same as the eager ones. */
+	assert(lazy.get_fde_offsets_by_cie_offset() == eager.fde_offsets_by_cie_offset);
+	assert(lazy.indexes_built);
+	assert(lazy.cie_offsets_by_index == eager.cie_offsets_by_index);
+	return 0;
+}
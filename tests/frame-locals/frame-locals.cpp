@@ -0,0 +1,88 @@
+#undef NDEBUG // assert is part of our logic
+#include <fstream>
+#include <cstring>
+#include <fileno.hpp>
+#include <dwarfpp/lib.hpp>
+
+using std::cout;
+using std::endl;
+using std::string;
+using namespace dwarf;
+
+/* Something with a few differently sized locals, one in a block. */
+static int __attribute__((noinline)) sum_digits(int n)
+{
+	char buf[24];
+	long total = 0;
+	snprintf(buf, sizeof buf, "%d", n);
+	for (unsigned i = 0; i < strlen(buf); ++i)
+	{
+		double weight = 1.0;
+		total += (long) ((buf[i] - '0') * weight);
+	}
+	return (int) total;
+}
+
+int main(int argc, char **argv)
+{
+	using namespace dwarf::core;
+
+	// using our own debug info...
+	std::ifstream in(argv[0]);
+	assert(in);
+	root_die r(fileno(in));
+
+	iterator_df<subprogram_die> i_sub = iterator_base::END;
+	for (auto i = r.begin(); i != r.end(); ++i)
+	{
+		if (i.tag_here() == DW_TAG_subprogram && i.name_here()
+			&& *i.name_here() == "sum_digits" && i.as_a<subprogram_die>()->get_low_pc())
+		{ i_sub = i.as_a<subprogram_die>(); break; }
+	}
+	assert(i_sub);
+	iterator_df<compile_unit_die> i_cu = r.cu_pos(i_sub.enclosing_cu_offset_here());
+	Dwarf_Addr vaddr = i_sub->get_low_pc()->addr
+		- (i_cu->get_low_pc() ? i_cu->get_low_pc()->addr : 0);
+
+	auto p_index = r.frame_locals(i_sub);
+	assert(p_index);
+	/* Asking again gives the same index. */
+	assert(r.frame_locals(i_sub) == p_index);
+	/* Only subprograms have one. */
+	assert(!r.frame_locals(i_cu));
+
+	/* Every fbreg-located local and arg is found at each of its bytes, by
+	 * the index and by asking it the slow way. */
+	unsigned n_checked = 0;
+	iterator_df<> i = i_sub;
+	for (++i; i != iterator_base::END && i.depth() > i_sub.depth(); ++i)
+	{
+		if (i.tag_here() != DW_TAG_variable && i.tag_here() != DW_TAG_formal_parameter) continue;
+		auto i_var = i.as_a<with_dynamic_location_die>();
+		auto compiled = i_var->get_compiled_location();
+		if (!compiled || compiled->entries.size() != 1
+			|| compiled->entries[0].expr.kind != expr::compiled_expr::FBREG) continue;
+		Dwarf_Signed lo = compiled->entries[0].expr.offset;
+		Dwarf_Unsigned size = *i_var->find_type()->calculate_byte_size();
+		for (Dwarf_Unsigned b = 0; b < size; ++b)
+		{
+			const frame_locals_index::slot *p_slot = p_index->find(vaddr, lo + b);
+			assert(p_slot);
+			assert(p_slot->var == i.offset_here());
+			assert(p_slot->lo == lo && p_slot->size == size);
+			opt<Dwarf_Off> slow = i_var->spans_addr(1000 + lo + b, 1000, r,
+				i_sub->get_low_pc()->addr);
+			assert(slow && *slow == b);
+		}
+		++n_checked;
+	}
+	/* Our locals are all on the stack at -O0. */
+	assert(n_checked >= 5);
+	assert(p_index->others.empty());
+	cout << "Checked " << n_checked << " locals against " << p_index->slots.size()
+		<< " slots" << endl;
+
+	/* Nothing lives far below the frame. */
+	assert(!p_index->find(vaddr, -1000000));
+	return sum_digits(argc) == 0 ? 1 : 0;
+}
@@ -0,0 +1,100 @@
+#undef NDEBUG // assert is part of our logic
+#include <fstream>
+#include <vector>
+#include <thread>
+#include <functional>
+#include <fileno.hpp>
+#include <dwarfpp/lib.hpp>
+
+using std::cout;
+using std::endl;
+using std::string;
+using std::vector;
+using namespace dwarf;
+
+/* What one walk over the tree reads: names (from .debug_str), location
+ * and range lists (.debug_loc, .debug_ranges) and CU file names
+ * (.debug_line). Each thread should see just what a serial walk saw. */
+struct summary
+{
+	unsigned n_dies;
+	unsigned n_names;
+	unsigned n_locs;
+	unsigned n_loc_exprs;
+	unsigned n_ranges;
+	size_t name_hash;
+	summary() : n_dies(0), n_names(0), n_locs(0), n_loc_exprs(0), n_ranges(0), name_hash(0) {}
+	bool operator==(const summary& s) const
+	{
+		return n_dies == s.n_dies && n_names == s.n_names && n_locs == s.n_locs
+			&& n_loc_exprs == s.n_loc_exprs && n_ranges == s.n_ranges && name_hash == s.name_hash;
+	}
+};
+
+static void walk(core::root_die& r, summary& s)
+{
+	using namespace dwarf::core;
+	for (auto i = r.begin(); i != r.end(); ++i)
+	{
+		if (i.is_root_position()) continue;
+		++s.n_dies;
+		auto name = i.name_here();
+		if (name)
+		{
+			++s.n_names;
+			s.name_hash = s.name_hash * 31 + std::hash<string>()(*name);
+		}
+		if (i.has_attr(DW_AT_location))
+		{
+			auto v = i.attr(DW_AT_location);
+			if (v.is_loclist()) { ++s.n_locs; s.n_loc_exprs += v.get_loclist().size(); }
+		}
+		if (i.has_attr(DW_AT_ranges))
+		{
+			auto v = i.attr(DW_AT_ranges);
+			if (v.is_rangelist()) s.n_ranges += v.get_rangelist().size();
+		}
+		if (i.tag_here() == DW_TAG_compile_unit)
+		{
+			auto cu = i.as_a<compile_unit_die>();
+			if (cu->source_file_count() > 0) cu->source_file_name(1);
+		}
+	}
+}
+
+int main(int argc, char **argv)
+{
+	using namespace dwarf::core;
+
+	// using our own debug info...
+	std::ifstream in(argv[0]);
+	assert(in);
+	std::ifstream in2(argv[0]);
+	assert(in2);
+
+	summary serial;
+	{
+		root_die r(fileno(in));
+		walk(r, serial);
+	}
+	assert(serial.n_dies > 0 && serial.n_names > 0);
+
+	/* A fresh root that has read only what preloading reads, so that
+	 * any section the walk wants is one freeze() had to load. */
+	root_die r(fileno(in2));
+	bool ok = r.preload(2) && r.freeze();
+	assert(ok);
+	const unsigned N_THREADS = 8;
+	vector<summary> summaries(N_THREADS);
+	vector<std::thread> threads;
+	for (unsigned i = 0; i < N_THREADS; ++i)
+	{
+		threads.push_back(std::thread(walk, std::ref(r), std::ref(summaries[i])));
+	}
+	for (auto i_t = threads.begin(); i_t != threads.end(); ++i_t) i_t->join();
+	r.thaw();
+	for (auto i_s = summaries.begin(); i_s != summaries.end(); ++i_s) assert(*i_s == serial);
+	cout << N_THREADS << " threads each read " << serial.n_dies << " DIEs, "
+		<< serial.n_locs << " location lists and " << serial.n_ranges << " ranges" << endl;
+	return 0;
+}
@@ -0,0 +1,140 @@
+#undef NDEBUG // assert is part of our logic
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+#include <fileno.hpp>
+#include <dwarfpp/lib.hpp>
+#include <dwarfpp/native-reader.hpp>
+
+using std::cout;
+using std::endl;
+using std::vector;
+using std::string;
+using namespace dwarf;
+
+static vector<std::pair<Dwarf_Off, Dwarf_Half> > walk(dwarf::core::root_die& r)
+{
+	vector<std::pair<Dwarf_Off, Dwarf_Half> > v;
+	for (auto i = r.begin(); i != r.end(); ++i)
+	{
+		v.push_back(std::make_pair(i.offset_here(), i.tag_here()));
+	}
+	return v;
+}
+
+/* The same answers as a root that built everything itself. */
+static void check_against(dwarf::core::root_die& r, dwarf::core::root_die& expected,
+	const vector<Dwarf_Addr>& pcs)
+{
+	using namespace dwarf::core;
+	assert(r.have_dense_nav());
+	assert(r.have_addr_index());
+	assert(walk(r) == walk(expected));
+	for (auto i_pc = pcs.begin(); i_pc != pcs.end(); ++i_pc)
+	{
+		iterator_base got = r.innermost_die_for_pc(*i_pc);
+		iterator_base want = expected.innermost_die_for_pc(*i_pc);
+		assert(got && want && got.offset_here() == want.offset_here());
+	}
+	assert(r.find_all_visible_grandchildren_named("main").size()
+		== expected.find_all_visible_grandchildren_named("main").size());
+	assert(r.find_all_visible_grandchildren_named("unsigned int").size()
+		== expected.find_all_visible_grandchildren_named("unsigned int").size());
+	unsigned n_types = 0;
+	for (iterator_df<> i = expected.begin(); i != expected.end() && n_types < 200; ++i)
+	{
+		if (!i.is_a<type_die>()) continue;
+		auto t = r.pos(i.offset_here()).as_a<type_die>();
+		assert(t && t->summary_code() == i.as_a<type_die>()->summary_code());
+		++n_types;
+	}
+	assert(n_types > 0);
+}
+
+int main(int argc, char **argv)
+{
+	using namespace dwarf::core;
+
+	// using our own debug info...
+	std::ifstream in(argv[0]);
+	assert(in);
+	root_die before(fileno(in), root_die::MAP_FILE);
+	/* Without an image there's no native reader to sign CUs with. */
+	root_die no_image(fileno(in));
+	assert(!no_image.save_incremental_index("/dev/null"));
+
+	bool ok = compute_all_type_summaries(before, 1);
+	assert(ok);
+	std::ostringstream s;
+	s << "/tmp/dwarfpp-incremental-index-test." << getpid();
+	string filename = s.str();
+	ok = before.save_incremental_index(filename);
+	assert(ok);
+
+	auto p_reader = native_reader::from_loader(*before.get_section_loader());
+	assert(p_reader);
+	unsigned n_signed = 0;
+	uint64_t first_signature = 0;
+	for (unsigned u = 0; u < p_reader->unit_count(); ++u)
+	{
+		uint64_t signature;
+		bool closed;
+		if (!p_reader->unit_signature(u, &signature, &closed)) continue;
+		if (n_signed++ == 0) first_signature = signature;
+	}
+	assert(n_signed > 0);
+
+	vector<Dwarf_Addr> pcs;
+	for (iterator_df<> i = before.begin(); i != before.end(); ++i)
+	{
+		if (i.tag_here() != DW_TAG_subprogram) continue;
+		auto i_s = i.as_a<subprogram_die>();
+		if (i_s->get_low_pc()) pcs.push_back(i_s->get_low_pc()->addr);
+	}
+	assert(!pcs.empty());
+
+	/* The same build: every CU we could sign carries over. */
+	root_die same(fileno(in), root_die::MAP_FILE);
+	unsigned n_reused;
+	ok = same.load_incremental_index(filename, &n_reused);
+	assert(ok);
+	assert(n_reused == n_signed);
+	check_against(same, before, pcs);
+	cout << "Reused all " << n_reused << " signed CUs of " << p_reader->unit_count() << endl;
+
+	/* Pretend one CU changed, by spoiling its signature in the file. It
+	 * gets recomputed, and the answers are still the same. */
+	string contents;
+	{
+		std::ifstream saved(filename, std::ios::binary);
+		assert(saved);
+		contents.assign(std::istreambuf_iterator<char>(saved), std::istreambuf_iterator<char>());
+	}
+	size_t pos = contents.find(string(reinterpret_cast<const char *>(&first_signature),
+		sizeof first_signature));
+	assert(pos != string::npos);
+	contents[pos] ^= 1;
+	{
+		std::ofstream spoiled(filename, std::ios::binary | std::ios::trunc);
+		spoiled.write(contents.data(), contents.size());
+		assert(spoiled);
+	}
+	root_die changed(fileno(in), root_die::MAP_FILE);
+	ok = changed.load_incremental_index(filename, &n_reused);
+	assert(ok);
+	assert(n_reused == n_signed - 1);
+	check_against(changed, before, pcs);
+	cout << "Reused " << n_reused << " CUs with one changed" << endl;
+
+	/* Junk isn't an index. */
+	{
+		std::ofstream junk(filename, std::ios::binary | std::ios::trunc);
+		junk << "not an index";
+	}
+	root_die junked(fileno(in), root_die::MAP_FILE);
+	assert(!junked.load_incremental_index(filename));
+	unlink(filename.c_str());
+	return 0;
+}
@@ -0,0 +1,88 @@
+#undef NDEBUG // assert is part of our logic
+#include <iostream>
+#include <vector>
+#include <dwarfpp/lib.hpp>
+#include <dwarfpp/attr.hpp>
+
+using std::cout;
+using std::endl;
+using std::string;
+using std::vector;
+using namespace dwarf;
+using namespace dwarf::core;
+
+static encap::attribute_map& attrs_of(iterator_base& i)
+{ return dynamic_cast<in_memory_abstract_die&>(i.dereference()).attrs(); }
+
+static iterator_base make_code(root_die& r, iterator_base& parent, Dwarf_Half tag,
+	Dwarf_Addr lo, Dwarf_Addr hi, iterator_base *p_origin = nullptr, unsigned call_line = 0)
+{
+	auto d = r.make_new(parent, tag);
+	attrs_of(d).insert(make_pair(DW_AT_low_pc, encap::attribute_value(encap::attribute_value::address(lo))));
+	attrs_of(d).insert(make_pair(DW_AT_high_pc, encap::attribute_value((Dwarf_Unsigned) (hi - lo))));
+	if (p_origin) attrs_of(d).insert(make_pair(DW_AT_abstract_origin, encap::attribute_value(
+		encap::attribute_value::weak_ref(r, p_origin->offset_here(), true, d.offset_here(), DW_AT_abstract_origin))));
+	if (call_line)
+	{
+		attrs_of(d).insert(make_pair(DW_AT_call_file, encap::attribute_value((Dwarf_Unsigned) 1)));
+		attrs_of(d).insert(make_pair(DW_AT_call_line, encap::attribute_value((Dwarf_Unsigned) call_line)));
+	}
+	return d;
+}
+
+int main(int argc, char **argv)
+{
+	in_memory_root_die r;
+	auto cu = r.get_or_create_synthetic_cu();
+	auto g = r.make_new(cu, DW_TAG_subprogram);
+	attrs_of(g).insert(make_pair(DW_AT_name, encap::attribute_value(string("g"))));
+	/* f inlines g twice over, once with a block in between. */
+	auto f = make_code(r, cu, DW_TAG_subprogram, 0x1000, 0x1100);
+	auto a = make_code(r, f, DW_TAG_inlined_subroutine, 0x1010, 0x1080, &g, 10);
+	auto block = make_code(r, a, DW_TAG_lexical_block, 0x1020, 0x1060);
+	auto b = make_code(r, block, DW_TAG_inlined_subroutine, 0x1030, 0x1040, &g, 20);
+	auto c = make_code(r, a, DW_TAG_inlined_subroutine, 0x1060, 0x1070, &g, 30);
+	auto d = make_code(r, f, DW_TAG_inlined_subroutine, 0x1090, 0x10a0, nullptr, 40);
+	iterator_base *all[] = { &a, &b, &c, &d };
+
+	auto t = r.inline_tree(f);
+	assert(t && t->frames.size() == 4);
+	assert(r.inline_tree(f) == t);
+	assert(!r.inline_tree(cu));
+	vector<const inline_tree_index::frame *> found;
+	assert(t->find(0x1035, found) == 2);
+	assert(found[0]->off == a.offset_here() && found[1]->off == b.offset_here());
+	assert(found[1]->origin == g.offset_here() && found[1]->call_line == 20 && found[1]->call_file == 1);
+	found.clear();
+	assert(t->find(0x1065, found) == 2 && found[1]->off == c.offset_here());
+	found.clear();
+	assert(t->find(0x1095, found) == 1 && found[0]->origin == 0 && found[0]->call_line == 40);
+	found.clear();
+	assert(t->find(0x1085, found) == 0 && t->find(0xfff, found) == 0 && t->find(0x10a0, found) == 0);
+
+	/* Every pc gets what a walk over all the frames would give it. */
+	for (Dwarf_Addr pc = 0x1000; pc < 0x1100; ++pc)
+	{
+		found.clear();
+		t->find(pc, found);
+		unsigned j = 0;
+		for (unsigned i = 0; i < 4; ++i)
+		{
+			Dwarf_Addr lo = all[i]->attr(DW_AT_low_pc).get_address().addr;
+			Dwarf_Addr hi = lo + all[i]->attr(DW_AT_high_pc).get_unsigned();
+			if (pc < lo || pc >= hi) continue;
+			assert(j < found.size() && found[j]->off == all[i]->offset_here());
+			++j;
+		}
+		assert(j == found.size());
+	}
+
+	/* A new inlined subroutine drops the tree. */
+	auto e = make_code(r, d, DW_TAG_inlined_subroutine, 0x1098, 0x109c, &g, 50);
+	auto t2 = r.inline_tree(f);
+	assert(t2 != t && t2->frames.size() == 5);
+	found.clear();
+	assert(t2->find(0x1099, found) == 2 && found[1]->off == e.offset_here());
+	cout << "Indexed " << t2->frames.size() << " inlined frames" << endl;
+	return 0;
+}
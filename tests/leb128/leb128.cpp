@@ -0,0 +1,77 @@
+#undef NDEBUG // assert is part of our logic
+#include <iostream>
+#include <string>
+#include <cstdlib>
+#include <cassert>
+#include <dwarfpp/leb128.hpp>
+
+using std::cout;
+using std::endl;
+using std::string;
+using namespace dwarf::core;
+
+static const unsigned char *bytes(const string& s) { return (const unsigned char *) s.data(); }
+
+int main(int argc, char **argv)
+{
+	/* The spec's examples. */
+	string two = string("\x02", 1), big = string("\x7f\x80\x01", 3), neg = string("\x7f", 1);
+	const unsigned char *p = bytes(two);
+	unsigned long long u;
+	long long s;
+	assert(read_uleb128(p, p + 1, &u) && u == 2 && p == bytes(two) + 1);
+	p = bytes(big);
+	assert(read_uleb128(p, p + 3, &u) && u == 127 && p == bytes(big) + 1);
+	assert(read_uleb128(p, bytes(big) + 3, &u) && u == 128 && p == bytes(big) + 3);
+	p = bytes(neg);
+	assert(read_sleb128(p, p + 1, &s) && s == -1);
+
+	/* Running into the end is an error, and reads nothing. */
+	string cut = string("\x80\x80\x80", 3);
+	p = bytes(cut);
+	assert(!read_uleb128(p, p + 3, &u) && p == bytes(cut));
+	assert(!read_sleb128(p, p, &s) && p == bytes(cut));
+
+	/* Round trips, at every length, with and without room for the
+	 * word-at-a-time path. */
+	srand(42);
+	unsigned n = 0;
+	for (unsigned i = 0; i < 100000; ++i)
+	{
+		unsigned nbits = rand() % 65;
+		unsigned long long v = ((unsigned long long) rand() << 42)
+			^ ((unsigned long long) rand() << 21) ^ rand() ^ ((unsigned long long) rand() << 63);
+		if (nbits < 64) v &= (1ull << nbits) - 1;
+		long long sv = (nbits == 0 || nbits == 64) ? (long long) v
+			: (long long) (v << (64 - nbits)) >> (64 - nbits);
+		string enc;
+		write_uleb128(enc, v);
+		write_sleb128(enc, sv);
+		enc += string(rand() % 10, (char) 0xff);
+		p = bytes(enc);
+		const unsigned char *end = p + enc.size();
+		assert(read_uleb128(p, end, &u) && u == v);
+		assert(read_sleb128(p, end, &s) && s == sv);
+		const unsigned char *junk = p;
+		assert(!read_uleb128(p, end, &u) && p == junk);
+		++n;
+	}
+
+	/* Runs of numbers, including eight one-byte ones at a time. */
+	string run;
+	for (unsigned i = 0; i < 40; ++i) write_uleb128(run, (i % 9 == 0) ? 1000 * i : i);
+	unsigned long long out[41];
+	p = bytes(run);
+	assert(read_uleb128s(p, bytes(run) + run.size(), out, 41) == 40);
+	assert(p == bytes(run) + run.size());
+	for (unsigned i = 0; i < 40; ++i) assert(out[i] == ((i % 9 == 0) ? 1000 * i : i));
+	string srun;
+	for (int i = -20; i < 20; ++i) write_sleb128(srun, i * 37);
+	long long sout[40];
+	p = bytes(srun);
+	assert(read_sleb128s(p, bytes(srun) + srun.size(), sout, 40) == 40);
+	for (int i = -20; i < 20; ++i) assert(sout[i + 20] == i * 37);
+
+	cout << "Round-tripped " << n << " pairs of LEB128 numbers" << endl;
+	return 0;
+}
@@ -0,0 +1,83 @@
+#undef NDEBUG // assert is part of our logic
+#include <fstream>
+#include <fileno.hpp>
+#include <dwarfpp/lib.hpp>
+#include <dwarfpp/die-reader.hpp>
+
+using std::cout;
+using std::endl;
+using std::vector;
+using std::string;
+using namespace dwarf;
+
+struct seen
+{
+	Dwarf_Off off;
+	Dwarf_Half tag;
+	unsigned depth;
+	string name;
+	bool operator==(const seen& s) const
+	{ return off == s.off && tag == s.tag && depth == s.depth && name == s.name; }
+};
+
+static vector<seen> walk(dwarf::core::root_die& r)
+{
+	vector<seen> v;
+	for (auto i = r.begin(); i != r.end(); ++i)
+	{
+		auto name = i.name_view_here();
+		v.push_back((seen) { i.offset_here(), i.tag_here(), i.depth(),
+			name.data() ? string(name.data(), name.size()) : string("(none)") });
+	}
+	return v;
+}
+
+int main(int argc, char **argv)
+{
+	using namespace dwarf::core;
+
+	// using our own debug info...
+	std::ifstream in(argv[0]);
+	assert(in);
+	root_die libdwarf_root(fileno(in));
+	vector<seen> expected = walk(libdwarf_root);
+
+	root_die r(fileno(in));
+	bool ok = r.set_reader(root_die::LIBDW_READER);
+#if !HAVE_LIBDW
+	assert(!ok);
+	assert(r.get_reader() == root_die::LIBDWARF_READER);
+	cout << "Not built with libdw" << endl;
+	return 0;
+#else
+	/* Unlike the native reader, libdw doesn't need an image. */
+	assert(ok);
+	assert(r.get_reader() == root_die::LIBDW_READER);
+	assert(!r.get_native_reader());
+	assert(r.get_die_reader()->unit_count() > 0);
+	vector<seen> got = walk(r);
+	assert(got == expected);
+	cout << "Walked " << got.size() << " DIEs with libdw" << endl;
+
+	/* From an image, libdw reads the image's Elf. */
+	root_die mapped(fileno(in), root_die::MAP_FILE);
+	ok = mapped.set_reader(root_die::LIBDW_READER);
+	assert(ok);
+	assert(walk(mapped) == expected);
+
+	/* Attributes still work, by asking libdwarf. */
+	iterator_df<subprogram_die> i_main = iterator_base::END;
+	for (auto i = r.begin(); i != r.end(); ++i)
+	{
+		if (i.tag_here() == DW_TAG_subprogram && i.name_here() && *i.name_here() == "main"
+			&& i.has_attr_here(DW_AT_low_pc)) { i_main = i.as_a<subprogram_die>(); break; }
+	}
+	assert(i_main);
+	assert(i_main->get_low_pc());
+
+	ok = r.set_reader(root_die::LIBDWARF_READER);
+	assert(ok);
+	assert(walk(r) == expected);
+	return 0;
+#endif
+}
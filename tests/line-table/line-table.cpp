@@ -0,0 +1,53 @@
+#undef NDEBUG // assert is part of our logic
+#include <fstream>
+#include <fileno.hpp>
+#include <dwarfpp/lib.hpp>
+
+using std::cout;
+using std::endl;
+using std::vector;
+using namespace dwarf;
+
+int main(int argc, char **argv)
+{
+	using namespace dwarf::core;
+
+	// using our own debug info...
+	std::ifstream in(argv[0]);
+	assert(in);
+	root_die r(fileno(in));
+	bool built = r.build_line_index();
+	assert(built);
+
+	/* Our main() should start on a line of this file, with a lower line
+	 * number than its body. */
+	iterator_df<subprogram_die> i_main = iterator_base::END;
+	for (auto i = r.begin(); i != r.end(); ++i)
+	{
+		if (i.tag_here() == DW_TAG_subprogram && i.name_here() && *i.name_here() == "main"
+			&& i.has_attr(DW_AT_low_pc)) { i_main = i.as_a<subprogram_die>(); break; }
+	}
+	assert(i_main);
+	Dwarf_Addr main_pc = i_main->get_low_pc()->addr;
+	const line_table::row *p_row = r.pc_to_line(main_pc);
+	assert(p_row);
+	assert(r.line_file_name(p_row->file).find("line-table.cpp") != std::string::npos);
+	assert(i_main->get_decl_line() && p_row->line >= *i_main->get_decl_line());
+	cout << "main() starts at " << r.line_file_name(p_row->file) << ":" << p_row->line << endl;
+
+	/* The CU's own table agrees with the index. */
+	auto p_t = i_main.enclosing_cu()->get_line_table();
+	assert(p_t);
+	const line_table::row *p_cu_row = p_t->find(main_pc);
+	assert(p_cu_row && p_cu_row->file == p_row->file && p_cu_row->line == p_row->line);
+
+	/* Batched lookups agree with one-at-a-time ones. */
+	vector<Dwarf_Addr> pcs;
+	for (Dwarf_Addr pc = main_pc - 64; pc < main_pc + 256; pc += 3) pcs.push_back(pc);
+	vector<const line_table::row *> rows;
+	r.pc_to_line(pcs, rows);
+	assert(rows.size() == pcs.size());
+	for (unsigned i = 0; i < pcs.size(); ++i) assert(rows[i] == r.pc_to_line(pcs[i]));
+	assert(!r.pc_to_line(0));
+	return 0;
+}
@@ -0,0 +1,61 @@
+#undef NDEBUG // assert is part of our logic
+#include <fstream>
+#include <vector>
+#include <fileno.hpp>
+#include <dwarfpp/lib.hpp>
+
+using std::cout;
+using std::endl;
+using std::string;
+using std::vector;
+using namespace dwarf;
+
+/* The slow way, for comparison. */
+static core::iterator_base linear_named_child(const core::iterator_base& start, const string& name)
+{
+	auto children = start.children_here();
+	for (auto i = std::move(children.first); i != children.second; ++i)
+	{
+		if (i.name_here() && *i.name_here() == name) return std::move(i);
+	}
+	return core::iterator_base::END;
+}
+
+int main(int argc, char **argv)
+{
+	using namespace dwarf::core;
+
+	// using our own debug info...
+	std::ifstream in(argv[0]);
+	assert(in);
+	root_die r(fileno(in));
+
+	/* Our CU has namespace dwarf { namespace core { struct root_die ... } }. */
+	vector<string> path = { "dwarf", "core", "root_die" };
+	iterator_base found = iterator_base::END;
+	auto cus = r.begin().children_here();
+	for (auto i_cu = std::move(cus.first); i_cu != cus.second && !found; ++i_cu)
+	{
+		found = r.resolve(i_cu, path.begin(), path.end());
+		if (!found) continue;
+		/* Each step agrees with a linear search, and asking twice (now
+		 * from the index) gives the same again. */
+		iterator_base cur = i_cu;
+		for (auto i_name = path.begin(); i_name != path.end(); ++i_name)
+		{
+			iterator_base slow = linear_named_child(cur, *i_name);
+			assert(slow);
+			assert(cur.named_child(*i_name).offset_here() == slow.offset_here());
+			assert(cur.named_child(*i_name).offset_here() == slow.offset_here());
+			cur = slow;
+		}
+		assert(cur.offset_here() == found.offset_here());
+		/* Absent names are absent. */
+		assert(!cur.named_child("no_such_member_of_root_die"));
+		assert(!r.resolve(i_cu, string("no_such_thing_anywhere")));
+	}
+	assert(found);
+	assert(found.tag_here() == DW_TAG_structure_type || found.tag_here() == DW_TAG_class_type);
+	cout << "Resolved dwarf::core::root_die at 0x" << std::hex << found.offset_here() << std::dec << endl;
+	return 0;
+}
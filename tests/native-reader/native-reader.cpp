@@ -0,0 +1,71 @@
+#undef NDEBUG // assert is part of our logic
+#include <fstream>
+#include <fileno.hpp>
+#include <dwarfpp/lib.hpp>
+#include <dwarfpp/native-reader.hpp>
+
+using std::cout;
+using std::endl;
+using std::vector;
+using std::string;
+using namespace dwarf;
+
+struct seen
+{
+	Dwarf_Off off;
+	Dwarf_Half tag;
+	unsigned depth;
+	string name;
+	bool operator==(const seen& s) const
+	{ return off == s.off && tag == s.tag && depth == s.depth && name == s.name; }
+};
+
+static vector<seen> walk(dwarf::core::root_die& r)
+{
+	vector<seen> v;
+	for (auto i = r.begin(); i != r.end(); ++i)
+	{
+		auto name = i.name_view_here();
+		v.push_back((seen) { i.offset_here(), i.tag_here(), i.depth(),
+			name.data() ? string(name.data(), name.size()) : string("(none)") });
+	}
+	return v;
+}
+
+int main(int argc, char **argv)
+{
+	using namespace dwarf::core;
+
+	// using our own debug info...
+	std::ifstream in(argv[0]);
+	assert(in);
+	root_die libdwarf_root(fileno(in));
+	assert(libdwarf_root.get_reader() == root_die::LIBDWARF_READER);
+	/* Without an image, there's nothing for our reader to read. */
+	assert(!libdwarf_root.set_reader(root_die::NATIVE_READER));
+	vector<seen> expected = walk(libdwarf_root);
+
+	root_die r(fileno(in), root_die::MAP_FILE);
+	bool ok = r.set_reader(root_die::NATIVE_READER);
+	assert(ok);
+	assert(r.get_native_reader()->unit_count() > 0);
+	vector<seen> got = walk(r);
+	assert(got == expected);
+	cout << "Walked " << got.size() << " DIEs natively" << endl;
+
+	/* Attributes still work, by asking libdwarf. */
+	iterator_df<subprogram_die> i_main = iterator_base::END;
+	for (auto i = r.begin(); i != r.end(); ++i)
+	{
+		if (i.tag_here() == DW_TAG_subprogram && i.name_here() && *i.name_here() == "main"
+			&& i.has_attr_here(DW_AT_low_pc)) { i_main = i.as_a<subprogram_die>(); break; }
+	}
+	assert(i_main);
+	assert(i_main->get_low_pc());
+
+	/* We can switch back. */
+	ok = r.set_reader(root_die::LIBDWARF_READER);
+	assert(ok);
+	assert(walk(r) == expected);
+	return 0;
+}
@@ -0,0 +1,72 @@
+#undef NDEBUG // assert is part of our logic
+#include <fstream>
+#include <cstdlib>
+#include <unistd.h>
+#include <fileno.hpp>
+#include <dwarfpp/lib.hpp>
+
+using std::cout;
+using std::endl;
+using namespace dwarf;
+
+struct my_root_die : public core::root_die
+{
+	using root_die::root_die;
+	unordered_map<Dwarf_Off, Dwarf_Off>& get_parent_of() { return this->parent_of; }
+	unordered_map<Dwarf_Off, Dwarf_Off>& get_next_sibling_of() { return this->next_sibling_of; }
+};
+
+int main(int argc, char **argv)
+{
+	using namespace dwarf::core;
+
+	// using our own debug info...
+	std::ifstream in(argv[0]);
+	assert(in);
+	std::ifstream in2(argv[0]);
+	assert(in2);
+	std::ifstream in3(argv[0]);
+	assert(in3);
+	string dir = getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp";
+
+	my_root_die r(fileno(in));
+	if (!r.get_build_id())
+	{
+		cout << "No build-id, so nothing to test" << endl;
+		return 0;
+	}
+	cout << "Build-id is " << *r.get_build_id() << endl;
+	/* Walk the whole tree so that the caches are complete. */
+	unsigned count = 0;
+	Dwarf_Off last_off = 0;
+	for (auto i = r.begin(); i != r.end(); ++i, ++count) last_off = i.offset_here();
+	bool saved = r.save_nav_index(dir);
+	assert(saved);
+
+	/* A fresh root_die should be able to find the last DIE, and its parent,
+	 * without searching, because the index tells it everything. */
+	my_root_die r2(fileno(in2));
+	bool loaded = r2.load_nav_index(dir);
+	assert(loaded);
+	assert(r2.get_parent_of().size() == r.get_parent_of().size());
+	assert(r2.get_next_sibling_of().size() == r.get_next_sibling_of().size());
+	auto found = r2.find(last_off);
+	assert(found);
+	assert(found.depth() == r.find(last_off).depth());
+	assert(found.parent().offset_here() == r.find(last_off).parent().offset_here());
+	cout << "Round-tripped navigation index for " << count << " DIEs" << endl;
+
+	/* An index that says it's in the other byte order is refused. */
+	{
+		std::fstream f(*r.nav_index_filename(dir), std::ios::in | std::ios::out | std::ios::binary);
+		uint32_t swapped = 0x04030201;
+		f.seekp(16); // past the magic and the record sizes
+		f.write(reinterpret_cast<const char *>(&swapped), sizeof swapped);
+		assert(f);
+	}
+	my_root_die r3(fileno(in3));
+	assert(!r3.load_nav_index(dir));
+
+	unlink(r.nav_index_filename(dir)->c_str());
+	return 0;
+}
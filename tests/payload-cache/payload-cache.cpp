@@ -0,0 +1,75 @@
+#undef NDEBUG // assert is part of our logic
+#include <fstream>
+#include <fileno.hpp>
+#include <dwarfpp/lib.hpp>
+
+using std::cout;
+using std::endl;
+using namespace dwarf;
+
+int main(int argc, char **argv)
+{
+	using namespace dwarf::core;
+
+	// using our own debug info...
+	std::ifstream in(argv[0]);
+	assert(in);
+	struct my_root_die : public core::root_die
+	{
+		using root_die::root_die;
+		unordered_map<Dwarf_Off, basic_die* >& get_live_dies() { return this->live_dies; }
+	} r(fileno(in));
+
+	/* By default we keep nothing but the CUs. */
+	assert(!r.get_retention_policy().enabled());
+	for (auto i = r.begin(); i != r.end(); ++i) if (i.tag_here() != DW_TAG_compile_unit) (void) *i;
+	unsigned n_cus = r.get_live_dies().size();
+	assert(r.retained_payload_count() == 0);
+
+	/* Keep 64, but never any formal parameters. */
+	payload_retention_policy pol;
+	pol.max_payloads = 64;
+	pol.tag_priorities[DW_TAG_formal_parameter] = 0;
+	pol.tag_priorities[DW_TAG_subprogram] = 2;
+	bool ok = r.set_retention_policy(pol);
+	assert(ok);
+	Dwarf_Off last_subprogram = 0;
+	for (auto i = r.begin(); i != r.end(); ++i)
+	{
+		if (i.tag_here() == DW_TAG_compile_unit) continue;
+		(void) *i; // make a payload
+		if (i.tag_here() == DW_TAG_subprogram) last_subprogram = i.offset_here();
+	}
+	assert(last_subprogram);
+	cout << "Retained " << r.retained_payload_count() << " payloads ("
+		<< r.retained_payload_bytes() << " bytes)" << endl;
+	assert(r.retained_payload_count() <= 64);
+	assert(r.get_live_dies().size() == n_cus + r.retained_payload_count());
+	for (auto i_live = r.get_live_dies().begin(); i_live != r.get_live_dies().end(); ++i_live)
+	{
+		assert(i_live->second->get_tag() != DW_TAG_formal_parameter);
+	}
+
+	/* The most recent subprogram outranks everything else, so it survives,
+	 * and we get the same payload back. */
+	auto found = r.get_live_dies().find(last_subprogram);
+	assert(found != r.get_live_dies().end());
+	basic_die *p_kept = found->second;
+	auto again = r.pos(last_subprogram);
+	assert(&again.dereference() == p_kept);
+
+	/* A byte limit too small for any payload keeps none. */
+	pol.max_payloads = 0;
+	pol.max_bytes = 1;
+	ok = r.set_retention_policy(pol);
+	assert(ok);
+	assert(r.retained_payload_count() == 0);
+	assert(r.retained_payload_bytes() == 0);
+
+	/* Disabling drops everything, so only the CUs (and our iterator's
+	 * payload) are live. */
+	ok = r.set_retention_policy(payload_retention_policy());
+	assert(ok);
+	assert(r.get_live_dies().size() <= n_cus + 1);
+	return 0;
+}
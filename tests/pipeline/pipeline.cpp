@@ -0,0 +1,84 @@
+#undef NDEBUG // assert is part of our logic
+#include <fstream>
+#include <vector>
+#include <mutex>
+#include <algorithm>
+#include <fileno.hpp>
+#include <dwarfpp/lib.hpp>
+#include <dwarfpp/pipeline.hpp>
+
+using std::cout;
+using std::endl;
+using std::vector;
+using namespace dwarf;
+
+int main(int argc, char **argv)
+{
+	using namespace dwarf::core;
+
+	// using our own debug info...
+	std::ifstream in(argv[0]);
+	assert(in);
+	root_die r(fileno(in));
+
+	/* What a plain walk sees: named subprograms with a low pc. */
+	vector<Dwarf_Off> expected;
+	for (auto i = r.begin(); i != r.end(); ++i)
+	{
+		if (i.tag_here() == DW_TAG_subprogram && i.has_attr_here(DW_AT_low_pc)
+			&& i.name_here()) expected.push_back(i.offset_here());
+	}
+	assert(!expected.empty());
+
+	/* Unfrozen, it all happens here, in order. */
+	vector<Dwarf_Off> seen;
+	unsigned long n = die_pipeline(r)
+		.with_tag(DW_TAG_subprogram)
+		.with_attr(DW_AT_low_pc)
+		.with([](const iterator_base& i) { return (bool) i.name_here(); })
+		.batch_size(7)
+		.run([&seen](const vector<die_view>& batch) {
+			assert(!batch.empty() && batch.size() <= 7);
+			for (auto i_v = batch.begin(); i_v != batch.end(); ++i_v)
+			{
+				assert(i_v->tag == DW_TAG_subprogram);
+				seen.push_back(i_v->off);
+			}
+		});
+	assert(n == expected.size());
+	assert(seen == expected);
+
+	/* Frozen, several threads at each end; batches come in any order. */
+	root_die frozen(fileno(in));
+	bool ok = frozen.preload(2) && frozen.freeze();
+	assert(ok);
+	std::mutex m;
+	vector<Dwarf_Off> seen_threaded;
+	n = die_pipeline(frozen)
+		.with_tag(DW_TAG_subprogram)
+		.with_attr(DW_AT_low_pc)
+		.with([](const iterator_base& i) { return (bool) i.name_here(); })
+		.batch_size(3)
+		.queue_depth(2)
+		.run([&](const vector<die_view>& batch) {
+			for (auto i_v = batch.begin(); i_v != batch.end(); ++i_v)
+			{
+				/* Consumers may go back to the root. */
+				assert(frozen.pos(i_v->off).tag_here() == DW_TAG_subprogram);
+				if (i_v != batch.begin()) assert(i_v->off > (i_v - 1)->off);
+			}
+			std::lock_guard<std::mutex> lock(m);
+			for (auto i_v = batch.begin(); i_v != batch.end(); ++i_v) seen_threaded.push_back(i_v->off);
+		}, 3, 2);
+	assert(n == expected.size());
+	std::sort(seen_threaded.begin(), seen_threaded.end());
+	assert(seen_threaded == expected);
+
+	/* No filters: every DIE, CUs included. */
+	unsigned long n_all = 0;
+	for (auto i = r.begin(); i != r.end(); ++i) if (i.depth() >= 1) ++n_all;
+	assert(die_pipeline(frozen).run([](const vector<die_view>&) {}, 4) == n_all);
+
+	cout << "Pipeline saw " << n << " of " << n_all << " DIEs" << endl;
+	return 0;
+}
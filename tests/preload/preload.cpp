@@ -0,0 +1,56 @@
+#undef NDEBUG // assert is part of our logic
+#include <fstream>
+#include <fileno.hpp>
+#include <dwarfpp/lib.hpp>
+
+using std::cout;
+using std::endl;
+using namespace dwarf;
+
+struct my_root_die : public core::root_die
+{
+	using root_die::root_die;
+	unordered_map<Dwarf_Off, Dwarf_Off>& get_parent_of() { return this->parent_of; }
+	unordered_map<Dwarf_Off, Dwarf_Off>& get_first_child_of() { return this->first_child_of; }
+	unordered_map<Dwarf_Off, Dwarf_Off>& get_next_sibling_of() { return this->next_sibling_of; }
+};
+
+int main(int argc, char **argv)
+{
+	using namespace dwarf::core;
+
+	// using our own debug info...
+	std::ifstream in(argv[0]);
+	assert(in);
+	std::ifstream in2(argv[0]);
+	assert(in2);
+
+	/* The serial walk fills the caches... */
+	my_root_die r(fileno(in));
+	unsigned count = 0;
+	for (auto i = r.begin(); i != r.end(); ++i, ++count);
+
+	/* ... and a parallel preload should give us the same parent edges. */
+	my_root_die r2(fileno(in2));
+	bool ok = r2.preload(4);
+	assert(ok);
+	// the serial walk doesn't record the root itself
+	assert(r2.get_parent_of().size() == count - 1);
+	for (auto i = r.get_parent_of().begin(); i != r.get_parent_of().end(); ++i)
+	{
+		auto found = r2.get_parent_of().find(i->first);
+		assert(found != r2.get_parent_of().end());
+		assert(found->second == i->second);
+	}
+	for (auto i = r.get_first_child_of().begin(); i != r.get_first_child_of().end(); ++i)
+	{
+		assert(r2.get_first_child_of()[i->first] == i->second);
+	}
+	/* Navigating a preloaded root should just work. */
+	unsigned count2 = 0;
+	for (auto i = r2.begin(); i != r2.end(); ++i, ++count2);
+	assert(count2 == count);
+	cout << "Preloaded " << count << " DIEs" << endl;
+
+	return 0;
+}
@@ -0,0 +1,66 @@
+#undef NDEBUG // assert is part of our logic
+#include <fstream>
+#include <fileno.hpp>
+#include <dwarfpp/lib.hpp>
+#include <dwarfpp/native-reader.hpp>
+
+using std::cout;
+using std::endl;
+using std::vector;
+using std::pair;
+using std::make_pair;
+using namespace dwarf;
+
+static vector<pair<Dwarf_Off, unsigned> > walk(dwarf::core::root_die& r)
+{
+	vector<pair<Dwarf_Off, unsigned> > v;
+	for (auto i = r.begin(); i != r.end(); ++i) v.push_back(make_pair(i.offset_here(), i.depth()));
+	return v;
+}
+
+int main(int argc, char **argv)
+{
+	using namespace dwarf::core;
+
+	// using our own debug info...
+	std::ifstream in(argv[0]);
+	assert(in);
+	/* Copying sections leaves nothing to read ahead in. */
+	root_die copied(fileno(in));
+	assert(!copied.set_readahead(2));
+	assert(copied.get_readahead() == 0);
+	auto expected = walk(copied);
+
+	/* Reading ahead changes nothing about what we see, with libdwarf... */
+	root_die r(fileno(in), root_die::MAP_FILE);
+	assert(r.set_readahead(2));
+	assert(r.get_readahead() == 2);
+	assert(walk(r) == expected);
+	assert(r.readahead_call_count() > 0);
+	assert(r.readahead_byte_count() > 0);
+	cout << "With libdwarf, read ahead " << r.readahead_byte_count() << " bytes in "
+		<< r.readahead_call_count() << " calls" << endl;
+
+	/* ... or with the native reader, which also finds the lists. */
+	root_die native(fileno(in), root_die::MAP_FILE);
+	bool ok = native.set_reader(root_die::NATIVE_READER);
+	assert(ok);
+	auto p_reader = native.get_native_reader();
+	for (unsigned u = 0; u < p_reader->unit_count(); ++u)
+	{
+		native_reader::offset_span locs, ranges;
+		assert(p_reader->unit_list_offsets(u, &locs, &ranges));
+	}
+	assert(native.set_readahead(1));
+	assert(walk(native) == expected);
+	assert(native.readahead_call_count() > 0);
+	cout << "With the native reader, read ahead " << native.readahead_byte_count() << " bytes in "
+		<< native.readahead_call_count() << " calls" << endl;
+
+	/* Off is off. */
+	root_die off(fileno(in), root_die::MAP_FILE);
+	assert(off.set_readahead(0));
+	walk(off);
+	assert(off.readahead_call_count() == 0);
+	return 0;
+}
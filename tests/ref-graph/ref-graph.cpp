@@ -0,0 +1,70 @@
+#undef NDEBUG // assert is part of our logic
+#include <fstream>
+#include <fileno.hpp>
+#include <dwarfpp/lib.hpp>
+
+using std::cout;
+using std::endl;
+using std::map;
+using std::pair;
+using std::make_pair;
+using std::unordered_map;
+using namespace dwarf;
+
+int main(int argc, char **argv)
+{
+	using namespace dwarf::core;
+
+	// using our own debug info...
+	std::ifstream in(argv[0]);
+	assert(in);
+	root_die r(fileno(in), root_die::MAP_FILE);
+
+	ref_graph g;
+	bool ok = r.extract_ref_graph(g);
+	assert(ok);
+	assert(!g.dies.empty());
+	assert(g.parents.size() == g.dies.size());
+	assert(g.edge_begin.size() == g.dies.size() + 1);
+	assert(g.edge_begin.back() == g.edges.size());
+	assert(std::is_sorted(g.dies.begin(), g.dies.end()));
+
+	/* It's the same graph however many threads make it. */
+	ref_graph g1;
+	ok = r.extract_ref_graph(g1, 1);
+	assert(ok);
+	assert(g1.dies == g.dies && g1.parents == g.parents && g1.edge_begin == g.edge_begin);
+
+	/* It agrees with the slow way, and has every DIE a walk sees. */
+	unordered_map<Dwarf_Off, Dwarf_Off> parent_of;
+	map<pair<Dwarf_Off, Dwarf_Half>, Dwarf_Off> refers_to;
+	r.get_referential_structure(parent_of, refers_to);
+	unsigned n_dies = 0;
+	for (auto i = r.begin(); i != r.end(); ++i)
+	{
+		if (i.offset_here() == 0) continue; // the root
+		unsigned idx = g.index_of(i.offset_here());
+		assert(idx != ref_graph::NONE);
+		assert(g.parents[idx] == parent_of[i.offset_here()]);
+		++n_dies;
+	}
+	assert(n_dies == g.dies.size());
+	for (unsigned idx = 0; idx < g.dies.size(); ++idx)
+	{
+		auto edges = g.edges_of(idx);
+		for (auto p_e = edges.first; p_e != edges.second; ++p_e)
+		{
+			auto found = refers_to.find(make_pair(g.dies[idx], p_e->attr));
+			assert(found != refers_to.end());
+			assert(found->second == p_e->target);
+			assert(g.index_of(p_e->target) != ref_graph::NONE);
+		}
+	}
+	cout << "Reference graph has " << g.dies.size() << " DIEs and "
+		<< g.edges.size() << " edges" << endl;
+
+	/* Without an image, there's nothing to decode. */
+	root_die libdwarf_root(fileno(in));
+	assert(!libdwarf_root.extract_ref_graph(g));
+	return 0;
+}
@@ -0,0 +1,104 @@
+#undef NDEBUG // assert is part of our logic
+#include <iostream>
+#include <dwarfpp/lib.hpp>
+#include <dwarfpp/attr.hpp>
+
+using std::cout;
+using std::endl;
+using std::string;
+using namespace dwarf;
+using namespace dwarf::core;
+
+static encap::attribute_map& attrs_of(iterator_base& i)
+{ return dynamic_cast<in_memory_abstract_die&>(i.dereference()).attrs(); }
+
+static void set_type(root_die& r, iterator_base& d, iterator_base& t)
+{
+	attrs_of(d).insert(make_pair(DW_AT_type, encap::attribute_value(
+		encap::attribute_value::weak_ref(r, t.offset_here(), true, d.offset_here(), DW_AT_type))));
+}
+
+static iterator_base make_base(root_die& r, iterator_base& cu, const char *name,
+	Dwarf_Unsigned size, Dwarf_Unsigned encoding)
+{
+	auto t = r.make_new(cu, DW_TAG_base_type);
+	attrs_of(t).insert(make_pair(DW_AT_name, encap::attribute_value(string(name))));
+	attrs_of(t).insert(make_pair(DW_AT_byte_size, encap::attribute_value(size)));
+	attrs_of(t).insert(make_pair(DW_AT_encoding, encap::attribute_value(encoding)));
+	return t;
+}
+
+static iterator_base make_union(root_die& r, iterator_base& cu, const char *name,
+	const char **member_names, iterator_base *member_types, unsigned n)
+{
+	auto u = r.make_new(cu, DW_TAG_union_type);
+	attrs_of(u).insert(make_pair(DW_AT_name, encap::attribute_value(string(name))));
+	attrs_of(u).insert(make_pair(DW_AT_byte_size, encap::attribute_value((Dwarf_Unsigned) 4)));
+	for (unsigned i = 0; i < n; ++i)
+	{
+		auto m = r.make_new(u, DW_TAG_member);
+		attrs_of(m).insert(make_pair(DW_AT_name, encap::attribute_value(string(member_names[i]))));
+		set_type(r, m, member_types[i]);
+	}
+	return u;
+}
+
+int main(int argc, char **argv)
+{
+	in_memory_root_die r;
+	auto cu = r.get_or_create_synthetic_cu();
+	auto int_t = make_base(r, cu, "int", 4, DW_ATE_signed);
+	auto signed_int_t = make_base(r, cu, "signed int", 4, DW_ATE_signed);
+	auto unsigned_t = make_base(r, cu, "unsigned int", 4, DW_ATE_unsigned);
+	auto char_t = make_base(r, cu, "char", 1, DW_ATE_signed_char);
+	auto typedef_t = r.make_new(cu, DW_TAG_typedef);
+	attrs_of(typedef_t).insert(make_pair(DW_AT_name, encap::attribute_value(string("myint"))));
+	set_type(r, typedef_t, int_t);
+	/* One union, and another with the same member and one more. */
+	const char *names[] = { "a", "b" };
+	iterator_base u1_types[] = { int_t };
+	iterator_base u2_types[] = { signed_int_t, unsigned_t };
+	auto u1 = make_union(r, cu, "u1", names, u1_types, 1);
+	auto u2 = make_union(r, cu, "u2", names, u2_types, 2);
+	iterator_base ptrs[2];
+	iterator_base *pointees[] = { &u1, &char_t };
+	for (unsigned i = 0; i < 2; ++i)
+	{
+		ptrs[i] = r.make_new(cu, DW_TAG_pointer_type);
+		attrs_of(ptrs[i]).insert(make_pair(DW_AT_byte_size, encap::attribute_value((Dwarf_Unsigned) 8)));
+		set_type(r, ptrs[i], *pointees[i]);
+	}
+
+	/* Differently named but alike base types are compatible, unlike
+	 * different encodings or sizes; so are typedefs of them. */
+	assert(!int_t.as_a<type_die>()->equal(signed_int_t.as_a<type_die>(), {}));
+	assert(r.rep_compatible(int_t, signed_int_t));
+	assert(r.rep_compatible(typedef_t, signed_int_t));
+	assert(!r.rep_compatible(int_t, unsigned_t));
+	assert(!r.rep_compatible(int_t, char_t));
+	assert(r.have_canonical_type_table());
+	/* All pointers are compatible. */
+	assert(r.rep_compatible(ptrs[0], ptrs[1]));
+	assert(!r.rep_compatible(ptrs[0], int_t));
+	/* Extra members on the right are fine, but not on the left. */
+	assert(r.rep_compatible(u1, u2));
+	assert(!r.rep_compatible(u2, u1));
+	/* The type's own call agrees with the root's. */
+	assert(u1.as_a<type_die>()->is_rep_compatible(u2.as_a<type_die>()));
+	assert(typedef_t.as_a<type_die>()->is_rep_compatible(signed_int_t.as_a<type_die>()));
+	assert(!char_t.as_a<type_die>()->is_rep_compatible(int_t.as_a<type_die>()));
+
+	/* Answers survive a rebuild of the IDs they're remembered under. */
+	r.build_canonical_type_table();
+	assert(r.rep_compatible(u1, u2) && !r.rep_compatible(u2, u1));
+	assert(r.rep_compatible(typedef_t, int_t));
+	/* An edit forgets the answers involving the types it reaches: with
+	 * a second member like u2's, u1 has room for a u2. */
+	auto m = r.make_new(u1, DW_TAG_member);
+	attrs_of(m).insert(make_pair(DW_AT_name, encap::attribute_value(string("b"))));
+	set_type(r, m, unsigned_t);
+	assert(r.rep_compatible(u2, u1));
+	cout << "Checked rep-compatibility over " << r.canonical_type_count() - 1
+		<< " canonical types" << endl;
+	return 0;
+}
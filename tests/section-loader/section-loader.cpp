@@ -0,0 +1,64 @@
+#undef NDEBUG // assert is part of our logic
+#include <fstream>
+#include <cstdlib>
+#include <fileno.hpp>
+#include <dwarfpp/lib.hpp>
+#include <dwarfpp/section-loader.hpp>
+
+using std::cout;
+using std::endl;
+using std::vector;
+using std::string;
+using namespace dwarf;
+
+static vector<Dwarf_Off> all_offsets(dwarf::core::root_die& r)
+{
+	vector<Dwarf_Off> offs;
+	for (auto i = r.begin(); i != r.end(); ++i) offs.push_back(i.offset_here());
+	return offs;
+}
+
+int main(int argc, char **argv)
+{
+	using namespace dwarf::core;
+
+	// using our own (compressed) debug info...
+	std::ifstream in(argv[0]);
+	assert(in);
+	root_die copied(fileno(in));
+	vector<Dwarf_Off> expected = all_offsets(copied);
+	assert(expected.size() > 0);
+
+	char dir_template[] = "/tmp/dwarfpp-sections-XXXXXX";
+	char *dir = mkdtemp(dir_template);
+	assert(dir);
+	unsigned n_inflated;
+	{
+		root_die r(fileno(in), root_die::MAP_FILE, dir);
+		auto p_loader = r.get_section_loader();
+		assert(p_loader);
+		/* Nothing is inflated until we look. */
+		assert(!p_loader->is_loaded(".debug_info"));
+		assert(all_offsets(r) == expected);
+		assert(p_loader->is_loaded(".debug_info"));
+		n_inflated = p_loader->inflated_count();
+		assert(n_inflated > 0); // we were built with -gz
+		assert(p_loader->cache_hit_count() == 0);
+		/* We walked no location lists, so didn't need those. */
+		cout << "Inflated " << n_inflated << " sections; .debug_loc "
+			<< (p_loader->is_loaded(".debug_loc") ? "was" : "was not") << " among them" << endl;
+	}
+	{
+		/* A second open maps what the first inflated. */
+		root_die r(fileno(in), root_die::MAP_FILE, dir);
+		auto p_loader = r.get_section_loader();
+		assert(p_loader);
+		assert(all_offsets(r) == expected);
+		assert(p_loader->inflated_count() == 0);
+		assert(p_loader->cache_hit_count() == n_inflated);
+	}
+	string cmd = string("rm -rf ") + dir;
+	int ret = system(cmd.c_str());
+	assert(ret == 0);
+	return 0;
+}
@@ -0,0 +1,127 @@
+#undef NDEBUG // assert is part of our logic
+#include <fstream>
+#include <cstdlib>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <fileno.hpp>
+#include <dwarfpp/lib.hpp>
+
+using std::cout;
+using std::endl;
+using std::vector;
+using namespace dwarf;
+
+static vector<std::pair<Dwarf_Off, Dwarf_Half> > walk(dwarf::core::root_die& r)
+{
+	vector<std::pair<Dwarf_Off, Dwarf_Half> > v;
+	for (auto i = r.begin(); i != r.end(); ++i)
+	{
+		v.push_back(std::make_pair(i.offset_here(), i.tag_here()));
+	}
+	return v;
+}
+
+int main(int argc, char **argv)
+{
+	using namespace dwarf::core;
+
+	// using our own debug info...
+	std::ifstream in(argv[0]);
+	assert(in);
+	string dir = getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp";
+
+	root_die publisher(fileno(in));
+	if (!publisher.get_build_id())
+	{
+		cout << "No build-id, so nothing to test" << endl;
+		return 0;
+	}
+	bool ok = publisher.build_canonical_type_table(1);
+	assert(ok);
+	ok = publisher.publish_shared_index(dir);
+	assert(ok);
+
+	root_die r(fileno(in));
+	assert(!r.have_shared_index());
+	ok = r.attach_shared_index(dir);
+	assert(ok);
+	assert(r.have_shared_index());
+	assert(r.have_dense_nav());
+	assert(r.have_addr_index());
+	assert(r.have_canonical_type_table());
+	assert(r.canonical_type_count() == publisher.canonical_type_count());
+
+	/* Everything we look up in the mapping agrees with what was built. */
+	auto expected = walk(publisher);
+	assert(walk(r) == expected);
+	unsigned n_pcs = 0;
+	unsigned n_types = 0;
+	for (iterator_df<> i = publisher.begin(); i != publisher.end(); ++i)
+	{
+		if (i.is_a<type_die>())
+		{
+			assert(r.canonical_id(r.pos(i.offset_here())) == publisher.canonical_id(i));
+			++n_types;
+		}
+		if (i.tag_here() != DW_TAG_subprogram) continue;
+		auto lopc = i.as_a<subprogram_die>()->get_low_pc();
+		if (!lopc) continue;
+		iterator_base got = r.innermost_die_for_pc(lopc->addr);
+		iterator_base want = publisher.innermost_die_for_pc(lopc->addr);
+		assert(got && want && got.offset_here() == want.offset_here());
+		++n_pcs;
+	}
+	assert(n_pcs > 0 && n_types > 0);
+	const char *names[] = { "main", "unsigned int", "no such name, we hope" };
+	for (unsigned i = 0; i < sizeof names / sizeof names[0]; ++i)
+	{
+		assert(r.find_all_visible_grandchildren_named(names[i]).size()
+			== publisher.find_all_visible_grandchildren_named(names[i]).size());
+	}
+	assert(r.find_visible_grandchild_named("main"));
+	cout << "Looked up " << expected.size() << " DIEs, " << n_pcs << " pcs and "
+		<< n_types << " types in the shared index" << endl;
+
+	/* Republishing from an attached root gives the same answers. */
+	ok = r.publish_shared_index(dir);
+	assert(ok);
+	root_die r2(fileno(in));
+	ok = r2.attach_shared_index(dir);
+	assert(ok);
+	assert(walk(r2) == expected);
+	assert(r2.find_all_visible_grandchildren_named("main").size()
+		== publisher.find_all_visible_grandchildren_named("main").size());
+
+	/* Detaching leaves us to find things the slow way. */
+	r.detach_shared_index();
+	assert(!r.have_shared_index());
+	assert(!r.have_dense_nav());
+	assert(!r.have_addr_index());
+	assert(walk(r) == expected);
+	assert(r.find_visible_grandchild_named("main"));
+
+	/* We only attach files that nobody else could have written... */
+	string filename = *publisher.shared_index_filename(dir);
+	root_die r3(fileno(in));
+	chmod(filename.c_str(), 0664);
+	assert(!r3.attach_shared_index(dir));
+	chmod(filename.c_str(), 0644);
+	assert(r3.attach_shared_index(dir));
+	r3.detach_shared_index();
+	/* ... and whose counts add up, without overflowing: here we claim
+	 * 2^60 navigation records, just after the magic, the four record
+	 * sizes, the build-id length and the CU count. */
+	{
+		std::fstream f(filename, std::ios::in | std::ios::out | std::ios::binary);
+		assert(f);
+		uint64_t huge = (uint64_t) 1 << 60;
+		f.seekp(8 + 4 * sizeof (uint32_t) + 2 * sizeof (uint64_t));
+		f.write(reinterpret_cast<const char *>(&huge), sizeof huge);
+		assert(f);
+	}
+	assert(!r3.attach_shared_index(dir));
+	assert(walk(r3) == expected);
+
+	unlink(filename.c_str());
+	return 0;
+}
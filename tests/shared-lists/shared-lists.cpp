@@ -0,0 +1,78 @@
+#undef NDEBUG // assert is part of our logic
+#include <fstream>
+#include <fileno.hpp>
+#include <dwarfpp/lib.hpp>
+
+using std::cout;
+using std::endl;
+using namespace dwarf;
+
+/* Built with -O2, so that some locations here are loclists. */
+static int __attribute__((noinline)) churn(volatile int *p, int n)
+{
+	int acc = 0;
+	for (int i = 0; i < n; ++i) acc += p[i] * i;
+	*p = acc;
+	return acc + n;
+}
+
+int main(int argc, char **argv)
+{
+	using namespace dwarf::core;
+	volatile int xs[4] = { 1, 2, 3, 4 };
+	assert(churn(xs, 4) != 0);
+
+	// using our own debug info...
+	std::ifstream in(argv[0]);
+	assert(in);
+	root_die r(fileno(in));
+
+	/* Copies share the decoded list, and DIEs decoded again find the
+	 * list they decoded before. */
+	unsigned n_lists = 0, n_shared = 0;
+	for (auto i = r.begin(); i != r.end(); ++i)
+	{
+		encap::attribute_map first = i.copy_attrs();
+		encap::attribute_map second = i.copy_attrs();
+		for (auto i_a = first.begin(); i_a != first.end(); ++i_a)
+		{
+			if (!i_a->second.is_loclist() && !i_a->second.is_rangelist()) continue;
+			++n_lists;
+			encap::attribute_value copy = i_a->second;
+			const encap::attribute_value& again = second.find(i_a->first)->second;
+			assert(copy == i_a->second && again == i_a->second);
+			if (i_a->second.is_loclist())
+			{
+				assert(&copy.get_loclist() == &i_a->second.get_loclist());
+				if (&again.get_loclist() == &i_a->second.get_loclist()) ++n_shared;
+			}
+			else
+			{
+				assert(&copy.get_rangelist() == &i_a->second.get_rangelist());
+				if (&again.get_rangelist() == &i_a->second.get_rangelist()) ++n_shared;
+			}
+		}
+	}
+	cout << "Of " << n_lists << " decoded lists, " << n_shared
+		<< " came from the root's cache" << endl;
+	assert(n_shared > 0);
+	assert(r.get_cache_usage().lists > 0);
+
+	/* What's evicted stays alive while an attribute holds it. */
+	encap::attribute_map held;
+	for (auto i = r.begin(); i != r.end() && held.empty(); ++i)
+	{
+		encap::attribute_map attrs = i.copy_attrs();
+		for (auto i_a = attrs.begin(); i_a != attrs.end(); ++i_a)
+		{
+			if (i_a->second.is_loclist() || i_a->second.is_rangelist()) { held = attrs; break; }
+		}
+	}
+	assert(!held.empty());
+	encap::attribute_map copied = held;
+	r.set_cache_budget(1);
+	r.set_cache_budget(0);
+	assert(r.get_cache_usage().lists == 0);
+	assert(held == copied);
+	return 0;
+}
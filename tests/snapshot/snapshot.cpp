@@ -0,0 +1,115 @@
+#undef NDEBUG // assert is part of our logic
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <unistd.h>
+#include <strings.h>
+#include <dwarfpp/lib.hpp>
+#include <dwarfpp/attr.hpp>
+
+using std::cout;
+using std::endl;
+using std::string;
+using namespace dwarf;
+
+static string dump(core::root_die& r)
+{
+	std::ostringstream s;
+	for (auto i = r.begin(); i != r.end(); ++i)
+	{
+		if (i.is_root_position()) continue;
+		s << std::hex << i.offset_here() << " " << i.depth() << " " << i.tag_here()
+			<< " " << i.enclosing_cu_offset_here() << std::dec << endl;
+		auto attrs = i.copy_attrs();
+		attrs.print(s, 1);
+	}
+	return s.str();
+}
+
+int main(int argc, char **argv)
+{
+	using namespace dwarf::core;
+	in_memory_root_die r;
+	auto cu = r.get_or_create_synthetic_cu();
+	auto int_t = r.make_new(cu, DW_TAG_base_type);
+	auto& int_attrs = dynamic_cast<in_memory_abstract_die&>(int_t.dereference()).attrs();
+	int_attrs.insert(make_pair(DW_AT_name, encap::attribute_value(string("int"))));
+	int_attrs.insert(make_pair(DW_AT_byte_size, encap::attribute_value((Dwarf_Unsigned) 4)));
+	int_attrs.insert(make_pair(DW_AT_encoding, encap::attribute_value((Dwarf_Unsigned) DW_ATE_signed)));
+	auto s = r.make_new(cu, DW_TAG_structure_type);
+	auto& s_attrs = dynamic_cast<in_memory_abstract_die&>(s.dereference()).attrs();
+	s_attrs.insert(make_pair(DW_AT_name, encap::attribute_value(string("point"))));
+	for (unsigned i = 0; i < 2; ++i)
+	{
+		auto m = r.make_new(s, DW_TAG_member);
+		auto& m_attrs = dynamic_cast<in_memory_abstract_die&>(m.dereference()).attrs();
+		m_attrs.insert(make_pair(DW_AT_name, encap::attribute_value(string(i ? "y" : "x"))));
+		m_attrs.insert(make_pair(DW_AT_type, encap::attribute_value(
+			encap::attribute_value::weak_ref(r, int_t.offset_here(), true, m.offset_here(), DW_AT_type))));
+		m_attrs.insert(make_pair(DW_AT_data_member_location,
+			encap::attribute_value((Dwarf_Signed) (4 * i))));
+	}
+	auto v = r.make_new(cu, DW_TAG_variable);
+	auto& v_attrs = dynamic_cast<in_memory_abstract_die&>(v.dereference()).attrs();
+	v_attrs.insert(make_pair(DW_AT_name, encap::attribute_value(string("x")))); // pooled once
+	v_attrs.insert(make_pair(DW_AT_external, encap::attribute_value((Dwarf_Bool) 1)));
+	v_attrs.insert(make_pair(DW_AT_low_pc, encap::attribute_value(encap::attribute_value::address(0x1234))));
+	/* Blocks and lists are saved too, and a list shared by two
+	 * attributes is stored once. */
+	encap::loc_expr e((Dwarf_Unsigned[]) { DW_OP_addr, 0x1234 }, 0, 0);
+	auto loc = encap::attribute_value(encap::loclist(e));
+	v_attrs.insert(make_pair(DW_AT_location, loc));
+	v_attrs.insert(make_pair(DW_AT_const_value, encap::attribute_value(
+		std::vector<unsigned char>({ 1, 2, 3 }))));
+	auto cu2 = r.make_new(r.begin(), DW_TAG_compile_unit);
+	auto f = r.make_new(cu2, DW_TAG_subprogram);
+	auto& f_attrs = dynamic_cast<in_memory_abstract_die&>(f.dereference()).attrs();
+	f_attrs.insert(make_pair(DW_AT_frame_base, loc));
+	encap::rangelist ranges;
+	lib::Dwarf_Ranges range;
+	bzero(&range, sizeof range);
+	range.dwr_addr1 = 0x2000;
+	range.dwr_addr2 = 0x2010;
+	ranges.push_back(range);
+	f_attrs.insert(make_pair(DW_AT_ranges, encap::attribute_value(ranges)));
+	string before = dump(r);
+	cout << before;
+
+	string filename = string(argv[0]) + ".snapshot";
+	bool saved = r.save_snapshot(filename);
+	assert(saved);
+
+	/* Same offsets, tags, structure and attributes. */
+	in_memory_root_die loaded;
+	bool ok = loaded.load_snapshot(filename);
+	assert(ok);
+	assert(dump(loaded) == before);
+	assert(loaded.get_or_create_synthetic_cu().offset_here() == cu.offset_here());
+	/* References point into the new root. */
+	auto found_m = loaded.find(s.offset_here()).children_here().first;
+	assert(found_m.name_here() && *found_m.name_here() == "x");
+	auto t = found_m.copy_attrs().find(DW_AT_type)->second.get_ref();
+	assert(t.p_root == &loaded && t.off == int_t.offset_here());
+	/* Attributes are read from the mapping, until an edit copies them. */
+	auto& found_v = dynamic_cast<in_memory_abstract_die&>(loaded.find(v.offset_here()).dereference());
+	assert(found_v.p_restored);
+	auto found_loc = found_v.attr_value(DW_AT_location).get_loclist();
+	assert(found_loc.size() == 1 && found_loc[0].size() == 2
+		&& found_loc[0][0].lr_atom == DW_OP_addr && found_loc[0][1].lr_number == 0x1234);
+	assert(*found_v.attr_value(DW_AT_const_value).get_block() == std::vector<unsigned char>({ 1, 2, 3 }));
+	auto found_ranges = loaded.find(f.offset_here()).copy_attrs().find(DW_AT_ranges)->second.get_rangelist();
+	assert(found_ranges.size() == 1 && found_ranges[0].dwr_addr1 == 0x2000 && found_ranges[0].dwr_addr2 == 0x2010);
+	found_v.attrs().insert(make_pair(DW_AT_declaration, encap::attribute_value((Dwarf_Bool) 1)));
+	assert(!found_v.p_restored);
+	assert(found_v.has_attr(DW_AT_declaration) && found_v.has_attr(DW_AT_location));
+	assert(*found_v.get_name() == "x");
+	/* We can carry on building. */
+	auto more = loaded.make_new(loaded.find(cu2.offset_here()), DW_TAG_variable);
+	assert(more.offset_here() > cu2.offset_here());
+	/* Loading twice would clobber our own DIEs. */
+	ok = loaded.load_snapshot(filename);
+	assert(!ok);
+
+	unlink(filename.c_str());
+	return 0;
+}
@@ -0,0 +1,107 @@
+#undef NDEBUG // assert is part of our logic
+#include <fstream>
+#include <map>
+#include <fileno.hpp>
+#include <dwarfpp/lib.hpp>
+
+using std::cout;
+using std::endl;
+using std::vector;
+using std::string;
+using namespace dwarf;
+
+static vector<vector<opt<string> > > all_paths(dwarf::core::root_die& r)
+{
+	using namespace dwarf::core;
+	vector<vector<opt<string> > > out;
+	auto cus = r.begin().children_here();
+	for (auto i_cu = std::move(cus.first); i_cu != cus.second; ++i_cu)
+	{
+		auto cu = i_cu.as_a<compile_unit_die>();
+		out.push_back(vector<opt<string> >());
+		for (unsigned o = cu->source_file_base(); o < cu->source_file_base() + cu->source_file_count(); ++o)
+		{
+			out.back().push_back(cu->source_file_fq_pathname(o));
+		}
+	}
+	return out;
+}
+
+int main(int argc, char **argv)
+{
+	using namespace dwarf::core;
+
+	/* Paths are made absolute as dirname(3) would. */
+	assert(*source_file_table::fq_pathname(opt<string>("/a/b/c"), "../../d.c") == "/a/d.c");
+	assert(*source_file_table::fq_pathname(opt<string>("/a"), "../d.c") == "//d.c");
+	assert(*source_file_table::fq_pathname(opt<string>(), "/x/d.c") == "/x/d.c");
+	assert(!source_file_table::fq_pathname(opt<string>(), "d.c"));
+
+	// using our own debug info...
+	std::ifstream in(argv[0]);
+	assert(in);
+	root_die r(fileno(in));
+	iterator_df<subprogram_die> i_main = iterator_base::END;
+	for (auto i = r.begin(); i != r.end(); ++i)
+	{
+		if (i.tag_here() == DW_TAG_subprogram && i.name_here() && *i.name_here() == "main"
+			&& i.has_attr(DW_AT_decl_file)) { i_main = i.as_a<subprogram_die>(); break; }
+	}
+	assert(i_main);
+
+	/* The CU decodes its table once, and a decl_file is one lookup. */
+	auto cu = i_main.enclosing_cu();
+	auto p_files = cu->get_source_files();
+	assert(p_files && p_files == cu->get_source_files());
+	assert(p_files->names.size() == p_files->paths.size());
+	assert(p_files->first_fileno == cu->source_file_base());
+	if (p_files->first_fileno > 0) assert(p_files->path_id(0) == source_file_table::NONE);
+	assert(p_files->path_id(p_files->first_fileno + p_files->paths.size()) == source_file_table::NONE);
+	unsigned id = p_files->path_id(*i_main->get_decl_file());
+	assert(id != source_file_table::NONE);
+	const string& path = r.line_file_name(id);
+	assert(path[0] == '/' && path.find("source-files.cpp") != string::npos);
+	assert(*cu->source_file_fq_pathname(*i_main->get_decl_file()) == path);
+	cout << "main() is declared in " << path << endl;
+
+	/* A declaration's name is on its decl_line in its decl_file, for
+	 * most of them anyway (macros and the like aside). Counting from
+	 * the wrong file number, as with DWARF 5's counting from 0, would
+	 * find the wrong file for most, even though main() might still come
+	 * out right, since a DWARF 5 table can list this file twice. */
+	std::map<string, vector<string> > lines_of;
+	unsigned n_decls = 0, n_found = 0;
+	for (auto i = r.begin(); i != r.end() && n_decls < 2000; ++i)
+	{
+		if (i.enclosing_cu_offset_here() != cu.offset_here() || !i.name_here()
+			|| i.name_here()->find('<') != string::npos) continue; // not spelt so in the source
+		auto i_pe = i.as_a<program_element_die>();
+		if (!i_pe || !i_pe->get_decl_file() || !i_pe->get_decl_line()
+			|| (i_pe->get_artificial() && *i_pe->get_artificial())) continue;
+		opt<string> decl_path = cu->source_file_fq_pathname(*i_pe->get_decl_file());
+		if (!decl_path) continue;
+		auto found = lines_of.find(*decl_path);
+		if (found == lines_of.end())
+		{
+			found = lines_of.insert(make_pair(*decl_path, vector<string>())).first;
+			std::ifstream src(*decl_path);
+			for (string line; std::getline(src, line); ) found->second.push_back(line);
+		}
+		if (found->second.empty()) continue; // not on this machine
+		++n_decls;
+		unsigned lineno = *i_pe->get_decl_line();
+		if (lineno > 0 && lineno <= found->second.size()
+			&& found->second[lineno - 1].find(*i.name_here()) != string::npos) ++n_found;
+	}
+	assert(n_decls > 0 && n_found * 3 >= n_decls * 2);
+	cout << n_found << " of " << n_decls << " declarations are where their decl_file says" << endl;
+
+	/* A frozen root with no tables goes the slow way, and agrees. */
+	auto with_tables = all_paths(r);
+	root_die r_frozen(fileno(in));
+	bool ok = r_frozen.preload(1) && r_frozen.freeze();
+	assert(ok);
+	assert(!r_frozen.begin().children_here().first.as_a<compile_unit_die>()->get_source_files());
+	assert(all_paths(r_frozen) == with_tables);
+	return 0;
+}
@@ -0,0 +1,41 @@
+#undef NDEBUG // assert is part of our logic
+#include <cstring>
+#include <dwarfpp/lib.hpp>
+
+using std::cout;
+using std::endl;
+using namespace dwarf::spec;
+
+int main(int argc, char **argv)
+{
+	/* Every name maps to its value and back. */
+	const name_table& attrs = dwarf4_t::attr_forward_map;
+	for (unsigned i = 0; i < attrs.n_entries; ++i)
+	{
+		assert(dwarf4.attr_for_name(attrs.entries[i].first) == attrs.entries[i].second);
+		assert(0 == strcmp(dwarf4.attr_lookup(attrs.entries[i].second), attrs.entries[i].first));
+	}
+	const name_table& ops = dwarf4_t::op_forward_map;
+	for (unsigned i = 0; i < ops.n_entries; ++i)
+	{
+		assert(dwarf4.op_for_name(ops.entries[i].first) == ops.entries[i].second);
+	}
+	assert(dwarf4.tag_for_name("DW_TAG_subprogram") == DW_TAG_subprogram);
+	assert(0 == strcmp(dwarf4.form_lookup(DW_FORM_strp), "DW_FORM_strp"));
+
+	/* Misses fall through to the empty def. */
+	assert(dwarf4.tag_for_name("DW_TAG_no_such_tag") == -1);
+	assert(dwarf4.attr_for_name("") == -1);
+	assert(0 == strcmp(dwarf4.op_lookup(0x7fff), "(unknown opcode)"));
+	assert(0 == strcmp(dwarf4.tag_lookup(-1), "(unknown tag)"));
+
+	/* The class tables still drive interpretation. */
+	assert(dwarf4.op_operand_count(DW_OP_bregx) == 2);
+	assert(dwarf4.op_operand_count(DW_OP_nop) == 0);
+	assert(dwarf4.get_interp(DW_AT_name, DW_FORM_strp) == interp::string);
+	assert(dwarf4.get_interp(DW_AT_location, DW_FORM_exprloc) == interp::exprloc);
+
+	cout << "Checked " << attrs.n_entries << " attribute and " << ops.n_entries
+		<< " opcode names" << endl;
+	return 0;
+}
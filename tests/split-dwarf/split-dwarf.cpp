@@ -0,0 +1,89 @@
+#undef NDEBUG // assert is part of our logic
+#include <fstream>
+#include <fileno.hpp>
+#include <dwarfpp/lib.hpp>
+
+using std::cout;
+using std::endl;
+using std::string;
+using namespace dwarf;
+
+int main(int argc, char **argv)
+{
+	using namespace dwarf::core;
+
+	// using our own debug info, which is split (see the Makefile)...
+	std::ifstream in(argv[0]);
+	assert(in);
+	root_die r(fileno(in));
+	/* No such package, so we fall back to the .dwo files. */
+	r.set_dwp_path("/nonexistent.dwp");
+
+	/* With the compiler's default DWARF version, that's a DWARF 5
+	 * skeleton unit, which has no name; its .dwo's CU has. */
+	iterator_df<compile_unit_die> our_cu = iterator_base::END;
+	iterator_df<compile_unit_die> full = iterator_base::END;
+	unsigned n_skeletons = 0;
+	auto cus = r.begin().children_here();
+	for (auto i_cu = std::move(cus.first); i_cu != cus.second; ++i_cu)
+	{
+		auto cu = i_cu.as_a<compile_unit_die>();
+		if (!cu || !r.is_skeleton(cu)) continue;
+		++n_skeletons;
+		auto split = r.split_unit(cu);
+		if (split && split.name_here() && split.name_here()->find("split-dwarf.cpp") != string::npos)
+		{ our_cu = cu; full = split; }
+	}
+	assert(our_cu);
+
+	/* The full unit is in a root of its own, and has our main() in it. */
+	assert(&full.get_root() != &r);
+	assert(full.tag_here() == DW_TAG_compile_unit);
+	/* Both halves have the DWO ID, whether in attributes or headers. */
+	assert(r.dwo_id(our_cu) && full.get_root().dwo_id(full) == r.dwo_id(our_cu));
+	iterator_df<subprogram_die> i_main = iterator_base::END;
+	auto children = full.children_here();
+	for (auto i = std::move(children.first); i != children.second; ++i)
+	{
+		if (i.tag_here() == DW_TAG_subprogram && i.name_here() && *i.name_here() == "main")
+		{ i_main = i.as_a<subprogram_die>(); break; }
+	}
+	assert(i_main);
+	cout << "Found main at 0x" << std::hex << i_main.offset_here() << std::dec
+		<< " in the .dwo" << endl;
+
+	/* Asking again gives the same root. */
+	assert(&r.split_unit(our_cu).get_root() == &full.get_root());
+
+	/* Prefetching finds at least ours; others may be from libraries
+	 * whose .dwos aren't here. */
+	root_die fresh(fileno(in));
+	unsigned n_found = fresh.prefetch_split_units(4);
+	assert(n_found >= 1 && n_found <= n_skeletons);
+	cout << "Prefetched " << n_found << " of " << n_skeletons << " split units" << endl;
+
+	/* Spliced, a walk of the whole tree goes into the split units, and
+	 * comes back out: main's parent is our skeleton. */
+	std::ifstream in2(argv[0]);
+	assert(in2);
+	root_die spliced(fileno(in2));
+	unsigned n_spliced = spliced.splice_split_units(4);
+	assert(n_spliced == n_found);
+	iterator_df<> spliced_main = iterator_base::END;
+	unsigned n_dies = 0;
+	unsigned n_cus_after = 0;
+	for (iterator_df<> i = spliced.begin(); i != iterator_base::END; ++i, ++n_dies)
+	{
+		if (spliced_main && i.depth() == 1) ++n_cus_after;
+		if (!spliced_main && i.tag_here() == DW_TAG_subprogram
+			&& i.name_here() && *i.name_here() == "main") spliced_main = i;
+	}
+	assert(spliced_main);
+	assert(&spliced_main.get_root() != &spliced);
+	auto spliced_parent = spliced_main.parent();
+	assert(&spliced_parent.get_root() == &spliced);
+	assert(spliced_parent.offset_here() == our_cu.offset_here());
+	cout << "Walked " << n_dies << " DIEs through " << n_spliced << " spliced units, "
+		<< n_cus_after << " CUs after ours" << endl;
+	return 0;
+}
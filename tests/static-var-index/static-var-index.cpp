@@ -0,0 +1,82 @@
+#undef NDEBUG // assert is part of our logic
+#include <fstream>
+#include <vector>
+#include <algorithm>
+#include <fileno.hpp>
+#include <dwarfpp/lib.hpp>
+
+using std::cout;
+using std::endl;
+using std::string;
+using std::vector;
+using namespace dwarf;
+
+/* Some statics of various sizes and scopes to find. */
+int static_we_should_find;
+char static_array[64];
+static struct { int a; double b; } static_pair = { 1, 2.0 };
+namespace ns { long static_in_namespace = 3; }
+static int *count_calls()
+{
+	static int calls;
+	++calls;
+	return &calls;
+}
+
+int main(int argc, char **argv)
+{
+	using namespace dwarf::core;
+
+	// using our own debug info...
+	std::ifstream in(argv[0]);
+	assert(in);
+	root_die r(fileno(in));
+	bool built = r.build_static_var_index();
+	assert(built && r.have_static_var_index());
+
+	/* Each of ours is at its DW_OP_addr, from its first byte to its last. */
+	vector<string> names = { "static_we_should_find", "static_array", "static_pair",
+		"static_in_namespace", "calls" };
+	vector<Dwarf_Addr> addrs;
+	unsigned n_found = 0;
+	for (auto i = r.begin(); i != r.end(); ++i)
+	{
+		if (i.tag_here() != DW_TAG_variable || !i.name_here()
+			|| std::find(names.begin(), names.end(), *i.name_here()) == names.end()) continue;
+		auto i_var = i.as_a<variable_die>();
+		auto compiled = i_var->get_compiled_location();
+		if (!compiled || compiled->entries.size() != 1
+			|| compiled->entries[0].expr.kind != expr::compiled_expr::ADDR) continue;
+		assert(i_var->has_static_storage());
+		Dwarf_Addr addr = compiled->entries[0].expr.offset;
+		Dwarf_Unsigned size = *i_var->find_type()->calculate_byte_size();
+		for (Dwarf_Off b : { (Dwarf_Unsigned) 0, size / 2, size - 1 })
+		{
+			Dwarf_Off within = (Dwarf_Off) -1;
+			auto found = r.static_var_for_addr(addr + b, &within);
+			assert(found);
+			assert(found.offset_here() == i.offset_here());
+			assert(within == b);
+		}
+		addrs.push_back(addr);
+		++n_found;
+	}
+	assert(n_found == names.size());
+	cout << "Found " << n_found << " statics by address" << endl;
+	/* Locals aren't statics, and nothing is at 0. */
+	assert(!r.static_var_for_addr(0));
+
+	/* A frozen root built with threads agrees. */
+	root_die frozen(fileno(in));
+	bool ok = frozen.preload(2) && frozen.freeze();
+	assert(ok);
+	built = frozen.build_static_var_index(4);
+	assert(built);
+	for (auto i_a = addrs.begin(); i_a != addrs.end(); ++i_a)
+	{
+		assert(frozen.static_var_for_addr(*i_a).offset_here()
+			== r.static_var_for_addr(*i_a).offset_here());
+	}
+	return static_pair.a + *count_calls() + static_array[0] + static_we_should_find
+		+ ns::static_in_namespace == 5 ? 0 : 1;
+}
@@ -0,0 +1,68 @@
+#undef NDEBUG // assert is part of our logic
+#include <fstream>
+#include <fileno.hpp>
+#include <dwarfpp/lib.hpp>
+#include <dwarfpp/native-reader.hpp>
+
+using std::cout;
+using std::endl;
+using std::vector;
+using std::pair;
+using std::make_pair;
+using namespace dwarf;
+
+static vector<pair<Dwarf_Off, unsigned> > walk(dwarf::core::root_die& r)
+{
+	vector<pair<Dwarf_Off, unsigned> > v;
+	for (auto i = r.begin(); i != r.end(); ++i) v.push_back(make_pair(i.offset_here(), i.depth()));
+	return v;
+}
+
+int main(int argc, char **argv)
+{
+	using namespace dwarf::core;
+
+	// using our own debug info...
+	std::ifstream in(argv[0]);
+	assert(in);
+	root_die libdwarf_root(fileno(in));
+	auto expected = walk(libdwarf_root);
+
+	/* The reader says where a subtree ends when we walk off its last
+	 * child, and that's where the parent's next sibling, if any, is. */
+	root_die r(fileno(in), root_die::MAP_FILE);
+	bool ok = r.set_reader(root_die::NATIVE_READER);
+	assert(ok);
+	auto p_reader = r.get_native_reader();
+	unsigned n_checked = 0;
+	for (unsigned u = 0; u < p_reader->unit_count(); ++u)
+	{
+		vector<Dwarf_Off> stack(1, p_reader->unit_die_offset(u));
+		while (!stack.empty())
+		{
+			Dwarf_Off parent = stack.back(); stack.pop_back();
+			Dwarf_Off last = die_reader::NONE;
+			for (Dwarf_Off c = p_reader->first_child(u, parent); c != die_reader::NONE;
+				c = p_reader->next_sibling(u, c))
+			{
+				stack.push_back(c);
+				last = c;
+			}
+			if (last == die_reader::NONE) continue;
+			Dwarf_Off end;
+			assert(p_reader->next_sibling_or_end(u, last, &end) == die_reader::NONE);
+			assert(end != die_reader::NONE && end > last);
+			if (parent == p_reader->unit_die_offset(u)) continue;
+			Dwarf_Off next = p_reader->next_sibling(u, parent);
+			assert(next == (p_reader->tag_at(u, end) ? end : die_reader::NONE));
+			++n_checked;
+		}
+	}
+	cout << "Checked the subtree ends of " << n_checked << " DIEs" << endl;
+
+	/* Walks that climb out of subtrees by those ends see what libdwarf does,
+	 * the second time from the recorded ends. */
+	assert(walk(r) == expected);
+	assert(walk(r) == expected);
+	return 0;
+}
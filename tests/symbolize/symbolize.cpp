@@ -0,0 +1,91 @@
+#undef NDEBUG // assert is part of our logic
+#include <fstream>
+#include <vector>
+#include <algorithm>
+#include <fileno.hpp>
+#include <dwarfpp/lib.hpp>
+
+using std::cout;
+using std::endl;
+using std::vector;
+using namespace dwarf;
+
+int main(int argc, char **argv)
+{
+	using namespace dwarf::core;
+
+	// using our own debug info...
+	std::ifstream in(argv[0]);
+	assert(in);
+	root_die r(fileno(in));
+
+	/* Every subprogram's entry point, plus one pc nothing covers, in
+	 * reverse order and with duplicates. */
+	vector<Dwarf_Addr> pcs;
+	vector<Dwarf_Off> subprograms;
+	vector<Dwarf_Off> cus;
+	for (auto i = r.begin(); i != r.end(); ++i)
+	{
+		if (i.tag_here() != DW_TAG_subprogram) continue;
+		if (!i.has_attr(DW_AT_low_pc) || !i.has_attr(DW_AT_high_pc)) continue;
+		auto high_pc = i.attr(DW_AT_high_pc);
+		Dwarf_Addr low_pc = i.attr(DW_AT_low_pc).get_address().addr;
+		if (high_pc.get_form() == encap::attribute_value::ADDR
+			? high_pc.get_address().addr == low_pc
+			: high_pc.get_unsigned() == 0) continue;
+		pcs.push_back(low_pc);
+		subprograms.push_back(i.offset_here());
+		cus.push_back(i.enclosing_cu_offset_here());
+	}
+	assert(!pcs.empty());
+	std::reverse(pcs.begin(), pcs.end());
+	std::reverse(subprograms.begin(), subprograms.end());
+	std::reverse(cus.begin(), cus.end());
+	pcs.push_back(pcs.front());
+	pcs.push_back(0);
+
+	root_die::symbolization s;
+	r.symbolize(pcs, s);
+	assert(s.pcs.size() == pcs.size());
+	for (unsigned i = 0; i < subprograms.size(); ++i)
+	{
+		const root_die::symbolized_pc& p = s.pcs[i];
+		assert(p.cu == cus[i]);
+		assert(p.subprogram == subprograms[i]);
+		for (unsigned j = 0; j < p.n_inlined; ++j)
+		{
+			assert(r.pos(s.inlined.at(p.first_inlined + j)).tag_here() == DW_TAG_inlined_subroutine);
+		}
+		/* It agrees with the one-at-a-time lookups. */
+		assert(p.line == r.pc_to_line(pcs[i]));
+	}
+	assert(s.pcs[subprograms.size()].subprogram == s.pcs[0].subprogram);
+	assert(s.pcs.back().cu == 0 && s.pcs.back().subprogram == 0 && s.pcs.back().n_inlined == 0);
+	cout << "Symbolized " << pcs.size() << " pcs" << endl;
+
+	/* Any run of pcs will do, e.g. part of a sample buffer. */
+	root_die::symbolization part;
+	r.symbolize(pcs.data() + 1, 2, part);
+	assert(part.pcs.size() == 2);
+	assert(part.pcs[0].subprogram == s.pcs[1].subprogram);
+	assert(part.pcs[1].line == s.pcs[2].line);
+
+	/* Frozen, we can use threads, and get the same answers. */
+	bool ok = r.preload(2) && r.freeze();
+	assert(ok);
+	root_die::symbolization s2;
+	r.symbolize(pcs, s2, 4);
+	assert(s2.pcs.size() == s.pcs.size());
+	for (unsigned i = 0; i < s.pcs.size(); ++i)
+	{
+		assert(s2.pcs[i].cu == s.pcs[i].cu);
+		assert(s2.pcs[i].subprogram == s.pcs[i].subprogram);
+		assert(s2.pcs[i].line == s.pcs[i].line);
+		assert(s2.pcs[i].n_inlined == s.pcs[i].n_inlined);
+		assert(std::equal(s.inlined.begin() + s.pcs[i].first_inlined,
+			s.inlined.begin() + s.pcs[i].first_inlined + s.pcs[i].n_inlined,
+			s2.inlined.begin() + s2.pcs[i].first_inlined));
+	}
+	r.thaw();
+	return 0;
+}
@@ -0,0 +1,56 @@
+#undef NDEBUG // assert is part of our logic
+#include <fstream>
+#include <fileno.hpp>
+#include <dwarfpp/lib.hpp>
+
+using std::cout;
+using std::endl;
+using namespace dwarf;
+
+template <typename Payload>
+static unsigned long check(core::iterator_df<> i)
+{
+	/* The tag table must agree with what the payload really is. */
+	Payload *p = dynamic_cast<Payload *>(&i.dereference());
+	assert(i.is_a<Payload>() == (p != nullptr));
+	if (!p) return 0;
+	auto i_cast = i.as_a<Payload>();
+	assert(i_cast && &*i_cast == p);
+	return 1;
+}
+
+int main(int argc, char **argv)
+{
+	using core::root_die;
+	std::ifstream in(argv[0]);
+	root_die r(fileno(in));
+
+	unsigned long n_dies = 0, n_types = 0, n_subprograms = 0, n_with_members = 0;
+	for (auto i = r.begin(); i != r.end(); ++i, ++n_dies)
+	{
+		n_types += check<core::type_die>(i);
+		n_subprograms += check<core::subprogram_die>(i);
+		n_with_members += check<core::with_data_members_die>(i);
+		check<core::program_element_die>(i);
+		assert(i.is_a<core::basic_die>());
+	}
+	assert(n_types > 0 && n_subprograms > 0 && n_with_members > 0);
+
+	/* Filtered and downcast children, in-memory ones included. */
+	auto i_cu = r.begin().children().first;
+	auto i_new = r.make_new(i_cu, DW_TAG_subprogram);
+	assert(i_new.is_a<core::subprogram_die>());
+	unsigned long n_seen = 0;
+	bool saw_new = false;
+	auto subps = i_cu.children().subseq_of<core::subprogram_die>();
+	for (auto i_subp = subps.first; i_subp != subps.second; ++i_subp, ++n_seen)
+	{
+		core::subprogram_die& d = *i_subp;
+		assert(d.get_tag() == DW_TAG_subprogram);
+		if (d.get_offset() == i_new.offset_here()) saw_new = true;
+	}
+	assert(saw_new);
+	cout << "Checked " << n_dies << " DIEs, " << n_subprograms << " subprograms and "
+		<< n_seen << " subprogram children of the first CU" << endl;
+	return 0;
+}
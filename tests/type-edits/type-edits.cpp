@@ -0,0 +1,100 @@
+#undef NDEBUG // assert is part of our logic
+#include <iostream>
+#include <dwarfpp/lib.hpp>
+#include <dwarfpp/attr.hpp>
+
+using std::cout;
+using std::endl;
+using std::string;
+using namespace dwarf;
+using namespace dwarf::core;
+
+static encap::attribute_map& attrs_of(iterator_base& i)
+{ return dynamic_cast<in_memory_abstract_die&>(i.dereference()).attrs(); }
+
+static void add_member(root_die& r, iterator_base& s, const char *name, iterator_base& t)
+{
+	auto m = r.make_new(s, DW_TAG_member);
+	attrs_of(m).insert(make_pair(DW_AT_name, encap::attribute_value(string(name))));
+	attrs_of(m).insert(make_pair(DW_AT_type, encap::attribute_value(
+		encap::attribute_value::weak_ref(r, t.offset_here(), true, m.offset_here(), DW_AT_type))));
+}
+
+int main(int argc, char **argv)
+{
+	in_memory_root_die r;
+	auto cu = r.get_or_create_synthetic_cu();
+	auto int_t = r.make_new(cu, DW_TAG_base_type);
+	attrs_of(int_t).insert(make_pair(DW_AT_name, encap::attribute_value(string("int"))));
+	attrs_of(int_t).insert(make_pair(DW_AT_byte_size, encap::attribute_value((Dwarf_Unsigned) 4)));
+	attrs_of(int_t).insert(make_pair(DW_AT_encoding, encap::attribute_value((Dwarf_Unsigned) DW_ATE_signed)));
+	/* Two equal structures, one different one, and a pointer to the first. */
+	iterator_base s[3];
+	for (unsigned i = 0; i < 3; ++i)
+	{
+		s[i] = r.make_new(cu, DW_TAG_structure_type);
+		attrs_of(s[i]).insert(make_pair(DW_AT_name, encap::attribute_value(string(i == 2 ? "t" : "s"))));
+		attrs_of(s[i]).insert(make_pair(DW_AT_byte_size, encap::attribute_value((Dwarf_Unsigned) 4)));
+		add_member(r, s[i], "a", int_t);
+	}
+	auto p = r.make_new(cu, DW_TAG_pointer_type);
+	attrs_of(p).insert(make_pair(DW_AT_byte_size, encap::attribute_value((Dwarf_Unsigned) 8)));
+	attrs_of(p).insert(make_pair(DW_AT_type, encap::attribute_value(
+		encap::attribute_value::weak_ref(r, s[0].offset_here(), true, p.offset_here(), DW_AT_type))));
+
+	/* Nothing's cached yet, so edits cost nothing. */
+	assert(r.invalidate_types_reaching(s[0].offset_here()) == 0);
+
+	iterator_df<type_die> t[3];
+	opt<uint32_t> codes[3];
+	for (unsigned i = 0; i < 3; ++i)
+	{
+		t[i] = s[i].as_a<type_die>();
+		codes[i] = t[i]->summary_code();
+		assert(codes[i]);
+	}
+	auto ptr = p.as_a<type_die>();
+	ptr->summary_code();
+	assert(codes[0] == codes[1]);
+	assert(t[0]->equal(t[1], {}));
+	assert(!t[1]->equal(t[2], {}));
+
+	/* With a canonical table, the first two share an ID, and a layout. */
+	bool ok = r.build_canonical_type_table(1);
+	assert(ok);
+	opt<unsigned> id = r.canonical_id(s[0]);
+	assert(id && r.canonical_id(s[1]) == id);
+	assert(r.canonical_representative(*id).offset_here() == s[0].offset_here());
+	assert(r.layout_of(s[1]) == r.layout_of(s[0]) && r.layout_of(s[0])->n_members == 1);
+
+	/* Growing the first structure changes it and the pointer, but not
+	 * the others, nor the int they all use. */
+	add_member(r, s[0], "b", int_t);
+	assert(!t[0]->cached_summary_code);
+	assert(!ptr->cached_summary_code);
+	assert(t[1]->cached_summary_code && t[1]->cached_summary_code == codes[1]);
+	assert(t[2]->cached_summary_code && t[2]->cached_summary_code == codes[2]);
+	unsigned n = r.invalidate_types_reaching(s[0].children_here().first.offset_here());
+	cout << "Editing a member invalidated " << n << " types" << endl;
+	assert(n == 2);
+	/* The first has left its ID, which the second now represents, and
+	 * each has its own layout. */
+	assert(!r.canonical_id(s[0]));
+	assert(r.canonical_id(s[1]) == id);
+	assert(r.canonical_representative(*id).offset_here() == s[1].offset_here());
+	assert(r.layout_of(s[0])->n_members == 2 && r.layout_of(s[1])->n_members == 1);
+
+	/* What we knew about the others still holds, and the first is
+	 * worked out afresh. */
+	assert(!t[0]->equal(t[1], {}));
+	assert(!t[1]->equal(t[2], {}));
+	assert(t[0]->summary_code() != codes[1]);
+	assert(t[1]->summary_code() == codes[1]);
+
+	/* Edits outside the types touch nothing. */
+	auto v = r.make_new(cu, DW_TAG_variable);
+	attrs_of(v).insert(make_pair(DW_AT_name, encap::attribute_value(string("v"))));
+	assert(r.invalidate_types_reaching(v.offset_here()) == 0);
+	assert(t[1]->cached_summary_code);
+	return 0;
+}
@@ -0,0 +1,83 @@
+#undef NDEBUG // assert is part of our logic
+#include <fstream>
+#include <cstddef>
+#include <fileno.hpp>
+#include <dwarfpp/lib.hpp>
+
+using std::cout;
+using std::endl;
+using std::string;
+using namespace dwarf;
+
+/* Something with nesting, a union, bitfields, an array and padding. */
+struct inner
+{
+	short s;
+	int i;
+};
+struct laid_out
+{
+	char c;
+	struct inner in;
+	union { long l; char bytes[12]; } u;
+	unsigned flag : 1;
+	unsigned level : 5;
+	double ds[3];
+} an_instance;
+
+int main(int argc, char **argv)
+{
+	using namespace dwarf::core;
+
+	// using our own debug info...
+	std::ifstream in(argv[0]);
+	assert(in);
+	root_die r(fileno(in));
+
+	iterator_df<type_die> t = iterator_base::END;
+	for (auto i = r.begin(); i != r.end(); ++i)
+	{
+		if (i.tag_here() == DW_TAG_structure_type && i.name_here()
+			&& *i.name_here() == "laid_out") { t = i.as_a<type_die>(); break; }
+	}
+	assert(t);
+	auto p_layout = r.layout_of(t);
+	assert(p_layout);
+	assert(p_layout->byte_size && *p_layout->byte_size == sizeof (laid_out));
+	/* Asking again gives the same layout. */
+	assert(r.layout_of(t) == p_layout);
+	/* Only aggregates have one. */
+	assert(!r.layout_of(r.find(p_layout->fields[0].type)));
+
+	auto name_at = [&r, &p_layout](Dwarf_Unsigned off) -> string {
+		const type_layout::field *p_f = p_layout->find(off);
+		if (!p_f) return string();
+		auto name = r.pos(p_f->member).name_here();
+		return name ? *name : string("(anonymous)");
+	};
+	assert(name_at(offsetof(laid_out, c)) == "c");
+	/* Padding after c is in no member. */
+	assert(offsetof(laid_out, in) == 1 || name_at(1) == "");
+	/* Nested members are found, not just their container. */
+	assert(name_at(offsetof(laid_out, in) + offsetof(inner, s)) == "s");
+	assert(name_at(offsetof(laid_out, in) + offsetof(inner, i) + 3) == "i");
+	/* In the union, past the long, only the array covers. */
+	assert(name_at(offsetof(laid_out, u) + sizeof (long) + 1) == "bytes");
+	assert(name_at(offsetof(laid_out, ds) + sizeof (double) * 2 + 7) == "ds");
+	assert(name_at(sizeof (laid_out)) == "");
+
+	/* The bitfields share a byte, so they're told apart by bits. */
+	unsigned n_bitfields = 0;
+	for (auto i_f = p_layout->fields.begin(); i_f != p_layout->fields.end(); ++i_f)
+	{
+		if (!i_f->bit_size) continue;
+		++n_bitfields;
+		string name = *r.pos(i_f->member).name_here();
+		assert(i_f->bit_size == (name == "flag" ? 1 : 5));
+		if (name == "level") assert(i_f->bit_offset == 1);
+		assert(i_f->depth == 0 && i_f->parent == type_layout::NONE);
+	}
+	assert(n_bitfields == 2);
+	cout << "Laid out " << p_layout->fields.size() << " fields of laid_out" << endl;
+	return an_instance.c;
+}
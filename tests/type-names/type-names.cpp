@@ -0,0 +1,80 @@
+#undef NDEBUG // assert is part of our logic
+#include <fstream>
+#include <fileno.hpp>
+#include <dwarfpp/lib.hpp>
+
+using std::cout;
+using std::endl;
+using std::string;
+using namespace dwarf;
+
+/* Some named types to find. */
+struct plain { int x; } a_plain;
+namespace ns
+{
+	template <typename T> struct Bar { T val; };
+	Bar<int> a_bar;
+	struct outer { struct nested { char c; } n; } an_outer;
+	union un { int i; float f; } a_un;
+	enum colour { RED, GREEN } a_colour;
+}
+typedef struct plain plain_t;
+plain_t a_plain_t;
+
+int main(int argc, char **argv)
+{
+	using namespace dwarf::core;
+
+	// using our own debug info...
+	std::ifstream in(argv[0]);
+	assert(in);
+	root_die r(fileno(in));
+
+	auto check = [&r](const string& query, Dwarf_Half tag, const string& name) {
+		iterator_base found = r.type_named(query);
+		assert(found);
+		assert(found.tag_here() == tag);
+		assert(found.name_here() && *found.name_here() == name);
+		assert(!found.has_attr(DW_AT_declaration));
+		return found;
+	};
+	check("struct plain", DW_TAG_structure_type, "plain");
+	check("plain", DW_TAG_structure_type, "plain");
+	check("plain_t", DW_TAG_typedef, "plain_t");
+	iterator_base bar = check("ns::Bar<int>", DW_TAG_structure_type, "Bar<int>");
+	check("class ns::Bar<int>", DW_TAG_structure_type, "Bar<int>");
+	iterator_base nested = check("ns::outer::nested", DW_TAG_structure_type, "nested");
+	check("union ns::un", DW_TAG_union_type, "un");
+	check("enum ns::colour", DW_TAG_enumeration_type, "colour");
+	check("int", DW_TAG_base_type, "int");
+	/* Wrong kind, wrong scope or no such thing. */
+	assert(!r.type_named("union plain"));
+	assert(!r.type_named("Bar<int>"));
+	assert(!r.type_named("ns::no_such_type"));
+	/* Names go back the other way. */
+	assert(r.qualified_type_name(bar) == "ns::Bar<int>");
+	assert(r.qualified_type_name(nested) == "ns::outer::nested");
+
+	/* Every declared struct we have either has no definition, or its
+	 * definition is like-named and not a declaration. */
+	unsigned n_decls = 0;
+	unsigned n_defined = 0;
+	for (auto i = r.begin(); i != r.end(); ++i)
+	{
+		if (i.tag_here() != DW_TAG_structure_type && i.tag_here() != DW_TAG_class_type) continue;
+		if (!i.has_attr(DW_AT_declaration) || !i.name_here()) continue;
+		++n_decls;
+		iterator_base def = i.as_a<with_data_members_die>()->find_definition();
+		if (!def) continue;
+		++n_defined;
+		assert(*def.name_here() == *i.name_here());
+		assert(!def.has_attr(DW_AT_declaration));
+	}
+	cout << "Found definitions for " << n_defined << " of " << n_decls
+		<< " declared structs" << endl;
+
+	/* With canonical IDs, the copies of a type count once. */
+	r.build_canonical_type_table();
+	assert(r.type_named_all(DW_TAG_structure_type, "plain").size() == 1);
+	return a_plain.x + a_bar.val + an_outer.n.c + a_un.i + a_colour + a_plain_t.x;
+}
@@ -0,0 +1,54 @@
+#undef NDEBUG // assert is part of our logic
+#include <fstream>
+#include <fileno.hpp>
+#include <dwarfpp/lib.hpp>
+#include <dwarfpp/type-registry.hpp>
+
+using std::cout;
+using std::endl;
+using namespace dwarf;
+
+int main(int argc, char **argv)
+{
+	using namespace dwarf::core;
+
+	/* Load our own debug info twice, as if it were two binaries.
+	 * Every type should get the same ID in both. */
+	std::ifstream in1(argv[0]);
+	std::ifstream in2(argv[0]);
+	assert(in1 && in2);
+	root_die r1(fileno(in1));
+	root_die r2(fileno(in2));
+	type_registry reg;
+	unsigned n1 = reg.add_root(r1);
+	unsigned n2 = reg.add_root(r2);
+	assert(n1 == 0 && n2 == 1);
+	assert(reg.add_root(r1) == n1);
+	bool ok = reg.build(2);
+	assert(ok);
+	// the roots are identical, so every local ID has a partner in the other
+	assert(reg.size() == r1.canonical_type_count());
+
+	unsigned count = 0;
+	unsigned matched = 0;
+	for (iterator_df<> i = r1.begin(); i != r1.end(); ++i)
+	{
+		if (!i.is_a<type_die>()) continue;
+		auto t1 = i.as_a<type_die>();
+		auto t2 = r2.pos(i.offset_here()).as_a<type_die>();
+		opt<unsigned> id1 = reg.global_id(t1);
+		opt<unsigned> id2 = reg.global_id(t2);
+		assert(id1 && id2);
+		assert(reg.representative(*id1));
+		++count;
+		/* Anonymous types match too, even though their summary codes
+		 * differ. But two like-shaped types that r1 keeps apart (say, by
+		 * where they're declared) may both take the same ID in r2. */
+		if (*id1 == *id2) ++matched;
+		else assert(t1->equal(reg.representative(*id2), {}));
+	}
+	cout << "Matched " << matched << " of " << count << " types across roots; "
+		<< reg.size() - 1 << " global IDs" << endl;
+	assert(count > 0 && matched > 0);
+	return 0;
+}
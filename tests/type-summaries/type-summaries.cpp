@@ -0,0 +1,37 @@
+#undef NDEBUG // assert is part of our logic
+#include <fstream>
+#include <fileno.hpp>
+#include <dwarfpp/lib.hpp>
+
+using std::cout;
+using std::endl;
+using namespace dwarf;
+
+int main(int argc, char **argv)
+{
+	using namespace dwarf::core;
+
+	// using our own debug info...
+	std::ifstream in(argv[0]);
+	assert(in);
+	root_die bulk(fileno(in));
+	bool ok = compute_all_type_summaries(bulk, 4);
+	assert(ok);
+
+	/* The bulk codes should agree with the ones we compute one at a time. */
+	std::ifstream in2(argv[0]);
+	assert(in2);
+	root_die lazy(fileno(in2));
+	unsigned count = 0;
+	for (iterator_df<> i = lazy.begin(); i != lazy.end(); ++i)
+	{
+		if (!i.is_a<type_die>()) continue;
+		auto from_bulk = bulk.pos(i.offset_here()).as_a<type_die>();
+		assert(from_bulk);
+		assert(from_bulk->summary_code() == i.as_a<type_die>()->summary_code());
+		++count;
+	}
+	cout << "Checked summary codes of " << count << " types" << endl;
+	assert(count > 0);
+	return 0;
+}
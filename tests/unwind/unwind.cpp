@@ -0,0 +1,123 @@
+#undef NDEBUG // assert is part of our logic
+#include <fstream>
+#include <algorithm>
+#include <cstring>
+#include <fileno.hpp>
+#include <dwarfpp/lib.hpp>
+#include <dwarfpp/frame.hpp>
+#include <dwarfpp/unwind.hpp>
+
+using std::cout;
+using std::endl;
+using std::vector;
+using namespace dwarf;
+using dwarf::core::FrameSection;
+typedef FrameSection::register_def register_def;
+
+int main(int argc, char **argv)
+{
+	using namespace dwarf::core;
+
+	// using our own .eh_frame...
+	std::ifstream in(argv[0]);
+	assert(in);
+	root_die r(fileno(in));
+	FrameSection fs(r.get_dbg(), true);
+	unwinder u(fs);
+	const cfi_table& t = u.get_table();
+	assert(u.get_ra_regnum() != -1 && t.tracked_index(u.get_ra_regnum()));
+	unsigned word_size = fs.get_address_size();
+	assert(word_size <= sizeof (Dwarf_Unsigned));
+
+	/* A fake stack, in which no two words are alike and none is zero. */
+	const Dwarf_Addr stack_base = 0x100000;
+	vector<unsigned char> stack(4096);
+	for (unsigned i = 0; i + word_size <= stack.size(); i += word_size)
+	{
+		Dwarf_Unsigned w = stack_base + i + 1;
+		memcpy(&stack[i], &w, word_size);
+	}
+	captured_stack_reader mem(stack_base, stack.data(), stack.size());
+	auto word_at = [&](Dwarf_Addr addr, Dwarf_Unsigned *out) {
+		if (addr < stack_base || addr - stack_base + word_size > stack.size()) return false;
+		*out = 0;
+		memcpy(out, &stack[addr - stack_base], word_size);
+		return true;
+	};
+
+	/* Step out of the start of every decoded row whose CFA is a register
+	 * plus offset and whose return address is saved relative to it: the
+	 * caller's pc, CFA, stack pointer and saved registers must be what the
+	 * decoded rules say. Overlapping FDEs are left out, as one wins. */
+	vector<std::pair<Dwarf_Addr, Dwarf_Addr> > ranges;
+	for (auto i_fde = fs.fde_begin(); i_fde != fs.fde_end(); ++i_fde)
+	{
+		if (i_fde->get_func_length() == 0) continue;
+		ranges.push_back(std::make_pair(i_fde->get_low_pc(),
+			i_fde->get_low_pc() + i_fde->get_func_length()));
+	}
+	std::sort(ranges.begin(), ranges.end());
+	vector<unwinder::sample> samples;
+	vector<Dwarf_Addr> expected_pcs;
+	unsigned n_checked = 0;
+	for (auto i_fde = fs.fde_begin(); i_fde != fs.fde_end(); ++i_fde)
+	{
+		if (i_fde->get_func_length() == 0) continue;
+		Dwarf_Addr lo = i_fde->get_low_pc();
+		Dwarf_Addr hi = lo + i_fde->get_func_length();
+		unsigned n_covering = 0;
+		for (auto i_r = ranges.begin(); i_r != ranges.end() && i_r->first < hi; ++i_r)
+		{
+			if (i_r->second > lo) ++n_covering;
+		}
+		if (n_covering > 1) continue;
+		auto p_decoded = i_fde->decoded();
+		const FrameSection::instrs_results& d = *p_decoded;
+		for (auto i_row = d.rows.begin(); i_row != d.rows.end() && i_row->lo < hi; ++i_row)
+		{
+			auto p_cfa = d.find_rule(*i_row, DW_FRAME_CFA_COL3);
+			auto p_ra = d.find_rule(*i_row, u.get_ra_regnum());
+			if (!p_cfa || p_cfa->k != register_def::REGISTER) continue;
+			if (!p_ra || p_ra->k != register_def::SAVED_AT_OFFSET_FROM_CFA) continue;
+
+			frame_regs regs;
+			regs.pc = i_row->lo;
+			Dwarf_Addr frame_base = stack_base + stack.size() / 2;
+			regs.set(p_cfa->u.reg_plus_offset.reg, frame_base);
+			Dwarf_Addr cfa = frame_base + p_cfa->u.reg_plus_offset.offset;
+			Dwarf_Unsigned ra;
+			if (!word_at(cfa + p_ra->u.offset, &ra)) continue;
+
+			frame_regs caller = regs;
+			bool stepped = u.step(caller, mem, true);
+			assert(stepped);
+			assert(caller.pc == ra);
+			assert(caller.cfa == cfa);
+			if (u.get_sp_regnum() != -1) assert((Dwarf_Addr) caller.get(u.get_sp_regnum()) == cfa);
+			for (auto i_reg = t.tracked_regs.begin(); i_reg != t.tracked_regs.end(); ++i_reg)
+			{
+				auto p_rule = d.find_rule(*i_row, *i_reg);
+				Dwarf_Unsigned saved;
+				if (!p_rule || p_rule->k != register_def::SAVED_AT_OFFSET_FROM_CFA
+					|| !word_at(cfa + p_rule->u.offset, &saved)) continue;
+				assert(caller.has(*i_reg) && (Dwarf_Unsigned) caller.vals[*i_reg] == saved);
+			}
+			samples.push_back((unwinder::sample) { .regs = regs, .p_mem = &mem });
+			expected_pcs.push_back(ra);
+			++n_checked;
+		}
+	}
+	assert(n_checked > 0);
+
+	/* Unwinding them all at once, on several threads, agrees. */
+	auto results = u.unwind_all(samples, 2, 4);
+	assert(results.size() == samples.size());
+	for (unsigned i = 0; i < results.size(); ++i)
+	{
+		assert(results[i].size() >= 2);
+		assert(results[i][0] == samples[i].regs.pc);
+		assert(results[i][1] == expected_pcs[i]);
+	}
+	cout << "Checked " << n_checked << " steps against decoded CFI" << endl;
+	return 0;
+}